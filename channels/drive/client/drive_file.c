@@ -39,6 +39,9 @@
 #include <winpr/path.h>
 #include <winpr/file.h>
 #include <winpr/stream.h>
+#include <winpr/sysinfo.h>
+#include <winpr/interlocked.h>
+#include <winpr/collections.h>
 
 #include <freerdp/channels/rdpdr.h>
 
@@ -59,6 +62,226 @@
 	} while (0)
 #endif
 
+#define DRIVE_CACHE_TTL_MS 2000
+#define DRIVE_CACHE_MAX_ENTRIES 1024
+#define DRIVE_CACHE_MAX_LISTING 4096
+#define DRIVE_FILE_READAHEAD_SIZE (1024ull * 1024ull)
+
+struct s_drive_cache
+{
+	wHashTable* attributes; /* UTF-8 path -> DRIVE_CACHE_ATTRIBUTES */
+	wHashTable* listings;   /* UTF-8 search pattern -> DRIVE_CACHE_LISTING */
+	LONG generation;
+};
+
+typedef struct
+{
+	LONG generation;
+	UINT64 timestamp;
+	WIN32_FILE_ATTRIBUTE_DATA data;
+} DRIVE_CACHE_ATTRIBUTES;
+
+typedef struct
+{
+	LONG generation;
+	UINT64 timestamp;
+	size_t count;
+	WIN32_FIND_DATAW* entries;
+} DRIVE_CACHE_LISTING;
+
+static void drive_cache_listing_free(void* obj)
+{
+	DRIVE_CACHE_LISTING* listing = obj;
+	if (!listing)
+		return;
+	free(listing->entries);
+	free(listing);
+}
+
+static wHashTable* drive_cache_table_new(OBJECT_FREE_FN fnValueFree)
+{
+	wHashTable* table = HashTable_New(TRUE);
+	if (!table)
+		return nullptr;
+
+	if (!HashTable_SetHashFunction(table, HashTable_StringHash))
+		goto fail;
+
+	wObject* obj = HashTable_KeyObject(table);
+	obj->fnObjectEquals = HashTable_StringCompare;
+	obj->fnObjectNew = winpr_ObjectStringClone;
+	obj->fnObjectFree = winpr_ObjectStringFree;
+
+	obj = HashTable_ValueObject(table);
+	obj->fnObjectFree = fnValueFree;
+	return table;
+
+fail:
+	HashTable_Free(table);
+	return nullptr;
+}
+
+DRIVE_CACHE* drive_cache_new(void)
+{
+	DRIVE_CACHE* cache = (DRIVE_CACHE*)calloc(1, sizeof(DRIVE_CACHE));
+	if (!cache)
+		return nullptr;
+
+	cache->attributes = drive_cache_table_new(free);
+	cache->listings = drive_cache_table_new(drive_cache_listing_free);
+	if (!cache->attributes || !cache->listings)
+		goto fail;
+
+	return cache;
+
+fail:
+	drive_cache_free(cache);
+	return nullptr;
+}
+
+void drive_cache_free(DRIVE_CACHE* cache)
+{
+	if (!cache)
+		return;
+
+	HashTable_Free(cache->attributes);
+	HashTable_Free(cache->listings);
+	free(cache);
+}
+
+void drive_cache_invalidate(DRIVE_CACHE* cache)
+{
+	if (!cache)
+		return;
+
+	/* Entries of older generations are ignored and replaced on the next lookup */
+	(void)InterlockedIncrement(&cache->generation);
+}
+
+static LONG drive_cache_generation(DRIVE_CACHE* cache)
+{
+	WINPR_ASSERT(cache);
+	return InterlockedCompareExchange(&cache->generation, 0, 0);
+}
+
+static BOOL drive_cache_valid(DRIVE_CACHE* cache, LONG generation, UINT64 timestamp)
+{
+	if (generation != drive_cache_generation(cache))
+		return FALSE;
+	return (GetTickCount64() - timestamp) < DRIVE_CACHE_TTL_MS;
+}
+
+static BOOL drive_cache_insert(wHashTable* table, const char* key, void* value)
+{
+	if (HashTable_Count(table) >= DRIVE_CACHE_MAX_ENTRIES)
+		HashTable_Clear(table);
+
+	HashTable_Lock(table);
+	(void)HashTable_Remove(table, key);
+	const BOOL rc = HashTable_Insert(table, key, value);
+	HashTable_Unlock(table);
+	return rc;
+}
+
+static BOOL drive_cache_get_attributes(DRIVE_CACHE* cache, const WCHAR* path,
+                                       WIN32_FILE_ATTRIBUTE_DATA* data)
+{
+	WINPR_ASSERT(data);
+
+	if (!cache)
+		return GetFileAttributesExW(path, GetFileExInfoStandard, data);
+
+	char* key = ConvertWCharToUtf8Alloc(path, nullptr);
+	if (!key)
+		return GetFileAttributesExW(path, GetFileExInfoStandard, data);
+
+	BOOL found = FALSE;
+	HashTable_Lock(cache->attributes);
+	const DRIVE_CACHE_ATTRIBUTES* entry = HashTable_GetItemValue(cache->attributes, key);
+	if (entry && drive_cache_valid(cache, entry->generation, entry->timestamp))
+	{
+		*data = entry->data;
+		found = TRUE;
+	}
+	HashTable_Unlock(cache->attributes);
+
+	if (!found)
+	{
+		/* Read the generation first, a concurrent change must not be hidden by our result */
+		const LONG generation = drive_cache_generation(cache);
+		found = GetFileAttributesExW(path, GetFileExInfoStandard, data);
+		if (found)
+		{
+			DRIVE_CACHE_ATTRIBUTES* value = calloc(1, sizeof(DRIVE_CACHE_ATTRIBUTES));
+			if (value)
+			{
+				value->generation = generation;
+				value->timestamp = GetTickCount64();
+				value->data = *data;
+				if (!drive_cache_insert(cache->attributes, key, value))
+					free(value);
+			}
+		}
+	}
+
+	free(key);
+	return found;
+}
+
+static BOOL drive_cache_get_listing(DRIVE_CACHE* cache, const char* key, DRIVE_FILE* file)
+{
+	BOOL found = FALSE;
+
+	WINPR_ASSERT(file);
+
+	if (!cache || !key)
+		return FALSE;
+
+	HashTable_Lock(cache->listings);
+	const DRIVE_CACHE_LISTING* entry = HashTable_GetItemValue(cache->listings, key);
+	if (entry && drive_cache_valid(cache, entry->generation, entry->timestamp))
+	{
+		file->listing = calloc(entry->count, sizeof(WIN32_FIND_DATAW));
+		if (file->listing)
+		{
+			memcpy(file->listing, entry->entries, entry->count * sizeof(WIN32_FIND_DATAW));
+			file->listing_count = entry->count;
+			file->listing_index = 0;
+			found = TRUE;
+		}
+	}
+	HashTable_Unlock(cache->listings);
+	return found;
+}
+
+static void drive_cache_put_listing(DRIVE_CACHE* cache, const char* key, LONG generation,
+                                    const DRIVE_FILE* file)
+{
+	WINPR_ASSERT(file);
+
+	if (!cache || !key)
+		return;
+
+	DRIVE_CACHE_LISTING* value = calloc(1, sizeof(DRIVE_CACHE_LISTING));
+	if (!value)
+		return;
+
+	value->entries = calloc(file->listing_count, sizeof(WIN32_FIND_DATAW));
+	if (!value->entries)
+	{
+		drive_cache_listing_free(value);
+		return;
+	}
+
+	memcpy(value->entries, file->listing, file->listing_count * sizeof(WIN32_FIND_DATAW));
+	value->count = file->listing_count;
+	value->generation = generation;
+	value->timestamp = GetTickCount64();
+
+	if (!drive_cache_insert(cache->listings, key, value))
+		drive_cache_listing_free(value);
+}
+
 static BOOL drive_file_fix_path(WCHAR* path, size_t length)
 {
 	if ((length == 0) || (length > UINT32_MAX))
@@ -207,7 +430,11 @@ static BOOL drive_file_set_fullpath(DRIVE_FILE* file, const WCHAR* fullpath)
 static BOOL drive_file_init(DRIVE_FILE* file)
 {
 	UINT CreateDisposition = 0;
-	DWORD dwAttr = GetFileAttributesW(file->fullpath);
+	DWORD dwAttr = INVALID_FILE_ATTRIBUTES;
+	WIN32_FILE_ATTRIBUTE_DATA attributes = WINPR_C_ARRAY_INIT;
+
+	if (drive_cache_get_attributes(file->cache, file->fullpath, &attributes))
+		dwAttr = attributes.dwFileAttributes;
 
 	if (dwAttr != INVALID_FILE_ATTRIBUTES)
 	{
@@ -251,6 +478,7 @@ static BOOL drive_file_init(DRIVE_FILE* file)
 			{
 				if (CreateDirectoryW(file->fullpath, nullptr) != 0)
 				{
+					drive_cache_invalidate(file->cache);
 					return TRUE;
 				}
 			}
@@ -303,6 +531,9 @@ static BOOL drive_file_init(DRIVE_FILE* file)
 #endif
 		file->file_handle = CreateFileW(file->fullpath, file->DesiredAccess, file->SharedAccess,
 		                                nullptr, CreateDisposition, file->FileAttributes, nullptr);
+
+		if ((file->file_handle != INVALID_HANDLE_VALUE) && (CreateDisposition != OPEN_EXISTING))
+			drive_cache_invalidate(file->cache);
 	}
 
 #ifdef WIN32
@@ -335,7 +566,8 @@ static BOOL drive_file_init(DRIVE_FILE* file)
 
 DRIVE_FILE* drive_file_new(const WCHAR* base_path, const WCHAR* path, UINT32 PathWCharLength,
                            UINT32 id, UINT32 DesiredAccess, UINT32 CreateDisposition,
-                           UINT32 CreateOptions, UINT32 FileAttributes, UINT32 SharedAccess)
+                           UINT32 CreateOptions, UINT32 FileAttributes, UINT32 SharedAccess,
+                           DRIVE_CACHE* cache)
 {
 	if (!base_path || (!path && (PathWCharLength > 0)))
 		return nullptr;
@@ -357,6 +589,7 @@ DRIVE_FILE* drive_file_new(const WCHAR* base_path, const WCHAR* path, UINT32 Pat
 	file->CreateDisposition = CreateDisposition;
 	file->CreateOptions = CreateOptions;
 	file->SharedAccess = SharedAccess;
+	file->cache = cache;
 
 	WCHAR* p = drive_file_combine_fullpath(base_path, path, PathWCharLength);
 	(void)drive_file_set_fullpath(file, p);
@@ -408,7 +641,12 @@ BOOL drive_file_free(DRIVE_FILE* file)
 
 	rc = TRUE;
 fail:
+	if (file->delete_pending)
+		drive_cache_invalidate(file->cache);
+
 	DEBUG_WSTR("Free %s", file->fullpath);
+	free(file->listing);
+	free(file->readahead);
 	free(file->fullpath);
 	free(file);
 	return rc;
@@ -446,6 +684,115 @@ BOOL drive_file_read(DRIVE_FILE* file, BYTE* buffer, UINT32* Length)
 	return FALSE;
 }
 
+static BOOL drive_file_read_direct(DRIVE_FILE* file, UINT64 Offset, BYTE* buffer, UINT32* Length)
+{
+	if (!drive_file_seek(file, Offset))
+		return FALSE;
+	return drive_file_read(file, buffer, Length);
+}
+
+static BOOL drive_file_get_stamp(DRIVE_FILE* file, UINT64* size, FILETIME* modified)
+{
+	BY_HANDLE_FILE_INFORMATION info = WINPR_C_ARRAY_INIT;
+
+	WINPR_ASSERT(file);
+	WINPR_ASSERT(size);
+	WINPR_ASSERT(modified);
+
+	if (!GetFileInformationByHandle(file->file_handle, &info))
+		return FALSE;
+
+	*size = ((UINT64)info.nFileSizeHigh << 32) | info.nFileSizeLow;
+	*modified = info.ftLastWriteTime;
+	return TRUE;
+}
+
+static BOOL drive_file_readahead_valid(DRIVE_FILE* file)
+{
+	UINT64 size = 0;
+	FILETIME modified = WINPR_C_ARRAY_INIT;
+
+	WINPR_ASSERT(file);
+
+	/* Writes through this drive are seen right away */
+	if (file->cache && (file->readahead_generation != drive_cache_generation(file->cache)))
+		return FALSE;
+
+	/* Writes by other processes only change the file size and time. The time might not
+	 * change within its resolution, so the data is not kept longer than cached attributes */
+	if ((GetTickCount64() - file->readahead_timestamp) >= DRIVE_CACHE_TTL_MS)
+		return FALSE;
+	if (!drive_file_get_stamp(file, &size, &modified))
+		return FALSE;
+
+	return (size == file->readahead_size) &&
+	       (modified.dwLowDateTime == file->readahead_modified.dwLowDateTime) &&
+	       (modified.dwHighDateTime == file->readahead_modified.dwHighDateTime);
+}
+
+BOOL drive_file_read_at(DRIVE_FILE* file, UINT64 Offset, BYTE* buffer, UINT32* Length)
+{
+	if (!file || !buffer || !Length)
+		return FALSE;
+
+	const BOOL sequential = (Offset == file->read_end);
+	const UINT32 requested = *Length;
+
+	if (file->readahead_length > 0)
+	{
+		const UINT64 end = file->readahead_offset + file->readahead_length;
+
+		if (!drive_file_readahead_valid(file))
+			file->readahead_length = 0;
+		else if ((Offset >= file->readahead_offset) && (Offset < end) &&
+		         (file->readahead_eof || (Offset + requested <= end)))
+		{
+			const size_t available = WINPR_ASSERTING_INT_CAST(size_t, end - Offset);
+			const size_t len = MIN(available, requested);
+			memcpy(buffer, &file->readahead[Offset - file->readahead_offset], len);
+			*Length = WINPR_ASSERTING_INT_CAST(UINT32, len);
+			file->read_end = Offset + len;
+			return TRUE;
+		}
+	}
+
+	/* Random access and large requests go straight to the file */
+	if (!sequential || (requested >= DRIVE_FILE_READAHEAD_SIZE))
+	{
+		if (!drive_file_read_direct(file, Offset, buffer, Length))
+			return FALSE;
+		file->read_end = Offset + *Length;
+		return TRUE;
+	}
+
+	if (!file->readahead)
+	{
+		file->readahead = malloc(DRIVE_FILE_READAHEAD_SIZE);
+		if (!file->readahead)
+			return drive_file_read_direct(file, Offset, buffer, Length);
+	}
+
+	UINT32 filled = DRIVE_FILE_READAHEAD_SIZE;
+	file->readahead_length = 0;
+	if (file->cache)
+		file->readahead_generation = drive_cache_generation(file->cache);
+	file->readahead_timestamp = GetTickCount64();
+	if (!drive_file_get_stamp(file, &file->readahead_size, &file->readahead_modified))
+		return drive_file_read_direct(file, Offset, buffer, Length);
+	if (!drive_file_read_direct(file, Offset, file->readahead, &filled))
+		return FALSE;
+
+	file->readahead_offset = Offset;
+	file->readahead_length = filled;
+	file->readahead_eof = (filled < DRIVE_FILE_READAHEAD_SIZE);
+
+	const UINT32 len = MIN(filled, requested);
+	memcpy(buffer, file->readahead, len);
+	*Length = len;
+	file->read_end = Offset + len;
+	return TRUE;
+}
+
 BOOL drive_file_write(DRIVE_FILE* file, const BYTE* buffer, UINT32 Length)
 {
 	DWORD written = 0;
@@ -455,16 +802,22 @@ BOOL drive_file_write(DRIVE_FILE* file, const BYTE* buffer, UINT32 Length)
 
 	DEBUG_WSTR("Write file %s", file->fullpath);
 
+	BOOL rc = TRUE;
 	while (Length > 0)
 	{
 		if (!WriteFile(file->file_handle, buffer, Length, &written, nullptr))
-			return FALSE;
+		{
+			rc = FALSE;
+			break;
+		}
 
 		Length -= written;
 		buffer += written;
 	}
 
-	return TRUE;
+	/* Also drops the read-ahead of every file of this drive */
+	drive_cache_invalidate(file->cache);
+	return rc;
 }
 
 static BOOL drive_file_query_from_handle_information(const DRIVE_FILE* file,
@@ -633,7 +986,7 @@ BOOL drive_file_query_information(DRIVE_FILE* file, UINT32 FsInformationClass, w
 	 * GetFileAttributesExW */
 	{
 		WIN32_FILE_ATTRIBUTE_DATA fileAttributes = WINPR_C_ARRAY_INIT;
-		if (!GetFileAttributesExW(file->fullpath, GetFileExInfoStandard, &fileAttributes))
+		if (!drive_cache_get_attributes(file->cache, file->fullpath, &fileAttributes))
 			goto out_fail;
 
 		if (!drive_file_query_from_attributes(file, &fileAttributes, FsInformationClass, output))
@@ -885,21 +1238,26 @@ BOOL drive_file_set_information(DRIVE_FILE* file, UINT32 FsInformationClass, UIN
 	if (!Stream_CheckAndLogRequiredLength(TAG, input, Length))
 		return FALSE;
 
+	BOOL rc = FALSE;
 	switch (FsInformationClass)
 	{
 		case FileBasicInformation:
-			return drive_file_set_basic_information(file, Length, input);
+			rc = drive_file_set_basic_information(file, Length, input);
+			break;
 
 		case FileEndOfFileInformation:
 		/* http://msdn.microsoft.com/en-us/library/cc232067.aspx */
 		case FileAllocationInformation:
-			return drive_file_set_alloc_information(file, Length, input);
+			rc = drive_file_set_alloc_information(file, Length, input);
+			break;
 
 		case FileDispositionInformation:
-			return drive_file_set_disposition_information(file, Length, input);
+			rc = drive_file_set_disposition_information(file, Length, input);
+			break;
 
 		case FileRenameInformation:
-			return drive_file_set_rename_information(file, Length, input);
+			rc = drive_file_set_rename_information(file, Length, input);
+			break;
 
 		default:
 			WLog_WARN(TAG, "Unhandled FSInformationClass %s [0x%08" PRIx32 "]",
@@ -907,7 +1265,8 @@ BOOL drive_file_set_information(DRIVE_FILE* file, UINT32 FsInformationClass, UIN
 			return FALSE;
 	}
 
-	return TRUE;
+	drive_cache_invalidate(file->cache);
+	return rc;
 }
 
 static BOOL drive_file_query_dir_info(DRIVE_FILE* file, wStream* output, size_t length)
@@ -1037,6 +1396,99 @@ static BOOL drive_file_query_names_info(DRIVE_FILE* file, wStream* output, size_
 	return TRUE;
 }
 
+static void drive_file_listing_reset(DRIVE_FILE* file)
+{
+	WINPR_ASSERT(file);
+
+	if (file->find_handle != INVALID_HANDLE_VALUE)
+		FindClose(file->find_handle);
+	file->find_handle = INVALID_HANDLE_VALUE;
+
+	free(file->listing);
+	file->listing = nullptr;
+	file->listing_count = 0;
+	file->listing_index = 0;
+}
+
+/**
+ * Enumerates the directory up front so the listing can be cached. Very large directories are
+ * only partially buffered, the remaining entries are read from the search handle.
+ */
+static BOOL drive_file_listing_load(DRIVE_FILE* file, const WCHAR* pattern)
+{
+	WIN32_FIND_DATAW data = WINPR_C_ARRAY_INIT;
+	size_t capacity = 0;
+
+	WINPR_ASSERT(file);
+
+	char* key = file->cache ? ConvertWCharToUtf8Alloc(pattern, nullptr) : nullptr;
+	if (drive_cache_get_listing(file->cache, key, file))
+	{
+		free(key);
+		return TRUE;
+	}
+
+	const LONG generation = file->cache ? drive_cache_generation(file->cache) : 0;
+	file->find_handle = FindFirstFileW(pattern, &data);
+	if (file->find_handle == INVALID_HANDLE_VALUE)
+	{
+		free(key);
+		return FALSE;
+	}
+
+	do
+	{
+		if (file->listing_count == capacity)
+		{
+			const size_t count = (capacity == 0) ? 32 : capacity * 2;
+			WIN32_FIND_DATAW* tmp = realloc(file->listing, count * sizeof(WIN32_FIND_DATAW));
+			if (!tmp)
+			{
+				free(key);
+				drive_file_listing_reset(file);
+				SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+				return FALSE;
+			}
+			file->listing = tmp;
+			capacity = count;
+		}
+
+		file->listing[file->listing_count++] = data;
+
+		if (file->listing_count >= DRIVE_CACHE_MAX_LISTING)
+			break;
+
+		if (!FindNextFileW(file->find_handle, &data))
+		{
+			FindClose(file->find_handle);
+			file->find_handle = INVALID_HANDLE_VALUE;
+			drive_cache_put_listing(file->cache, key, generation, file);
+		}
+	} while (file->find_handle != INVALID_HANDLE_VALUE);
+
+	free(key);
+	return TRUE;
+}
+
+static BOOL drive_file_listing_next(DRIVE_FILE* file)
+{
+	WINPR_ASSERT(file);
+
+	if (file->listing_index < file->listing_count)
+	{
+		file->find_data = file->listing[file->listing_index++];
+		return TRUE;
+	}
+
+	if (file->find_handle == INVALID_HANDLE_VALUE)
+	{
+		SetLastError(ERROR_NO_MORE_FILES);
+		return FALSE;
+	}
+
+	return FindNextFileW(file->find_handle, &file->find_data);
+}
+
 BOOL drive_file_query_directory(DRIVE_FILE* file, UINT32 FsInformationClass, BYTE InitialQuery,
                                 const WCHAR* path, UINT32 PathWCharLength, wStream* output)
 {
@@ -1050,18 +1502,23 @@ BOOL drive_file_query_directory(DRIVE_FILE* file, UINT32 FsInformationClass, BYT
 	if (InitialQuery != 0)
 	{
 		/* release search handle */
-		if (file->find_handle != INVALID_HANDLE_VALUE)
-			FindClose(file->find_handle);
+		drive_file_listing_reset(file);
 
 		ent_path = drive_file_combine_fullpath(file->basepath, path, PathWCharLength);
-		/* open new search handle and retrieve the first entry */
-		file->find_handle = FindFirstFileW(ent_path, &file->find_data);
+		if (!ent_path)
+			goto out_fail;
+
+		/* open new search and retrieve the first entry */
+		const BOOL loaded = drive_file_listing_load(file, ent_path);
 		free(ent_path);
 
-		if (file->find_handle == INVALID_HANDLE_VALUE)
+		if (!loaded)
+			goto out_fail;
+
+		if (!drive_file_listing_next(file))
 			goto out_fail;
 	}
-	else if (!FindNextFileW(file->find_handle, &file->find_data))
+	else if (!drive_file_listing_next(file))
 		goto out_fail;
 
 	length = _wcslen(file->find_data.cFileName) * sizeof(WCHAR);
@@ -34,6 +34,9 @@
 
 #define TAG CHANNELS_TAG("drive.client")
 
+/** @brief attribute and directory listing cache shared by all files of a drive */
+typedef struct s_drive_cache DRIVE_CACHE;
+
 typedef struct
 {
 	UINT32 id;
@@ -41,6 +44,19 @@ typedef struct
 	HANDLE file_handle;
 	HANDLE find_handle;
 	WIN32_FIND_DATAW find_data;
+	WIN32_FIND_DATAW* listing; /* entries of the current directory query not yet returned */
+	size_t listing_count;
+	size_t listing_index;
+	BYTE* readahead; /* file data following the last sequential read */
+	UINT64 readahead_offset;
+	size_t readahead_length;
+	BOOL readahead_eof;
+	LONG readahead_generation;
+	UINT64 readahead_timestamp;
+	UINT64 readahead_size;       /* file size when the read-ahead was filled */
+	FILETIME readahead_modified; /* last write time when the read-ahead was filled */
+	UINT64 read_end;
+	DRIVE_CACHE* cache;
 	const WCHAR* basepath;
 	WCHAR* fullpath;
 	BOOL delete_pending;
@@ -51,13 +67,21 @@ typedef struct
 	UINT32 CreateOptions;
 } DRIVE_FILE;
 
+FREERDP_LOCAL void drive_cache_free(DRIVE_CACHE* cache);
+
+WINPR_ATTR_MALLOC(drive_cache_free, 1)
+WINPR_ATTR_NODISCARD FREERDP_LOCAL DRIVE_CACHE* drive_cache_new(void);
+
+/** @brief Drops all cached entries, called whenever the drive content was modified */
+FREERDP_LOCAL void drive_cache_invalidate(DRIVE_CACHE* cache);
+
 FREERDP_LOCAL BOOL drive_file_free(DRIVE_FILE* file);
 
 WINPR_ATTR_MALLOC(drive_file_free, 1)
 WINPR_ATTR_NODISCARD FREERDP_LOCAL DRIVE_FILE*
 drive_file_new(const WCHAR* base_path, const WCHAR* path, UINT32 PathWCharLength, UINT32 id,
                UINT32 DesiredAccess, UINT32 CreateDisposition, UINT32 CreateOptions,
-               UINT32 FileAttributes, UINT32 SharedAccess);
+               UINT32 FileAttributes, UINT32 SharedAccess, DRIVE_CACHE* cache);
 
 WINPR_ATTR_NODISCARD FREERDP_LOCAL BOOL drive_file_open(DRIVE_FILE* file);
 
@@ -66,6 +90,11 @@ WINPR_ATTR_NODISCARD FREERDP_LOCAL BOOL drive_file_seek(DRIVE_FILE* file, UINT64
 WINPR_ATTR_NODISCARD FREERDP_LOCAL BOOL drive_file_read(DRIVE_FILE* file, BYTE* buffer,
                                                         UINT32* Length);
 
+/** @brief Reads \b Length bytes at \b Offset. Sequential reads are served from a read-ahead
+ *  buffer that is refilled with large reads. */
+WINPR_ATTR_NODISCARD FREERDP_LOCAL BOOL drive_file_read_at(DRIVE_FILE* file, UINT64 Offset,
+                                                           BYTE* buffer, UINT32* Length);
+
 WINPR_ATTR_NODISCARD FREERDP_LOCAL BOOL drive_file_write(DRIVE_FILE* file, const BYTE* buffer,
                                                          UINT32 Length);
 
@@ -48,7 +48,19 @@
 
 #include "drive_file.h"
 
+/* IRPs of different files are executed concurrently, IRPs of one file stay in order */
+#define DRIVE_MAX_WORKERS 4
+
+typedef struct s_drive_device DRIVE_DEVICE;
+
 typedef struct
+{
+	DRIVE_DEVICE* drive;
+	HANDLE thread;
+	wMessageQueue* IrpQueue;
+} DRIVE_WORKER;
+
+struct s_drive_device
 {
 	DEVICE device;
 
@@ -56,15 +68,16 @@ typedef struct
 	BOOL automount;
 	UINT32 PathLength;
 	wListDictionary* files;
+	DRIVE_CACHE* cache;
 
-	HANDLE thread;
 	BOOL async;
-	wMessageQueue* IrpQueue;
+	DRIVE_WORKER workers[DRIVE_MAX_WORKERS];
+	size_t workerCount;
 
 	DEVMAN* devman;
 
 	rdpContext* rdpcontext;
-} DRIVE_DEVICE;
+};
 
 static NTSTATUS drive_map_windows_err(DWORD fs_errno)
 {
@@ -179,9 +192,9 @@ static UINT drive_process_irp_create(DRIVE_DEVICE* drive, IRP* irp)
 
 	const WCHAR* path = Stream_ConstPointer(irp->input);
 	UINT32 FileId = irp->devman->id_sequence++;
-	DRIVE_FILE* file =
-	    drive_file_new(drive->path, path, PathLength / sizeof(WCHAR), FileId, DesiredAccess,
-	                   CreateDisposition, CreateOptions, FileAttributes, SharedAccess);
+	DRIVE_FILE* file = drive_file_new(drive->path, path, PathLength / sizeof(WCHAR), FileId,
+	                                  DesiredAccess, CreateDisposition, CreateOptions,
+	                                  FileAttributes, SharedAccess, drive->cache);
 
 	if (!file)
 	{
@@ -293,11 +306,6 @@ static UINT drive_process_irp_read(DRIVE_DEVICE* drive, IRP* irp)
 		irp->IoStatus = STATUS_UNSUCCESSFUL;
 		Length = 0;
 	}
-	else if (!drive_file_seek(file, Offset))
-	{
-		irp->IoStatus = drive_map_windows_err(GetLastError());
-		Length = 0;
-	}
 
 	if (!Stream_EnsureRemainingCapacity(irp->output, 4ull + Length))
 	{
@@ -310,7 +318,7 @@ static UINT drive_process_irp_read(DRIVE_DEVICE* drive, IRP* irp)
 	{
 		BYTE* buffer = Stream_PointerAs(irp->output, BYTE) + sizeof(UINT32);
 
-		if (!drive_file_read(file, buffer, &Length))
+		if (!drive_file_read_at(file, Offset, buffer, &Length))
 		{
 			irp->IoStatus = drive_map_windows_err(GetLastError());
 			Stream_Write_UINT32(irp->output, 0);
@@ -816,7 +824,8 @@ static BOOL drive_poll_run(DRIVE_DEVICE* drive, IRP* irp)
 
 static DWORD WINAPI drive_thread_func(LPVOID arg)
 {
-	DRIVE_DEVICE* drive = (DRIVE_DEVICE*)arg;
+	DRIVE_WORKER* worker = (DRIVE_WORKER*)arg;
+	DRIVE_DEVICE* drive = worker ? worker->drive : nullptr;
 	UINT error = CHANNEL_RC_OK;
 
 	if (!drive)
@@ -827,18 +836,18 @@ static DWORD WINAPI drive_thread_func(LPVOID arg)
 
 	while (1)
 	{
-		if (!MessageQueue_Wait(drive->IrpQueue))
+		if (!MessageQueue_Wait(worker->IrpQueue))
 		{
 			WLog_ERR(TAG, "MessageQueue_Wait failed!");
 			error = ERROR_INTERNAL_ERROR;
 			break;
 		}
 
-		if (MessageQueue_Size(drive->IrpQueue) < 1)
+		if (MessageQueue_Size(worker->IrpQueue) < 1)
 			continue;
 
 		wMessage message = WINPR_C_ARRAY_INIT;
-		if (!MessageQueue_Peek(drive->IrpQueue, &message, TRUE))
+		if (!MessageQueue_Peek(worker->IrpQueue, &message, TRUE))
 		{
 			WLog_ERR(TAG, "MessageQueue_Peek failed!");
 			continue;
@@ -875,7 +884,13 @@ static UINT drive_irp_request(DEVICE* device, IRP* irp)
 
 	if (drive->async)
 	{
-		if (!MessageQueue_Post(drive->IrpQueue, nullptr, 0, (void*)irp, nullptr))
+		/* A file is always served by the same worker, new files are created by the first one */
+		WINPR_ASSERT(drive->workerCount > 0);
+		const size_t index =
+		    (irp->MajorFunction == IRP_MJ_CREATE) ? 0 : irp->FileId % drive->workerCount;
+		DRIVE_WORKER* worker = &drive->workers[index];
+
+		if (!MessageQueue_Post(worker->IrpQueue, nullptr, 0, (void*)irp, nullptr))
 		{
 			WLog_ERR(TAG, "MessageQueue_Post failed!");
 			return ERROR_INTERNAL_ERROR;
@@ -890,6 +905,25 @@ static UINT drive_irp_request(DEVICE* device, IRP* irp)
 	return CHANNEL_RC_OK;
 }
 
+static UINT drive_stop_workers(DRIVE_DEVICE* drive)
+{
+	WINPR_ASSERT(drive);
+
+	for (size_t x = 0; x < drive->workerCount; x++)
+	{
+		DRIVE_WORKER* worker = &drive->workers[x];
+		if (MessageQueue_PostQuit(worker->IrpQueue, 0) &&
+		    (WaitForSingleObject(worker->thread, INFINITE) == WAIT_FAILED))
+		{
+			const UINT error = GetLastError();
+			WLog_ERR(TAG, "WaitForSingleObject failed with error %" PRIu32 "", error);
+			return error;
+		}
+	}
+
+	return CHANNEL_RC_OK;
+}
+
 static UINT drive_free_int(DRIVE_DEVICE* drive)
 {
 	UINT error = CHANNEL_RC_OK;
@@ -897,9 +931,15 @@ static UINT drive_free_int(DRIVE_DEVICE* drive)
 	if (!drive)
 		return ERROR_INVALID_PARAMETER;
 
-	(void)CloseHandle(drive->thread);
+	for (size_t x = 0; x < ARRAYSIZE(drive->workers); x++)
+	{
+		DRIVE_WORKER* worker = &drive->workers[x];
+		(void)CloseHandle(worker->thread);
+		MessageQueue_Free(worker->IrpQueue);
+	}
+
 	ListDictionary_Free(drive->files);
-	MessageQueue_Free(drive->IrpQueue);
+	drive_cache_free(drive->cache);
 	Stream_Free(drive->device.data, TRUE);
 	free(drive->path);
 	free(drive);
@@ -919,13 +959,9 @@ static UINT drive_free(DEVICE* device)
 	if (!drive)
 		return ERROR_INVALID_PARAMETER;
 
-	if (MessageQueue_PostQuit(drive->IrpQueue, 0) &&
-	    (WaitForSingleObject(drive->thread, INFINITE) == WAIT_FAILED))
-	{
-		error = GetLastError();
-		WLog_ERR(TAG, "WaitForSingleObject failed with error %" PRIu32 "", error);
+	error = drive_stop_workers(drive);
+	if (error)
 		return error;
-	}
 
 	return drive_free_int(drive);
 }
@@ -1048,18 +1084,32 @@ static UINT drive_register_drive_path(PDEVICE_SERVICE_ENTRY_POINTS pEntryPoints,
 		}
 
 		ListDictionary_ValueObject(drive->files)->fnObjectFree = drive_file_objfree;
-		drive->IrpQueue = MessageQueue_New(nullptr);
 
-		if (!drive->IrpQueue)
+		drive->cache = drive_cache_new();
+		if (!drive->cache)
 		{
-			WLog_ERR(TAG, "ListDictionary_New failed!");
+			WLog_ERR(TAG, "drive_cache_new failed!");
 			error = CHANNEL_RC_NO_MEMORY;
 			goto out_error;
 		}
 
-		wObject* obj = MessageQueue_Object(drive->IrpQueue);
-		WINPR_ASSERT(obj);
-		obj->fnObjectFree = drive_message_free;
+		for (size_t x = 0; x < ARRAYSIZE(drive->workers); x++)
+		{
+			DRIVE_WORKER* worker = &drive->workers[x];
+			worker->drive = drive;
+			worker->IrpQueue = MessageQueue_New(nullptr);
+
+			if (!worker->IrpQueue)
+			{
+				WLog_ERR(TAG, "MessageQueue_New failed!");
+				error = CHANNEL_RC_NO_MEMORY;
+				goto out_error;
+			}
+
+			wObject* obj = MessageQueue_Object(worker->IrpQueue);
+			WINPR_ASSERT(obj);
+			obj->fnObjectFree = drive_message_free;
+		}
 
 		if ((error = pEntryPoints->RegisterDevice(pEntryPoints->devman, &drive->device)))
 		{
@@ -1072,19 +1122,26 @@ static UINT drive_register_drive_path(PDEVICE_SERVICE_ENTRY_POINTS pEntryPoints,
 		                                          FreeRDP_SynchronousStaticChannels);
 		if (drive->async)
 		{
-			if (!(drive->thread = CreateThread(nullptr, 0, drive_thread_func, drive,
-			                                   CREATE_SUSPENDED, nullptr)))
+			for (size_t x = 0; x < ARRAYSIZE(drive->workers); x++)
 			{
-				WLog_ERR(TAG, "CreateThread failed!");
-				goto out_error;
+				DRIVE_WORKER* worker = &drive->workers[x];
+				if (!(worker->thread = CreateThread(nullptr, 0, drive_thread_func, worker,
+				                                    CREATE_SUSPENDED, nullptr)))
+				{
+					WLog_ERR(TAG, "CreateThread failed!");
+					goto out_error;
+				}
+
+				drive->workerCount++;
+				ResumeThread(worker->thread);
 			}
-
-			ResumeThread(drive->thread);
 		}
 	}
 
 	return CHANNEL_RC_OK;
 out_error:
+	if (drive)
+		(void)drive_stop_workers(drive);
 	drive_free_int(drive);
 	return error;
 }
@@ -0,0 +1,145 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Drive file read-ahead unit test
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+
+#include <winpr/crt.h>
+#include <winpr/file.h>
+#include <winpr/path.h>
+#include <winpr/synch.h>
+#include <winpr/sysinfo.h>
+
+#include "../drive_file.h"
+
+/* Matches DRIVE_CACHE_TTL_MS in drive_file.c */
+#define TEST_CACHE_TTL_MS 2000
+#define TEST_FILE_SIZE (64 * 1024)
+#define TEST_BLOCK 4096
+
+static BYTE test_pattern(size_t offset, BYTE seed)
+{
+	return (BYTE)((offset * 7) + seed);
+}
+
+/* Writes length bytes of the pattern at offset like another process would */
+static BOOL test_write_external(const char* name, const char* mode, size_t offset, size_t length,
+                                BYTE seed)
+{
+	FILE* fp = winpr_fopen(name, mode);
+	if (!fp)
+		return FALSE;
+
+	BOOL rc = (_fseeki64(fp, (INT64)offset, SEEK_SET) == 0);
+	for (size_t x = 0; rc && (x < length); x++)
+		rc = (fputc(test_pattern(offset + x, seed), fp) != EOF);
+
+	return (fclose(fp) == 0) && rc;
+}
+
+static BOOL test_read(DRIVE_FILE* file, size_t offset, BYTE seed)
+{
+	BYTE buffer[TEST_BLOCK] = WINPR_C_ARRAY_INIT;
+	UINT32 length = sizeof(buffer);
+
+	if (!drive_file_read_at(file, offset, buffer, &length) || (length != sizeof(buffer)))
+		return FALSE;
+
+	for (size_t x = 0; x < length; x++)
+	{
+		if (buffer[x] != test_pattern(offset + x, seed))
+		{
+			(void)fprintf(stderr, "stale data read at offset %" PRIuz "\n", offset + x);
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+static BOOL test_readahead(const char* base, const char* name, DRIVE_CACHE* cache)
+{
+	BOOL rc = FALSE;
+	WCHAR* wbase = ConvertUtf8ToWCharAlloc(base, nullptr);
+	WCHAR* wpath = ConvertUtf8ToWCharAlloc("/data.bin", nullptr);
+	DRIVE_FILE* file = nullptr;
+
+	if (!wbase || !wpath)
+		goto fail;
+
+	file = drive_file_new(wbase, wpath, (UINT32)_wcslen(wpath), 1, GENERIC_READ, FILE_OPEN, 0,
+	                      FILE_ATTRIBUTE_NORMAL, FILE_SHARE_READ | FILE_SHARE_WRITE, cache);
+	if (!file)
+		goto fail;
+
+	/* The first sequential read fills the read-ahead with the whole file */
+	if (!test_read(file, 0, 0) || !test_read(file, TEST_BLOCK, 0))
+		goto fail;
+
+	/* A modification changing the size is seen right away */
+	if (!test_write_external(name, "r+b", 2 * TEST_BLOCK, TEST_BLOCK, 1) ||
+	    !test_write_external(name, "ab", TEST_FILE_SIZE, TEST_BLOCK, 1))
+		goto fail;
+	if (!test_read(file, 2 * TEST_BLOCK, 1))
+		goto fail;
+
+	/* A modification within the resolution of the file time is seen once the read-ahead
+	 * expired */
+	if (!test_write_external(name, "r+b", 3 * TEST_BLOCK, TEST_BLOCK, 2))
+		goto fail;
+	Sleep(TEST_CACHE_TTL_MS + 100);
+	if (!test_read(file, 3 * TEST_BLOCK, 2))
+		goto fail;
+
+	rc = TRUE;
+fail:
+	(void)drive_file_free(file);
+	free(wbase);
+	free(wpath);
+	return rc;
+}
+
+int TestDriveFile(int argc, char* argv[])
+{
+	int rc = -1;
+	char sname[64] = WINPR_C_ARRAY_INIT;
+	char* name = nullptr;
+
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	(void)_snprintf(sname, sizeof(sname), "TestDriveFile-%" PRIu32, GetCurrentProcessId());
+	char* base = GetKnownSubPath(KNOWN_PATH_TEMP, sname);
+	DRIVE_CACHE* cache = drive_cache_new();
+	if (!base || !cache || !winpr_PathMakePath(base, nullptr))
+		goto fail;
+
+	name = GetCombinedPath(base, "data.bin");
+	if (!name || !test_write_external(name, "wb", 0, TEST_FILE_SIZE, 0))
+		goto fail;
+
+	if (!test_readahead(base, name, cache))
+		goto fail;
+
+	rc = 0;
+fail:
+	if (base)
+		(void)winpr_RemoveDirectory_RecursiveA(base);
+	drive_cache_free(cache);
+	free(name);
+	free(base);
+	return rc;
+}
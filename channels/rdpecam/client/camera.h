@@ -55,6 +55,11 @@
  */
 #define ECAM_SAMPLE_RESPONSE_BUFFER_SIZE (1024ULL * 4050ULL)
 
+/* Captured frames waiting for the encoder thread. If the encoder falls behind the oldest
+ * frames are dropped, a deeper queue would only add latency.
+ */
+#define ECAM_MAX_QUEUED_FRAMES 2
+
 typedef struct s_ICamHal ICamHal;
 
 typedef struct
@@ -82,8 +87,13 @@ typedef struct
 
 } CAM_MEDIA_FORMAT_INFO;
 
+typedef struct s_camera_device CameraDevice;
+
 typedef struct
 {
+	CameraDevice* dev;
+	size_t index;
+
 	BOOL streaming;
 	CAM_MEDIA_FORMAT_INFO formats;
 	CAM_MEDIA_TYPE_DESCRIPTION currMediaType;
@@ -91,10 +101,19 @@ typedef struct
 	GENERIC_CHANNEL_CALLBACK* hSampleReqChannel;
 	CRITICAL_SECTION lock;
 	volatile LONG samplesRequested;
-	wStream* pendingSample;
-	volatile BOOL haveSample;
 	wStream* sampleRespBuffer;
 
+	/* captured frames, oldest first, taken from framePool */
+	wStreamPool* framePool;
+	wStream* frames[ECAM_MAX_QUEUED_FRAMES];
+	size_t nFrames;
+
+	/* encodes and sends the queued frames, woken up by frameEvent */
+	HANDLE encoderThread;
+	HANDLE frameEvent;
+	/* set when the encoder thread took a frame, a capture callback waits on it for room */
+	HANDLE frameTakenEvent;
+
 	FREERDP_VIDEO_CONTEXT* video;
 } CameraDeviceStream;
 
@@ -110,7 +129,7 @@ static inline CAM_MEDIA_FORMAT streamOutputFormat(CameraDeviceStream* stream)
 	return stream->formats.outputFormat;
 }
 
-typedef struct
+struct s_camera_device
 {
 	IWTSListener* listener;
 	GENERIC_LISTENER_CALLBACK* hlistener;
@@ -118,8 +137,7 @@ typedef struct
 	ICamHal* ihal; /* HAL interface, same as used by CameraPlugin */
 	char deviceId[32];
 	CameraDeviceStream streams[ECAM_DEVICE_MAX_STREAMS];
-
-} CameraDevice;
+};
 
 /**
  * Subsystem (Hardware Abstraction Layer, HAL) Interface
@@ -20,6 +20,8 @@
 #include <winpr/assert.h>
 #include <winpr/cast.h>
 #include <winpr/interlocked.h>
+#include <winpr/synch.h>
+#include <winpr/thread.h>
 
 #include "camera.h"
 #include "rdpecam-utils.h"
@@ -162,33 +164,69 @@ static BOOL mediaSupportDrops(CAM_MEDIA_FORMAT format)
 	}
 }
 
-static UINT ecam_dev_send_pending(CameraDevice* dev, size_t streamIndex, CameraDeviceStream* stream)
+/**
+ * @brief Takes the next frame to encode from the queue
+ *
+ * stream->lock must be held. If frames can be dropped only the most recent one is encoded.
+ *
+ * @return the frame or nullptr if nothing should be sent now
+ */
+WINPR_ATTR_NODISCARD
+static wStream* ecam_dev_dequeue_frame(CameraDeviceStream* stream)
 {
-	WINPR_ASSERT(dev);
 	WINPR_ASSERT(stream);
 
 	if (stream->samplesRequested <= 0)
 	{
 		WLog_VRB(TAG, "Frame delayed: No sample requested");
-		return CHANNEL_RC_OK;
+		return nullptr;
 	}
 
-	if (!stream->haveSample)
+	if (stream->nFrames == 0)
 	{
 		WLog_VRB(TAG, "Frame response delayed: No sample available");
-		return CHANNEL_RC_OK;
+		return nullptr;
+	}
+
+	if (mediaSupportDrops(streamInputFormat(stream)))
+	{
+		while (stream->nFrames > 1)
+		{
+			WLog_VRB(TAG, "Frame dropped: superseded by a newer one");
+			Stream_Release(stream->frames[0]);
+			memmove(&stream->frames[0], &stream->frames[1],
+			        (stream->nFrames - 1) * sizeof(wStream*));
+			stream->nFrames--;
+		}
 	}
 
-	wStream* output = ecam_dev_prepare_sample_response(dev, streamIndex);
+	wStream* frame = stream->frames[0];
+	stream->nFrames--;
+	memmove(&stream->frames[0], &stream->frames[1], stream->nFrames * sizeof(wStream*));
+	(void)SetEvent(stream->frameTakenEvent);
+	return frame;
+}
+
+/**
+ * @brief Encodes \b frame straight into the reused sample response and sends it
+ *
+ * @return 0 on success, otherwise a Win32 error code
+ */
+static UINT ecam_dev_send_frame(CameraDeviceStream* stream, GENERIC_CHANNEL_CALLBACK* hchannel,
+                                wStream* frame, BOOL* sent)
+{
+	WINPR_ASSERT(stream);
+	WINPR_ASSERT(sent);
+
+	*sent = FALSE;
+
+	wStream* output = ecam_dev_prepare_sample_response(stream->dev, stream->index);
 	if (!output)
 		return CHANNEL_RC_OK;
 
-	const BYTE* encodedSample = Stream_Buffer(stream->pendingSample);
-	const size_t encodedSize = Stream_Length(stream->pendingSample);
-	if (!ecam_encoder_compress(stream, encodedSample, encodedSize, output))
+	if (!ecam_encoder_compress(stream, Stream_Buffer(frame), Stream_Length(frame), output))
 	{
 		WLog_DBG(TAG, "Frame dropped: error in ecam_encoder_compress");
-		stream->haveSample = FALSE;
 		return CHANNEL_RC_OK;
 	}
 
@@ -198,12 +236,60 @@ static UINT ecam_dev_send_pending(CameraDevice* dev, size_t streamIndex, CameraD
 		return CHANNEL_RC_OK;
 	}
 
-	stream->samplesRequested--;
-	stream->haveSample = FALSE;
+	*sent = TRUE;
 
 	/* channel write is protected by critical section in dvcman_write_channel */
-	return ecam_channel_write(dev->ecam, stream->hSampleReqChannel, CAM_MSG_ID_SampleResponse,
-	                          output, FALSE /* don't free stream */);
+	return ecam_channel_write(stream->dev->ecam, hchannel, CAM_MSG_ID_SampleResponse, output,
+	                          FALSE /* don't free stream */);
+}
+
+/**
+ * @brief Encoder thread of a stream
+ *
+ * Encoding runs outside of the lock, the capture thread only queues frames and sample
+ * requests only add credits.
+ *
+ * @return 0 on success, otherwise a Win32 error code
+ */
+static DWORD WINAPI ecam_dev_encoder_thread(LPVOID arg)
+{
+	CameraDeviceStream* stream = arg;
+	WINPR_ASSERT(stream);
+
+	while (WaitForSingleObject(stream->frameEvent, INFINITE) == WAIT_OBJECT_0)
+	{
+		EnterCriticalSection(&stream->lock);
+		/* frames and requests are added with the lock held, none is missed */
+		(void)ResetEvent(stream->frameEvent);
+
+		while (stream->streaming)
+		{
+			wStream* frame = ecam_dev_dequeue_frame(stream);
+			if (!frame)
+				break;
+
+			GENERIC_CHANNEL_CALLBACK* hchannel = stream->hSampleReqChannel;
+			LeaveCriticalSection(&stream->lock);
+
+			BOOL sent = FALSE;
+			const UINT error = ecam_dev_send_frame(stream, hchannel, frame, &sent);
+			Stream_Release(frame);
+			if (error != CHANNEL_RC_OK)
+				WLog_ERR(TAG, "Failure sending sample: %" PRIu32, error);
+
+			EnterCriticalSection(&stream->lock);
+			if (sent)
+				stream->samplesRequested--;
+		}
+
+		const BOOL streaming = stream->streaming;
+		LeaveCriticalSection(&stream->lock);
+
+		if (!streaming)
+			break;
+	}
+
+	return CHANNEL_RC_OK;
 }
 
 static UINT ecam_dev_sample_captured_callback(CameraDevice* dev, size_t streamIndex,
@@ -225,53 +311,55 @@ static UINT ecam_dev_sample_captured_callback(CameraDevice* dev, size_t streamIn
 	EnterCriticalSection(&stream->lock);
 	UINT ret = CHANNEL_RC_NO_MEMORY;
 
-	/* If we already have a waiting sample, let's see if the input format support dropping
-	 * frames so that we could just "refresh" the pending sample, otherwise we must wait until
-	 * a frame request flushes it
+	/* If the queue is full, let's see if the input format support dropping frames so that we
+	 * could just replace the oldest one, otherwise we must wait until the encoder thread
+	 * took one
 	 */
 
-	if (stream->haveSample && !mediaSupportDrops(stream->formats.inputFormat))
-	{
-		/* we can't drop samples, so we have to wait until the pending sample is
-		 * sent, by a sample request.
-		 *
-		 * When we're here we already have a sample ready to be sent, the delay between 2 frames
-		 * seems like a reasonable wait delay. For instance 60 FPS means a frame every 16ms.
-		 * We also cap that wait delay to not spinloop and not get stuck for too long.
-		 * */
-		DWORD waitDelay = (1000 * stream->currMediaType.FrameRateDenominator) /
-		                  stream->currMediaType.FrameRateNumerator;
-		if (waitDelay < 16)
-			waitDelay = 16;
-		if (waitDelay > 100)
-			waitDelay = 100;
-
-		while (stream->haveSample && stream->streaming)
+	if (stream->nFrames >= ECAM_MAX_QUEUED_FRAMES)
+	{
+		if (mediaSupportDrops(stream->formats.inputFormat))
 		{
-			LeaveCriticalSection(&stream->lock);
+			WLog_VRB(TAG, "Frame dropped: encoder busy");
+			Stream_Release(stream->frames[0]);
+			stream->nFrames--;
+			memmove(&stream->frames[0], &stream->frames[1], stream->nFrames * sizeof(wStream*));
+		}
+		else
+		{
+			/* we can't drop samples, so we have to wait until the encoder thread took a
+			 * queued sample for a sample request, or the stream is stopped */
+			while ((stream->nFrames >= ECAM_MAX_QUEUED_FRAMES) && stream->streaming)
+			{
+				(void)ResetEvent(stream->frameTakenEvent);
+				LeaveCriticalSection(&stream->lock);
 
-			SleepEx(waitDelay, TRUE);
+				(void)WaitForSingleObject(stream->frameTakenEvent, INFINITE);
 
-			EnterCriticalSection(&stream->lock);
-		}
+				EnterCriticalSection(&stream->lock);
+			}
 
-		if (!stream->streaming)
-		{
-			WLog_DBG(TAG, "Frame drop: stream not running");
-			ret = CHANNEL_RC_OK;
-			goto out;
+			if (!stream->streaming)
+			{
+				WLog_DBG(TAG, "Frame drop: stream not running");
+				ret = CHANNEL_RC_OK;
+				goto out;
+			}
 		}
 	}
 
-	Stream_ResetPosition(stream->pendingSample);
-	if (!Stream_EnsureRemainingCapacity(stream->pendingSample, size))
-		goto out;
+	{
+		wStream* frame = StreamPool_Take(stream->framePool, size);
+		if (!frame)
+			goto out;
 
-	Stream_Write(stream->pendingSample, sample, size);
-	Stream_SealLength(stream->pendingSample);
-	stream->haveSample = TRUE;
+		Stream_Write(frame, sample, size);
+		Stream_SealLength(frame);
+		stream->frames[stream->nFrames++] = frame;
+	}
 
-	ret = ecam_dev_send_pending(dev, streamIndex, stream);
+	(void)SetEvent(stream->frameEvent);
+	ret = CHANNEL_RC_OK;
 
 out:
 	LeaveCriticalSection(&stream->lock);
@@ -289,18 +377,43 @@ static void ecam_dev_stop_stream(CameraDevice* dev, size_t streamIndex)
 
 	if (stream->streaming)
 	{
+		/* a capture callback waiting for room in the queue returns */
+		EnterCriticalSection(&stream->lock);
 		stream->streaming = FALSE;
+		(void)SetEvent(stream->frameTakenEvent);
+		LeaveCriticalSection(&stream->lock);
+
 		dev->ihal->StopStream(dev->ihal, dev->deviceId, 0);
 
+		if (stream->encoderThread)
+		{
+			(void)SetEvent(stream->frameEvent);
+			(void)WaitForSingleObject(stream->encoderThread, INFINITE);
+			(void)CloseHandle(stream->encoderThread);
+			stream->encoderThread = nullptr;
+		}
+
 		DeleteCriticalSection(&stream->lock);
 	}
 
+	for (size_t x = 0; x < stream->nFrames; x++)
+		Stream_Release(stream->frames[x]);
+	stream->nFrames = 0;
+
+	StreamPool_Free(stream->framePool);
+	stream->framePool = nullptr;
+
+	if (stream->frameEvent)
+		(void)CloseHandle(stream->frameEvent);
+	stream->frameEvent = nullptr;
+
+	if (stream->frameTakenEvent)
+		(void)CloseHandle(stream->frameTakenEvent);
+	stream->frameTakenEvent = nullptr;
+
 	Stream_Free(stream->sampleRespBuffer, TRUE);
 	stream->sampleRespBuffer = nullptr;
 
-	Stream_Free(stream->pendingSample, TRUE);
-	stream->pendingSample = nullptr;
-
 	ecam_encoder_context_free(stream);
 }
 
@@ -389,7 +502,7 @@ static UINT ecam_dev_process_start_streams_request(CameraDevice* dev,
 	mediaType.Format = streamInputFormat(stream);
 
 	stream->samplesRequested = 0;
-	stream->haveSample = FALSE;
+	stream->nFrames = 0;
 
 	if (!InitializeCriticalSectionEx(&stream->lock, 0, 0))
 	{
@@ -399,10 +512,12 @@ static UINT ecam_dev_process_start_streams_request(CameraDevice* dev,
 		return ERROR_INVALID_DATA;
 	}
 
-	stream->pendingSample = Stream_New(nullptr, 4ull * mediaType.Width * mediaType.Height);
-	if (!stream->pendingSample)
+	stream->framePool = StreamPool_New(TRUE, 4ull * mediaType.Width * mediaType.Height);
+	stream->frameEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+	stream->frameTakenEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+	if (!stream->framePool || !stream->frameEvent || !stream->frameTakenEvent)
 	{
-		WLog_ERR(TAG, "pending stream failed");
+		WLog_ERR(TAG, "frame queue failed");
 		ecam_dev_stop_stream(dev, streamIndex);
 		ecam_channel_send_error_response(dev->ecam, hchannel, CAM_ERROR_CODE_OutOfMemory);
 		return ERROR_INVALID_DATA;
@@ -419,6 +534,16 @@ static UINT ecam_dev_process_start_streams_request(CameraDevice* dev,
 	}
 
 	stream->streaming = TRUE;
+
+	stream->encoderThread = CreateThread(nullptr, 0, ecam_dev_encoder_thread, stream, 0, nullptr);
+	if (!stream->encoderThread)
+	{
+		WLog_ERR(TAG, "CreateThread failed");
+		ecam_dev_stop_stream(dev, streamIndex);
+		ecam_channel_send_error_response(dev->ecam, hchannel, CAM_ERROR_CODE_OutOfMemory);
+		return ERROR_INVALID_DATA;
+	}
+
 	return ecam_channel_send_generic_msg(dev->ecam, hchannel, CAM_MSG_ID_SuccessResponse);
 }
 
@@ -498,10 +623,10 @@ static UINT ecam_dev_process_sample_request(CameraDevice* dev, GENERIC_CHANNEL_C
 		stream->hSampleReqChannel = hchannel;
 
 	stream->samplesRequested++;
-	const UINT ret = ecam_dev_send_pending(dev, streamIndex, stream);
+	(void)SetEvent(stream->frameEvent);
 
 	LeaveCriticalSection(&stream->lock);
-	return ret;
+	return CHANNEL_RC_OK;
 }
 
 /**
@@ -907,6 +1032,11 @@ CameraDevice* ecam_dev_create(CameraPlugin* ecam, const char* deviceId,
 
 	dev->ecam = ecam;
 	dev->ihal = ecam->ihal;
+	for (size_t i = 0; i < ECAM_DEVICE_MAX_STREAMS; i++)
+	{
+		dev->streams[i].dev = dev;
+		dev->streams[i].index = i;
+	}
 	strncpy(dev->deviceId, deviceId, sizeof(dev->deviceId) - 1);
 	dev->hlistener = (GENERIC_LISTENER_CALLBACK*)calloc(1, sizeof(GENERIC_LISTENER_CALLBACK));
 
@@ -68,6 +68,14 @@
 #define MAX_CONTACTS 64
 #define MAX_PEN_CONTACTS 4
 
+/* The coalesced contact state is sampled every frame interval, the frames are queued and sent
+ * as one multi-frame PDU once the flush interval passed. The flush interval grows with the
+ * round trip time, where a few more ms of batching are not noticeable. */
+#define RDPEI_FRAME_INTERVAL 10     /* ms */
+#define RDPEI_MIN_FLUSH_INTERVAL 20 /* ms */
+#define RDPEI_MAX_FLUSH_INTERVAL 50 /* ms */
+#define RDPEI_MAX_BATCH_FRAMES 16
+
 typedef struct
 {
 	GENERIC_DYNVC_PLUGIN base;
@@ -86,6 +94,15 @@ typedef struct
 	UINT16 maxPenContacts;
 	RDPINPUT_PEN_CONTACT_POINT penContactPoints[MAX_PEN_CONTACTS];
 
+	/* encoded frames not yet sent, see rdpei_flush */
+	wStream* touchBatch;
+	UINT16 touchBatchFrames;
+	UINT64 touchBatchTime;
+	wStream* penBatch;
+	UINT16 penBatchFrames;
+	UINT64 penBatchTime;
+	BOOL contactEnded; /* a queued frame lifts or cancels a contact, flushed right away */
+
 	CRITICAL_SECTION lock;
 	rdpContext* rdpcontext;
 
@@ -175,6 +192,10 @@ static UINT rdpei_add_frame(RdpeiClientContext* context)
 
 		if (contactPoint->dirty)
 		{
+			if (contact->contactFlags &
+			    (RDPINPUT_CONTACT_FLAG_UP | RDPINPUT_CONTACT_FLAG_CANCELED))
+				rdpei->contactEnded = TRUE;
+
 			contacts[frame.contactCount] = *contact;
 			rdpei->contactPoints[i].dirty = FALSE;
 			frame.contactCount++;
@@ -298,30 +319,54 @@ static UINT rdpei_write_pen_frame(wStream* s, const RDPINPUT_PEN_FRAME* frame)
 	return CHANNEL_RC_OK;
 }
 
-static UINT rdpei_send_pen_event_pdu(GENERIC_CHANNEL_CALLBACK* callback, size_t frameOffset,
-                                     const RDPINPUT_PEN_FRAME* frames, size_t count)
+static UINT32 rdpei_flush_interval(RDPEI_PLUGIN* rdpei)
+{
+	WINPR_ASSERT(rdpei);
+	WINPR_ASSERT(rdpei->rdpcontext);
+
+	const rdpAutoDetect* autodetect = rdpei->rdpcontext->autodetect;
+	if (!autodetect)
+		return RDPEI_MIN_FLUSH_INTERVAL;
+
+	const UINT32 interval = autodetect->netCharAverageRTT / 4;
+	if (interval < RDPEI_MIN_FLUSH_INTERVAL)
+		return RDPEI_MIN_FLUSH_INTERVAL;
+	if (interval > RDPEI_MAX_FLUSH_INTERVAL)
+		return RDPEI_MAX_FLUSH_INTERVAL;
+	return interval;
+}
+
+/**
+ * Function description
+ *
+ * Sends the \b frames frames encoded in \b batch, the oldest queued at \b oldest, as a single
+ * touch or pen event PDU and empties the batch.
+ *
+ * @return 0 on success, otherwise a Win32 error code
+ */
+static UINT rdpei_send_batch(GENERIC_CHANNEL_CALLBACK* callback, UINT16 eventId, wStream* batch,
+                             UINT16* frames, UINT64 oldest, UINT64 now)
 {
 	UINT status = ERROR_OUTOFMEMORY;
 	WINPR_ASSERT(callback);
+	WINPR_ASSERT(batch);
+	WINPR_ASSERT(frames);
 
-	if (frameOffset > UINT32_MAX)
-		return ERROR_INVALID_PARAMETER;
-	if (count > UINT16_MAX)
-		return ERROR_INVALID_PARAMETER;
+	if (*frames == 0)
+		return CHANNEL_RC_OK;
 
 	RDPEI_PLUGIN* rdpei = (RDPEI_PLUGIN*)callback->plugin;
 	if (!rdpei)
 		return ERROR_INTERNAL_ERROR;
 
-	if (!frames || (count == 0))
-		return ERROR_INTERNAL_ERROR;
-
-	wStream* s = Stream_New(nullptr, 64);
+	const size_t length = Stream_GetPosition(batch);
+	wStream* s = Stream_New(nullptr, RDPINPUT_HEADER_LENGTH + 6 + length);
 
 	if (!s)
 	{
 		WLog_Print(rdpei->base.log, WLOG_ERROR, "Stream_New failed!");
-		return CHANNEL_RC_NO_MEMORY;
+		status = CHANNEL_RC_NO_MEMORY;
+		goto fail;
 	}
 
 	Stream_Seek(s, RDPINPUT_HEADER_LENGTH);
@@ -329,30 +374,79 @@ static UINT rdpei_send_pen_event_pdu(GENERIC_CHANNEL_CALLBACK* callback, size_t
 	 * the time that has elapsed (in milliseconds) from when the oldest touch frame
 	 * was generated to when it was encoded for transmission by the client.
 	 */
+	const UINT64 encodeTime = (now > oldest) ? now - oldest : 0;
 	if (!rdpei_write_4byte_unsigned(
-	        s, (UINT32)frameOffset)) /* encodeTime (FOUR_BYTE_UNSIGNED_INTEGER) */
+	        s, (UINT32)encodeTime)) /* encodeTime (FOUR_BYTE_UNSIGNED_INTEGER) */
 		goto fail;
-	if (!rdpei_write_2byte_unsigned(s, (UINT16)count)) /* (frameCount) TWO_BYTE_UNSIGNED_INTEGER */
+	if (!rdpei_write_2byte_unsigned(s, *frames)) /* (frameCount) TWO_BYTE_UNSIGNED_INTEGER */
 		goto fail;
-
-	for (size_t x = 0; x < count; x++)
-	{
-		status = rdpei_write_pen_frame(s, &frames[x]);
-		if (status)
-		{
-			WLog_Print(rdpei->base.log, WLOG_ERROR,
-			           "rdpei_write_pen_frame failed with error %" PRIu32 "!", status);
-			goto fail;
-		}
-	}
+	if (!Stream_EnsureRemainingCapacity(s, length))
+		goto fail;
+	Stream_Write(s, Stream_Buffer(batch), length);
 	Stream_SealLength(s);
 
-	status = rdpei_send_pdu(callback, s, EVENTID_PEN, Stream_Length(s));
+	status = rdpei_send_pdu(callback, s, eventId, Stream_Length(s));
 fail:
 	Stream_Free(s, TRUE);
+	Stream_ResetPosition(batch);
+	*frames = 0;
 	return status;
 }
 
+static void rdpei_discard_batches(RDPEI_PLUGIN* rdpei)
+{
+	WINPR_ASSERT(rdpei);
+
+	Stream_ResetPosition(rdpei->touchBatch);
+	rdpei->touchBatchFrames = 0;
+	Stream_ResetPosition(rdpei->penBatch);
+	rdpei->penBatchFrames = 0;
+}
+
+/**
+ * Function description
+ *
+ * Sends the queued touch and pen frames once the oldest of them waited for the flush interval,
+ * or right away if \b force is set.
+ *
+ * @return 0 on success, otherwise a Win32 error code
+ */
+static UINT rdpei_flush(RDPEI_PLUGIN* rdpei, UINT64 now, BOOL force)
+{
+	UINT error = CHANNEL_RC_OK;
+	WINPR_ASSERT(rdpei);
+
+	GENERIC_CHANNEL_CALLBACK* callback = nullptr;
+	if (rdpei->base.listener_callback)
+		callback = rdpei->base.listener_callback->channel_callback;
+
+	/* The channel was closed in between, nobody is interested in these frames anymore */
+	if (!callback)
+	{
+		rdpei_discard_batches(rdpei);
+		return CHANNEL_RC_OK;
+	}
+
+	/* Send the batch if it would be late at the next frame interval */
+	const UINT64 deadline = rdpei_flush_interval(rdpei);
+	if ((rdpei->touchBatchFrames > 0) &&
+	    (force || (now + RDPEI_FRAME_INTERVAL >= rdpei->touchBatchTime + deadline)))
+	{
+		error = rdpei_send_batch(callback, EVENTID_TOUCH, rdpei->touchBatch,
+		                         &rdpei->touchBatchFrames, rdpei->touchBatchTime, now);
+		if (error)
+			return error;
+	}
+
+	if ((rdpei->penBatchFrames > 0) &&
+	    (force || (now + RDPEI_FRAME_INTERVAL >= rdpei->penBatchTime + deadline)))
+	{
+		error = rdpei_send_batch(callback, EVENTID_PEN, rdpei->penBatch, &rdpei->penBatchFrames,
+		                         rdpei->penBatchTime, now);
+	}
+	return error;
+}
+
 static UINT rdpei_send_pen_frame(RdpeiClientContext* context, RDPINPUT_PEN_FRAME* frame)
 {
 	const UINT64 currentTime = GetTickCount64();
@@ -384,13 +478,27 @@ static UINT rdpei_send_pen_frame(RdpeiClientContext* context, RDPINPUT_PEN_FRAME
 		frame->frameOffset = rdpei->currentPenFrameTime - rdpei->previousPenFrameTime;
 	}
 
-	const size_t off = WINPR_ASSERTING_INT_CAST(size_t, frame->frameOffset);
-	const UINT error = rdpei_send_pen_event_pdu(callback, off, frame, 1);
+	if (rdpei->penBatchFrames == 0)
+		rdpei->penBatchTime = currentTime;
+
+	const size_t pos = Stream_GetPosition(rdpei->penBatch);
+	const UINT error = rdpei_write_pen_frame(rdpei->penBatch, frame);
 	if (error)
+	{
+		WLog_Print(rdpei->base.log, WLOG_ERROR,
+		           "rdpei_write_pen_frame failed with error %" PRIu32 "!", error);
+		if (!Stream_SetPosition(rdpei->penBatch, pos))
+			return ERROR_INVALID_DATA;
 		return error;
+	}
 
+	rdpei->penBatchFrames++;
 	rdpei->previousPenFrameTime = rdpei->currentPenFrameTime;
-	return error;
+
+	if (rdpei->penBatchFrames < RDPEI_MAX_BATCH_FRAMES)
+		return CHANNEL_RC_OK;
+	return rdpei_send_batch(callback, EVENTID_PEN, rdpei->penBatch, &rdpei->penBatchFrames,
+	                        rdpei->penBatchTime, currentTime);
 }
 
 static UINT rdpei_add_pen_frame(RdpeiClientContext* context)
@@ -411,6 +519,10 @@ static UINT rdpei_add_pen_frame(RdpeiClientContext* context)
 
 		if (contact->dirty)
 		{
+			if (contact->data.contactFlags &
+			    (RDPINPUT_CONTACT_FLAG_UP | RDPINPUT_CONTACT_FLAG_CANCELED))
+				rdpei->contactEnded = TRUE;
+
 			penContacts[penFrame.contactCount++] = contact->data;
 			contact->dirty = FALSE;
 		}
@@ -457,13 +569,19 @@ static BOOL rdpei_poll_run_unlocked(rdpContext* context, void* userdata)
 
 	const UINT64 now = GetTickCount64();
 
-	/* Send an event every ~20ms */
-	if ((now < rdpei->lastPollEventTime) || (now - rdpei->lastPollEventTime < 20ULL))
+	/* Queue a frame every frame interval, send the queue at the flush deadline */
+	if ((now < rdpei->lastPollEventTime) ||
+	    (now - rdpei->lastPollEventTime < RDPEI_FRAME_INTERVAL))
 		return TRUE;
 
 	rdpei->lastPollEventTime = now;
 
-	const UINT error = rdpei_update(rdpei->base.log, rdpei->context);
+	UINT error = rdpei_update(rdpei->base.log, rdpei->context);
+
+	/* The end of a gesture is not delayed, the server might wait for it */
+	if (error == CHANNEL_RC_OK)
+		error = rdpei_flush(rdpei, now, rdpei->contactEnded);
+	rdpei->contactEnded = FALSE;
 
 	(void)ResetEvent(rdpei->event);
 
@@ -508,7 +626,7 @@ static DWORD WINAPI rdpei_periodic_update(LPVOID arg)
 
 	while (rdpei->running)
 	{
-		const DWORD status = WaitForSingleObject(rdpei->event, 20);
+		const DWORD status = WaitForSingleObject(rdpei->event, RDPEI_FRAME_INTERVAL);
 
 		if (status == WAIT_FAILED)
 		{
@@ -705,12 +823,13 @@ static UINT rdpei_write_touch_frame(wLog* log, wStream* s, RDPINPUT_TOUCH_FRAME*
 /**
  * Function description
  *
+ * Appends \b frame to the touch batch, which is sent right away if it is full.
+ *
  * @return 0 on success, otherwise a Win32 error code
  */
-static UINT rdpei_send_touch_event_pdu(GENERIC_CHANNEL_CALLBACK* callback,
-                                       RDPINPUT_TOUCH_FRAME* frame)
+static UINT rdpei_queue_touch_frame(GENERIC_CHANNEL_CALLBACK* callback,
+                                    RDPINPUT_TOUCH_FRAME* frame, UINT64 now)
 {
-	UINT status = ERROR_OUTOFMEMORY;
 	WINPR_ASSERT(callback);
 
 	RDPEI_PLUGIN* rdpei = (RDPEI_PLUGIN*)callback->plugin;
@@ -722,42 +841,25 @@ static UINT rdpei_send_touch_event_pdu(GENERIC_CHANNEL_CALLBACK* callback,
 	if (!frame)
 		return ERROR_INTERNAL_ERROR;
 
-	size_t pduLength = 64ULL + (64ULL * frame->contactCount);
-	wStream* s = Stream_New(nullptr, pduLength);
-
-	if (!s)
-	{
-		WLog_Print(rdpei->base.log, WLOG_ERROR, "Stream_New failed!");
-		return CHANNEL_RC_NO_MEMORY;
-	}
-
-	if (!Stream_SafeSeek(s, RDPINPUT_HEADER_LENGTH))
-		goto fail;
-	/**
-	 * the time that has elapsed (in milliseconds) from when the oldest touch frame
-	 * was generated to when it was encoded for transmission by the client.
-	 */
-	if (!rdpei_write_4byte_unsigned(
-	        s, (UINT32)frame->frameOffset)) /* encodeTime (FOUR_BYTE_UNSIGNED_INTEGER) */
-		goto fail;
-	if (!rdpei_write_2byte_unsigned(s, 1)) /* (frameCount) TWO_BYTE_UNSIGNED_INTEGER */
-		goto fail;
+	if (rdpei->touchBatchFrames == 0)
+		rdpei->touchBatchTime = now;
 
-	const UINT rc = rdpei_write_touch_frame(rdpei->base.log, s, frame);
+	const size_t pos = Stream_GetPosition(rdpei->touchBatch);
+	const UINT rc = rdpei_write_touch_frame(rdpei->base.log, rdpei->touchBatch, frame);
 	if (rc)
 	{
 		WLog_Print(rdpei->base.log, WLOG_ERROR,
 		           "rdpei_write_touch_frame failed with error %" PRIu32 "!", rc);
-		status = rc;
-		goto fail;
+		if (!Stream_SetPosition(rdpei->touchBatch, pos))
+			return ERROR_INVALID_DATA;
+		return rc;
 	}
 
-	Stream_SealLength(s);
-
-	status = rdpei_send_pdu(callback, s, EVENTID_TOUCH, Stream_Length(s));
-fail:
-	Stream_Free(s, TRUE);
-	return status;
+	rdpei->touchBatchFrames++;
+	if (rdpei->touchBatchFrames < RDPEI_MAX_BATCH_FRAMES)
+		return CHANNEL_RC_OK;
+	return rdpei_send_batch(callback, EVENTID_TOUCH, rdpei->touchBatch, &rdpei->touchBatchFrames,
+	                        rdpei->touchBatchTime, now);
 }
 
 /**
@@ -959,8 +1061,14 @@ static UINT rdpei_on_close(IWTSVirtualChannelCallback* pChannelCallback)
 		RDPEI_PLUGIN* rdpei = (RDPEI_PLUGIN*)callback->plugin;
 		if (rdpei && rdpei->base.listener_callback)
 		{
+			EnterCriticalSection(&rdpei->lock);
 			if (rdpei->base.listener_callback->channel_callback == callback)
+			{
+				/* The channel can't be written to anymore, the queued frames are stale */
+				rdpei_discard_batches(rdpei);
 				rdpei->base.listener_callback->channel_callback = nullptr;
+			}
+			LeaveCriticalSection(&rdpei->lock);
 		}
 	}
 	free(callback);
@@ -1016,11 +1124,11 @@ UINT rdpei_send_frame(RdpeiClientContext* context, RDPINPUT_TOUCH_FRAME* frame)
 		frame->frameOffset = rdpei->currentFrameTime - rdpei->previousFrameTime;
 	}
 
-	const UINT error = rdpei_send_touch_event_pdu(callback, frame);
+	const UINT error = rdpei_queue_touch_frame(callback, frame, currentTime);
 	if (error)
 	{
 		WLog_Print(rdpei->base.log, WLOG_ERROR,
-		           "rdpei_send_touch_event_pdu failed with error %" PRIu32 "!", error);
+		           "rdpei_queue_touch_frame failed with error %" PRIu32 "!", error);
 		return error;
 	}
 
@@ -1519,6 +1627,14 @@ static UINT init_plugin_cb(GENERIC_DYNVC_PLUGIN* base, rdpContext* rcontext, rdp
 		return CHANNEL_RC_NO_MEMORY;
 	}
 
+	rdpei->touchBatch = Stream_New(nullptr, 1024);
+	rdpei->penBatch = Stream_New(nullptr, 256);
+	if (!rdpei->touchBatch || !rdpei->penBatch)
+	{
+		WLog_Print(rdpei->base.log, WLOG_ERROR, "Stream_New failed!");
+		return CHANNEL_RC_NO_MEMORY;
+	}
+
 	RdpeiClientContext* context = (RdpeiClientContext*)calloc(1, sizeof(RdpeiClientContext));
 	if (!context)
 	{
@@ -1595,6 +1711,8 @@ static void terminate_plugin_cb(GENERIC_DYNVC_PLUGIN* base)
 		(void)CloseHandle(rdpei->event);
 
 	DeleteCriticalSection(&rdpei->lock);
+	Stream_Free(rdpei->touchBatch, TRUE);
+	Stream_Free(rdpei->penBatch, TRUE);
 	free(rdpei->context);
 }
 
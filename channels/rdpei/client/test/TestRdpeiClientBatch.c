@@ -0,0 +1,484 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Input Virtual Channel Extension client unit test
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+#include <winpr/stream.h>
+
+#include <freerdp/freerdp.h>
+#include <freerdp/addin.h>
+#include <freerdp/settings.h>
+#include <freerdp/autodetect.h>
+#include <freerdp/channels/channels.h>
+#include <freerdp/client/channels.h>
+#include <freerdp/client/rdpei.h>
+#include <freerdp/channels/rdpei.h>
+
+#include "../../rdpei_common.h"
+
+#define TEST_MAX_PDUS 8
+#define TEST_MAX_FRAMES 16 /* RDPEI_MAX_BATCH_FRAMES */
+#define TEST_MAX_POLLS 20
+#define TEST_FRAME_INTERVAL 10 /* RDPEI_FRAME_INTERVAL */
+#define TEST_RTT 200           /* gives the 50ms maximum flush interval */
+
+typedef struct
+{
+	IDRDYNVC_ENTRY_POINTS entry;
+	IWTSVirtualChannelManager mgr;
+	IWTSVirtualChannel channel;
+	IWTSListener listener;
+	IWTSListenerCallback* listenerCallback;
+	IWTSPlugin* plugin;
+	freerdp* instance;
+
+	wStream* pdus[TEST_MAX_PDUS];
+	size_t pduCount;
+} TEST_DVC;
+
+/* the first contact of a decoded frame */
+typedef struct
+{
+	UINT16 contactCount;
+	INT32 x;
+	UINT32 contactFlags;
+} TEST_FRAME;
+
+static TEST_DVC* test_from_entry(IDRDYNVC_ENTRY_POINTS* pEntryPoints)
+{
+	return (TEST_DVC*)pEntryPoints;
+}
+
+static UINT test_register_plugin(IDRDYNVC_ENTRY_POINTS* pEntryPoints,
+                                 WINPR_ATTR_UNUSED const char* name, IWTSPlugin* pPlugin)
+{
+	TEST_DVC* test = test_from_entry(pEntryPoints);
+	test->plugin = pPlugin;
+	return CHANNEL_RC_OK;
+}
+
+static IWTSPlugin* test_get_plugin(WINPR_ATTR_UNUSED IDRDYNVC_ENTRY_POINTS* pEntryPoints,
+                                   WINPR_ATTR_UNUSED const char* name)
+{
+	return nullptr;
+}
+
+static const ADDIN_ARGV* test_get_plugin_data(WINPR_ATTR_UNUSED IDRDYNVC_ENTRY_POINTS* pEntryPoints)
+{
+	return nullptr;
+}
+
+static rdpSettings* test_get_settings(IDRDYNVC_ENTRY_POINTS* pEntryPoints)
+{
+	return test_from_entry(pEntryPoints)->instance->context->settings;
+}
+
+static rdpContext* test_get_context(IDRDYNVC_ENTRY_POINTS* pEntryPoints)
+{
+	return test_from_entry(pEntryPoints)->instance->context;
+}
+
+static UINT test_create_listener(IWTSVirtualChannelManager* pChannelMgr,
+                                 WINPR_ATTR_UNUSED const char* pszChannelName,
+                                 WINPR_ATTR_UNUSED ULONG ulFlags,
+                                 IWTSListenerCallback* pListenerCallback, IWTSListener** ppListener)
+{
+	TEST_DVC* test = (TEST_DVC*)((BYTE*)pChannelMgr - offsetof(TEST_DVC, mgr));
+	test->listenerCallback = pListenerCallback;
+	*ppListener = &test->listener;
+	return CHANNEL_RC_OK;
+}
+
+static UINT test_destroy_listener(WINPR_ATTR_UNUSED IWTSVirtualChannelManager* pChannelMgr,
+                                  WINPR_ATTR_UNUSED IWTSListener* pListener)
+{
+	return CHANNEL_RC_OK;
+}
+
+static UINT test_channel_write(IWTSVirtualChannel* pChannel, ULONG cbSize, const BYTE* pBuffer,
+                               WINPR_ATTR_UNUSED void* pReserved)
+{
+	TEST_DVC* test = (TEST_DVC*)((BYTE*)pChannel - offsetof(TEST_DVC, channel));
+
+	if (test->pduCount >= TEST_MAX_PDUS)
+		return ERROR_INSUFFICIENT_BUFFER;
+
+	wStream* s = Stream_New(nullptr, cbSize);
+	if (!s)
+		return CHANNEL_RC_NO_MEMORY;
+	Stream_Write(s, pBuffer, cbSize);
+	Stream_SealLength(s);
+	Stream_ResetPosition(s);
+	test->pdus[test->pduCount++] = s;
+	return CHANNEL_RC_OK;
+}
+
+static UINT test_channel_close(WINPR_ATTR_UNUSED IWTSVirtualChannel* pChannel)
+{
+	return CHANNEL_RC_OK;
+}
+
+static void test_pdus_clear(TEST_DVC* test)
+{
+	for (size_t x = 0; x < test->pduCount; x++)
+		Stream_Free(test->pdus[x], TRUE);
+	test->pduCount = 0;
+}
+
+/* reads a variable length integer of [MS-RDPEI] 2.2.2, the \b countBits high bits of the first
+ * byte hold the number of following bytes, then comes the sign bit if \b sign is set */
+static BOOL test_read_var(wStream* s, BYTE countBits, BOOL sign, INT64* value)
+{
+	if (!Stream_CheckAndLogRequiredLength("test", s, 1))
+		return FALSE;
+
+	const BYTE first = Stream_Get_UINT8(s);
+	const size_t extra = first >> (8 - countBits);
+	const BYTE valueBits = (BYTE)(8 - countBits - (sign ? 1 : 0));
+	UINT64 magnitude = first & ((1u << valueBits) - 1);
+
+	if (!Stream_CheckAndLogRequiredLength("test", s, extra))
+		return FALSE;
+	for (size_t x = 0; x < extra; x++)
+		magnitude = (magnitude << 8) | Stream_Get_UINT8(s);
+
+	*value = (INT64)magnitude;
+	if (sign && (first & (0x80 >> countBits)))
+		*value = -*value;
+	return TRUE;
+}
+
+static BOOL test_skip_var(wStream* s, BYTE countBits, BOOL sign, size_t count)
+{
+	INT64 value = 0;
+	for (size_t x = 0; x < count; x++)
+	{
+		if (!test_read_var(s, countBits, sign, &value))
+			return FALSE;
+	}
+	return TRUE;
+}
+
+static BOOL test_read_contact(wStream* s, UINT16 eventId, TEST_FRAME* frame, BOOL first)
+{
+	INT64 fieldsPresent = 0;
+	INT64 x = 0;
+	INT64 y = 0;
+	INT64 contactFlags = 0;
+
+	if (!Stream_CheckAndLogRequiredLength("test", s, 1))
+		return FALSE;
+	Stream_Seek_UINT8(s); /* contactId or deviceId */
+
+	if (!test_read_var(s, 1, FALSE, &fieldsPresent) || !test_read_var(s, 2, TRUE, &x) ||
+	    !test_read_var(s, 2, TRUE, &y) || !test_read_var(s, 2, FALSE, &contactFlags))
+		return FALSE;
+
+	if (eventId == EVENTID_TOUCH)
+	{
+		if ((fieldsPresent & CONTACT_DATA_CONTACTRECT_PRESENT) && !test_skip_var(s, 1, TRUE, 4))
+			return FALSE;
+		if ((fieldsPresent & CONTACT_DATA_ORIENTATION_PRESENT) && !test_skip_var(s, 2, FALSE, 1))
+			return FALSE;
+		if ((fieldsPresent & CONTACT_DATA_PRESSURE_PRESENT) && !test_skip_var(s, 2, FALSE, 1))
+			return FALSE;
+	}
+	else
+	{
+		if ((fieldsPresent & RDPINPUT_PEN_CONTACT_PENFLAGS_PRESENT) &&
+		    !test_skip_var(s, 2, FALSE, 1))
+			return FALSE;
+		if ((fieldsPresent & RDPINPUT_PEN_CONTACT_PRESSURE_PRESENT) &&
+		    !test_skip_var(s, 2, FALSE, 1))
+			return FALSE;
+		if ((fieldsPresent & RDPINPUT_PEN_CONTACT_ROTATION_PRESENT) &&
+		    !test_skip_var(s, 1, FALSE, 1))
+			return FALSE;
+		if ((fieldsPresent & RDPINPUT_PEN_CONTACT_TILTX_PRESENT) && !test_skip_var(s, 1, TRUE, 1))
+			return FALSE;
+		if ((fieldsPresent & RDPINPUT_PEN_CONTACT_TILTY_PRESENT) && !test_skip_var(s, 1, TRUE, 1))
+			return FALSE;
+	}
+
+	if (first)
+	{
+		frame->x = (INT32)x;
+		frame->contactFlags = (UINT32)contactFlags;
+	}
+	return TRUE;
+}
+
+/* decodes a touch or pen event PDU, all of it must be consumed */
+static BOOL test_decode_event(wStream* s, UINT16 eventId, TEST_FRAME* frames, UINT16* frameCount)
+{
+	INT64 encodeTime = 0;
+	INT64 count = 0;
+
+	Stream_ResetPosition(s);
+	if (!Stream_CheckAndLogRequiredLength("test", s, 6) || (Stream_Get_UINT16(s) != eventId) ||
+	    (Stream_Get_UINT32(s) != Stream_Length(s)))
+		return FALSE;
+
+	if (!test_read_var(s, 2, FALSE, &encodeTime) || !test_read_var(s, 1, FALSE, &count) ||
+	    (count < 1) || (count > TEST_MAX_FRAMES))
+		return FALSE;
+
+	for (INT64 f = 0; f < count; f++)
+	{
+		INT64 contactCount = 0;
+		INT64 frameOffset = 0;
+		if (!test_read_var(s, 1, FALSE, &contactCount) || !test_read_var(s, 3, FALSE, &frameOffset))
+			return FALSE;
+
+		frames[f].contactCount = (UINT16)contactCount;
+		for (INT64 k = 0; k < contactCount; k++)
+		{
+			if (!test_read_contact(s, eventId, &frames[f], k == 0))
+				return FALSE;
+		}
+	}
+
+	*frameCount = (UINT16)count;
+	return Stream_GetRemainingLength(s) == 0;
+}
+
+/* runs the contact sampling of the synchronous channel once a frame interval passed */
+static BOOL test_poll(TEST_DVC* test)
+{
+	Sleep(TEST_FRAME_INTERVAL + 1);
+	return freerdp_channels_check_fds(test->instance->context->channels, test->instance);
+}
+
+static BOOL test_expect_pdus(TEST_DVC* test, size_t count, const char* what)
+{
+	if (test->pduCount != count)
+	{
+		(void)fprintf(stderr, "%s: %" PRIuz " PDUs sent, expected %" PRIuz "\n", what,
+		              test->pduCount, count);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+static UINT test_begin(RdpeiClientContext* rdpei, BOOL pen, INT32 id, INT32 x)
+{
+	INT32 contactId = 0;
+	if (pen)
+		return rdpei->PenBegin(rdpei, id, 0, x, 10);
+	return rdpei->TouchBegin(rdpei, id, x, 10, &contactId);
+}
+
+static UINT test_update(RdpeiClientContext* rdpei, BOOL pen, INT32 id, INT32 x)
+{
+	INT32 contactId = 0;
+	if (pen)
+		return rdpei->PenUpdate(rdpei, id, 0, x, 10);
+	return rdpei->TouchUpdate(rdpei, id, x, 10, &contactId);
+}
+
+static UINT test_end(RdpeiClientContext* rdpei, BOOL pen, INT32 id, INT32 x)
+{
+	INT32 contactId = 0;
+	if (pen)
+		return rdpei->PenEnd(rdpei, id, 0, x, 10);
+	return rdpei->TouchEnd(rdpei, id, x, 10, &contactId);
+}
+
+/* the frames sampled while a contact moves go out together once the oldest is about to exceed
+ * the flush interval, a frame lifting the contact is sent at once */
+static BOOL test_batch(TEST_DVC* test, RdpeiClientContext* rdpei, BOOL pen)
+{
+	BOOL rc = FALSE;
+	const UINT16 eventId = pen ? EVENTID_PEN : EVENTID_TOUCH;
+	const char* what = pen ? "pen" : "touch";
+	TEST_FRAME frames[TEST_MAX_FRAMES] = WINPR_C_ARRAY_INIT;
+	UINT16 frameCount = 0;
+	INT32 x = 10;
+
+	/* the first frame is never sent on its own, its age is 0 when it is queued */
+	test_pdus_clear(test);
+	if ((test_begin(rdpei, pen, 1, x) != CHANNEL_RC_OK) || !test_poll(test) ||
+	    !test_expect_pdus(test, 0, what))
+		return FALSE;
+
+	for (size_t poll = 0; (poll < TEST_MAX_POLLS) && (test->pduCount == 0); poll++)
+	{
+		if ((test_update(rdpei, pen, 1, ++x) != CHANNEL_RC_OK) || !test_poll(test))
+			goto fail;
+	}
+
+	if (!test_expect_pdus(test, 1, what) ||
+	    !test_decode_event(test->pdus[0], eventId, frames, &frameCount) || (frameCount < 2))
+	{
+		(void)fprintf(stderr, "%s: batch of %" PRIu16 " frames\n", what, frameCount);
+		goto fail;
+	}
+
+	if (!(frames[0].contactFlags & RDPINPUT_CONTACT_FLAG_DOWN))
+		goto fail;
+	for (size_t f = 0; f < frameCount; f++)
+	{
+		if ((frames[f].contactCount != 1) || ((f > 0) && (frames[f].x <= frames[f - 1].x)))
+		{
+			(void)fprintf(stderr, "%s: frame %" PRIuz " out of order\n", what, f);
+			goto fail;
+		}
+	}
+
+	/* the batch is empty, a frame queued now would wait for the flush interval */
+	test_pdus_clear(test);
+	if ((test_end(rdpei, pen, 1, x) != CHANNEL_RC_OK) || !test_poll(test))
+		goto fail;
+
+	if (!test_expect_pdus(test, 1, what) ||
+	    !test_decode_event(test->pdus[0], eventId, frames, &frameCount) ||
+	    !(frames[frameCount - 1].contactFlags & RDPINPUT_CONTACT_FLAG_UP))
+	{
+		(void)fprintf(stderr, "%s: contact end was not flushed\n", what);
+		goto fail;
+	}
+
+	/* nothing is left, a hovering pen is batched again */
+	test_pdus_clear(test);
+	if (!test_poll(test) || !test_expect_pdus(test, 0, what))
+		goto fail;
+
+	/* the pen leaving the range flushes the hover frames */
+	if (pen)
+	{
+		if ((rdpei->PenHoverCancel(rdpei, 1, 0, x, 10) != CHANNEL_RC_OK) || !test_poll(test))
+			goto fail;
+
+		if (!test_expect_pdus(test, 1, what) ||
+		    !test_decode_event(test->pdus[0], eventId, frames, &frameCount) ||
+		    !(frames[frameCount - 1].contactFlags & RDPINPUT_CONTACT_FLAG_CANCELED))
+		{
+			(void)fprintf(stderr, "%s: hover cancel was not flushed\n", what);
+			goto fail;
+		}
+	}
+
+	rc = TRUE;
+fail:
+	test_pdus_clear(test);
+	return rc;
+}
+
+/* a canceled contact is sent at once too */
+static BOOL test_cancel(TEST_DVC* test, RdpeiClientContext* rdpei)
+{
+	BOOL rc = FALSE;
+	INT32 contactId = 0;
+	TEST_FRAME frames[TEST_MAX_FRAMES] = WINPR_C_ARRAY_INIT;
+	UINT16 frameCount = 0;
+
+	test_pdus_clear(test);
+	if ((rdpei->TouchBegin(rdpei, 2, 50, 50, &contactId) != CHANNEL_RC_OK) || !test_poll(test) ||
+	    !test_expect_pdus(test, 0, "cancel"))
+		goto fail;
+
+	if ((rdpei->TouchCancel(rdpei, 2, 50, 50, &contactId) != CHANNEL_RC_OK) || !test_poll(test))
+		goto fail;
+
+	if (!test_expect_pdus(test, 1, "cancel") ||
+	    !test_decode_event(test->pdus[0], EVENTID_TOUCH, frames, &frameCount) ||
+	    (frameCount != 2) || !(frames[0].contactFlags & RDPINPUT_CONTACT_FLAG_DOWN) ||
+	    !(frames[1].contactFlags & RDPINPUT_CONTACT_FLAG_CANCELED))
+	{
+		(void)fprintf(stderr, "cancel: contact cancel was not flushed\n");
+		goto fail;
+	}
+
+	rc = TRUE;
+fail:
+	test_pdus_clear(test);
+	return rc;
+}
+
+int TestRdpeiClientBatch(int argc, char* argv[])
+{
+	int rc = -1;
+	TEST_DVC test = WINPR_C_ARRAY_INIT;
+	IWTSVirtualChannelCallback* callback = nullptr;
+
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	PVIRTUALCHANNELENTRY fkt = freerdp_channels_load_static_addin_entry(
+	    RDPEI_CHANNEL_NAME, nullptr, nullptr, FREERDP_ADDIN_CHANNEL_DYNAMIC);
+	PDVC_PLUGIN_ENTRY entry = WINPR_FUNC_PTR_CAST(fkt, PDVC_PLUGIN_ENTRY);
+	if (!entry)
+	{
+		(void)fprintf(stderr, "rdpei is not built in, skipping\n");
+		return 0;
+	}
+
+	test.instance = freerdp_new();
+	if (!test.instance || !freerdp_context_new(test.instance))
+		goto fail;
+
+	/* contacts are sampled from freerdp_channels_check_fds instead of a thread */
+	rdpContext* context = test.instance->context;
+	if (!freerdp_settings_set_bool(context->settings, FreeRDP_SynchronousDynamicChannels, TRUE))
+		goto fail;
+	context->autodetect->netCharAverageRTT = TEST_RTT;
+
+	test.entry.RegisterPlugin = test_register_plugin;
+	test.entry.GetPlugin = test_get_plugin;
+	test.entry.GetPluginData = test_get_plugin_data;
+	test.entry.GetRdpSettings = test_get_settings;
+	test.entry.GetRdpContext = test_get_context;
+	test.mgr.CreateListener = test_create_listener;
+	test.mgr.DestroyListener = test_destroy_listener;
+	test.channel.Write = test_channel_write;
+	test.channel.Close = test_channel_close;
+
+	if (entry(&test.entry) != CHANNEL_RC_OK)
+		goto fail;
+
+	if (!test.plugin || (test.plugin->Initialize(test.plugin, &test.mgr) != CHANNEL_RC_OK) ||
+	    !test.listenerCallback)
+		goto fail;
+
+	BOOL accept = TRUE;
+	if (test.listenerCallback->OnNewChannelConnection(test.listenerCallback, &test.channel,
+	                                                  nullptr, &accept,
+	                                                  &callback) != CHANNEL_RC_OK)
+		goto fail;
+
+	RdpeiClientContext* rdpei = test.plugin->pInterface;
+	if (!test_batch(&test, rdpei, FALSE) || !test_batch(&test, rdpei, TRUE) ||
+	    !test_cancel(&test, rdpei))
+		goto fail;
+
+	rc = 0;
+fail:
+	if (callback)
+		(void)callback->OnClose(callback);
+	if (test.plugin)
+		(void)test.plugin->Terminated(test.plugin);
+	test_pdus_clear(&test);
+	if (test.instance)
+		freerdp_context_free(test.instance);
+	freerdp_free(test.instance);
+	if (rc != 0)
+		(void)fprintf(stderr, "TestRdpeiClientBatch failed\n");
+	return rc;
+}
@@ -67,6 +67,16 @@ struct s_rdpei_server_private
 	RDPINPUT_TOUCH_EVENT touchEvent;
 	RDPINPUT_PEN_EVENT penEvent;
 
+	/* frames and contacts of the last event, kept to decode the next one without allocations */
+	RDPINPUT_TOUCH_FRAME* touchFrames;
+	size_t touchFramesSize;
+	RDPINPUT_CONTACT_DATA* touchContacts;
+	size_t touchContactsSize;
+	RDPINPUT_PEN_FRAME* penFrames;
+	size_t penFramesSize;
+	RDPINPUT_PEN_CONTACT* penContacts;
+	size_t penContactsSize;
+
 	enum RdpEiState automataState;
 };
 
@@ -359,6 +369,10 @@ void rdpei_server_context_free(RdpeiServerContext* context)
 			(void)WTSVirtualChannelClose(priv->channelHandle);
 		Stream_Free(priv->inputStream, TRUE);
 		Stream_Free(priv->outputStream, TRUE);
+		free(priv->touchFrames);
+		free(priv->touchContacts);
+		free(priv->penFrames);
+		free(priv->penContacts);
 	}
 	free(priv);
 	free(context);
@@ -500,14 +514,38 @@ static UINT read_pen_contact(RdpeiServerContext* context, wStream* s,
 	return CHANNEL_RC_OK;
 }
 
+/* Grows \b data to hold at least \b count elements of \b size bytes.
+ * Returns the new array or nullptr, in which case \b data is left untouched. */
+static void* rdpei_server_reserve(void* data, size_t* capacity, size_t count, size_t size)
+{
+	WINPR_ASSERT(capacity);
+
+	if (data && (count <= *capacity))
+		return data;
+
+	size_t newCapacity = (*capacity > 0) ? *capacity : 16;
+	while (newCapacity < count)
+		newCapacity *= 2;
+
+	void* tmp = realloc(data, newCapacity * size);
+	if (!tmp)
+		return nullptr;
+	*capacity = newCapacity;
+	return tmp;
+}
+
 /**
  * Function description
  *
+ * Reads a frame header and its contacts to the contact storage starting at \b used.
+ * frame->contacts is assigned by the caller once the whole event is decoded.
+ *
  * @return 0 on success, otherwise a Win32 error code
  */
-static UINT read_touch_frame(RdpeiServerContext* context, wStream* s, RDPINPUT_TOUCH_FRAME* frame)
+static UINT read_touch_frame(RdpeiServerContext* context, wStream* s, RDPINPUT_TOUCH_FRAME* frame,
+                             size_t used)
 {
-	RDPINPUT_CONTACT_DATA* contact = nullptr;
+	RdpeiServerPrivate* priv = context->priv;
 	UINT error = 0;
 
 	if (!rdpei_read_2byte_unsigned(s, &frame->contactCount) ||
@@ -517,29 +555,45 @@ static UINT read_touch_frame(RdpeiServerContext* context, wStream* s, RDPINPUT_T
 		return ERROR_INTERNAL_ERROR;
 	}
 
-	frame->contacts = contact = calloc(frame->contactCount, sizeof(RDPINPUT_CONTACT_DATA));
-	if (!frame->contacts)
+	/* contactId, fieldsPresent, x, y and contactFlags take at least a byte each */
+	if (!Stream_CheckAndLogRequiredLengthOfSize(TAG, s, frame->contactCount, 5ull))
+		return ERROR_INVALID_DATA;
+
+	RDPINPUT_CONTACT_DATA* contacts =
+	    rdpei_server_reserve(priv->touchContacts, &priv->touchContactsSize,
+	                         used + frame->contactCount, sizeof(RDPINPUT_CONTACT_DATA));
+	if (!contacts)
 	{
-		WLog_ERR(TAG, "calloc failed!");
+		WLog_ERR(TAG, "realloc failed!");
 		return CHANNEL_RC_NO_MEMORY;
 	}
+	priv->touchContacts = contacts;
 
-	for (UINT32 i = 0; i < frame->contactCount; i++, contact++)
+	memset(&contacts[used], 0, frame->contactCount * sizeof(RDPINPUT_CONTACT_DATA));
+	for (UINT32 i = 0; i < frame->contactCount; i++)
 	{
+		RDPINPUT_CONTACT_DATA* contact = &contacts[used + i];
+
 		if ((error = read_touch_contact_data(context, s, contact)))
 		{
 			WLog_ERR(TAG, "read_touch_contact_data failed with error %" PRIu32 "!", error);
-			frame->contactCount = WINPR_ASSERTING_INT_CAST(UINT16, i);
-			touch_frame_reset(frame);
 			return error;
 		}
 	}
 	return CHANNEL_RC_OK;
 }
 
-static UINT read_pen_frame(RdpeiServerContext* context, wStream* s, RDPINPUT_PEN_FRAME* frame)
+/**
+ * Function description
+ *
+ * Like read_touch_frame for pen frames.
+ *
+ * @return 0 on success, otherwise a Win32 error code
+ */
+static UINT read_pen_frame(RdpeiServerContext* context, wStream* s, RDPINPUT_PEN_FRAME* frame,
+                           size_t used)
 {
-	RDPINPUT_PEN_CONTACT* contact = nullptr;
+	RdpeiServerPrivate* priv = context->priv;
 	UINT error = 0;
 
 	if (!rdpei_read_2byte_unsigned(s, &frame->contactCount) ||
@@ -549,21 +603,28 @@ static UINT read_pen_frame(RdpeiServerContext* context, wStream* s, RDPINPUT_PEN
 		return ERROR_INTERNAL_ERROR;
 	}
 
-	frame->contacts = contact = calloc(frame->contactCount, sizeof(RDPINPUT_PEN_CONTACT));
-	if (!frame->contacts)
+	/* deviceId, fieldsPresent, x, y and contactFlags take at least a byte each */
+	if (!Stream_CheckAndLogRequiredLengthOfSize(TAG, s, frame->contactCount, 5ull))
+		return ERROR_INVALID_DATA;
+
+	RDPINPUT_PEN_CONTACT* contacts =
+	    rdpei_server_reserve(priv->penContacts, &priv->penContactsSize,
+	                         used + frame->contactCount, sizeof(RDPINPUT_PEN_CONTACT));
+	if (!contacts)
 	{
-		WLog_ERR(TAG, "calloc failed!");
+		WLog_ERR(TAG, "realloc failed!");
 		return CHANNEL_RC_NO_MEMORY;
 	}
+	priv->penContacts = contacts;
 
-	for (UINT32 i = 0; i < frame->contactCount; i++, contact++)
+	memset(&contacts[used], 0, frame->contactCount * sizeof(RDPINPUT_PEN_CONTACT));
+	for (UINT32 i = 0; i < frame->contactCount; i++)
 	{
+		RDPINPUT_PEN_CONTACT* contact = &contacts[used + i];
+
 		if ((error = read_pen_contact(context, s, contact)))
 		{
-			WLog_ERR(TAG, "read_touch_contact_data failed with error %" PRIu32 "!", error);
-			frame->contactCount = WINPR_ASSERTING_INT_CAST(UINT16, i);
-
-			pen_frame_reset(frame);
+			WLog_ERR(TAG, "read_pen_contact failed with error %" PRIu32 "!", error);
 			return error;
 		}
 	}
@@ -573,6 +634,8 @@ static UINT read_pen_frame(RdpeiServerContext* context, wStream* s, RDPINPUT_PEN
 /**
  * Function description
  *
+ * Decodes all frames of a (possibly batched) touch event into storage reused across events.
+ *
  * @return 0 on success, otherwise a Win32 error code
  */
 static UINT read_touch_event(RdpeiServerContext* context, wStream* s)
@@ -582,11 +645,10 @@ static UINT read_touch_event(RdpeiServerContext* context, wStream* s)
 	WINPR_ASSERT(context);
 	WINPR_ASSERT(context->priv);
 
-	RDPINPUT_TOUCH_EVENT* event = &context->priv->touchEvent;
-	WINPR_ASSERT(event);
-
-	RDPINPUT_TOUCH_FRAME* frame = nullptr;
+	RdpeiServerPrivate* priv = context->priv;
+	RDPINPUT_TOUCH_EVENT* event = &priv->touchEvent;
 	UINT error = CHANNEL_RC_OK;
+	size_t used = 0;
 
 	if (!rdpei_read_4byte_unsigned(s, &event->encodeTime) ||
 	    !rdpei_read_2byte_unsigned(s, &frameCount))
@@ -595,40 +657,67 @@ static UINT read_touch_event(RdpeiServerContext* context, wStream* s)
 		return ERROR_INTERNAL_ERROR;
 	}
 
-	event->frameCount = frameCount;
-	event->frames = frame = calloc(event->frameCount, sizeof(RDPINPUT_TOUCH_FRAME));
-	if (!event->frames)
+	/* contactCount and frameOffset take at least a byte each */
+	if (!Stream_CheckAndLogRequiredLengthOfSize(TAG, s, frameCount, 2ull))
+		return ERROR_INVALID_DATA;
+
+	RDPINPUT_TOUCH_FRAME* frames = rdpei_server_reserve(priv->touchFrames, &priv->touchFramesSize,
+	                                                    frameCount, sizeof(RDPINPUT_TOUCH_FRAME));
+	if (!frames)
 	{
-		WLog_ERR(TAG, "calloc failed!");
+		WLog_ERR(TAG, "realloc failed!");
 		return CHANNEL_RC_NO_MEMORY;
 	}
+	priv->touchFrames = frames;
 
-	for (UINT32 i = 0; i < frameCount; i++, frame++)
+	for (UINT32 i = 0; i < frameCount; i++)
 	{
-		if ((error = read_touch_frame(context, s, frame)))
+		if ((error = read_touch_frame(context, s, &frames[i], used)))
 		{
-			WLog_ERR(TAG, "read_touch_contact_data failed with error %" PRIu32 "!", error);
-			event->frameCount = WINPR_ASSERTING_INT_CAST(UINT16, i);
-
-			goto out_cleanup;
+			WLog_ERR(TAG, "read_touch_frame failed with error %" PRIu32 "!", error);
+			return error;
 		}
+		used += frames[i].contactCount;
 	}
 
+	/* The contact storage may have moved while decoding, assign the pointers last */
+	used = 0;
+	for (UINT32 i = 0; i < frameCount; i++)
+	{
+		frames[i].contacts = &priv->touchContacts[used];
+		used += frames[i].contactCount;
+	}
+
+	event->frameCount = frameCount;
+	event->frames = frames;
+
 	IFCALLRET(context->onTouchEvent, error, context, event);
 	if (error)
 		WLog_ERR(TAG, "context->onTouchEvent failed with error %" PRIu32 "", error);
 
-out_cleanup:
-	touch_event_reset(event);
+	event->frameCount = 0;
+	event->frames = nullptr;
 	return error;
 }
 
+/**
+ * Function description
+ *
+ * Decodes all frames of a (possibly batched) pen event into storage reused across events.
+ *
+ * @return 0 on success, otherwise a Win32 error code
+ */
 static UINT read_pen_event(RdpeiServerContext* context, wStream* s)
 {
 	UINT16 frameCount = 0;
-	RDPINPUT_PEN_EVENT* event = &context->priv->penEvent;
-	RDPINPUT_PEN_FRAME* frame = nullptr;
+
+	WINPR_ASSERT(context);
+	WINPR_ASSERT(context->priv);
+
+	RdpeiServerPrivate* priv = context->priv;
+	RDPINPUT_PEN_EVENT* event = &priv->penEvent;
 	UINT error = CHANNEL_RC_OK;
+	size_t used = 0;
 
 	if (!rdpei_read_4byte_unsigned(s, &event->encodeTime) ||
 	    !rdpei_read_2byte_unsigned(s, &frameCount))
@@ -637,31 +726,46 @@ static UINT read_pen_event(RdpeiServerContext* context, wStream* s)
 		return ERROR_INTERNAL_ERROR;
 	}
 
-	event->frameCount = frameCount;
-	event->frames = frame = calloc(event->frameCount, sizeof(RDPINPUT_PEN_FRAME));
-	if (!event->frames)
+	/* contactCount and frameOffset take at least a byte each */
+	if (!Stream_CheckAndLogRequiredLengthOfSize(TAG, s, frameCount, 2ull))
+		return ERROR_INVALID_DATA;
+
+	RDPINPUT_PEN_FRAME* frames = rdpei_server_reserve(priv->penFrames, &priv->penFramesSize,
+	                                                  frameCount, sizeof(RDPINPUT_PEN_FRAME));
+	if (!frames)
 	{
-		WLog_ERR(TAG, "calloc failed!");
+		WLog_ERR(TAG, "realloc failed!");
 		return CHANNEL_RC_NO_MEMORY;
 	}
+	priv->penFrames = frames;
 
-	for (UINT32 i = 0; i < frameCount; i++, frame++)
+	for (UINT32 i = 0; i < frameCount; i++)
 	{
-		if ((error = read_pen_frame(context, s, frame)))
+		if ((error = read_pen_frame(context, s, &frames[i], used)))
 		{
 			WLog_ERR(TAG, "read_pen_frame failed with error %" PRIu32 "!", error);
-			event->frameCount = WINPR_ASSERTING_INT_CAST(UINT16, i);
-
-			goto out_cleanup;
+			return error;
 		}
+		used += frames[i].contactCount;
 	}
 
+	/* The contact storage may have moved while decoding, assign the pointers last */
+	used = 0;
+	for (UINT32 i = 0; i < frameCount; i++)
+	{
+		frames[i].contacts = &priv->penContacts[used];
+		used += frames[i].contactCount;
+	}
+
+	event->frameCount = frameCount;
+	event->frames = frames;
+
 	IFCALLRET(context->onPenEvent, error, context, event);
 	if (error)
 		WLog_ERR(TAG, "context->onPenEvent failed with error %" PRIu32 "", error);
 
-out_cleanup:
-	pen_event_reset(event);
+	event->frameCount = 0;
+	event->frames = nullptr;
 	return error;
 }
 
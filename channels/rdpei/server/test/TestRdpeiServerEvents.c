@@ -0,0 +1,462 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Input Virtual Channel Extension server unit test
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+
+#include <winpr/crt.h>
+#include <winpr/wtsapi.h>
+#include <winpr/stream.h>
+
+#include <freerdp/peer.h>
+#include <freerdp/constants.h>
+#include <freerdp/channels/channels.h>
+#include <freerdp/channels/wtsvc.h>
+#include <freerdp/server/rdpei.h>
+
+#include "../../rdpei_common.h"
+#include "../../../../libfreerdp/core/mcs.h"
+#include "../../../../libfreerdp/core/rdp.h"
+
+#define TEST_SVC_CHANNEL_ID 1004
+#define TEST_DVC_CHANNEL_ID 1
+#define TEST_MAX_FRAMES 32
+#define TEST_PEN_PRESSURE 512
+
+typedef struct
+{
+	freerdp_peer* client;
+	HANDLE vcm;
+	RdpeiServerContext* rdpei;
+
+	/* what the next event must contain, see test_write_event */
+	const UINT16* counts;
+	UINT16 frameCount;
+	UINT32 events;
+	BOOL mismatch;
+} TEST_SERVER;
+
+/* writes a variable length integer of [MS-RDPEI] 2.2.2, the \b countBits high bits of the first
+ * byte hold the number of following bytes, then comes the sign bit if \b sign is set */
+static BOOL test_write_var(wStream* s, BYTE countBits, BOOL sign, INT64 value)
+{
+	const BOOL negative = value < 0;
+	const UINT64 magnitude = negative ? (UINT64)(-value) : (UINT64)value;
+	const BYTE valueBits = (BYTE)(8 - countBits - (sign ? 1 : 0));
+	const BYTE maxExtra = (BYTE)((1u << countBits) - 1);
+	BYTE extra = 0;
+
+	while ((extra < maxExtra) && ((magnitude >> (valueBits + 8 * extra)) != 0))
+		extra++;
+	if ((magnitude >> (valueBits + 8 * extra)) != 0)
+		return FALSE;
+	if (!Stream_EnsureRemainingCapacity(s, 1ull + extra))
+		return FALSE;
+
+	BYTE first = (BYTE)((extra << (8 - countBits)) | (magnitude >> (8 * extra)));
+	if (negative)
+		first |= (BYTE)(0x80 >> countBits);
+	Stream_Write_UINT8(s, first);
+	for (BYTE x = extra; x > 0; x--)
+		Stream_Write_UINT8(s, (BYTE)(magnitude >> (8 * (x - 1))));
+	return TRUE;
+}
+
+#define test_write_2byte_unsigned(s, v) test_write_var((s), 1, FALSE, (v))
+#define test_write_4byte_unsigned(s, v) test_write_var((s), 2, FALSE, (v))
+#define test_write_4byte_signed(s, v) test_write_var((s), 2, TRUE, (v))
+#define test_write_8byte_unsigned(s, v) test_write_var((s), 3, FALSE, (v))
+
+/* contact k of frame f is at (f * 100 + k, f) */
+static INT32 test_contact_x(UINT32 frame, UINT32 contact)
+{
+	return (INT32)(frame * 100 + contact);
+}
+
+static BOOL test_write_contact(wStream* s, BOOL pen, UINT32 frame, UINT32 contact)
+{
+	const UINT16 fieldsPresent = pen ? RDPINPUT_PEN_CONTACT_PRESSURE_PRESENT : 0;
+
+	if (!Stream_EnsureRemainingCapacity(s, 1))
+		return FALSE;
+	Stream_Write_UINT8(s, (BYTE)contact); /* contactId or deviceId */
+	if (!test_write_2byte_unsigned(s, fieldsPresent) ||
+	    !test_write_4byte_signed(s, test_contact_x(frame, contact)) ||
+	    !test_write_4byte_signed(s, (INT32)frame) ||
+	    !test_write_4byte_unsigned(s, RDPINPUT_CONTACT_FLAG_UPDATE |
+	                                      RDPINPUT_CONTACT_FLAG_INRANGE |
+	                                      RDPINPUT_CONTACT_FLAG_INCONTACT))
+		return FALSE;
+	if (pen && !test_write_4byte_unsigned(s, TEST_PEN_PRESSURE))
+		return FALSE;
+	return TRUE;
+}
+
+/* a touch or pen event of \b frameCount frames, frame f holds counts[f] contacts */
+static BOOL test_write_event(wStream* s, BOOL pen, const UINT16* counts, UINT16 frameCount)
+{
+	if (!test_write_4byte_unsigned(s, 5) ||             /* encodeTime */
+	    !test_write_2byte_unsigned(s, frameCount))      /* frameCount */
+		return FALSE;
+
+	for (UINT32 f = 0; f < frameCount; f++)
+	{
+		if (!test_write_2byte_unsigned(s, counts[f]) || /* contactCount */
+		    !test_write_8byte_unsigned(s, f ? 10000 : 0)) /* frameOffset */
+			return FALSE;
+
+		for (UINT32 k = 0; k < counts[f]; k++)
+		{
+			if (!test_write_contact(s, pen, f, k))
+				return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+static wStream* test_pdu_new(UINT16 eventId)
+{
+	wStream* s = Stream_New(nullptr, 256);
+	if (!s)
+		return nullptr;
+
+	/* DYNVC_DATA header, then the RDPINPUT_HEADER */
+	Stream_Write_UINT8(s, DATA_PDU << 4);
+	Stream_Write_UINT8(s, TEST_DVC_CHANNEL_ID);
+	Stream_Write_UINT16(s, eventId);
+	Stream_Write_UINT32(s, 0); /* pduLength, set by test_pdu_send */
+	return s;
+}
+
+static BOOL test_pdu_send(TEST_SERVER* test, wStream* s)
+{
+	const size_t length = Stream_GetPosition(s);
+
+	if (!Stream_SetPosition(s, 4))
+		return FALSE;
+	Stream_Write_UINT32(s, (UINT32)(length - 2));
+	if (!Stream_SetPosition(s, length))
+		return FALSE;
+	return test->client->ReceiveChannelData(test->client, TEST_SVC_CHANNEL_ID,
+	                                        Stream_Buffer(s), length,
+	                                        CHANNEL_FLAG_FIRST | CHANNEL_FLAG_LAST, length);
+}
+
+/* sends an event and processes everything the channel received */
+static UINT test_send_event(TEST_SERVER* test, BOOL pen, const UINT16* counts, UINT16 frameCount)
+{
+	UINT error = ERROR_INTERNAL_ERROR;
+	wStream* s = test_pdu_new(pen ? EVENTID_PEN : EVENTID_TOUCH);
+
+	test->counts = counts;
+	test->frameCount = frameCount;
+	if (!s || !test_write_event(s, pen, counts, frameCount) || !test_pdu_send(test, s))
+		goto fail;
+
+	/* header and body are read separately, the drained channel reports a read fault */
+	for (size_t x = 0; x < 16; x++)
+	{
+		error = rdpei_server_handle_messages(test->rdpei);
+		if (error == ERROR_READ_FAULT)
+		{
+			error = CHANNEL_RC_OK;
+			break;
+		}
+		if (error != CHANNEL_RC_OK)
+			break;
+	}
+
+fail:
+	Stream_Free(s, TRUE);
+	return error;
+}
+
+static BOOL test_check_frame(TEST_SERVER* test, UINT32 frame, UINT16 contactCount)
+{
+	if ((frame >= test->frameCount) || (contactCount != test->counts[frame]))
+	{
+		(void)fprintf(stderr, "frame %" PRIu32 " has %" PRIu16 " contacts\n", frame,
+		              contactCount);
+		test->mismatch = TRUE;
+		return FALSE;
+	}
+	return TRUE;
+}
+
+static BOOL test_check_contact(TEST_SERVER* test, UINT32 frame, UINT32 contact, INT32 x, INT32 y)
+{
+	if ((x != test_contact_x(frame, contact)) || (y != (INT32)frame))
+	{
+		(void)fprintf(stderr, "contact %" PRIu32 " of frame %" PRIu32 " at %" PRId32 "x%" PRId32
+		                      "\n",
+		              contact, frame, x, y);
+		test->mismatch = TRUE;
+		return FALSE;
+	}
+	return TRUE;
+}
+
+static UINT test_on_touch_event(RdpeiServerContext* context,
+                                const RDPINPUT_TOUCH_EVENT* touchEvent)
+{
+	TEST_SERVER* test = context->user_data;
+
+	test->events++;
+	if (touchEvent->frameCount != test->frameCount)
+		test->mismatch = TRUE;
+
+	for (UINT32 f = 0; f < touchEvent->frameCount; f++)
+	{
+		const RDPINPUT_TOUCH_FRAME* frame = &touchEvent->frames[f];
+		if (!test_check_frame(test, f, frame->contactCount))
+			break;
+
+		for (UINT32 k = 0; k < frame->contactCount; k++)
+		{
+			const RDPINPUT_CONTACT_DATA* contact = &frame->contacts[k];
+			if ((contact->contactId != k) ||
+			    !test_check_contact(test, f, k, contact->x, contact->y))
+				test->mismatch = TRUE;
+		}
+	}
+	return CHANNEL_RC_OK;
+}
+
+static UINT test_on_pen_event(RdpeiServerContext* context, const RDPINPUT_PEN_EVENT* penEvent)
+{
+	TEST_SERVER* test = context->user_data;
+
+	test->events++;
+	if (penEvent->frameCount != test->frameCount)
+		test->mismatch = TRUE;
+
+	for (UINT32 f = 0; f < penEvent->frameCount; f++)
+	{
+		const RDPINPUT_PEN_FRAME* frame = &penEvent->frames[f];
+		if (!test_check_frame(test, f, frame->contactCount))
+			break;
+
+		for (UINT32 k = 0; k < frame->contactCount; k++)
+		{
+			const RDPINPUT_PEN_CONTACT* contact = &frame->contacts[k];
+			if ((contact->deviceId != k) || (contact->pressure != TEST_PEN_PRESSURE) ||
+			    !test_check_contact(test, f, k, contact->x, contact->y))
+				test->mismatch = TRUE;
+		}
+	}
+	return CHANNEL_RC_OK;
+}
+
+static void test_server_free(TEST_SERVER* test)
+{
+	rdpei_server_context_free(test->rdpei);
+	if (test->vcm && (test->vcm != INVALID_HANDLE_VALUE))
+		WTSCloseServer(test->vcm);
+	if (test->client)
+		freerdp_peer_context_free(test->client);
+	free(test->client);
+	memset(test, 0, sizeof(TEST_SERVER));
+}
+
+/* a peer with a ready drdynvc channel and an open input channel */
+static BOOL test_server_init(TEST_SERVER* test)
+{
+	memset(test, 0, sizeof(TEST_SERVER));
+	test->client = calloc(1, sizeof(freerdp_peer));
+	if (!test->client)
+		return FALSE;
+
+	test->client->ContextSize = sizeof(rdpContext);
+	if (!freerdp_peer_context_new(test->client))
+		goto fail;
+
+	rdpMcs* mcs = test->client->context->rdp->mcs;
+	mcs->channelCount = 1;
+	(void)strncpy(mcs->channels[0].Name, DRDYNVC_SVC_CHANNEL_NAME, CHANNEL_NAME_LEN);
+	mcs->channels[0].ChannelId = TEST_SVC_CHANNEL_ID;
+	mcs->channels[0].joined = TRUE;
+
+	test->vcm = WTSOpenServerA((LPSTR)test->client->context);
+	if (!test->vcm || (test->vcm == INVALID_HANDLE_VALUE) ||
+	    !WTSVirtualChannelManagerOpen(test->vcm))
+		goto fail;
+
+	/* DYNVC_CAPS_RSP, moves the drdynvc channel to DRDYNVC_STATE_READY */
+	const BYTE capsRsp[] = { 0x50, 0x00, 0x01, 0x00 };
+	if (!test->client->ReceiveChannelData(test->client, TEST_SVC_CHANNEL_ID, capsRsp,
+	                                      sizeof(capsRsp), CHANNEL_FLAG_FIRST | CHANNEL_FLAG_LAST,
+	                                      sizeof(capsRsp)))
+		goto fail;
+
+	test->rdpei = rdpei_server_context_new(test->vcm);
+	if (!test->rdpei)
+		goto fail;
+	test->rdpei->user_data = test;
+	test->rdpei->onTouchEvent = test_on_touch_event;
+	test->rdpei->onPenEvent = test_on_pen_event;
+	if (rdpei_server_init(test->rdpei) != CHANNEL_RC_OK)
+		goto fail;
+
+	/* DYNVC_CREATE_RSP for the input channel, HRESULT 0 */
+	const BYTE createRsp[] = { 0x10, TEST_DVC_CHANNEL_ID, 0x00, 0x00, 0x00, 0x00 };
+	if (!test->client->ReceiveChannelData(test->client, TEST_SVC_CHANNEL_ID, createRsp,
+	                                      sizeof(createRsp), CHANNEL_FLAG_FIRST | CHANNEL_FLAG_LAST,
+	                                      sizeof(createRsp)))
+		goto fail;
+
+	return TRUE;
+fail:
+	test_server_free(test);
+	return FALSE;
+}
+
+/* batched events are decoded into the reused frame and contact storage, which grows for a
+ * large event and still gives the right contacts for smaller ones afterwards */
+static BOOL test_multi_frame(void)
+{
+	BOOL rc = FALSE;
+	TEST_SERVER test = WINPR_C_ARRAY_INIT;
+	const UINT16 small[] = { 1, 2, 1 };
+	UINT16 large[TEST_MAX_FRAMES] = WINPR_C_ARRAY_INIT;
+
+	for (size_t x = 0; x < ARRAYSIZE(large); x++)
+		large[x] = (UINT16)(1 + (x % 5));
+
+	if (!test_server_init(&test))
+		return FALSE;
+
+	for (size_t x = 0; x < 2; x++)
+	{
+		const BOOL pen = (x != 0);
+		if ((test_send_event(&test, pen, small, ARRAYSIZE(small)) != CHANNEL_RC_OK) ||
+		    (test_send_event(&test, pen, large, ARRAYSIZE(large)) != CHANNEL_RC_OK) ||
+		    (test_send_event(&test, pen, small, ARRAYSIZE(small)) != CHANNEL_RC_OK))
+			goto fail;
+	}
+
+	if (test.mismatch || (test.events != 6))
+	{
+		(void)fprintf(stderr, "multi frame: %" PRIu32 " events decoded%s\n", test.events,
+		              test.mismatch ? ", content differs" : "");
+		goto fail;
+	}
+
+	rc = TRUE;
+fail:
+	test_server_free(&test);
+	return rc;
+}
+
+/* sends a touch or pen event with a frame or contact count the PDU is too short for */
+static BOOL test_invalid_count(BOOL pen, BOOL frames)
+{
+	BOOL rc = FALSE;
+	TEST_SERVER test = WINPR_C_ARRAY_INIT;
+	UINT16 counts[] = { 1, 1 };
+
+	if (!test_server_init(&test))
+		return FALSE;
+
+	wStream* s = test_pdu_new(pen ? EVENTID_PEN : EVENTID_TOUCH);
+	if (!s || !test_write_event(s, pen, counts, ARRAYSIZE(counts)))
+		goto fail;
+
+	/* claim more frames than follow, or more contacts in the last frame */
+	const size_t length = Stream_GetPosition(s);
+	/* frameCount follows the one byte encodeTime, then the contactCount of the first frame */
+	if (!Stream_SetPosition(s, frames ? 9 : 10))
+		goto fail;
+	Stream_Write_UINT8(s, 0x7F);
+	if (!Stream_SetPosition(s, length))
+		goto fail;
+
+	test.counts = counts;
+	test.frameCount = ARRAYSIZE(counts);
+	if (!test_pdu_send(&test, s))
+		goto fail;
+
+	UINT error = CHANNEL_RC_OK;
+	for (size_t x = 0; (x < 4) && (error == CHANNEL_RC_OK); x++)
+		error = rdpei_server_handle_messages(test.rdpei);
+
+	if ((error != ERROR_INVALID_DATA) || (test.events != 0))
+	{
+		(void)fprintf(stderr, "%s %s count: error %" PRIu32 ", %" PRIu32 " events\n",
+		              pen ? "pen" : "touch", frames ? "frame" : "contact", error, test.events);
+		goto fail;
+	}
+
+	rc = TRUE;
+fail:
+	Stream_Free(s, TRUE);
+	test_server_free(&test);
+	return rc;
+}
+
+/* a contact cut short after the counts passed the length checks */
+static BOOL test_truncated_contact(void)
+{
+	BOOL rc = FALSE;
+	TEST_SERVER test = WINPR_C_ARRAY_INIT;
+	const UINT16 counts[] = { 1, 3 };
+
+	if (!test_server_init(&test))
+		return FALSE;
+
+	wStream* s = test_pdu_new(EVENTID_TOUCH);
+	if (!s || !test_write_event(s, FALSE, counts, ARRAYSIZE(counts)))
+		goto fail;
+
+	/* drop the contactFlags of the last contact */
+	if (!Stream_SetPosition(s, Stream_GetPosition(s) - 1) || !test_pdu_send(&test, s))
+		goto fail;
+
+	UINT error = CHANNEL_RC_OK;
+	for (size_t x = 0; (x < 4) && (error == CHANNEL_RC_OK); x++)
+		error = rdpei_server_handle_messages(test.rdpei);
+
+	if ((error == CHANNEL_RC_OK) || (error == ERROR_READ_FAULT) || (test.events != 0))
+	{
+		(void)fprintf(stderr, "truncated contact: error %" PRIu32 ", %" PRIu32 " events\n",
+		              error, test.events);
+		goto fail;
+	}
+
+	rc = TRUE;
+fail:
+	Stream_Free(s, TRUE);
+	test_server_free(&test);
+	return rc;
+}
+
+int TestRdpeiServerEvents(WINPR_ATTR_UNUSED int argc, WINPR_ATTR_UNUSED char* argv[])
+{
+	WTSRegisterWtsApiFunctionTable(FreeRDP_InitWtsApi());
+
+	if (!test_multi_frame())
+		return -1;
+
+	for (size_t x = 0; x < 4; x++)
+	{
+		if (!test_invalid_count((x & 1) != 0, (x & 2) != 0))
+			return -1;
+	}
+
+	if (!test_truncated_contact())
+		return -1;
+
+	return 0;
+}
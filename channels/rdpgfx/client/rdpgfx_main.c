@@ -30,6 +30,7 @@
 #include <winpr/wlog.h>
 #include <winpr/print.h>
 #include <winpr/synch.h>
+#include <winpr/interlocked.h>
 #include <winpr/thread.h>
 #include <winpr/stream.h>
 #include <winpr/sysinfo.h>
@@ -48,6 +49,11 @@
 
 #define RDPGFX_NUMBER_CAPSETS 0x100
 
+/* Decompressed channel buffers that may wait for the decode thread. When they are used up
+ * the receiving side blocks, the server notices through the growing frame acknowledge
+ * queue depth. */
+#define RDPGFX_DECODE_QUEUE_DEPTH 16
+
 typedef struct
 {
 	uint64_t cntGfxCodecID[RDPGFX_CODECID_MAX];
@@ -794,6 +800,63 @@ static UINT rdpgfx_recv_reset_graphics_pdu(GENERIC_CHANNEL_CALLBACK* callback, w
 	return error;
 }
 
+static void rdpgfx_clear_pending_cache_slot(RDPGFX_PLUGIN* gfx, UINT16 cacheSlot)
+{
+	WINPR_ASSERT(gfx);
+
+	if ((cacheSlot > 0) && (cacheSlot <= gfx->MaxCacheSlots))
+		gfx->PendingCacheKeys[cacheSlot - 1] = 0;
+}
+
+static void rdpgfx_close_persistent_cache(RDPGFX_PLUGIN* gfx)
+{
+	WINPR_ASSERT(gfx);
+
+	persistent_cache_free(gfx->persistent);
+	gfx->persistent = nullptr;
+	gfx->OfferedCacheCount = 0;
+	ZeroMemory(gfx->PendingCacheKeys, sizeof(gfx->PendingCacheKeys));
+}
+
+/**
+ * Function description
+ *
+ * Bitmaps imported from a version 4 persistent cache are only read from the mapped cache file
+ * when the server first draws them.
+ *
+ * @return 0 on success, otherwise a Win32 error code
+ */
+static UINT rdpgfx_materialize_cache_slot(RDPGFX_PLUGIN* gfx, UINT16 cacheSlot)
+{
+	PERSISTENT_CACHE_ENTRY entry = WINPR_C_ARRAY_INIT;
+
+	WINPR_ASSERT(gfx);
+	RdpgfxClientContext* context = gfx->context;
+
+	if ((cacheSlot == 0) || (cacheSlot > gfx->MaxCacheSlots))
+		return CHANNEL_RC_OK;
+
+	const UINT64 key64 = gfx->PendingCacheKeys[cacheSlot - 1];
+	if ((key64 == 0) || !gfx->persistent)
+		return CHANNEL_RC_OK;
+
+	gfx->PendingCacheKeys[cacheSlot - 1] = 0;
+
+	if (persistent_cache_find_entry(gfx->persistent, key64, &entry) < 1)
+	{
+		WLog_Print(gfx->base.log, WLOG_WARN,
+		           "cache slot %" PRIu16 ": key 0x%016" PRIX64 " missing from persistent cache",
+		           cacheSlot, key64);
+		return CHANNEL_RC_OK;
+	}
+
+	if (!context || !context->ImportCacheEntry)
+		return CHANNEL_RC_OK;
+
+	entry.flags = PERSISTENT_CACHE_ENTRY_FLAG_USED;
+	return context->ImportCacheEntry(context, cacheSlot, &entry);
+}
+
 /**
  * Function description
  *
@@ -814,6 +877,7 @@ static UINT rdpgfx_recv_evict_cache_entry_pdu(GENERIC_CHANNEL_CALLBACK* callback
 	Stream_Read_UINT16(s, pdu.cacheSlot); /* cacheSlot (2 bytes) */
 	WLog_Print(gfx->base.log, WLOG_DEBUG, "RecvEvictCacheEntryPdu: cacheSlot: %" PRIu16 "",
 	           pdu.cacheSlot);
+	rdpgfx_clear_pending_cache_slot(gfx, pdu.cacheSlot);
 
 	if (context)
 	{
@@ -860,7 +924,8 @@ static UINT rdpgfx_save_persistent_cache(RDPGFX_PLUGIN* gfx)
 	if (!persistent)
 		return CHANNEL_RC_NO_MEMORY;
 
-	if (persistent_cache_open(persistent, BitmapCachePersistFile, TRUE, 3) < 1)
+	/* Version 4 appends to the existing cache file and commits the new index on close */
+	if (persistent_cache_open(persistent, BitmapCachePersistFile, TRUE, 4) < 1)
 	{
 		error = CHANNEL_RC_INITIALIZATION_ERROR;
 		goto fail;
@@ -868,23 +933,44 @@ static UINT rdpgfx_save_persistent_cache(RDPGFX_PLUGIN* gfx)
 
 	for (UINT16 idx = 0; idx < gfx->MaxCacheSlots; idx++)
 	{
-		if (gfx->CacheSlots[idx])
-		{
-			const UINT16 cacheSlot = idx;
-			PERSISTENT_CACHE_ENTRY cacheEntry = WINPR_C_ARRAY_INIT;
+		/* Microsoft uses 1-based indexing for the egfx bitmap cache ! */
+		const UINT16 cacheSlot = idx + 1;
+		PERSISTENT_CACHE_ENTRY cacheEntry = WINPR_C_ARRAY_INIT;
 
+		if (gfx->PendingCacheKeys[idx] && gfx->persistent)
+		{
+			/* Imported, but never drawn: keep it without marking it used */
+			if (persistent_cache_find_entry(gfx->persistent, gfx->PendingCacheKeys[idx],
+			                                &cacheEntry) < 1)
+				continue;
+		}
+		else if (gfx->CacheSlots[idx])
+		{
 			if (context->ExportCacheEntry(context, cacheSlot, &cacheEntry) != CHANNEL_RC_OK)
 				continue;
 
-			if (persistent_cache_write_entry(persistent, &cacheEntry) < 0)
-				goto fail;
+			cacheEntry.flags = PERSISTENT_CACHE_ENTRY_FLAG_USED;
+		}
+		else
+			continue;
+
+		if (cacheEntry.size == 0)
+			continue;
+
+		if (persistent_cache_write_entry(persistent, &cacheEntry) < 0)
+		{
+			error = ERROR_INTERNAL_ERROR;
+			goto fail;
 		}
 	}
 
-	persistent_cache_free(persistent);
+	/* The session cache maps the file that is about to be replaced, release it first */
+	rdpgfx_close_persistent_cache(gfx);
+	if (persistent_cache_close(persistent) < 0)
+		error = ERROR_INTERNAL_ERROR;
 
-	return error;
 fail:
+	rdpgfx_close_persistent_cache(gfx);
 	persistent_cache_free(persistent);
 	return error;
 }
@@ -982,6 +1068,7 @@ static UINT rdpgfx_send_cache_offer(RDPGFX_PLUGIN* gfx)
 	if (!BitmapCachePersistFile)
 		return CHANNEL_RC_OK;
 
+	rdpgfx_close_persistent_cache(gfx);
 	rdpPersistentCache* persistent = persistent_cache_new();
 
 	if (!persistent)
@@ -993,7 +1080,8 @@ static UINT rdpgfx_send_cache_offer(RDPGFX_PLUGIN* gfx)
 		goto fail;
 	}
 
-	if (persistent_cache_get_version(persistent) != 3)
+	const int version = persistent_cache_get_version(persistent);
+	if ((version != 3) && (version != 4))
 	{
 		error = ERROR_INVALID_DATA;
 		goto fail;
@@ -1034,6 +1122,7 @@ static UINT rdpgfx_send_cache_offer(RDPGFX_PLUGIN* gfx)
 
 		offer->cacheEntries[idx].cacheKey = entry.key64;
 		offer->cacheEntries[idx].bitmapLength = entry.size;
+		gfx->OfferedCacheKeys[idx] = entry.key64;
 	}
 
 	if (offer->cacheEntriesCount > 0)
@@ -1046,6 +1135,14 @@ static UINT rdpgfx_send_cache_offer(RDPGFX_PLUGIN* gfx)
 		}
 	}
 
+	/* Keep the mapped version 4 cache around to import entries on first use */
+	if (version == 4)
+	{
+		gfx->persistent = persistent;
+		gfx->OfferedCacheCount = offer->cacheEntriesCount;
+		persistent = nullptr;
+	}
+
 fail:
 	persistent_cache_free(persistent);
 	free(offer);
@@ -1077,6 +1174,26 @@ static UINT rdpgfx_load_cache_import_reply(RDPGFX_PLUGIN* gfx,
 	if (!BitmapCachePersistFile)
 		return CHANNEL_RC_OK;
 
+	if (gfx->persistent)
+	{
+		const UINT16 count = MIN(gfx->OfferedCacheCount, reply->importedEntriesCount);
+
+		WLog_Print(gfx->base.log, WLOG_DEBUG, "Receiving Cache Import Reply: %" PRIu16 "",
+		           count);
+
+		for (UINT16 idx = 0; idx < count; idx++)
+		{
+			const UINT16 cacheSlot = reply->cacheSlots[idx];
+
+			if ((cacheSlot == 0) || (cacheSlot > gfx->MaxCacheSlots))
+				continue;
+
+			gfx->PendingCacheKeys[cacheSlot - 1] = gfx->OfferedCacheKeys[idx];
+		}
+
+		return CHANNEL_RC_OK;
+	}
+
 	persistent = persistent_cache_new();
 
 	if (!persistent)
@@ -1341,6 +1458,11 @@ static UINT rdpgfx_recv_end_frame_pdu(GENERIC_CHANNEL_CALLBACK* callback, wStrea
 	const UINT64 EndFrameTime = end - start;
 	gfx->TotalDecodedFrames++;
 
+	/* With the decode thread running, track the frames still queued behind this one */
+	LONG queuedFrames = 0;
+	if (gfx->DecodeThread)
+		queuedFrames = InterlockedDecrement(&gfx->QueuedFrames);
+
 	if (!gfx->sendFrameAcks)
 		return error;
 
@@ -1360,6 +1482,8 @@ static UINT rdpgfx_recv_end_frame_pdu(GENERIC_CHANNEL_CALLBACK* callback, wStrea
 	else
 	{
 		ack.queueDepth = QUEUE_DEPTH_UNAVAILABLE;
+		if (queuedFrames > 0)
+			ack.queueDepth = WINPR_ASSERTING_INT_CAST(UINT32, queuedFrames);
 
 		if ((error = rdpgfx_send_frame_acknowledge_pdu(context, &ack)))
 			WLog_Print(gfx->base.log, WLOG_ERROR,
@@ -1836,6 +1960,7 @@ static UINT rdpgfx_recv_surface_to_cache_pdu(GENERIC_CHANNEL_CALLBACK* callback,
 	           "left: %" PRIu16 " top: %" PRIu16 " right: %" PRIu16 " bottom: %" PRIu16 "",
 	           pdu.surfaceId, pdu.cacheKey, pdu.cacheSlot, pdu.rectSrc.left, pdu.rectSrc.top,
 	           pdu.rectSrc.right, pdu.rectSrc.bottom);
+	rdpgfx_clear_pending_cache_slot(gfx, pdu.cacheSlot);
 
 	if (context)
 	{
@@ -1900,6 +2025,15 @@ static UINT rdpgfx_recv_cache_to_surface_pdu(GENERIC_CHANNEL_CALLBACK* callback,
 	           " destPtsCount: %" PRIu16 "",
 	           pdu.cacheSlot, pdu.surfaceId, pdu.destPtsCount);
 
+	error = rdpgfx_materialize_cache_slot(gfx, pdu.cacheSlot);
+	if (error)
+	{
+		WLog_Print(gfx->base.log, WLOG_ERROR,
+		           "rdpgfx_materialize_cache_slot failed with error %" PRIu32 "", error);
+		free(pdu.destPts);
+		return error;
+	}
+
 	if (context)
 	{
 		IFCALLRET(context->CacheToSurface, error, context, &pdu);
@@ -2292,6 +2426,198 @@ static UINT rdpgfx_recv_pdu(GENERIC_CHANNEL_CALLBACK* callback, wStream* s)
  *
  * @return 0 on success, otherwise a Win32 error code
  */
+static UINT rdpgfx_recv_pdus(GENERIC_CHANNEL_CALLBACK* callback, wStream* s)
+{
+	UINT error = CHANNEL_RC_OK;
+
+	WINPR_ASSERT(callback);
+	RDPGFX_PLUGIN* gfx = (RDPGFX_PLUGIN*)callback->plugin;
+	WINPR_ASSERT(gfx);
+
+	while (Stream_GetPosition(s) < Stream_Length(s))
+	{
+		if ((error = rdpgfx_recv_pdu(callback, s)))
+		{
+			WLog_Print(gfx->base.log, WLOG_ERROR, "rdpgfx_recv_pdu failed with error %" PRIu32 "!",
+			           error);
+			break;
+		}
+	}
+
+	return error;
+}
+
+/**
+ * Count the StartFrame PDUs in a decompressed buffer without decoding it, so frame
+ * acknowledgements can report how many frames are still queued for the decode thread.
+ */
+static LONG rdpgfx_count_start_frames(const BYTE* data, size_t length)
+{
+	LONG count = 0;
+	size_t offset = 0;
+
+	while (length - offset >= RDPGFX_HEADER_SIZE)
+	{
+		const UINT16 cmdId = winpr_Data_Get_UINT16(&data[offset]);
+		const UINT32 pduLength = winpr_Data_Get_UINT32(&data[offset + 4]);
+
+		if ((pduLength < RDPGFX_HEADER_SIZE) || (pduLength > length - offset))
+			break;
+		if (cmdId == RDPGFX_CMDID_STARTFRAME)
+			count++;
+		offset += pduLength;
+	}
+
+	return count;
+}
+
+static void rdpgfx_decode_message_free(void* obj)
+{
+	wMessage* msg = (wMessage*)obj;
+
+	if (msg && (msg->id == 0))
+	{
+		wStream* s = (wStream*)msg->wParam;
+		Stream_Free(s, TRUE);
+	}
+}
+
+static void rdpgfx_decode_slot_release(RDPGFX_PLUGIN* gfx)
+{
+	WINPR_ASSERT(gfx);
+
+	if (!ReleaseSemaphore(gfx->DecodeSlots, 1, nullptr))
+		WLog_Print(gfx->base.log, WLOG_WARN, "ReleaseSemaphore failed!");
+}
+
+static DWORD WINAPI rdpgfx_decode_thread_func(LPVOID arg)
+{
+	RDPGFX_PLUGIN* gfx = (RDPGFX_PLUGIN*)arg;
+	wMessage message = WINPR_C_ARRAY_INIT;
+	UINT error = CHANNEL_RC_OK;
+
+	WINPR_ASSERT(gfx);
+
+	while (1)
+	{
+		if (!MessageQueue_Wait(gfx->DecodeQueue))
+		{
+			WLog_Print(gfx->base.log, WLOG_ERROR, "MessageQueue_Wait failed!");
+			error = ERROR_INTERNAL_ERROR;
+			break;
+		}
+
+		if (!MessageQueue_Peek(gfx->DecodeQueue, &message, TRUE))
+		{
+			WLog_Print(gfx->base.log, WLOG_ERROR, "MessageQueue_Peek failed!");
+			error = ERROR_INTERNAL_ERROR;
+			break;
+		}
+
+		if (message.id == WMQ_QUIT)
+			break;
+
+		if (message.id == 0)
+		{
+			wStream* s = (wStream*)message.wParam;
+			error = rdpgfx_recv_pdus((GENERIC_CHANNEL_CALLBACK*)message.lParam, s);
+			Stream_Free(s, TRUE);
+			rdpgfx_decode_slot_release(gfx);
+
+			if (error)
+				break;
+		}
+	}
+
+	if (error)
+	{
+		const LONG prev =
+		    InterlockedExchange(&gfx->DecodeError, WINPR_ASSERTING_INT_CAST(LONG, error));
+		WINPR_UNUSED(prev);
+		if (gfx->rdpcontext)
+			setChannelError(gfx->rdpcontext, error, "rdpgfx_decode_thread_func reported an error");
+	}
+
+	ExitThread(error);
+	return error;
+}
+
+static void rdpgfx_decode_thread_stop(RDPGFX_PLUGIN* gfx)
+{
+	WINPR_ASSERT(gfx);
+
+	/* WMQ_QUIT is queued behind all pending buffers, so they are decoded before the thread
+	 * exits. */
+	if (gfx->DecodeThread)
+	{
+		if (MessageQueue_PostQuit(gfx->DecodeQueue, 0))
+			(void)WaitForSingleObject(gfx->DecodeThread, INFINITE);
+		(void)CloseHandle(gfx->DecodeThread);
+		gfx->DecodeThread = nullptr;
+	}
+
+	MessageQueue_Free(gfx->DecodeQueue);
+	gfx->DecodeQueue = nullptr;
+	if (gfx->DecodeSlots)
+		(void)CloseHandle(gfx->DecodeSlots);
+	gfx->DecodeSlots = nullptr;
+	gfx->QueuedFrames = 0;
+	gfx->DecodeError = 0;
+}
+
+static UINT rdpgfx_decode_thread_start(RDPGFX_PLUGIN* gfx)
+{
+	WINPR_ASSERT(gfx);
+	WINPR_ASSERT(gfx->rdpcontext);
+
+	if ((freerdp_settings_get_uint32(gfx->rdpcontext->settings, FreeRDP_ThreadingFlags) &
+	     THREADING_FLAGS_DISABLE_THREADS) != 0)
+		return CHANNEL_RC_OK;
+
+	if (gfx->DecodeThread)
+	{
+		WLog_Print(gfx->base.log, WLOG_DEBUG, "decode thread already running");
+		return CHANNEL_RC_OK;
+	}
+
+	gfx->DecodeSlots =
+	    CreateSemaphore(nullptr, RDPGFX_DECODE_QUEUE_DEPTH, RDPGFX_DECODE_QUEUE_DEPTH, nullptr);
+	if (!gfx->DecodeSlots)
+	{
+		WLog_Print(gfx->base.log, WLOG_ERROR, "CreateSemaphore failed!");
+		return CHANNEL_RC_NO_MEMORY;
+	}
+
+	wObject obj = WINPR_C_ARRAY_INIT;
+	obj.fnObjectFree = rdpgfx_decode_message_free;
+	gfx->DecodeQueue = MessageQueue_New(&obj);
+	if (!gfx->DecodeQueue)
+	{
+		WLog_Print(gfx->base.log, WLOG_ERROR, "MessageQueue_New failed!");
+		rdpgfx_decode_thread_stop(gfx);
+		return CHANNEL_RC_NO_MEMORY;
+	}
+
+	gfx->DecodeThread = CreateThread(nullptr, 0, rdpgfx_decode_thread_func, gfx, 0, nullptr);
+	if (!gfx->DecodeThread)
+	{
+		WLog_Print(gfx->base.log, WLOG_ERROR, "CreateThread failed!");
+		rdpgfx_decode_thread_stop(gfx);
+		return ERROR_INTERNAL_ERROR;
+	}
+
+	return CHANNEL_RC_OK;
+}
+
+/**
+ * Function description
+ *
+ * Decompresses the received data and either decodes it right away or, if the decode thread
+ * is running, hands the decompressed buffer over to it. The latter lets the channel receive
+ * and decompress the next frame while the previous one is still being decoded and presented.
+ *
+ * @return 0 on success, otherwise a Win32 error code
+ */
 static UINT rdpgfx_on_data_received(IWTSVirtualChannelCallback* pChannelCallback, wStream* data)
 {
 	UINT32 DstSize = 0;
@@ -2302,6 +2628,11 @@ static UINT rdpgfx_on_data_received(IWTSVirtualChannelCallback* pChannelCallback
 	UINT error = CHANNEL_RC_OK;
 
 	WINPR_ASSERT(gfx);
+
+	const LONG decodeError = InterlockedCompareExchange(&gfx->DecodeError, 0, 0);
+	if (decodeError != 0)
+		return WINPR_ASSERTING_INT_CAST(UINT, decodeError);
+
 	int status = zgfx_decompress(gfx->zgfx, Stream_ConstPointer(data),
 	                             (UINT32)Stream_GetRemainingLength(data), &pDstData, &DstSize, 0);
 
@@ -2312,6 +2643,55 @@ static UINT rdpgfx_on_data_received(IWTSVirtualChannelCallback* pChannelCallback
 		return ERROR_INTERNAL_ERROR;
 	}
 
+	if (gfx->DecodeThread)
+	{
+		if (DstSize == 0)
+		{
+			free(pDstData);
+			return CHANNEL_RC_OK;
+		}
+
+		/* Wait for the decoder to catch up instead of queueing without bound. If it stopped
+		 * on an error there is nobody left to make room. */
+		HANDLE events[] = { gfx->DecodeSlots, gfx->DecodeThread };
+		const DWORD waitStatus = WaitForMultipleObjects(ARRAYSIZE(events), events, FALSE, INFINITE);
+		if (waitStatus != WAIT_OBJECT_0)
+		{
+			free(pDstData);
+			const LONG threadError = InterlockedCompareExchange(&gfx->DecodeError, 0, 0);
+			if ((waitStatus == WAIT_OBJECT_0 + 1) && (threadError != 0))
+				return WINPR_ASSERTING_INT_CAST(UINT, threadError);
+			WLog_Print(gfx->base.log, WLOG_ERROR, "waiting for the decode thread failed!");
+			return ERROR_INTERNAL_ERROR;
+		}
+
+		wStream* s = Stream_New(pDstData, DstSize);
+		if (!s)
+		{
+			WLog_Print(gfx->base.log, WLOG_ERROR, "Stream_New failed!");
+			free(pDstData);
+			rdpgfx_decode_slot_release(gfx);
+			return CHANNEL_RC_NO_MEMORY;
+		}
+
+		const LONG frames = rdpgfx_count_start_frames(pDstData, DstSize);
+		if (frames > 0)
+		{
+			const LONG prev = InterlockedExchangeAdd(&gfx->QueuedFrames, frames);
+			WINPR_UNUSED(prev);
+		}
+
+		if (!MessageQueue_Post(gfx->DecodeQueue, nullptr, 0, s, callback))
+		{
+			WLog_Print(gfx->base.log, WLOG_ERROR, "MessageQueue_Post failed!");
+			Stream_Free(s, TRUE);
+			rdpgfx_decode_slot_release(gfx);
+			return ERROR_INTERNAL_ERROR;
+		}
+
+		return CHANNEL_RC_OK;
+	}
+
 	wStream sbuffer = WINPR_C_ARRAY_INIT;
 	wStream* s = Stream_StaticConstInit(&sbuffer, pDstData, DstSize);
 
@@ -2322,15 +2702,7 @@ static UINT rdpgfx_on_data_received(IWTSVirtualChannelCallback* pChannelCallback
 		return CHANNEL_RC_NO_MEMORY;
 	}
 
-	while (Stream_GetPosition(s) < Stream_Length(s))
-	{
-		if ((error = rdpgfx_recv_pdu(callback, s)))
-		{
-			WLog_Print(gfx->base.log, WLOG_ERROR, "rdpgfx_recv_pdu failed with error %" PRIu32 "!",
-			           error);
-			break;
-		}
-	}
+	error = rdpgfx_recv_pdus(callback, s);
 
 	free(pDstData);
 	return error;
@@ -2366,6 +2738,10 @@ static UINT rdpgfx_on_open(IWTSVirtualChannelCallback* pChannelCallback)
 		ctx->stats = empty;
 	}
 
+	const UINT rc = rdpgfx_decode_thread_start(gfx);
+	if (rc != CHANNEL_RC_OK)
+		return rc;
+
 	if (do_caps_advertise)
 		error = rdpgfx_send_supported_caps(callback);
 
@@ -2411,6 +2787,7 @@ static UINT rdpgfx_on_close(IWTSVirtualChannelCallback* pChannelCallback)
 	RdpgfxClientContext* context = gfx->context;
 
 	WLog_Print(gfx->base.log, WLOG_DEBUG, "OnClose");
+	rdpgfx_decode_thread_stop(gfx);
 	error = rdpgfx_save_persistent_cache(gfx);
 
 	if (error)
@@ -2419,6 +2796,7 @@ static UINT rdpgfx_on_close(IWTSVirtualChannelCallback* pChannelCallback)
 		WLog_Print(gfx->base.log, WLOG_ERROR,
 		           "rdpgfx_save_persistent_cache failed with error %" PRIu32 "", error);
 	}
+	rdpgfx_close_persistent_cache(gfx);
 
 	free_surfaces(context, gfx->SurfaceTable);
 	error = evict_cache_slots(context, gfx->MaxCacheSlots, gfx->CacheSlots);
@@ -2456,6 +2834,8 @@ static void terminate_plugin_cb(GENERIC_DYNVC_PLUGIN* base)
 	RdpgfxClientContext* context = gfx->context;
 
 	WLog_Print(gfx->base.log, WLOG_DEBUG, "Terminated");
+	rdpgfx_decode_thread_stop(gfx);
+	rdpgfx_close_persistent_cache(gfx);
 	rdpgfx_client_context_free(context);
 }
 
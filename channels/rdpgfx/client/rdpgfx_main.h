@@ -50,11 +50,20 @@ typedef struct
 	UINT16 MaxCacheSlots;
 	void* CacheSlots[25600];
 	rdpPersistentCache* persistent;
+	UINT64 PendingCacheKeys[25600];
+	UINT64 OfferedCacheKeys[RDPGFX_CACHE_ENTRY_MAX_COUNT];
+	UINT16 OfferedCacheCount;
 
 	rdpContext* rdpcontext;
 
 	RDPGFX_CAPSET ConnectionCaps;
 	RdpgfxClientContext* context;
+
+	wMessageQueue* DecodeQueue;
+	HANDLE DecodeSlots;
+	HANDLE DecodeThread;
+	volatile LONG QueuedFrames;
+	volatile LONG DecodeError;
 } RDPGFX_PLUGIN;
 
 FREERDP_LOCAL UINT logSurfaceCommand(RDPGFX_PLUGIN* gfx, const RDPGFX_SURFACE_COMMAND* cmd);
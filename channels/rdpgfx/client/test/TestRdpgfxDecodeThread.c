@@ -0,0 +1,406 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Graphics Pipeline client decode thread unit test
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+#include <winpr/thread.h>
+#include <winpr/interlocked.h>
+#include <winpr/stream.h>
+
+#include <freerdp/freerdp.h>
+#include <freerdp/addin.h>
+#include <freerdp/settings.h>
+#include <freerdp/client/channels.h>
+#include <freerdp/client/rdpgfx.h>
+#include <freerdp/channels/rdpgfx.h>
+#include <freerdp/codec/zgfx.h>
+
+#define TEST_FRAME_COUNT 8
+#define TEST_QUEUE_DEPTH 16 /* RDPGFX_DECODE_QUEUE_DEPTH */
+#define TEST_QUEUE_FRAMES (3 * TEST_QUEUE_DEPTH)
+#define TEST_BAD_FRAME_ID 0xBAD
+
+typedef struct
+{
+	IDRDYNVC_ENTRY_POINTS entry;
+	IWTSVirtualChannelManager mgr;
+	IWTSVirtualChannel channel;
+	IWTSListener listener;
+	IWTSListenerCallback* listenerCallback;
+	IWTSPlugin* plugin;
+	rdpContext* context;
+
+	DWORD mainThreadId;
+	volatile LONG startFrames;
+	volatile LONG endFrames;
+	volatile LONG acks;
+	volatile LONG wrongThread;
+} TEST_DVC;
+
+static TEST_DVC* test_from_entry(IDRDYNVC_ENTRY_POINTS* pEntryPoints)
+{
+	return (TEST_DVC*)pEntryPoints;
+}
+
+static UINT test_register_plugin(IDRDYNVC_ENTRY_POINTS* pEntryPoints,
+                                 WINPR_ATTR_UNUSED const char* name, IWTSPlugin* pPlugin)
+{
+	TEST_DVC* test = test_from_entry(pEntryPoints);
+	test->plugin = pPlugin;
+	return CHANNEL_RC_OK;
+}
+
+static IWTSPlugin* test_get_plugin(WINPR_ATTR_UNUSED IDRDYNVC_ENTRY_POINTS* pEntryPoints,
+                                   WINPR_ATTR_UNUSED const char* name)
+{
+	return nullptr;
+}
+
+static const ADDIN_ARGV* test_get_plugin_data(WINPR_ATTR_UNUSED IDRDYNVC_ENTRY_POINTS* pEntryPoints)
+{
+	return nullptr;
+}
+
+static rdpSettings* test_get_settings(IDRDYNVC_ENTRY_POINTS* pEntryPoints)
+{
+	return test_from_entry(pEntryPoints)->context->settings;
+}
+
+static rdpContext* test_get_context(IDRDYNVC_ENTRY_POINTS* pEntryPoints)
+{
+	return test_from_entry(pEntryPoints)->context;
+}
+
+static UINT test_create_listener(IWTSVirtualChannelManager* pChannelMgr,
+                                 WINPR_ATTR_UNUSED const char* pszChannelName,
+                                 WINPR_ATTR_UNUSED ULONG ulFlags,
+                                 IWTSListenerCallback* pListenerCallback, IWTSListener** ppListener)
+{
+	TEST_DVC* test = (TEST_DVC*)((BYTE*)pChannelMgr - offsetof(TEST_DVC, mgr));
+	test->listenerCallback = pListenerCallback;
+	*ppListener = &test->listener;
+	return CHANNEL_RC_OK;
+}
+
+static UINT test_destroy_listener(WINPR_ATTR_UNUSED IWTSVirtualChannelManager* pChannelMgr,
+                                  WINPR_ATTR_UNUSED IWTSListener* pListener)
+{
+	return CHANNEL_RC_OK;
+}
+
+static UINT test_channel_write(IWTSVirtualChannel* pChannel, ULONG cbSize, const BYTE* pBuffer,
+                               WINPR_ATTR_UNUSED void* pReserved)
+{
+	TEST_DVC* test = (TEST_DVC*)((BYTE*)pChannel - offsetof(TEST_DVC, channel));
+
+	if (cbSize < RDPGFX_HEADER_SIZE)
+		return ERROR_INVALID_DATA;
+
+	if (winpr_Data_Get_UINT16(pBuffer) == RDPGFX_CMDID_FRAMEACKNOWLEDGE)
+		(void)InterlockedIncrement(&test->acks);
+	return CHANNEL_RC_OK;
+}
+
+static UINT test_channel_close(WINPR_ATTR_UNUSED IWTSVirtualChannel* pChannel)
+{
+	return CHANNEL_RC_OK;
+}
+
+static UINT test_start_frame(RdpgfxClientContext* context,
+                             WINPR_ATTR_UNUSED const RDPGFX_START_FRAME_PDU* startFrame)
+{
+	TEST_DVC* test = context->custom;
+
+	if (GetCurrentThreadId() == test->mainThreadId)
+		(void)InterlockedIncrement(&test->wrongThread);
+
+	/* make decoding slower than receiving so buffers pile up in the queue */
+	Sleep(5);
+	(void)InterlockedIncrement(&test->startFrames);
+	return CHANNEL_RC_OK;
+}
+
+static UINT test_end_frame(RdpgfxClientContext* context, const RDPGFX_END_FRAME_PDU* endFrame)
+{
+	TEST_DVC* test = context->custom;
+
+	if (endFrame->frameId == TEST_BAD_FRAME_ID)
+		return ERROR_INVALID_DATA;
+
+	(void)InterlockedIncrement(&test->endFrames);
+	return CHANNEL_RC_OK;
+}
+
+static BOOL test_frame_data(UINT32 frameId, BYTE** ppData, UINT32* pSize)
+{
+	BYTE raw[2 * RDPGFX_HEADER_SIZE + RDPGFX_START_FRAME_PDU_SIZE + RDPGFX_END_FRAME_PDU_SIZE] =
+	    WINPR_C_ARRAY_INIT;
+	wStream buffer = WINPR_C_ARRAY_INIT;
+	wStream* s = Stream_StaticInit(&buffer, raw, sizeof(raw));
+
+	Stream_Write_UINT16(s, RDPGFX_CMDID_STARTFRAME);
+	Stream_Write_UINT16(s, 0);
+	Stream_Write_UINT32(s, RDPGFX_HEADER_SIZE + RDPGFX_START_FRAME_PDU_SIZE);
+	Stream_Write_UINT32(s, 0); /* timestamp */
+	Stream_Write_UINT32(s, frameId);
+	Stream_Write_UINT16(s, RDPGFX_CMDID_ENDFRAME);
+	Stream_Write_UINT16(s, 0);
+	Stream_Write_UINT32(s, RDPGFX_HEADER_SIZE + RDPGFX_END_FRAME_PDU_SIZE);
+	Stream_Write_UINT32(s, frameId);
+
+	ZGFX_CONTEXT* zgfx = zgfx_context_new(TRUE);
+	if (!zgfx)
+		return FALSE;
+
+	UINT32 flags = 0;
+	const int rc = zgfx_compress(zgfx, raw, sizeof(raw), ppData, pSize, &flags);
+	zgfx_context_free(zgfx);
+	return rc >= 0;
+}
+
+static UINT test_send_frame(IWTSVirtualChannelCallback* callback, UINT32 frameId)
+{
+	BYTE* data = nullptr;
+	UINT32 size = 0;
+
+	if (!test_frame_data(frameId, &data, &size))
+		return ERROR_INTERNAL_ERROR;
+
+	wStream buffer = WINPR_C_ARRAY_INIT;
+	wStream* s = Stream_StaticConstInit(&buffer, data, size);
+	const UINT rc = callback->OnDataReceived(callback, s);
+	free(data);
+	return rc;
+}
+
+static IWTSVirtualChannelCallback* test_open_channel(TEST_DVC* test)
+{
+	IWTSVirtualChannelCallback* callback = nullptr;
+	BOOL accept = TRUE;
+
+	if (test->listenerCallback->OnNewChannelConnection(test->listenerCallback, &test->channel,
+	                                                   nullptr, &accept, &callback) !=
+	    CHANNEL_RC_OK)
+		return nullptr;
+
+	if (callback->OnOpen(callback) != CHANNEL_RC_OK)
+	{
+		(void)callback->OnClose(callback);
+		return nullptr;
+	}
+
+	return callback;
+}
+
+/* all buffers queued before the channel closes are decoded and acknowledged */
+static BOOL test_drain_on_close(TEST_DVC* test)
+{
+	IWTSVirtualChannelCallback* callback = test_open_channel(test);
+	if (!callback)
+		return FALSE;
+
+	for (UINT32 x = 0; x < TEST_FRAME_COUNT; x++)
+	{
+		if (test_send_frame(callback, x + 1) != CHANNEL_RC_OK)
+		{
+			(void)callback->OnClose(callback);
+			return FALSE;
+		}
+	}
+
+	/* receiving must not wait for the slow decoder */
+	if (InterlockedCompareExchange(&test->endFrames, 0, 0) >= TEST_FRAME_COUNT)
+	{
+		(void)fprintf(stderr, "frames were decoded on the receive path\n");
+		(void)callback->OnClose(callback);
+		return FALSE;
+	}
+
+	if (callback->OnClose(callback) != CHANNEL_RC_OK)
+		return FALSE;
+
+	if ((test->startFrames != TEST_FRAME_COUNT) || (test->endFrames != TEST_FRAME_COUNT) ||
+	    (test->acks != TEST_FRAME_COUNT))
+	{
+		(void)fprintf(stderr, "drain on close: %" PRId32 " started, %" PRId32 " ended, %" PRId32
+		                      " acknowledged, expected %d\n",
+		              test->startFrames, test->endFrames, test->acks, TEST_FRAME_COUNT);
+		return FALSE;
+	}
+
+	if (test->wrongThread != 0)
+	{
+		(void)fprintf(stderr, "frames were decoded on the receive thread\n");
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/* a slow decoder makes the receive path wait instead of queueing without bound, opening
+ * the channel again must not start a second decode thread */
+static BOOL test_queue_bound(TEST_DVC* test)
+{
+	BOOL rc = FALSE;
+	IWTSVirtualChannelCallback* callback = test_open_channel(test);
+	if (!callback)
+		return FALSE;
+
+	test->startFrames = 0;
+	test->endFrames = 0;
+	test->acks = 0;
+	if (callback->OnOpen(callback) != CHANNEL_RC_OK)
+		goto fail;
+
+	for (UINT32 x = 0; x < TEST_QUEUE_FRAMES; x++)
+	{
+		if (test_send_frame(callback, x + 1) != CHANNEL_RC_OK)
+			goto fail;
+
+		/* the queue plus the buffer the decoder is working on */
+		const LONG pending = (LONG)(x + 1) - InterlockedCompareExchange(&test->endFrames, 0, 0);
+		if (pending > TEST_QUEUE_DEPTH + 1)
+		{
+			(void)fprintf(stderr, "%" PRId32 " buffers wait for the decoder\n", pending);
+			goto fail;
+		}
+	}
+
+	rc = TRUE;
+fail:
+	if (callback->OnClose(callback) != CHANNEL_RC_OK)
+		rc = FALSE;
+
+	if (rc && (test->endFrames != TEST_QUEUE_FRAMES))
+	{
+		(void)fprintf(stderr, "queue bound: %" PRId32 " of %d frames decoded\n", test->endFrames,
+		              TEST_QUEUE_FRAMES);
+		rc = FALSE;
+	}
+	return rc;
+}
+
+/* a decode failure on the decode thread is returned from the next received PDU */
+static BOOL test_decode_error(TEST_DVC* test)
+{
+	BOOL rc = FALSE;
+	IWTSVirtualChannelCallback* callback = test_open_channel(test);
+	if (!callback)
+		return FALSE;
+
+	test->endFrames = 0;
+	if (test_send_frame(callback, TEST_BAD_FRAME_ID) != CHANNEL_RC_OK)
+		goto fail;
+
+	if (WaitForSingleObject(test->context->channelErrorEvent, 10000) != WAIT_OBJECT_0)
+	{
+		(void)fprintf(stderr, "decode error was not reported\n");
+		goto fail;
+	}
+
+	if (test->context->channelErrorNum != ERROR_INVALID_DATA)
+		goto fail;
+
+	if (test_send_frame(callback, 1) != ERROR_INVALID_DATA)
+	{
+		(void)fprintf(stderr, "decode error was not returned from the next PDU\n");
+		goto fail;
+	}
+
+	rc = TRUE;
+fail:
+	if (callback->OnClose(callback) != CHANNEL_RC_OK)
+		rc = FALSE;
+
+	/* the frame after the error must not have been decoded */
+	if (test->endFrames != 0)
+		rc = FALSE;
+	return rc;
+}
+
+int TestRdpgfxDecodeThread(int argc, char* argv[])
+{
+	int rc = -1;
+	TEST_DVC test = WINPR_C_ARRAY_INIT;
+	rdpContext context = WINPR_C_ARRAY_INIT;
+
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	PVIRTUALCHANNELENTRY fkt = freerdp_channels_load_static_addin_entry(
+	    RDPGFX_CHANNEL_NAME, nullptr, nullptr, FREERDP_ADDIN_CHANNEL_DYNAMIC);
+	PDVC_PLUGIN_ENTRY entry = WINPR_FUNC_PTR_CAST(fkt, PDVC_PLUGIN_ENTRY);
+	if (!entry)
+	{
+		(void)fprintf(stderr, "rdpgfx is not built in, skipping\n");
+		return 0;
+	}
+
+	context.settings = freerdp_settings_new(0);
+	context.channelErrorEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+	context.errorDescription = calloc(1, 500);
+	if (!context.settings || !context.channelErrorEvent || !context.errorDescription)
+		goto fail;
+
+	test.context = &context;
+	test.mainThreadId = GetCurrentThreadId();
+	test.entry.RegisterPlugin = test_register_plugin;
+	test.entry.GetPlugin = test_get_plugin;
+	test.entry.GetPluginData = test_get_plugin_data;
+	test.entry.GetRdpSettings = test_get_settings;
+	test.entry.GetRdpContext = test_get_context;
+	test.mgr.CreateListener = test_create_listener;
+	test.mgr.DestroyListener = test_destroy_listener;
+	test.channel.Write = test_channel_write;
+	test.channel.Close = test_channel_close;
+
+	if (entry(&test.entry) != CHANNEL_RC_OK)
+		goto fail;
+
+	if (!test.plugin || (test.plugin->Initialize(test.plugin, &test.mgr) != CHANNEL_RC_OK) ||
+	    !test.listenerCallback)
+		goto fail;
+
+	RdpgfxClientContext* gfx = test.plugin->pInterface;
+	gfx->custom = &test;
+	gfx->StartFrame = test_start_frame;
+	gfx->EndFrame = test_end_frame;
+
+	if (!test_drain_on_close(&test))
+		goto fail;
+
+	if (!test_queue_bound(&test))
+		goto fail;
+
+	if (!test_decode_error(&test))
+		goto fail;
+
+	rc = 0;
+fail:
+	if (test.plugin)
+		(void)test.plugin->Terminated(test.plugin);
+	if (context.channelErrorEvent)
+		(void)CloseHandle(context.channelErrorEvent);
+	free(context.errorDescription);
+	freerdp_settings_free(context.settings);
+	if (rc != 0)
+		(void)fprintf(stderr, "TestRdpgfxDecodeThread failed\n");
+	return rc;
+}
@@ -0,0 +1,324 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Audio Output Virtual Channel - adaptive jitter buffer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <freerdp/config.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <winpr/assert.h>
+#include <winpr/endian.h>
+#include <winpr/synch.h>
+
+#include "rdpsnd_jitter.h"
+
+#define RDPSND_JITTER_DEFAULT_LATENCY 40 /* ms */
+#define RDPSND_JITTER_MAX_LATENCY 400    /* ms */
+#define RDPSND_JITTER_HYSTERESIS 10      /* ms */
+#define RDPSND_JITTER_MAX_STRETCH 20     /* per mille of a packet */
+#define RDPSND_JITTER_SILENCE 64         /* peak amplitude of a silent packet */
+#define RDPSND_JITTER_MAX_CONCEAL 100    /* ms of consecutive concealment */
+#define RDPSND_JITTER_CONCEAL_GUARD 5    /* ms before the device runs dry */
+
+struct rdpsnd_jitter
+{
+	UINT32 minLatency;
+	UINT32 maxLatency;
+
+	/* RFC 3550 style interarrival jitter in ms */
+	double jitter;
+	BOOL haveLast;
+	UINT16 lastTimeStamp;
+	UINT64 lastArrival;
+
+	/* local time in us the audio handed to the device so far ends */
+	UINT64 playEnd;
+	UINT64 concealed;
+
+	BYTE* scratch;
+	size_t scratchSize;
+};
+
+static UINT32 rdpsnd_jitter_frame_size(const AUDIO_FORMAT* format)
+{
+	WINPR_ASSERT(format);
+	return format->nChannels * format->wBitsPerSample / 8;
+}
+
+static UINT64 rdpsnd_jitter_duration(const AUDIO_FORMAT* format, size_t frames)
+{
+	WINPR_ASSERT(format);
+	if (format->nSamplesPerSec == 0)
+		return 0;
+	return 1000000ull * frames / format->nSamplesPerSec;
+}
+
+static size_t rdpsnd_jitter_frames(const AUDIO_FORMAT* format, UINT64 duration)
+{
+	WINPR_ASSERT(format);
+	return (size_t)(duration * format->nSamplesPerSec / 1000000ull);
+}
+
+static UINT64 rdpsnd_jitter_buffered(const RDPSND_JITTER* jitter, UINT64 now)
+{
+	WINPR_ASSERT(jitter);
+
+	const UINT64 nowUs = now * 1000ull;
+	if (jitter->playEnd <= nowUs)
+		return 0;
+	return jitter->playEnd - nowUs;
+}
+
+static BOOL rdpsnd_jitter_is_silent(const BYTE* data, size_t samples)
+{
+	for (size_t x = 0; x < samples; x++)
+	{
+		const INT16 s = winpr_Data_Get_INT16(&data[x * sizeof(INT16)]);
+		if ((s > RDPSND_JITTER_SILENCE) || (s < -RDPSND_JITTER_SILENCE))
+			return FALSE;
+	}
+	return TRUE;
+}
+
+static BOOL rdpsnd_jitter_prepend_silence(const AUDIO_FORMAT* format, wStream* pcm,
+                                          size_t frames)
+{
+	const size_t bytes = frames * rdpsnd_jitter_frame_size(format);
+	const size_t length = Stream_Length(pcm);
+
+	if (!Stream_EnsureCapacity(pcm, length + bytes))
+		return FALSE;
+
+	BYTE* data = Stream_Buffer(pcm);
+	memmove(&data[bytes], data, length);
+	memset(data, 0, bytes);
+	return Stream_SetLength(pcm, length + bytes);
+}
+
+/* Linear interpolation of 16bit samples from \b frames to \b target frames. Only used for
+ * changes of a few percent, where this is indistinguishable from better interpolators. */
+static BOOL rdpsnd_jitter_stretch(RDPSND_JITTER* jitter, const AUDIO_FORMAT* format,
+                                  wStream* pcm, size_t frames, size_t target)
+{
+	const UINT32 channels = format->nChannels;
+	const size_t bytes = target * channels * sizeof(INT16);
+
+	if ((frames < 2) || (target < 2))
+		return TRUE;
+
+	if (jitter->scratchSize < bytes)
+	{
+		BYTE* tmp = realloc(jitter->scratch, bytes);
+		if (!tmp)
+			return FALSE;
+		jitter->scratch = tmp;
+		jitter->scratchSize = bytes;
+	}
+
+	const BYTE* src = Stream_Buffer(pcm);
+	const UINT64 step = ((UINT64)(frames - 1) << 16) / (target - 1);
+
+	for (size_t x = 0; x < target; x++)
+	{
+		const UINT64 pos = x * step;
+		const size_t index = (size_t)(pos >> 16);
+		const INT32 frac = (INT32)(pos & 0xFFFF);
+		const size_t next = (index + 1 < frames) ? index + 1 : index;
+
+		for (UINT32 c = 0; c < channels; c++)
+		{
+			const INT32 a = winpr_Data_Get_INT16(&src[(index * channels + c) * sizeof(INT16)]);
+			const INT32 b = winpr_Data_Get_INT16(&src[(next * channels + c) * sizeof(INT16)]);
+			const INT32 v = a + (((b - a) * frac) >> 16);
+			winpr_Data_Write_INT16(&jitter->scratch[(x * channels + c) * sizeof(INT16)],
+			                       (INT16)v);
+		}
+	}
+
+	if (!Stream_EnsureCapacity(pcm, bytes))
+		return FALSE;
+	memcpy(Stream_Buffer(pcm), jitter->scratch, bytes);
+	return Stream_SetLength(pcm, bytes);
+}
+
+void rdpsnd_jitter_free(RDPSND_JITTER* jitter)
+{
+	if (!jitter)
+		return;
+
+	free(jitter->scratch);
+	free(jitter);
+}
+
+RDPSND_JITTER* rdpsnd_jitter_new(UINT32 latency)
+{
+	RDPSND_JITTER* jitter = calloc(1, sizeof(RDPSND_JITTER));
+	if (!jitter)
+		return nullptr;
+
+	jitter->minLatency = (latency > 0) ? latency : RDPSND_JITTER_DEFAULT_LATENCY;
+	jitter->maxLatency = (jitter->minLatency > RDPSND_JITTER_MAX_LATENCY)
+	                         ? jitter->minLatency
+	                         : RDPSND_JITTER_MAX_LATENCY;
+	return jitter;
+}
+
+void rdpsnd_jitter_reset(RDPSND_JITTER* jitter)
+{
+	if (!jitter)
+		return;
+
+	jitter->haveLast = FALSE;
+	jitter->playEnd = 0;
+	jitter->concealed = 0;
+}
+
+void rdpsnd_jitter_arrival(RDPSND_JITTER* jitter, UINT16 wTimeStamp, UINT64 arrival)
+{
+	if (!jitter)
+		return;
+
+	if (jitter->haveLast)
+	{
+		/* wTimeStamp wraps around, the difference of two consecutive ones is small */
+		const INT64 sent = (INT16)(UINT16)(wTimeStamp - jitter->lastTimeStamp);
+		const INT64 received = (INT64)(arrival - jitter->lastArrival);
+		const INT64 d = received - sent;
+		const double deviation = (double)((d < 0) ? -d : d);
+
+		jitter->jitter += (deviation - jitter->jitter) / 16.0;
+	}
+
+	jitter->haveLast = TRUE;
+	jitter->lastTimeStamp = wTimeStamp;
+	jitter->lastArrival = arrival;
+	jitter->concealed = 0;
+}
+
+UINT32 rdpsnd_jitter_target(const RDPSND_JITTER* jitter)
+{
+	WINPR_ASSERT(jitter);
+
+	const UINT32 target = jitter->minLatency + (UINT32)(3.0 * jitter->jitter + 0.5);
+	return (target < jitter->maxLatency) ? target : jitter->maxLatency;
+}
+
+BOOL rdpsnd_jitter_adapt(RDPSND_JITTER* jitter, const AUDIO_FORMAT* format, wStream* pcm,
+                         UINT64 now)
+{
+	WINPR_ASSERT(jitter);
+	WINPR_ASSERT(format);
+	WINPR_ASSERT(pcm);
+
+	const UINT32 bpf = rdpsnd_jitter_frame_size(format);
+	if ((bpf == 0) || (format->nSamplesPerSec == 0))
+		return TRUE;
+
+	const size_t frames = Stream_Length(pcm) / bpf;
+	const INT64 duration = (INT64)rdpsnd_jitter_duration(format, frames);
+	const INT64 buffered = (INT64)rdpsnd_jitter_buffered(jitter, now);
+	const INT64 target = 1000ll * rdpsnd_jitter_target(jitter);
+	const INT64 hysteresis = 1000ll * RDPSND_JITTER_HYSTERESIS;
+	const INT64 error = buffered + duration - target;
+
+	/* More than a packet above the target, the server sends faster than we play */
+	if (buffered > target + duration + hysteresis)
+		return FALSE;
+
+	if (format->wBitsPerSample != 16)
+		return TRUE;
+
+	/* Nothing queued, either the stream (re)starts or the device ran dry */
+	if (buffered == 0)
+	{
+		if (error >= 0)
+			return TRUE;
+		return rdpsnd_jitter_prepend_silence(format, pcm,
+		                                     rdpsnd_jitter_frames(format, (UINT64)-error));
+	}
+
+	const size_t maxStretch = frames * RDPSND_JITTER_MAX_STRETCH / 1000;
+	if (error > hysteresis)
+	{
+		if ((duration <= error) &&
+		    rdpsnd_jitter_is_silent(Stream_Buffer(pcm), frames * format->nChannels))
+			return FALSE;
+
+		size_t drop = rdpsnd_jitter_frames(format, (UINT64)error);
+		if (drop > maxStretch)
+			drop = maxStretch;
+		if (drop > 0)
+			return rdpsnd_jitter_stretch(jitter, format, pcm, frames, frames - drop);
+	}
+	else if (error < -hysteresis)
+	{
+		size_t add = rdpsnd_jitter_frames(format, (UINT64)-error);
+		if (add > maxStretch)
+			add = maxStretch;
+		if (add > 0)
+			return rdpsnd_jitter_stretch(jitter, format, pcm, frames, frames + add);
+	}
+
+	return TRUE;
+}
+
+UINT32 rdpsnd_jitter_played(RDPSND_JITTER* jitter, const AUDIO_FORMAT* format, size_t size,
+                            UINT64 now, BOOL concealed)
+{
+	WINPR_ASSERT(jitter);
+	WINPR_ASSERT(format);
+
+	const UINT32 bpf = rdpsnd_jitter_frame_size(format);
+	const UINT64 nowUs = now * 1000ull;
+	const UINT64 duration = (bpf > 0) ? rdpsnd_jitter_duration(format, size / bpf) : 0;
+
+	if (jitter->playEnd < nowUs)
+		jitter->playEnd = nowUs;
+	jitter->playEnd += duration;
+
+	if (concealed)
+		jitter->concealed += duration;
+
+	return (UINT32)((jitter->playEnd - nowUs + 999ull) / 1000ull);
+}
+
+DWORD rdpsnd_jitter_conceal_timeout(const RDPSND_JITTER* jitter, UINT64 now)
+{
+	if (!jitter || (jitter->playEnd == 0))
+		return INFINITE;
+
+	if (jitter->concealed >= 1000ull * RDPSND_JITTER_MAX_CONCEAL)
+		return INFINITE;
+
+	/* Already ran dry, the stream most likely ended */
+	const UINT64 buffered = rdpsnd_jitter_buffered(jitter, now);
+	if (buffered == 0)
+		return INFINITE;
+
+	const UINT64 guard = 1000ull * RDPSND_JITTER_CONCEAL_GUARD;
+	if (buffered <= guard)
+		return 0;
+	return (DWORD)((buffered - guard) / 1000ull);
+}
+
+void rdpsnd_jitter_conceal_disable(RDPSND_JITTER* jitter)
+{
+	if (!jitter)
+		return;
+
+	jitter->concealed = 1000ull * RDPSND_JITTER_MAX_CONCEAL;
+}
@@ -0,0 +1,76 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Audio Output Virtual Channel - adaptive jitter buffer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FREERDP_CHANNEL_RDPSND_CLIENT_JITTER_H
+#define FREERDP_CHANNEL_RDPSND_CLIENT_JITTER_H
+
+#include <winpr/wtypes.h>
+#include <winpr/stream.h>
+
+#include <freerdp/api.h>
+#include <freerdp/codec/audio.h>
+
+/** @brief interval of concealment audio generated while waiting for a late packet */
+#define RDPSND_JITTER_CONCEAL_MS 20
+
+typedef struct rdpsnd_jitter RDPSND_JITTER;
+
+FREERDP_LOCAL void rdpsnd_jitter_free(RDPSND_JITTER* jitter);
+
+/** @brief Creates a jitter buffer, \b latency is the minimum target latency in ms, 0 selects
+ *  the default. */
+WINPR_ATTR_MALLOC(rdpsnd_jitter_free, 1)
+WINPR_ATTR_NODISCARD
+FREERDP_LOCAL RDPSND_JITTER* rdpsnd_jitter_new(UINT32 latency);
+
+/** @brief Forgets the queued audio, e.g. after the device was reopened */
+FREERDP_LOCAL void rdpsnd_jitter_reset(RDPSND_JITTER* jitter);
+
+/** @brief Updates the arrival jitter estimate with a wave sent at server time \b wTimeStamp
+ *  and received at local time \b arrival (both ms) */
+FREERDP_LOCAL void rdpsnd_jitter_arrival(RDPSND_JITTER* jitter, UINT16 wTimeStamp,
+                                         UINT64 arrival);
+
+/** @brief The latency in ms the buffer currently converges on */
+WINPR_ATTR_NODISCARD
+FREERDP_LOCAL UINT32 rdpsnd_jitter_target(const RDPSND_JITTER* jitter);
+
+/** @brief Prepares \b pcm (decoded audio described by \b format) for playback at \b now.
+ *
+ *  After an underrun silence is prepended to rebuild the target latency. Above the target
+ *  silent packets are dropped and others are shortened, below it they are stretched, by at
+ *  most a few percent so the pitch change stays inaudible.
+ *
+ *  @return FALSE if the packet should not be played at all */
+WINPR_ATTR_NODISCARD
+FREERDP_LOCAL BOOL rdpsnd_jitter_adapt(RDPSND_JITTER* jitter, const AUDIO_FORMAT* format,
+                                       wStream* pcm, UINT64 now);
+
+/** @brief Accounts \b size bytes of \b format handed to the device at \b now.
+ *  @return the time in ms until the last sample is played */
+FREERDP_LOCAL UINT32 rdpsnd_jitter_played(RDPSND_JITTER* jitter, const AUDIO_FORMAT* format,
+                                          size_t size, UINT64 now, BOOL concealed);
+
+/** @brief Time in ms the player may wait for the next packet before concealment audio must
+ *  be generated, INFINITE if nothing is playing or the concealment budget is used up. */
+WINPR_ATTR_NODISCARD
+FREERDP_LOCAL DWORD rdpsnd_jitter_conceal_timeout(const RDPSND_JITTER* jitter, UINT64 now);
+
+/** @brief Stops concealment until the next packet arrives, e.g. if the codec has none */
+FREERDP_LOCAL void rdpsnd_jitter_conceal_disable(RDPSND_JITTER* jitter);
+
+#endif /* FREERDP_CHANNEL_RDPSND_CLIENT_JITTER_H */
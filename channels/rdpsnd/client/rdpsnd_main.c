@@ -50,6 +50,7 @@
 
 #include "rdpsnd_common.h"
 #include "rdpsnd_main.h"
+#include "rdpsnd_jitter.h"
 
 struct rdpsnd_plugin
 {
@@ -87,6 +88,7 @@ struct rdpsnd_plugin
 	UINT16 waveDataSize;
 	UINT16 wTimeStamp;
 	UINT64 wArrivalTime;
+	UINT64 receiveTime;
 
 	UINT32 latency;
 	BOOL isOpen;
@@ -103,6 +105,7 @@ struct rdpsnd_plugin
 	rdpContext* rdpcontext;
 
 	FREERDP_DSP_CONTEXT* dsp_context;
+	RDPSND_JITTER* jitter;
 
 	HANDLE thread;
 	wMessageQueue* queue;
@@ -442,6 +445,12 @@ static BOOL rdpsnd_ensure_device_is_open(rdpsndPlugin* rdpsnd, UINT16 wFormatNo,
 				return FALSE;
 		}
 
+		if (!rdpsnd->jitter)
+			rdpsnd->jitter = rdpsnd_jitter_new(rdpsnd->latency);
+		if (!rdpsnd->jitter)
+			return FALSE;
+		rdpsnd_jitter_reset(rdpsnd->jitter);
+
 		rdpsnd->isOpen = TRUE;
 		rdpsnd->wCurrentFormatNo = wFormatNo;
 		rdpsnd->startPlayTime = 0;
@@ -466,7 +475,7 @@ static UINT rdpsnd_recv_wave_info_pdu(rdpsndPlugin* rdpsnd, wStream* s, UINT16 B
 	if (!Stream_CheckAndLogRequiredLength(TAG, s, 12) || (BodySize < 8))
 		return ERROR_BAD_LENGTH;
 
-	rdpsnd->wArrivalTime = GetTickCount64();
+	rdpsnd->wArrivalTime = rdpsnd->receiveTime;
 	Stream_Read_UINT16(s, rdpsnd->wTimeStamp);
 	Stream_Read_UINT16(s, wFormatNo);
 
@@ -486,6 +495,7 @@ static UINT rdpsnd_recv_wave_info_pdu(rdpsndPlugin* rdpsnd, wStream* s, UINT16 B
 	if (!rdpsnd_ensure_device_is_open(rdpsnd, wFormatNo, format))
 		return ERROR_INTERNAL_ERROR;
 
+	rdpsnd_jitter_arrival(rdpsnd->jitter, rdpsnd->wTimeStamp, rdpsnd->wArrivalTime);
 	rdpsnd->expectingWave = TRUE;
 	return CHANNEL_RC_OK;
 }
@@ -605,6 +615,100 @@ static BOOL rdpsnd_detect_overrun(rdpsndPlugin* rdpsnd, const AUDIO_FORMAT* form
 	}
 }
 
+static UINT rdpsnd_play(rdpsndPlugin* rdpsnd, const AUDIO_FORMAT* format, const BYTE* data,
+                        size_t size)
+{
+	WINPR_ASSERT(rdpsnd);
+	WINPR_ASSERT(rdpsnd->device);
+
+	if (rdpsnd->device->PlayEx)
+		return rdpsnd->device->PlayEx(rdpsnd->device, format, data, size);
+	return IFCALLRESULT(0, rdpsnd->device->Play, rdpsnd->device, data, size);
+}
+
+/* Layout of the audio freerdp_dsp_decode produces for \b format */
+static AUDIO_FORMAT rdpsnd_decoded_format(const AUDIO_FORMAT* format)
+{
+	AUDIO_FORMAT pcm = WINPR_C_ARRAY_INIT;
+
+	WINPR_ASSERT(format);
+	pcm.wFormatTag = WAVE_FORMAT_PCM;
+	pcm.nChannels = format->nChannels;
+	pcm.nSamplesPerSec = format->nSamplesPerSec;
+	pcm.wBitsPerSample = (format->wFormatTag == WAVE_FORMAT_PCM) ? format->wBitsPerSample : 16;
+	pcm.nBlockAlign = pcm.nChannels * pcm.wBitsPerSample / 8;
+	pcm.nAvgBytesPerSec = pcm.nBlockAlign * pcm.nSamplesPerSec;
+	return pcm;
+}
+
+/**
+ * Plays decoded audio through the jitter buffer.
+ *
+ * @return the time in ms until the last sample of \b pcm is played
+ */
+static UINT32 rdpsnd_play_adaptive(rdpsndPlugin* rdpsnd, const AUDIO_FORMAT* format,
+                                   wStream* pcm, BOOL concealed)
+{
+	const AUDIO_FORMAT decoded = rdpsnd_decoded_format(format);
+	const UINT64 now = GetTickCount64();
+
+	if (!rdpsnd_jitter_adapt(rdpsnd->jitter, &decoded, pcm, now))
+	{
+		WLog_Print(rdpsnd->log, WLOG_DEBUG,
+		           "%s Buffer above target latency %" PRIu32 " ms, dropping %" PRIuz " bytes",
+		           rdpsnd_is_dyn_str(rdpsnd->dynamic), rdpsnd_jitter_target(rdpsnd->jitter),
+		           Stream_Length(pcm));
+		return rdpsnd_jitter_played(rdpsnd->jitter, &decoded, 0, now, FALSE);
+	}
+
+	const UINT latency = rdpsnd_play(rdpsnd, format, Stream_Buffer(pcm), Stream_Length(pcm));
+	const UINT32 delay =
+	    rdpsnd_jitter_played(rdpsnd->jitter, &decoded, Stream_Length(pcm), now, concealed);
+	return (delay > latency) ? delay : latency;
+}
+
+/* The current format is decoded by us with a codec that has packet loss concealment */
+static const AUDIO_FORMAT* rdpsnd_concealable_format(rdpsndPlugin* rdpsnd)
+{
+	WINPR_ASSERT(rdpsnd);
+
+	if (!rdpsnd->device || !rdpsnd->attached || !rdpsnd->isOpen ||
+	    (rdpsnd->wCurrentFormatNo >= rdpsnd->NumberOfClientFormats))
+		return nullptr;
+
+	const AUDIO_FORMAT* format = &rdpsnd->ClientFormats[rdpsnd->wCurrentFormatNo];
+	if (format->wFormatTag != WAVE_FORMAT_OPUS)
+		return nullptr;
+	if (rdpsnd->device->FormatSupported(rdpsnd->device, format))
+		return nullptr;
+	return format;
+}
+
+/* Fills the gap of a late packet with decoder concealment audio */
+static void rdpsnd_conceal(rdpsndPlugin* rdpsnd)
+{
+	const AUDIO_FORMAT* format = rdpsnd_concealable_format(rdpsnd);
+	if (!format)
+		return;
+
+	wStream* pcm = StreamPool_Take(rdpsnd->pool, 4096);
+	if (!pcm)
+		return;
+
+	const size_t frames = 1ull * format->nSamplesPerSec * RDPSND_JITTER_CONCEAL_MS / 1000;
+	if (freerdp_dsp_decode_lost(rdpsnd->dsp_context, format, frames, pcm))
+	{
+		Stream_SealLength(pcm);
+		WLog_Print(rdpsnd->log, WLOG_DEBUG, "%s Concealing %" PRIuz " late frames",
+		           rdpsnd_is_dyn_str(rdpsnd->dynamic), frames);
+		(void)rdpsnd_play_adaptive(rdpsnd, format, pcm, TRUE);
+	}
+	else
+		rdpsnd_jitter_conceal_disable(rdpsnd->jitter);
+
+	Stream_Release(pcm);
+}
+
 static UINT rdpsnd_treat_wave(rdpsndPlugin* rdpsnd, wStream* s, size_t size)
 {
 	AUDIO_FORMAT* format = nullptr;
@@ -635,38 +739,51 @@ static UINT rdpsnd_treat_wave(rdpsndPlugin* rdpsnd, wStream* s, size_t size)
 	           "%s Wave: cBlockNo: %" PRIu8 " wTimeStamp: %" PRIu16 ", size: %" PRIuz,
 	           rdpsnd_is_dyn_str(rdpsnd->dynamic), rdpsnd->cBlockNo, rdpsnd->wTimeStamp, size);
 
-	if (rdpsnd->device && rdpsnd->attached && !rdpsnd_detect_overrun(rdpsnd, format, size))
+	if (rdpsnd->device && rdpsnd->attached)
 	{
-		UINT status = CHANNEL_RC_OK;
-		wStream* pcmData = StreamPool_Take(rdpsnd->pool, 4096);
+		const BOOL native = rdpsnd->device->FormatSupported(rdpsnd->device, format);
 
-		if (rdpsnd->device->FormatSupported(rdpsnd->device, format))
+		/* Compressed audio the device plays itself can not be measured, fall back to the
+		 * size based overrun detection for these. */
+		if (native && (format->wFormatTag != WAVE_FORMAT_PCM))
 		{
-			if (rdpsnd->device->PlayEx)
-				latency = rdpsnd->device->PlayEx(rdpsnd->device, format, data, size);
-			else
-				latency = IFCALLRESULT(0, rdpsnd->device->Play, rdpsnd->device, data, size);
+			if (!rdpsnd_detect_overrun(rdpsnd, format, size))
+				latency = rdpsnd_play(rdpsnd, format, data, size);
 		}
-		else if (freerdp_dsp_decode(rdpsnd->dsp_context, format, data, size, pcmData))
+		else
 		{
-			Stream_SealLength(pcmData);
+			BOOL rc = FALSE;
+			wStream* pcmData = StreamPool_Take(rdpsnd->pool, size);
+
+			if (!pcmData)
+				return CHANNEL_RC_NO_MEMORY;
 
-			if (rdpsnd->device->PlayEx)
-				latency = rdpsnd->device->PlayEx(rdpsnd->device, format, Stream_Buffer(pcmData),
-				                                 Stream_Length(pcmData));
+			if (native)
+			{
+				rc = Stream_EnsureRemainingCapacity(pcmData, size);
+				if (rc)
+					Stream_Write(pcmData, data, size);
+			}
 			else
-				latency = IFCALLRESULT(0, rdpsnd->device->Play, rdpsnd->device,
-				                       Stream_Buffer(pcmData), Stream_Length(pcmData));
-		}
-		else
-			status = ERROR_INTERNAL_ERROR;
+				rc = freerdp_dsp_decode(rdpsnd->dsp_context, format, data, size, pcmData);
+
+			if (rc)
+			{
+				Stream_SealLength(pcmData);
+				latency = rdpsnd_play_adaptive(rdpsnd, format, pcmData, FALSE);
+			}
 
-		Stream_Release(pcmData);
+			Stream_Release(pcmData);
 
-		if (status != CHANNEL_RC_OK)
-			return status;
+			if (!rc)
+				return ERROR_INTERNAL_ERROR;
+		}
 	}
 
+	/*
+	 * latency is the time until this wave is played, the second WaveConfirm PDU reports
+	 * the local playback time of the wave in server time.
+	 */
 	end = GetTickCount64();
 	diffMS = end - rdpsnd->wArrivalTime + latency;
 	ts = (rdpsnd->wTimeStamp + diffMS) % UINT16_MAX;
@@ -719,7 +836,7 @@ static UINT rdpsnd_recv_wave2_pdu(rdpsndPlugin* rdpsnd, wStream* s, UINT16 BodyS
 		return ERROR_INVALID_DATA;
 	format = &rdpsnd->ClientFormats[wFormatNo];
 	rdpsnd->waveDataSize = BodySize - 12;
-	rdpsnd->wArrivalTime = GetTickCount64();
+	rdpsnd->wArrivalTime = rdpsnd->receiveTime;
 	WLog_Print(rdpsnd->log, WLOG_DEBUG,
 	           "%s Wave2PDU: cBlockNo: %" PRIu8 " wFormatNo: %" PRIu16
 	           " [%s] , align=%hu wTimeStamp=0x%04" PRIx16 ", dwAudioTimeStamp=0x%08" PRIx32,
@@ -730,11 +847,14 @@ static UINT rdpsnd_recv_wave2_pdu(rdpsndPlugin* rdpsnd, wStream* s, UINT16 BodyS
 	if (!rdpsnd_ensure_device_is_open(rdpsnd, wFormatNo, format))
 		return ERROR_INTERNAL_ERROR;
 
+	rdpsnd_jitter_arrival(rdpsnd->jitter, rdpsnd->wTimeStamp, rdpsnd->wArrivalTime);
 	return rdpsnd_treat_wave(rdpsnd, s, rdpsnd->waveDataSize);
 }
 
 static void rdpsnd_recv_close_pdu(rdpsndPlugin* rdpsnd)
 {
+	rdpsnd_jitter_reset(rdpsnd->jitter);
+
 	if (rdpsnd->isOpen)
 	{
 		WLog_Print(rdpsnd->log, WLOG_DEBUG, "%s Closing device",
@@ -1192,6 +1312,7 @@ static UINT rdpsnd_virtual_channel_event_data_received(rdpsndPlugin* plugin, voi
 		}
 		else
 		{
+			plugin->receiveTime = GetTickCount64();
 			UINT error = rdpsnd_recv_pdu(plugin, plugin->data_in);
 			plugin->data_in = nullptr;
 			if (error)
@@ -1392,9 +1513,11 @@ static void free_internals(rdpsndPlugin* rdpsnd)
 
 	rdpsnd_terminate_thread(rdpsnd);
 	freerdp_dsp_context_free(rdpsnd->dsp_context);
+	rdpsnd_jitter_free(rdpsnd->jitter);
 	StreamPool_Free(rdpsnd->pool);
 	rdpsnd->pool = nullptr;
 	rdpsnd->dsp_context = nullptr;
+	rdpsnd->jitter = nullptr;
 }
 
 static BOOL allocate_internals(rdpsndPlugin* rdpsnd)
@@ -1459,11 +1582,20 @@ static DWORD WINAPI play_thread(LPVOID arg)
 
 		handles[nCount++] = MessageQueue_Event(rdpsnd->queue);
 		handles[nCount++] = freerdp_abort_event(rdpsnd->rdpcontext);
-		status = WaitForMultipleObjects(nCount, handles, FALSE, INFINITE);
+
+		/* Wake up before the device runs dry to conceal a late packet */
+		DWORD timeout = INFINITE;
+		if (rdpsnd_concealable_format(rdpsnd))
+			timeout = rdpsnd_jitter_conceal_timeout(rdpsnd->jitter, GetTickCount64());
+
+		status = WaitForMultipleObjects(nCount, handles, FALSE, timeout);
 		switch (status)
 		{
 			case WAIT_OBJECT_0:
 				break;
+			case WAIT_TIMEOUT:
+				rdpsnd_conceal(rdpsnd);
+				continue;
 			default:
 				return ERROR_TIMEOUT;
 		}
@@ -1476,6 +1608,7 @@ static DWORD WINAPI play_thread(LPVOID arg)
 			break;
 
 		s = message.wParam;
+		rdpsnd->receiveTime = message.time;
 		error = rdpsnd_recv_pdu(rdpsnd, s);
 
 		if (error)
@@ -1697,6 +1830,7 @@ static UINT rdpsnd_on_data_received(IWTSVirtualChannelCallback* pChannelCallback
 	}
 	else
 	{
+		plugin->receiveTime = GetTickCount64();
 		UINT error = rdpsnd_recv_pdu(plugin, copy);
 		if (error)
 			return error;
@@ -0,0 +1,229 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Audio Output Virtual Channel - jitter buffer unit test
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+
+#include <winpr/crt.h>
+#include <winpr/endian.h>
+#include <winpr/stream.h>
+
+#include "../rdpsnd_jitter.h"
+
+/* Match the defaults in rdpsnd_jitter.c */
+#define TEST_MIN_LATENCY 40
+#define TEST_MAX_LATENCY 400
+#define TEST_MAX_STRETCH 20 /* per mille */
+
+#define TEST_PACKET_MS 20
+#define TEST_PACKET_FRAMES 960 /* 20 ms at 48 kHz */
+
+static const AUDIO_FORMAT test_format = { .wFormatTag = WAVE_FORMAT_PCM,
+	                                      .nChannels = 2,
+	                                      .nSamplesPerSec = 48000,
+	                                      .nAvgBytesPerSec = 48000 * 4,
+	                                      .nBlockAlign = 4,
+	                                      .wBitsPerSample = 16 };
+
+static INT16 test_sample(size_t frame, BOOL silent)
+{
+	if (silent)
+		return 0;
+	return (INT16)((INT32)(frame % 100) * 100 - 5000);
+}
+
+static wStream* test_packet(size_t frames, BOOL silent)
+{
+	wStream* s = Stream_New(nullptr, frames * 4);
+	if (!s)
+		return nullptr;
+
+	for (size_t x = 0; x < frames; x++)
+	{
+		Stream_Write_INT16(s, test_sample(x, silent));
+		Stream_Write_INT16(s, test_sample(x, silent));
+	}
+	Stream_SealLength(s);
+	return s;
+}
+
+/* Feeds packets sent every 20 ms that arrive late by delay(x) ms */
+static void test_arrivals(RDPSND_JITTER* jitter, UINT16 start, size_t count,
+                          UINT64 (*delay)(size_t x))
+{
+	/* Each series starts a new stream, the jitter estimate is kept */
+	rdpsnd_jitter_reset(jitter);
+	for (size_t x = 0; x < count; x++)
+	{
+		const UINT16 sent = (UINT16)(start + x * TEST_PACKET_MS);
+		rdpsnd_jitter_arrival(jitter, sent, 1000 + x * TEST_PACKET_MS + delay(x));
+	}
+}
+
+static UINT64 test_delay_constant(WINPR_ATTR_UNUSED size_t x)
+{
+	return 50;
+}
+
+static UINT64 test_delay_alternating(size_t x)
+{
+	return (x % 2) ? 10 : 0;
+}
+
+static UINT64 test_delay_huge(size_t x)
+{
+	return (x % 2) ? 500 : 0;
+}
+
+static BOOL test_target(void)
+{
+	BOOL rc = FALSE;
+	RDPSND_JITTER* jitter = rdpsnd_jitter_new(0);
+	if (!jitter)
+		return FALSE;
+
+	if (rdpsnd_jitter_target(jitter) != TEST_MIN_LATENCY)
+		goto fail;
+
+	/* A constant delay is no jitter, also across the wrap around of wTimeStamp */
+	test_arrivals(jitter, 65000, 100, test_delay_constant);
+	if (rdpsnd_jitter_target(jitter) != TEST_MIN_LATENCY)
+		goto fail;
+
+	/* Every packet deviates by 10 ms, the target converges on three times the jitter */
+	test_arrivals(jitter, 0, 200, test_delay_alternating);
+	const UINT32 target = rdpsnd_jitter_target(jitter);
+	if ((target < TEST_MIN_LATENCY + 28) || (target > TEST_MIN_LATENCY + 30))
+		goto fail;
+
+	/* and is limited */
+	test_arrivals(jitter, 0, 200, test_delay_huge);
+	if (rdpsnd_jitter_target(jitter) != TEST_MAX_LATENCY)
+		goto fail;
+
+	/* A configured latency is the minimum */
+	rdpsnd_jitter_free(jitter);
+	jitter = rdpsnd_jitter_new(100);
+	if (!jitter || (rdpsnd_jitter_target(jitter) != 100))
+		goto fail;
+
+	rc = TRUE;
+fail:
+	if (!rc)
+		(void)fprintf(stderr, "unexpected target latency\n");
+	rdpsnd_jitter_free(jitter);
+	return rc;
+}
+
+/* Adapts a packet of 20 ms with buffered ms already queued, returns the frames to play or -1
+ * if the packet is dropped */
+static INT64 test_adapt(size_t buffered, BOOL silent, wStream** out)
+{
+	INT64 frames = -2;
+	const UINT64 now = 1000;
+	RDPSND_JITTER* jitter = rdpsnd_jitter_new(0);
+	wStream* s = test_packet(TEST_PACKET_FRAMES, silent);
+
+	if (!jitter || !s)
+		goto fail;
+
+	if (buffered > 0)
+		(void)rdpsnd_jitter_played(jitter, &test_format, buffered * 48 * 4, now, FALSE);
+
+	if (!rdpsnd_jitter_adapt(jitter, &test_format, s, now))
+		frames = -1;
+	else
+		frames = (INT64)(Stream_Length(s) / 4);
+
+fail:
+	rdpsnd_jitter_free(jitter);
+	if (out)
+		*out = s;
+	else
+		Stream_Free(s, TRUE);
+	return frames;
+}
+
+static BOOL test_stretch(void)
+{
+	const INT64 maxStretch = TEST_PACKET_FRAMES * TEST_MAX_STRETCH / 1000;
+
+	/* Within the hysteresis around the target nothing changes */
+	if (test_adapt(TEST_MIN_LATENCY - TEST_PACKET_MS, FALSE, nullptr) != TEST_PACKET_FRAMES)
+		return FALSE;
+
+	/* Far above the target the packet is shortened, by no more than the stretch limit */
+	if (test_adapt(60, FALSE, nullptr) != TEST_PACKET_FRAMES - maxStretch)
+		return FALSE;
+
+	/* Far below it is stretched the same way */
+	if (test_adapt(5, FALSE, nullptr) != TEST_PACKET_FRAMES + maxStretch)
+		return FALSE;
+
+	/* Silent packets are dropped instead of shortened */
+	if (test_adapt(60, TRUE, nullptr) != -1)
+		return FALSE;
+
+	/* More than a packet above the target the packet is dropped */
+	if (test_adapt(100, FALSE, nullptr) != -1)
+		return FALSE;
+
+	return TRUE;
+}
+
+static BOOL test_underrun(void)
+{
+	wStream* s = nullptr;
+	const size_t silence = (TEST_MIN_LATENCY - TEST_PACKET_MS) * 48;
+
+	/* Nothing queued, silence fills the gap up to the target latency */
+	const INT64 frames = test_adapt(0, FALSE, &s);
+	BOOL rc = s && (frames == (INT64)(TEST_PACKET_FRAMES + silence));
+
+	for (size_t x = 0; rc && (x < (size_t)frames); x++)
+	{
+		const INT16 expect = (x < silence) ? 0 : test_sample(x - silence, FALSE);
+		const BYTE* data = Stream_Buffer(s) + x * 4;
+		rc = (winpr_Data_Get_INT16(data) == expect) &&
+		     (winpr_Data_Get_INT16(data + 2) == expect);
+	}
+
+	Stream_Free(s, TRUE);
+	return rc;
+}
+
+int TestRdpsndJitter(int argc, char* argv[])
+{
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	if (!test_target())
+		return -1;
+
+	if (!test_stretch())
+	{
+		(void)fprintf(stderr, "packet stretched beyond the limit\n");
+		return -1;
+	}
+
+	if (!test_underrun())
+	{
+		(void)fprintf(stderr, "no silence prepended after an underrun\n");
+		return -1;
+	}
+
+	return 0;
+}
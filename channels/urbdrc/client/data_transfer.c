@@ -58,7 +58,7 @@ static BOOL write_urb_result_header(wStream* s, UINT16 Size, UINT32 status)
 	if (!Stream_EnsureRemainingCapacity(s, 8ULL + Size))
 		return FALSE;
 	Stream_Write_UINT16(s, Size);
-	Stream_Seek_UINT16(s);
+	Stream_Write_UINT16(s, 0); /* Padding */
 	Stream_Write_UINT32(s, status);
 	return TRUE;
 }
@@ -117,7 +117,7 @@ static UINT urb_write_completion(WINPR_ATTR_UNUSED IUDEVICE* pdev,
 	const UINT32 payloadSize = urb_completion_payload_size(transferDir, OutputBufferSize);
 	if (Stream_Capacity(out) < payloadSize + 36ULL)
 	{
-		Stream_Free(out, TRUE);
+		Stream_Release(out);
 		return ERROR_INVALID_PARAMETER;
 	}
 
@@ -126,7 +126,7 @@ static UINT urb_write_completion(WINPR_ATTR_UNUSED IUDEVICE* pdev,
 	const UINT32 FunctionId = (payloadSize != 0) ? URB_COMPLETION : URB_COMPLETION_NO_DATA;
 	if (!write_shared_message_header_with_functionid(out, InterfaceId, MessageId, FunctionId))
 	{
-		Stream_Free(out, TRUE);
+		Stream_Release(out);
 		return ERROR_OUTOFMEMORY;
 	}
 
@@ -135,7 +135,7 @@ static UINT urb_write_completion(WINPR_ATTR_UNUSED IUDEVICE* pdev,
 
 	if (!write_urb_result_header(out, 8, usbd_status))
 	{
-		Stream_Free(out, TRUE);
+		Stream_Release(out);
 		return ERROR_OUTOFMEMORY;
 	}
 
@@ -146,7 +146,7 @@ static UINT urb_write_completion(WINPR_ATTR_UNUSED IUDEVICE* pdev,
 	if (!noAck)
 		return stream_write_and_free(callback->plugin, callback->channel, out);
 	else
-		Stream_Free(out, TRUE);
+		Stream_Release(out);
 
 	return ERROR_SUCCESS;
 }
@@ -855,7 +855,7 @@ static void urb_bulk_transfer_cb(IUDEVICE* pdev, GENERIC_CHANNEL_CALLBACK* callb
 		urb_write_completion(pdev, callback, noAck, out, InterfaceId, MessageId, RequestId, status,
 		                     OutputBufferSize, transferDir);
 	else
-		Stream_Free(out, TRUE);
+		Stream_Release(out);
 }
 
 static UINT urb_bulk_or_interrupt_transfer(IUDEVICE* pdev, GENERIC_CHANNEL_CALLBACK* callback,
@@ -914,7 +914,7 @@ static void urb_isoch_transfer_cb(WINPR_ATTR_UNUSED IUDEVICE* pdev,
 		const UINT32 FunctionId = (payloadSize != 0) ? URB_COMPLETION : URB_COMPLETION_NO_DATA;
 		if (!write_shared_message_header_with_functionid(out, InterfaceId, MessageId, FunctionId))
 		{
-			Stream_Free(out, TRUE);
+			Stream_Release(out);
 			return;
 		}
 
@@ -923,7 +923,7 @@ static void urb_isoch_transfer_cb(WINPR_ATTR_UNUSED IUDEVICE* pdev,
 		if (!write_urb_result_header(out, WINPR_ASSERTING_INT_CAST(uint16_t, 20 + packetSize),
 		                             status))
 		{
-			Stream_Free(out, TRUE);
+			Stream_Release(out);
 			return;
 		}
 
@@ -0,0 +1,1738 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * RemoteFX USB Redirection - in process fake USB devices
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <winpr/assert.h>
+#include <winpr/cast.h>
+#include <winpr/crt.h>
+#include <winpr/collections.h>
+#include <winpr/endian.h>
+#include <winpr/stream.h>
+#include <winpr/synch.h>
+#include <winpr/sysinfo.h>
+#include <winpr/thread.h>
+
+#include "fake_udevice.h"
+#include "msusb.h"
+
+/* Idle transfers kept per device for reuse by later URBs */
+#define FAKE_TRANSFER_POOL_SIZE 32
+/* Completions delivered per wakeup of the device thread */
+#define FAKE_COMPLETION_BATCH 32
+
+/* offset of the payload in a bulk or interrupt completion message */
+#define FAKE_BULK_HEADER 36
+/* offset of the iso packet descriptors in an isochronous completion message */
+#define FAKE_ISOCH_PACKETS 40
+
+#define FAKE_DT_DEVICE 0x01
+#define FAKE_DT_CONFIG 0x02
+#define FAKE_DT_STRING 0x03
+#define FAKE_DT_INTERFACE 0x04
+#define FAKE_DT_ENDPOINT 0x05
+
+#define FAKE_REQUEST_GET_STATUS 0x00
+#define FAKE_REQUEST_CLEAR_FEATURE 0x01
+#define FAKE_REQUEST_SET_FEATURE 0x03
+#define FAKE_REQUEST_GET_DESCRIPTOR 0x06
+#define FAKE_REQUEST_GET_CONFIGURATION 0x08
+#define FAKE_REQUEST_SET_CONFIGURATION 0x09
+#define FAKE_REQUEST_GET_INTERFACE 0x0A
+#define FAKE_REQUEST_SET_INTERFACE 0x0B
+
+#define FAKE_STORAGE_EP_IN 0x81
+#define FAKE_STORAGE_BLOCK 512
+#define FAKE_CBW_SIGNATURE 0x43425355
+#define FAKE_CSW_SIGNATURE 0x53425355
+#define FAKE_CBW_LENGTH 31
+#define FAKE_CSW_LENGTH 13
+
+#define FAKE_SENSE_NONE 0x00
+#define FAKE_SENSE_ILLEGAL_REQUEST 0x05
+
+#define FAKE_AUDIO_SAMPLE_RATE 48000
+
+#define BASIC_STATE_FUNC_DEFINED(_arg, _type)                  \
+	static _type fake_udev_get_##_arg(IUDEVICE* idev)          \
+	{                                                          \
+		FAKE_UDEVICE* pdev = (FAKE_UDEVICE*)idev;              \
+		return pdev->_arg;                                     \
+	}                                                          \
+	static void fake_udev_set_##_arg(IUDEVICE* idev, _type _t) \
+	{                                                          \
+		FAKE_UDEVICE* pdev = (FAKE_UDEVICE*)idev;              \
+		pdev->_arg = _t;                                       \
+	}
+
+#define BASIC_POINT_FUNC_DEFINED(_arg, _type)                    \
+	static _type fake_udev_get_p_##_arg(IUDEVICE* idev)          \
+	{                                                            \
+		FAKE_UDEVICE* pdev = (FAKE_UDEVICE*)idev;                \
+		return pdev->_arg;                                       \
+	}                                                            \
+	static void fake_udev_set_p_##_arg(IUDEVICE* idev, _type _t) \
+	{                                                            \
+		FAKE_UDEVICE* pdev = (FAKE_UDEVICE*)idev;                \
+		pdev->_arg = _t;                                         \
+	}
+
+#define BASIC_STATE_FUNC_REGISTER(_arg, _dev)      \
+	(_dev)->iface.get_##_arg = fake_udev_get_##_arg; \
+	(_dev)->iface.set_##_arg = fake_udev_set_##_arg
+
+typedef struct
+{
+	UINT16 idVendor;
+	UINT16 idProduct;
+	const BYTE* device;
+	const BYTE* config;
+	size_t configLength;
+	const char* strings[3]; /* iManufacturer, iProduct, iSerialNumber */
+} FAKE_UDEVICE_PROFILE;
+
+typedef struct
+{
+	UINT32 RequestId;
+	UINT32 MessageId;
+	BYTE EndpointAddress;
+	BOOL isoch;
+	BOOL noAck;
+	int transferDir;
+	UINT32 BufferSize;
+	UINT32 NumberOfPackets;
+	UINT32 StartFrame;
+	UINT32 ErrorCount;
+	UINT32 status;
+	UINT32 actual;
+	BOOL ready;
+	UINT64 due; /* GetTickCount64() the completion is sent at */
+	wStream* data;
+	GENERIC_CHANNEL_CALLBACK* callback;
+	t_isoch_transfer_cb cb;
+} FAKE_TRANSFER;
+
+/* bulk only transport state of the mass storage profile */
+typedef struct
+{
+	BYTE* disk;
+	UINT32 blocks;
+
+	UINT32 tag;
+	UINT32 residue;
+	BYTE status;
+	BOOL cswPending;
+	BOOL stallIn;
+
+	/* data phase, device to host */
+	const BYTE* inData;
+	UINT32 inLength;
+	/* data phase, host to device. Bytes beyond outWritable are discarded */
+	BYTE* outData;
+	UINT32 outWritable;
+	UINT32 outRemaining;
+
+	BYTE senseKey;
+	BYTE senseCode;
+	BYTE reply[36];
+} FAKE_STORAGE;
+
+typedef struct
+{
+	IUDEVICE iface;
+
+	void* udev;
+	void* prev;
+	void* next;
+
+	UINT32 UsbDevice;     /* An unique interface ID */
+	UINT32 ReqCompletion; /* An unique interface ID */
+	IWTSVirtualChannelManager* channelManager;
+	UINT32 channelID;
+	UINT16 status;
+	BYTE bus_number;
+	BYTE dev_number;
+	char path[17];
+	UINT8 port_number;
+	MSUSB_CONFIG_DESCRIPTOR* MsConfig;
+
+	FAKE_UDEVICE_TYPE type;
+	const FAKE_UDEVICE_PROFILE* profile;
+	BYTE configuration;
+	BYTE alternate[4];
+
+	/* guards everything below, transfers complete on the device thread */
+	CRITICAL_SECTION lock;
+	wArrayList* requests;
+	wStreamPool* buffers;
+	FAKE_TRANSFER* transfer_pool[FAKE_TRANSFER_POOL_SIZE];
+	size_t transfer_pool_count;
+
+	HANDLE event;
+	HANDLE thread;
+	BOOL running;
+
+	FAKE_STORAGE storage;
+	UINT64 isochClock[2]; /* end of the frames scheduled per direction */
+
+	URBDRC_PLUGIN* urbdrc;
+} FAKE_UDEVICE;
+
+static const BYTE fake_storage_device[] = { 0x12, 0x01, 0x00, 0x02, 0x00, 0x00, 0x00, 0x40, 0x25,
+	                                        0x05, 0xa5, 0xa4, 0x00, 0x01, 0x01, 0x02, 0x03, 0x01 };
+
+static const BYTE fake_storage_config[] = {
+	/* configuration */
+	0x09, 0x02, 0x20, 0x00, 0x01, 0x01, 0x00, 0x80, 0x32,
+	/* interface 0: mass storage, SCSI transparent, bulk only transport */
+	0x09, 0x04, 0x00, 0x00, 0x02, 0x08, 0x06, 0x50, 0x00,
+	/* bulk in 0x81 and bulk out 0x02, 512 bytes */
+	0x07, 0x05, 0x81, 0x02, 0x00, 0x02, 0x00, 0x07, 0x05, 0x02, 0x02, 0x00, 0x02, 0x00
+};
+
+static const BYTE fake_headset_device[] = { 0x12, 0x01, 0x10, 0x01, 0x00, 0x00, 0x00, 0x40, 0x6b,
+	                                        0x1d, 0x01, 0x01, 0x00, 0x01, 0x01, 0x02, 0x03, 0x01 };
+
+static const BYTE fake_headset_config[] = {
+	/* configuration */
+	0x09, 0x02, 0xae, 0x00, 0x03, 0x01, 0x00, 0x80, 0x32,
+	/* interface 0: audio control */
+	0x09, 0x04, 0x00, 0x00, 0x00, 0x01, 0x01, 0x00, 0x00,
+	/* class specific header, streaming interfaces 1 and 2 */
+	0x0a, 0x24, 0x01, 0x00, 0x01, 0x34, 0x00, 0x02, 0x01, 0x02,
+	/* USB streaming input terminal 1, stereo, to headphones output terminal 2 */
+	0x0c, 0x24, 0x02, 0x01, 0x01, 0x01, 0x00, 0x02, 0x03, 0x00, 0x00, 0x00,
+	0x09, 0x24, 0x03, 0x02, 0x02, 0x03, 0x00, 0x01, 0x00,
+	/* microphone input terminal 3, mono, to USB streaming output terminal 4 */
+	0x0c, 0x24, 0x02, 0x03, 0x01, 0x02, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00,
+	0x09, 0x24, 0x03, 0x04, 0x01, 0x01, 0x00, 0x03, 0x00,
+	/* interface 1: speaker streaming, alternate 1 is 48kHz 16bit stereo PCM */
+	0x09, 0x04, 0x01, 0x00, 0x00, 0x01, 0x02, 0x00, 0x00,
+	0x09, 0x04, 0x01, 0x01, 0x01, 0x01, 0x02, 0x00, 0x00,
+	0x07, 0x24, 0x01, 0x01, 0x01, 0x01, 0x00,
+	0x0b, 0x24, 0x02, 0x01, 0x02, 0x02, 0x10, 0x01, 0x80, 0xbb, 0x00,
+	/* isochronous adaptive out 0x01, 192 bytes every frame */
+	0x09, 0x05, 0x01, 0x09, 0xc0, 0x00, 0x01, 0x00, 0x00,
+	0x07, 0x25, 0x01, 0x01, 0x00, 0x00, 0x00,
+	/* interface 2: microphone streaming, alternate 1 is 48kHz 16bit mono PCM */
+	0x09, 0x04, 0x02, 0x00, 0x00, 0x01, 0x02, 0x00, 0x00,
+	0x09, 0x04, 0x02, 0x01, 0x01, 0x01, 0x02, 0x00, 0x00,
+	0x07, 0x24, 0x01, 0x04, 0x01, 0x01, 0x00,
+	0x0b, 0x24, 0x02, 0x01, 0x01, 0x02, 0x10, 0x01, 0x80, 0xbb, 0x00,
+	/* isochronous asynchronous in 0x82, 96 bytes every frame */
+	0x09, 0x05, 0x82, 0x05, 0x60, 0x00, 0x01, 0x00, 0x00,
+	0x07, 0x25, 0x01, 0x01, 0x00, 0x00, 0x00
+};
+
+static const FAKE_UDEVICE_PROFILE fake_profiles[FAKE_UDEVICE_COUNT] = {
+	{ 0x0525,
+	  0xa4a5,
+	  fake_storage_device,
+	  fake_storage_config,
+	  sizeof(fake_storage_config),
+	  { "FreeRDP", "Fake Storage", "000000000001" } },
+	{ 0x1d6b,
+	  0x0101,
+	  fake_headset_device,
+	  fake_headset_config,
+	  sizeof(fake_headset_config),
+	  { "FreeRDP", "Fake Headset", "000000000002" } }
+};
+
+static BYTE fake_num_interfaces(const FAKE_UDEVICE_PROFILE* profile)
+{
+	return profile->config[4];
+}
+
+static const BYTE* fake_find_interface(const FAKE_UDEVICE_PROFILE* profile, BYTE InterfaceNumber,
+                                       BYTE AlternateSetting)
+{
+	const BYTE* config = profile->config;
+
+	for (size_t pos = 0; (pos + 4 < profile->configLength) && (config[pos] >= 2);
+	     pos += config[pos])
+	{
+		if ((config[pos + 1] == FAKE_DT_INTERFACE) && (config[pos + 2] == InterfaceNumber) &&
+		    (config[pos + 3] == AlternateSetting))
+			return &config[pos];
+	}
+
+	return nullptr;
+}
+
+/* Endpoint descriptor \b index of the interface descriptor \b iface */
+static const BYTE* fake_interface_endpoint(const FAKE_UDEVICE_PROFILE* profile, const BYTE* iface,
+                                           BYTE index)
+{
+	const BYTE* end = profile->config + profile->configLength;
+	BYTE count = 0;
+
+	for (const BYTE* cur = iface + iface[0]; (cur + 2 <= end) && (cur[0] >= 2); cur += cur[0])
+	{
+		if (cur[1] == FAKE_DT_INTERFACE)
+			break;
+
+		if (cur[1] == FAKE_DT_ENDPOINT)
+		{
+			if (count == index)
+				return cur;
+			count++;
+		}
+	}
+
+	return nullptr;
+}
+
+/* Endpoint descriptor of \b EndpointAddress in the selected alternate settings */
+static const BYTE* fake_find_endpoint(const FAKE_UDEVICE* pdev, UINT32 EndpointAddress)
+{
+	const FAKE_UDEVICE_PROFILE* profile = pdev->profile;
+
+	for (BYTE inum = 0; inum < fake_num_interfaces(profile); inum++)
+	{
+		const BYTE* iface = fake_find_interface(profile, inum, pdev->alternate[inum]);
+		if (!iface)
+			continue;
+
+		for (BYTE pnum = 0; pnum < iface[4]; pnum++)
+		{
+			const BYTE* ep = fake_interface_endpoint(profile, iface, pnum);
+			if (ep && (ep[2] == EndpointAddress))
+				return ep;
+		}
+	}
+
+	return nullptr;
+}
+
+static FAKE_TRANSFER* fake_transfer_take(FAKE_UDEVICE* pdev)
+{
+	FAKE_TRANSFER* transfer = nullptr;
+
+	if (pdev->transfer_pool_count > 0)
+		transfer = pdev->transfer_pool[--pdev->transfer_pool_count];
+	else
+		transfer = calloc(1, sizeof(FAKE_TRANSFER));
+
+	return transfer;
+}
+
+static void fake_transfer_free(FAKE_TRANSFER* transfer)
+{
+	if (!transfer)
+		return;
+
+	if (transfer->data)
+		Stream_Release(transfer->data);
+	free(transfer);
+}
+
+static void fake_transfer_return(FAKE_UDEVICE* pdev, FAKE_TRANSFER* transfer)
+{
+	if (transfer->data)
+		Stream_Release(transfer->data);
+	memset(transfer, 0, sizeof(FAKE_TRANSFER));
+
+	if (pdev->transfer_pool_count < ARRAYSIZE(pdev->transfer_pool))
+		pdev->transfer_pool[pdev->transfer_pool_count++] = transfer;
+	else
+		free(transfer);
+}
+
+static void fake_transfer_ready(FAKE_TRANSFER* transfer, UINT32 status, UINT32 actual, UINT64 due)
+{
+	transfer->status = status;
+	transfer->actual = actual;
+	transfer->due = due;
+	transfer->ready = TRUE;
+}
+
+static void fake_storage_reset(FAKE_STORAGE* storage)
+{
+	storage->cswPending = FALSE;
+	storage->inData = nullptr;
+	storage->inLength = 0;
+	storage->outData = nullptr;
+	storage->outWritable = 0;
+	storage->outRemaining = 0;
+}
+
+static void fake_storage_sense(FAKE_STORAGE* storage, BYTE key, BYTE code)
+{
+	storage->senseKey = key;
+	storage->senseCode = code;
+	storage->status = (key == FAKE_SENSE_NONE) ? 0 : 1;
+}
+
+/* Checks the LBA range of a READ(10) or WRITE(10) command, returns the offset into the disk */
+static BOOL fake_storage_range(FAKE_STORAGE* storage, const BYTE* cb, size_t* offset,
+                               UINT32* length)
+{
+	const UINT32 lba = winpr_Data_Get_UINT32_BE(&cb[2]);
+	const UINT32 count = winpr_Data_Get_UINT16_BE(&cb[7]);
+
+	if ((lba > storage->blocks) || (count > storage->blocks - lba))
+	{
+		/* LOGICAL BLOCK ADDRESS OUT OF RANGE */
+		fake_storage_sense(storage, FAKE_SENSE_ILLEGAL_REQUEST, 0x21);
+		return FALSE;
+	}
+
+	*offset = 1ull * lba * FAKE_STORAGE_BLOCK;
+	*length = count * FAKE_STORAGE_BLOCK;
+	return TRUE;
+}
+
+static void fake_storage_command(FAKE_STORAGE* storage, const BYTE* cbw)
+{
+	const UINT32 expected = winpr_Data_Get_UINT32(&cbw[8]);
+	const BOOL hostIn = (cbw[12] & 0x80) != 0;
+	const BYTE* cb = &cbw[15];
+	BYTE* reply = storage->reply;
+	const BYTE* inData = nullptr;
+	UINT32 inLength = 0;
+	BYTE* outData = nullptr;
+	UINT32 outLength = 0;
+
+	fake_storage_reset(storage);
+	storage->tag = winpr_Data_Get_UINT32(&cbw[4]);
+	storage->status = 0;
+	memset(reply, 0, sizeof(storage->reply));
+
+	switch (cb[0])
+	{
+		case 0x00: /* TEST UNIT READY */
+		case 0x1B: /* START STOP UNIT */
+		case 0x1E: /* PREVENT ALLOW MEDIUM REMOVAL */
+		case 0x2F: /* VERIFY(10) */
+		case 0x35: /* SYNCHRONIZE CACHE(10) */
+			fake_storage_sense(storage, FAKE_SENSE_NONE, 0);
+			break;
+
+		case 0x03: /* REQUEST SENSE */
+			reply[0] = 0x70;
+			reply[2] = storage->senseKey;
+			reply[7] = 10;
+			reply[12] = storage->senseCode;
+			inData = reply;
+			inLength = 18;
+			fake_storage_sense(storage, FAKE_SENSE_NONE, 0);
+			break;
+
+		case 0x12: /* INQUIRY */
+			if (cb[1] & 0x01)
+			{
+				/* no vital product data pages, INVALID FIELD IN CDB */
+				fake_storage_sense(storage, FAKE_SENSE_ILLEGAL_REQUEST, 0x24);
+				break;
+			}
+			reply[1] = 0x80; /* removable */
+			reply[2] = 0x04; /* SPC-2 */
+			reply[3] = 0x02;
+			reply[4] = 31;
+			memcpy(&reply[8], "FreeRDP ", 8);
+			memcpy(&reply[16], "Fake Storage    ", 16);
+			memcpy(&reply[32], "1.00", 4);
+			inData = reply;
+			inLength = 36;
+			fake_storage_sense(storage, FAKE_SENSE_NONE, 0);
+			break;
+
+		case 0x1A: /* MODE SENSE(6) */
+			reply[0] = 3;
+			inData = reply;
+			inLength = 4;
+			fake_storage_sense(storage, FAKE_SENSE_NONE, 0);
+			break;
+
+		case 0x5A: /* MODE SENSE(10) */
+			reply[1] = 6;
+			inData = reply;
+			inLength = 8;
+			fake_storage_sense(storage, FAKE_SENSE_NONE, 0);
+			break;
+
+		case 0x23: /* READ FORMAT CAPACITIES */
+			reply[3] = 8;
+			winpr_Data_Write_UINT32_BE(&reply[4], storage->blocks);
+			/* descriptor type in the high byte of the block length */
+			winpr_Data_Write_UINT32_BE(&reply[8], FAKE_STORAGE_BLOCK);
+			reply[8] = 0x02; /* formatted media */
+			inData = reply;
+			inLength = 12;
+			fake_storage_sense(storage, FAKE_SENSE_NONE, 0);
+			break;
+
+		case 0x25: /* READ CAPACITY(10) */
+			winpr_Data_Write_UINT32_BE(&reply[0], storage->blocks - 1);
+			winpr_Data_Write_UINT32_BE(&reply[4], FAKE_STORAGE_BLOCK);
+			inData = reply;
+			inLength = 8;
+			fake_storage_sense(storage, FAKE_SENSE_NONE, 0);
+			break;
+
+		case 0x28: /* READ(10) */
+		{
+			size_t offset = 0;
+			if (!fake_storage_range(storage, cb, &offset, &inLength))
+				break;
+			inData = &storage->disk[offset];
+			fake_storage_sense(storage, FAKE_SENSE_NONE, 0);
+		}
+		break;
+
+		case 0x2A: /* WRITE(10) */
+		{
+			size_t offset = 0;
+			if (!fake_storage_range(storage, cb, &offset, &outLength))
+				break;
+			outData = &storage->disk[offset];
+			fake_storage_sense(storage, FAKE_SENSE_NONE, 0);
+		}
+		break;
+
+		default:
+			/* INVALID COMMAND OPERATION CODE */
+			fake_storage_sense(storage, FAKE_SENSE_ILLEGAL_REQUEST, 0x20);
+			break;
+	}
+
+	/* device and host disagree about the direction of the data phase */
+	if (((inLength > 0) && (expected > 0) && !hostIn) ||
+	    ((outLength > 0) && (expected > 0) && hostIn))
+	{
+		storage->status = 2;
+		inLength = 0;
+		outLength = 0;
+	}
+
+	if (inLength > expected)
+		inLength = expected;
+	if (outLength > expected)
+		outLength = expected;
+
+	if (hostIn)
+	{
+		storage->inData = inData;
+		storage->inLength = inLength;
+		storage->residue = expected - inLength;
+
+		/* the host expects more data than there is, stall to end the data phase */
+		if ((expected > 0) && (inLength == 0))
+			storage->stallIn = TRUE;
+	}
+	else
+	{
+		storage->outData = outData;
+		storage->outWritable = outLength;
+		storage->outRemaining = expected;
+		storage->residue = expected - outLength;
+	}
+
+	storage->cswPending = TRUE;
+}
+
+/* Bulk out data of the mass storage profile, FALSE stalls the endpoint */
+static BOOL fake_storage_out(FAKE_STORAGE* storage, const BYTE* data, UINT32 length)
+{
+	if (storage->outRemaining > 0)
+	{
+		const UINT32 used = (length < storage->outRemaining) ? length : storage->outRemaining;
+		const UINT32 written = (used < storage->outWritable) ? used : storage->outWritable;
+
+		if (written > 0)
+		{
+			memcpy(storage->outData, data, written);
+			storage->outData += written;
+			storage->outWritable -= written;
+		}
+		storage->outRemaining -= used;
+		return TRUE;
+	}
+
+	if (!data || (length != FAKE_CBW_LENGTH) ||
+	    (winpr_Data_Get_UINT32(data) != FAKE_CBW_SIGNATURE) || ((data[13] & 0x0F) != 0))
+	{
+		/* invalid command block wrapper, wait for a reset recovery */
+		fake_storage_reset(storage);
+		storage->stallIn = TRUE;
+		return FALSE;
+	}
+
+	fake_storage_command(storage, data);
+	return TRUE;
+}
+
+/* Serves the queued bulk in transfers of the mass storage profile, data phase first */
+static BOOL fake_storage_poll(FAKE_UDEVICE* pdev, UINT64 now)
+{
+	FAKE_STORAGE* storage = &pdev->storage;
+	BOOL completed = FALSE;
+
+	if (pdev->type != FAKE_UDEVICE_STORAGE)
+		return FALSE;
+
+	const size_t count = ArrayList_Count(pdev->requests);
+	for (size_t x = 0; x < count; x++)
+	{
+		FAKE_TRANSFER* transfer = ArrayList_GetItem(pdev->requests, x);
+		if (transfer->ready || (transfer->EndpointAddress != FAKE_STORAGE_EP_IN))
+			continue;
+
+		BYTE* buffer = Stream_Buffer(transfer->data) + FAKE_BULK_HEADER;
+
+		if (storage->stallIn)
+			fake_transfer_ready(transfer, USBD_STATUS_STALL_PID, 0, now);
+		else if (storage->inLength > 0)
+		{
+			const UINT32 length = (transfer->BufferSize < storage->inLength)
+			                          ? transfer->BufferSize
+			                          : storage->inLength;
+			memcpy(buffer, storage->inData, length);
+			storage->inData += length;
+			storage->inLength -= length;
+			fake_transfer_ready(transfer, USBD_STATUS_SUCCESS, length, now);
+		}
+		else if (storage->cswPending && (storage->outRemaining == 0))
+		{
+			storage->cswPending = FALSE;
+			if (transfer->BufferSize < FAKE_CSW_LENGTH)
+				fake_transfer_ready(transfer, USBD_STATUS_BABBLE_DETECTED, 0, now);
+			else
+			{
+				winpr_Data_Write_UINT32(&buffer[0], FAKE_CSW_SIGNATURE);
+				winpr_Data_Write_UINT32(&buffer[4], storage->tag);
+				winpr_Data_Write_UINT32(&buffer[8], storage->residue);
+				buffer[12] = storage->status;
+				fake_transfer_ready(transfer, USBD_STATUS_SUCCESS, FAKE_CSW_LENGTH, now);
+			}
+		}
+		else
+			break;
+
+		completed = TRUE;
+	}
+
+	return completed;
+}
+
+static void fake_clear_halt(FAKE_UDEVICE* pdev, UINT32 EndpointAddress)
+{
+	EnterCriticalSection(&pdev->lock);
+	if ((pdev->type == FAKE_UDEVICE_STORAGE) && (EndpointAddress == FAKE_STORAGE_EP_IN))
+	{
+		pdev->storage.stallIn = FALSE;
+		if (fake_storage_poll(pdev, GetTickCount64()))
+			(void)SetEvent(pdev->event);
+	}
+	LeaveCriticalSection(&pdev->lock);
+}
+
+/* Completes all queued transfers on \b EndpointAddress (all if 0xFF) with USBD_STATUS_CANCELED */
+static size_t fake_cancel_transfers(FAKE_UDEVICE* pdev, UINT32 EndpointAddress, UINT32 RequestId,
+                                    BOOL byRequest)
+{
+	size_t cancelled = 0;
+
+	EnterCriticalSection(&pdev->lock);
+	const size_t count = ArrayList_Count(pdev->requests);
+	for (size_t x = 0; x < count; x++)
+	{
+		FAKE_TRANSFER* transfer = ArrayList_GetItem(pdev->requests, x);
+		if (transfer->ready)
+			continue;
+
+		if (byRequest && (transfer->RequestId != RequestId))
+			continue;
+
+		if (!byRequest && (EndpointAddress != 0xFF) &&
+		    (transfer->EndpointAddress != EndpointAddress))
+			continue;
+
+		fake_transfer_ready(transfer, USBD_STATUS_CANCELED, 0, 0);
+		cancelled++;
+	}
+
+	if (cancelled > 0)
+		(void)SetEvent(pdev->event);
+	LeaveCriticalSection(&pdev->lock);
+	return cancelled;
+}
+
+static void fake_transfer_complete(FAKE_UDEVICE* pdev, FAKE_TRANSFER* transfer)
+{
+	wStream* out = transfer->data;
+	transfer->data = nullptr;
+
+	/* the isochronous completion callback only handles acknowledged requests */
+	if (transfer->isoch && transfer->noAck)
+	{
+		Stream_Release(out);
+		return;
+	}
+
+	const UINT32 InterfaceId =
+	    ((STREAM_ID_PROXY << 30) | pdev->iface.get_ReqCompletion(&pdev->iface));
+	transfer->cb(&pdev->iface, transfer->callback, out, InterfaceId, transfer->noAck,
+	             transfer->MessageId, transfer->RequestId, transfer->NumberOfPackets,
+	             transfer->status, transfer->StartFrame, transfer->ErrorCount, transfer->actual,
+	             transfer->transferDir);
+}
+
+static DWORD WINAPI fake_udev_thread(LPVOID arg)
+{
+	FAKE_UDEVICE* pdev = (FAKE_UDEVICE*)arg;
+	FAKE_TRANSFER* batch[FAKE_COMPLETION_BATCH] = WINPR_C_ARRAY_INIT;
+
+	WINPR_ASSERT(pdev);
+
+	while (pdev->running)
+	{
+		const UINT64 now = GetTickCount64();
+		DWORD timeout = INFINITE;
+		size_t count = 0;
+
+		/* collect every due completion, the per wakeup cost is shared by all of them */
+		EnterCriticalSection(&pdev->lock);
+		/* the event is manual reset, it is only set with the lock held */
+		(void)ResetEvent(pdev->event);
+		if (!pdev->running)
+			timeout = 0;
+		for (size_t x = 0; x < ArrayList_Count(pdev->requests);)
+		{
+			FAKE_TRANSFER* transfer = ArrayList_GetItem(pdev->requests, x);
+			if (!transfer->ready)
+			{
+				x++;
+				continue;
+			}
+
+			if (transfer->due > now)
+			{
+				if (transfer->due - now < timeout)
+					timeout = (DWORD)(transfer->due - now);
+				x++;
+				continue;
+			}
+
+			if (count >= ARRAYSIZE(batch))
+			{
+				timeout = 0;
+				break;
+			}
+
+			batch[count++] = transfer;
+			ArrayList_RemoveAt(pdev->requests, x);
+		}
+		LeaveCriticalSection(&pdev->lock);
+
+		for (size_t x = 0; x < count; x++)
+			fake_transfer_complete(pdev, batch[x]);
+
+		if (count > 0)
+		{
+			EnterCriticalSection(&pdev->lock);
+			for (size_t x = 0; x < count; x++)
+				fake_transfer_return(pdev, batch[x]);
+			LeaveCriticalSection(&pdev->lock);
+			continue;
+		}
+
+		(void)WaitForSingleObject(pdev->event, timeout);
+	}
+
+	return 0;
+}
+
+static int fake_udev_isoch_transfer(IUDEVICE* idev, GENERIC_CHANNEL_CALLBACK* callback,
+                                    UINT32 MessageId, UINT32 RequestId, UINT32 EndpointAddress,
+                                    WINPR_ATTR_UNUSED UINT32 TransferFlags,
+                                    WINPR_ATTR_UNUSED UINT32 StartFrame, UINT32 ErrorCount,
+                                    BOOL NoAck, WINPR_ATTR_UNUSED const BYTE* packetDescriptorData,
+                                    UINT32 NumberOfPackets, UINT32 BufferSize,
+                                    WINPR_ATTR_UNUSED const BYTE* Buffer, int transferDir,
+                                    t_isoch_transfer_cb cb, WINPR_ATTR_UNUSED UINT32 Timeout)
+{
+	FAKE_UDEVICE* pdev = (FAKE_UDEVICE*)idev;
+
+	if (!pdev || !pdev->urbdrc)
+		return -1;
+
+	URBDRC_PLUGIN* urbdrc = pdev->urbdrc;
+	const BYTE* ep = fake_find_endpoint(pdev, EndpointAddress);
+	if (!ep || ((ep[3] & 0x03) != ISOCHRONOUS_TRANSFER) || (NumberOfPackets == 0) ||
+	    (NumberOfPackets > 1024))
+	{
+		WLog_Print(urbdrc->log, WLOG_ERROR,
+		           "isoch transfer on endpoint 0x%02" PRIx32 " with %" PRIu32 " packets rejected",
+		           EndpointAddress, NumberOfPackets);
+		return -1;
+	}
+
+	const UINT32 maxPacketSize = winpr_Data_Get_UINT16(&ep[4]) & 0x07ff;
+	const UINT32 packetSize = BufferSize / NumberOfPackets;
+	const UINT32 actualSize = (transferDir == USBD_TRANSFER_DIRECTION_IN)
+	                              ? ((packetSize < maxPacketSize) ? packetSize : maxPacketSize)
+	                              : packetSize;
+	const size_t header = FAKE_ISOCH_PACKETS + 12ull * NumberOfPackets + 8ull;
+	const size_t payload = (transferDir == USBD_TRANSFER_DIRECTION_IN) ? BufferSize : 0;
+
+	EnterCriticalSection(&pdev->lock);
+	FAKE_TRANSFER* transfer = fake_transfer_take(pdev);
+	if (!transfer)
+		goto fail;
+
+	transfer->data = StreamPool_Take(pdev->buffers, header + payload);
+	if (!transfer->data)
+		goto fail;
+
+	/* the device plays or records silence in real time, one packet per 1ms frame */
+	BYTE* packets = Stream_Buffer(transfer->data) + FAKE_ISOCH_PACKETS;
+	for (UINT32 x = 0; x < NumberOfPackets; x++)
+	{
+		winpr_Data_Write_UINT32(&packets[12ull * x], x * actualSize);
+		winpr_Data_Write_UINT32(&packets[12ull * x + 4], actualSize);
+		winpr_Data_Write_UINT32(&packets[12ull * x + 8], USBD_STATUS_SUCCESS);
+	}
+	if (payload > 0)
+		memset(Stream_Buffer(transfer->data) + header, 0, 1ull * actualSize * NumberOfPackets);
+
+	{
+		const UINT64 now = GetTickCount64();
+		UINT64* clock = &pdev->isochClock[(EndpointAddress & 0x80) ? 1 : 0];
+		const UINT64 start = (*clock > now) ? *clock : now;
+
+		*clock = start + NumberOfPackets;
+		transfer->StartFrame = (UINT32)start;
+		fake_transfer_ready(transfer, USBD_STATUS_SUCCESS, actualSize * NumberOfPackets, *clock);
+	}
+
+	transfer->RequestId = RequestId;
+	transfer->MessageId = MessageId;
+	transfer->EndpointAddress = (BYTE)EndpointAddress;
+	transfer->isoch = TRUE;
+	transfer->noAck = NoAck;
+	transfer->transferDir = transferDir;
+	transfer->BufferSize = BufferSize;
+	transfer->NumberOfPackets = NumberOfPackets;
+	transfer->ErrorCount = ErrorCount;
+	transfer->callback = callback;
+	transfer->cb = cb;
+
+	if (!ArrayList_Append(pdev->requests, transfer))
+		goto fail;
+
+	(void)SetEvent(pdev->event);
+	LeaveCriticalSection(&pdev->lock);
+	return 0;
+
+fail:
+	if (transfer)
+		fake_transfer_return(pdev, transfer);
+	LeaveCriticalSection(&pdev->lock);
+	return -1;
+}
+
+static int fake_udev_bulk_or_interrupt_transfer(IUDEVICE* idev, GENERIC_CHANNEL_CALLBACK* callback,
+                                                UINT32 MessageId, UINT32 RequestId,
+                                                UINT32 EndpointAddress,
+                                                WINPR_ATTR_UNUSED UINT32 TransferFlags, BOOL NoAck,
+                                                UINT32 BufferSize, const BYTE* data,
+                                                int transferDir, t_isoch_transfer_cb cb,
+                                                WINPR_ATTR_UNUSED UINT32 Timeout)
+{
+	FAKE_UDEVICE* pdev = (FAKE_UDEVICE*)idev;
+
+	if (!pdev || !pdev->urbdrc)
+		return -1;
+
+	URBDRC_PLUGIN* urbdrc = pdev->urbdrc;
+	const BYTE* ep = fake_find_endpoint(pdev, EndpointAddress);
+	if (!ep || ((ep[3] & 0x03) != BULK_TRANSFER) || (pdev->type != FAKE_UDEVICE_STORAGE))
+	{
+		WLog_Print(urbdrc->log, WLOG_ERROR, "bulk transfer on endpoint 0x%02" PRIx32 " rejected",
+		           EndpointAddress);
+		return -1;
+	}
+
+	const size_t payload = (transferDir == USBD_TRANSFER_DIRECTION_IN) ? BufferSize : 0;
+
+	EnterCriticalSection(&pdev->lock);
+	FAKE_TRANSFER* transfer = fake_transfer_take(pdev);
+	if (!transfer)
+		goto fail;
+
+	transfer->data = StreamPool_Take(pdev->buffers, FAKE_BULK_HEADER + payload);
+	if (!transfer->data)
+		goto fail;
+
+	transfer->RequestId = RequestId;
+	transfer->MessageId = MessageId;
+	transfer->EndpointAddress = (BYTE)EndpointAddress;
+	transfer->noAck = NoAck;
+	transfer->transferDir = transferDir;
+	transfer->BufferSize = BufferSize;
+	transfer->callback = callback;
+	transfer->cb = cb;
+
+	const UINT64 now = GetTickCount64();
+	if (transferDir == USBD_TRANSFER_DIRECTION_OUT)
+	{
+		/* the command or data is consumed right away, in queues until data is ready */
+		if (fake_storage_out(&pdev->storage, data, BufferSize))
+			fake_transfer_ready(transfer, USBD_STATUS_SUCCESS, BufferSize, now);
+		else
+			fake_transfer_ready(transfer, USBD_STATUS_STALL_PID, 0, now);
+	}
+
+	if (!ArrayList_Append(pdev->requests, transfer))
+		goto fail;
+
+	(void)fake_storage_poll(pdev, now);
+	(void)SetEvent(pdev->event);
+	LeaveCriticalSection(&pdev->lock);
+	return 0;
+
+fail:
+	if (transfer)
+		fake_transfer_return(pdev, transfer);
+	LeaveCriticalSection(&pdev->lock);
+	return -1;
+}
+
+static BOOL fake_string_descriptor(const FAKE_UDEVICE_PROFILE* profile, BYTE index, BYTE* reply,
+                                   size_t* length)
+{
+	if (index == 0)
+	{
+		/* supported languages: en-US */
+		reply[0] = 4;
+		reply[1] = FAKE_DT_STRING;
+		winpr_Data_Write_UINT16(&reply[2], 0x0409);
+		*length = 4;
+		return TRUE;
+	}
+
+	if (index > ARRAYSIZE(profile->strings))
+		return FALSE;
+
+	const char* str = profile->strings[index - 1];
+	const size_t len = strlen(str);
+	for (size_t x = 0; x < len; x++)
+		winpr_Data_Write_UINT16(&reply[2 + x * sizeof(WCHAR)], (UINT16)str[x]);
+
+	*length = 2 + len * sizeof(WCHAR);
+	reply[0] = (BYTE)*length;
+	reply[1] = FAKE_DT_STRING;
+	return TRUE;
+}
+
+static int fake_udev_select_configuration(IUDEVICE* idev, UINT32 bConfigurationValue);
+static int fake_udev_select_interface(IUDEVICE* idev, BYTE InterfaceNumber,
+                                      BYTE AlternateSetting);
+
+static BOOL fake_standard_request(FAKE_UDEVICE* pdev, BYTE bmRequestType, BYTE Request,
+                                  UINT16 Value, UINT16 Index, BYTE* reply, const BYTE** data,
+                                  size_t* length)
+{
+	const FAKE_UDEVICE_PROFILE* profile = pdev->profile;
+
+	switch (Request)
+	{
+		case FAKE_REQUEST_GET_STATUS:
+			*length = 2;
+			return TRUE;
+
+		case FAKE_REQUEST_CLEAR_FEATURE:
+			if (((bmRequestType & 0x1F) == 0x02) && (Value == ENDPOINT_HALT))
+				fake_clear_halt(pdev, Index);
+			return TRUE;
+
+		case FAKE_REQUEST_SET_FEATURE:
+			return TRUE;
+
+		case FAKE_REQUEST_GET_DESCRIPTOR:
+			switch (Value >> 8)
+			{
+				case FAKE_DT_DEVICE:
+					*data = profile->device;
+					*length = profile->device[0];
+					return TRUE;
+				case FAKE_DT_CONFIG:
+					if ((Value & 0xFF) != 0)
+						return FALSE;
+					*data = profile->config;
+					*length = profile->configLength;
+					return TRUE;
+				case FAKE_DT_STRING:
+					return fake_string_descriptor(profile, Value & 0xFF, reply, length);
+				default:
+					return FALSE;
+			}
+
+		case FAKE_REQUEST_GET_CONFIGURATION:
+			reply[0] = pdev->configuration;
+			*length = 1;
+			return TRUE;
+
+		case FAKE_REQUEST_SET_CONFIGURATION:
+			return fake_udev_select_configuration(&pdev->iface, Value) == 0;
+
+		case FAKE_REQUEST_GET_INTERFACE:
+			if (Index >= fake_num_interfaces(profile))
+				return FALSE;
+			reply[0] = pdev->alternate[Index];
+			*length = 1;
+			return TRUE;
+
+		case FAKE_REQUEST_SET_INTERFACE:
+			if ((Index > UINT8_MAX) || (Value > UINT8_MAX))
+				return FALSE;
+			return fake_udev_select_interface(&pdev->iface, (BYTE)Index, (BYTE)Value) == 0;
+
+		default:
+			return FALSE;
+	}
+}
+
+static BOOL fake_class_request(FAKE_UDEVICE* pdev, BYTE bmRequestType, BYTE Request,
+                               WINPR_ATTR_UNUSED UINT16 Value, WINPR_ATTR_UNUSED UINT16 Index,
+                               BYTE* reply, size_t* length)
+{
+	switch (pdev->type)
+	{
+		case FAKE_UDEVICE_STORAGE:
+			if ((bmRequestType == 0xA1) && (Request == 0xFE))
+			{
+				/* GET MAX LUN */
+				reply[0] = 0;
+				*length = 1;
+				return TRUE;
+			}
+			if ((bmRequestType == 0x21) && (Request == 0xFF))
+			{
+				/* BULK ONLY MASS STORAGE RESET */
+				EnterCriticalSection(&pdev->lock);
+				fake_storage_reset(&pdev->storage);
+				LeaveCriticalSection(&pdev->lock);
+				return TRUE;
+			}
+			return FALSE;
+
+		case FAKE_UDEVICE_HEADSET:
+			/* SET_CUR / GET_CUR of the endpoint sampling frequency control */
+			if ((bmRequestType == 0x22) && (Request == 0x01))
+				return TRUE;
+			if ((bmRequestType == 0xA2) && (Request == 0x81))
+			{
+				reply[0] = FAKE_AUDIO_SAMPLE_RATE & 0xFF;
+				reply[1] = (FAKE_AUDIO_SAMPLE_RATE >> 8) & 0xFF;
+				reply[2] = (FAKE_AUDIO_SAMPLE_RATE >> 16) & 0xFF;
+				*length = 3;
+				return TRUE;
+			}
+			return FALSE;
+
+		default:
+			return FALSE;
+	}
+}
+
+static BOOL fake_udev_control_transfer(IUDEVICE* idev, WINPR_ATTR_UNUSED UINT32 RequestId,
+                                       WINPR_ATTR_UNUSED UINT32 EndpointAddress,
+                                       WINPR_ATTR_UNUSED UINT32 TransferFlags, BYTE bmRequestType,
+                                       BYTE Request, UINT16 Value, UINT16 Index,
+                                       UINT32* UrbdStatus, UINT32* BufferSize, BYTE* Buffer,
+                                       WINPR_ATTR_UNUSED UINT32 Timeout)
+{
+	FAKE_UDEVICE* pdev = (FAKE_UDEVICE*)idev;
+	BYTE reply[256] = WINPR_C_ARRAY_INIT;
+	const BYTE* data = reply;
+	size_t length = 0;
+	BOOL handled = FALSE;
+
+	WINPR_ASSERT(UrbdStatus);
+	WINPR_ASSERT(BufferSize);
+
+	if (!pdev || !pdev->urbdrc)
+		return FALSE;
+
+	switch (bmRequestType & 0x60)
+	{
+		case 0x00:
+			handled = fake_standard_request(pdev, bmRequestType, Request, Value, Index, reply,
+			                                &data, &length);
+			break;
+		case 0x20:
+			handled =
+			    fake_class_request(pdev, bmRequestType, Request, Value, Index, reply, &length);
+			break;
+		default:
+			break;
+	}
+
+	if (!handled)
+	{
+		WLog_Print(pdev->urbdrc->log, WLOG_DEBUG,
+		           "control request 0x%02" PRIx8 "/0x%02" PRIx8 " stalled", bmRequestType,
+		           Request);
+		*UrbdStatus = USBD_STATUS_STALL_PID;
+		*BufferSize = 0;
+		return TRUE;
+	}
+
+	if (bmRequestType & 0x80)
+	{
+		if (length > *BufferSize)
+			length = *BufferSize;
+		if (length > 0)
+			memcpy(Buffer, data, length);
+		*BufferSize = (UINT32)length;
+	}
+
+	*UrbdStatus = USBD_STATUS_SUCCESS;
+	return TRUE;
+}
+
+static int fake_udev_select_configuration(IUDEVICE* idev, UINT32 bConfigurationValue)
+{
+	FAKE_UDEVICE* pdev = (FAKE_UDEVICE*)idev;
+
+	if (!pdev)
+		return -1;
+
+	/* 0 puts the device in unconfigured state */
+	if ((bConfigurationValue != 0) && (bConfigurationValue != pdev->profile->config[5]))
+		return -1;
+
+	EnterCriticalSection(&pdev->lock);
+	pdev->configuration = (BYTE)bConfigurationValue;
+	memset(pdev->alternate, 0, sizeof(pdev->alternate));
+	memset(pdev->isochClock, 0, sizeof(pdev->isochClock));
+	LeaveCriticalSection(&pdev->lock);
+	return 0;
+}
+
+static int fake_udev_select_interface(IUDEVICE* idev, BYTE InterfaceNumber, BYTE AlternateSetting)
+{
+	FAKE_UDEVICE* pdev = (FAKE_UDEVICE*)idev;
+
+	if (!pdev || (InterfaceNumber >= ARRAYSIZE(pdev->alternate)) ||
+	    !fake_find_interface(pdev->profile, InterfaceNumber, AlternateSetting))
+		return -1;
+
+	EnterCriticalSection(&pdev->lock);
+	pdev->alternate[InterfaceNumber] = AlternateSetting;
+	memset(pdev->isochClock, 0, sizeof(pdev->isochClock));
+	LeaveCriticalSection(&pdev->lock);
+	return 0;
+}
+
+static MSUSB_CONFIG_DESCRIPTOR*
+fake_udev_complete_msconfig_setup(IUDEVICE* idev, MSUSB_CONFIG_DESCRIPTOR* MsConfig)
+{
+	FAKE_UDEVICE* pdev = (FAKE_UDEVICE*)idev;
+	UINT32 MsOutSize = 0;
+
+	if (!pdev || !pdev->urbdrc || !MsConfig)
+		return nullptr;
+
+	URBDRC_PLUGIN* urbdrc = pdev->urbdrc;
+	const FAKE_UDEVICE_PROFILE* profile = pdev->profile;
+
+	if (fake_num_interfaces(profile) != MsConfig->NumInterfaces)
+	{
+		WLog_Print(urbdrc->log, WLOG_ERROR,
+		           "Select Configuration: NumberInterfaces(%" PRIu8 ") is different "
+		           "with MsConfig NumberInterfaces(%" PRIu32 ")",
+		           fake_num_interfaces(profile), MsConfig->NumInterfaces);
+		return nullptr;
+	}
+
+	MSUSB_INTERFACE_DESCRIPTOR** MsInterfaces = MsConfig->MsInterfaces;
+
+	for (UINT32 inum = 0; inum < MsConfig->NumInterfaces; inum++)
+	{
+		const MSUSB_INTERFACE_DESCRIPTOR* MsInterface = MsInterfaces[inum];
+		if (!fake_find_interface(profile, MsInterface->InterfaceNumber,
+		                         MsInterface->AlternateSetting))
+		{
+			WLog_Print(urbdrc->log, WLOG_ERROR,
+			           "interface %" PRIu8 " has no alternate setting %" PRIu8,
+			           MsInterface->InterfaceNumber, MsInterface->AlternateSetting);
+			return nullptr;
+		}
+	}
+
+	for (UINT32 inum = 0; inum < MsConfig->NumInterfaces; inum++)
+	{
+		MSUSB_INTERFACE_DESCRIPTOR* MsInterface = MsInterfaces[inum];
+		const BYTE* iface = fake_find_interface(profile, MsInterface->InterfaceNumber,
+		                                        MsInterface->AlternateSetting);
+		const BYTE NumEndpoints = iface[4];
+		MSUSB_PIPE_DESCRIPTOR** t_MsPipes =
+		    (MSUSB_PIPE_DESCRIPTOR**)calloc(NumEndpoints, sizeof(MSUSB_PIPE_DESCRIPTOR*));
+
+		if (!t_MsPipes && (NumEndpoints > 0))
+			return nullptr;
+
+		for (UINT32 pnum = 0; pnum < NumEndpoints; pnum++)
+		{
+			MSUSB_PIPE_DESCRIPTOR* t_MsPipe =
+			    (MSUSB_PIPE_DESCRIPTOR*)calloc(1, sizeof(MSUSB_PIPE_DESCRIPTOR));
+
+			if (!t_MsPipe)
+			{
+				for (UINT32 x = 0; x < pnum; x++)
+					free(t_MsPipes[x]);
+				free((void*)t_MsPipes);
+				return nullptr;
+			}
+
+			if (pnum < MsInterface->NumberOfPipes && MsInterface->MsPipes)
+			{
+				const MSUSB_PIPE_DESCRIPTOR* MsPipe = MsInterface->MsPipes[pnum];
+				t_MsPipe->MaximumPacketSize = MsPipe->MaximumPacketSize;
+				t_MsPipe->MaximumTransferSize = MsPipe->MaximumTransferSize;
+				t_MsPipe->PipeFlags = MsPipe->PipeFlags;
+			}
+			else
+				t_MsPipe->MaximumTransferSize = 0xffffffff;
+
+			t_MsPipes[pnum] = t_MsPipe;
+		}
+
+		msusb_mspipes_replace(MsInterface, t_MsPipes, NumEndpoints);
+	}
+
+	/* same handle layout as the libusb backend */
+	MsOutSize = 8;
+	MsConfig->ConfigurationHandle = (uint32_t)MsConfig->bConfigurationValue |
+	                                ((uint32_t)pdev->bus_number << 24) |
+	                                (((uint32_t)pdev->dev_number << 16) & 0xFF0000);
+
+	for (UINT32 inum = 0; inum < MsConfig->NumInterfaces; inum++)
+	{
+		MsOutSize += 16;
+		MSUSB_INTERFACE_DESCRIPTOR* MsInterface = MsInterfaces[inum];
+		const BYTE* iface = fake_find_interface(profile, MsInterface->InterfaceNumber,
+		                                        MsInterface->AlternateSetting);
+
+		MsInterface->InterfaceHandle =
+		    WINPR_ASSERTING_INT_CAST(UINT32, (iface[2] | (iface[3] << 8) |
+		                                      (pdev->dev_number << 16) | (pdev->bus_number << 24)));
+		const size_t len = 16 + (MsInterface->NumberOfPipes * 20);
+		MsInterface->Length = WINPR_ASSERTING_INT_CAST(UINT16, len);
+		MsInterface->bInterfaceClass = iface[5];
+		MsInterface->bInterfaceSubClass = iface[6];
+		MsInterface->bInterfaceProtocol = iface[7];
+		MsInterface->InitCompleted = 1;
+
+		for (BYTE pnum = 0; pnum < iface[4]; pnum++)
+		{
+			MsOutSize += 20;
+
+			MSUSB_PIPE_DESCRIPTOR* MsPipe = MsInterface->MsPipes[pnum];
+			const BYTE* ep = fake_interface_endpoint(profile, iface, pnum);
+			WINPR_ASSERT(ep);
+
+			MsPipe->PipeHandle = ep[2] | (((uint32_t)pdev->dev_number << 16) & 0xFF0000) |
+			                     (((uint32_t)pdev->bus_number << 24) & 0xFF000000);
+			MsPipe->MaximumPacketSize = winpr_Data_Get_UINT16(&ep[4]) & 0x07ff;
+			MsPipe->bEndpointAddress = ep[2];
+			MsPipe->bInterval = ep[6];
+			MsPipe->PipeType = ep[3] & 0x3;
+			MsPipe->InitCompleted = 1;
+		}
+	}
+
+	MsConfig->MsOutSize = WINPR_ASSERTING_INT_CAST(int, MsOutSize);
+	MsConfig->InitCompleted = 1;
+
+	/* replace device's MsConfig */
+	if (MsConfig != pdev->MsConfig)
+	{
+		msusb_msconfig_free(pdev->MsConfig);
+		pdev->MsConfig = MsConfig;
+	}
+
+	return MsConfig;
+}
+
+static int fake_udev_control_pipe_request(IUDEVICE* idev, WINPR_ATTR_UNUSED UINT32 RequestId,
+                                          UINT32 EndpointAddress, UINT32* UsbdStatus, int command)
+{
+	FAKE_UDEVICE* pdev = (FAKE_UDEVICE*)idev;
+
+	WINPR_ASSERT(UsbdStatus);
+
+	if (!pdev)
+		return -1;
+
+	switch (command)
+	{
+		case PIPE_CANCEL:
+			(void)fake_cancel_transfers(pdev, EndpointAddress, 0, FALSE);
+			break;
+
+		case PIPE_RESET:
+			(void)fake_cancel_transfers(pdev, EndpointAddress, 0, FALSE);
+			fake_clear_halt(pdev, EndpointAddress);
+			break;
+
+		default:
+			return -0xff;
+	}
+
+	*UsbdStatus = 0;
+	return 0;
+}
+
+static UINT8 fake_write_text(const char* str, BYTE* Buffer, UINT8 inSize)
+{
+	const size_t max = inSize / sizeof(WCHAR);
+
+	if (max == 0)
+		return 0;
+
+	const size_t len = strnlen(str, max - 1);
+	for (size_t x = 0; x < len; x++)
+		winpr_Data_Write_UINT16(&Buffer[x * sizeof(WCHAR)], (UINT16)str[x]);
+	winpr_Data_Write_UINT16(&Buffer[len * sizeof(WCHAR)], 0);
+	return (UINT8)((len + 1) * sizeof(WCHAR));
+}
+
+static UINT32 fake_udev_control_query_device_text(IUDEVICE* idev, UINT32 TextType,
+                                                  WINPR_ATTR_UNUSED UINT16 LocaleId,
+                                                  UINT8* BufferSize, BYTE* Buffer)
+{
+	FAKE_UDEVICE* pdev = (FAKE_UDEVICE*)idev;
+	char deviceLocation[25] = WINPR_C_ARRAY_INIT;
+	const UINT8 inSize = *BufferSize;
+
+	*BufferSize = 0;
+	if (!pdev || !pdev->urbdrc)
+		return ERROR_INVALID_DATA;
+
+	switch (TextType)
+	{
+		case DeviceTextDescription:
+			*BufferSize = fake_write_text(pdev->profile->strings[1], Buffer, inSize);
+			break;
+
+		case DeviceTextLocationInformation:
+			(void)sprintf_s(deviceLocation, sizeof(deviceLocation),
+			                "Port_#%04" PRIu8 ".Hub_#%04" PRIu8 "", pdev->dev_number,
+			                pdev->bus_number);
+			*BufferSize = fake_write_text(deviceLocation, Buffer, inSize);
+			break;
+
+		default:
+			WLog_Print(pdev->urbdrc->log, WLOG_DEBUG, "Query Text: unknown TextType %" PRIu32 "",
+			           TextType);
+			return ERROR_INVALID_DATA;
+	}
+
+	return S_OK;
+}
+
+static int fake_udev_os_feature_descriptor_request(
+    IUDEVICE* idev, WINPR_ATTR_UNUSED UINT32 RequestId, WINPR_ATTR_UNUSED BYTE Recipient,
+    WINPR_ATTR_UNUSED BYTE InterfaceNumber, WINPR_ATTR_UNUSED BYTE Ms_PageIndex,
+    WINPR_ATTR_UNUSED UINT16 Ms_featureDescIndex, UINT32* UsbdStatus, UINT32* BufferSize,
+    WINPR_ATTR_UNUSED BYTE* Buffer, WINPR_ATTR_UNUSED UINT32 Timeout)
+{
+	WINPR_ASSERT(idev);
+	WINPR_ASSERT(UsbdStatus);
+	WINPR_ASSERT(BufferSize);
+
+	/* no Microsoft OS descriptors */
+	*BufferSize = 0;
+	*UsbdStatus = USBD_STATUS_STALL_PID;
+	return ERROR_SUCCESS;
+}
+
+static void fake_udev_cancel_all_transfer_request(IUDEVICE* idev)
+{
+	FAKE_UDEVICE* pdev = (FAKE_UDEVICE*)idev;
+
+	if (!pdev || !pdev->requests)
+		return;
+
+	(void)fake_cancel_transfers(pdev, 0xFF, 0, FALSE);
+}
+
+static int fake_udev_cancel_transfer_request(IUDEVICE* idev, UINT32 RequestId)
+{
+	FAKE_UDEVICE* pdev = (FAKE_UDEVICE*)idev;
+
+	if (!pdev || !pdev->requests)
+		return -1;
+
+	return (fake_cancel_transfers(pdev, 0, RequestId, TRUE) > 0) ? 1 : -1;
+}
+
+static int fake_udev_query_device_descriptor(IUDEVICE* idev, int offset)
+{
+	FAKE_UDEVICE* pdev = (FAKE_UDEVICE*)idev;
+	const BYTE* device = pdev->profile->device;
+
+	switch (offset)
+	{
+		case B_LENGTH:
+		case B_DESCRIPTOR_TYPE:
+		case B_MAX_PACKET_SIZE0:
+		case I_MANUFACTURER:
+		case I_PRODUCT:
+		case I_SERIAL_NUMBER:
+		case B_NUM_CONFIGURATIONS:
+			return device[offset];
+
+		case BCD_USB:
+		case ID_VENDOR:
+		case ID_PRODUCT:
+		case BCD_DEVICE:
+			return winpr_Data_Get_UINT16(&device[offset]);
+
+		case B_DEVICE_CLASS:
+		case B_DEVICE_SUBCLASS:
+		case B_DEVICE_PROTOCOL:
+		{
+			/* like the libusb backend report the class of the first interface */
+			const BYTE* iface = fake_find_interface(pdev->profile, 0, 0);
+			if (!iface)
+				return device[offset];
+			return iface[5 + offset - B_DEVICE_CLASS];
+		}
+
+		default:
+			return 0;
+	}
+}
+
+static BOOL fake_udev_detach_kernel_driver(WINPR_ATTR_UNUSED IUDEVICE* idev)
+{
+	return TRUE;
+}
+
+static BOOL fake_udev_attach_kernel_driver(WINPR_ATTR_UNUSED IUDEVICE* idev)
+{
+	return TRUE;
+}
+
+static int fake_udev_query_device_port_status(IUDEVICE* idev, UINT32* UsbdStatus,
+                                              UINT32* BufferSize, WINPR_ATTR_UNUSED BYTE* Buffer)
+{
+	WINPR_ASSERT(idev);
+	WINPR_ASSERT(UsbdStatus);
+	WINPR_ASSERT(BufferSize);
+
+	/* there is no hub, the generic port status is reported */
+	*UsbdStatus = USBD_STATUS_SUCCESS;
+	*BufferSize = 0;
+	return 1;
+}
+
+static int fake_udev_is_composite_device(IUDEVICE* idev)
+{
+	FAKE_UDEVICE* pdev = (FAKE_UDEVICE*)idev;
+	const BYTE* device = pdev->profile->device;
+
+	return ((device[17] == 1) && (fake_num_interfaces(pdev->profile) > 1) && (device[4] == 0))
+	           ? 1
+	           : 0;
+}
+
+static int fake_udev_is_exist(IUDEVICE* idev)
+{
+	FAKE_UDEVICE* pdev = (FAKE_UDEVICE*)idev;
+	return (pdev->status & URBDRC_DEVICE_NOT_FOUND) ? 0 : 1;
+}
+
+static int fake_udev_is_channel_closed(IUDEVICE* idev)
+{
+	FAKE_UDEVICE* pdev = (FAKE_UDEVICE*)idev;
+	if (!pdev || !pdev->urbdrc)
+		return 1;
+
+	IUDEVMAN* udevman = pdev->urbdrc->udevman;
+	if (udevman && (udevman->status & URBDRC_DEVICE_CHANNEL_CLOSED))
+		return 1;
+
+	if (pdev->status & URBDRC_DEVICE_CHANNEL_CLOSED)
+		return 1;
+
+	return 0;
+}
+
+static int fake_udev_is_already_send(IUDEVICE* idev)
+{
+	FAKE_UDEVICE* pdev = (FAKE_UDEVICE*)idev;
+	return (pdev->status & URBDRC_DEVICE_ALREADY_SEND) ? 1 : 0;
+}
+
+/* This is called from channel cleanup code.
+ * Avoid double free, just remove the device and mark the channel closed. */
+static void fake_udev_mark_channel_closed(IUDEVICE* idev)
+{
+	FAKE_UDEVICE* pdev = (FAKE_UDEVICE*)idev;
+	if (pdev && ((pdev->status & URBDRC_DEVICE_CHANNEL_CLOSED) == 0))
+	{
+		URBDRC_PLUGIN* urbdrc = pdev->urbdrc;
+		const uint8_t busNr = idev->get_bus_number(idev);
+		const uint8_t devNr = idev->get_dev_number(idev);
+
+		pdev->status |= URBDRC_DEVICE_CHANNEL_CLOSED;
+		pdev->iface.cancel_all_transfer_request(&pdev->iface);
+		if (!urbdrc->udevman->unregister_udevice(urbdrc->udevman, busNr, devNr))
+			WLog_Print(urbdrc->log, WLOG_WARN, "unregister_udevice failed for %d, %d", busNr,
+			           devNr);
+	}
+}
+
+/* This is called by local events where the device is removed or in an error
+ * state. Remove the device from redirection and close the channel. */
+static void fake_udev_channel_closed(IUDEVICE* idev)
+{
+	FAKE_UDEVICE* pdev = (FAKE_UDEVICE*)idev;
+	if (pdev && ((pdev->status & URBDRC_DEVICE_CHANNEL_CLOSED) == 0))
+	{
+		URBDRC_PLUGIN* urbdrc = pdev->urbdrc;
+		const uint8_t busNr = idev->get_bus_number(idev);
+		const uint8_t devNr = idev->get_dev_number(idev);
+		IWTSVirtualChannel* channel = nullptr;
+
+		if (pdev->channelManager)
+			channel = IFCALLRESULT(nullptr, pdev->channelManager->FindChannelById,
+			                       pdev->channelManager, pdev->channelID);
+
+		pdev->status |= URBDRC_DEVICE_CHANNEL_CLOSED;
+
+		if (channel)
+		{
+			const UINT rc = channel->Write(channel, 0, nullptr, nullptr);
+			if (rc != CHANNEL_RC_OK)
+				WLog_Print(urbdrc->log, WLOG_WARN, "channel->Write failed with %" PRIu32, rc);
+		}
+
+		if (!urbdrc->udevman->unregister_udevice(urbdrc->udevman, busNr, devNr))
+			WLog_Print(urbdrc->log, WLOG_WARN, "unregister_udevice failed for %d, %d", busNr,
+			           devNr);
+	}
+}
+
+static void fake_udev_set_already_send(IUDEVICE* idev)
+{
+	FAKE_UDEVICE* pdev = (FAKE_UDEVICE*)idev;
+	pdev->status |= URBDRC_DEVICE_ALREADY_SEND;
+}
+
+static char* fake_udev_get_path(IUDEVICE* idev)
+{
+	FAKE_UDEVICE* pdev = (FAKE_UDEVICE*)idev;
+	return pdev->path;
+}
+
+BASIC_STATE_FUNC_DEFINED(channelManager, IWTSVirtualChannelManager*)
+BASIC_STATE_FUNC_DEFINED(channelID, UINT32)
+BASIC_STATE_FUNC_DEFINED(UsbDevice, UINT32)
+BASIC_STATE_FUNC_DEFINED(ReqCompletion, UINT32)
+BASIC_STATE_FUNC_DEFINED(bus_number, BYTE)
+BASIC_STATE_FUNC_DEFINED(dev_number, BYTE)
+BASIC_STATE_FUNC_DEFINED(port_number, UINT8)
+BASIC_STATE_FUNC_DEFINED(MsConfig, MSUSB_CONFIG_DESCRIPTOR*)
+
+BASIC_POINT_FUNC_DEFINED(udev, void*)
+BASIC_POINT_FUNC_DEFINED(prev, void*)
+BASIC_POINT_FUNC_DEFINED(next, void*)
+
+static void fake_udev_free(IUDEVICE* idev)
+{
+	FAKE_UDEVICE* pdev = (FAKE_UDEVICE*)idev;
+
+	if (!pdev)
+		return;
+
+	if (pdev->thread)
+	{
+		EnterCriticalSection(&pdev->lock);
+		pdev->running = FALSE;
+		(void)SetEvent(pdev->event);
+		LeaveCriticalSection(&pdev->lock);
+		(void)WaitForSingleObject(pdev->thread, INFINITE);
+		(void)CloseHandle(pdev->thread);
+	}
+
+	/* transfers still queued are dropped without a completion, like on device removal */
+	if (pdev->requests)
+	{
+		for (size_t x = 0; x < ArrayList_Count(pdev->requests); x++)
+			fake_transfer_free(ArrayList_GetItem(pdev->requests, x));
+		ArrayList_Free(pdev->requests);
+	}
+
+	for (size_t x = 0; x < pdev->transfer_pool_count; x++)
+		fake_transfer_free(pdev->transfer_pool[x]);
+
+	StreamPool_Free(pdev->buffers);
+	if (pdev->event)
+		(void)CloseHandle(pdev->event);
+	DeleteCriticalSection(&pdev->lock);
+	msusb_msconfig_free(pdev->MsConfig);
+	free(pdev->storage.disk);
+	free(pdev);
+}
+
+static void fake_udev_load_interface(FAKE_UDEVICE* pdev)
+{
+	WINPR_ASSERT(pdev);
+
+	/* Basic */
+	BASIC_STATE_FUNC_REGISTER(channelManager, pdev);
+	BASIC_STATE_FUNC_REGISTER(channelID, pdev);
+	BASIC_STATE_FUNC_REGISTER(UsbDevice, pdev);
+	BASIC_STATE_FUNC_REGISTER(ReqCompletion, pdev);
+	BASIC_STATE_FUNC_REGISTER(bus_number, pdev);
+	BASIC_STATE_FUNC_REGISTER(dev_number, pdev);
+	BASIC_STATE_FUNC_REGISTER(port_number, pdev);
+	BASIC_STATE_FUNC_REGISTER(MsConfig, pdev);
+	BASIC_STATE_FUNC_REGISTER(p_udev, pdev);
+	BASIC_STATE_FUNC_REGISTER(p_prev, pdev);
+	BASIC_STATE_FUNC_REGISTER(p_next, pdev);
+	pdev->iface.isCompositeDevice = fake_udev_is_composite_device;
+	pdev->iface.isExist = fake_udev_is_exist;
+	pdev->iface.isAlreadySend = fake_udev_is_already_send;
+	pdev->iface.isChannelClosed = fake_udev_is_channel_closed;
+	pdev->iface.setAlreadySend = fake_udev_set_already_send;
+	pdev->iface.setChannelClosed = fake_udev_channel_closed;
+	pdev->iface.markChannelClosed = fake_udev_mark_channel_closed;
+	pdev->iface.getPath = fake_udev_get_path;
+	/* Transfer */
+	pdev->iface.isoch_transfer = fake_udev_isoch_transfer;
+	pdev->iface.control_transfer = fake_udev_control_transfer;
+	pdev->iface.bulk_or_interrupt_transfer = fake_udev_bulk_or_interrupt_transfer;
+	pdev->iface.select_interface = fake_udev_select_interface;
+	pdev->iface.select_configuration = fake_udev_select_configuration;
+	pdev->iface.complete_msconfig_setup = fake_udev_complete_msconfig_setup;
+	pdev->iface.control_pipe_request = fake_udev_control_pipe_request;
+	pdev->iface.control_query_device_text = fake_udev_control_query_device_text;
+	pdev->iface.os_feature_descriptor_request = fake_udev_os_feature_descriptor_request;
+	pdev->iface.cancel_all_transfer_request = fake_udev_cancel_all_transfer_request;
+	pdev->iface.cancel_transfer_request = fake_udev_cancel_transfer_request;
+	pdev->iface.query_device_descriptor = fake_udev_query_device_descriptor;
+	pdev->iface.detach_kernel_driver = fake_udev_detach_kernel_driver;
+	pdev->iface.attach_kernel_driver = fake_udev_attach_kernel_driver;
+	pdev->iface.query_device_port_status = fake_udev_query_device_port_status;
+	pdev->iface.free = fake_udev_free;
+}
+
+BOOL fake_udevice_ids(FAKE_UDEVICE_TYPE type, UINT16* idVendor, UINT16* idProduct)
+{
+	WINPR_ASSERT(idVendor);
+	WINPR_ASSERT(idProduct);
+
+	if ((size_t)type >= ARRAYSIZE(fake_profiles))
+		return FALSE;
+
+	*idVendor = fake_profiles[type].idVendor;
+	*idProduct = fake_profiles[type].idProduct;
+	return TRUE;
+}
+
+IUDEVICE* fake_udevice_new(URBDRC_PLUGIN* urbdrc, FAKE_UDEVICE_TYPE type, BYTE bus_number,
+                           BYTE dev_number, size_t storageSize)
+{
+	WINPR_ASSERT(urbdrc);
+
+	if ((size_t)type >= ARRAYSIZE(fake_profiles))
+		return nullptr;
+
+	FAKE_UDEVICE* pdev = (FAKE_UDEVICE*)calloc(1, sizeof(FAKE_UDEVICE));
+
+	if (!pdev)
+		return nullptr;
+
+	if (!InitializeCriticalSectionAndSpinCount(&pdev->lock, 4000))
+	{
+		free(pdev);
+		return nullptr;
+	}
+
+	pdev->urbdrc = urbdrc;
+	pdev->type = type;
+	pdev->profile = &fake_profiles[type];
+	pdev->bus_number = bus_number;
+	pdev->dev_number = dev_number;
+	pdev->port_number = dev_number;
+	(void)_snprintf(pdev->path, sizeof(pdev->path), "%" PRIu8 "-%" PRIu8, bus_number, dev_number);
+	fake_udev_load_interface(pdev);
+
+	if (urbdrc->listener_callback)
+		fake_udev_set_channelManager(&pdev->iface, urbdrc->listener_callback->channel_mgr);
+
+	if (type == FAKE_UDEVICE_STORAGE)
+	{
+		const size_t blocks = storageSize / FAKE_STORAGE_BLOCK;
+		if ((blocks == 0) || (blocks > UINT32_MAX))
+			goto fail;
+
+		pdev->storage.blocks = (UINT32)blocks;
+		pdev->storage.disk = calloc(blocks, FAKE_STORAGE_BLOCK);
+		if (!pdev->storage.disk)
+			goto fail;
+	}
+
+	pdev->requests = ArrayList_New(FALSE);
+	if (!pdev->requests)
+		goto fail;
+
+	pdev->buffers = StreamPool_New(TRUE, 0);
+	if (!pdev->buffers)
+		goto fail;
+
+	for (size_t x = 0; x < ARRAYSIZE(pdev->transfer_pool); x++)
+	{
+		FAKE_TRANSFER* transfer = calloc(1, sizeof(FAKE_TRANSFER));
+		if (!transfer)
+			goto fail;
+		pdev->transfer_pool[pdev->transfer_pool_count++] = transfer;
+	}
+
+	pdev->MsConfig = msusb_msconfig_new();
+	if (!pdev->MsConfig)
+		goto fail;
+
+	pdev->event = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+	if (!pdev->event)
+		goto fail;
+
+	pdev->running = TRUE;
+	pdev->thread = CreateThread(nullptr, 0, fake_udev_thread, pdev, 0, nullptr);
+	if (!pdev->thread)
+		goto fail;
+
+	WLog_Print(urbdrc->log, WLOG_DEBUG,
+	           "Registered fake device: Vid: 0x%04" PRIX16 " Pid: 0x%04" PRIX16 " at %s",
+	           pdev->profile->idVendor, pdev->profile->idProduct, pdev->path);
+	return &pdev->iface;
+
+fail:
+	fake_udev_free(&pdev->iface);
+	return nullptr;
+}
@@ -0,0 +1,47 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * RemoteFX USB Redirection - in process fake USB devices
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FREERDP_CHANNEL_URBDRC_CLIENT_FAKE_UDEVICE_H
+#define FREERDP_CHANNEL_URBDRC_CLIENT_FAKE_UDEVICE_H
+
+#include <winpr/wtypes.h>
+
+#include "urbdrc_types.h"
+#include "urbdrc_main.h"
+
+/** @brief Device profiles emulated by the fake subsystem */
+typedef enum
+{
+	FAKE_UDEVICE_STORAGE, /**< bulk only mass storage backed by a RAM disk */
+	FAKE_UDEVICE_HEADSET, /**< USB audio class 1 headset, 48kHz speaker and microphone */
+	FAKE_UDEVICE_COUNT
+} FAKE_UDEVICE_TYPE;
+
+/** @brief Vendor and product id \b type enumerates with
+ *  @return FALSE if \b type is unknown */
+WINPR_ATTR_NODISCARD
+FREERDP_LOCAL BOOL fake_udevice_ids(FAKE_UDEVICE_TYPE type, UINT16* idVendor, UINT16* idProduct);
+
+/** @brief Creates a device of \b type at \b bus_number / \b dev_number.
+ *
+ *  \b storageSize is the size of the RAM disk in bytes, only used for
+ *  \b FAKE_UDEVICE_STORAGE */
+WINPR_ATTR_NODISCARD
+FREERDP_LOCAL IUDEVICE* fake_udevice_new(URBDRC_PLUGIN* urbdrc, FAKE_UDEVICE_TYPE type,
+                                         BYTE bus_number, BYTE dev_number, size_t storageSize);
+
+#endif /* FREERDP_CHANNEL_URBDRC_CLIENT_FAKE_UDEVICE_H */
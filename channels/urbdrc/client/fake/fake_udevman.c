@@ -0,0 +1,461 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * RemoteFX USB Redirection - in process fake USB devices
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+
+#include <freerdp/addin.h>
+
+#include "urbdrc_types.h"
+#include "urbdrc_main.h"
+
+#include "fake_udevice.h"
+
+/* default size of the RAM disk of the storage profile in MiB */
+#define FAKE_STORAGE_DEFAULT_SIZE 64
+#define FAKE_BUS_NUMBER 1
+
+#define BASIC_STATE_FUNC_DEFINED(_arg, _type)                   \
+	static _type udevman_get_##_arg(IUDEVMAN* idevman)          \
+	{                                                           \
+		UDEVMAN* udevman = (UDEVMAN*)idevman;                   \
+		return udevman->_arg;                                   \
+	}                                                           \
+	static void udevman_set_##_arg(IUDEVMAN* idevman, _type _t) \
+	{                                                           \
+		UDEVMAN* udevman = (UDEVMAN*)idevman;                   \
+		udevman->_arg = _t;                                     \
+	}
+
+#define BASIC_STATE_FUNC_REGISTER(_arg, _man)    \
+	_man->iface.get_##_arg = udevman_get_##_arg; \
+	(_man)->iface.set_##_arg = udevman_set_##_arg
+
+typedef struct
+{
+	IUDEVMAN iface;
+
+	IUDEVICE* idev; /* iterator device */
+	IUDEVICE* head; /* head device in linked list */
+	IUDEVICE* tail; /* tail device in linked list */
+
+	BOOL devices[FAKE_UDEVICE_COUNT];
+	size_t storageSize;
+	UINT32 device_num;
+	UINT32 next_device_id;
+
+	HANDLE devman_loading;
+} UDEVMAN;
+typedef UDEVMAN* PUDEVMAN;
+
+static void udevman_rewind(IUDEVMAN* idevman)
+{
+	UDEVMAN* udevman = (UDEVMAN*)idevman;
+	udevman->idev = udevman->head;
+}
+
+static BOOL udevman_has_next(IUDEVMAN* idevman)
+{
+	UDEVMAN* udevman = (UDEVMAN*)idevman;
+
+	return !(!udevman || !udevman->idev);
+}
+
+static IUDEVICE* udevman_get_next(IUDEVMAN* idevman)
+{
+	UDEVMAN* udevman = (UDEVMAN*)idevman;
+	IUDEVICE* pdev = udevman->idev;
+	udevman->idev = (IUDEVICE*)pdev->get_p_next(pdev);
+	return pdev;
+}
+
+static IUDEVICE* udevman_get_udevice_by_addr(IUDEVMAN* idevman, BYTE bus_number, BYTE dev_number)
+{
+	IUDEVICE* dev = nullptr;
+
+	if (!idevman)
+		return nullptr;
+
+	idevman->loading_lock(idevman);
+	idevman->rewind(idevman);
+
+	while (idevman->has_next(idevman))
+	{
+		IUDEVICE* pdev = idevman->get_next(idevman);
+
+		if ((pdev->get_bus_number(pdev) == bus_number) &&
+		    (pdev->get_dev_number(pdev) == dev_number))
+		{
+			dev = pdev;
+			break;
+		}
+	}
+
+	idevman->loading_unlock(idevman);
+	return dev;
+}
+
+static size_t udevman_register_udevice(IUDEVMAN* idevman, BYTE bus_number, BYTE dev_number,
+                                       UINT16 idVendor, UINT16 idProduct,
+                                       WINPR_ATTR_UNUSED UINT32 flag)
+{
+	UDEVMAN* udevman = (UDEVMAN*)idevman;
+
+	if (!idevman || !idevman->plugin)
+		return 0;
+
+	URBDRC_PLUGIN* urbdrc = (URBDRC_PLUGIN*)idevman->plugin;
+
+	if (udevman_get_udevice_by_addr(idevman, bus_number, dev_number) != nullptr)
+		return 0;
+
+	for (size_t x = 0; x < FAKE_UDEVICE_COUNT; x++)
+	{
+		const FAKE_UDEVICE_TYPE type = (FAKE_UDEVICE_TYPE)x;
+		UINT16 vid = 0;
+		UINT16 pid = 0;
+
+		if (!fake_udevice_ids(type, &vid, &pid) || (vid != idVendor) || (pid != idProduct))
+			continue;
+
+		IUDEVICE* tdev =
+		    fake_udevice_new(urbdrc, type, bus_number, dev_number, udevman->storageSize);
+		if (!tdev)
+			return 0;
+
+		tdev->set_UsbDevice(tdev, idevman->get_next_device_id(idevman));
+		idevman->loading_lock(idevman);
+
+		if (udevman->head == nullptr)
+		{
+			/* linked list is empty */
+			udevman->head = tdev;
+			udevman->tail = tdev;
+		}
+		else
+		{
+			/* append device to the end of the linked list */
+			udevman->tail->set_p_next(udevman->tail, tdev);
+			tdev->set_p_prev(tdev, udevman->tail);
+			udevman->tail = tdev;
+		}
+
+		udevman->device_num += 1;
+		idevman->loading_unlock(idevman);
+		return 1;
+	}
+
+	WLog_Print(urbdrc->log, WLOG_WARN, "No fake usb device with id %04" PRIx16 ":%04" PRIx16,
+	           idVendor, idProduct);
+	return 0;
+}
+
+/* Unlinks \b dev from the device list, the caller holds the loading lock */
+static void udevman_unlink_udevice(UDEVMAN* udevman, IUDEVICE* dev)
+{
+	IUDEVICE* prev = dev->get_p_prev(dev);
+	IUDEVICE* next = dev->get_p_next(dev);
+
+	if (prev)
+		prev->set_p_next(prev, next);
+	else
+		udevman->head = next;
+
+	if (next)
+		next->set_p_prev(next, prev);
+	else
+		udevman->tail = prev;
+
+	udevman->device_num--;
+}
+
+static BOOL udevman_unregister_udevice(IUDEVMAN* idevman, BYTE bus_number, BYTE dev_number)
+{
+	UDEVMAN* udevman = (UDEVMAN*)idevman;
+	IUDEVICE* dev = udevman_get_udevice_by_addr(idevman, bus_number, dev_number);
+
+	if (!dev || !idevman)
+		return FALSE;
+
+	idevman->loading_lock(idevman);
+	udevman_unlink_udevice(udevman, dev);
+	idevman->loading_unlock(idevman);
+
+	dev->free(dev);
+	return TRUE;
+}
+
+static void udevman_unregister_all_udevices(UDEVMAN* udevman)
+{
+	IUDEVMAN* idevman = &udevman->iface;
+
+	idevman->loading_lock(idevman);
+	while (udevman->head)
+	{
+		IUDEVICE* dev = udevman->head;
+		udevman_unlink_udevice(udevman, dev);
+		dev->free(dev);
+	}
+	idevman->loading_unlock(idevman);
+}
+
+static int udevman_is_auto_add(WINPR_ATTR_UNUSED IUDEVMAN* idevman)
+{
+	return 0;
+}
+
+static IUDEVICE* udevman_get_udevice_by_UsbDevice(IUDEVMAN* idevman, UINT32 UsbDevice)
+{
+	if (!idevman || !idevman->plugin)
+		return nullptr;
+
+	/* Mask highest 2 bits, must be ignored */
+	UsbDevice = UsbDevice & INTERFACE_ID_MASK;
+	URBDRC_PLUGIN* urbdrc = (URBDRC_PLUGIN*)idevman->plugin;
+	idevman->loading_lock(idevman);
+	idevman->rewind(idevman);
+
+	while (idevman->has_next(idevman))
+	{
+		IUDEVICE* pdev = idevman->get_next(idevman);
+
+		if (pdev->get_UsbDevice(pdev) == UsbDevice)
+		{
+			idevman->loading_unlock(idevman);
+			return pdev;
+		}
+	}
+
+	idevman->loading_unlock(idevman);
+	WLog_Print(urbdrc->log, WLOG_WARN, "Failed to find a USB device mapped to deviceId=%08" PRIx32,
+	           UsbDevice);
+	return nullptr;
+}
+
+static IUDEVICE* udevman_get_udevice_by_ChannelID(IUDEVMAN* idevman, UINT32 channelID)
+{
+	if (!idevman || !idevman->plugin)
+		return nullptr;
+
+	URBDRC_PLUGIN* urbdrc = (URBDRC_PLUGIN*)idevman->plugin;
+	idevman->loading_lock(idevman);
+	idevman->rewind(idevman);
+
+	while (idevman->has_next(idevman))
+	{
+		IUDEVICE* pdev = idevman->get_next(idevman);
+
+		if (pdev->get_channelID(pdev) == channelID)
+		{
+			idevman->loading_unlock(idevman);
+			return pdev;
+		}
+	}
+
+	idevman->loading_unlock(idevman);
+	WLog_Print(urbdrc->log, WLOG_WARN, "Failed to find a USB device mapped to channelID=%08" PRIx32,
+	           channelID);
+	return nullptr;
+}
+
+static void udevman_loading_lock(IUDEVMAN* idevman)
+{
+	UDEVMAN* udevman = (UDEVMAN*)idevman;
+	(void)WaitForSingleObject(udevman->devman_loading, INFINITE);
+}
+
+static void udevman_loading_unlock(IUDEVMAN* idevman)
+{
+	UDEVMAN* udevman = (UDEVMAN*)idevman;
+	(void)ReleaseMutex(udevman->devman_loading);
+}
+
+BASIC_STATE_FUNC_DEFINED(device_num, UINT32)
+
+static UINT32 udevman_get_next_device_id(IUDEVMAN* idevman)
+{
+	UDEVMAN* udevman = (UDEVMAN*)idevman;
+	return udevman->next_device_id++;
+}
+
+static void udevman_set_next_device_id(IUDEVMAN* idevman, UINT32 _t)
+{
+	UDEVMAN* udevman = (UDEVMAN*)idevman;
+	udevman->next_device_id = _t;
+}
+
+static void udevman_free(UDEVMAN* udevman)
+{
+	if (!udevman)
+		return;
+
+	if (udevman->devman_loading)
+	{
+		udevman_unregister_all_udevices(udevman);
+		(void)CloseHandle(udevman->devman_loading);
+	}
+
+	free(udevman);
+}
+
+static void idevman_free(IUDEVMAN* idevman)
+{
+	UDEVMAN* udevman = (UDEVMAN*)idevman;
+	udevman_free(udevman);
+}
+
+static BOOL udevman_initialize(IUDEVMAN* idevman, UINT32 channelId)
+{
+	UDEVMAN* udevman = (UDEVMAN*)idevman;
+
+	if (!udevman)
+		return FALSE;
+
+	idevman->status &= (uint32_t)~URBDRC_DEVICE_CHANNEL_CLOSED;
+	idevman->controlChannelId = channelId;
+	return TRUE;
+}
+
+static UINT fake_udevman_parse_addin_args(UDEVMAN* udevman, const ADDIN_ARGV* args)
+{
+	BOOL any = FALSE;
+
+	udevman->storageSize = FAKE_STORAGE_DEFAULT_SIZE * 1024ull * 1024ull;
+
+	for (int x = 0; x < args->argc; x++)
+	{
+		const char* arg = args->argv[x];
+		if (strcmp(arg, "dbg") == 0)
+		{
+			if (!WLog_SetLogLevel(WLog_Get(TAG), WLOG_TRACE))
+				return ERROR_INTERNAL_ERROR;
+		}
+		else if (_strnicmp(arg, "storage", 7) == 0)
+		{
+			udevman->devices[FAKE_UDEVICE_STORAGE] = TRUE;
+			any = TRUE;
+
+			if (arg[7] == ':')
+			{
+				errno = 0;
+				const unsigned long size = strtoul(&arg[8], nullptr, 0);
+				if ((errno != 0) || (size == 0) || (size > 4096))
+				{
+					WLog_ERR(TAG, "Invalid storage size: \"%s\"", arg);
+					return CHANNEL_RC_INITIALIZATION_ERROR;
+				}
+				udevman->storageSize = size * 1024ull * 1024ull;
+			}
+		}
+		else if (_stricmp(arg, "headset") == 0)
+		{
+			udevman->devices[FAKE_UDEVICE_HEADSET] = TRUE;
+			any = TRUE;
+		}
+	}
+
+	/* without a selection every profile is attached */
+	if (!any)
+	{
+		for (size_t x = 0; x < FAKE_UDEVICE_COUNT; x++)
+			udevman->devices[x] = TRUE;
+	}
+
+	return CHANNEL_RC_OK;
+}
+
+static UINT udevman_listener_created_callback(IUDEVMAN* iudevman)
+{
+	UDEVMAN* udevman = (UDEVMAN*)iudevman;
+	WINPR_ASSERT(udevman);
+
+	for (size_t x = 0; x < FAKE_UDEVICE_COUNT; x++)
+	{
+		UINT16 vid = 0;
+		UINT16 pid = 0;
+
+		if (!udevman->devices[x] || !fake_udevice_ids((FAKE_UDEVICE_TYPE)x, &vid, &pid))
+			continue;
+
+		if (!add_device(&udevman->iface, DEVICE_ADD_FLAG_ALL, FAKE_BUS_NUMBER, (BYTE)(x + 1),
+		                vid, pid))
+			return CHANNEL_RC_INITIALIZATION_ERROR;
+	}
+
+	return CHANNEL_RC_OK;
+}
+
+static void udevman_load_interface(UDEVMAN* udevman)
+{
+	/* standard */
+	udevman->iface.free = idevman_free;
+	/* manage devices */
+	udevman->iface.rewind = udevman_rewind;
+	udevman->iface.get_next = udevman_get_next;
+	udevman->iface.has_next = udevman_has_next;
+	udevman->iface.register_udevice = udevman_register_udevice;
+	udevman->iface.unregister_udevice = udevman_unregister_udevice;
+	udevman->iface.get_udevice_by_UsbDevice = udevman_get_udevice_by_UsbDevice;
+	udevman->iface.get_udevice_by_ChannelID = udevman_get_udevice_by_ChannelID;
+	/* Extension */
+	udevman->iface.isAutoAdd = udevman_is_auto_add;
+	/* Basic state */
+	BASIC_STATE_FUNC_REGISTER(device_num, udevman);
+	BASIC_STATE_FUNC_REGISTER(next_device_id, udevman);
+
+	/* control semaphore or mutex lock */
+	udevman->iface.loading_lock = udevman_loading_lock;
+	udevman->iface.loading_unlock = udevman_loading_unlock;
+	udevman->iface.initialize = udevman_initialize;
+	udevman->iface.listener_created_callback = udevman_listener_created_callback;
+}
+
+FREERDP_ENTRY_POINT(UINT VCAPITYPE fake_freerdp_urbdrc_client_subsystem_entry(
+    PFREERDP_URBDRC_SERVICE_ENTRY_POINTS pEntryPoints))
+{
+	const ADDIN_ARGV* args = pEntryPoints->args;
+	UDEVMAN* udevman = (PUDEVMAN)calloc(1, sizeof(UDEVMAN));
+
+	if (!udevman)
+		goto fail;
+
+	udevman->next_device_id = BASE_USBDEVICE_NUM;
+	udevman->iface.plugin = pEntryPoints->plugin;
+	udevman->devman_loading = CreateMutexA(nullptr, FALSE, "devman_loading");
+
+	if (!udevman->devman_loading)
+		goto fail;
+
+	udevman_load_interface(udevman);
+
+	if (fake_udevman_parse_addin_args(udevman, args) != CHANNEL_RC_OK)
+		goto fail;
+
+	if (!pEntryPoints->pRegisterUDEVMAN(pEntryPoints->plugin, (IUDEVMAN*)udevman))
+		goto fail;
+
+	WLog_DBG(TAG, "UDEVMAN fake device registered.");
+	return 0;
+fail:
+	udevman_free(udevman);
+	return ERROR_INTERNAL_ERROR;
+}
@@ -0,0 +1,328 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * RemoteFX USB Redirection - fake device unit test
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+
+#include <winpr/crt.h>
+#include <winpr/endian.h>
+#include <winpr/stream.h>
+#include <winpr/synch.h>
+#include <winpr/wlog.h>
+
+#include "../fake_udevice.h"
+
+/* Match the storage profile in fake_udevice.c */
+#define TEST_BULK_HEADER 36
+#define TEST_EP_IN 0x81
+#define TEST_EP_OUT 0x02
+#define TEST_BLOCK 512
+#define TEST_BLOCKS 64
+#define TEST_CBW_SIGNATURE 0x43425355
+#define TEST_CSW_SIGNATURE 0x53425355
+#define TEST_CBW_LENGTH 31
+#define TEST_CSW_LENGTH 13
+
+/* Completion of the last bulk transfer, written by the device thread */
+typedef struct
+{
+	HANDLE event;
+	UINT32 status;
+	UINT32 actual;
+	BYTE data[4 * TEST_BLOCK];
+} TEST_COMPLETION;
+
+static TEST_COMPLETION completion = WINPR_C_ARRAY_INIT;
+
+static void test_transfer_cb(WINPR_ATTR_UNUSED IUDEVICE* idev,
+                             WINPR_ATTR_UNUSED GENERIC_CHANNEL_CALLBACK* callback, wStream* out,
+                             WINPR_ATTR_UNUSED UINT32 InterfaceId, WINPR_ATTR_UNUSED BOOL noAck,
+                             WINPR_ATTR_UNUSED UINT32 MessageId,
+                             WINPR_ATTR_UNUSED UINT32 RequestId,
+                             WINPR_ATTR_UNUSED UINT32 NumberOfPackets, UINT32 status,
+                             WINPR_ATTR_UNUSED UINT32 StartFrame,
+                             WINPR_ATTR_UNUSED UINT32 ErrorCount, UINT32 OutputBufferSize,
+                             int transferDir)
+{
+	completion.status = status;
+	completion.actual = OutputBufferSize;
+
+	if ((transferDir == USBD_TRANSFER_DIRECTION_IN) && (OutputBufferSize > 0) &&
+	    (OutputBufferSize <= sizeof(completion.data)))
+		memcpy(completion.data, Stream_Buffer(out) + TEST_BULK_HEADER, OutputBufferSize);
+
+	Stream_Release(out);
+	(void)SetEvent(completion.event);
+}
+
+/* Runs a bulk transfer and waits for its completion, FALSE if it did not complete */
+static BOOL test_bulk(IUDEVICE* idev, UINT32 EndpointAddress, const BYTE* data, UINT32 length,
+                      UINT32* status, UINT32* actual)
+{
+	static UINT32 requestId = 0;
+	const int dir = (EndpointAddress & 0x80) ? USBD_TRANSFER_DIRECTION_IN
+	                                          : USBD_TRANSFER_DIRECTION_OUT;
+
+	(void)ResetEvent(completion.event);
+	if (idev->bulk_or_interrupt_transfer(idev, nullptr, 0, ++requestId, EndpointAddress, 0, FALSE,
+	                                     length, data, dir, test_transfer_cb, 1000) != 0)
+		return FALSE;
+
+	if (WaitForSingleObject(completion.event, 5000) != WAIT_OBJECT_0)
+	{
+		(void)fprintf(stderr, "bulk transfer on 0x%02" PRIx32 " did not complete\n",
+		              EndpointAddress);
+		return FALSE;
+	}
+
+	*status = completion.status;
+	*actual = completion.actual;
+	return TRUE;
+}
+
+/* Runs a SCSI command through the bulk only transport, returns the CSW status or -1 */
+static int test_scsi(IUDEVICE* idev, const BYTE* cb, size_t cbLength, BOOL hostIn, BYTE* data,
+                     UINT32 length)
+{
+	static UINT32 tag = 0x1000;
+	BYTE cbw[TEST_CBW_LENGTH] = WINPR_C_ARRAY_INIT;
+	UINT32 status = 0;
+	UINT32 actual = 0;
+
+	winpr_Data_Write_UINT32(&cbw[0], TEST_CBW_SIGNATURE);
+	winpr_Data_Write_UINT32(&cbw[4], ++tag);
+	winpr_Data_Write_UINT32(&cbw[8], length);
+	cbw[12] = hostIn ? 0x80 : 0x00;
+	cbw[14] = (BYTE)cbLength;
+	memcpy(&cbw[15], cb, cbLength);
+
+	if (!test_bulk(idev, TEST_EP_OUT, cbw, sizeof(cbw), &status, &actual) ||
+	    (status != USBD_STATUS_SUCCESS))
+		return -1;
+
+	if (length > 0)
+	{
+		if (hostIn)
+		{
+			if (!test_bulk(idev, TEST_EP_IN, nullptr, length, &status, &actual) ||
+			    (status != USBD_STATUS_SUCCESS) || (actual != length))
+				return -1;
+			memcpy(data, completion.data, length);
+		}
+		else if (!test_bulk(idev, TEST_EP_OUT, data, length, &status, &actual) ||
+		         (status != USBD_STATUS_SUCCESS))
+			return -1;
+	}
+
+	if (!test_bulk(idev, TEST_EP_IN, nullptr, TEST_CSW_LENGTH, &status, &actual) ||
+	    (status != USBD_STATUS_SUCCESS) || (actual != TEST_CSW_LENGTH))
+		return -1;
+
+	if ((winpr_Data_Get_UINT32(&completion.data[0]) != TEST_CSW_SIGNATURE) ||
+	    (winpr_Data_Get_UINT32(&completion.data[4]) != tag) ||
+	    (winpr_Data_Get_UINT32(&completion.data[8]) != 0))
+		return -1;
+
+	return completion.data[12];
+}
+
+static BOOL test_descriptors(IUDEVICE* idev)
+{
+	BYTE buffer[64] = WINPR_C_ARRAY_INIT;
+	UINT32 status = 0;
+	UINT32 size = sizeof(buffer);
+	UINT16 vid = 0;
+	UINT16 pid = 0;
+
+	if (!fake_udevice_ids(FAKE_UDEVICE_STORAGE, &vid, &pid))
+		return FALSE;
+
+	/* GET_DESCRIPTOR device */
+	if (!idev->control_transfer(idev, 1, 0, 0, 0x80, 0x06, 0x0100, 0, &status, &size, buffer,
+	                            1000) ||
+	    (status != USBD_STATUS_SUCCESS) || (size != 18) || (buffer[1] != 0x01) ||
+	    (winpr_Data_Get_UINT16(&buffer[8]) != vid) || (winpr_Data_Get_UINT16(&buffer[10]) != pid))
+		return FALSE;
+
+	/* GET_DESCRIPTOR configuration, then select it */
+	size = sizeof(buffer);
+	if (!idev->control_transfer(idev, 2, 0, 0, 0x80, 0x06, 0x0200, 0, &status, &size, buffer,
+	                            1000) ||
+	    (status != USBD_STATUS_SUCCESS) || (size != winpr_Data_Get_UINT16(&buffer[2])))
+		return FALSE;
+
+	if (idev->select_configuration(idev, buffer[5]) != 0)
+		return FALSE;
+
+	/* Unknown requests stall */
+	size = sizeof(buffer);
+	if (!idev->control_transfer(idev, 3, 0, 0, 0xC0, 0x42, 0, 0, &status, &size, buffer, 1000) ||
+	    (status != USBD_STATUS_STALL_PID))
+		return FALSE;
+
+	return TRUE;
+}
+
+static BOOL test_storage(IUDEVICE* idev)
+{
+	const BYTE testUnitReady[6] = WINPR_C_ARRAY_INIT;
+	const BYTE write10[10] = { 0x2A, 0, 0, 0, 0, 3, 0, 0, 2, 0 };
+	const BYTE read10[10] = { 0x28, 0, 0, 0, 0, 3, 0, 0, 2, 0 };
+	BYTE data[2 * TEST_BLOCK] = WINPR_C_ARRAY_INIT;
+	BYTE readBack[2 * TEST_BLOCK] = WINPR_C_ARRAY_INIT;
+
+	if (test_scsi(idev, testUnitReady, sizeof(testUnitReady), FALSE, nullptr, 0) != 0)
+		return FALSE;
+
+	/* Two blocks written at LBA 3 read back unchanged */
+	for (size_t x = 0; x < sizeof(data); x++)
+		data[x] = (BYTE)(x * 13 + 7);
+	if (test_scsi(idev, write10, sizeof(write10), FALSE, data, sizeof(data)) != 0)
+		return FALSE;
+	if (test_scsi(idev, read10, sizeof(read10), TRUE, readBack, sizeof(readBack)) != 0)
+		return FALSE;
+	if (memcmp(data, readBack, sizeof(data)) != 0)
+	{
+		(void)fprintf(stderr, "RAM disk returned different data\n");
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/* A read past the end of the disk stalls the data phase and fails in the CSW */
+static BOOL test_out_of_range(IUDEVICE* idev)
+{
+	const BYTE read10[10] = { 0x28, 0, 0, 0, 0, TEST_BLOCKS - 1, 0, 0, 2, 0 };
+	BYTE cbw[TEST_CBW_LENGTH] = WINPR_C_ARRAY_INIT;
+	BYTE buffer[8] = WINPR_C_ARRAY_INIT;
+	UINT32 status = 0;
+	UINT32 actual = 0;
+	UINT32 size = 0;
+
+	winpr_Data_Write_UINT32(&cbw[0], TEST_CBW_SIGNATURE);
+	winpr_Data_Write_UINT32(&cbw[8], 2 * TEST_BLOCK);
+	cbw[12] = 0x80;
+	cbw[14] = sizeof(read10);
+	memcpy(&cbw[15], read10, sizeof(read10));
+
+	if (!test_bulk(idev, TEST_EP_OUT, cbw, sizeof(cbw), &status, &actual) ||
+	    (status != USBD_STATUS_SUCCESS))
+		return FALSE;
+	if (!test_bulk(idev, TEST_EP_IN, nullptr, 2 * TEST_BLOCK, &status, &actual) ||
+	    (status != USBD_STATUS_STALL_PID))
+		return FALSE;
+
+	/* CLEAR_FEATURE(ENDPOINT_HALT) */
+	if (!idev->control_transfer(idev, 4, 0, 0, 0x02, 0x01, ENDPOINT_HALT, TEST_EP_IN, &status,
+	                            &size, buffer, 1000) ||
+	    (status != USBD_STATUS_SUCCESS))
+		return FALSE;
+
+	if (!test_bulk(idev, TEST_EP_IN, nullptr, TEST_CSW_LENGTH, &status, &actual) ||
+	    (status != USBD_STATUS_SUCCESS) || (actual != TEST_CSW_LENGTH))
+		return FALSE;
+
+	/* command failed, nothing transferred */
+	return (winpr_Data_Get_UINT32(&completion.data[8]) == 2 * TEST_BLOCK) &&
+	       (completion.data[12] == 1);
+}
+
+/* An invalid CBW stalls until the host does a reset recovery */
+static BOOL test_reset_recovery(IUDEVICE* idev)
+{
+	const BYTE garbage[10] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10 };
+	const BYTE testUnitReady[6] = WINPR_C_ARRAY_INIT;
+	BYTE buffer[8] = WINPR_C_ARRAY_INIT;
+	UINT32 status = 0;
+	UINT32 actual = 0;
+	UINT32 size = 0;
+
+	if (!test_bulk(idev, TEST_EP_OUT, garbage, sizeof(garbage), &status, &actual) ||
+	    (status != USBD_STATUS_STALL_PID))
+		return FALSE;
+	if (!test_bulk(idev, TEST_EP_IN, nullptr, TEST_CSW_LENGTH, &status, &actual) ||
+	    (status != USBD_STATUS_STALL_PID))
+		return FALSE;
+
+	/* BULK ONLY MASS STORAGE RESET, then CLEAR_FEATURE(ENDPOINT_HALT) */
+	if (!idev->control_transfer(idev, 5, 0, 0, 0x21, 0xFF, 0, 0, &status, &size, buffer, 1000) ||
+	    (status != USBD_STATUS_SUCCESS))
+		return FALSE;
+	if (!idev->control_transfer(idev, 6, 0, 0, 0x02, 0x01, ENDPOINT_HALT, TEST_EP_IN, &status,
+	                            &size, buffer, 1000) ||
+	    (status != USBD_STATUS_SUCCESS))
+		return FALSE;
+
+	return test_scsi(idev, testUnitReady, sizeof(testUnitReady), FALSE, nullptr, 0) == 0;
+}
+
+int TestUrbdrcFake(int argc, char* argv[])
+{
+	int rc = -1;
+	UINT16 vid = 0;
+	UINT16 pid = 0;
+	URBDRC_PLUGIN urbdrc = WINPR_C_ARRAY_INIT;
+	IUDEVICE* idev = nullptr;
+
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	urbdrc.log = WLog_Get("com.freerdp.channels.urbdrc.test");
+	completion.event = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+	if (!urbdrc.log || !completion.event)
+		goto fail;
+
+	if (!fake_udevice_ids(FAKE_UDEVICE_HEADSET, &vid, &pid) ||
+	    fake_udevice_ids(FAKE_UDEVICE_COUNT, &vid, &pid))
+		goto fail;
+
+	idev = fake_udevice_new(&urbdrc, FAKE_UDEVICE_STORAGE, 1, 2, TEST_BLOCKS * TEST_BLOCK);
+	if (!idev)
+		goto fail;
+
+	if (!test_descriptors(idev))
+	{
+		(void)fprintf(stderr, "descriptor requests failed\n");
+		goto fail;
+	}
+
+	if (!test_storage(idev))
+	{
+		(void)fprintf(stderr, "SCSI commands failed\n");
+		goto fail;
+	}
+
+	if (!test_out_of_range(idev))
+	{
+		(void)fprintf(stderr, "read past the end of the disk not failed\n");
+		goto fail;
+	}
+
+	if (!test_reset_recovery(idev))
+	{
+		(void)fprintf(stderr, "no reset recovery after an invalid CBW\n");
+		goto fail;
+	}
+
+	rc = 0;
+fail:
+	if (idev)
+		idev->free(idev);
+	if (completion.event)
+		(void)CloseHandle(completion.event);
+	return rc;
+}
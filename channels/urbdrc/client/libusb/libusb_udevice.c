@@ -83,6 +83,8 @@ typedef struct
 #if !defined(HAVE_STREAM_ID_API)
 	UINT32 streamID;
 #endif
+	/* number of iso packets the transfer was allocated with */
+	UINT32 isoPackets;
 } ASYNC_TRANSFER_USER_DATA;
 
 static void request_free(void* value);
@@ -204,29 +206,119 @@ const char* usb_interface_class_to_string(uint8_t c_class)
 	}
 }
 
-static ASYNC_TRANSFER_USER_DATA*
-async_transfer_user_data_new(IUDEVICE* idev, UINT32 MessageId, size_t offset, size_t BufferSize,
-                             const BYTE* data, size_t packetSize, BOOL NoAck, int transferDir,
-                             t_isoch_transfer_cb cb, GENERIC_CHANNEL_CALLBACK* callback)
+static void udev_transfer_free(struct libusb_transfer* transfer)
 {
-	ASYNC_TRANSFER_USER_DATA* user_data = nullptr;
-	UDEVICE* pdev = (UDEVICE*)idev;
+	if (!transfer)
+		return;
 
-	if (BufferSize > UINT32_MAX)
+	ASYNC_TRANSFER_USER_DATA* user_data = (ASYNC_TRANSFER_USER_DATA*)transfer->user_data;
+	if (user_data && user_data->data)
+		Stream_Release(user_data->data);
+	free(user_data);
+	transfer->user_data = nullptr;
+	libusb_free_transfer(transfer);
+}
+
+static struct libusb_transfer* udev_transfer_new(UDEVICE* pdev, UINT32 NumberOfPackets)
+{
+	if (NumberOfPackets > INT32_MAX)
+		return nullptr;
+
+	struct libusb_transfer* transfer = libusb_alloc_transfer((int)NumberOfPackets);
+	if (!transfer)
 		return nullptr;
 
-	user_data = calloc(1, sizeof(ASYNC_TRANSFER_USER_DATA));
+	ASYNC_TRANSFER_USER_DATA* user_data = calloc(1, sizeof(ASYNC_TRANSFER_USER_DATA));
 	if (!user_data)
+	{
+		libusb_free_transfer(transfer);
 		return nullptr;
+	}
 
-	user_data->data = Stream_New(nullptr, offset + BufferSize + packetSize);
+	user_data->idev = &pdev->iface;
+	user_data->isoPackets = NumberOfPackets;
+	transfer->user_data = user_data;
+	return transfer;
+}
 
-	if (!user_data->data)
+/* Takes the smallest idle transfer with room for NumberOfPackets iso packets from the pool,
+ * only if there is none a new one is allocated. */
+static struct libusb_transfer* udev_transfer_take(UDEVICE* pdev, UINT32 NumberOfPackets)
+{
+	struct libusb_transfer* transfer = nullptr;
+	size_t index = 0;
+
+	EnterCriticalSection(&pdev->transfer_lock);
+	for (size_t x = 0; x < pdev->transfer_pool_count; x++)
 	{
-		free(user_data);
-		return nullptr;
+		const ASYNC_TRANSFER_USER_DATA* cur =
+		    (const ASYNC_TRANSFER_USER_DATA*)pdev->transfer_pool[x]->user_data;
+		if (cur->isoPackets < NumberOfPackets)
+			continue;
+
+		if (transfer)
+		{
+			const ASYNC_TRANSFER_USER_DATA* best =
+			    (const ASYNC_TRANSFER_USER_DATA*)transfer->user_data;
+			if (best->isoPackets <= cur->isoPackets)
+				continue;
+		}
+
+		transfer = pdev->transfer_pool[x];
+		index = x;
 	}
 
+	if (transfer)
+		pdev->transfer_pool[index] = pdev->transfer_pool[--pdev->transfer_pool_count];
+	LeaveCriticalSection(&pdev->transfer_lock);
+
+	if (!transfer)
+		return udev_transfer_new(pdev, NumberOfPackets);
+
+	transfer->num_iso_packets = 0;
+	return transfer;
+}
+
+/* Returns a transfer that is no longer in flight to the pool, or frees it if the pool is full */
+static void udev_transfer_return(UDEVICE* pdev, struct libusb_transfer* transfer)
+{
+	ASYNC_TRANSFER_USER_DATA* user_data = (ASYNC_TRANSFER_USER_DATA*)transfer->user_data;
+	const UINT32 isoPackets = user_data->isoPackets;
+
+	if (user_data->data)
+		Stream_Release(user_data->data);
+	memset(user_data, 0, sizeof(ASYNC_TRANSFER_USER_DATA));
+	user_data->idev = &pdev->iface;
+	user_data->isoPackets = isoPackets;
+
+	EnterCriticalSection(&pdev->transfer_lock);
+	if (pdev->transfer_pool_count < ARRAYSIZE(pdev->transfer_pool))
+	{
+		pdev->transfer_pool[pdev->transfer_pool_count++] = transfer;
+		transfer = nullptr;
+	}
+	LeaveCriticalSection(&pdev->transfer_lock);
+
+	udev_transfer_free(transfer);
+}
+
+static ASYNC_TRANSFER_USER_DATA*
+async_transfer_user_data_init(struct libusb_transfer* transfer, UINT32 MessageId, size_t offset,
+                              size_t BufferSize, const BYTE* data, size_t packetSize, BOOL NoAck,
+                              int transferDir, t_isoch_transfer_cb cb,
+                              GENERIC_CHANNEL_CALLBACK* callback)
+{
+	ASYNC_TRANSFER_USER_DATA* user_data = (ASYNC_TRANSFER_USER_DATA*)transfer->user_data;
+	UDEVICE* pdev = (UDEVICE*)user_data->idev;
+
+	if (BufferSize > UINT32_MAX)
+		return nullptr;
+
+	user_data->data = StreamPool_Take(pdev->buffers, offset + BufferSize + packetSize);
+
+	if (!user_data->data)
+		return nullptr;
+
 	Stream_Seek(user_data->data, offset); /* Skip header offset */
 	if (data)
 		memcpy(Stream_Pointer(user_data->data), data, BufferSize);
@@ -235,7 +327,6 @@ async_transfer_user_data_new(IUDEVICE* idev, UINT32 MessageId, size_t offset, si
 	user_data->transferDir = transferDir;
 	user_data->cb = cb;
 	user_data->callback = callback;
-	user_data->idev = idev;
 	user_data->MessageId = MessageId;
 
 	user_data->queue = pdev->request_queue;
@@ -243,15 +334,6 @@ async_transfer_user_data_new(IUDEVICE* idev, UINT32 MessageId, size_t offset, si
 	return user_data;
 }
 
-static void async_transfer_user_data_free(ASYNC_TRANSFER_USER_DATA* user_data)
-{
-	if (user_data)
-	{
-		Stream_Free(user_data->data, TRUE);
-		free(user_data);
-	}
-}
-
 static void LIBUSB_CALL func_iso_callback(struct libusb_transfer* transfer)
 {
 	ASYNC_TRANSFER_USER_DATA* user_data = (ASYNC_TRANSFER_USER_DATA*)transfer->user_data;
@@ -1285,22 +1367,11 @@ static int libusb_udev_isoch_transfer(IUDEVICE* idev, GENERIC_CHANNEL_CALLBACK*
 		return -1;
 
 	urbdrc = pdev->urbdrc;
-	user_data = async_transfer_user_data_new(idev, MessageId, 48, BufferSize, Buffer,
-	                                         outSize + 1024, NoAck, transferDir, cb, callback);
-
-	if (!user_data)
-		return -1;
-
-	user_data->ErrorCount = ErrorCount;
-	user_data->StartFrame = StartFrame;
-
-	if (!Buffer)
-		Stream_Seek(user_data->data, (12ULL * NumberOfPackets));
 
 	if (NumberOfPackets > 0)
 	{
 		iso_packet_size = BufferSize / NumberOfPackets;
-		iso_transfer = libusb_alloc_transfer((int)NumberOfPackets);
+		iso_transfer = udev_transfer_take(pdev, NumberOfPackets);
 	}
 
 	if (iso_transfer == nullptr)
@@ -1309,10 +1380,24 @@ static int libusb_udev_isoch_transfer(IUDEVICE* idev, GENERIC_CHANNEL_CALLBACK*
 		           "Error: libusb_alloc_transfer [NumberOfPackets=%" PRIu32 ", BufferSize=%" PRIu32
 		           " ]",
 		           NumberOfPackets, BufferSize);
-		async_transfer_user_data_free(user_data);
 		return -1;
 	}
 
+	user_data = async_transfer_user_data_init(iso_transfer, MessageId, 48, BufferSize, Buffer,
+	                                          outSize + 1024, NoAck, transferDir, cb, callback);
+
+	if (!user_data)
+	{
+		request_free(iso_transfer);
+		return -1;
+	}
+
+	user_data->ErrorCount = ErrorCount;
+	user_data->StartFrame = StartFrame;
+
+	if (!Buffer)
+		Stream_Seek(user_data->data, (12ULL * NumberOfPackets));
+
 	/**  process URB_FUNCTION_IOSCH_TRANSFER */
 	libusb_fill_iso_transfer(
 	    iso_transfer, pdev->libusb_handle, WINPR_ASSERTING_INT_CAST(uint8_t, EndpointAddress),
@@ -1393,20 +1478,20 @@ static int libusb_udev_bulk_or_interrupt_transfer(
 		return -1;
 
 	urbdrc = pdev->urbdrc;
-	user_data = async_transfer_user_data_new(idev, MessageId, 36, BufferSize, data, 0, NoAck,
-	                                         transferDir, cb, callback);
 
-	if (!user_data)
+	/* take a urb transfer from the pool */
+	transfer = udev_transfer_take(pdev, 0);
+	if (!transfer)
 		return -1;
 
-	/* alloc memory for urb transfer */
-	transfer = libusb_alloc_transfer(0);
-	if (!transfer)
+	user_data = async_transfer_user_data_init(transfer, MessageId, 36, BufferSize, data, 0, NoAck,
+	                                          transferDir, cb, callback);
+
+	if (!user_data)
 	{
-		async_transfer_user_data_free(user_data);
+		request_free(transfer);
 		return -1;
 	}
-	transfer->user_data = user_data;
 
 	ep_desc = func_get_ep_desc(pdev->LibusbConfig, pdev->MsConfig, EndpointAddress);
 
@@ -1592,6 +1677,10 @@ static void udev_free(IUDEVICE* idev)
 	if (!udev->iface.attach_kernel_driver(idev))
 		WLog_Print(udev->urbdrc->log, WLOG_WARN, "attach_kernel_driver failed for device");
 	ArrayList_Free(udev->request_queue);
+	for (size_t x = 0; x < udev->transfer_pool_count; x++)
+		udev_transfer_free(udev->transfer_pool[x]);
+	StreamPool_Free(udev->buffers);
+	DeleteCriticalSection(&udev->transfer_lock);
 	/* free the config descriptor that send from windows */
 	msusb_msconfig_free(udev->MsConfig);
 	libusb_unref_device(udev->libusb_dev);
@@ -1746,9 +1835,13 @@ static void request_free(void* value)
 		return;
 
 	user_data = (ASYNC_TRANSFER_USER_DATA*)transfer->user_data;
-	async_transfer_user_data_free(user_data);
-	transfer->user_data = nullptr;
-	libusb_free_transfer(transfer);
+	if (!user_data)
+	{
+		libusb_free_transfer(transfer);
+		return;
+	}
+
+	udev_transfer_return((UDEVICE*)user_data->idev, transfer);
 }
 
 static IUDEVICE* udev_init(URBDRC_PLUGIN* urbdrc, libusb_context* context, LIBUSB_DEVICE* device,
@@ -1767,6 +1860,12 @@ static IUDEVICE* udev_init(URBDRC_PLUGIN* urbdrc, libusb_context* context, LIBUS
 	if (!pdev)
 		return nullptr;
 
+	if (!InitializeCriticalSectionAndSpinCount(&pdev->transfer_lock, 4000))
+	{
+		free(pdev);
+		return nullptr;
+	}
+
 	pdev->urbdrc = urbdrc;
 	udev_load_interface(pdev);
 
@@ -1856,6 +1955,22 @@ static IUDEVICE* udev_init(URBDRC_PLUGIN* urbdrc, libusb_context* context, LIBUS
 
 	ArrayList_Object(pdev->request_queue)->fnObjectFree = request_free;
 
+	pdev->buffers = StreamPool_New(TRUE, 0);
+
+	if (!pdev->buffers)
+		goto fail;
+
+	/* most URBs are bulk transfers, have some ready before the first one arrives */
+	for (size_t x = 0; x < UDEV_TRANSFER_POOL_SIZE / 4; x++)
+	{
+		struct libusb_transfer* transfer = udev_transfer_new(pdev, 0);
+
+		if (!transfer)
+			goto fail;
+
+		pdev->transfer_pool[pdev->transfer_pool_count++] = transfer;
+	}
+
 	/* set config of windows */
 	pdev->MsConfig = msusb_msconfig_new();
 
@@ -36,6 +36,9 @@ typedef struct libusb_interface LIBUSB_INTERFACE;
 typedef struct libusb_interface_descriptor LIBUSB_INTERFACE_DESCRIPTOR;
 typedef struct libusb_endpoint_descriptor LIBUSB_ENDPOINT_DESCEIPTOR;
 
+/* Idle libusb transfers kept per device for reuse by later URBs */
+#define UDEV_TRANSFER_POOL_SIZE 32
+
 typedef struct
 {
 	IUDEVICE iface;
@@ -64,6 +67,12 @@ typedef struct
 
 	wArrayList* request_queue;
 
+	/* completion messages are built in place in these buffers */
+	wStreamPool* buffers;
+	CRITICAL_SECTION transfer_lock;
+	struct libusb_transfer* transfer_pool[UDEV_TRANSFER_POOL_SIZE];
+	size_t transfer_pool_count;
+
 	URBDRC_PLUGIN* urbdrc;
 } UDEVICE;
 typedef UDEVICE* PUDEVICE;
@@ -0,0 +1,303 @@
+
+#include <freerdp/config.h>
+
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+
+#include <freerdp/client.h>
+#include <freerdp/gdi/gfx.h>
+
+#include "../xf_client.h"
+#include "../xf_gfx.h"
+#include "../xf_graphics.h"
+#include "../xfreerdp.h"
+#include "../../../libfreerdp/cache/cache.h"
+
+#define TEST_WIDTH 128
+#define TEST_HEIGHT 96
+#define TEST_SURFACE_ID 7
+
+typedef struct
+{
+	UINT16 surfaceId;
+	void* surface;
+} TestSurfaces;
+
+static TestSurfaces testSurfaces;
+
+static UINT test_set_surface_data(WINPR_ATTR_UNUSED RdpgfxClientContext* context, UINT16 surfaceId,
+                                  void* pData)
+{
+	testSurfaces.surfaceId = surfaceId;
+	testSurfaces.surface = pData;
+	return CHANNEL_RC_OK;
+}
+
+static void* test_get_surface_data(WINPR_ATTR_UNUSED RdpgfxClientContext* context,
+                                   UINT16 surfaceId)
+{
+	if (!testSurfaces.surface || (testSurfaces.surfaceId != surfaceId))
+		return nullptr;
+	return testSurfaces.surface;
+}
+
+static UINT test_get_surface_ids(WINPR_ATTR_UNUSED RdpgfxClientContext* context,
+                                 UINT16** ppSurfaceIds, UINT16* count)
+{
+	*ppSurfaceIds = nullptr;
+	*count = 0;
+	if (!testSurfaces.surface)
+		return CHANNEL_RC_OK;
+
+	*ppSurfaceIds = calloc(1, sizeof(UINT16));
+	if (!*ppSurfaceIds)
+		return CHANNEL_RC_NO_MEMORY;
+	(*ppSurfaceIds)[0] = testSurfaces.surfaceId;
+	*count = 1;
+	return CHANNEL_RC_OK;
+}
+
+/** sets up what xf_setup_x11 and xf_post_connect do for the GFX output path, drawing into
+ * a pixmap instead of a window */
+static BOOL test_setup_x11(xfContext* xfc)
+{
+	int count = 0;
+	rdpContext* context = &xfc->common.context;
+
+	WINPR_ASSERT(xfc->display);
+	xfc->UseXThreads = FALSE;
+	xfc->mutex = CreateMutex(nullptr, FALSE, nullptr);
+	if (!xfc->mutex)
+		return FALSE;
+
+	xfc->screen_number = DefaultScreen(xfc->display);
+	xfc->screen = ScreenOfDisplay(xfc->display, xfc->screen_number);
+	xfc->depth = DefaultDepthOfScreen(xfc->screen);
+	xfc->visual = DefaultVisual(xfc->display, xfc->screen_number);
+	xfc->invert = TRUE;
+
+	XPixmapFormatValues* pfs = XListPixmapFormats(xfc->display, &count);
+	for (int i = 0; pfs && (i < count); i++)
+	{
+		if (pfs[i].depth == xfc->depth)
+			xfc->scanline_pad = pfs[i].scanline_pad;
+	}
+	if (pfs)
+		XFree(pfs);
+	if (xfc->scanline_pad == 0)
+		return FALSE;
+
+	xfc->drawable = XCreatePixmap(xfc->display, RootWindowOfScreen(xfc->screen), TEST_WIDTH,
+	                              TEST_HEIGHT, WINPR_ASSERTING_INT_CAST(uint32_t, xfc->depth));
+	xfc->gc = XCreateGC(xfc->display, xfc->drawable, 0, nullptr);
+	if (!xfc->gc)
+		return FALSE;
+
+	if (!freerdp_settings_set_uint32(context->settings, FreeRDP_DesktopWidth, TEST_WIDTH) ||
+	    !freerdp_settings_set_uint32(context->settings, FreeRDP_DesktopHeight, TEST_HEIGHT))
+		return FALSE;
+
+	context->cache = cache_new(context);
+	if (!context->cache)
+		return FALSE;
+
+	return gdi_init(context->instance, xf_get_local_color_format(xfc, TRUE));
+}
+
+static void test_teardown_x11(xfContext* xfc)
+{
+	rdpContext* context = &xfc->common.context;
+
+	gdi_free(context->instance);
+	cache_free(context->cache);
+	context->cache = nullptr;
+
+	if (xfc->gc)
+		XFreeGC(xfc->display, xfc->gc);
+	if (xfc->drawable)
+		XFreePixmap(xfc->display, xfc->drawable);
+	if (xfc->display)
+		XCloseDisplay(xfc->display);
+	if (xfc->mutex)
+		(void)CloseHandle(xfc->mutex);
+	xfc->gc = nullptr;
+	xfc->drawable = 0;
+	xfc->display = nullptr;
+	xfc->mutex = nullptr;
+}
+
+static BYTE test_pattern(UINT32 x, UINT32 y, UINT32 channel, UINT32 round)
+{
+	return (BYTE)((x * 3 + y * 5 + channel * 70 + round * 20) & 0xff);
+}
+
+/** pushes an uncompressed frame to the surface and reads it back from the X server */
+static BOOL test_present(xfContext* xfc, RdpgfxClientContext* gfx, BOOL useShm, UINT32 round)
+{
+	BOOL rc = FALSE;
+	XImage* image = nullptr;
+	const UINT32 left = 8 + round;
+	const UINT32 top = 4 + round;
+	const UINT32 width = 40;
+	const UINT32 height = 30;
+	BYTE* data = calloc(1ull * width * height, 4);
+
+	const RDPGFX_CREATE_SURFACE_PDU create = { .surfaceId = TEST_SURFACE_ID,
+		                                       .width = TEST_WIDTH,
+		                                       .height = TEST_HEIGHT,
+		                                       .pixelFormat = GFX_PIXEL_FORMAT_XRGB_8888 };
+	const RDPGFX_MAP_SURFACE_TO_OUTPUT_PDU map = { .surfaceId = TEST_SURFACE_ID };
+	const RDPGFX_DELETE_SURFACE_PDU del = { .surfaceId = TEST_SURFACE_ID };
+	RDPGFX_SURFACE_COMMAND cmd = { .surfaceId = TEST_SURFACE_ID,
+		                           .codecId = RDPGFX_CODECID_UNCOMPRESSED,
+		                           .format = PIXEL_FORMAT_BGRX32,
+		                           .left = left,
+		                           .top = top,
+		                           .right = left + width,
+		                           .bottom = top + height,
+		                           .width = width,
+		                           .height = height,
+		                           .length = width * height * 4,
+		                           .data = data };
+
+	if (!data)
+		return FALSE;
+
+	for (UINT32 y = 0; y < height; y++)
+	{
+		for (UINT32 x = 0; x < width; x++)
+		{
+			BYTE* pixel = &data[(1ull * y * width + x) * 4];
+			pixel[0] = test_pattern(x, y, 0, round);
+			pixel[1] = test_pattern(x, y, 1, round);
+			pixel[2] = test_pattern(x, y, 2, round);
+			pixel[3] = 0xff;
+		}
+	}
+
+#if defined(WITH_XSHM)
+	xfc->xshmAvailable = useShm && XShmQueryExtension(xfc->display);
+#else
+	WINPR_UNUSED(useShm);
+#endif
+
+	if ((gfx->CreateSurface(gfx, &create) != CHANNEL_RC_OK) ||
+	    (gfx->MapSurfaceToOutput(gfx, &map) != CHANNEL_RC_OK))
+		goto fail;
+
+#if defined(WITH_XSHM)
+	{
+		const xfGfxSurface* surface = testSurfaces.surface;
+		/* a remote display fails the attach and disables MIT-SHM for the connection */
+		if (!surface || (surface->shmAttached != xfc->xshmAvailable))
+			goto fail;
+		(void)printf("%s: round %" PRIu32 " MIT-SHM %s\n", __func__, round,
+		             surface->shmAttached ? "attached" : "not used");
+	}
+#endif
+
+	/* not inside a frame, the surface command presents the damage right away */
+	if (gfx->SurfaceCommand(gfx, &cmd) != CHANNEL_RC_OK)
+		goto fail;
+
+	image = XGetImage(xfc->display, xfc->drawable, 0, 0, TEST_WIDTH, TEST_HEIGHT, AllPlanes,
+	                  ZPixmap);
+	if (!image)
+		goto fail;
+
+	/* only check the content for the usual 8 bit per channel visuals */
+	if ((xfc->visual->red_mask == 0xff0000) && (xfc->visual->green_mask == 0xff00) &&
+	    (xfc->visual->blue_mask == 0xff))
+	{
+		for (UINT32 y = 0; y < height; y++)
+		{
+			for (UINT32 x = 0; x < width; x++)
+			{
+				const unsigned long expected = ((unsigned long)test_pattern(x, y, 2, round) << 16) |
+				                               ((unsigned long)test_pattern(x, y, 1, round) << 8) |
+				                               test_pattern(x, y, 0, round);
+				const unsigned long pixel =
+				    XGetPixel(image, (int)(left + x), (int)(top + y)) & 0xffffff;
+				if (pixel != expected)
+				{
+					(void)fprintf(stderr, "%s: pixel %" PRIu32 "x%" PRIu32 " is 0x%06lx\n",
+					              __func__, left + x, top + y, pixel);
+					goto fail;
+				}
+			}
+		}
+	}
+
+	rc = TRUE;
+fail:
+	if (image)
+		XDestroyImage(image);
+	if (testSurfaces.surface && (gfx->DeleteSurface(gfx, &del) != CHANNEL_RC_OK))
+		rc = FALSE;
+	free(data);
+	return rc;
+}
+
+int TestXfGfxShm(WINPR_ATTR_UNUSED int argc, WINPR_ATTR_UNUSED char* argv[])
+{
+	int rc = -1;
+	RDP_CLIENT_ENTRY_POINTS entry = WINPR_C_ARRAY_INIT;
+	RdpgfxClientContext* gfx = nullptr;
+
+	Display* display = XOpenDisplay(nullptr);
+	if (!display)
+	{
+		(void)printf("%s: No X11 display, skipping test (run it with xvfb-run)\n", __func__);
+		return 0;
+	}
+
+	entry.Version = 1;
+	entry.Size = sizeof(RDP_CLIENT_ENTRY_POINTS_V1);
+	if (RdpClientEntry(&entry) != 0)
+	{
+		XCloseDisplay(display);
+		return -1;
+	}
+
+	rdpContext* context = freerdp_client_context_new(&entry);
+	if (!context)
+	{
+		XCloseDisplay(display);
+		return -1;
+	}
+
+	xfContext* xfc = (xfContext*)context;
+	xfc->display = display;
+	if (!test_setup_x11(xfc))
+	{
+		(void)fprintf(stderr, "%s: X11 setup failed\n", __func__);
+		goto fail;
+	}
+
+	gfx = calloc(1, sizeof(RdpgfxClientContext));
+	if (!gfx)
+		goto fail;
+	gfx->SetSurfaceData = test_set_surface_data;
+	gfx->GetSurfaceData = test_get_surface_data;
+	gfx->GetSurfaceIds = test_get_surface_ids;
+
+	xf_graphics_pipeline_init(xfc, gfx);
+	if (!gfx->custom)
+		goto fail;
+
+	/* surfaces presented with XShmPutImage, then with the XPutImage fallback */
+	for (UINT32 round = 0; round < 4; round++)
+	{
+		if (!test_present(xfc, gfx, (round % 2) == 0, round))
+			goto fail;
+	}
+
+	rc = 0;
+fail:
+	if (gfx && gfx->custom)
+		xf_graphics_pipeline_uninit(xfc, gfx);
+	free(gfx);
+	test_teardown_x11(xfc);
+	freerdp_client_context_free(context);
+	return rc;
+}
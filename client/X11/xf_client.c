@@ -971,6 +971,11 @@ static void xf_check_extensions(xfContext* context)
 		}
 	}
 #endif
+
+#ifdef WITH_XSHM
+	if (XShmQueryExtension(context->display))
+		context->xshmAvailable = TRUE;
+#endif
 }
 
 #ifdef WITH_XI
@@ -34,8 +34,159 @@
 
 #include <X11/Xutil.h>
 
+#if defined(WITH_XSHM)
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#endif
+
 #define TAG CLIENT_TAG("x11")
 
+#if defined(WITH_XSHM)
+static int xf_gfx_shm_error;
+
+static int xf_gfx_shm_error_handler(WINPR_ATTR_UNUSED Display* display, XErrorEvent* event)
+{
+	WINPR_ASSERT(event);
+	xf_gfx_shm_error = event->error_code;
+	return 0;
+}
+
+/** Attaches a SysV shared memory segment of \b size bytes to the X server.
+ *  XShmQueryExtension also succeeds for remote displays, the server only fails
+ *  the attach request, so the error is trapped here and MIT-SHM is disabled for
+ *  this connection on failure.
+ */
+static BYTE* xf_gfx_shm_attach(xfContext* xfc, xfGfxSurface* surface, size_t size)
+{
+	WINPR_ASSERT(xfc);
+	WINPR_ASSERT(surface);
+
+	if (!xfc->xshmAvailable)
+		return nullptr;
+
+	surface->shm.shmid = shmget(IPC_PRIVATE, size, IPC_CREAT | 0600);
+	if (surface->shm.shmid < 0)
+		return nullptr;
+
+	surface->shm.shmaddr = shmat(surface->shm.shmid, nullptr, 0);
+	if (surface->shm.shmaddr == (char*)-1)
+	{
+		(void)shmctl(surface->shm.shmid, IPC_RMID, nullptr);
+		surface->shm.shmaddr = nullptr;
+		return nullptr;
+	}
+
+	/* The server reads the segment, it never writes to it */
+	surface->shm.readOnly = True;
+
+	xf_lock_x11(xfc);
+	LogDynAndXSync(xfc->log, xfc->display, False);
+	xf_gfx_shm_error = Success;
+	int (*handler)(Display*, XErrorEvent*) = XSetErrorHandler(xf_gfx_shm_error_handler);
+	const Status attached = XShmAttach(xfc->display, &surface->shm);
+	LogDynAndXSync(xfc->log, xfc->display, False);
+	XSetErrorHandler(handler);
+	xf_unlock_x11(xfc);
+
+	/* Mark the segment for removal, it is released once both sides detached */
+	(void)shmctl(surface->shm.shmid, IPC_RMID, nullptr);
+
+	if (!attached || (xf_gfx_shm_error != Success))
+	{
+		WLog_Print(xfc->log, WLOG_INFO, "MIT-SHM attach failed, falling back to XPutImage");
+		xfc->xshmAvailable = FALSE;
+		(void)shmdt(surface->shm.shmaddr);
+		surface->shm.shmaddr = nullptr;
+		return nullptr;
+	}
+
+	surface->shmAttached = TRUE;
+	return (BYTE*)surface->shm.shmaddr;
+}
+
+static void xf_gfx_shm_detach(xfContext* xfc, xfGfxSurface* surface)
+{
+	WINPR_ASSERT(xfc);
+	WINPR_ASSERT(surface);
+
+	if (!surface->shmAttached)
+		return;
+
+	xf_lock_x11(xfc);
+	XShmDetach(xfc->display, &surface->shm);
+	LogDynAndXSync(xfc->log, xfc->display, False);
+	xf_unlock_x11(xfc);
+
+	(void)shmdt(surface->shm.shmaddr);
+	surface->shm.shmaddr = nullptr;
+	surface->shmAttached = FALSE;
+}
+#endif
+
+static void xf_gfx_put_image(xfContext* xfc, xfGfxSurface* surface, Drawable d, UINT32 nXSrc,
+                             UINT32 nYSrc, UINT32 nXDst, UINT32 nYDst, UINT32 width,
+                             UINT32 height)
+{
+	WINPR_ASSERT(xfc);
+	WINPR_ASSERT(surface);
+
+#if defined(WITH_XSHM)
+	if (surface->shmAttached)
+	{
+		LogDynAndXShmPutImage(xfc->log, xfc->display, d, xfc->gc, surface->image,
+		                      WINPR_ASSERTING_INT_CAST(int, nXSrc),
+		                      WINPR_ASSERTING_INT_CAST(int, nYSrc),
+		                      WINPR_ASSERTING_INT_CAST(int, nXDst),
+		                      WINPR_ASSERTING_INT_CAST(int, nYDst), width, height, False);
+		return;
+	}
+#endif
+
+	LogDynAndXPutImage(xfc->log, xfc->display, d, xfc->gc, surface->image,
+	                   WINPR_ASSERTING_INT_CAST(int, nXSrc), WINPR_ASSERTING_INT_CAST(int, nYSrc),
+	                   WINPR_ASSERTING_INT_CAST(int, nXDst), WINPR_ASSERTING_INT_CAST(int, nYDst),
+	                   width, height);
+}
+
+/** Allocates a surface pixel buffer, in shared memory if MIT-SHM is usable */
+static BYTE* xf_gfx_surface_buffer_new(xfContext* xfc, xfGfxSurface* surface, size_t size)
+{
+	BYTE* data = nullptr;
+
+#if defined(WITH_XSHM)
+	data = xf_gfx_shm_attach(xfc, surface, size);
+#else
+	WINPR_UNUSED(xfc);
+	WINPR_UNUSED(surface);
+#endif
+
+	if (!data)
+		data = (BYTE*)winpr_aligned_malloc(size, 16);
+
+	if (data)
+		ZeroMemory(data, size);
+	return data;
+}
+
+static void xf_gfx_surface_buffer_free(xfContext* xfc, xfGfxSurface* surface, BYTE* data)
+{
+	if (!data)
+		return;
+
+#if defined(WITH_XSHM)
+	if (surface->shmAttached && (data == (BYTE*)surface->shm.shmaddr))
+	{
+		xf_gfx_shm_detach(xfc, surface);
+		return;
+	}
+#else
+	WINPR_UNUSED(xfc);
+	WINPR_UNUSED(surface);
+#endif
+
+	winpr_aligned_free(data);
+}
+
 static UINT xf_OutputUpdate(xfContext* xfc, xfGfxSurface* surface)
 {
 	UINT rc = ERROR_INTERNAL_ERROR;
@@ -98,11 +249,8 @@ static UINT xf_OutputUpdate(xfContext* xfc, xfGfxSurface* surface)
 
 		if (xfc->remote_app)
 		{
-			LogDynAndXPutImage(xfc->log, xfc->display, xfc->primary, xfc->gc, surface->image,
-			                   WINPR_ASSERTING_INT_CAST(int, nXSrc),
-			                   WINPR_ASSERTING_INT_CAST(int, nYSrc),
-			                   WINPR_ASSERTING_INT_CAST(int, nXDst),
-			                   WINPR_ASSERTING_INT_CAST(int, nYDst), dwidth, dheight);
+			xf_gfx_put_image(xfc, surface, xfc->primary, nXSrc, nYSrc, nXDst, nYDst, dwidth,
+			                 dheight);
 			if (!xf_rail_paint_surface(xfc, surface->gdi.windowId, rect))
 				goto fail;
 		}
@@ -111,11 +259,8 @@ static UINT xf_OutputUpdate(xfContext* xfc, xfGfxSurface* surface)
 		    if (freerdp_settings_get_bool(settings, FreeRDP_SmartSizing) ||
 		        freerdp_settings_get_bool(settings, FreeRDP_MultiTouchGestures))
 		{
-			LogDynAndXPutImage(xfc->log, xfc->display, xfc->primary, xfc->gc, surface->image,
-			                   WINPR_ASSERTING_INT_CAST(int, nXSrc),
-			                   WINPR_ASSERTING_INT_CAST(int, nYSrc),
-			                   WINPR_ASSERTING_INT_CAST(int, nXDst),
-			                   WINPR_ASSERTING_INT_CAST(int, nYDst), dwidth, dheight);
+			xf_gfx_put_image(xfc, surface, xfc->primary, nXSrc, nYSrc, nXDst, nYDst, dwidth,
+			                 dheight);
 			xf_draw_screen(xfc, WINPR_ASSERTING_INT_CAST(int32_t, nXDst),
 			               WINPR_ASSERTING_INT_CAST(int32_t, nYDst),
 			               WINPR_ASSERTING_INT_CAST(int32_t, dwidth),
@@ -124,11 +269,8 @@ static UINT xf_OutputUpdate(xfContext* xfc, xfGfxSurface* surface)
 		else
 #endif
 		{
-			LogDynAndXPutImage(xfc->log, xfc->display, xfc->drawable, xfc->gc, surface->image,
-			                   WINPR_ASSERTING_INT_CAST(int, nXSrc),
-			                   WINPR_ASSERTING_INT_CAST(int, nYSrc),
-			                   WINPR_ASSERTING_INT_CAST(int, nXDst),
-			                   WINPR_ASSERTING_INT_CAST(int, nYDst), dwidth, dheight);
+			xf_gfx_put_image(xfc, surface, xfc->drawable, nXSrc, nYSrc, nXDst, nYDst, dwidth,
+			                 dheight);
 		}
 	}
 
@@ -136,6 +278,9 @@ static UINT xf_OutputUpdate(xfContext* xfc, xfGfxSurface* surface)
 fail:
 	region16_clear(&surface->gdi.invalidRegion);
 	LogDynAndXSetClipMask(xfc->log, xfc->display, xfc->gc, None);
+	/* The whole frame damage was pushed above. For MIT-SHM surfaces the sync is
+	 * also what keeps the decoder from writing to the segment before the server
+	 * is done reading it, so no XShmCompletionEvent is required. */
 	LogDynAndXSync(xfc->log, xfc->display, False);
 	xf_unlock_x11(xfc);
 	return rc;
@@ -343,7 +488,18 @@ static UINT xf_CreateSurface(RdpgfxClientContext* context,
 	surface->gdi.scanline = x11_pad_scanline(surface->gdi.scanline,
 	                                         WINPR_ASSERTING_INT_CAST(uint32_t, xfc->scanline_pad));
 	size = 1ull * surface->gdi.scanline * surface->gdi.height;
-	surface->gdi.data = (BYTE*)winpr_aligned_malloc(size, 16);
+
+	if (FreeRDPAreColorFormatsEqualNoAlpha(gdi->dstFormat, surface->gdi.format))
+	{
+		/* The XImage uses the surface buffer directly, share it with the server */
+		surface->gdi.data = xf_gfx_surface_buffer_new(xfc, surface, size);
+	}
+	else
+	{
+		surface->gdi.data = (BYTE*)winpr_aligned_malloc(size, 16);
+		if (surface->gdi.data)
+			ZeroMemory(surface->gdi.data, size);
+	}
 
 	if (!surface->gdi.data)
 	{
@@ -351,8 +507,6 @@ static UINT xf_CreateSurface(RdpgfxClientContext* context,
 		goto out_free;
 	}
 
-	ZeroMemory(surface->gdi.data, size);
-
 	if (FreeRDPAreColorFormatsEqualNoAlpha(gdi->dstFormat, surface->gdi.format))
 	{
 		WINPR_ASSERT(xfc->depth != 0);
@@ -370,7 +524,7 @@ static UINT xf_CreateSurface(RdpgfxClientContext* context,
 		surface->stageScanline = x11_pad_scanline(
 		    surface->stageScanline, WINPR_ASSERTING_INT_CAST(uint32_t, xfc->scanline_pad));
 		size = 1ull * surface->stageScanline * surface->gdi.height;
-		surface->stage = (BYTE*)winpr_aligned_malloc(size, 16);
+		surface->stage = xf_gfx_surface_buffer_new(xfc, surface, size);
 
 		if (!surface->stage)
 		{
@@ -378,7 +532,6 @@ static UINT xf_CreateSurface(RdpgfxClientContext* context,
 			goto out_free_gdidata;
 		}
 
-		ZeroMemory(surface->stage, size);
 		WINPR_ASSERT(xfc->depth != 0);
 		surface->image = LogDynAndXCreateImage(
 		    xfc->log, xfc->display, xfc->visual, WINPR_ASSERTING_INT_CAST(uint32_t, xfc->depth),
@@ -395,6 +548,13 @@ static UINT xf_CreateSurface(RdpgfxClientContext* context,
 	surface->image->byte_order = LSBFirst;
 	surface->image->bitmap_bit_order = LSBFirst;
 
+#if defined(WITH_XSHM)
+	/* XShmPutImage looks up the segment through obdata, the same as for
+	 * XShmCreateImage. It must be reset before XDestroyImage. */
+	if (surface->shmAttached)
+		surface->image->obdata = (char*)&surface->shm;
+#endif
+
 	region16_init(&surface->gdi.invalidRegion);
 
 	if (context->SetSurfaceData(context, surface->gdi.surfaceId, (void*)surface) != CHANNEL_RC_OK)
@@ -406,11 +566,12 @@ static UINT xf_CreateSurface(RdpgfxClientContext* context,
 	return CHANNEL_RC_OK;
 error_set_surface_data:
 	surface->image->data = nullptr;
+	surface->image->obdata = nullptr;
 	XDestroyImage(surface->image);
 error_surface_image:
-	winpr_aligned_free(surface->stage);
+	xf_gfx_surface_buffer_free(xfc, surface, surface->stage);
 out_free_gdidata:
-	winpr_aligned_free(surface->gdi.data);
+	xf_gfx_surface_buffer_free(xfc, surface, surface->gdi.data);
 out_free:
 	free(surface);
 	return ret;
@@ -425,6 +586,9 @@ static UINT xf_DeleteSurface(RdpgfxClientContext* context,
                              const RDPGFX_DELETE_SURFACE_PDU* deleteSurface)
 {
 	rdpCodecs* codecs = nullptr;
+	rdpGdi* gdi = (rdpGdi*)context->custom;
+	WINPR_ASSERT(gdi);
+	xfContext* xfc = (xfContext*)gdi->context;
 
 	UINT status = 0;
 	EnterCriticalSection(&context->mux);
@@ -448,9 +612,10 @@ static UINT xf_DeleteSurface(RdpgfxClientContext* context,
 		freerdp_av1_context_free(surface->gdi.av1);
 #endif
 		surface->image->data = nullptr;
+		surface->image->obdata = nullptr;
 		XDestroyImage(surface->image);
-		winpr_aligned_free(surface->gdi.data);
-		winpr_aligned_free(surface->stage);
+		xf_gfx_surface_buffer_free(xfc, surface, surface->gdi.data);
+		xf_gfx_surface_buffer_free(xfc, surface, surface->stage);
 		region16_uninit(&surface->gdi.invalidRegion);
 		codecs = surface->gdi.codecs;
 		free(surface);
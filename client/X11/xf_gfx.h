@@ -27,12 +27,20 @@
 
 #include <freerdp/gdi/gfx.h>
 
+#if defined(WITH_XSHM)
+#include <X11/extensions/XShm.h>
+#endif
+
 struct xf_gfx_surface
 {
 	gdiGfxSurface gdi;
 	BYTE* stage;
 	UINT32 stageScanline;
 	XImage* image;
+#if defined(WITH_XSHM)
+	XShmSegmentInfo shm;
+	BOOL shmAttached;
+#endif
 };
 typedef struct xf_gfx_surface xfGfxSurface;
 
@@ -344,6 +344,39 @@ int LogDynAndXPutImage_ex(wLog* log, const char* file, const char* fkt, size_t l
 	                                       rc);
 }
 
+#if defined(WITH_XSHM)
+Bool LogDynAndXShmPutImage_ex(wLog* log, const char* file, const char* fkt, size_t line,
+                              Display* display, Drawable d, GC gc, XImage* image, int src_x,
+                              int src_y, int dest_x, int dest_y, unsigned int width,
+                              unsigned int height, Bool send_event)
+{
+	if (WLog_IsLevelActive(log, log_level))
+	{
+		write_log(log, log_level, file, fkt, line,
+		          "XShmPutImage(%p, d: {%lu}, gc: {%p}, image: [%p]{%d}, src_x: {%d}, src_y: {%d}, "
+		          "dest_x: {%d}, "
+		          "dest_y: {%d}, width: {%u}, "
+		          "height: {%u}, send_event: {%d})",
+		          (void*)display, d, (void*)gc, (void*)image, image ? image->depth : -1, src_x,
+		          src_y, dest_x, dest_y, width, height, send_event);
+	}
+
+	if ((width == 0) || (height == 0))
+	{
+		const DWORD lvl = WLOG_WARN;
+		if (WLog_IsLevelActive(log, lvl))
+			write_log(log, lvl, file, fkt, line, "XShmPutImage(width=%u, height=%u) !", width,
+			          height);
+		return True;
+	}
+
+	const Bool rc = XShmPutImage(display, d, gc, image, src_x, src_y, dest_x, dest_y, width,
+	                             height, send_event);
+	return write_result_log_expect_one(log, WLOG_WARN, file, fkt, line, display, "XShmPutImage",
+	                                   rc);
+}
+#endif
+
 /* be careful here.
  * XSendEvent returns Status, but implementation always returns 1
  */
@@ -24,6 +24,10 @@
 
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
+
+#if defined(WITH_XSHM)
+#include <X11/extensions/XShm.h>
+#endif
 #include "xfreerdp.h"
 
 const char* x11_error_to_string(xfContext* xfc, int error, char* buffer, size_t size);
@@ -188,6 +192,17 @@ int LogDynAndXPutImage_ex(wLog* log, const char* file, const char* fkt, size_t l
                           Display* display, Drawable d, GC gc, XImage* image, int src_x, int src_y,
                           int dest_x, int dest_y, unsigned int width, unsigned int height);
 
+#if defined(WITH_XSHM)
+#define LogDynAndXShmPutImage(log, display, d, gc, image, src_x, src_y, dest_x, dest_y, width, \
+                              height, send_event)                                              \
+	LogDynAndXShmPutImage_ex(log, __FILE__, __func__, __LINE__, (display), (d), (gc), (image),   \
+	                         (src_x), (src_y), (dest_x), (dest_y), (width), (height), (send_event))
+Bool LogDynAndXShmPutImage_ex(wLog* log, const char* file, const char* fkt, size_t line,
+                              Display* display, Drawable d, GC gc, XImage* image, int src_x,
+                              int src_y, int dest_x, int dest_y, unsigned int width,
+                              unsigned int height, Bool send_event);
+#endif
+
 #define LogDynAndXCopyArea(log, display, src, dest, gc, src_x, src_y, width, height, dest_x, \
                            dest_y)                                                           \
 	LogDynAndXCopyArea_ex(log, __FILE__, __func__, __LINE__, (display), (src), (dest), (gc), \
@@ -45,6 +45,7 @@
 #include <winpr/stream.h>
 #include <winpr/clipboard.h>
 #include <winpr/path.h>
+#include <winpr/sysinfo.h>
 
 #include <freerdp/utils/signal.h>
 #include <freerdp/log.h>
@@ -57,6 +58,13 @@
 #define NO_CLIP_DATA_ID (UINT64_C(1) << 32)
 #define WIN32_FILETIME_TO_UNIX_EPOCH INT64_C(11644473600)
 
+/* Sequential FUSE reads are served from ranges requested ahead of time. Each file keeps at most
+ * CLIPRDR_READAHEAD_MAX_CHUNKS chunks in flight or cached, which bounds the readback cache. */
+#define CLIPRDR_READAHEAD_CHUNK_SIZE (1024ULL * 1024ULL)
+#define CLIPRDR_READAHEAD_MAX_CHUNKS 16
+#define CLIPRDR_READAHEAD_MIN_WINDOW 2
+#define CLIPRDR_READAHEAD_SEQUENTIAL_READS 2
+
 #ifdef WITH_DEBUG_CLIPRDR
 #define DEBUG_CLIPRDR(log, ...) WLog_Print(log, WLOG_DEBUG, __VA_ARGS__)
 #else
@@ -73,8 +81,47 @@ typedef enum eFuseLowlevelOperationType
 	FUSE_LL_OPERATION_LOOKUP,
 	FUSE_LL_OPERATION_GETATTR,
 	FUSE_LL_OPERATION_READ,
+	FUSE_LL_OPERATION_READ_AHEAD,
 } FuseLowlevelOperationType;
 
+typedef enum
+{
+	CLIPRDR_CHUNK_FREE,
+	CLIPRDR_CHUNK_PENDING,
+	CLIPRDR_CHUNK_READY,
+} CliprdrFuseChunkState;
+
+typedef struct
+{
+	CliprdrFuseChunkState state;
+	UINT64 offset;
+	size_t size; /* requested size while pending, received size when ready */
+	BYTE* data;
+	UINT64 requested_ns;
+} CliprdrFuseChunk;
+
+typedef struct
+{
+	fuse_req_t fuse_req;
+	UINT64 offset;
+	size_t size;
+} CliprdrFuseWaitingRead;
+
+typedef struct
+{
+	UINT64 next_offset;
+	UINT32 sequential_reads;
+	UINT64 fetch_offset;
+
+	size_t window;
+	UINT64 rtt_ns;
+	UINT64 consume_ns;
+	UINT64 last_consumed_ns;
+
+	CliprdrFuseChunk chunks[CLIPRDR_READAHEAD_MAX_CHUNKS];
+	wArrayList* waiting_reads;
+} CliprdrFuseReadAhead;
+
 typedef struct sCliprdrFuseFile CliprdrFuseFile;
 
 struct sCliprdrFuseFile
@@ -101,6 +148,8 @@ struct sCliprdrFuseFile
 
 	BOOL has_clip_data_id;
 	UINT32 clip_data_id;
+
+	CliprdrFuseReadAhead* readahead;
 };
 
 typedef struct
@@ -130,6 +179,7 @@ typedef struct
 	CliprdrFuseFile* fuse_file;
 	fuse_req_t fuse_req;
 	UINT32 stream_id;
+	CliprdrFuseChunk* chunk;
 } CliprdrFuseRequest;
 #endif
 
@@ -194,6 +244,55 @@ struct cliprdr_file_context
 #if defined(WITH_FUSE)
 static CliprdrFuseFile* get_fuse_file_by_ino(CliprdrFileContext* file_context, fuse_ino_t fuse_ino);
 
+static void readahead_fail_waiting_reads(CliprdrFuseReadAhead* readahead)
+{
+	if (!readahead)
+		return;
+
+	for (size_t x = 0; x < ArrayList_Count(readahead->waiting_reads); x++)
+	{
+		CliprdrFuseWaitingRead* waiting_read = ArrayList_GetItem(readahead->waiting_reads, x);
+		fuse_reply_err(waiting_read->fuse_req, EIO);
+	}
+	ArrayList_Clear(readahead->waiting_reads);
+}
+
+static void readahead_free(CliprdrFuseReadAhead* readahead)
+{
+	if (!readahead)
+		return;
+
+	ArrayList_Free(readahead->waiting_reads);
+
+	for (size_t x = 0; x < ARRAYSIZE(readahead->chunks); x++)
+		free(readahead->chunks[x].data);
+
+	free(readahead);
+}
+
+WINPR_ATTR_NODISCARD
+static CliprdrFuseReadAhead* readahead_new(void)
+{
+	CliprdrFuseReadAhead* readahead = calloc(1, sizeof(CliprdrFuseReadAhead));
+	if (!readahead)
+		return nullptr;
+
+	readahead->waiting_reads = ArrayList_New(FALSE);
+	if (!readahead->waiting_reads)
+		goto fail;
+
+	{
+		wObject* obj = ArrayList_Object(readahead->waiting_reads);
+		obj->fnObjectFree = free;
+	}
+
+	readahead->window = CLIPRDR_READAHEAD_MIN_WINDOW;
+	return readahead;
+fail:
+	readahead_free(readahead);
+	return nullptr;
+}
+
 static void fuse_file_free(void* data)
 {
 	CliprdrFuseFile* fuse_file = data;
@@ -201,6 +300,7 @@ static void fuse_file_free(void* data)
 	if (!fuse_file)
 		return;
 
+	readahead_free(fuse_file->readahead);
 	ArrayList_Free(fuse_file->children);
 	free(fuse_file->filename_with_root);
 
@@ -372,7 +472,11 @@ static BOOL maybe_clear_fuse_request(const void* key, void* value, void* arg)
 	DEBUG_CLIPRDR(file_context->log, "Clearing FileContentsRequest for file \"%s\"",
 	              fuse_file->filename_with_root);
 
-	fuse_reply_err(fuse_request->fuse_req, EIO);
+	/* Read-ahead requests have no FUSE request attached, fail the reads waiting on them instead */
+	if (fuse_request->operation_type == FUSE_LL_OPERATION_READ_AHEAD)
+		readahead_fail_waiting_reads(fuse_file->readahead);
+	else
+		fuse_reply_err(fuse_request->fuse_req, EIO);
 	HashTable_Remove(file_context->request_table, key);
 
 	return TRUE;
@@ -958,8 +1062,10 @@ static void cliprdr_file_fuse_open(fuse_req_t fuse_req, fuse_ino_t fuse_ino,
 	fuse_reply_open(fuse_req, file_info);
 }
 
-static BOOL request_file_range_async(CliprdrFileContext* file_context, CliprdrFuseFile* fuse_file,
-                                     fuse_req_t fuse_req, off_t offset, size_t requested_size)
+static CliprdrFuseRequest* request_file_range(CliprdrFileContext* file_context,
+                                              CliprdrFuseFile* fuse_file, fuse_req_t fuse_req,
+                                              FuseLowlevelOperationType operation_type,
+                                              UINT64 offset, size_t requested_size)
 {
 	CLIPRDR_FILE_CONTENTS_REQUEST file_contents_request = WINPR_C_ARRAY_INIT;
 
@@ -967,12 +1073,12 @@ static BOOL request_file_range_async(CliprdrFileContext* file_context, CliprdrFu
 	WINPR_ASSERT(fuse_file);
 
 	if (requested_size > UINT32_MAX)
-		return FALSE;
+		return nullptr;
 
 	CliprdrFuseRequest* fuse_request =
-	    cliprdr_fuse_request_new(file_context, fuse_file, fuse_req, FUSE_LL_OPERATION_READ);
+	    cliprdr_fuse_request_new(file_context, fuse_file, fuse_req, operation_type);
 	if (!fuse_request)
-		return FALSE;
+		return nullptr;
 
 	file_contents_request.common.msgType = CB_FILECONTENTS_REQUEST;
 	file_contents_request.streamId = fuse_request->stream_id;
@@ -991,20 +1097,383 @@ static BOOL request_file_range_async(CliprdrFileContext* file_context, CliprdrFu
 		           "Failed to send FileContentsRequest for file \"%s\"",
 		           fuse_file->filename_with_root);
 		HashTable_Remove(file_context->request_table, (void*)(uintptr_t)fuse_request->stream_id);
-		return FALSE;
+		return nullptr;
 	}
 
 	// file_context->request_table owns fuse_request
 	// NOLINTBEGIN(clang-analyzer-unix.Malloc)
-	DEBUG_CLIPRDR(
-	    file_context->log,
-	    "Requested file range (%zu Bytes at offset %lu) for file \"%s\" with stream id %u",
-	    requested_size, offset, fuse_file->filename, fuse_request->stream_id);
+	DEBUG_CLIPRDR(file_context->log,
+	              "Requested file range (%zu Bytes at offset %" PRIu64
+	              ") for file \"%s\" with stream id %u",
+	              requested_size, offset, fuse_file->filename, fuse_request->stream_id);
 
-	return TRUE;
+	return fuse_request;
 	// NOLINTEND(clang-analyzer-unix.Malloc)
 }
 
+static BOOL request_file_range_async(CliprdrFileContext* file_context, CliprdrFuseFile* fuse_file,
+                                     fuse_req_t fuse_req, UINT64 offset, size_t requested_size)
+{
+	return request_file_range(file_context, fuse_file, fuse_req, FUSE_LL_OPERATION_READ, offset,
+	                          requested_size) != nullptr;
+}
+
+static CliprdrFuseChunk* readahead_find_chunk(CliprdrFuseReadAhead* readahead, UINT64 offset)
+{
+	WINPR_ASSERT(readahead);
+
+	for (size_t x = 0; x < ARRAYSIZE(readahead->chunks); x++)
+	{
+		CliprdrFuseChunk* chunk = &readahead->chunks[x];
+
+		if (chunk->state == CLIPRDR_CHUNK_FREE)
+			continue;
+		if ((offset >= chunk->offset) && (offset - chunk->offset < chunk->size))
+			return chunk;
+	}
+
+	return nullptr;
+}
+
+static void readahead_update_window(CliprdrFuseReadAhead* readahead)
+{
+	WINPR_ASSERT(readahead);
+
+	if ((readahead->rtt_ns == 0) || (readahead->consume_ns == 0))
+		return;
+
+	/* Keep enough chunks in flight to cover one round trip at the rate the reader consumes
+	 * them, plus one for the chunk currently being read. */
+	size_t window = 1 + (size_t)((readahead->rtt_ns + readahead->consume_ns - 1) /
+	                             readahead->consume_ns);
+	window = MAX(window, CLIPRDR_READAHEAD_MIN_WINDOW);
+	readahead->window = MIN(window, CLIPRDR_READAHEAD_MAX_CHUNKS);
+}
+
+static void readahead_release_chunk(CliprdrFuseChunk* chunk)
+{
+	WINPR_ASSERT(chunk);
+
+	free(chunk->data);
+	chunk->data = nullptr;
+	chunk->size = 0;
+	chunk->state = CLIPRDR_CHUNK_FREE;
+}
+
+static void readahead_evict_chunks(CliprdrFuseReadAhead* readahead, UINT64 consumed_offset)
+{
+	WINPR_ASSERT(readahead);
+
+	for (size_t x = 0; x < ARRAYSIZE(readahead->chunks); x++)
+	{
+		CliprdrFuseChunk* chunk = &readahead->chunks[x];
+
+		if (chunk->state != CLIPRDR_CHUNK_READY)
+			continue;
+		if (chunk->offset + chunk->size > consumed_offset)
+			continue;
+
+		const UINT64 now = winpr_GetTickCount64NS();
+		if (readahead->last_consumed_ns != 0)
+		{
+			const UINT64 sample = now - readahead->last_consumed_ns;
+			if (readahead->consume_ns == 0)
+				readahead->consume_ns = sample;
+			else
+				readahead->consume_ns = (7 * readahead->consume_ns + sample) / 8;
+		}
+		readahead->last_consumed_ns = now;
+		readahead_release_chunk(chunk);
+	}
+
+	readahead_update_window(readahead);
+}
+
+static void readahead_drop_chunks(CliprdrFuseReadAhead* readahead)
+{
+	WINPR_ASSERT(readahead);
+
+	/* Pending chunks are still referenced by their request and are released once answered */
+	for (size_t x = 0; x < ARRAYSIZE(readahead->chunks); x++)
+	{
+		if (readahead->chunks[x].state == CLIPRDR_CHUNK_READY)
+			readahead_release_chunk(&readahead->chunks[x]);
+	}
+	readahead->last_consumed_ns = 0;
+}
+
+typedef enum
+{
+	CLIPRDR_READ_SERVED,
+	CLIPRDR_READ_PENDING,
+	CLIPRDR_READ_MISSED,
+} CliprdrFuseReadResult;
+
+static CliprdrFuseReadResult readahead_serve(CliprdrFuseFile* fuse_file, fuse_req_t fuse_req,
+                                             UINT64 offset, size_t size)
+{
+	CliprdrFuseReadAhead* readahead = fuse_file->readahead;
+	CliprdrFuseChunk* chunks[CLIPRDR_READAHEAD_MAX_CHUNKS] = WINPR_C_ARRAY_INIT;
+	size_t nchunks = 0;
+
+	WINPR_ASSERT(readahead);
+
+	const UINT64 end = MIN(offset + size, fuse_file->size);
+	for (UINT64 pos = offset; pos < end;)
+	{
+		CliprdrFuseChunk* chunk = readahead_find_chunk(readahead, pos);
+		if (!chunk)
+			return CLIPRDR_READ_MISSED;
+		if (chunk->state == CLIPRDR_CHUNK_PENDING)
+			return CLIPRDR_READ_PENDING;
+		if (nchunks >= ARRAYSIZE(chunks))
+			return CLIPRDR_READ_MISSED;
+
+		chunks[nchunks++] = chunk;
+		pos = chunk->offset + chunk->size;
+	}
+
+	if (nchunks == 0)
+	{
+		fuse_reply_buf(fuse_req, nullptr, 0);
+		return CLIPRDR_READ_SERVED;
+	}
+
+	const size_t length = (size_t)(end - offset);
+	const size_t first_skip = (size_t)(offset - chunks[0]->offset);
+	if (nchunks == 1)
+	{
+		fuse_reply_buf(fuse_req, (const char*)&chunks[0]->data[first_skip], length);
+		return CLIPRDR_READ_SERVED;
+	}
+
+	char* buffer = malloc(length);
+	if (!buffer)
+		return CLIPRDR_READ_MISSED;
+
+	size_t written = 0;
+	for (size_t x = 0; x < nchunks; x++)
+	{
+		const size_t skip = (x == 0) ? first_skip : 0;
+		const size_t copy = MIN(chunks[x]->size - skip, length - written);
+
+		memcpy(&buffer[written], &chunks[x]->data[skip], copy);
+		written += copy;
+	}
+
+	fuse_reply_buf(fuse_req, buffer, written);
+	free(buffer);
+
+	return CLIPRDR_READ_SERVED;
+}
+
+static void readahead_fill_window(CliprdrFileContext* file_context, CliprdrFuseFile* fuse_file)
+{
+	CliprdrFuseReadAhead* readahead = fuse_file->readahead;
+	size_t in_use = 0;
+
+	WINPR_ASSERT(file_context);
+	WINPR_ASSERT(readahead);
+
+	if (readahead->sequential_reads < CLIPRDR_READAHEAD_SEQUENTIAL_READS)
+		return;
+
+	for (size_t x = 0; x < ARRAYSIZE(readahead->chunks); x++)
+	{
+		if (readahead->chunks[x].state != CLIPRDR_CHUNK_FREE)
+			in_use++;
+	}
+
+	readahead->fetch_offset = MAX(readahead->fetch_offset, readahead->next_offset);
+	for (size_t x = 0; x < ARRAYSIZE(readahead->chunks); x++)
+	{
+		CliprdrFuseChunk* chunk = &readahead->chunks[x];
+
+		if ((in_use >= readahead->window) || (readahead->fetch_offset >= fuse_file->size))
+			break;
+		if (chunk->state != CLIPRDR_CHUNK_FREE)
+			continue;
+
+		const size_t size =
+		    (size_t)MIN(CLIPRDR_READAHEAD_CHUNK_SIZE, fuse_file->size - readahead->fetch_offset);
+		CliprdrFuseRequest* fuse_request =
+		    request_file_range(file_context, fuse_file, nullptr, FUSE_LL_OPERATION_READ_AHEAD,
+		                       readahead->fetch_offset, size);
+		if (!fuse_request)
+			break;
+
+		fuse_request->chunk = chunk;
+		chunk->state = CLIPRDR_CHUNK_PENDING;
+		chunk->offset = readahead->fetch_offset;
+		chunk->size = size;
+		chunk->requested_ns = winpr_GetTickCount64NS();
+
+		readahead->fetch_offset += size;
+		in_use++;
+	}
+}
+
+static BOOL readahead_wait(CliprdrFuseReadAhead* readahead, fuse_req_t fuse_req, UINT64 offset,
+                           size_t size)
+{
+	const BOOL stalled = ArrayList_Count(readahead->waiting_reads) == 0;
+	CliprdrFuseWaitingRead* waiting_read = calloc(1, sizeof(CliprdrFuseWaitingRead));
+	if (!waiting_read)
+		return FALSE;
+
+	waiting_read->fuse_req = fuse_req;
+	waiting_read->offset = offset;
+	waiting_read->size = size;
+
+	if (!ArrayList_Append(readahead->waiting_reads, waiting_read))
+	{
+		free(waiting_read);
+		return FALSE;
+	}
+
+	/* The reader caught up with the data in flight, widen the window right away instead of
+	 * waiting for the next consumption sample. */
+	if (stalled)
+		readahead->window = MIN(readahead->window + 1, CLIPRDR_READAHEAD_MAX_CHUNKS);
+	return TRUE;
+}
+
+static BOOL readahead_read(CliprdrFileContext* file_context, CliprdrFuseFile* fuse_file,
+                           fuse_req_t fuse_req, UINT64 offset, size_t size)
+{
+	WINPR_ASSERT(file_context);
+	WINPR_ASSERT(fuse_file);
+
+	if (!fuse_file->readahead)
+	{
+		fuse_file->readahead = readahead_new();
+		if (!fuse_file->readahead)
+			return request_file_range_async(file_context, fuse_file, fuse_req, offset, size);
+	}
+
+	/* The kernel may issue several reads at once, so reads landing inside the read-ahead range
+	 * still count as sequential access. */
+	CliprdrFuseReadAhead* readahead = fuse_file->readahead;
+	const UINT64 end = MIN(offset + size, fuse_file->size);
+	if ((offset == readahead->next_offset) || readahead_find_chunk(readahead, offset))
+	{
+		if (readahead->sequential_reads < UINT32_MAX)
+			readahead->sequential_reads++;
+		readahead->next_offset = MAX(readahead->next_offset, end);
+	}
+	else
+	{
+		readahead->sequential_reads = 0;
+		readahead->fetch_offset = offset;
+		readahead->next_offset = end;
+		readahead_drop_chunks(readahead);
+	}
+
+	switch (readahead_serve(fuse_file, fuse_req, offset, size))
+	{
+		case CLIPRDR_READ_SERVED:
+			readahead_evict_chunks(readahead, readahead->next_offset);
+			readahead_fill_window(file_context, fuse_file);
+			return TRUE;
+		case CLIPRDR_READ_PENDING:
+			if (!readahead_wait(readahead, fuse_req, offset, size))
+				return FALSE;
+			readahead_fill_window(file_context, fuse_file);
+			return TRUE;
+		case CLIPRDR_READ_MISSED:
+		default:
+			break;
+	}
+
+	if (readahead->sequential_reads < CLIPRDR_READAHEAD_SEQUENTIAL_READS)
+		return request_file_range_async(file_context, fuse_file, fuse_req, offset, size);
+
+	/* Sequential access, but the data is not in flight yet: restart the window at this read */
+	readahead->fetch_offset = offset;
+	readahead_fill_window(file_context, fuse_file);
+
+	CliprdrFuseChunk* chunk = readahead_find_chunk(readahead, offset);
+	if (chunk && (chunk->state == CLIPRDR_CHUNK_PENDING))
+		return readahead_wait(readahead, fuse_req, offset, size);
+
+	return request_file_range_async(file_context, fuse_file, fuse_req, offset, size);
+}
+
+static void readahead_complete(CliprdrFileContext* file_context, CliprdrFuseRequest* fuse_request,
+                               const CLIPRDR_FILE_CONTENTS_RESPONSE* file_contents_response)
+{
+	CliprdrFuseFile* fuse_file = fuse_request->fuse_file;
+	CliprdrFuseChunk* chunk = fuse_request->chunk;
+
+	WINPR_ASSERT(file_context);
+	WINPR_ASSERT(fuse_file);
+	WINPR_ASSERT(chunk);
+
+	CliprdrFuseReadAhead* readahead = fuse_file->readahead;
+	WINPR_ASSERT(readahead);
+
+	chunk->state = CLIPRDR_CHUNK_FREE;
+	if ((file_contents_response->common.msgFlags & CB_RESPONSE_OK) &&
+	    (file_contents_response->cbRequested > 0))
+	{
+		chunk->data = malloc(file_contents_response->cbRequested);
+		if (chunk->data)
+		{
+			memcpy(chunk->data, file_contents_response->requestedData,
+			       file_contents_response->cbRequested);
+			chunk->size = MIN(chunk->size, file_contents_response->cbRequested);
+			chunk->state = CLIPRDR_CHUNK_READY;
+
+			const UINT64 sample = winpr_GetTickCount64NS() - chunk->requested_ns;
+			if (readahead->rtt_ns == 0)
+				readahead->rtt_ns = sample;
+			else
+				readahead->rtt_ns = (7 * readahead->rtt_ns + sample) / 8;
+		}
+	}
+	else
+		WLog_Print(file_context->log, WLOG_WARN,
+		           "Read-ahead FileContentsRequest for file \"%s\" was unsuccessful",
+		           fuse_file->filename);
+
+	if (chunk->state == CLIPRDR_CHUNK_FREE)
+	{
+		/* Readers waiting on this range fall back to plain range requests below */
+		chunk->size = 0;
+		readahead->sequential_reads = 0;
+	}
+
+	for (size_t x = 0; x < ArrayList_Count(readahead->waiting_reads);)
+	{
+		CliprdrFuseWaitingRead* waiting_read = ArrayList_GetItem(readahead->waiting_reads, x);
+		BOOL done = TRUE;
+
+		switch (readahead_serve(fuse_file, waiting_read->fuse_req, waiting_read->offset,
+		                        waiting_read->size))
+		{
+			case CLIPRDR_READ_SERVED:
+				break;
+			case CLIPRDR_READ_PENDING:
+				done = FALSE;
+				break;
+			case CLIPRDR_READ_MISSED:
+			default:
+				if (!request_file_range_async(file_context, fuse_file, waiting_read->fuse_req,
+				                              waiting_read->offset, waiting_read->size))
+					fuse_reply_err(waiting_read->fuse_req, EIO);
+				break;
+		}
+
+		if (done)
+			ArrayList_RemoveAt(readahead->waiting_reads, x);
+		else
+			x++;
+	}
+
+	readahead_evict_chunks(readahead, readahead->next_offset);
+	readahead_fill_window(file_context, fuse_file);
+}
+
 static void cliprdr_file_fuse_read(fuse_req_t fuse_req, fuse_ino_t fuse_ino, size_t size,
                                    off_t offset, WINPR_ATTR_UNUSED struct fuse_file_info* file_info)
 {
@@ -1036,7 +1505,7 @@ static void cliprdr_file_fuse_read(fuse_req_t fuse_req, fuse_ino_t fuse_ino, siz
 
 	size = MIN(size, 8ULL * 1024ULL * 1024ULL);
 
-	result = request_file_range_async(file_context, fuse_file, fuse_req, offset, size);
+	result = readahead_read(file_context, fuse_file, fuse_req, (UINT64)offset, size);
 	HashTable_Unlock(file_context->inode_table);
 
 	if (!result)
@@ -1249,6 +1718,19 @@ static UINT cliprdr_file_context_server_file_contents_response(
 		return CHANNEL_RC_OK;
 	}
 
+	if (fuse_request->operation_type == FUSE_LL_OPERATION_READ_AHEAD)
+	{
+		DEBUG_CLIPRDR(file_context->log,
+		              "Received read-ahead range for file \"%s\" with stream id %u",
+		              fuse_request->fuse_file->filename, file_contents_response->streamId);
+
+		readahead_complete(file_context, fuse_request, file_contents_response);
+		HashTable_Remove(file_context->request_table,
+		                 (void*)(uintptr_t)file_contents_response->streamId);
+		HashTable_Unlock(file_context->inode_table);
+		return CHANNEL_RC_OK;
+	}
+
 	if (!(file_contents_response->common.msgFlags & CB_RESPONSE_OK))
 	{
 		WLog_Print(file_context->log, WLOG_WARN,
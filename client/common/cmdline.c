@@ -5512,6 +5512,16 @@ static int parse_command_line(rdpSettings* settings, const COMMAND_LINE_ARGUMENT
 			if (!freerdp_settings_set_bool(settings, FreeRDP_AsyncChannels, enable))
 				return fail_at(arg, COMMAND_LINE_ERROR);
 		}
+		CommandLineSwitchCase(arg, "codec-threads")
+		{
+			UINT32 flags = freerdp_settings_get_uint32(settings, FreeRDP_ThreadingFlags);
+			if (enable)
+				flags |= THREADING_FLAGS_ALLOW_CODEC_THREADS;
+			else
+				flags &= ~THREADING_FLAGS_ALLOW_CODEC_THREADS;
+			if (!freerdp_settings_set_uint32(settings, FreeRDP_ThreadingFlags, flags))
+				return fail_at(arg, COMMAND_LINE_ERROR);
+		}
 		CommandLineSwitchCase(arg, "wm-class")
 		{
 			if (!freerdp_settings_set_string(settings, FreeRDP_WmClass, arg->Value))
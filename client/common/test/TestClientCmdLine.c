@@ -107,6 +107,19 @@ static BOOL check_settings_smartcard_no_redirection(rdpSettings* settings)
 	return result;
 }
 
+static BOOL check_settings_codec_threads(rdpSettings* settings)
+{
+	const UINT32 flags = freerdp_settings_get_uint32(settings, FreeRDP_ThreadingFlags);
+
+	if ((flags & THREADING_FLAGS_ALLOW_CODEC_THREADS) == 0)
+	{
+		TEST_FAILURE("Expected THREADING_FLAGS_ALLOW_CODEC_THREADS in ThreadingFlags!\n");
+		return FALSE;
+	}
+
+	return check_settings_smartcard_no_redirection(settings);
+}
+
 typedef struct
 {
 	int expected_status;
@@ -205,6 +218,10 @@ static const test tests[] = {
 	  check_settings_smartcard_no_redirection,
 	  { "testfreerdp", "/sound", "/drive:media,/foo/bar/blabla", "/v:test.freerdp.com", nullptr },
 	  { WINPR_C_ARRAY_INIT } },
+	{ 0,
+	  check_settings_codec_threads,
+	  { "testfreerdp", "+codec-threads", "/v:test.freerdp.com", nullptr },
+	  { WINPR_C_ARRAY_INIT } },
 };
 // NOLINTEND(bugprone-suspicious-missing-comma)
 
@@ -76,6 +76,12 @@ extern "C"
 		BYTE* data;
 	} PERSISTENT_CACHE_ENTRY;
 
+/** @brief Set by the writer on entries that were used during the session. Version 4 caches
+ *  rank such entries higher so they are offered first on the next connection.
+ *  @since version 3.31.0
+ */
+#define PERSISTENT_CACHE_ENTRY_FLAG_USED 0x00000001
+
 	WINPR_ATTR_NODISCARD
 	FREERDP_API int persistent_cache_get_version(rdpPersistentCache* persistent);
 
@@ -90,6 +96,22 @@ extern "C"
 	FREERDP_API int persistent_cache_write_entry(rdpPersistentCache* persistent,
 	                                             const PERSISTENT_CACHE_ENTRY* entry);
 
+	/** @brief Look up an entry of a version 4 cache opened for reading by its key.
+	 *
+	 *  The entry data points into the mapped cache file and stays valid until the cache is
+	 *  closed.
+	 *
+	 *  @param persistent The cache to search
+	 *  @param key64 The key of the bitmap to look up
+	 *  @param entry Receives the entry
+	 *
+	 *  @return 1 if found, 0 if not found, -1 if the cache does not support lookups
+	 *  @since version 3.31.0
+	 */
+	WINPR_ATTR_NODISCARD
+	FREERDP_API int persistent_cache_find_entry(rdpPersistentCache* persistent, UINT64 key64,
+	                                            PERSISTENT_CACHE_ENTRY* entry);
+
 	WINPR_ATTR_NODISCARD
 	FREERDP_API int persistent_cache_open(rdpPersistentCache* persistent, const char* filename,
 	                                      BOOL write, UINT32 version);
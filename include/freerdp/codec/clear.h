@@ -100,6 +100,18 @@ extern "C"
 	WINPR_ATTR_MALLOC(clear_context_free, 1)
 	FREERDP_API CLEAR_CONTEXT* clear_context_new(BOOL Compressor);
 
+	/** @brief allocate a clear codec context
+	 *
+	 *  @param Compressor Allocate for compression (set to \b TRUE ) or decompression
+	 *  @param ThreadingFlags Threading flags, see \b FreeRDP_ThreadingFlags. Non overlapping
+	 *                        subcodec rectangles are decoded on the thread pool if
+	 *                        \b THREADING_FLAGS_ALLOW_CODEC_THREADS is set.
+	 *  @return An allocated context or \b nullptr in case of an error
+	 *  @since version 3.31.0
+	 */
+	WINPR_ATTR_MALLOC(clear_context_free, 1)
+	FREERDP_API CLEAR_CONTEXT* clear_context_new_ex(BOOL Compressor, UINT32 ThreadingFlags);
+
 #ifdef __cplusplus
 }
 #endif
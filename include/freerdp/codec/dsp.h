@@ -54,6 +54,17 @@ extern "C"
 	                                    const BYTE* WINPR_RESTRICT data, size_t length,
 	                                    wStream* WINPR_RESTRICT out);
 
+	/** @brief Decodes \b frames frames of concealment audio in place of a lost or late packet.
+	 *
+	 *  Only formats whose decoder implements packet loss concealment (Opus) are supported.
+	 *
+	 *  @return TRUE if concealment audio was written to \b out
+	 *  @since version 3.31.0 */
+	WINPR_ATTR_NODISCARD
+	FREERDP_API BOOL freerdp_dsp_decode_lost(FREERDP_DSP_CONTEXT* WINPR_RESTRICT context,
+	                                         const AUDIO_FORMAT* WINPR_RESTRICT srcFormat,
+	                                         size_t frames, wStream* WINPR_RESTRICT out);
+
 	WINPR_ATTR_NODISCARD
 	FREERDP_API BOOL freerdp_dsp_context_reset(FREERDP_DSP_CONTEXT* WINPR_RESTRICT context,
 	                                           const AUDIO_FORMAT* WINPR_RESTRICT targetFormat,
@@ -63,6 +63,8 @@ extern "C"
 		H264_CONTEXT_OPTION_USAGETYPE, /** @since version 3.6.0 */
 		H264_CONTEXT_OPTION_HW_ACCEL,  /** set to request hw accel, get to check if hw accel is on,
 		                                  @since version 3.11.0 */
+		H264_CONTEXT_OPTION_SLICES, /** number of slices encoded in parallel per frame, 0 (the
+		                               default) encodes a single slice, @since version 3.31.0 */
 	} H264_CONTEXT_OPTION;
 
 	FREERDP_API void free_h264_metablock(RDPGFX_H264_METABLOCK* meta);
@@ -59,6 +59,24 @@ extern "C"
 	FREERDP_API BITMAP_PLANAR_CONTEXT* freerdp_bitmap_planar_context_new(DWORD flags, UINT32 width,
 	                                                                     UINT32 height);
 
+	/** @brief Create a new planar codec context
+	 *
+	 *  @param flags The planar flags (compressor options)
+	 *  @param width The maximum width of images handled
+	 *  @param height The maximum height of images handled
+	 *  @param ThreadingFlags Threading flags, see \b FreeRDP_ThreadingFlags. Large images are
+	 *                        decoded on the thread pool if \b THREADING_FLAGS_ALLOW_CODEC_THREADS
+	 *                        is set.
+	 *
+	 *  @return A new context or \b nullptr
+	 *  @since version 3.31.0
+	 */
+	WINPR_ATTR_MALLOC(freerdp_bitmap_planar_context_free, 1)
+	WINPR_ATTR_NODISCARD
+	FREERDP_API BITMAP_PLANAR_CONTEXT*
+	freerdp_bitmap_planar_context_new_ex(DWORD flags, UINT32 width, UINT32 height,
+	                                     UINT32 ThreadingFlags);
+
 	FREERDP_API void freerdp_planar_switch_bgr(BITMAP_PLANAR_CONTEXT* WINPR_RESTRICT planar,
 	                                           BOOL bgr);
 	FREERDP_API void freerdp_planar_topdown_image(BITMAP_PLANAR_CONTEXT* WINPR_RESTRICT planar,
@@ -91,6 +91,20 @@ extern "C"
 	    PROGRESSIVE_CONTEXT* WINPR_RESTRICT progressive, wStream* WINPR_RESTRICT s,
 	    const RFX_MESSAGE* WINPR_RESTRICT msg);
 
+	/** Replace the quantization values used by the encoder.
+	 *  Forward wrapper for \link rfx_context_set_quantization
+	 *  @param progressive The progressive codec context
+	 *  @param quantVals 10 quantization values, each in the range 6 to 15
+	 *  @param count The number of values in \b quantVals
+	 *
+	 *  @since version 3.31.0
+	 *  @return \b TRUE in case of success, \b FALSE for any error
+	 */
+	WINPR_ATTR_NODISCARD
+	FREERDP_API BOOL
+	progressive_context_set_quantization(PROGRESSIVE_CONTEXT* WINPR_RESTRICT progressive,
+	                                     const UINT32* WINPR_RESTRICT quantVals, size_t count);
+
 #ifdef __cplusplus
 }
 #endif
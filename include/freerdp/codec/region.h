@@ -40,6 +40,11 @@ extern "C"
 		REGION16_DATA* data;
 	} REGION16;
 
+	/** @brief scratch memory of the batch region operations
+	 *  @since version 3.31.0
+	 */
+	typedef struct S_REGION16_SCRATCH REGION16_SCRATCH;
+
 	/** computes if two rectangles are equal
 	 * @param r1 first rectangle
 	 * @param r2 second rectangle
@@ -177,6 +182,89 @@ extern "C"
 	FREERDP_API BOOL region16_intersect_rect(REGION16* dst, const REGION16* src,
 	                                         const RECTANGLE_16* rect);
 
+	/** releases the scratch memory of the batch region operations
+	 * @param scratch the scratch memory to free, may be nullptr
+	 * @since version 3.31.0
+	 */
+	FREERDP_API void region16_scratch_free(REGION16_SCRATCH* scratch);
+
+	/** allocates scratch memory for the batch region operations
+	 *
+	 * The memory grows to the largest operation it is used for and is kept until
+	 * \ref region16_scratch_free, so operations repeated every frame do not allocate.
+	 * A scratch must not be used by two threads at the same time.
+	 *
+	 * @return the new scratch memory or nullptr on failure
+	 * @since version 3.31.0
+	 */
+	WINPR_ATTR_MALLOC(region16_scratch_free, 1)
+	WINPR_ATTR_NODISCARD
+	FREERDP_API REGION16_SCRATCH* region16_scratch_new(void);
+
+	/** adds a set of rectangles to src and stores the resulting region in dst
+	 *
+	 * All rectangles are merged in a single pass, which is a lot cheaper than
+	 * calling \ref region16_union_rect in a loop for large sets.
+	 *
+	 * @param dst destination region
+	 * @param src source region, may be the same as dst
+	 * @param rects the rectangles to add, empty rectangles are ignored
+	 * @param count the number of rectangles in \ref rects
+	 * @param scratch scratch memory to use, nullptr to allocate it for this call
+	 * @return if the operation was successful (false meaning out-of-memory)
+	 * @since version 3.31.0
+	 */
+	WINPR_ATTR_NODISCARD
+	FREERDP_API BOOL region16_union_rects(REGION16* dst, const REGION16* src,
+	                                      const RECTANGLE_16* rects, size_t count,
+	                                      REGION16_SCRATCH* scratch);
+
+	/** adds a set of rectangles to src with tile granularity
+	 *
+	 * Every tile of a tileSize grid that is touched by one of the rectangles is
+	 * added entirely. The rectangles are marked in a tile bitmap, so the cost is
+	 * linear in the number of rectangles and of tiles they cover instead of the
+	 * exact union of \ref region16_union_rects. Use it for dense damage made of
+	 * many small rectangles when the consumer works on tiles anyway.
+	 *
+	 * @param dst destination region
+	 * @param src source region, may be the same as dst
+	 * @param rects the rectangles to add, empty rectangles are ignored
+	 * @param count the number of rectangles in \ref rects
+	 * @param tileSize the width and height of a tile, at least 8
+	 * @param scratch scratch memory to use, nullptr to allocate it for this call
+	 * @return if the operation was successful (false meaning out-of-memory or invalid tileSize)
+	 * @since version 3.31.0
+	 */
+	WINPR_ATTR_NODISCARD
+	FREERDP_API BOOL region16_union_rects_tiled(REGION16* dst, const REGION16* src,
+	                                            const RECTANGLE_16* rects, size_t count,
+	                                            UINT16 tileSize, REGION16_SCRATCH* scratch);
+
+	/** computes the intersection of two regions
+	 * @param dst destination region, may be the same as one of the sources
+	 * @param src1 the first region
+	 * @param src2 the second region
+	 * @param scratch scratch memory to use, nullptr to allocate it for this call
+	 * @return if the operation was successful (false meaning out-of-memory)
+	 * @since version 3.31.0
+	 */
+	WINPR_ATTR_NODISCARD
+	FREERDP_API BOOL region16_intersect_region(REGION16* dst, const REGION16* src1,
+	                                           const REGION16* src2, REGION16_SCRATCH* scratch);
+
+	/** removes the area covered by src2 from src1 and stores the result in dst
+	 * @param dst destination region, may be the same as one of the sources
+	 * @param src1 the region to subtract from
+	 * @param src2 the region to subtract
+	 * @param scratch scratch memory to use, nullptr to allocate it for this call
+	 * @return if the operation was successful (false meaning out-of-memory)
+	 * @since version 3.31.0
+	 */
+	WINPR_ATTR_NODISCARD
+	FREERDP_API BOOL region16_subtract(REGION16* dst, const REGION16* src1, const REGION16* src2,
+	                                   REGION16_SCRATCH* scratch);
+
 	/** release internal data associated with this region
 	 * @param region the region to release
 	 */
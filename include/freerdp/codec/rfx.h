@@ -194,6 +194,23 @@ extern "C"
 	WINPR_ATTR_NODISCARD
 	FREERDP_API UINT32 rfx_context_get_frame_idx(const RFX_CONTEXT* WINPR_RESTRICT context);
 
+	/** Replace the quantization values used by the encoder.
+	 *
+	 *  Higher values trade image quality for a smaller encoding.
+	 *
+	 *  @param context The RFX encoder context
+	 *  @param quantVals 10 quantization values (LL3, LH3, HL3, HH3, LH2, HL2, HH2, LH1, HL1,
+	 *  HH1), each in the range 6 to 15
+	 *  @param count The number of values in \b quantVals
+	 *
+	 *  @since version 3.31.0
+	 *  @return \b TRUE in case of success, \b FALSE for invalid values or allocation failure
+	 */
+	WINPR_ATTR_NODISCARD
+	FREERDP_API BOOL rfx_context_set_quantization(RFX_CONTEXT* WINPR_RESTRICT context,
+	                                              const UINT32* WINPR_RESTRICT quantVals,
+	                                              size_t count);
+
 	/** Write a RFX message as simple progressive message to a stream.
 	 *
 	 *  @param rfx The RFX codec context
@@ -905,6 +905,33 @@ owned by rdpRdp */
 	WINPR_ATTR_NODISCARD
 	FREERDP_API BOOL freerdp_is_active_state(const rdpContext* context);
 
+	/** @brief A \b CONNECTION_STATE change recorded in the connection timeline
+	 *  @since version 3.31.0
+	 */
+	typedef struct
+	{
+		CONNECTION_STATE state; /**< The state entered */
+		UINT64 timestamp;       /**< Nanoseconds since the connection attempt started */
+	} FREERDP_CONNECTION_TIMELINE_ENTRY;
+
+	/** \brief Get the connection timeline of the context.
+	 *
+	 * Every state change of the connection sequence is recorded with a timestamp, starting
+	 * with \b freerdp_connect (client) or the accepted connection (server). Reconnects and
+	 * redirections continue the timeline of the connection attempt.
+	 *
+	 *  \param context A pointer to the context to query
+	 *  \param entries An array receiving the recorded state changes, may be \b nullptr
+	 *  \param count The number of entries available in \b entries
+	 *
+	 *  \return The number of recorded state changes, may be larger than \b count
+	 *  \since version 3.31.0
+	 */
+	WINPR_ATTR_NODISCARD
+	FREERDP_API size_t freerdp_get_connection_timeline(const rdpContext* context,
+	                                                   FREERDP_CONNECTION_TIMELINE_ENTRY* entries,
+	                                                   size_t count);
+
 	WINPR_ATTR_NODISCARD
 	FREERDP_API BOOL freerdp_channels_from_mcs(rdpSettings* settings, const rdpContext* context);
 
@@ -489,6 +489,9 @@ extern "C"
 	};
 	typedef struct gdi_glyph gdiGlyph;
 
+	typedef struct gdi_bitmap_decoders gdiBitmapDecoders;
+	typedef struct gdi_gfx_cache_arena gdiGfxCacheArena;
+
 	struct rdp_gdi
 	{
 		rdpContext* context;
@@ -520,6 +523,9 @@ extern "C"
 		GeometryClientContext* geometry;
 
 		wLog* log;
+		gdiBitmapDecoders* bitmapDecoders;  /**< @since version 3.31.0 */
+		gdiGfxCacheArena* gfxCacheArena;    /**< @since version 3.31.0 */
+		REGION16_SCRATCH* gfxRegionScratch; /**< @since version 3.31.0 */
 	};
 	typedef struct rdp_gdi rdpGdi;
 
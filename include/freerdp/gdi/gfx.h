@@ -68,6 +68,19 @@ extern "C"
 	};
 	typedef struct gdi_gfx_cache_entry gdiGfxCacheEntry;
 
+	/** @brief Occupancy of the GFX cache slot allocator
+	 *  @since version 3.31.0
+	 */
+	typedef struct
+	{
+		size_t liveEntries;   /**< cache entries in use */
+		size_t liveBytes;     /**< pixel memory held by the entries in use */
+		size_t pooledEntries; /**< released entries kept for reuse */
+		size_t pooledBytes;   /**< pixel memory held by the released entries */
+		UINT64 allocations;   /**< entries allocated from the system */
+		UINT64 reuses;        /**< entries served from the pool */
+	} gdiGfxCacheStats;
+
 	FREERDP_API BOOL gdi_graphics_pipeline_init(rdpGdi* gdi, RdpgfxClientContext* gfx);
 
 	FREERDP_API BOOL gdi_graphics_pipeline_init_ex(rdpGdi* gdi, RdpgfxClientContext* gfx,
@@ -76,6 +89,17 @@ extern "C"
 	                                               pcRdpgfxUpdateSurfaceArea update);
 	FREERDP_API void gdi_graphics_pipeline_uninit(rdpGdi* gdi, RdpgfxClientContext* gfx);
 
+	/** @brief Get the occupancy of the GFX cache slot allocator
+	 *
+	 *  @param gdi The gdi the graphics pipeline was initialized with
+	 *  @param stats Receives the statistics
+	 *
+	 *  @return \b TRUE for success, \b FALSE if the pipeline is not initialized
+	 *  @since version 3.31.0
+	 */
+	WINPR_ATTR_NODISCARD
+	FREERDP_API BOOL gdi_graphics_pipeline_get_cache_stats(rdpGdi* gdi, gdiGfxCacheStats* stats);
+
 #ifdef __cplusplus
 }
 #endif
@@ -50,6 +50,130 @@ extern "C"
 	WINPR_ATTR_NODISCARD
 	FREERDP_API rdpMetrics* metrics_new(rdpContext* context);
 
+	/** @brief Hot path metrics tracked per connection.
+	 *
+	 *  Times are recorded in nanoseconds and exported in seconds.
+	 *  @since version 3.31.0
+	 */
+	typedef enum
+	{
+		FREERDP_METRIC_PDU_DISPATCH_TIME,            /**< histogram, label: data PDU type */
+		FREERDP_METRIC_FASTPATH_UPDATE_TIME,         /**< histogram, label: fastpath update code */
+		FREERDP_METRIC_CODEC_DECODE_TIME,            /**< histogram, label: RDPGFX codec id */
+		FREERDP_METRIC_CODEC_DECODE_BYTES,           /**< counter, label: RDPGFX codec id */
+		FREERDP_METRIC_CODEC_ENCODE_TIME,            /**< histogram, label: RDPGFX codec id */
+		FREERDP_METRIC_CODEC_ENCODE_BYTES,           /**< counter, label: RDPGFX codec id */
+		FREERDP_METRIC_TRANSPORT_READ_BYTES,         /**< counter */
+		FREERDP_METRIC_TRANSPORT_WRITE_BYTES,        /**< counter */
+		FREERDP_METRIC_TRANSPORT_WRITE_BLOCKED_TIME, /**< histogram */
+		FREERDP_METRIC_FRAME_ACK_TIME,               /**< histogram, frame round trip */
+		FREERDP_METRIC_FRAME_QUEUE_DEPTH,            /**< histogram, in frames */
+		FREERDP_METRIC_TLS_HANDSHAKE_TIME,           /**< histogram, label: session resumption */
+		FREERDP_METRIC_CONNECT_STATE_TIME,           /**< histogram, label: CONNECTION_STATE */
+		FREERDP_METRIC_COUNT
+	} FreeRDP_MetricId;
+
+	/** @brief The number of distinct labels supported per metric, labels must be smaller
+	 *  @since version 3.31.0
+	 */
+#define FREERDP_METRICS_MAX_LABELS 64
+
+	/** @brief A snapshot of a histogram
+	 *  @since version 3.31.0
+	 */
+	typedef struct
+	{
+		UINT64 count; /**< number of recorded values */
+		UINT64 sum;   /**< sum of all recorded values */
+		UINT64 max;   /**< largest recorded value */
+		UINT64 p50;   /**< median, upper bound of the bucket */
+		UINT64 p90;   /**< 90th percentile, upper bound of the bucket */
+		UINT64 p99;   /**< 99th percentile, upper bound of the bucket */
+	} FREERDP_METRICS_HISTOGRAM;
+
+	/** @brief Add a value to a counter metric. Lock free, may be called from any thread.
+	 *
+	 *  @param metrics The metrics of the connection, may be \b nullptr
+	 *  @param id The metric to update, must be a counter
+	 *  @param label The label (e.g. PDU type) the value belongs to, use \b 0 if the metric has none
+	 *  @param value The value to add
+	 *
+	 *  @return \b TRUE for success, \b FALSE if the arguments are invalid
+	 *  @since version 3.31.0
+	 */
+	FREERDP_API BOOL freerdp_metrics_add(rdpMetrics* metrics, FreeRDP_MetricId id, UINT32 label,
+	                                     UINT64 value);
+
+	/** @brief Record a value in a histogram metric. Lock free, may be called from any thread.
+	 *
+	 *  @param metrics The metrics of the connection, may be \b nullptr
+	 *  @param id The metric to update, must be a histogram
+	 *  @param label The label (e.g. PDU type) the value belongs to, use \b 0 if the metric has none
+	 *  @param value The value to record, times in nanoseconds
+	 *
+	 *  @return \b TRUE for success, \b FALSE if the arguments are invalid or out of memory
+	 *  @since version 3.31.0
+	 */
+	FREERDP_API BOOL freerdp_metrics_record(rdpMetrics* metrics, FreeRDP_MetricId id, UINT32 label,
+	                                        UINT64 value);
+
+	/** @brief Record the time elapsed since \b start in a histogram metric
+	 *
+	 *  @param metrics The metrics of the connection, may be \b nullptr
+	 *  @param id The metric to update, must be a histogram
+	 *  @param label The label the value belongs to
+	 *  @param start A timestamp obtained with \b winpr_GetTickCount64NS
+	 *
+	 *  @return \b TRUE for success, \b FALSE otherwise
+	 *  @since version 3.31.0
+	 */
+	FREERDP_API BOOL freerdp_metrics_record_since(rdpMetrics* metrics, FreeRDP_MetricId id,
+	                                              UINT32 label, UINT64 start);
+
+	/** @brief Get the current value of a counter metric
+	 *
+	 *  @return The counter value or \b 0 if the arguments are invalid
+	 *  @since version 3.31.0
+	 */
+	WINPR_ATTR_NODISCARD
+	FREERDP_API UINT64 freerdp_metrics_get_counter(const rdpMetrics* metrics, FreeRDP_MetricId id,
+	                                               UINT32 label);
+
+	/** @brief Get a snapshot of a histogram metric
+	 *
+	 *  @param metrics The metrics of the connection
+	 *  @param id The metric to query, must be a histogram
+	 *  @param label The label to query
+	 *  @param histogram A pointer to the snapshot to fill
+	 *
+	 *  @return \b TRUE for success, \b FALSE if the arguments are invalid
+	 *  @since version 3.31.0
+	 */
+	WINPR_ATTR_NODISCARD
+	FREERDP_API BOOL freerdp_metrics_get_histogram(const rdpMetrics* metrics, FreeRDP_MetricId id,
+	                                               UINT32 label,
+	                                               FREERDP_METRICS_HISTOGRAM* histogram);
+
+	/** @brief Export metrics in OpenMetrics (Prometheus) text format
+	 *
+	 *  The metrics of multiple connections can be exported into a single document. Each
+	 *  connection can be distinguished by an additional label set, e.g. \b "client=\"1\"".
+	 *
+	 *  @param metrics An array of \b count metrics
+	 *  @param labels An optional array of \b count label sets, may be \b nullptr, entries may
+	 *                be \b nullptr
+	 *  @param count The number of entries in \b metrics and \b labels
+	 *  @param plength Optional pointer receiving the length of the text (without \b '\\0')
+	 *
+	 *  @return A '\\0' terminated string to be freed with \b free or \b nullptr on failure
+	 *  @since version 3.31.0
+	 */
+	WINPR_ATTR_MALLOC(free, 1)
+	WINPR_ATTR_NODISCARD
+	FREERDP_API char* freerdp_metrics_to_openmetrics(const rdpMetrics* const* metrics,
+	                                                 const char* const* labels, size_t count,
+	                                                 size_t* plength);
+
 #ifdef __cplusplus
 }
 #endif
@@ -113,7 +113,13 @@ extern "C"
 		WINPR_ATTR_NODISCARD proxyFilterFn DynChannelToIntercept;    /* 138 */
 		WINPR_ATTR_NODISCARD proxyFilterFn DynChannelIntercept;      /* 139 */
 		WINPR_ATTR_NODISCARD proxyFilterFn StaticChannelToIntercept; /* 140 */
-		UINT64 reserved5[160 - 141];            /* 141-159 */
+
+		/* Header of a fast-path update forwarded with CompressedPassthrough. Returning FALSE
+		 * makes the proxy decode and re-encode the update instead.
+		 * @since version 3.31.0
+		 */
+		WINPR_ATTR_NODISCARD proxyFilterFn FastPathUpdate; /* 141 */
+		UINT64 reserved5[160 - 142];                       /* 142-159 */
 
 		/* Runtime data fields */
 		proxyPluginsManager* mgr; /* 160 */ /** Set during plugin registration */
@@ -236,6 +242,14 @@ typedef struct dyn_channel_to_intercept_data
 	BOOL intercept;
 } proxyChannelToInterceptData;
 
+typedef struct fastpath_update_info
+{
+	BYTE updateCode;       /* FASTPATH_UPDATETYPE_* */
+	BYTE fragmentation;    /* FASTPATH_FRAGMENT_SINGLE or FASTPATH_FRAGMENT_FIRST */
+	BYTE compressionFlags; /* bulk compression type and flags */
+	size_t length;         /* compressed length of this fragment */
+} proxyFastPathUpdateInfo;
+
 #define WINPR_PACK_POP
 #include <winpr/pack.h>
 
@@ -141,6 +141,7 @@ extern "C"
 		UINT32 resizeHeight;
 		BOOL areGfxCapsReady; /** @since version 3.3.0 */
 		RDPGFX_CAPSET confirmedCaps; /** @since version 3.25.0 */
+		REGION16_SCRATCH* regionScratch; /** @since version 3.31.0 */
 	};
 
 	struct rdp_shadow_server
@@ -187,6 +188,8 @@ extern "C"
 #else
 	    UINT32 reservedAV1[2];
 #endif
+		char* MetricsFile;      /** @since version 3.31.0 */
+		UINT32 MetricsInterval; /** @since version 3.31.0, seconds */
 	};
 
 	struct rdp_shadow_surface
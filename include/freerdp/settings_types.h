@@ -513,6 +513,11 @@ extern "C"
 
 /* ThreadingFlags */
 #define THREADING_FLAGS_DISABLE_THREADS 0x00000001
+/** Allow codecs (planar, ClearCodec) to split a single image across the thread pool.
+ *  Ignored if THREADING_FLAGS_DISABLE_THREADS is set.
+ *  @since version 3.31.0
+ */
+#define THREADING_FLAGS_ALLOW_CODEC_THREADS 0x00000002
 
 	enum rdp_settings_type
 	{
@@ -163,6 +163,28 @@ extern "C"
 		SURFACE_BITS_COMMAND* commands;
 	} SURFACE_FRAME;
 
+	/** @since version 3.31.0 */
+	enum FASTPATH_FRAGMENT
+	{
+		FASTPATH_FRAGMENT_SINGLE = 0x0,
+		FASTPATH_FRAGMENT_LAST = 0x1,
+		FASTPATH_FRAGMENT_FIRST = 0x2,
+		FASTPATH_FRAGMENT_NEXT = 0x3
+	};
+
+	/** @brief A single fast-path update as found on the wire, before bulk decompression
+	 *  and reassembly.
+	 *  @since version 3.31.0
+	 */
+	typedef struct
+	{
+		BYTE updateCode;       /**< FASTPATH_UPDATETYPE_* */
+		BYTE fragmentation;    /**< FASTPATH_FRAGMENT_* */
+		BYTE compressionFlags; /**< bulk compression type and flags, 0 if uncompressed */
+		const BYTE* data;      /**< the (possibly compressed) update data */
+		size_t length;
+	} FASTPATH_RAW_UPDATE;
+
 	/* defined inside libfreerdp-core */
 	typedef struct rdp_update_proxy rdpUpdateProxy;
 
@@ -197,6 +219,10 @@ extern "C"
 	                                      UINT32 imeConvMode);
 	typedef BOOL (*pServerStatusInfo)(rdpContext* context, UINT32 status);
 
+	typedef BOOL (*pFastPathUpdateRaw)(rdpContext* context, const FASTPATH_RAW_UPDATE* update,
+	                                   BOOL* handled);
+	typedef BOOL (*pSlowPathCompressed)(rdpContext* context, BYTE pduType2);
+
 	struct rdp_update
 	{
 		rdpContext* context;     /* 0 */
@@ -237,12 +263,54 @@ extern "C"
 		 * fills BITMAP_DATA struct members: flags, cbCompMainBodySize and cbCompFirstRowSize.
 		 */
 		BOOL autoCalculateBitmapData; /* 71 */
-		UINT32 paddingE[80 - 72];     /* 72 */
+
+		/* Client side only: if set, every received fast-path update is handed to this callback
+		 * before it is parsed. Setting *handled to TRUE skips parsing of the update, bulk
+		 * decompression is still done to keep the compression history intact.
+		 * The decision must only change on FASTPATH_FRAGMENT_SINGLE or FASTPATH_FRAGMENT_FIRST.
+		 * @since version 3.31.0
+		 */
+		WINPR_ATTR_NODISCARD pFastPathUpdateRaw FastPathUpdateRaw; /* 72 */
+		/* Client side only: called while FastPathUpdateRaw is set and a bulk compressed
+		 * slow-path data PDU was received. Compressed data forwarded before no longer shares
+		 * its history with the data that follows.
+		 * @since version 3.31.0
+		 */
+		WINPR_ATTR_NODISCARD pSlowPathCompressed SlowPathCompressed; /* 73 */
+		UINT32 paddingE[80 - 74];                                    /* 74 */
 	};
 
 	FREERDP_API void rdp_update_lock(rdpUpdate* update);
 	FREERDP_API void rdp_update_unlock(rdpUpdate* update);
 
+	/** @brief Send a fast-path update received on another connection unmodified.
+	 *
+	 *  The update is neither decompressed nor recompressed. The caller must ensure both
+	 *  connections negotiated identical bulk compression and capabilities and should enable
+	 *  freerdp_update_set_compression_passthrough() while doing so.
+	 *
+	 *  @param context The (server side) context to send on. Must not be nullptr.
+	 *  @param update The update to forward. Must not be nullptr.
+	 *  @return \b TRUE for success, \b FALSE otherwise
+	 *  @since version 3.31.0
+	 */
+	WINPR_ATTR_NODISCARD
+	FREERDP_API BOOL freerdp_update_send_fastpath_raw(rdpContext* context,
+	                                                  const FASTPATH_RAW_UPDATE* update);
+
+	/** @brief Enable or disable bulk compression passthrough on a connection.
+	 *
+	 *  While enabled the connection sends its own updates uncompressed so that compressed
+	 *  updates forwarded with freerdp_update_send_fastpath_raw() keep a consistent history
+	 *  on the peer. Disabling flushes the history with the next compressed packet.
+	 *
+	 *  @param context The (server side) context. Must not be nullptr.
+	 *  @param enable \b TRUE to enable, \b FALSE to disable passthrough
+	 *  @return \b TRUE for success, \b FALSE otherwise
+	 *  @since version 3.31.0
+	 */
+	FREERDP_API BOOL freerdp_update_set_compression_passthrough(rdpContext* context, BOOL enable);
+
 	/** @brief Get the number of RDP codec stats indices in use.
 	 *
 	 *  @return The number of RDP codec stats indices that will return a value
@@ -19,15 +19,66 @@
 
 #include <freerdp/config.h>
 
+#include <stdlib.h>
+
 #include <winpr/crt.h>
+#include <winpr/file.h>
+#include <winpr/path.h>
 #include <winpr/stream.h>
 #include <winpr/assert.h>
+#include <winpr/string.h>
+
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 
 #include <freerdp/freerdp.h>
 #include <freerdp/constants.h>
 
 #include <freerdp/cache/persistent.h>
 
+/* Version 4 is an indexed format of our own:
+ *
+ * header (32 bytes):  signature, version, entry count, index offset, committed file size
+ * bitmap data:        32bpp pixel data, stored once per key64
+ * index (32 bytes):   key64, data offset, size, width, height and usage score per entry,
+ *                     sorted by descending score
+ *
+ * Saving appends new bitmaps and a new index behind the committed data and rewrites the
+ * header last, so an interrupted save leaves the previous index intact. Once more than half
+ * of the file is dead space, the cache is compacted into a new file that replaces the old one.
+ * Readers map the file and hand out pointers into the mapping, so bitmap data is only paged
+ * in when an entry is actually used.
+ *
+ * Several clients may share one cache file. A writer holds an exclusive lock on
+ * "<file>.lock" from reading the committed size until the new header (or the compacted file)
+ * is in place. Readers hold a shared lock while they map and parse the index. The lock lives
+ * in a separate file because compaction replaces the cache file itself.
+ */
+#define PERSIST_V4_HEADER_SIZE 32
+#define PERSIST_V4_INDEX_ENTRY_SIZE 32
+#define PERSIST_V4_MAX_ENTRIES 25600
+#define PERSIST_V4_HASH_SIZE 65536
+#define PERSIST_V4_USED_SCORE 16
+
+typedef struct
+{
+	UINT64 key64;
+	UINT64 offset;
+	UINT32 size;
+	UINT16 width;
+	UINT16 height;
+	UINT32 score;
+	BOOL carried;
+} PERSISTENT_CACHE_INDEX_ENTRY;
+
 struct rdp_persistent_cache
 {
 	FILE* fp;
@@ -37,10 +88,33 @@ struct rdp_persistent_cache
 	char* filename;
 	BYTE* bmpData;
 	size_t bmpSize;
+
+	/* version 4 */
+	BYTE* map;
+	size_t mapSize;
+	PERSISTENT_CACHE_INDEX_ENTRY* index;
+	size_t indexCount;
+	PERSISTENT_CACHE_INDEX_ENTRY** indexByKey;
+	size_t readPos;
+
+	char* tmpFilename;
+	BOOL incremental;
+	BOOL writeError;
+	UINT64 appendOffset;
+	PERSISTENT_CACHE_INDEX_ENTRY* entries;
+	size_t entryCount;
+	UINT32* entrySlots;
+
+#if defined(_WIN32)
+	HANDLE lock;
+#else
+	int lock;
+#endif
 };
 
 static const size_t PERSIST_ALIGN = 32;
 static const char sig_str[] = "RDP8bmp";
+static const char sig_str_v4[] = "FRDPbmi";
 
 int persistent_cache_get_version(rdpPersistentCache* persistent)
 {
@@ -215,12 +289,548 @@ static int persistent_cache_read_v3(rdpPersistentCache* persistent)
 	return 1;
 }
 
+static BOOL persistent_cache_map(rdpPersistentCache* persistent)
+{
+	WINPR_ASSERT(persistent);
+	WINPR_ASSERT(persistent->filename);
+
+#if defined(_WIN32)
+	BOOL rc = FALSE;
+	HANDLE mapping = nullptr;
+	LARGE_INTEGER size = WINPR_C_ARRAY_INIT;
+	WCHAR* wfilename = ConvertUtf8ToWCharAlloc(persistent->filename, nullptr);
+
+	if (!wfilename)
+		return FALSE;
+
+	HANDLE file = CreateFileW(wfilename, GENERIC_READ,
+	                          FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+	                          OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	free(wfilename);
+
+	if (file == INVALID_HANDLE_VALUE)
+		return FALSE;
+
+	if (!GetFileSizeEx(file, &size) || (size.QuadPart <= 0) ||
+	    ((UINT64)size.QuadPart > SIZE_MAX))
+		goto fail;
+
+	mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!mapping)
+		goto fail;
+
+	persistent->map = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!persistent->map)
+		goto fail;
+
+	persistent->mapSize = (size_t)size.QuadPart;
+	rc = TRUE;
+fail:
+	if (mapping)
+		(void)CloseHandle(mapping);
+	(void)CloseHandle(file);
+	return rc;
+#else
+	struct stat st = WINPR_C_ARRAY_INIT;
+	const int fd = open(persistent->filename, O_RDONLY | O_CLOEXEC);
+
+	if (fd < 0)
+		return FALSE;
+
+	if ((fstat(fd, &st) != 0) || (st.st_size <= 0) || ((UINT64)st.st_size > SIZE_MAX))
+	{
+		(void)close(fd);
+		return FALSE;
+	}
+
+	void* map = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	(void)close(fd);
+
+	if (map == MAP_FAILED)
+		return FALSE;
+
+	persistent->map = map;
+	persistent->mapSize = (size_t)st.st_size;
+	return TRUE;
+#endif
+}
+
+static void persistent_cache_unmap(rdpPersistentCache* persistent)
+{
+	WINPR_ASSERT(persistent);
+
+	if (!persistent->map)
+		return;
+
+#if defined(_WIN32)
+	(void)UnmapViewOfFile(persistent->map);
+#else
+	(void)munmap(persistent->map, persistent->mapSize);
+#endif
+	persistent->map = nullptr;
+	persistent->mapSize = 0;
+}
+
+static BOOL persistent_cache_lock(rdpPersistentCache* persistent, BOOL exclusive)
+{
+	WINPR_ASSERT(persistent);
+	WINPR_ASSERT(persistent->filename);
+
+	const size_t len = strlen(persistent->filename) + 6;
+	char* name = calloc(len, sizeof(char));
+	if (!name)
+		return FALSE;
+	(void)_snprintf(name, len, "%s.lock", persistent->filename);
+
+#if defined(_WIN32)
+	WINPR_ASSERT(persistent->lock == INVALID_HANDLE_VALUE);
+
+	OVERLAPPED overlapped = WINPR_C_ARRAY_INIT;
+	WCHAR* wname = ConvertUtf8ToWCharAlloc(name, nullptr);
+	free(name);
+	if (!wname)
+		return FALSE;
+
+	HANDLE lock = CreateFileW(wname, GENERIC_READ | GENERIC_WRITE,
+	                          FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+	                          OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	free(wname);
+	if (lock == INVALID_HANDLE_VALUE)
+		return FALSE;
+
+	if (!LockFileEx(lock, exclusive ? LOCKFILE_EXCLUSIVE_LOCK : 0, 0, MAXDWORD, MAXDWORD,
+	                &overlapped))
+	{
+		(void)CloseHandle(lock);
+		return FALSE;
+	}
+#else
+	WINPR_ASSERT(persistent->lock < 0);
+
+	const int lock = open(name, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+	free(name);
+	if (lock < 0)
+		return FALSE;
+
+	int rc = 0;
+	do
+	{
+		rc = flock(lock, exclusive ? LOCK_EX : LOCK_SH);
+	} while ((rc != 0) && (errno == EINTR));
+
+	if (rc != 0)
+	{
+		(void)close(lock);
+		return FALSE;
+	}
+#endif
+
+	persistent->lock = lock;
+	return TRUE;
+}
+
+static void persistent_cache_unlock(rdpPersistentCache* persistent)
+{
+	WINPR_ASSERT(persistent);
+
+	/* closing the handle releases the lock */
+#if defined(_WIN32)
+	if (persistent->lock != INVALID_HANDLE_VALUE)
+		(void)CloseHandle(persistent->lock);
+	persistent->lock = INVALID_HANDLE_VALUE;
+#else
+	if (persistent->lock >= 0)
+		(void)close(persistent->lock);
+	persistent->lock = -1;
+#endif
+}
+
+static int persistent_cache_compare_score(const void* pva, const void* pvb)
+{
+	const PERSISTENT_CACHE_INDEX_ENTRY* a = pva;
+	const PERSISTENT_CACHE_INDEX_ENTRY* b = pvb;
+
+	if (a->score != b->score)
+		return (a->score > b->score) ? -1 : 1;
+	if (a->key64 != b->key64)
+		return (a->key64 < b->key64) ? -1 : 1;
+	return 0;
+}
+
+static int persistent_cache_compare_key(const void* pva, const void* pvb)
+{
+	const PERSISTENT_CACHE_INDEX_ENTRY* a = pva;
+	const PERSISTENT_CACHE_INDEX_ENTRY* b = pvb;
+
+	if (a->key64 != b->key64)
+		return (a->key64 < b->key64) ? -1 : 1;
+	return 0;
+}
+
+static int persistent_cache_compare_key_ptr(const void* pva, const void* pvb)
+{
+	const PERSISTENT_CACHE_INDEX_ENTRY* const* a = pva;
+	const PERSISTENT_CACHE_INDEX_ENTRY* const* b = pvb;
+
+	return persistent_cache_compare_key(*a, *b);
+}
+
+/* Parses the header and index of a mapped version 4 file into persistent->index */
+static BOOL persistent_cache_parse_v4(rdpPersistentCache* persistent)
+{
+	WINPR_ASSERT(persistent);
+
+	const BYTE* map = persistent->map;
+	if (!map || (persistent->mapSize < PERSIST_V4_HEADER_SIZE))
+		return FALSE;
+
+	if (memcmp(map, sig_str_v4, sizeof(sig_str_v4)) != 0)
+		return FALSE;
+
+	const UINT32 version = winpr_Data_Get_UINT32(&map[8]);
+	const UINT32 count = winpr_Data_Get_UINT32(&map[12]);
+	const UINT64 indexOffset = winpr_Data_Get_UINT64(&map[16]);
+	const UINT64 fileSize = winpr_Data_Get_UINT64(&map[24]);
+
+	if ((version != 4) || (count > PERSIST_V4_MAX_ENTRIES) || (fileSize > persistent->mapSize))
+		return FALSE;
+
+	if ((indexOffset < PERSIST_V4_HEADER_SIZE) || (indexOffset > fileSize) ||
+	    ((fileSize - indexOffset) / PERSIST_V4_INDEX_ENTRY_SIZE < count))
+		return FALSE;
+
+	PERSISTENT_CACHE_INDEX_ENTRY* index =
+	    calloc(count + 1ull, sizeof(PERSISTENT_CACHE_INDEX_ENTRY));
+	if (!index)
+		return FALSE;
+
+	for (size_t x = 0; x < count; x++)
+	{
+		const BYTE* cur = &map[indexOffset + x * PERSIST_V4_INDEX_ENTRY_SIZE];
+		PERSISTENT_CACHE_INDEX_ENTRY* entry = &index[x];
+
+		entry->key64 = winpr_Data_Get_UINT64(&cur[0]);
+		entry->offset = winpr_Data_Get_UINT64(&cur[8]);
+		entry->size = winpr_Data_Get_UINT32(&cur[16]);
+		entry->width = winpr_Data_Get_UINT16(&cur[20]);
+		entry->height = winpr_Data_Get_UINT16(&cur[22]);
+		entry->score = winpr_Data_Get_UINT32(&cur[24]);
+
+		if ((entry->size == 0) || (entry->size != 4ull * entry->width * entry->height) ||
+		    (entry->offset < PERSIST_V4_HEADER_SIZE) || (entry->offset > indexOffset) ||
+		    (indexOffset - entry->offset < entry->size))
+		{
+			free(index);
+			return FALSE;
+		}
+	}
+
+	free(persistent->index);
+	persistent->index = index;
+	persistent->indexCount = count;
+	persistent->appendOffset = fileSize;
+	return TRUE;
+}
+
+static void persistent_cache_fill_entry(const rdpPersistentCache* persistent,
+                                        const PERSISTENT_CACHE_INDEX_ENTRY* cur,
+                                        PERSISTENT_CACHE_ENTRY* entry)
+{
+	entry->key64 = cur->key64;
+	entry->width = cur->width;
+	entry->height = cur->height;
+	entry->size = cur->size;
+	entry->flags = 0;
+	entry->data = &persistent->map[cur->offset];
+}
+
+static int persistent_cache_read_entry_v4(rdpPersistentCache* persistent,
+                                          PERSISTENT_CACHE_ENTRY* entry)
+{
+	WINPR_ASSERT(persistent);
+	WINPR_ASSERT(entry);
+
+	if (persistent->readPos >= persistent->indexCount)
+		return -1;
+
+	persistent_cache_fill_entry(persistent, &persistent->index[persistent->readPos++], entry);
+	return 1;
+}
+
+static size_t persistent_cache_hash_key(UINT64 key64)
+{
+	return (size_t)((key64 * 0x9E3779B97F4A7C15ull) >> 48) & (PERSIST_V4_HASH_SIZE - 1);
+}
+
+static PERSISTENT_CACHE_INDEX_ENTRY* persistent_cache_find_written(rdpPersistentCache* persistent,
+                                                                  UINT64 key64)
+{
+	WINPR_ASSERT(persistent);
+	WINPR_ASSERT(persistent->entrySlots);
+
+	for (size_t pos = persistent_cache_hash_key(key64);; pos = (pos + 1) % PERSIST_V4_HASH_SIZE)
+	{
+		const UINT32 idx = persistent->entrySlots[pos];
+
+		if (idx == 0)
+			return nullptr;
+		if (persistent->entries[idx - 1].key64 == key64)
+			return &persistent->entries[idx - 1];
+	}
+}
+
+static BOOL persistent_cache_add_written(rdpPersistentCache* persistent,
+                                         const PERSISTENT_CACHE_INDEX_ENTRY* entry)
+{
+	WINPR_ASSERT(persistent);
+	WINPR_ASSERT(entry);
+
+	if (persistent->entryCount >= PERSIST_V4_MAX_ENTRIES)
+		return FALSE;
+
+	size_t pos = persistent_cache_hash_key(entry->key64);
+	while (persistent->entrySlots[pos] != 0)
+		pos = (pos + 1) % PERSIST_V4_HASH_SIZE;
+
+	persistent->entries[persistent->entryCount++] = *entry;
+	persistent->entrySlots[pos] = (UINT32)persistent->entryCount;
+	return TRUE;
+}
+
+static UINT32 persistent_cache_score(UINT32 previous, UINT32 bonus)
+{
+	/* Scores decay by a quarter on every save, so entries that stop being used age out */
+	const UINT32 score = previous - (previous / 4) - ((previous % 4) ? 1 : 0);
+
+	if (score > UINT32_MAX - bonus)
+		return UINT32_MAX;
+	return score + bonus;
+}
+
+static BOOL persistent_cache_append_v4(rdpPersistentCache* persistent, const BYTE* data,
+                                       UINT32 size, UINT64* offset)
+{
+	WINPR_ASSERT(persistent);
+	WINPR_ASSERT(data);
+	WINPR_ASSERT(offset);
+
+	if (fwrite(data, size, 1, persistent->fp) != 1)
+	{
+		persistent->writeError = TRUE;
+		return FALSE;
+	}
+
+	*offset = persistent->appendOffset;
+	persistent->appendOffset += size;
+	return TRUE;
+}
+
+static int persistent_cache_write_entry_v4(rdpPersistentCache* persistent,
+                                           const PERSISTENT_CACHE_ENTRY* entry)
+{
+	WINPR_ASSERT(persistent);
+	WINPR_ASSERT(entry);
+
+	const UINT32 bonus =
+	    (entry->flags & PERSISTENT_CACHE_ENTRY_FLAG_USED) ? PERSIST_V4_USED_SCORE : 1;
+
+	if ((entry->size == 0) || (entry->size != 4ull * entry->width * entry->height))
+		return -1;
+
+	/* Several cache slots may hold the same bitmap, store it only once */
+	PERSISTENT_CACHE_INDEX_ENTRY* written = persistent_cache_find_written(persistent, entry->key64);
+	if (written)
+	{
+		written->score = MAX(written->score, bonus);
+		return 1;
+	}
+
+	if (persistent->entryCount >= PERSIST_V4_MAX_ENTRIES)
+		return 1;
+
+	PERSISTENT_CACHE_INDEX_ENTRY record = { .key64 = entry->key64,
+		                                    .size = entry->size,
+		                                    .width = entry->width,
+		                                    .height = entry->height,
+		                                    .score = bonus };
+
+	const PERSISTENT_CACHE_INDEX_ENTRY key = { .key64 = entry->key64 };
+	PERSISTENT_CACHE_INDEX_ENTRY* previous =
+	    persistent->index ? bsearch(&key, persistent->index, persistent->indexCount,
+	                                sizeof(PERSISTENT_CACHE_INDEX_ENTRY),
+	                                persistent_cache_compare_key)
+	                      : nullptr;
+
+	if (previous && (previous->size == record.size))
+	{
+		previous->carried = TRUE;
+		record.score = persistent_cache_score(previous->score, bonus);
+
+		if (persistent->incremental)
+			record.offset = previous->offset;
+		else if (!persistent_cache_append_v4(persistent, &persistent->map[previous->offset],
+		                                     previous->size, &record.offset))
+			return -1;
+	}
+	else
+	{
+		if (!entry->data)
+			return -1;
+		if (!persistent_cache_append_v4(persistent, entry->data, entry->size, &record.offset))
+			return -1;
+	}
+
+	if (!persistent_cache_add_written(persistent, &record))
+		return -1;
+
+	persistent->count++;
+	return 1;
+}
+
+static BOOL persistent_cache_sync(FILE* fp)
+{
+	WINPR_ASSERT(fp);
+
+	if (fflush(fp) != 0)
+		return FALSE;
+
+#if defined(_WIN32)
+	return _commit(_fileno(fp)) == 0;
+#else
+	return fsync(fileno(fp)) == 0;
+#endif
+}
+
+static int persistent_cache_commit_v4(rdpPersistentCache* persistent)
+{
+	int status = -1;
+	wStream* s = nullptr;
+	BYTE header[PERSIST_V4_HEADER_SIZE] = WINPR_C_ARRAY_INIT;
+
+	WINPR_ASSERT(persistent);
+	WINPR_ASSERT(persistent->fp);
+
+	/* A failed write leaves the file position undefined, keep the previous index */
+	if (persistent->writeError)
+		goto fail;
+
+	/* Keep the best scored entries of the previous save that were not written this time */
+	qsort(persistent->index, persistent->indexCount, sizeof(PERSISTENT_CACHE_INDEX_ENTRY),
+	      persistent_cache_compare_score);
+	for (size_t x = 0; x < persistent->indexCount; x++)
+	{
+		PERSISTENT_CACHE_INDEX_ENTRY record = persistent->index[x];
+
+		if (persistent->entryCount >= PERSIST_V4_MAX_ENTRIES)
+			break;
+		if (record.carried || persistent_cache_find_written(persistent, record.key64))
+			continue;
+
+		record.score = persistent_cache_score(record.score, 0);
+		if (record.score == 0)
+			continue;
+
+		if (!persistent->incremental &&
+		    !persistent_cache_append_v4(persistent, &persistent->map[record.offset], record.size,
+		                                &record.offset))
+			goto fail;
+
+		if (!persistent_cache_add_written(persistent, &record))
+			goto fail;
+	}
+
+	qsort(persistent->entries, persistent->entryCount, sizeof(PERSISTENT_CACHE_INDEX_ENTRY),
+	      persistent_cache_compare_score);
+
+	s = Stream_New(nullptr, (persistent->entryCount + 1) * PERSIST_V4_INDEX_ENTRY_SIZE);
+	if (!s)
+		goto fail;
+
+	for (size_t x = 0; x < persistent->entryCount; x++)
+	{
+		const PERSISTENT_CACHE_INDEX_ENTRY* entry = &persistent->entries[x];
+
+		Stream_Write_UINT64(s, entry->key64);
+		Stream_Write_UINT64(s, entry->offset);
+		Stream_Write_UINT32(s, entry->size);
+		Stream_Write_UINT16(s, entry->width);
+		Stream_Write_UINT16(s, entry->height);
+		Stream_Write_UINT32(s, entry->score);
+		Stream_Write_UINT32(s, 0); /* reserved */
+	}
+
+	const UINT64 indexOffset = persistent->appendOffset;
+	const size_t indexSize = Stream_GetPosition(s);
+	if ((indexSize > 0) && (fwrite(Stream_Buffer(s), indexSize, 1, persistent->fp) != 1))
+		goto fail;
+	persistent->appendOffset += indexSize;
+
+	if (!persistent_cache_sync(persistent->fp))
+		goto fail;
+
+	/* The header is written last, it commits the new index */
+	memcpy(header, sig_str_v4, sizeof(sig_str_v4));
+	winpr_Data_Write_UINT32(&header[8], 4);
+	winpr_Data_Write_UINT32(&header[12], (UINT32)persistent->entryCount);
+	winpr_Data_Write_UINT64(&header[16], indexOffset);
+	winpr_Data_Write_UINT64(&header[24], persistent->appendOffset);
+
+	if ((_fseeki64(persistent->fp, 0, SEEK_SET) != 0) ||
+	    (fwrite(header, sizeof(header), 1, persistent->fp) != 1) ||
+	    !persistent_cache_sync(persistent->fp))
+		goto fail;
+
+	status = 1;
+fail:
+	Stream_Free(s, TRUE);
+	(void)fclose(persistent->fp);
+	persistent->fp = nullptr;
+	persistent_cache_unmap(persistent);
+
+	if (!persistent->incremental)
+	{
+		if ((status > 0) &&
+		    !winpr_MoveFileEx(persistent->tmpFilename, persistent->filename,
+		                      MOVEFILE_REPLACE_EXISTING))
+			status = -1;
+		if (status < 0)
+			(void)winpr_DeleteFile(persistent->tmpFilename);
+	}
+
+	persistent_cache_unlock(persistent);
+	return status;
+}
+
+int persistent_cache_find_entry(rdpPersistentCache* persistent, UINT64 key64,
+                                PERSISTENT_CACHE_ENTRY* entry)
+{
+	WINPR_ASSERT(persistent);
+	WINPR_ASSERT(entry);
+
+	if ((persistent->version != 4) || persistent->write || !persistent->indexByKey)
+		return -1;
+
+	const PERSISTENT_CACHE_INDEX_ENTRY key = { .key64 = key64 };
+	const PERSISTENT_CACHE_INDEX_ENTRY* pkey = &key;
+	PERSISTENT_CACHE_INDEX_ENTRY** found =
+	    bsearch(&pkey, persistent->indexByKey, persistent->indexCount,
+	            sizeof(PERSISTENT_CACHE_INDEX_ENTRY*), persistent_cache_compare_key_ptr);
+
+	if (!found)
+		return 0;
+
+	persistent_cache_fill_entry(persistent, *found, entry);
+	return 1;
+}
+
 int persistent_cache_read_entry(rdpPersistentCache* persistent, PERSISTENT_CACHE_ENTRY* entry)
 {
 	WINPR_ASSERT(persistent);
 	WINPR_ASSERT(entry);
 
-	if (persistent->version == 3)
+	if (persistent->version == 4)
+		return persistent_cache_read_entry_v4(persistent, entry);
+	else if (persistent->version == 3)
 		return persistent_cache_read_entry_v3(persistent, entry);
 	else if (persistent->version == 2)
 		return persistent_cache_read_entry_v2(persistent, entry);
@@ -234,7 +844,12 @@ int persistent_cache_write_entry(rdpPersistentCache* persistent,
 	WINPR_ASSERT(persistent);
 	WINPR_ASSERT(entry);
 
-	if (persistent->version == 3)
+	if (!persistent->write)
+		return -1;
+
+	if (persistent->version == 4)
+		return persistent_cache_write_entry_v4(persistent, entry);
+	else if (persistent->version == 3)
 		return persistent_cache_write_entry_v3(persistent, entry);
 	else if (persistent->version == 2)
 		return persistent_cache_write_entry_v2(persistent, entry);
@@ -242,6 +857,37 @@ int persistent_cache_write_entry(rdpPersistentCache* persistent,
 	return -1;
 }
 
+static int persistent_cache_open_read_v4(rdpPersistentCache* persistent)
+{
+	WINPR_ASSERT(persistent);
+
+	if (!persistent_cache_lock(persistent, FALSE))
+		return -1;
+
+	const BOOL mapped = persistent_cache_map(persistent) && persistent_cache_parse_v4(persistent);
+	persistent_cache_unlock(persistent);
+	if (!mapped)
+		return -1;
+
+	qsort(persistent->index, persistent->indexCount, sizeof(PERSISTENT_CACHE_INDEX_ENTRY),
+	      persistent_cache_compare_score);
+
+	persistent->indexByKey =
+	    calloc(persistent->indexCount + 1, sizeof(PERSISTENT_CACHE_INDEX_ENTRY*));
+	if (!persistent->indexByKey)
+		return -1;
+
+	for (size_t x = 0; x < persistent->indexCount; x++)
+		persistent->indexByKey[x] = &persistent->index[x];
+	qsort(persistent->indexByKey, persistent->indexCount, sizeof(PERSISTENT_CACHE_INDEX_ENTRY*),
+	      persistent_cache_compare_key_ptr);
+
+	persistent->version = 4;
+	persistent->count = (int)persistent->indexCount;
+	persistent->readPos = 0;
+	return 1;
+}
+
 static int persistent_cache_open_read(rdpPersistentCache* persistent)
 {
 	BYTE sig[8] = WINPR_C_ARRAY_INIT;
@@ -257,6 +903,13 @@ static int persistent_cache_open_read(rdpPersistentCache* persistent)
 	if (fread(sig, 8, 1, persistent->fp) != 1)
 		return -1;
 
+	if (memcmp(sig, sig_str_v4, sizeof(sig_str_v4)) == 0)
+	{
+		(void)fclose(persistent->fp);
+		persistent->fp = nullptr;
+		return persistent_cache_open_read_v4(persistent);
+	}
+
 	if (memcmp(sig, sig_str, sizeof(sig_str)) == 0)
 		persistent->version = 3;
 	else
@@ -285,10 +938,71 @@ static int persistent_cache_open_read(rdpPersistentCache* persistent)
 	return status;
 }
 
+static int persistent_cache_open_write_v4(rdpPersistentCache* persistent)
+{
+	BYTE header[PERSIST_V4_HEADER_SIZE] = WINPR_C_ARRAY_INIT;
+
+	WINPR_ASSERT(persistent);
+
+	const size_t len = strlen(persistent->filename) + 5;
+	persistent->tmpFilename = calloc(len, sizeof(char));
+	persistent->entries = calloc(PERSIST_V4_MAX_ENTRIES, sizeof(PERSISTENT_CACHE_INDEX_ENTRY));
+	persistent->entrySlots = calloc(PERSIST_V4_HASH_SIZE, sizeof(UINT32));
+	if (!persistent->tmpFilename || !persistent->entries || !persistent->entrySlots)
+		return -1;
+	(void)_snprintf(persistent->tmpFilename, len, "%s.tmp", persistent->filename);
+
+	/* Held until the new index is committed, see persistent_cache_commit_v4 */
+	if (!persistent_cache_lock(persistent, TRUE))
+		return -1;
+
+	/* Append to an intact version 4 cache unless more than half of it is dead space */
+	if (persistent_cache_map(persistent))
+	{
+		if (persistent_cache_parse_v4(persistent))
+		{
+			UINT64 live = PERSIST_V4_HEADER_SIZE +
+			              1ull * persistent->indexCount * PERSIST_V4_INDEX_ENTRY_SIZE;
+			for (size_t x = 0; x < persistent->indexCount; x++)
+				live += persistent->index[x].size;
+
+			persistent->incremental =
+			    (persistent->appendOffset <= live) || (persistent->appendOffset - live <= live);
+			qsort(persistent->index, persistent->indexCount, sizeof(PERSISTENT_CACHE_INDEX_ENTRY),
+			      persistent_cache_compare_key);
+		}
+		else
+			persistent_cache_unmap(persistent);
+	}
+
+	if (persistent->incremental)
+	{
+		persistent->fp = winpr_fopen(persistent->filename, "r+b");
+		if (!persistent->fp)
+			return -1;
+		if (_fseeki64(persistent->fp, (INT64)persistent->appendOffset, SEEK_SET) != 0)
+			return -1;
+		return 1;
+	}
+
+	persistent->fp = winpr_fopen(persistent->tmpFilename, "w+b");
+	if (!persistent->fp)
+		return -1;
+
+	if (fwrite(header, sizeof(header), 1, persistent->fp) != 1)
+		return -1;
+
+	persistent->appendOffset = sizeof(header);
+	return 1;
+}
+
 static int persistent_cache_open_write(rdpPersistentCache* persistent)
 {
 	WINPR_ASSERT(persistent);
 
+	if (persistent->version == 4)
+		return persistent_cache_open_write_v4(persistent);
+
 	persistent->fp = winpr_fopen(persistent->filename, "w+b");
 
 	if (!persistent->fp)
@@ -315,7 +1029,9 @@ int persistent_cache_open(rdpPersistentCache* persistent, const char* filename,
 	WINPR_ASSERT(persistent);
 	WINPR_ASSERT(filename);
 	persistent->write = write;
+	persistent->count = 0;
 
+	free(persistent->filename);
 	persistent->filename = _strdup(filename);
 
 	if (!persistent->filename)
@@ -333,14 +1049,39 @@ int persistent_cache_open(rdpPersistentCache* persistent, const char* filename,
 
 int persistent_cache_close(rdpPersistentCache* persistent)
 {
+	int status = 1;
+
 	WINPR_ASSERT(persistent);
+	if ((persistent->version == 4) && persistent->write && persistent->fp)
+		status = persistent_cache_commit_v4(persistent);
+
 	if (persistent->fp)
 	{
 		(void)fclose(persistent->fp);
 		persistent->fp = nullptr;
 	}
 
-	return 1;
+	persistent_cache_unmap(persistent);
+	persistent_cache_unlock(persistent);
+	free(persistent->indexByKey);
+	persistent->indexByKey = nullptr;
+	free(persistent->index);
+	persistent->index = nullptr;
+	persistent->indexCount = 0;
+	persistent->readPos = 0;
+
+	free(persistent->tmpFilename);
+	persistent->tmpFilename = nullptr;
+	free(persistent->entries);
+	persistent->entries = nullptr;
+	free(persistent->entrySlots);
+	persistent->entrySlots = nullptr;
+	persistent->entryCount = 0;
+	persistent->incremental = FALSE;
+	persistent->writeError = FALSE;
+	persistent->appendOffset = 0;
+
+	return status;
 }
 
 rdpPersistentCache* persistent_cache_new(void)
@@ -350,6 +1091,11 @@ rdpPersistentCache* persistent_cache_new(void)
 	if (!persistent)
 		return nullptr;
 
+#if defined(_WIN32)
+	persistent->lock = INVALID_HANDLE_VALUE;
+#else
+	persistent->lock = -1;
+#endif
 	persistent->bmpSize = 0x4000;
 	persistent->bmpData = winpr_aligned_calloc(1, persistent->bmpSize, PERSIST_ALIGN);
 
@@ -367,7 +1113,7 @@ void persistent_cache_free(rdpPersistentCache* persistent)
 	if (!persistent)
 		return;
 
-	persistent_cache_close(persistent);
+	(void)persistent_cache_close(persistent);
 
 	free(persistent->filename);
 
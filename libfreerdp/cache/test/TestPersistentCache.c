@@ -0,0 +1,420 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Persistent Bitmap Cache unit test
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+
+#include <winpr/crt.h>
+#include <winpr/file.h>
+#include <winpr/path.h>
+#include <winpr/sysinfo.h>
+#include <winpr/endian.h>
+
+#include <freerdp/cache/persistent.h>
+
+#define TEST_WIDTH 8
+#define TEST_HEIGHT 8
+#define TEST_SIZE (4 * TEST_WIDTH * TEST_HEIGHT)
+
+static BYTE test_pixel(UINT64 key64, size_t x)
+{
+	return (BYTE)((key64 * 31) + x);
+}
+
+static BOOL test_write(rdpPersistentCache* persistent, UINT64 key64, UINT32 flags)
+{
+	BYTE data[TEST_SIZE] = WINPR_C_ARRAY_INIT;
+	for (size_t x = 0; x < sizeof(data); x++)
+		data[x] = test_pixel(key64, x);
+
+	const PERSISTENT_CACHE_ENTRY entry = { .key64 = key64,
+		                                   .width = TEST_WIDTH,
+		                                   .height = TEST_HEIGHT,
+		                                   .size = TEST_SIZE,
+		                                   .flags = flags,
+		                                   .data = data };
+	return persistent_cache_write_entry(persistent, &entry) > 0;
+}
+
+static BOOL test_entry_valid(const PERSISTENT_CACHE_ENTRY* entry)
+{
+	if ((entry->width != TEST_WIDTH) || (entry->height != TEST_HEIGHT) ||
+	    (entry->size != TEST_SIZE) || !entry->data)
+		return FALSE;
+
+	for (size_t x = 0; x < entry->size; x++)
+	{
+		if (entry->data[x] != test_pixel(entry->key64, x))
+			return FALSE;
+	}
+	return TRUE;
+}
+
+/* Save the keys first to last in one session */
+static BOOL test_save(const char* file, UINT32 version, UINT64 first, UINT64 last,
+                      BOOL markUsed)
+{
+	BOOL rc = FALSE;
+	rdpPersistentCache* persistent = persistent_cache_new();
+	if (!persistent)
+		return FALSE;
+
+	if (persistent_cache_open(persistent, file, TRUE, version) < 1)
+		goto fail;
+
+	for (UINT64 key = first; key <= last; key++)
+	{
+		if (!test_write(persistent, key, markUsed ? PERSISTENT_CACHE_ENTRY_FLAG_USED : 0))
+			goto fail;
+	}
+
+	rc = persistent_cache_close(persistent) > 0;
+fail:
+	persistent_cache_free(persistent);
+	return rc;
+}
+
+static BOOL test_find_all(const char* file, UINT64 first, UINT64 last, int count)
+{
+	BOOL rc = FALSE;
+	rdpPersistentCache* persistent = persistent_cache_new();
+	if (!persistent)
+		return FALSE;
+
+	if (persistent_cache_open(persistent, file, FALSE, 0) < 1)
+		goto fail;
+	if ((persistent_cache_get_version(persistent) != 4) ||
+	    (persistent_cache_get_count(persistent) != count))
+		goto fail;
+
+	for (UINT64 key = first; key <= last; key++)
+	{
+		PERSISTENT_CACHE_ENTRY entry = WINPR_C_ARRAY_INIT;
+		if ((persistent_cache_find_entry(persistent, key, &entry) != 1) ||
+		    (entry.key64 != key) || !test_entry_valid(&entry))
+			goto fail;
+	}
+
+	rc = TRUE;
+fail:
+	persistent_cache_free(persistent);
+	return rc;
+}
+
+static BOOL test_can_open(const char* file)
+{
+	rdpPersistentCache* persistent = persistent_cache_new();
+	if (!persistent)
+		return FALSE;
+
+	const int status = persistent_cache_open(persistent, file, FALSE, 0);
+	persistent_cache_free(persistent);
+	return status > 0;
+}
+
+static BYTE* test_load(const char* file, size_t* size)
+{
+	BYTE* data = nullptr;
+	FILE* fp = winpr_fopen(file, "rb");
+	if (!fp)
+		return nullptr;
+
+	if (_fseeki64(fp, 0, SEEK_END) != 0)
+		goto fail;
+	const INT64 len = _ftelli64(fp);
+	if ((len <= 0) || (_fseeki64(fp, 0, SEEK_SET) != 0))
+		goto fail;
+
+	data = malloc((size_t)len);
+	if (!data || (fread(data, (size_t)len, 1, fp) != 1))
+	{
+		free(data);
+		data = nullptr;
+		goto fail;
+	}
+	*size = (size_t)len;
+fail:
+	(void)fclose(fp);
+	return data;
+}
+
+static BOOL test_store(const char* file, const BYTE* data, size_t size)
+{
+	FILE* fp = winpr_fopen(file, "wb");
+	if (!fp)
+		return FALSE;
+
+	const BOOL rc = fwrite(data, size, 1, fp) == 1;
+	(void)fclose(fp);
+	return rc;
+}
+
+static size_t test_file_size(const char* file)
+{
+	size_t size = 0;
+	free(test_load(file, &size));
+	return size;
+}
+
+static char* test_path(const char* base, const char* suffix)
+{
+	const size_t len = strlen(base) + strlen(suffix) + 1;
+	char* path = calloc(len, sizeof(char));
+	if (path)
+		(void)_snprintf(path, len, "%s%s", base, suffix);
+	return path;
+}
+
+static BOOL test_v3_to_v4(const char* v3file, const char* file)
+{
+	BOOL rc = FALSE;
+	rdpPersistentCache* input = persistent_cache_new();
+	rdpPersistentCache* output = persistent_cache_new();
+	if (!input || !output)
+		goto fail;
+
+	if (!test_save(v3file, 3, 1, 16, FALSE))
+		goto fail;
+
+	if ((persistent_cache_open(input, v3file, FALSE, 0) < 1) ||
+	    (persistent_cache_get_version(input) != 3) || (persistent_cache_get_count(input) != 16))
+		goto fail;
+	if (persistent_cache_open(output, file, TRUE, 4) < 1)
+		goto fail;
+
+	for (int x = 0; x < 16; x++)
+	{
+		PERSISTENT_CACHE_ENTRY entry = WINPR_C_ARRAY_INIT;
+		if ((persistent_cache_read_entry(input, &entry) < 1) || !test_entry_valid(&entry))
+			goto fail;
+		if (persistent_cache_write_entry(output, &entry) < 1)
+			goto fail;
+	}
+
+	if (persistent_cache_close(output) < 1)
+		goto fail;
+
+	rc = test_find_all(file, 1, 16, 16);
+fail:
+	persistent_cache_free(input);
+	persistent_cache_free(output);
+	return rc;
+}
+
+static BOOL test_dedupe(const char* file)
+{
+	BOOL rc = FALSE;
+	rdpPersistentCache* persistent = persistent_cache_new();
+	if (!persistent)
+		return FALSE;
+
+	/* The same bitmap held by several cache slots is written once */
+	if (persistent_cache_open(persistent, file, TRUE, 4) < 1)
+		goto fail;
+	if (!test_write(persistent, 1, 0) || !test_write(persistent, 2, 0) ||
+	    !test_write(persistent, 1, 0) || !test_write(persistent, 1, 0))
+		goto fail;
+	if (persistent_cache_get_count(persistent) != 2)
+		goto fail;
+	if (persistent_cache_close(persistent) < 1)
+		goto fail;
+
+	if (test_file_size(file) != 32 + 2 * (TEST_SIZE + 32))
+		goto fail;
+
+	rc = test_find_all(file, 1, 2, 2);
+fail:
+	persistent_cache_free(persistent);
+	return rc;
+}
+
+static BOOL test_append(const char* file)
+{
+	/* Used entries survive a save in which they were not written */
+	if (!test_save(file, 4, 1, 4, TRUE))
+		return FALSE;
+	const size_t first = test_file_size(file);
+
+	if (!test_save(file, 4, 3, 6, FALSE))
+		return FALSE;
+	const size_t second = test_file_size(file);
+
+	/* Only the two new bitmaps and the new index are appended */
+	if (second != first + 2 * TEST_SIZE + 6 * 32)
+		return FALSE;
+
+	return test_find_all(file, 1, 6, 6);
+}
+
+static BOOL test_compaction(const char* file)
+{
+	size_t last = 0;
+
+	/* Each save replaces all entries, the old ones age out and leave dead space behind */
+	for (UINT64 x = 0; x < 4; x++)
+	{
+		if (!test_save(file, 4, 1 + 16 * x, 16 + 16 * x, FALSE))
+			return FALSE;
+
+		const size_t size = test_file_size(file);
+		if ((x < 3) && (size <= last))
+			return FALSE;
+		if (x == 3)
+		{
+			if ((size >= last) || (size != 32 + 16 * (TEST_SIZE + 32)))
+				return FALSE;
+		}
+		last = size;
+	}
+
+	char* tmp = test_path(file, ".tmp");
+	const BOOL rc = tmp && !winpr_PathFileExists(tmp) && test_find_all(file, 49, 64, 16);
+	free(tmp);
+	return rc;
+}
+
+static BOOL test_corrupted(const char* file)
+{
+	BOOL rc = FALSE;
+	size_t size = 0;
+
+	if (!test_save(file, 4, 1, 4, FALSE))
+		return FALSE;
+
+	BYTE* data = test_load(file, &size);
+	if (!data || !test_can_open(file))
+		goto fail;
+
+	const size_t indexOffset = winpr_Data_Get_UINT64(&data[16]);
+	if (indexOffset + 4 * 32 != size)
+		goto fail;
+
+	/* Truncated behind the committed size */
+	if (!test_store(file, data, size - 1) || test_can_open(file))
+		goto fail;
+
+	/* Truncated inside the header */
+	if (!test_store(file, data, 16) || test_can_open(file))
+		goto fail;
+
+	/* Unknown version */
+	data[8] = 5;
+	if (!test_store(file, data, size) || test_can_open(file))
+		goto fail;
+	data[8] = 4;
+
+	/* Entry count exceeding the index */
+	data[12] = 5;
+	if (!test_store(file, data, size) || test_can_open(file))
+		goto fail;
+	data[12] = 4;
+
+	/* Entry data pointing into the index */
+	const UINT64 offset = winpr_Data_Get_UINT64(&data[indexOffset + 8]);
+	winpr_Data_Write_UINT64(&data[indexOffset + 8], indexOffset - 1);
+	if (!test_store(file, data, size) || test_can_open(file))
+		goto fail;
+	winpr_Data_Write_UINT64(&data[indexOffset + 8], offset);
+
+	/* Size not matching the dimensions */
+	data[indexOffset + 20]++;
+	if (!test_store(file, data, size) || test_can_open(file))
+		goto fail;
+	data[indexOffset + 20]--;
+
+	/* and the intact file is accepted again */
+	if (!test_store(file, data, size) || !test_can_open(file))
+		goto fail;
+
+	rc = TRUE;
+fail:
+	free(data);
+	return rc;
+}
+
+static void test_remove(const char* base)
+{
+	const char* suffixes[] = { ".bmc", ".bmc.lock", ".bmc.tmp", "-v3.bmc", "-v3.bmc.lock" };
+
+	for (size_t x = 0; x < ARRAYSIZE(suffixes); x++)
+	{
+		char* path = test_path(base, suffixes[x]);
+		if (path && winpr_PathFileExists(path))
+			(void)winpr_DeleteFile(path);
+		free(path);
+	}
+}
+
+int TestPersistentCache(int argc, char* argv[])
+{
+	int rc = -1;
+	char sname[128] = WINPR_C_ARRAY_INIT;
+
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	(void)_snprintf(sname, sizeof(sname), "TestPersistentCache-%" PRIu32 "-%" PRIu64,
+	                GetCurrentProcessId(), GetTickCount64());
+
+	char* base = GetKnownSubPath(KNOWN_PATH_TEMP, sname);
+	char* file = base ? test_path(base, ".bmc") : nullptr;
+	char* v3file = base ? test_path(base, "-v3.bmc") : nullptr;
+	if (!file || !v3file)
+		goto fail;
+
+	if (!test_v3_to_v4(v3file, file))
+	{
+		(void)fprintf(stderr, "version 3 to version 4 conversion failed\n");
+		goto fail;
+	}
+	test_remove(base);
+
+	if (!test_dedupe(file))
+	{
+		(void)fprintf(stderr, "duplicate entries not merged\n");
+		goto fail;
+	}
+	test_remove(base);
+
+	if (!test_append(file))
+	{
+		(void)fprintf(stderr, "incremental save failed\n");
+		goto fail;
+	}
+	test_remove(base);
+
+	if (!test_compaction(file))
+	{
+		(void)fprintf(stderr, "compaction failed\n");
+		goto fail;
+	}
+	test_remove(base);
+
+	if (!test_corrupted(file))
+	{
+		(void)fprintf(stderr, "corrupted cache accepted\n");
+		goto fail;
+	}
+
+	rc = 0;
+fail:
+	if (base)
+		test_remove(base);
+	free(v3file);
+	free(file);
+	free(base);
+	return rc;
+}
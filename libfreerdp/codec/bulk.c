@@ -44,6 +44,7 @@ struct rdp_bulk
 	ALIGN64 NCRUSH_CONTEXT* ncrushSend;
 	ALIGN64 XCRUSH_CONTEXT* xcrushRecv;
 	ALIGN64 XCRUSH_CONTEXT* xcrushSend;
+	ALIGN64 BOOL SendPassthrough;
 	ALIGN64 BYTE OutputBuffer[65536];
 };
 
@@ -257,7 +258,7 @@ int bulk_compress(rdpBulk* WINPR_RESTRICT bulk, const BYTE* WINPR_RESTRICT pSrcD
 	rdpMetrics* metrics = bulk->context->metrics;
 	WINPR_ASSERT(metrics);
 
-	if ((SrcSize <= 50) || (SrcSize >= 16384))
+	if ((SrcSize <= 50) || (SrcSize >= 16384) || bulk->SendPassthrough)
 	{
 		*ppDstData = pSrcData;
 		*pDstSize = SrcSize;
@@ -337,6 +338,25 @@ void bulk_reset(rdpBulk* WINPR_RESTRICT bulk)
 	xcrush_context_reset(bulk->xcrushSend, FALSE);
 }
 
+void bulk_set_send_passthrough(rdpBulk* WINPR_RESTRICT bulk, BOOL enable)
+{
+	WINPR_ASSERT(bulk);
+
+	if (bulk->SendPassthrough == enable)
+		return;
+
+	/* While the peer receives compressed data we did not produce our own send history is
+	 * meaningless to it. Flush it so the next compressed packet carries PACKET_FLUSHED. */
+	if (!enable)
+	{
+		mppc_context_reset(bulk->mppcSend, TRUE);
+		ncrush_context_reset(bulk->ncrushSend, TRUE);
+		xcrush_context_reset(bulk->xcrushSend, TRUE);
+	}
+
+	bulk->SendPassthrough = enable;
+}
+
 rdpBulk* bulk_new(rdpContext* context)
 {
 	rdpBulk* bulk = nullptr;
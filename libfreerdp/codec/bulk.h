@@ -43,6 +43,13 @@ FREERDP_LOCAL int bulk_compress(rdpBulk* WINPR_RESTRICT bulk, const BYTE* WINPR_
 
 FREERDP_LOCAL void bulk_reset(rdpBulk* WINPR_RESTRICT bulk);
 
+/** @brief Stop (or resume) compressing outgoing data.
+ *
+ *  Used while already compressed data of another connection is forwarded to the peer.
+ *  Resuming flushes the send history.
+ */
+FREERDP_LOCAL void bulk_set_send_passthrough(rdpBulk* WINPR_RESTRICT bulk, BOOL enable);
+
 FREERDP_LOCAL void bulk_free(rdpBulk* bulk);
 
 WINPR_ATTR_MALLOC(bulk_free, 1)
@@ -24,10 +24,13 @@
 #include <winpr/crt.h>
 #include <winpr/print.h>
 #include <winpr/bitstream.h>
+#include <winpr/pool.h>
+#include <winpr/sysinfo.h>
 
 #include <freerdp/codec/color.h>
 #include <freerdp/codec/clear.h>
 #include <freerdp/log.h>
+#include <freerdp/settings.h>
 
 #define TAG FREERDP_TAG("codec.clear")
 
@@ -38,6 +41,12 @@
 #define CLEARCODEC_VBAR_SIZE 32768
 #define CLEARCODEC_VBAR_SHORT_SIZE 16384
 
+/* Subcodec rectangles covering less than this are decoded on the calling thread */
+#define CLEARCODEC_THREADING_MIN_PIXELS (128u * 128u)
+
+/* Above this many subcodec rectangles the overlap check is not worth it */
+#define CLEARCODEC_THREADING_MAX_SUBCODECS 256
+
 typedef struct
 {
 	UINT32 size;
@@ -52,6 +61,17 @@ typedef struct
 	BYTE* pixels;
 } CLEAR_VBAR_ENTRY;
 
+typedef struct
+{
+	UINT16 width;
+	UINT16 height;
+	UINT32 nXDstRel;
+	UINT32 nYDstRel;
+	UINT32 bitmapDataByteCount;
+	UINT8 subcodecId;
+	const BYTE* data;
+} CLEAR_SUBCODEC;
+
 struct S_CLEAR_CONTEXT
 {
 	BOOL Compressor;
@@ -67,6 +87,12 @@ struct S_CLEAR_CONTEXT
 	UINT32 ShortVBarStorageCursor;
 	CLEAR_VBAR_ENTRY ShortVBarStorage[CLEARCODEC_VBAR_SHORT_SIZE];
 	wLog* log;
+
+	BOOL UseThreads;
+	UINT32 nbThreads;
+	NSC_CONTEXT** workerNsc; /* nbThreads entries, index 0 is unused (clear->nsc is used) */
+	CLEAR_SUBCODEC* subcodecs;
+	size_t subcodecsSize;
 };
 
 static const UINT32 CLEAR_LOG2_FLOOR[256] = {
@@ -452,6 +478,195 @@ static BOOL clear_decompress_residual_data(CLEAR_CONTEXT* WINPR_RESTRICT clear,
 	                     palette);
 }
 
+typedef struct
+{
+	CLEAR_CONTEXT* clear;
+	NSC_CONTEXT* nsc;
+	const CLEAR_SUBCODEC* subcodecs;
+	size_t count;
+	size_t first;
+	size_t step;
+	BYTE* pDstData;
+	UINT32 DstFormat;
+	UINT32 nDstStep;
+	UINT32 nDstWidth;
+	UINT32 nDstHeight;
+	const gdiPalette* palette;
+	BOOL rc;
+} CLEAR_SUBCODEC_WORK;
+
+static BOOL clear_decompress_subcodec(CLEAR_CONTEXT* WINPR_RESTRICT clear,
+                                      NSC_CONTEXT* WINPR_RESTRICT nsc,
+                                      const CLEAR_SUBCODEC* WINPR_RESTRICT subcodec,
+                                      BYTE* WINPR_RESTRICT pDstData, UINT32 DstFormat,
+                                      UINT32 nDstStep, UINT32 nDstWidth, UINT32 nDstHeight,
+                                      const gdiPalette* WINPR_RESTRICT palette)
+{
+	wStream sbuffer = WINPR_C_ARRAY_INIT;
+	wStream* s = Stream_StaticConstInit(&sbuffer, subcodec->data, subcodec->bitmapDataByteCount);
+	if (!s)
+		return FALSE;
+
+	const UINT32 width = subcodec->width;
+	const UINT32 height = subcodec->height;
+
+	switch (subcodec->subcodecId)
+	{
+		case 0: /* Uncompressed */
+		{
+			const UINT32 nSrcStep = width * FreeRDPGetBytesPerPixel(PIXEL_FORMAT_BGR24);
+			const size_t nSrcSize = 1ull * nSrcStep * height;
+
+			if (subcodec->bitmapDataByteCount != nSrcSize)
+			{
+				WLog_Print(clear->log, WLOG_ERROR,
+				           "bitmapDataByteCount %" PRIu32 " != nSrcSize %" PRIuz "",
+				           subcodec->bitmapDataByteCount, nSrcSize);
+				return FALSE;
+			}
+
+			return convert_color(pDstData, nDstStep, DstFormat, subcodec->nXDstRel,
+			                     subcodec->nYDstRel, width, height, subcodec->data, nSrcStep,
+			                     PIXEL_FORMAT_BGR24, nDstWidth, nDstHeight, palette);
+		}
+
+		case 1: /* NSCodec */
+			return clear_decompress_nscodec(clear->log, nsc, width, height, s,
+			                                subcodec->bitmapDataByteCount, pDstData, DstFormat,
+			                                nDstStep, subcodec->nXDstRel, subcodec->nYDstRel,
+			                                nDstWidth, nDstHeight);
+
+		case 2: /* CLEARCODEC_SUBCODEC_RLEX */
+			return clear_decompress_subcode_rlex(clear->log, s, subcodec->bitmapDataByteCount,
+			                                     width, height, pDstData, DstFormat, nDstStep,
+			                                     subcodec->nXDstRel, subcodec->nYDstRel, nDstWidth,
+			                                     nDstHeight);
+
+		default:
+			WLog_Print(clear->log, WLOG_ERROR, "Unknown subcodec ID %" PRIu8 "",
+			           subcodec->subcodecId);
+			return FALSE;
+	}
+}
+
+static void clear_subcodec_work_run(CLEAR_SUBCODEC_WORK* work)
+{
+	WINPR_ASSERT(work);
+
+	work->rc = TRUE;
+	for (size_t x = work->first; x < work->count; x += work->step)
+	{
+		if (!clear_decompress_subcodec(work->clear, work->nsc, &work->subcodecs[x],
+		                               work->pDstData, work->DstFormat, work->nDstStep,
+		                               work->nDstWidth, work->nDstHeight, work->palette))
+		{
+			work->rc = FALSE;
+			return;
+		}
+	}
+}
+
+static void CALLBACK clear_subcodec_work_callback(WINPR_ATTR_UNUSED PTP_CALLBACK_INSTANCE instance,
+                                                  void* context, WINPR_ATTR_UNUSED PTP_WORK work)
+{
+	clear_subcodec_work_run(context);
+}
+
+static BOOL clear_subcodecs_overlap(const CLEAR_SUBCODEC* subcodecs, size_t count)
+{
+	for (size_t x = 0; x < count; x++)
+	{
+		const CLEAR_SUBCODEC* a = &subcodecs[x];
+		for (size_t y = x + 1; y < count; y++)
+		{
+			const CLEAR_SUBCODEC* b = &subcodecs[y];
+			if ((a->nXDstRel < b->nXDstRel + b->width) && (b->nXDstRel < a->nXDstRel + a->width) &&
+			    (a->nYDstRel < b->nYDstRel + b->height) && (b->nYDstRel < a->nYDstRel + a->height))
+				return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+/** decode subcodec rectangles on the thread pool.
+ *
+ *  Only used if the rectangles do not overlap, so the output does not depend on the
+ *  order they are decoded in. Each worker uses its own NSCodec context.
+ */
+static BOOL clear_decompress_subcodecs_threaded(CLEAR_CONTEXT* WINPR_RESTRICT clear, size_t count,
+                                                BYTE* WINPR_RESTRICT pDstData, UINT32 DstFormat,
+                                                UINT32 nDstStep, UINT32 nDstWidth,
+                                                UINT32 nDstHeight,
+                                                const gdiPalette* WINPR_RESTRICT palette)
+{
+	BOOL rc = FALSE;
+	const size_t workers = MIN(clear->nbThreads, count);
+	CLEAR_SUBCODEC_WORK* work = calloc(workers, sizeof(CLEAR_SUBCODEC_WORK));
+	PTP_WORK* handles = calloc(workers, sizeof(PTP_WORK));
+
+	if (!work || !handles)
+		goto fail;
+
+	for (size_t x = 0; x < workers; x++)
+	{
+		NSC_CONTEXT* nsc = clear->nsc;
+		if (x > 0)
+		{
+			if (!clear->workerNsc[x])
+			{
+				clear->workerNsc[x] = nsc_context_new();
+				if (!clear->workerNsc[x])
+					goto fail;
+			}
+			nsc = clear->workerNsc[x];
+			if (!nsc_context_set_parameters(nsc, NSC_COLOR_FORMAT, clear->format))
+				goto fail;
+		}
+
+		CLEAR_SUBCODEC_WORK* cur = &work[x];
+		cur->clear = clear;
+		cur->nsc = nsc;
+		cur->subcodecs = clear->subcodecs;
+		cur->count = count;
+		cur->first = x;
+		cur->step = workers;
+		cur->pDstData = pDstData;
+		cur->DstFormat = DstFormat;
+		cur->nDstStep = nDstStep;
+		cur->nDstWidth = nDstWidth;
+		cur->nDstHeight = nDstHeight;
+		cur->palette = palette;
+	}
+
+	/* worker 0 runs on the calling thread */
+	for (size_t x = 1; x < workers; x++)
+	{
+		handles[x] = CreateThreadpoolWork(clear_subcodec_work_callback, &work[x], nullptr);
+		if (handles[x])
+			SubmitThreadpoolWork(handles[x]);
+	}
+
+	clear_subcodec_work_run(&work[0]);
+
+	rc = work[0].rc;
+	for (size_t x = 1; x < workers; x++)
+	{
+		if (handles[x])
+		{
+			WaitForThreadpoolWorkCallbacks(handles[x], FALSE);
+			CloseThreadpoolWork(handles[x]);
+		}
+		else
+			clear_subcodec_work_run(&work[x]);
+		rc &= work[x].rc;
+	}
+
+fail:
+	free(handles);
+	free(work);
+	return rc;
+}
+
 static BOOL clear_decompress_subcodecs_data(CLEAR_CONTEXT* WINPR_RESTRICT clear,
                                             wStream* WINPR_RESTRICT s, UINT32 subcodecByteCount,
                                             UINT32 nWidth, UINT32 nHeight,
@@ -461,10 +676,13 @@ static BOOL clear_decompress_subcodecs_data(CLEAR_CONTEXT* WINPR_RESTRICT clear,
                                             const gdiPalette* WINPR_RESTRICT palette)
 {
 	UINT32 suboffset = 0;
+	size_t count = 0;
+	size_t pixels = 0;
 
 	if (!Stream_CheckAndLogRequiredLengthWLog(clear->log, s, subcodecByteCount))
 		return FALSE;
 
+	/* Parse and validate all rectangles first, decoding happens afterwards */
 	while (suboffset < subcodecByteCount)
 	{
 		if (!Stream_CheckAndLogRequiredLengthWLog(clear->log, s, 13))
@@ -516,54 +734,43 @@ static BOOL clear_decompress_subcodecs_data(CLEAR_CONTEXT* WINPR_RESTRICT clear,
 		if (!clear_resize_buffer(clear, width, height))
 			return FALSE;
 
-		switch (subcodecId)
+		if (count >= clear->subcodecsSize)
 		{
-			case 0: /* Uncompressed */
-			{
-				const UINT32 nSrcStep = width * FreeRDPGetBytesPerPixel(PIXEL_FORMAT_BGR24);
-				const size_t nSrcSize = 1ull * nSrcStep * height;
-
-				if (bitmapDataByteCount != nSrcSize)
-				{
-					WLog_Print(clear->log, WLOG_ERROR,
-					           "bitmapDataByteCount %" PRIu32 " != nSrcSize %" PRIuz "",
-					           bitmapDataByteCount, nSrcSize);
-					return FALSE;
-				}
-
-				if (!convert_color(pDstData, nDstStep, DstFormat, nXDstRel, nYDstRel, width, height,
-				                   Stream_Pointer(s), nSrcStep, PIXEL_FORMAT_BGR24, nDstWidth,
-				                   nDstHeight, palette))
-					return FALSE;
-
-				Stream_Seek(s, bitmapDataByteCount);
-			}
-			break;
-
-			case 1: /* NSCodec */
-				if (!clear_decompress_nscodec(clear->log, clear->nsc, width, height, s,
-				                              bitmapDataByteCount, pDstData, DstFormat, nDstStep,
-				                              nXDstRel, nYDstRel, nDstWidth, nDstHeight))
-					return FALSE;
-
-				break;
-
-			case 2: /* CLEARCODEC_SUBCODEC_RLEX */
-				if (!clear_decompress_subcode_rlex(clear->log, s, bitmapDataByteCount, width,
-				                                   height, pDstData, DstFormat, nDstStep, nXDstRel,
-				                                   nYDstRel, nDstWidth, nDstHeight))
-					return FALSE;
-
-				break;
-
-			default:
-				WLog_Print(clear->log, WLOG_ERROR, "Unknown subcodec ID %" PRIu8 "", subcodecId);
+			const size_t size = MAX(16, clear->subcodecsSize * 2);
+			CLEAR_SUBCODEC* tmp = realloc(clear->subcodecs, size * sizeof(CLEAR_SUBCODEC));
+			if (!tmp)
 				return FALSE;
+			clear->subcodecs = tmp;
+			clear->subcodecsSize = size;
 		}
 
+		CLEAR_SUBCODEC* cur = &clear->subcodecs[count++];
+		cur->width = width;
+		cur->height = height;
+		cur->nXDstRel = nXDstRel;
+		cur->nYDstRel = nYDstRel;
+		cur->bitmapDataByteCount = bitmapDataByteCount;
+		cur->subcodecId = subcodecId;
+		cur->data = Stream_ConstPointer(s);
+		pixels += 1ull * width * height;
+
+		Stream_Seek(s, bitmapDataByteCount);
 		suboffset += bitmapDataByteCount;
 	}
 
+	if (clear->UseThreads && (count > 1) && (count <= CLEARCODEC_THREADING_MAX_SUBCODECS) &&
+	    (pixels >= CLEARCODEC_THREADING_MIN_PIXELS) &&
+	    !clear_subcodecs_overlap(clear->subcodecs, count))
+		return clear_decompress_subcodecs_threaded(clear, count, pDstData, DstFormat, nDstStep,
+		                                           nDstWidth, nDstHeight, palette);
+
+	for (size_t x = 0; x < count; x++)
+	{
+		if (!clear_decompress_subcodec(clear, clear->nsc, &clear->subcodecs[x], pDstData,
+		                               DstFormat, nDstStep, nDstWidth, nDstHeight, palette))
+			return FALSE;
+	}
+
 	return TRUE;
 }
 
@@ -1295,6 +1502,11 @@ BOOL clear_context_reset(CLEAR_CONTEXT* WINPR_RESTRICT clear)
 }
 
 CLEAR_CONTEXT* clear_context_new(BOOL Compressor)
+{
+	return clear_context_new_ex(Compressor, THREADING_FLAGS_DISABLE_THREADS);
+}
+
+CLEAR_CONTEXT* clear_context_new_ex(BOOL Compressor, UINT32 ThreadingFlags)
 {
 	CLEAR_CONTEXT* clear = (CLEAR_CONTEXT*)winpr_aligned_calloc(1, sizeof(CLEAR_CONTEXT), 32);
 
@@ -1307,6 +1519,21 @@ CLEAR_CONTEXT* clear_context_new(BOOL Compressor)
 	if (!clear->nsc)
 		goto error_nsc;
 
+	if (!Compressor && !(ThreadingFlags & THREADING_FLAGS_DISABLE_THREADS) &&
+	    (ThreadingFlags & THREADING_FLAGS_ALLOW_CODEC_THREADS))
+	{
+		SYSTEM_INFO sysInfos = WINPR_C_ARRAY_INIT;
+		GetNativeSystemInfo(&sysInfos);
+		clear->nbThreads = sysInfos.dwNumberOfProcessors;
+		clear->UseThreads = (clear->nbThreads > 1);
+		if (clear->UseThreads)
+		{
+			clear->workerNsc = calloc(clear->nbThreads, sizeof(NSC_CONTEXT*));
+			if (!clear->workerNsc)
+				goto error_nsc;
+		}
+	}
+
 	if (!updateContextFormat(clear, PIXEL_FORMAT_BGRX32, TRUE))
 		goto error_nsc;
 
@@ -1334,6 +1561,13 @@ void clear_context_free(CLEAR_CONTEXT* WINPR_RESTRICT clear)
 		return;
 
 	nsc_context_free(clear->nsc);
+	if (clear->workerNsc)
+	{
+		for (size_t x = 0; x < clear->nbThreads; x++)
+			nsc_context_free(clear->workerNsc[x]);
+		free(clear->workerNsc);
+	}
+	free(clear->subcodecs);
 	winpr_aligned_free(clear->TempBuffer);
 
 	clear_reset_vbar_storage(clear, TRUE);
@@ -31,6 +31,7 @@
 #include <freerdp/codec/dsp.h>
 
 #include "dsp.h"
+#include "dsp_resample.h"
 
 #if defined(WITH_FDK_AAC)
 #include "dsp_fdk_aac.h"
@@ -118,6 +119,8 @@ struct S_FREERDP_DSP_CONTEXT
 
 #if defined(WITH_SOXR)
 	soxr_t sox;
+#else
+	FREERDP_DSP_RESAMPLER* resampler;
 #endif
 };
 
@@ -168,25 +171,32 @@ static BOOL freerdp_dsp_channel_mix(FREERDP_DSP_CONTEXT* WINPR_RESTRICT context,
 
 	Stream_ResetPosition(context->common.channelmix);
 
+	const FREERDP_DSP_KERNELS* kernels = freerdp_dsp_kernels_get();
+
 	/* Destination has more channels than source */
 	if (context->common.format.nChannels > srcFormat->nChannels)
 	{
 		switch (srcFormat->nChannels)
 		{
 			case 1:
-				if (!Stream_EnsureCapacity(context->common.channelmix, size * 2))
+				if (!Stream_EnsureCapacity(context->common.channelmix, samples * bpp * 2))
 					return FALSE;
 
-				for (size_t x = 0; x < samples; x++)
+				if (bpp == 2)
+					kernels->mono_to_stereo(src, Stream_Buffer(context->common.channelmix),
+					                        samples);
+				else
 				{
-					for (size_t y = 0; y < bpp; y++)
-						Stream_Write_UINT8(context->common.channelmix, src[x * bpp + y]);
-
-					for (size_t y = 0; y < bpp; y++)
-						Stream_Write_UINT8(context->common.channelmix, src[x * bpp + y]);
+					BYTE* dst = Stream_Buffer(context->common.channelmix);
+					for (size_t x = 0; x < samples; x++)
+					{
+						dst[2 * x] = src[x];
+						dst[2 * x + 1] = src[x];
+					}
 				}
 
-				Stream_SealLength(context->common.channelmix);
+				if (!Stream_SetLength(context->common.channelmix, samples * bpp * 2))
+					return FALSE;
 				*data = Stream_Buffer(context->common.channelmix);
 				*length = Stream_Length(context->common.channelmix);
 				return TRUE;
@@ -201,18 +211,21 @@ static BOOL freerdp_dsp_channel_mix(FREERDP_DSP_CONTEXT* WINPR_RESTRICT context,
 	switch (srcFormat->nChannels)
 	{
 		case 2:
-			if (!Stream_EnsureCapacity(context->common.channelmix, size / 2))
+			if (!Stream_EnsureCapacity(context->common.channelmix, samples * bpp))
 				return FALSE;
 
-			/* Simply drop second channel.
-			 * TODO: Calculate average */
-			for (size_t x = 0; x < samples; x++)
+			if (bpp == 2)
+				kernels->stereo_to_mono(src, Stream_Buffer(context->common.channelmix), samples);
+			else
 			{
-				for (size_t y = 0; y < bpp; y++)
-					Stream_Write_UINT8(context->common.channelmix, src[2 * x * bpp + y]);
+				/* 8bit PCM is unsigned, the average is taken around the 0x80 midpoint */
+				BYTE* dst = Stream_Buffer(context->common.channelmix);
+				for (size_t x = 0; x < samples; x++)
+					dst[x] = (BYTE)((src[2 * x] + src[2 * x + 1]) / 2);
 			}
 
-			Stream_SealLength(context->common.channelmix);
+			if (!Stream_SetLength(context->common.channelmix, samples * bpp))
+				return FALSE;
 			*data = Stream_Buffer(context->common.channelmix);
 			*length = Stream_Length(context->common.channelmix);
 			return TRUE;
@@ -294,8 +307,39 @@ static BOOL freerdp_dsp_resample(FREERDP_DSP_CONTEXT* WINPR_RESTRICT context,
 	*length = Stream_Length(context->common.resample);
 	return (error == 0) != 0;
 #else
-	WLog_ERR(TAG, "Missing resample support, recompile -DWITH_SOXR=ON or -DWITH_DSP_FFMPEG=ON");
-	return FALSE;
+	if (srcFormat->wBitsPerSample != 16)
+	{
+		WLog_ERR(TAG, "built-in resampler requires 16bit samples, got %" PRIu16,
+		         srcFormat->wBitsPerSample);
+		return FALSE;
+	}
+
+	if (srcFormat->nChannels != context->common.format.nChannels)
+		return FALSE;
+
+	/* The source rate is only known here, rebuild the filter whenever it changes */
+	if (!freerdp_dsp_resampler_matches(context->resampler, srcFormat->nSamplesPerSec,
+	                                   context->common.format.nSamplesPerSec,
+	                                   srcFormat->nChannels))
+	{
+		freerdp_dsp_resampler_free(context->resampler);
+		context->resampler =
+		    freerdp_dsp_resampler_new(srcFormat->nSamplesPerSec,
+		                              context->common.format.nSamplesPerSec, srcFormat->nChannels);
+		if (!context->resampler)
+			return FALSE;
+	}
+
+	const size_t frames = size / (sizeof(INT16) * srcFormat->nChannels);
+	Stream_ResetPosition(context->common.resample);
+	if (!freerdp_dsp_resampler_process(context->resampler, src, frames,
+	                                   context->common.resample))
+		return FALSE;
+
+	Stream_SealLength(context->common.resample);
+	*data = Stream_Buffer(context->common.resample);
+	*length = Stream_Length(context->common.resample);
+	return TRUE;
 #endif
 }
 
@@ -695,6 +739,27 @@ static BOOL freerdp_dsp_decode_opus(FREERDP_DSP_CONTEXT* WINPR_RESTRICT context,
 	return TRUE;
 }
 
+static BOOL freerdp_dsp_decode_opus_lost(FREERDP_DSP_CONTEXT* WINPR_RESTRICT context,
+                                         size_t frames, wStream* WINPR_RESTRICT out)
+{
+	if (!context || !out || (frames == 0) || (frames > OPUS_MAX_FRAMES))
+		return FALSE;
+
+	const size_t max_size = frames * context->common.format.nChannels * sizeof(int16_t);
+	if (!Stream_EnsureRemainingCapacity(out, max_size))
+		return FALSE;
+
+	/* A missing packet makes the decoder extrapolate from its state */
+	const opus_int32 decoded =
+	    opus_decode(context->opus_decoder, nullptr, 0, Stream_Pointer(out),
+	                WINPR_ASSERTING_INT_CAST(opus_int32, frames), 0);
+	if (decoded < 0)
+		return FALSE;
+
+	Stream_Seek(out, (size_t)decoded * context->common.format.nChannels * sizeof(int16_t));
+	return TRUE;
+}
+
 static BOOL freerdp_dsp_encode_opus(FREERDP_DSP_CONTEXT* WINPR_RESTRICT context,
                                     const BYTE* WINPR_RESTRICT src, size_t size,
                                     wStream* WINPR_RESTRICT out)
@@ -1357,6 +1422,8 @@ void freerdp_dsp_context_free(FREERDP_DSP_CONTEXT* context)
 #endif
 #if defined(WITH_SOXR)
 		soxr_delete(context->sox);
+#else
+		freerdp_dsp_resampler_free(context->resampler);
 #endif
 	    free(context);
 
@@ -1506,6 +1573,33 @@ BOOL freerdp_dsp_decode(FREERDP_DSP_CONTEXT* WINPR_RESTRICT context,
 #endif
 }
 
+BOOL freerdp_dsp_decode_lost(FREERDP_DSP_CONTEXT* WINPR_RESTRICT context,
+                             const AUDIO_FORMAT* WINPR_RESTRICT srcFormat, size_t frames,
+                             wStream* WINPR_RESTRICT out)
+{
+#if defined(WITH_DSP_FFMPEG)
+	WINPR_UNUSED(context);
+	WINPR_UNUSED(srcFormat);
+	WINPR_UNUSED(frames);
+	WINPR_UNUSED(out);
+	return FALSE;
+#else
+	if (!context || context->common.encoder || !srcFormat || !out)
+		return FALSE;
+
+	switch (context->common.format.wFormatTag)
+	{
+#if defined(WITH_OPUS)
+		case WAVE_FORMAT_OPUS:
+			return freerdp_dsp_decode_opus_lost(context, frames, out);
+#endif
+		default:
+			WINPR_UNUSED(frames);
+			return FALSE;
+	}
+#endif
+}
+
 BOOL freerdp_dsp_supports_format(const AUDIO_FORMAT* WINPR_RESTRICT format, BOOL encode)
 {
 #if defined(WITH_FDK_AAC)
@@ -1726,6 +1820,10 @@ BOOL freerdp_dsp_context_reset(FREERDP_DSP_CONTEXT* WINPR_RESTRICT context,
 		if (!context->sox || (error != nullptr))
 			return FALSE;
 	}
+#else
+	/* Drop the filter history of the previous stream */
+	freerdp_dsp_resampler_free(context->resampler);
+	context->resampler = nullptr;
 #endif
 	return TRUE;
 #endif
@@ -0,0 +1,375 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Digital Sound Processing - built-in resampler and channel mixer
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <freerdp/config.h>
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <winpr/assert.h>
+#include <winpr/endian.h>
+#include <winpr/synch.h>
+
+#include "dsp_resample.h"
+#include "sse/dsp_sse2.h"
+#include "neon/dsp_neon.h"
+
+/* Polyphase windowed sinc filter. The conversion ratio is reduced to L/M, with L phases
+ * (at most DSP_RESAMPLE_MAX_PHASES, finer ratios use the closest lower phase) of
+ * DSP_RESAMPLE_TAPS taps each. Downsampling lowers the cutoff and widens the filter
+ * accordingly. Coefficients are Q15, every phase sums up to unity gain. */
+#define DSP_RESAMPLE_TAPS 64
+#define DSP_RESAMPLE_MAX_TAPS 512
+#define DSP_RESAMPLE_MAX_PHASES 512
+#define DSP_RESAMPLE_CUTOFF 0.45
+#define DSP_RESAMPLE_KAISER_BETA 8.0
+#define DSP_RESAMPLE_PI 3.14159265358979323846
+
+struct S_FREERDP_DSP_RESAMPLER
+{
+	UINT32 srcRate;
+	UINT32 dstRate;
+	UINT32 channels;
+
+	UINT32 up;
+	UINT32 down;
+	UINT32 phases;
+	size_t taps;
+	INT16* coeffs;
+
+	INT16** history;
+	size_t capacity;
+	size_t fill;
+	size_t base;
+	UINT32 frac;
+
+	const FREERDP_DSP_KERNELS* kernels;
+};
+
+static INT32 generic_dot(const INT16* WINPR_RESTRICT a, const INT16* WINPR_RESTRICT b,
+                         size_t count)
+{
+	INT64 sum = 0;
+
+	for (size_t x = 0; x < count; x++)
+		sum += (INT32)a[x] * b[x];
+
+	return (INT32)sum;
+}
+
+static void generic_mono_to_stereo(const BYTE* WINPR_RESTRICT src, BYTE* WINPR_RESTRICT dst,
+                                   size_t frames)
+{
+	for (size_t x = 0; x < frames; x++)
+	{
+		const INT16 sample = winpr_Data_Get_INT16(&src[2 * x]);
+		winpr_Data_Write_INT16(&dst[4 * x], sample);
+		winpr_Data_Write_INT16(&dst[4 * x + 2], sample);
+	}
+}
+
+static void generic_stereo_to_mono(const BYTE* WINPR_RESTRICT src, BYTE* WINPR_RESTRICT dst,
+                                   size_t frames)
+{
+	for (size_t x = 0; x < frames; x++)
+	{
+		const INT32 left = winpr_Data_Get_INT16(&src[4 * x]);
+		const INT32 right = winpr_Data_Get_INT16(&src[4 * x + 2]);
+		winpr_Data_Write_INT16(&dst[2 * x], (INT16)((left + right) >> 1));
+	}
+}
+
+static const FREERDP_DSP_KERNELS generic_kernels = { generic_dot, generic_mono_to_stereo,
+	                                                 generic_stereo_to_mono };
+
+static INIT_ONCE kernels_once = INIT_ONCE_STATIC_INIT;
+static FREERDP_DSP_KERNELS cpu_kernels = WINPR_C_ARRAY_INIT;
+
+static BOOL CALLBACK freerdp_dsp_kernels_init(WINPR_ATTR_UNUSED PINIT_ONCE once,
+                                              WINPR_ATTR_UNUSED PVOID param,
+                                              WINPR_ATTR_UNUSED PVOID* context)
+{
+	cpu_kernels = generic_kernels;
+	dsp_init_sse2(&cpu_kernels);
+#if defined(WITH_AVX2)
+	dsp_init_avx2(&cpu_kernels);
+#endif
+	dsp_init_neon(&cpu_kernels);
+	return TRUE;
+}
+
+const FREERDP_DSP_KERNELS* freerdp_dsp_kernels_get_generic(void)
+{
+	return &generic_kernels;
+}
+
+const FREERDP_DSP_KERNELS* freerdp_dsp_kernels_get(void)
+{
+	if (!InitOnceExecuteOnce(&kernels_once, freerdp_dsp_kernels_init, nullptr, nullptr))
+		return &generic_kernels;
+	return &cpu_kernels;
+}
+
+static UINT32 gcd(UINT32 a, UINT32 b)
+{
+	while (b != 0)
+	{
+		const UINT32 t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+/* modified bessel function of the first kind, order 0 */
+static double bessel_i0(double x)
+{
+	double sum = 1.0;
+	double term = 1.0;
+
+	for (size_t k = 1; k < 64; k++)
+	{
+		const double f = x / (2.0 * (double)k);
+		term *= f * f;
+		sum += term;
+		if (term < sum * 1e-12)
+			break;
+	}
+	return sum;
+}
+
+static BOOL resampler_build_filter(FREERDP_DSP_RESAMPLER* resampler)
+{
+	WINPR_ASSERT(resampler);
+
+	const double ratio = (double)resampler->up / (double)resampler->down;
+	const double cutoff = DSP_RESAMPLE_CUTOFF * ((ratio < 1.0) ? ratio : 1.0);
+	const double scale = (ratio < 1.0) ? (1.0 / ratio) : 1.0;
+	size_t taps = (size_t)ceil(DSP_RESAMPLE_TAPS * scale);
+
+	taps = (taps + DSP_RESAMPLE_TAP_ALIGN - 1) & ~((size_t)DSP_RESAMPLE_TAP_ALIGN - 1);
+	if (taps > DSP_RESAMPLE_MAX_TAPS)
+		taps = DSP_RESAMPLE_MAX_TAPS;
+
+	resampler->taps = taps;
+	resampler->coeffs = calloc(1ull * resampler->phases * taps, sizeof(INT16));
+	double* tmp = calloc(taps, sizeof(double));
+	if (!resampler->coeffs || !tmp)
+	{
+		free(tmp);
+		return FALSE;
+	}
+
+	const double half = (double)taps / 2.0;
+	const double i0beta = bessel_i0(DSP_RESAMPLE_KAISER_BETA);
+
+	for (size_t p = 0; p < resampler->phases; p++)
+	{
+		const double f = (double)p / (double)resampler->phases;
+		INT16* coeffs = &resampler->coeffs[p * taps];
+		double sum = 0.0;
+
+		for (size_t k = 0; k < taps; k++)
+		{
+			const double t = (double)k - (half - 1.0) - f;
+			const double x = DSP_RESAMPLE_PI * 2.0 * cutoff * t;
+			const double sinc = (fabs(x) < 1e-9) ? 1.0 : sin(x) / x;
+			const double w = t / half;
+			double window = 0.0;
+			if (fabs(w) < 1.0)
+				window = bessel_i0(DSP_RESAMPLE_KAISER_BETA * sqrt(1.0 - w * w)) / i0beta;
+
+			tmp[k] = sinc * window;
+			sum += tmp[k];
+		}
+
+		/* Normalize to unity gain, put the rounding error on the center tap */
+		INT32 qsum = 0;
+		for (size_t k = 0; k < taps; k++)
+		{
+			const double v = round(tmp[k] / sum * 32768.0);
+			coeffs[k] = (INT16)((v > INT16_MAX) ? INT16_MAX : ((v < INT16_MIN) ? INT16_MIN : v));
+			qsum += coeffs[k];
+		}
+
+		const size_t center = (size_t)half - 1 + ((f >= 0.5) ? 1 : 0);
+		const INT32 fixed = coeffs[center] + 32768 - qsum;
+		coeffs[center] = (INT16)((fixed > INT16_MAX) ? INT16_MAX : fixed);
+	}
+
+	free(tmp);
+	return TRUE;
+}
+
+static BOOL resampler_ensure_capacity(FREERDP_DSP_RESAMPLER* resampler, size_t frames)
+{
+	WINPR_ASSERT(resampler);
+
+	if (resampler->fill + frames <= resampler->capacity)
+		return TRUE;
+
+	size_t capacity = resampler->capacity;
+	while (capacity < resampler->fill + frames)
+		capacity *= 2;
+
+	for (UINT32 c = 0; c < resampler->channels; c++)
+	{
+		INT16* tmp = realloc(resampler->history[c], capacity * sizeof(INT16));
+		if (!tmp)
+			return FALSE;
+		resampler->history[c] = tmp;
+	}
+	resampler->capacity = capacity;
+	return TRUE;
+}
+
+void freerdp_dsp_resampler_free(FREERDP_DSP_RESAMPLER* resampler)
+{
+	if (!resampler)
+		return;
+
+	if (resampler->history)
+	{
+		for (UINT32 c = 0; c < resampler->channels; c++)
+			free(resampler->history[c]);
+	}
+	free((void*)resampler->history);
+	free(resampler->coeffs);
+	free(resampler);
+}
+
+FREERDP_DSP_RESAMPLER* freerdp_dsp_resampler_new(UINT32 srcRate, UINT32 dstRate, UINT32 channels)
+{
+	if ((srcRate == 0) || (dstRate == 0) || (channels == 0))
+		return nullptr;
+
+	FREERDP_DSP_RESAMPLER* resampler = calloc(1, sizeof(FREERDP_DSP_RESAMPLER));
+	if (!resampler)
+		return nullptr;
+
+	const UINT32 div = gcd(srcRate, dstRate);
+	resampler->srcRate = srcRate;
+	resampler->dstRate = dstRate;
+	resampler->channels = channels;
+	resampler->up = dstRate / div;
+	resampler->down = srcRate / div;
+	resampler->phases =
+	    (resampler->up > DSP_RESAMPLE_MAX_PHASES) ? DSP_RESAMPLE_MAX_PHASES : resampler->up;
+	resampler->kernels = freerdp_dsp_kernels_get();
+
+	if (!resampler_build_filter(resampler))
+		goto fail;
+
+	resampler->history = (INT16**)calloc(channels, sizeof(INT16*));
+	if (!resampler->history)
+		goto fail;
+
+	resampler->capacity = 2 * resampler->taps;
+	for (UINT32 c = 0; c < channels; c++)
+	{
+		resampler->history[c] = calloc(resampler->capacity, sizeof(INT16));
+		if (!resampler->history[c])
+			goto fail;
+	}
+
+	/* Prime with silence so the first output sample is centered on the first input sample */
+	resampler->fill = resampler->taps / 2 - 1;
+	return resampler;
+
+fail:
+	freerdp_dsp_resampler_free(resampler);
+	return nullptr;
+}
+
+BOOL freerdp_dsp_resampler_matches(const FREERDP_DSP_RESAMPLER* resampler, UINT32 srcRate,
+                                   UINT32 dstRate, UINT32 channels)
+{
+	if (!resampler)
+		return FALSE;
+
+	return (resampler->srcRate == srcRate) && (resampler->dstRate == dstRate) &&
+	       (resampler->channels == channels);
+}
+
+BOOL freerdp_dsp_resampler_process(FREERDP_DSP_RESAMPLER* WINPR_RESTRICT resampler,
+                                   const BYTE* WINPR_RESTRICT src, size_t frames,
+                                   wStream* WINPR_RESTRICT out)
+{
+	WINPR_ASSERT(resampler);
+	WINPR_ASSERT(src || (frames == 0));
+	WINPR_ASSERT(out);
+
+	const UINT32 channels = resampler->channels;
+	const size_t taps = resampler->taps;
+
+	if (!resampler_ensure_capacity(resampler, frames))
+		return FALSE;
+
+	for (size_t x = 0; x < frames; x++)
+	{
+		for (UINT32 c = 0; c < channels; c++)
+			resampler->history[c][resampler->fill + x] =
+			    winpr_Data_Get_INT16(&src[(x * channels + c) * sizeof(INT16)]);
+	}
+	resampler->fill += frames;
+
+	/* Upper bound of the output frames this call can produce */
+	const size_t avail = resampler->fill - resampler->base;
+	const size_t bound = (avail * resampler->up) / resampler->down + 2;
+	if (!Stream_EnsureRemainingCapacity(out, bound * channels * sizeof(INT16)))
+		return FALSE;
+
+	BYTE* dst = Stream_Pointer(out);
+	size_t produced = 0;
+
+	while ((resampler->base + taps <= resampler->fill) && (produced < bound))
+	{
+		const size_t phase = (1ull * resampler->frac * resampler->phases) / resampler->up;
+		const INT16* coeffs = &resampler->coeffs[phase * taps];
+
+		for (UINT32 c = 0; c < channels; c++)
+		{
+			const INT16* history = &resampler->history[c][resampler->base];
+			const INT32 acc = resampler->kernels->dot(history, coeffs, taps);
+			INT32 sample = (acc + (1 << 14)) >> 15;
+
+			if (sample > INT16_MAX)
+				sample = INT16_MAX;
+			else if (sample < INT16_MIN)
+				sample = INT16_MIN;
+
+			winpr_Data_Write_INT16(dst, (INT16)sample);
+			dst += sizeof(INT16);
+		}
+		produced++;
+
+		resampler->frac += resampler->down;
+		resampler->base += resampler->frac / resampler->up;
+		resampler->frac %= resampler->up;
+	}
+	Stream_Seek(out, produced * channels * sizeof(INT16));
+
+	/* Keep the samples still required by the filter */
+	const size_t consumed = (resampler->base < resampler->fill) ? resampler->base : resampler->fill;
+	for (UINT32 c = 0; c < channels; c++)
+		memmove(resampler->history[c], &resampler->history[c][consumed],
+		        (resampler->fill - consumed) * sizeof(INT16));
+	resampler->fill -= consumed;
+	resampler->base -= consumed;
+	return TRUE;
+}
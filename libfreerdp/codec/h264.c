@@ -36,6 +36,9 @@
 
 #define TAG FREERDP_TAG("codec")
 
+/* Slices are encoded in parallel but each restarts prediction, do not split frames further */
+#define H264_MAX_SLICES 16
+
 static BOOL avc444_ensure_buffer(H264_CONTEXT* h264, DWORD nDstHeight);
 
 static BOOL yuv_ensure_buffer(H264_CONTEXT* h264, UINT32 stride, UINT32 width, UINT32 height)
@@ -801,6 +804,16 @@ BOOL h264_context_reset(H264_CONTEXT* h264, UINT32 width, UINT32 height)
 	return yuv_context_reset(h264->yuv, width, height);
 }
 
+UINT32 h264_context_encoder_slices(const H264_CONTEXT* h264)
+{
+	WINPR_ASSERT(h264);
+
+	/* Unless requested frames are encoded as a single slice, every slice holds at least one row
+	 * of macroblocks */
+	const UINT32 slices = MIN(h264->NumberOfSlices, (h264->height + 15) / 16);
+	return MAX(MIN(slices, H264_MAX_SLICES), 1);
+}
+
 H264_CONTEXT* h264_context_new(BOOL Compressor)
 {
 	H264_CONTEXT* h264 = (H264_CONTEXT*)calloc(1, sizeof(H264_CONTEXT));
@@ -912,6 +925,9 @@ BOOL h264_context_set_option(H264_CONTEXT* h264, H264_CONTEXT_OPTION option, UIN
 		case H264_CONTEXT_OPTION_HW_ACCEL:
 			h264->hwAccel = (value);
 			return TRUE;
+		case H264_CONTEXT_OPTION_SLICES:
+			h264->NumberOfSlices = value;
+			return TRUE;
 		default:
 			WLog_Print(h264->log, WLOG_WARN, "Unknown H264_CONTEXT_OPTION[0x%08" PRIx32 "]",
 			           option);
@@ -936,6 +952,8 @@ UINT32 h264_context_get_option(H264_CONTEXT* h264, H264_CONTEXT_OPTION option)
 			return h264->UsageType;
 		case H264_CONTEXT_OPTION_HW_ACCEL:
 			return h264->hwAccel;
+		case H264_CONTEXT_OPTION_SLICES:
+			return h264->NumberOfSlices;
 		default:
 			WLog_Print(h264->log, WLOG_WARN, "Unknown H264_CONTEXT_OPTION[0x%08" PRIx32 "]",
 			           option);
@@ -63,7 +63,7 @@ extern "C"
 		UINT32 QP;
 		UINT32 UsageType;
 		UINT32 hwAccel;
-		UINT32 NumberOfThreads;
+		UINT32 NumberOfSlices;
 
 		UINT32 iStride[3];
 		BYTE* pOldYUVData[3];
@@ -90,6 +90,10 @@ extern "C"
 		UINT32 YUVHeight;
 	};
 
+	/** @brief The number of slices (and encoder threads) to use for the current frame size */
+	WINPR_ATTR_NODISCARD
+	FREERDP_LOCAL UINT32 h264_context_encoder_slices(const H264_CONTEXT* h264);
+
 	WINPR_ATTR_NODISCARD
 	FREERDP_LOCAL BOOL avc420_ensure_buffer(H264_CONTEXT* h264, UINT32 stride, UINT32 width,
 	                                        UINT32 height);
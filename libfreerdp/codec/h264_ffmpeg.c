@@ -442,10 +442,13 @@ static BOOL libavcodec_create_encoder_context(H264_CONTEXT* WINPR_RESTRICT h264)
 
 	recreate = !sys->codecEncoderContext;
 
+	const UINT32 slices = h264_context_encoder_slices(h264);
+
 	if (sys->codecEncoderContext)
 	{
 		if ((sys->codecEncoderContext->width != (int)h264->width) ||
-		    (sys->codecEncoderContext->height != (int)h264->height))
+		    (sys->codecEncoderContext->height != (int)h264->height) ||
+		    (sys->codecEncoderContext->slices != (int)slices))
 			recreate = TRUE;
 	}
 
@@ -489,6 +492,7 @@ static BOOL libavcodec_create_encoder_context(H264_CONTEXT* WINPR_RESTRICT h264)
 	av_opt_set(sys->codecEncoderContext, "tune", "zerolatency", AV_OPT_SEARCH_CHILDREN);
 
 	sys->codecEncoderContext->flags |= AV_CODEC_FLAG_LOOP_FILTER;
+	sys->codecEncoderContext->slices = (int)slices;
 
 #ifdef WITH_VAAPI_H264_ENCODING
 	if (sys->hwctx)
@@ -505,6 +509,13 @@ static BOOL libavcodec_create_encoder_context(H264_CONTEXT* WINPR_RESTRICT h264)
 	{
 		av_opt_set(sys->codecEncoderContext, "preset", "medium", AV_OPT_SEARCH_CHILDREN);
 		sys->codecEncoderContext->pix_fmt = AV_PIX_FMT_YUV420P;
+
+		/* Software encoders encode the slices in parallel, frame threading would add latency */
+		if (slices > 1)
+		{
+			sys->codecEncoderContext->thread_count = (int)slices;
+			sys->codecEncoderContext->thread_type = FF_THREAD_SLICE;
+		}
 	}
 
 	if (avcodec_open2(sys->codecEncoderContext, sys->codecEncoder, nullptr) < 0)
@@ -56,6 +56,7 @@ typedef struct
 	ISVCDecoder* pDecoder;
 	ISVCEncoder* pEncoder;
 	SEncParamExt EncParamExt;
+	UINT32 NumberOfSlices;
 } H264_CONTEXT_OPENH264;
 
 #if defined(WITH_OPENH264_LOADING)
@@ -215,13 +216,14 @@ static int openh264_compress(H264_CONTEXT* WINPR_RESTRICT h264,
 	if ((h264->width > INT_MAX) || (h264->height > INT_MAX))
 		return -1;
 
-	if ((h264->FrameRate > INT_MAX) || (h264->NumberOfThreads > INT_MAX) ||
-	    (h264->BitRate > INT_MAX) || (h264->QP > INT_MAX))
+	if ((h264->FrameRate > INT_MAX) || (h264->BitRate > INT_MAX) || (h264->QP > INT_MAX))
 		return -1;
 
+	const UINT32 slices = h264_context_encoder_slices(h264);
+
 	WINPR_ASSERT(sys->pEncoder);
 	if ((sys->EncParamExt.iPicWidth != (int)h264->width) ||
-	    (sys->EncParamExt.iPicHeight != (int)h264->height))
+	    (sys->EncParamExt.iPicHeight != (int)h264->height) || (sys->NumberOfSlices != slices))
 	{
 		WINPR_ASSERT((*sys->pEncoder)->GetDefaultParams);
 		status = (*sys->pEncoder)->GetDefaultParams(sys->pEncoder, &sys->EncParamExt);
@@ -259,8 +261,9 @@ static int openh264_compress(H264_CONTEXT* WINPR_RESTRICT h264,
 		sys->EncParamExt.bEnableDenoise = 0;
 		sys->EncParamExt.bEnableLongTermReference = 0;
 		sys->EncParamExt.iSpatialLayerNum = 1;
+		/* A single slice leaves the thread count to OpenH264 */
 		sys->EncParamExt.iMultipleThreadIdc =
-		    WINPR_ASSERTING_INT_CAST(unsigned short, h264->NumberOfThreads);
+		    (slices > 1) ? WINPR_ASSERTING_INT_CAST(unsigned short, slices) : 0;
 		sys->EncParamExt.sSpatialLayers[0].fFrameRate =
 		    WINPR_ASSERTING_INT_CAST(short, h264->FrameRate);
 		sys->EncParamExt.sSpatialLayers[0].iVideoWidth = sys->EncParamExt.iPicWidth;
@@ -286,12 +289,14 @@ static int openh264_compress(H264_CONTEXT* WINPR_RESTRICT h264,
 				break;
 		}
 
-		if (sys->EncParamExt.iMultipleThreadIdc > 1)
+		/* Horizontal slices are encoded by the encoder threads in parallel */
+		if (slices > 1)
 		{
 #if (OPENH264_MAJOR == 1) && (OPENH264_MINOR <= 5)
 			sys->EncParamExt.sSpatialLayers[0].sSliceCfg.uiSliceMode = SM_AUTO_SLICE;
 #else
 			sys->EncParamExt.sSpatialLayers[0].sSliceArgument.uiSliceMode = SM_FIXEDSLCNUM_SLICE;
+			sys->EncParamExt.sSpatialLayers[0].sSliceArgument.uiSliceNum = slices;
 #endif
 		}
 
@@ -316,6 +321,8 @@ static int openh264_compress(H264_CONTEXT* WINPR_RESTRICT h264,
 			           "Failed to get initial OpenH264 encoder parameters (status=%d)", status);
 			return status > 0 ? -status : status;
 		}
+
+		sys->NumberOfSlices = slices;
 	}
 	else
 	{
@@ -0,0 +1,93 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Digital Sound Processing - NEON Optimizations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <winpr/assert.h>
+#include <winpr/platform.h>
+#include <freerdp/config.h>
+
+#include "dsp_neon.h"
+
+#include "../../core/simd.h"
+
+#if defined(NEON_INTRINSICS_ENABLED)
+#include <arm_neon.h>
+
+static INT32 neon_dot(const INT16* WINPR_RESTRICT a, const INT16* WINPR_RESTRICT b, size_t count)
+{
+	WINPR_ASSERT((count % 8) == 0);
+
+	int32x4_t acc0 = vdupq_n_s32(0);
+	int32x4_t acc1 = vdupq_n_s32(0);
+
+	for (size_t x = 0; x < count; x += 8)
+	{
+		const int16x8_t a0 = vld1q_s16(&a[x]);
+		const int16x8_t b0 = vld1q_s16(&b[x]);
+		acc0 = vmlal_s16(acc0, vget_low_s16(a0), vget_low_s16(b0));
+		acc1 = vmlal_s16(acc1, vget_high_s16(a0), vget_high_s16(b0));
+	}
+
+	const int32x4_t acc = vaddq_s32(acc0, acc1);
+	const int32x2_t sum = vadd_s32(vget_low_s32(acc), vget_high_s32(acc));
+	return vget_lane_s32(vpadd_s32(sum, sum), 0);
+}
+
+static void neon_mono_to_stereo(const BYTE* WINPR_RESTRICT src, BYTE* WINPR_RESTRICT dst,
+                                size_t frames)
+{
+	size_t x = 0;
+
+	for (; x + 8 <= frames; x += 8)
+	{
+		const int16x8_t mono = vld1q_s16((const int16_t*)&src[2 * x]);
+		int16x8x2_t stereo;
+		stereo.val[0] = mono;
+		stereo.val[1] = mono;
+		vst2q_s16((int16_t*)&dst[4 * x], stereo);
+	}
+
+	freerdp_dsp_kernels_get_generic()->mono_to_stereo(&src[2 * x], &dst[4 * x], frames - x);
+}
+
+static void neon_stereo_to_mono(const BYTE* WINPR_RESTRICT src, BYTE* WINPR_RESTRICT dst,
+                                size_t frames)
+{
+	size_t x = 0;
+
+	for (; x + 8 <= frames; x += 8)
+	{
+		const int16x8x2_t stereo = vld2q_s16((const int16_t*)&src[4 * x]);
+		/* halving add, same rounding as (left + right) >> 1 */
+		vst1q_s16((int16_t*)&dst[2 * x], vhaddq_s16(stereo.val[0], stereo.val[1]));
+	}
+
+	freerdp_dsp_kernels_get_generic()->stereo_to_mono(&src[4 * x], &dst[2 * x], frames - x);
+}
+#endif
+
+void dsp_init_neon_int(FREERDP_DSP_KERNELS* WINPR_RESTRICT kernels)
+{
+#if defined(NEON_INTRINSICS_ENABLED)
+	WLog_VRB(PRIM_TAG, "NEON optimizations");
+	kernels->dot = neon_dot;
+	kernels->mono_to_stereo = neon_mono_to_stereo;
+	kernels->stereo_to_mono = neon_stereo_to_mono;
+#else
+	WLog_VRB(PRIM_TAG, "undefined WITH_SIMD or NEON intrinsics not available");
+	WINPR_UNUSED(kernels);
+#endif
+}
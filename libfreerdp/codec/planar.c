@@ -26,14 +26,23 @@
 #include <winpr/assert.h>
 #include <winpr/cast.h>
 #include <winpr/print.h>
+#include <winpr/pool.h>
+#include <winpr/sysinfo.h>
 
 #include <freerdp/primitives.h>
 #include <freerdp/log.h>
 #include <freerdp/codec/bitmap.h>
+#include <freerdp/settings.h>
 #include <freerdp/codec/planar.h>
 
 #define TAG FREERDP_TAG("codec")
 
+/* Images smaller than this are always decoded on the calling thread */
+#define PLANAR_THREADING_MIN_PIXELS (256u * 256u)
+
+/* Maximum number of concurrent jobs used to decode a single image */
+#define PLANAR_MAX_JOBS 8
+
 #define PLANAR_ALIGN(val, align) \
 	((val) % (align) == 0) ? (val) : ((val) + (align) - (val) % (align))
 
@@ -94,8 +103,46 @@ struct S_BITMAP_PLANAR_CONTEXT
 
 	BOOL bgr;
 	BOOL topdown;
+
+	BOOL UseThreads;
+	UINT32 nbThreads;
 };
 
+typedef enum
+{
+	PLANAR_JOB_PLANE_RLE,
+	PLANAR_JOB_PLANE_RLE_ONLY,
+	PLANAR_JOB_SET_PLANE,
+	PLANAR_JOB_YCOCG
+} PLANAR_JOB_TYPE;
+
+/** A unit of independent decoding work.
+ *
+ * Each job writes to a disjoint part of the output (its own plane, its own
+ * channel of an interleaved buffer, or its own set of lines), so jobs can run in
+ * any order or concurrently and still produce the same image.
+ */
+typedef struct
+{
+	PLANAR_JOB_TYPE type;
+	const BYTE* pSrcData;
+	UINT32 SrcSize;
+	UINT32 nSrcStep;
+	BYTE* pDstData;
+	UINT32 DstFormat;
+	UINT32 nDstStep;
+	UINT32 nXDst;
+	UINT32 nYDst;
+	UINT32 nWidth;
+	UINT32 nHeight;
+	UINT32 nChannel;
+	BOOL vFlip;
+	BYTE value;
+	BYTE cll;
+	BOOL alpha;
+	BOOL rc;
+} PLANAR_JOB;
+
 static inline BYTE PLANAR_CONTROL_BYTE(UINT32 nRunLength, UINT32 cRawBytes)
 {
 	return WINPR_ASSERTING_INT_CAST(UINT8, ((nRunLength & 0x0F) | ((cRawBytes & 0x0F) << 4)));
@@ -541,6 +588,139 @@ static inline INT32 planar_set_plane(BYTE bValue, BYTE* pDstData, UINT32 nDstSte
 	return 0;
 }
 
+static void planar_run_job(PLANAR_JOB* job)
+{
+	WINPR_ASSERT(job);
+
+	switch (job->type)
+	{
+		case PLANAR_JOB_PLANE_RLE:
+			job->rc = planar_decompress_plane_rle(job->pSrcData, job->SrcSize, job->pDstData,
+			                                      job->nDstStep, job->nXDst, job->nYDst,
+			                                      job->nWidth, job->nHeight, job->nChannel,
+			                                      job->vFlip) >= 0;
+			break;
+
+		case PLANAR_JOB_PLANE_RLE_ONLY:
+			job->rc = planar_decompress_plane_rle_only(job->pSrcData, job->SrcSize, job->pDstData,
+			                                           job->nWidth, job->nHeight) >= 0;
+			break;
+
+		case PLANAR_JOB_SET_PLANE:
+			job->rc = planar_set_plane(job->value, job->pDstData, job->nDstStep, job->nXDst,
+			                           job->nYDst, job->nWidth, job->nHeight, job->nChannel,
+			                           job->vFlip) >= 0;
+			break;
+
+		case PLANAR_JOB_YCOCG:
+		{
+			const primitives_t* prims = primitives_get();
+			WINPR_ASSERT(prims);
+			WINPR_ASSERT(prims->YCoCgToRGB_8u_AC4R);
+
+			const pstatus_t status = prims->YCoCgToRGB_8u_AC4R(
+			    job->pSrcData, WINPR_ASSERTING_INT_CAST(int32_t, job->nSrcStep), job->pDstData,
+			    job->DstFormat, WINPR_ASSERTING_INT_CAST(int32_t, job->nDstStep), job->nWidth,
+			    job->nHeight, job->cll, job->alpha);
+			job->rc = (status == PRIMITIVES_SUCCESS);
+			if (!job->rc)
+				WLog_ERR(TAG, "YCoCgToRGB_8u_AC4R failed with %" PRId32, status);
+		}
+		break;
+
+		default:
+			job->rc = FALSE;
+			break;
+	}
+}
+
+static void CALLBACK planar_job_work_callback(WINPR_ATTR_UNUSED PTP_CALLBACK_INSTANCE instance,
+                                              void* context, WINPR_ATTR_UNUSED PTP_WORK work)
+{
+	planar_run_job(context);
+}
+
+static BOOL planar_use_threads(const BITMAP_PLANAR_CONTEXT* WINPR_RESTRICT planar, UINT32 nWidth,
+                               UINT32 nHeight)
+{
+	WINPR_ASSERT(planar);
+	if (!planar->UseThreads)
+		return FALSE;
+	return (1ull * nWidth * nHeight) >= PLANAR_THREADING_MIN_PIXELS;
+}
+
+/** runs independent jobs, on the thread pool if threading is enabled for this context.
+ *  The last job always runs on the calling thread.
+ */
+static BOOL planar_run_jobs(PLANAR_JOB* jobs, size_t count, BOOL threaded)
+{
+	PTP_WORK work[PLANAR_MAX_JOBS] = WINPR_C_ARRAY_INIT;
+	size_t submitted = 0;
+
+	WINPR_ASSERT(jobs);
+	WINPR_ASSERT(count <= PLANAR_MAX_JOBS);
+
+	if (threaded)
+	{
+		for (size_t x = 0; x + 1 < count; x++)
+		{
+			work[x] = CreateThreadpoolWork(planar_job_work_callback, &jobs[x], nullptr);
+			if (!work[x])
+				break;
+
+			SubmitThreadpoolWork(work[x]);
+			submitted = x + 1;
+		}
+	}
+
+	/* whatever was not handed to the pool runs here */
+	for (size_t x = submitted; x < count; x++)
+		planar_run_job(&jobs[x]);
+
+	BOOL rc = TRUE;
+	for (size_t x = 0; x < submitted; x++)
+	{
+		WaitForThreadpoolWorkCallbacks(work[x], FALSE);
+		CloseThreadpoolWork(work[x]);
+	}
+
+	for (size_t x = 0; x < count; x++)
+		rc &= jobs[x].rc;
+	return rc;
+}
+
+/** converts YCoCg to RGB, split in horizontal stripes for large images */
+static BOOL planar_ycocg_to_rgb(const BITMAP_PLANAR_CONTEXT* WINPR_RESTRICT planar,
+                                const BYTE* WINPR_RESTRICT pSrcData, UINT32 nSrcStep,
+                                BYTE* WINPR_RESTRICT pDstData, UINT32 DstFormat, UINT32 nDstStep,
+                                UINT32 nWidth, UINT32 nHeight, BYTE cll, BOOL alpha)
+{
+	PLANAR_JOB jobs[PLANAR_MAX_JOBS] = WINPR_C_ARRAY_INIT;
+	size_t count = 1;
+
+	if (planar_use_threads(planar, nWidth, nHeight))
+		count = MIN(MIN(planar->nbThreads, PLANAR_MAX_JOBS), MAX(1, nHeight / 64));
+
+	const UINT32 stripe = (nHeight + (UINT32)count - 1) / (UINT32)count;
+	size_t used = 0;
+	for (UINT32 y = 0; y < nHeight; y += stripe)
+	{
+		PLANAR_JOB* job = &jobs[used++];
+		job->type = PLANAR_JOB_YCOCG;
+		job->pSrcData = &pSrcData[1ull * y * nSrcStep];
+		job->nSrcStep = nSrcStep;
+		job->pDstData = &pDstData[1ull * y * nDstStep];
+		job->DstFormat = DstFormat;
+		job->nDstStep = nDstStep;
+		job->nWidth = nWidth;
+		job->nHeight = MIN(stripe, nHeight - y);
+		job->cll = cll;
+		job->alpha = alpha;
+	}
+
+	return planar_run_jobs(jobs, used, used > 1);
+}
+
 static inline BOOL writeLine(BYTE** WINPR_RESTRICT ppRgba, UINT32 DstFormat, UINT32 width,
                              const BYTE** WINPR_RESTRICT ppR, const BYTE** WINPR_RESTRICT ppG,
                              const BYTE** WINPR_RESTRICT ppB, const BYTE** WINPR_RESTRICT ppA)
@@ -989,42 +1169,38 @@ BOOL freerdp_bitmap_decompress_planar(BITMAP_PLANAR_CONTEXT* WINPR_RESTRICT plan
 				return FALSE;
 			}
 
-			status = planar_decompress_plane_rle(
-			    planes[0], WINPR_ASSERTING_INT_CAST(uint32_t, rleSizes[0]), pTempData, nTempStep,
-			    nXDst, nYDst, nSrcWidth, nSrcHeight, 2, vFlip); /* RedPlane */
-
-			if (status < 0)
-				return FALSE;
-
-			status = planar_decompress_plane_rle(
-			    planes[1], WINPR_ASSERTING_INT_CAST(uint32_t, rleSizes[1]), pTempData, nTempStep,
-			    nXDst, nYDst, nSrcWidth, nSrcHeight, 1, vFlip); /* GreenPlane */
-
-			if (status < 0)
-				return FALSE;
-
-			status = planar_decompress_plane_rle(
-			    planes[2], WINPR_ASSERTING_INT_CAST(uint32_t, rleSizes[2]), pTempData, nTempStep,
-			    nXDst, nYDst, nSrcWidth, nSrcHeight, 0, vFlip); /* BluePlane */
-
-			if (status < 0)
-				return FALSE;
+			/* Each plane is written to its own channel of the interleaved buffer */
+			PLANAR_JOB jobs[4] = WINPR_C_ARRAY_INIT;
+			const UINT32 channels[4] = { 2, 1, 0, 3 }; /* Red, Green, Blue, Alpha */
 
-			srcp += rleSizes[0] + rleSizes[1] + rleSizes[2];
+			for (size_t x = 0; x < ARRAYSIZE(jobs); x++)
+			{
+				PLANAR_JOB* job = &jobs[x];
+				job->type = PLANAR_JOB_PLANE_RLE;
+				job->pSrcData = planes[x];
+				job->SrcSize = WINPR_ASSERTING_INT_CAST(uint32_t, rleSizes[x]);
+				job->pDstData = pTempData;
+				job->nDstStep = nTempStep;
+				job->nXDst = nXDst;
+				job->nYDst = nYDst;
+				job->nWidth = nSrcWidth;
+				job->nHeight = nSrcHeight;
+				job->nChannel = channels[x];
+				job->vFlip = vFlip;
+			}
 
-			if (useAlpha)
+			if (!useAlpha)
 			{
-				status = planar_decompress_plane_rle(
-				    planes[3], WINPR_ASSERTING_INT_CAST(uint32_t, rleSizes[3]), pTempData,
-				    nTempStep, nXDst, nYDst, nSrcWidth, nSrcHeight, 3, vFlip); /* AlphaPlane */
+				jobs[3].type = PLANAR_JOB_SET_PLANE;
+				jobs[3].value = 0xFF;
 			}
-			else
-				status = planar_set_plane(0xFF, pTempData, nTempStep, nXDst, nYDst, nSrcWidth,
-				                          nSrcHeight, 3, vFlip);
 
-			if (status < 0)
+			if (!planar_run_jobs(jobs, ARRAYSIZE(jobs),
+			                     planar_use_threads(planar, nSrcWidth, nSrcHeight)))
 				return FALSE;
 
+			srcp += rleSizes[0] + rleSizes[1] + rleSizes[2];
+
 			if (alpha)
 				srcp += rleSizes[3];
 		}
@@ -1067,39 +1243,27 @@ BOOL freerdp_bitmap_decompress_planar(BITMAP_PLANAR_CONTEXT* WINPR_RESTRICT plan
 			rleBuffer[0] = rleBuffer[3] + planeSize; /* LumaOrRedPlane */
 			rleBuffer[1] = rleBuffer[0] + planeSize; /* OrangeChromaOrGreenPlane */
 			rleBuffer[2] = rleBuffer[1] + planeSize; /* GreenChromaOrBluePlane */
-			if (useAlpha)
-			{
-				status = planar_decompress_plane_rle_only(
-				    planes[3], WINPR_ASSERTING_INT_CAST(uint32_t, rleSizes[3]), rleBuffer[3],
-				    rawWidths[3], rawHeights[3]); /* AlphaPlane */
-
-				if (status < 0)
-					return FALSE;
-			}
-
-			if (alpha)
-				srcp += rleSizes[3];
-
-			status = planar_decompress_plane_rle_only(
-			    planes[0], WINPR_ASSERTING_INT_CAST(uint32_t, rleSizes[0]), rleBuffer[0],
-			    rawWidths[0], rawHeights[0]); /* LumaPlane */
 
-			if (status < 0)
-				return FALSE;
+			/* Luma, OrangeChroma, GreenChroma and optionally Alpha */
+			PLANAR_JOB jobs[4] = WINPR_C_ARRAY_INIT;
+			const size_t count = useAlpha ? 4 : 3;
 
-			status = planar_decompress_plane_rle_only(
-			    planes[1], WINPR_ASSERTING_INT_CAST(uint32_t, rleSizes[1]), rleBuffer[1],
-			    rawWidths[1], rawHeights[1]); /* OrangeChromaPlane */
+			for (size_t x = 0; x < count; x++)
+			{
+				PLANAR_JOB* job = &jobs[x];
+				job->type = PLANAR_JOB_PLANE_RLE_ONLY;
+				job->pSrcData = planes[x];
+				job->SrcSize = WINPR_ASSERTING_INT_CAST(uint32_t, rleSizes[x]);
+				job->pDstData = rleBuffer[x];
+				job->nWidth = rawWidths[x];
+				job->nHeight = rawHeights[x];
+			}
 
-			if (status < 0)
+			if (!planar_run_jobs(jobs, count, planar_use_threads(planar, nSrcWidth, nSrcHeight)))
 				return FALSE;
 
-			status = planar_decompress_plane_rle_only(
-			    planes[2], WINPR_ASSERTING_INT_CAST(uint32_t, rleSizes[2]), rleBuffer[2],
-			    rawWidths[2], rawHeights[2]); /* GreenChromaPlane */
-
-			if (status < 0)
-				return FALSE;
+			if (alpha)
+				srcp += rleSizes[3];
 
 			planes[0] = rleBuffer[0];
 			planes[1] = rleBuffer[1];
@@ -1145,15 +1309,9 @@ BOOL freerdp_bitmap_decompress_planar(BITMAP_PLANAR_CONTEXT* WINPR_RESTRICT plan
 				srcp++; /* pad */
 		}
 
-		WINPR_ASSERT(prims->YCoCgToRGB_8u_AC4R);
-		int rc = prims->YCoCgToRGB_8u_AC4R(
-		    pTempData, WINPR_ASSERTING_INT_CAST(int32_t, nTempStep), dst, DstFormat,
-		    WINPR_ASSERTING_INT_CAST(int32_t, nDstStep), w, h, cll, useAlpha);
-		if (rc != PRIMITIVES_SUCCESS)
-		{
-			WLog_ERR(TAG, "YCoCgToRGB_8u_AC4R failed with %d", rc);
+		if (!planar_ycocg_to_rgb(planar, pTempData, nTempStep, dst, DstFormat, nDstStep, w, h,
+		                         cll, useAlpha))
 			return FALSE;
-		}
 	}
 
 	WINPR_UNUSED(srcp);
@@ -1777,6 +1935,13 @@ BOOL freerdp_bitmap_planar_context_reset(BITMAP_PLANAR_CONTEXT* WINPR_RESTRICT c
 
 BITMAP_PLANAR_CONTEXT* freerdp_bitmap_planar_context_new(DWORD flags, UINT32 maxWidth,
                                                          UINT32 maxHeight)
+{
+	return freerdp_bitmap_planar_context_new_ex(flags, maxWidth, maxHeight,
+	                                            THREADING_FLAGS_DISABLE_THREADS);
+}
+
+BITMAP_PLANAR_CONTEXT* freerdp_bitmap_planar_context_new_ex(DWORD flags, UINT32 maxWidth,
+                                                            UINT32 maxHeight, UINT32 ThreadingFlags)
 {
 	BITMAP_PLANAR_CONTEXT* context =
 	    (BITMAP_PLANAR_CONTEXT*)winpr_aligned_calloc(1, sizeof(BITMAP_PLANAR_CONTEXT), 32);
@@ -1798,6 +1963,15 @@ BITMAP_PLANAR_CONTEXT* freerdp_bitmap_planar_context_new(DWORD flags, UINT32 max
 	if (context->ColorLossLevel)
 		context->AllowDynamicColorFidelity = TRUE;
 
+	if (!(ThreadingFlags & THREADING_FLAGS_DISABLE_THREADS) &&
+	    (ThreadingFlags & THREADING_FLAGS_ALLOW_CODEC_THREADS))
+	{
+		SYSTEM_INFO sysInfos = WINPR_C_ARRAY_INIT;
+		GetNativeSystemInfo(&sysInfos);
+		context->nbThreads = sysInfos.dwNumberOfProcessors;
+		context->UseThreads = (context->nbThreads > 1);
+	}
+
 	if (!freerdp_bitmap_planar_context_reset(context, maxWidth, maxHeight))
 	{
 		WINPR_PRAGMA_DIAG_PUSH
@@ -2499,6 +2499,13 @@ BOOL progressive_rfx_write_message_progressive_simple(
 	return rfx_write_message_progressive_simple(context, s, msg);
 }
 
+BOOL progressive_context_set_quantization(PROGRESSIVE_CONTEXT* WINPR_RESTRICT progressive,
+                                          const UINT32* WINPR_RESTRICT quantVals, size_t count)
+{
+	WINPR_ASSERT(progressive);
+	return rfx_context_set_quantization(progressive->rfx_context, quantVals, count);
+}
+
 int progressive_compress(PROGRESSIVE_CONTEXT* WINPR_RESTRICT progressive,
                          const BYTE* WINPR_RESTRICT pSrcData, UINT32 SrcSize, UINT32 SrcFormat,
                          UINT32 Width, UINT32 Height, UINT32 ScanLine,
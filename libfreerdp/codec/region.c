@@ -945,6 +945,679 @@ BOOL region16_intersect_rect(REGION16* dst, const REGION16* src, const RECTANGLE
 	return region16_simplify_bands(dst);
 }
 
+typedef enum
+{
+	REGION16_OP_UNION,
+	REGION16_OP_INTERSECT,
+	REGION16_OP_SUBTRACT
+} region16_op;
+
+/** Scratch memory of the batch operations.
+ *
+ * Both buffers only grow and are kept between operations, so a caller reusing
+ * the scratch does not allocate anything but the output region once the
+ * buffers reached the size of its largest operation.
+ */
+struct S_REGION16_SCRATCH
+{
+	void* arena; /* sweep arrays, see REGION16_SWEEP */
+	size_t arenaSize;
+	void* tiles; /* tile bitmap and tile rectangles of region16_union_rects_tiled */
+	size_t tilesSize;
+};
+
+/** Arrays used by the sweep line engine, all carved out of the scratch arena. */
+typedef struct
+{
+	RECTANGLE_16* sortedA; /* input set A, sorted by top */
+	RECTANGLE_16* sortedB; /* input set B, sorted by top */
+	RECTANGLE_16* activeA; /* rectangles of A crossing the current band, sorted by left */
+	RECTANGLE_16* activeB; /* rectangles of B crossing the current band, sorted by left */
+	UINT16* ys;            /* band boundaries */
+	UINT16* xa;            /* disjoint x spans of A in the current band */
+	UINT16* xb;            /* disjoint x spans of B in the current band */
+	UINT16* xo;            /* resulting x spans in the current band */
+
+	size_t nbA;
+	size_t nbB;
+	size_t nbYs;
+} REGION16_SWEEP;
+
+void region16_scratch_free(REGION16_SCRATCH* scratch)
+{
+	if (!scratch)
+		return;
+
+	free(scratch->arena);
+	free(scratch->tiles);
+	free(scratch);
+}
+
+REGION16_SCRATCH* region16_scratch_new(void)
+{
+	return calloc(1, sizeof(REGION16_SCRATCH));
+}
+
+/** grows a scratch buffer to hold at least size bytes, the content is not preserved */
+WINPR_ATTR_NODISCARD
+static void* region16_scratch_reserve(void** buffer, size_t* bufferSize, size_t size)
+{
+	WINPR_ASSERT(buffer);
+	WINPR_ASSERT(bufferSize);
+
+	if (size <= *bufferSize)
+		return *buffer;
+
+	const size_t newSize = MAX(size, *bufferSize * 2);
+	void* tmp = malloc(newSize);
+	if (!tmp)
+		return nullptr;
+
+	free(*buffer);
+	*buffer = tmp;
+	*bufferSize = newSize;
+	return tmp;
+}
+
+static int region16_compare_top(const void* pva, const void* pvb)
+{
+	const RECTANGLE_16* a = pva;
+	const RECTANGLE_16* b = pvb;
+
+	if (a->top != b->top)
+		return (a->top < b->top) ? -1 : 1;
+	if (a->left != b->left)
+		return (a->left < b->left) ? -1 : 1;
+	return 0;
+}
+
+static int region16_compare_y(const void* pva, const void* pvb)
+{
+	const UINT16* a = pva;
+	const UINT16* b = pvb;
+
+	if (*a != *b)
+		return (*a < *b) ? -1 : 1;
+	return 0;
+}
+
+static size_t region16_copy_non_empty(RECTANGLE_16* dst, const RECTANGLE_16* src, size_t count)
+{
+	size_t used = 0;
+
+	for (size_t x = 0; x < count; x++)
+	{
+		if (!rectangle_is_empty(&src[x]))
+			dst[used++] = src[x];
+	}
+
+	return used;
+}
+
+WINPR_ATTR_NODISCARD
+static BOOL region16_sweep_init(REGION16_SWEEP* sweep, REGION16_SCRATCH* scratch,
+                                const RECTANGLE_16* a, size_t nbA, BOOL sortA,
+                                const RECTANGLE_16* b, size_t nbB, BOOL sortB)
+{
+	WINPR_ASSERT(sweep);
+	WINPR_ASSERT(scratch);
+	WINPR_ASSERT(a || (nbA == 0));
+	WINPR_ASSERT(b || (nbB == 0));
+
+	const REGION16_SWEEP empty = WINPR_C_ARRAY_INIT;
+	*sweep = empty;
+
+	const size_t total = nbA + nbB;
+	if ((total < nbA) || (total > SIZE_MAX / (4 * sizeof(RECTANGLE_16) + 10 * sizeof(UINT16))))
+		return FALSE;
+
+	/* 2 sorted copies + 2 active lists, 2 y coordinates per rectangle
+	 * and 2 x coordinates per rectangle for each of xa, xb and xo (xo may hold both) */
+	const size_t rectBytes = 2 * total * sizeof(RECTANGLE_16);
+	const size_t coordBytes = (2 * total + 2 * nbA + 2 * nbB + 2 * total) * sizeof(UINT16);
+
+	RECTANGLE_16* rects = region16_scratch_reserve(&scratch->arena, &scratch->arenaSize,
+	                                               rectBytes + coordBytes + 1);
+	if (!rects)
+		return FALSE;
+
+	sweep->sortedA = rects;
+	sweep->sortedB = sweep->sortedA + nbA;
+	sweep->activeA = sweep->sortedB + nbB;
+	sweep->activeB = sweep->activeA + nbA;
+
+	UINT16* coords = (UINT16*)(sweep->activeB + nbB);
+	sweep->ys = coords;
+	sweep->xa = sweep->ys + 2 * total;
+	sweep->xb = sweep->xa + 2 * nbA;
+	sweep->xo = sweep->xb + 2 * nbB;
+
+	sweep->nbA = region16_copy_non_empty(sweep->sortedA, a, nbA);
+	sweep->nbB = region16_copy_non_empty(sweep->sortedB, b, nbB);
+
+	if (sortA && (sweep->nbA > 1))
+		qsort(sweep->sortedA, sweep->nbA, sizeof(RECTANGLE_16), region16_compare_top);
+	if (sortB && (sweep->nbB > 1))
+		qsort(sweep->sortedB, sweep->nbB, sizeof(RECTANGLE_16), region16_compare_top);
+
+	size_t nbYs = 0;
+	for (size_t x = 0; x < sweep->nbA; x++)
+	{
+		sweep->ys[nbYs++] = sweep->sortedA[x].top;
+		sweep->ys[nbYs++] = sweep->sortedA[x].bottom;
+	}
+	for (size_t x = 0; x < sweep->nbB; x++)
+	{
+		sweep->ys[nbYs++] = sweep->sortedB[x].top;
+		sweep->ys[nbYs++] = sweep->sortedB[x].bottom;
+	}
+
+	if (nbYs > 1)
+	{
+		qsort(sweep->ys, nbYs, sizeof(UINT16), region16_compare_y);
+
+		size_t unique = 1;
+		for (size_t x = 1; x < nbYs; x++)
+		{
+			if (sweep->ys[x] != sweep->ys[unique - 1])
+				sweep->ys[unique++] = sweep->ys[x];
+		}
+		nbYs = unique;
+	}
+
+	sweep->nbYs = nbYs;
+	return TRUE;
+}
+
+/** updates the list of rectangles crossing the band starting at y and returns
+ * the disjoint x spans they cover as a flat [left, right, left, right, ...] array.
+ *
+ * The active list stays sorted by left between bands: ended rectangles are
+ * removed in order and new ones are merged in, so no band needs a full sort.
+ */
+static size_t region16_band_spans(const RECTANGLE_16* sorted, size_t nbSorted, size_t* nextSorted,
+                                  RECTANGLE_16* active, size_t* nbActive, UINT16 y, UINT16* spans)
+{
+	WINPR_ASSERT(nextSorted);
+	WINPR_ASSERT(nbActive);
+
+	/* drop rectangles that ended, order is preserved */
+	size_t kept = 0;
+	for (size_t x = 0; x < *nbActive; x++)
+	{
+		if (active[x].bottom > y)
+			active[kept++] = active[x];
+	}
+
+	/* every top is a band boundary, so the rectangles starting in this band
+	 * share the same top and the input already orders them by left */
+	const size_t first = *nextSorted;
+	while ((*nextSorted < nbSorted) && (sorted[*nextSorted].top <= y))
+		(*nextSorted)++;
+
+	/* merge them into the active list from the back */
+	size_t added = *nextSorted - first;
+	size_t src = kept;
+	size_t dst = kept + added;
+	*nbActive = dst;
+	while (added > 0)
+	{
+		const RECTANGLE_16* next = &sorted[first + added - 1];
+		if ((src > 0) && (active[src - 1].left > next->left))
+			active[--dst] = active[--src];
+		else
+		{
+			active[--dst] = *next;
+			added--;
+		}
+	}
+	kept = *nbActive;
+
+	/* coalesce overlapping or touching spans */
+	size_t nbSpans = 0;
+	for (size_t x = 0; x < kept; x++)
+	{
+		if ((nbSpans > 0) && (active[x].left <= spans[nbSpans - 1]))
+		{
+			spans[nbSpans - 1] = MAX(spans[nbSpans - 1], active[x].right);
+		}
+		else
+		{
+			spans[nbSpans++] = active[x].left;
+			spans[nbSpans++] = active[x].right;
+		}
+	}
+
+	return nbSpans;
+}
+
+static inline BOOL region16_op_inside(region16_op op, BOOL inA, BOOL inB)
+{
+	switch (op)
+	{
+		case REGION16_OP_UNION:
+			return inA || inB;
+		case REGION16_OP_INTERSECT:
+			return inA && inB;
+		case REGION16_OP_SUBTRACT:
+		default:
+			return inA && !inB;
+	}
+}
+
+/** combines two sets of disjoint spans, boundaries of each set are strictly increasing */
+static size_t region16_combine_spans(region16_op op, const UINT16* xa, size_t nbXa,
+                                     const UINT16* xb, size_t nbXb, UINT16* xo)
+{
+	size_t ia = 0;
+	size_t ib = 0;
+	size_t nbXo = 0;
+	BOOL inA = FALSE;
+	BOOL inB = FALSE;
+	BOOL inside = FALSE;
+
+	while ((ia < nbXa) || (ib < nbXb))
+	{
+		UINT16 x = 0;
+		if (ia >= nbXa)
+			x = xb[ib];
+		else if (ib >= nbXb)
+			x = xa[ia];
+		else
+			x = MIN(xa[ia], xb[ib]);
+
+		if ((ia < nbXa) && (xa[ia] == x))
+		{
+			inA = !inA;
+			ia++;
+		}
+		if ((ib < nbXb) && (xb[ib] == x))
+		{
+			inB = !inB;
+			ib++;
+		}
+
+		const BOOL nowInside = region16_op_inside(op, inA, inB);
+		if (nowInside != inside)
+		{
+			xo[nbXo++] = x;
+			inside = nowInside;
+		}
+	}
+
+	return nbXo;
+}
+
+WINPR_ATTR_NODISCARD
+static BOOL region16_append_band(REGION16_DATA* data, size_t* capacity, size_t* prevBand,
+                                 size_t* prevCount, const UINT16* spans, size_t nbSpans, UINT16 top,
+                                 UINT16 bottom)
+{
+	WINPR_ASSERT(data);
+	WINPR_ASSERT(capacity);
+	WINPR_ASSERT(prevBand);
+	WINPR_ASSERT(prevCount);
+
+	const size_t count = nbSpans / 2;
+	if (count == 0)
+		return TRUE;
+
+	/* extend the previous band if it touches and has the same items */
+	if ((*prevCount == count) && (data->rects[*prevBand].bottom == top))
+	{
+		BOOL match = TRUE;
+		for (size_t x = 0; x < count; x++)
+		{
+			const RECTANGLE_16* cur = &data->rects[*prevBand + x];
+			if ((cur->left != spans[2 * x]) || (cur->right != spans[2 * x + 1]))
+			{
+				match = FALSE;
+				break;
+			}
+		}
+
+		if (match)
+		{
+			for (size_t x = 0; x < count; x++)
+				data->rects[*prevBand + x].bottom = bottom;
+			return TRUE;
+		}
+	}
+
+	if (data->nbRects + count > *capacity)
+	{
+		size_t newCapacity = MAX(*capacity * 2, data->nbRects + count);
+		RECTANGLE_16* rects = realloc(data->rects, newCapacity * sizeof(RECTANGLE_16));
+		if (!rects)
+			return FALSE;
+		data->rects = rects;
+		*capacity = newCapacity;
+	}
+
+	*prevBand = data->nbRects;
+	*prevCount = count;
+	for (size_t x = 0; x < count; x++)
+	{
+		RECTANGLE_16* cur = &data->rects[data->nbRects++];
+		cur->left = spans[2 * x];
+		cur->right = spans[2 * x + 1];
+		cur->top = top;
+		cur->bottom = bottom;
+	}
+
+	return TRUE;
+}
+
+/** computes a boolean operation of two rectangle sets with a single y-x sweep.
+ *
+ * Every distinct top and bottom coordinate opens a band, in each band the spans
+ * of both sets are coalesced and combined. The output is produced directly in
+ * y-x banded form with touching identical bands merged, so there is no need for
+ * the iterative rebuild done by region16_union_rect.
+ */
+WINPR_ATTR_NODISCARD
+static BOOL region16_op_rects(REGION16* dst, region16_op op, const RECTANGLE_16* a, size_t nbA,
+                              BOOL sortA, const RECTANGLE_16* b, size_t nbB, BOOL sortB,
+                              REGION16_SCRATCH* scratch)
+{
+	WINPR_ASSERT(dst);
+	WINPR_ASSERT(scratch);
+
+	BOOL rc = FALSE;
+	REGION16_SWEEP sweep = WINPR_C_ARRAY_INIT;
+	REGION16_DATA* newItems = nullptr;
+
+	if (!region16_sweep_init(&sweep, scratch, a, nbA, sortA, b, nbB, sortB))
+		goto fail;
+
+	newItems = allocateRegion(0);
+	if (!newItems)
+		goto fail;
+
+	{
+		size_t capacity = 0;
+		size_t prevBand = 0;
+		size_t prevCount = 0;
+		size_t nextA = 0;
+		size_t nextB = 0;
+		size_t nbActiveA = 0;
+		size_t nbActiveB = 0;
+
+		for (size_t y = 0; y + 1 < sweep.nbYs; y++)
+		{
+			const UINT16 top = sweep.ys[y];
+			const UINT16 bottom = sweep.ys[y + 1];
+
+			const size_t nbXa = region16_band_spans(sweep.sortedA, sweep.nbA, &nextA,
+			                                        sweep.activeA, &nbActiveA, top, sweep.xa);
+			const size_t nbXb = region16_band_spans(sweep.sortedB, sweep.nbB, &nextB,
+			                                        sweep.activeB, &nbActiveB, top, sweep.xb);
+			const size_t nbXo =
+			    region16_combine_spans(op, sweep.xa, nbXa, sweep.xb, nbXb, sweep.xo);
+
+			if (!region16_append_band(newItems, &capacity, &prevBand, &prevCount, sweep.xo,
+			                          nbXo, top, bottom))
+				goto fail;
+		}
+	}
+
+	if (newItems->nbRects == 0)
+	{
+		region16_clear(dst);
+		rc = TRUE;
+		goto fail;
+	}
+
+	{
+		RECTANGLE_16 extents = newItems->rects[0];
+		extents.bottom = newItems->rects[newItems->nbRects - 1].bottom;
+		for (size_t x = 1; x < newItems->nbRects; x++)
+		{
+			extents.left = MIN(extents.left, newItems->rects[x].left);
+			extents.right = MAX(extents.right, newItems->rects[x].right);
+		}
+
+		freeRegion(dst->data);
+		dst->data = newItems;
+		dst->extents = extents;
+		newItems = nullptr;
+	}
+
+	rc = TRUE;
+fail:
+	freeRegion(newItems);
+	return rc;
+}
+
+/** runs region16_op_rects with the caller scratch or a temporary one */
+WINPR_ATTR_NODISCARD
+static BOOL region16_op_rects_scratch(REGION16* dst, region16_op op, const RECTANGLE_16* a,
+                                      size_t nbA, BOOL sortA, const RECTANGLE_16* b, size_t nbB,
+                                      BOOL sortB, REGION16_SCRATCH* scratch)
+{
+	if (scratch)
+		return region16_op_rects(dst, op, a, nbA, sortA, b, nbB, sortB, scratch);
+
+	REGION16_SCRATCH tmp = WINPR_C_ARRAY_INIT;
+	const BOOL rc = region16_op_rects(dst, op, a, nbA, sortA, b, nbB, sortB, &tmp);
+	free(tmp.arena);
+	free(tmp.tiles);
+	return rc;
+}
+
+BOOL region16_union_rects(REGION16* dst, const REGION16* src, const RECTANGLE_16* rects,
+                          size_t count, REGION16_SCRATCH* scratch)
+{
+	WINPR_ASSERT(dst);
+	WINPR_ASSERT(src);
+	WINPR_ASSERT(rects || (count == 0));
+
+	if (count == 0)
+		return region16_copy(dst, src);
+
+	UINT32 nbSrcRects = 0;
+	const RECTANGLE_16* srcRects = region16_rects(src, &nbSrcRects);
+	return region16_op_rects_scratch(dst, REGION16_OP_UNION, srcRects, nbSrcRects, FALSE, rects,
+	                                 count, TRUE, scratch);
+}
+
+/* The tile bitmap of region16_union_rects_tiled is limited to this many tiles,
+ * larger extents use the exact union */
+#define REGION16_MAX_TILES (1024 * 1024)
+
+/** marks the tiles touched by rects in a bitmap and emits the rows of marked tiles as
+ * banded rectangles into the tile buffer of the scratch */
+WINPR_ATTR_NODISCARD
+static BOOL region16_tiles_rasterize(REGION16_SCRATCH* scratch, const RECTANGLE_16* rects,
+                                     size_t count, UINT16 tileSize, RECTANGLE_16** tileRects,
+                                     size_t* nbTileRects)
+{
+	WINPR_ASSERT(scratch);
+	WINPR_ASSERT(tileRects);
+	WINPR_ASSERT(nbTileRects);
+
+	*tileRects = nullptr;
+	*nbTileRects = 0;
+
+	BOOL found = FALSE;
+	RECTANGLE_16 extents = WINPR_C_ARRAY_INIT;
+	for (size_t x = 0; x < count; x++)
+	{
+		const RECTANGLE_16* rect = &rects[x];
+		if (rectangle_is_empty(rect))
+			continue;
+
+		if (!found)
+			extents = *rect;
+		extents.left = MIN(extents.left, rect->left);
+		extents.top = MIN(extents.top, rect->top);
+		extents.right = MAX(extents.right, rect->right);
+		extents.bottom = MAX(extents.bottom, rect->bottom);
+		found = TRUE;
+	}
+
+	if (!found)
+		return TRUE;
+
+	/* the grid is anchored at 0/0 so tiles of different calls line up */
+	const size_t col0 = extents.left / tileSize;
+	const size_t row0 = extents.top / tileSize;
+	const size_t cols = (extents.right + tileSize - 1ull) / tileSize - col0;
+	const size_t rows = (extents.bottom + tileSize - 1ull) / tileSize - row0;
+	if (cols * rows > REGION16_MAX_TILES)
+		return FALSE;
+
+	/* a row of n tiles holds at most (n + 1) / 2 runs */
+	const size_t bitmapBytes = cols * rows;
+	const size_t rectBytes = rows * ((cols + 1) / 2) * sizeof(RECTANGLE_16);
+	BYTE* bitmap = region16_scratch_reserve(&scratch->tiles, &scratch->tilesSize,
+	                                        rectBytes + bitmapBytes);
+	if (!bitmap)
+		return FALSE;
+
+	RECTANGLE_16* out = (RECTANGLE_16*)bitmap;
+	bitmap += rectBytes;
+	memset(bitmap, 0, bitmapBytes);
+
+	for (size_t x = 0; x < count; x++)
+	{
+		const RECTANGLE_16* rect = &rects[x];
+		if (rectangle_is_empty(rect))
+			continue;
+
+		const size_t left = rect->left / tileSize - col0;
+		const size_t right = (rect->right + tileSize - 1ull) / tileSize - col0;
+		const size_t top = rect->top / tileSize - row0;
+		const size_t bottom = (rect->bottom + tileSize - 1ull) / tileSize - row0;
+		for (size_t row = top; row < bottom; row++)
+			memset(&bitmap[row * cols + left], 1, right - left);
+	}
+
+	size_t used = 0;
+	for (size_t row = 0; row < rows; row++)
+	{
+		const BYTE* line = &bitmap[row * cols];
+		const size_t y = (row0 + row) * tileSize;
+
+		for (size_t col = 0; col < cols;)
+		{
+			if (!line[col])
+			{
+				col++;
+				continue;
+			}
+
+			const size_t start = col;
+			while ((col < cols) && line[col])
+				col++;
+
+			RECTANGLE_16* cur = &out[used++];
+			cur->left = (UINT16)((col0 + start) * tileSize);
+			cur->right = (UINT16)MIN(UINT16_MAX, (col0 + col) * tileSize);
+			cur->top = (UINT16)y;
+			cur->bottom = (UINT16)MIN(UINT16_MAX, y + tileSize);
+		}
+	}
+
+	*tileRects = out;
+	*nbTileRects = used;
+	return TRUE;
+}
+
+BOOL region16_union_rects_tiled(REGION16* dst, const REGION16* src, const RECTANGLE_16* rects,
+                                size_t count, UINT16 tileSize, REGION16_SCRATCH* scratch)
+{
+	WINPR_ASSERT(dst);
+	WINPR_ASSERT(src);
+	WINPR_ASSERT(rects || (count == 0));
+
+	if (tileSize < 8)
+		return FALSE;
+
+	if (count == 0)
+		return region16_copy(dst, src);
+
+	REGION16_SCRATCH tmp = WINPR_C_ARRAY_INIT;
+	REGION16_SCRATCH* cur = scratch ? scratch : &tmp;
+	RECTANGLE_16* tileRects = nullptr;
+	size_t nbTileRects = 0;
+	BOOL rc = FALSE;
+
+	if (!region16_tiles_rasterize(cur, rects, count, tileSize, &tileRects, &nbTileRects))
+	{
+		/* too many tiles or no memory for the bitmap, fall back to the exact union */
+		rc = region16_union_rects(dst, src, rects, count, cur);
+		goto out;
+	}
+
+	if (nbTileRects == 0)
+	{
+		rc = region16_copy(dst, src);
+		goto out;
+	}
+
+	{
+		/* the tile rows are already sorted by top and left */
+		UINT32 nbSrcRects = 0;
+		const RECTANGLE_16* srcRects = region16_rects(src, &nbSrcRects);
+		rc = region16_op_rects(dst, REGION16_OP_UNION, srcRects, nbSrcRects, FALSE, tileRects,
+		                       nbTileRects, FALSE, cur);
+	}
+
+out:
+	free(tmp.arena);
+	free(tmp.tiles);
+	return rc;
+}
+
+BOOL region16_intersect_region(REGION16* dst, const REGION16* src1, const REGION16* src2,
+                               REGION16_SCRATCH* scratch)
+{
+	WINPR_ASSERT(dst);
+	WINPR_ASSERT(src1);
+	WINPR_ASSERT(src2);
+
+	UINT32 nbRects1 = 0;
+	UINT32 nbRects2 = 0;
+	const RECTANGLE_16* rects1 = region16_rects(src1, &nbRects1);
+	const RECTANGLE_16* rects2 = region16_rects(src2, &nbRects2);
+
+	if ((nbRects1 == 0) || (nbRects2 == 0) ||
+	    !rectangles_intersects(region16_extents(src1), region16_extents(src2)))
+	{
+		region16_clear(dst);
+		return TRUE;
+	}
+
+	return region16_op_rects_scratch(dst, REGION16_OP_INTERSECT, rects1, nbRects1, FALSE, rects2,
+	                                 nbRects2, FALSE, scratch);
+}
+
+BOOL region16_subtract(REGION16* dst, const REGION16* src1, const REGION16* src2,
+                       REGION16_SCRATCH* scratch)
+{
+	WINPR_ASSERT(dst);
+	WINPR_ASSERT(src1);
+	WINPR_ASSERT(src2);
+
+	UINT32 nbRects1 = 0;
+	UINT32 nbRects2 = 0;
+	const RECTANGLE_16* rects1 = region16_rects(src1, &nbRects1);
+	const RECTANGLE_16* rects2 = region16_rects(src2, &nbRects2);
+
+	if (nbRects1 == 0)
+	{
+		region16_clear(dst);
+		return TRUE;
+	}
+
+	if ((nbRects2 == 0) || !rectangles_intersects(region16_extents(src1), region16_extents(src2)))
+		return region16_copy(dst, src1);
+
+	return region16_op_rects_scratch(dst, REGION16_OP_SUBTRACT, rects1, nbRects1, FALSE, rects2,
+	                                 nbRects2, FALSE, scratch);
+}
+
 void region16_uninit(REGION16* region)
 {
 	WINPR_ASSERT(region);
@@ -2259,6 +2259,39 @@ UINT32 rfx_context_get_frame_idx(const RFX_CONTEXT* WINPR_RESTRICT context)
 	return context->frameIdx;
 }
 
+BOOL rfx_context_set_quantization(RFX_CONTEXT* WINPR_RESTRICT context,
+                                  const UINT32* WINPR_RESTRICT quantVals, size_t count)
+{
+	WINPR_ASSERT(context);
+	WINPR_ASSERT(quantVals || (count == 0));
+
+	if (count != NR_QUANT_VALUES)
+		return FALSE;
+
+	for (size_t i = 0; i < count; i++)
+	{
+		if ((quantVals[i] < 6) || (quantVals[i] > 15))
+			return FALSE;
+	}
+
+	/* Messages reference the context table, so it is updated in place once allocated */
+	if (context->numQuant != 1)
+	{
+		UINT32* quants = (UINT32*)winpr_aligned_recalloc(context->quants, NR_QUANT_VALUES,
+		                                                 sizeof(UINT32), 32);
+		if (!quants)
+			return FALSE;
+		context->quants = quants;
+		context->numQuant = 1;
+		context->quantIdxY = 0;
+		context->quantIdxCb = 0;
+		context->quantIdxCr = 0;
+	}
+
+	CopyMemory(context->quants, quantVals, NR_QUANT_VALUES * sizeof(UINT32));
+	return TRUE;
+}
+
 UINT32 rfx_message_get_frame_idx(const RFX_MESSAGE* WINPR_RESTRICT message)
 {
 	WINPR_ASSERT(message);
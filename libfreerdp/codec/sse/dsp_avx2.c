@@ -0,0 +1,73 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Digital Sound Processing - AVX2 Optimizations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <winpr/assert.h>
+#include <winpr/platform.h>
+#include <freerdp/config.h>
+
+#include "dsp_sse2.h"
+
+#include "../../core/simd.h"
+
+#if defined(SSE_AVX_INTRINSICS_ENABLED)
+#include <immintrin.h>
+
+static INT32 avx2_dot(const INT16* WINPR_RESTRICT a, const INT16* WINPR_RESTRICT b, size_t count)
+{
+	WINPR_ASSERT((count % 16) == 0);
+
+	__m256i acc0 = _mm256_setzero_si256();
+	__m256i acc1 = _mm256_setzero_si256();
+	size_t x = 0;
+
+	for (; x + 32 <= count; x += 32)
+	{
+		const __m256i a0 = _mm256_loadu_si256((const __m256i*)&a[x]);
+		const __m256i b0 = _mm256_loadu_si256((const __m256i*)&b[x]);
+		const __m256i a1 = _mm256_loadu_si256((const __m256i*)&a[x + 16]);
+		const __m256i b1 = _mm256_loadu_si256((const __m256i*)&b[x + 16]);
+		acc0 = _mm256_add_epi32(acc0, _mm256_madd_epi16(a0, b0));
+		acc1 = _mm256_add_epi32(acc1, _mm256_madd_epi16(a1, b1));
+	}
+
+	for (; x < count; x += 16)
+	{
+		const __m256i a0 = _mm256_loadu_si256((const __m256i*)&a[x]);
+		const __m256i b0 = _mm256_loadu_si256((const __m256i*)&b[x]);
+		acc0 = _mm256_add_epi32(acc0, _mm256_madd_epi16(a0, b0));
+	}
+
+	const __m256i acc256 = _mm256_add_epi32(acc0, acc1);
+	__m128i acc =
+	    _mm_add_epi32(_mm256_castsi256_si128(acc256), _mm256_extracti128_si256(acc256, 1));
+	acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+	acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2, 3, 0, 1)));
+	return _mm_cvtsi128_si32(acc);
+}
+#endif
+
+void dsp_init_avx2_int(FREERDP_DSP_KERNELS* WINPR_RESTRICT kernels)
+{
+#if defined(SSE_AVX_INTRINSICS_ENABLED)
+	WLog_VRB(PRIM_TAG, "AVX2 optimizations");
+	/* The channel mixers are memory bound, the SSE2 versions are kept */
+	kernels->dot = avx2_dot;
+#else
+	WINPR_UNUSED(kernels);
+	WLog_VRB(PRIM_TAG, "undefined WITH_SIMD or WITH_AVX2 or AVX2 intrinsics not available");
+#endif
+}
@@ -0,0 +1,106 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Digital Sound Processing - SSE2 Optimizations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <winpr/assert.h>
+#include <winpr/platform.h>
+#include <freerdp/config.h>
+
+#include "dsp_sse2.h"
+
+#include "../../core/simd.h"
+
+#if defined(SSE_AVX_INTRINSICS_ENABLED)
+#include <emmintrin.h>
+
+static INT32 sse2_dot(const INT16* WINPR_RESTRICT a, const INT16* WINPR_RESTRICT b, size_t count)
+{
+	WINPR_ASSERT((count % 8) == 0);
+
+	__m128i acc0 = _mm_setzero_si128();
+	__m128i acc1 = _mm_setzero_si128();
+	size_t x = 0;
+
+	for (; x + 16 <= count; x += 16)
+	{
+		const __m128i a0 = _mm_loadu_si128((const __m128i*)&a[x]);
+		const __m128i b0 = _mm_loadu_si128((const __m128i*)&b[x]);
+		const __m128i a1 = _mm_loadu_si128((const __m128i*)&a[x + 8]);
+		const __m128i b1 = _mm_loadu_si128((const __m128i*)&b[x + 8]);
+		acc0 = _mm_add_epi32(acc0, _mm_madd_epi16(a0, b0));
+		acc1 = _mm_add_epi32(acc1, _mm_madd_epi16(a1, b1));
+	}
+
+	for (; x < count; x += 8)
+	{
+		const __m128i a0 = _mm_loadu_si128((const __m128i*)&a[x]);
+		const __m128i b0 = _mm_loadu_si128((const __m128i*)&b[x]);
+		acc0 = _mm_add_epi32(acc0, _mm_madd_epi16(a0, b0));
+	}
+
+	__m128i acc = _mm_add_epi32(acc0, acc1);
+	acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+	acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2, 3, 0, 1)));
+	return _mm_cvtsi128_si32(acc);
+}
+
+static void sse2_mono_to_stereo(const BYTE* WINPR_RESTRICT src, BYTE* WINPR_RESTRICT dst,
+                                size_t frames)
+{
+	size_t x = 0;
+
+	for (; x + 8 <= frames; x += 8)
+	{
+		const __m128i mono = _mm_loadu_si128((const __m128i*)&src[2 * x]);
+		_mm_storeu_si128((__m128i*)&dst[4 * x], _mm_unpacklo_epi16(mono, mono));
+		_mm_storeu_si128((__m128i*)&dst[4 * x + 16], _mm_unpackhi_epi16(mono, mono));
+	}
+
+	freerdp_dsp_kernels_get_generic()->mono_to_stereo(&src[2 * x], &dst[4 * x], frames - x);
+}
+
+static void sse2_stereo_to_mono(const BYTE* WINPR_RESTRICT src, BYTE* WINPR_RESTRICT dst,
+                                size_t frames)
+{
+	const __m128i ones = _mm_set1_epi16(1);
+	size_t x = 0;
+
+	for (; x + 8 <= frames; x += 8)
+	{
+		const __m128i s0 = _mm_loadu_si128((const __m128i*)&src[4 * x]);
+		const __m128i s1 = _mm_loadu_si128((const __m128i*)&src[4 * x + 16]);
+		/* left + right as 32bit, halved, the result always fits 16bit again */
+		const __m128i m0 = _mm_srai_epi32(_mm_madd_epi16(s0, ones), 1);
+		const __m128i m1 = _mm_srai_epi32(_mm_madd_epi16(s1, ones), 1);
+		_mm_storeu_si128((__m128i*)&dst[2 * x], _mm_packs_epi32(m0, m1));
+	}
+
+	freerdp_dsp_kernels_get_generic()->stereo_to_mono(&src[4 * x], &dst[2 * x], frames - x);
+}
+#endif
+
+void dsp_init_sse2_int(FREERDP_DSP_KERNELS* WINPR_RESTRICT kernels)
+{
+#if defined(SSE_AVX_INTRINSICS_ENABLED)
+	WLog_VRB(PRIM_TAG, "SSE2 optimizations");
+	kernels->dot = sse2_dot;
+	kernels->mono_to_stereo = sse2_mono_to_stereo;
+	kernels->stereo_to_mono = sse2_stereo_to_mono;
+#else
+	WINPR_UNUSED(kernels);
+	WLog_VRB(PRIM_TAG, "undefined WITH_SIMD or SSE2 intrinsics not available");
+#endif
+}
@@ -0,0 +1,48 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Digital Sound Processing - SSE2/AVX2 Optimizations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FREERDP_LIB_CODEC_DSP_SSE2_H
+#define FREERDP_LIB_CODEC_DSP_SSE2_H
+
+#include <winpr/sysinfo.h>
+
+#include <freerdp/config.h>
+#include <freerdp/api.h>
+
+#include "../dsp_resample.h"
+
+FREERDP_LOCAL void dsp_init_sse2_int(FREERDP_DSP_KERNELS* WINPR_RESTRICT kernels);
+static inline void dsp_init_sse2(FREERDP_DSP_KERNELS* WINPR_RESTRICT kernels)
+{
+	if (!IsProcessorFeaturePresent(PF_SSE2_INSTRUCTIONS_AVAILABLE))
+		return;
+
+	dsp_init_sse2_int(kernels);
+}
+
+#if defined(WITH_AVX2)
+FREERDP_LOCAL void dsp_init_avx2_int(FREERDP_DSP_KERNELS* WINPR_RESTRICT kernels);
+static inline void dsp_init_avx2(FREERDP_DSP_KERNELS* WINPR_RESTRICT kernels)
+{
+	if (!IsProcessorFeaturePresent(PF_AVX2_INSTRUCTIONS_AVAILABLE))
+		return;
+
+	dsp_init_avx2_int(kernels);
+}
+#endif
+
+#endif /* FREERDP_LIB_CODEC_DSP_SSE2_H */
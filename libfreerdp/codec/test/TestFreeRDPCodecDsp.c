@@ -0,0 +1,231 @@
+#include <math.h>
+
+#include <winpr/crt.h>
+#include <winpr/sysinfo.h>
+#include <winpr/stream.h>
+
+#include <freerdp/config.h>
+#include <freerdp/codec/dsp.h>
+#include <freerdp/codec/audio.h>
+
+#define TEST_PI 3.14159265358979323846
+
+static AUDIO_FORMAT test_format(UINT32 rate, UINT16 channels)
+{
+	AUDIO_FORMAT format = WINPR_C_ARRAY_INIT;
+	format.wFormatTag = WAVE_FORMAT_PCM;
+	format.nChannels = channels;
+	format.nSamplesPerSec = rate;
+	format.wBitsPerSample = 16;
+	format.nBlockAlign = 2 * channels;
+	format.nAvgBytesPerSec = format.nBlockAlign * rate;
+	return format;
+}
+
+static void test_sine(BYTE* data, size_t frames, UINT16 channels, UINT32 rate, size_t offset)
+{
+	for (size_t x = 0; x < frames; x++)
+	{
+		const double t = (double)(x + offset) / rate;
+		for (UINT16 c = 0; c < channels; c++)
+		{
+			/* different tone per channel to catch swapped or mixed channels */
+			const double v = 16384.0 * sin(2.0 * TEST_PI * (1000.0 + 250.0 * c) * t);
+			const INT16 s = (INT16)lround(v);
+			data[(x * channels + c) * 2] = (BYTE)(s & 0xFF);
+			data[(x * channels + c) * 2 + 1] = (BYTE)((s >> 8) & 0xFF);
+		}
+	}
+}
+
+static INT16 test_sample(const BYTE* data, size_t index)
+{
+	return (INT16)(data[2 * index] | (data[2 * index + 1] << 8));
+}
+
+#if !defined(WITH_DSP_FFMPEG)
+static BOOL test_channel_mix(UINT16 srcChannels, UINT16 dstChannels)
+{
+	BOOL rc = FALSE;
+	const size_t frames = 1027;
+	const AUDIO_FORMAT src = test_format(44100, srcChannels);
+	const AUDIO_FORMAT dst = test_format(44100, dstChannels);
+	BYTE* data = calloc(frames * srcChannels, 2);
+	FREERDP_DSP_CONTEXT* context = freerdp_dsp_context_new(TRUE);
+	wStream* out = Stream_New(nullptr, 1024);
+
+	if (!data || !context || !out)
+		goto fail;
+
+	for (size_t x = 0; x < frames * srcChannels; x++)
+	{
+		const INT16 s = (INT16)((x * 7919) ^ 0x5A5A);
+		data[2 * x] = (BYTE)(s & 0xFF);
+		data[2 * x + 1] = (BYTE)((s >> 8) & 0xFF);
+	}
+
+	if (!freerdp_dsp_context_reset(context, &dst, 0))
+		goto fail;
+	if (!freerdp_dsp_encode(context, &src, data, frames * srcChannels * 2, out))
+		goto fail;
+	if (Stream_GetPosition(out) != frames * dstChannels * 2)
+		goto fail;
+
+	for (size_t x = 0; x < frames; x++)
+	{
+		const BYTE* res = Stream_Buffer(out);
+		if (srcChannels == 1)
+		{
+			const INT16 s = test_sample(data, x);
+			if ((test_sample(res, 2 * x) != s) || (test_sample(res, 2 * x + 1) != s))
+				goto fail;
+		}
+		else
+		{
+			const INT32 l = test_sample(data, 2 * x);
+			const INT32 r = test_sample(data, 2 * x + 1);
+			if (test_sample(res, x) != (INT16)((l + r) >> 1))
+				goto fail;
+		}
+	}
+
+	rc = TRUE;
+fail:
+	if (!rc)
+		(void)fprintf(stderr, "channel mix %" PRIu16 " -> %" PRIu16 " failed\n", srcChannels,
+		              dstChannels);
+	Stream_Free(out, TRUE);
+	freerdp_dsp_context_free(context);
+	free(data);
+	return rc;
+}
+#endif
+
+#if !defined(WITH_SOXR) && !defined(WITH_DSP_FFMPEG)
+/* Resample one second of a sine in 10ms packets and compare with the analytic signal */
+static BOOL test_resample(UINT32 srcRate, UINT32 dstRate)
+{
+	BOOL rc = FALSE;
+	const UINT16 channels = 2;
+	const size_t packet = srcRate / 100;
+	const AUDIO_FORMAT src = test_format(srcRate, channels);
+	const AUDIO_FORMAT dst = test_format(dstRate, channels);
+	BYTE* data = calloc(packet * channels, 2);
+	FREERDP_DSP_CONTEXT* context = freerdp_dsp_context_new(TRUE);
+	wStream* out = Stream_New(nullptr, 1024);
+	double signal = 0.0;
+	double noise = 0.0;
+
+	if (!data || !context || !out)
+		goto fail;
+
+	if (!freerdp_dsp_context_reset(context, &dst, 0))
+		goto fail;
+
+	for (size_t x = 0; x < 100; x++)
+	{
+		test_sine(data, packet, channels, srcRate, x * packet);
+		if (!freerdp_dsp_encode(context, &src, data, packet * channels * 2, out))
+			goto fail;
+	}
+
+	const size_t frames = Stream_GetPosition(out) / channels / 2;
+	if ((frames < dstRate * 95 / 100) || (frames > dstRate))
+		goto fail;
+
+	/* skip the filter ramp up */
+	for (size_t x = dstRate / 100; x < frames; x++)
+	{
+		const double t = (double)x / dstRate;
+		for (UINT16 c = 0; c < channels; c++)
+		{
+			const double ref = 16384.0 * sin(2.0 * TEST_PI * (1000.0 + 250.0 * c) * t);
+			const double diff = test_sample(Stream_Buffer(out), x * channels + c) - ref;
+			signal += ref * ref;
+			noise += diff * diff;
+		}
+	}
+
+	const double snr = 10.0 * log10(signal / (noise + 1e-9));
+	printf("resample %" PRIu32 " -> %" PRIu32 ": %" PRIuz " frames, SNR %.1f dB\n", srcRate,
+	       dstRate, frames, snr);
+	rc = snr > 65.0;
+fail:
+	if (!rc)
+		(void)fprintf(stderr, "resample %" PRIu32 " -> %" PRIu32 " failed\n", srcRate, dstRate);
+	Stream_Free(out, TRUE);
+	freerdp_dsp_context_free(context);
+	free(data);
+	return rc;
+}
+
+/* Ten seconds of 44.1kHz stereo to 48kHz, must be way faster than real time */
+static BOOL test_resample_throughput(void)
+{
+	BOOL rc = FALSE;
+	const size_t packet = 441;
+	const AUDIO_FORMAT src = test_format(44100, 2);
+	const AUDIO_FORMAT dst = test_format(48000, 2);
+	BYTE* data = calloc(packet * 2, 2);
+	FREERDP_DSP_CONTEXT* context = freerdp_dsp_context_new(TRUE);
+	wStream* out = Stream_New(nullptr, 4096);
+
+	if (!data || !context || !out)
+		goto fail;
+
+	if (!freerdp_dsp_context_reset(context, &dst, 0))
+		goto fail;
+
+	test_sine(data, packet, 2, 44100, 0);
+
+	const UINT64 start = winpr_GetTickCount64NS();
+	for (size_t x = 0; x < 1000; x++)
+	{
+		Stream_ResetPosition(out);
+		if (!freerdp_dsp_encode(context, &src, data, packet * 2 * 2, out))
+			goto fail;
+	}
+	const UINT64 duration = winpr_GetTickCount64NS() - start;
+
+	printf("resample 44100 -> 48000: 10s of stereo audio in %" PRIu64 " ms\n",
+	       duration / 1000000ull);
+	rc = duration < 10ull * 1000ull * 1000ull * 1000ull;
+fail:
+	Stream_Free(out, TRUE);
+	freerdp_dsp_context_free(context);
+	free(data);
+	return rc;
+}
+#endif
+
+int TestFreeRDPCodecDsp(int argc, char* argv[])
+{
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+#if !defined(WITH_DSP_FFMPEG)
+	if (!test_channel_mix(1, 2))
+		return -1;
+	if (!test_channel_mix(2, 1))
+		return -1;
+#endif
+
+#if !defined(WITH_SOXR) && !defined(WITH_DSP_FFMPEG)
+	const UINT32 rates[] = { 8000, 16000, 44100, 48000 };
+	for (size_t x = 0; x < ARRAYSIZE(rates); x++)
+	{
+		for (size_t y = 0; y < ARRAYSIZE(rates); y++)
+		{
+			if (x == y)
+				continue;
+			if (!test_resample(rates[x], rates[y]))
+				return -1;
+		}
+	}
+
+	if (!test_resample_throughput())
+		return -1;
+#endif
+
+	return 0;
+}
@@ -37,7 +37,8 @@ static BOOL testContextOptions(BOOL compressor, uint32_t width, uint32_t height)
 		                                 { H264_CONTEXT_OPTION_BITRATE, 2323 },
 		                                 { H264_CONTEXT_OPTION_FRAMERATE, 23 },
 		                                 { H264_CONTEXT_OPTION_QP, 21 },
-		                                 { H264_CONTEXT_OPTION_USAGETYPE, 23 } };
+		                                 { H264_CONTEXT_OPTION_USAGETYPE, 23 },
+		                                 { H264_CONTEXT_OPTION_SLICES, 4 } };
 	for (size_t x = 0; x < ARRAYSIZE(optpair); x++)
 	{
 		const struct optpair_s* cur = &optpair[x];
@@ -194,6 +195,60 @@ fail:
 	return rc;
 }
 
+/* counts the coded slice NAL units of an annex B stream */
+static size_t countSlices(const BYTE* data, size_t size)
+{
+	size_t count = 0;
+	for (size_t x = 0; x + 3 < size; x++)
+	{
+		if ((data[x] != 0) || (data[x + 1] != 0) || (data[x + 2] != 1))
+			continue;
+
+		const BYTE type = data[x + 3] & 0x1f;
+		if ((type == 1) || (type == 5))
+			count++;
+		x += 2;
+	}
+	return count;
+}
+
+static BOOL testEncodeSlices(UINT32 option, size_t expected)
+{
+	BOOL rc = FALSE;
+	const UINT32 width = 256;
+	const UINT32 height = 256;
+	const UINT32 format = PIXEL_FORMAT_BGRX32;
+	const RECTANGLE_16 rect = { .left = 0, .top = 0, .right = width, .bottom = height };
+	RDPGFX_H264_METABLOCK meta = WINPR_C_ARRAY_INIT;
+	H264_CONTEXT* h264 = h264_context_new(TRUE);
+	UINT32 stride = 0;
+	BYTE* src = allocRGB(format, width, height, &stride);
+	BYTE* dst = nullptr;
+	UINT32 dstSize = 0;
+
+	if (!h264 || !src || !h264_context_set_option(h264, H264_CONTEXT_OPTION_SLICES, option) ||
+	    !h264_context_reset(h264, width, height))
+		goto fail;
+
+	if (avc420_compress(h264, src, format, stride, width, height, &rect, &dst, &dstSize, &meta) < 0)
+		goto fail;
+
+	const size_t slices = countSlices(dst, dstSize);
+	if (slices != expected)
+	{
+		(void)fprintf(stderr, "%s failed: option %" PRIu32 " encoded %" PRIuz " slices\n",
+		              __func__, option, slices);
+		goto fail;
+	}
+
+	rc = TRUE;
+fail:
+	h264_context_free(h264);
+	free_h264_metablock(&meta);
+	free(src);
+	return rc;
+}
+
 int TestFreeRDPCodecH264(int argc, char* argv[])
 {
 	WINPR_UNUSED(argc);
@@ -235,6 +290,10 @@ int TestFreeRDPCodecH264(int argc, char* argv[])
 	if (!testEncodeOffsetRegion())
 		return -1;
 
+	/* frames are a single slice unless more are requested */
+	if (!testEncodeSlices(0, 1) || !testEncodeSlices(4, 4))
+		return -1;
+
 	for (size_t x = 0; x < ARRAYSIZE(formats); x++)
 	{
 		const UINT32 SrcFormat = formats[x];
@@ -406,6 +406,72 @@ fail:
 	return rc;
 }
 
+static BOOL TestPlanarThreaded(void)
+{
+	BOOL rc = FALSE;
+	const UINT32 width = 512;
+	const UINT32 height = 512;
+	const UINT32 format = PIXEL_FORMAT_BGRX32;
+	const UINT32 stride = width * FreeRDPGetBytesPerPixel(format);
+	const DWORD planarFlags = PLANAR_FORMAT_HEADER_NA | PLANAR_FORMAT_HEADER_RLE;
+	UINT32 dstSize = 0;
+	BYTE* compressed = nullptr;
+	BYTE* src = calloc(height, stride);
+	BYTE* plain = calloc(height, stride);
+	BYTE* threaded = calloc(height, stride);
+	BITMAP_PLANAR_CONTEXT* encplanar =
+	    freerdp_bitmap_planar_context_new(planarFlags, width, height);
+	BITMAP_PLANAR_CONTEXT* decplanar =
+	    freerdp_bitmap_planar_context_new(planarFlags, width, height);
+	BITMAP_PLANAR_CONTEXT* mtplanar = freerdp_bitmap_planar_context_new_ex(
+	    planarFlags, width, height, THREADING_FLAGS_ALLOW_CODEC_THREADS);
+
+	if (!src || !plain || !threaded || !encplanar || !decplanar || !mtplanar)
+		goto fail;
+
+	for (UINT32 y = 0; y < height; y++)
+	{
+		for (UINT32 x = 0; x < width; x++)
+		{
+			const UINT32 color =
+			    FreeRDPGetColor(format, (BYTE)(x / 8), (BYTE)(y / 8), (BYTE)((x + y) / 16), 0xFF);
+			if (!FreeRDPWriteColor(&src[1ull * y * stride + 4ull * x], format, color))
+				goto fail;
+		}
+	}
+
+	compressed =
+	    freerdp_bitmap_compress_planar(encplanar, src, format, width, height, 0, nullptr, &dstSize);
+	if (!compressed)
+		goto fail;
+
+	if (!freerdp_bitmap_decompress_planar(decplanar, compressed, dstSize, width, height, plain,
+	                                      format, 0, 0, 0, width, height, FALSE))
+		goto fail;
+
+	if (!freerdp_bitmap_decompress_planar(mtplanar, compressed, dstSize, width, height, threaded,
+	                                      format, 0, 0, 0, width, height, FALSE))
+		goto fail;
+
+	if (memcmp(plain, threaded, 1ull * height * stride) != 0)
+	{
+		(void)fprintf(stderr, "threaded planar decoding differs from sequential decoding\n");
+		goto fail;
+	}
+
+	rc = TRUE;
+fail:
+	freerdp_bitmap_planar_context_free(encplanar);
+	freerdp_bitmap_planar_context_free(decplanar);
+	freerdp_bitmap_planar_context_free(mtplanar);
+	free(compressed);
+	free(src);
+	free(plain);
+	free(threaded);
+	(void)printf("%s: %s\n", __func__, rc ? "SUCCESS" : "FAILED");
+	return rc;
+}
+
 int TestFreeRDPCodecPlanar(int argc, char* argv[])
 {
 	int rc = -1;
@@ -415,6 +481,9 @@ int TestFreeRDPCodecPlanar(int argc, char* argv[])
 	if (!FuzzPlanar())
 		goto fail;
 
+	if (!TestPlanarThreaded())
+		goto fail;
+
 	for (UINT32 x = 0; x < colorFormatCount; x++)
 	{
 		if (!TestPlanar(colorFormatList[x]))
@@ -19,6 +19,7 @@
 
 #include <winpr/crt.h>
 #include <winpr/print.h>
+#include <winpr/crypto.h>
 
 #include <freerdp/codec/region.h>
 
@@ -828,6 +829,241 @@ out:
 	return retCode;
 }
 
+#define TEST_GRID_SIZE 64
+
+static void rasterize(BYTE* grid, const RECTANGLE_16* rects, UINT32 nbRects)
+{
+	memset(grid, 0, TEST_GRID_SIZE * TEST_GRID_SIZE);
+
+	for (UINT32 i = 0; i < nbRects; i++)
+	{
+		for (UINT16 y = rects[i].top; y < rects[i].bottom; y++)
+		{
+			for (UINT16 x = rects[i].left; x < rects[i].right; x++)
+				grid[y * TEST_GRID_SIZE + x] = 1;
+		}
+	}
+}
+
+static BOOL region_is_banded(const REGION16* region)
+{
+	UINT32 nbRects = 0;
+	const RECTANGLE_16* rects = region16_rects(region, &nbRects);
+
+	for (UINT32 i = 1; i < nbRects; i++)
+	{
+		const RECTANGLE_16* prev = &rects[i - 1];
+		const RECTANGLE_16* cur = &rects[i];
+
+		if (prev->top == cur->top)
+		{
+			/* same band: same height, sorted and not touching */
+			if ((prev->bottom != cur->bottom) || (prev->right >= cur->left))
+				return FALSE;
+		}
+		else if (prev->bottom > cur->top)
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+static int test_batch_operations(void)
+{
+	int retCode = -1;
+	REGION16 iterative;
+	REGION16 batch;
+	REGION16 other;
+	REGION16 result;
+	RECTANGLE_16 rects[64] = WINPR_C_ARRAY_INIT;
+	BYTE expected[TEST_GRID_SIZE * TEST_GRID_SIZE] = WINPR_C_ARRAY_INIT;
+	BYTE gridA[TEST_GRID_SIZE * TEST_GRID_SIZE] = WINPR_C_ARRAY_INIT;
+	BYTE gridB[TEST_GRID_SIZE * TEST_GRID_SIZE] = WINPR_C_ARRAY_INIT;
+	BYTE gridR[TEST_GRID_SIZE * TEST_GRID_SIZE] = WINPR_C_ARRAY_INIT;
+	REGION16_SCRATCH* kept = region16_scratch_new();
+
+	region16_init(&iterative);
+	region16_init(&batch);
+	region16_init(&other);
+	region16_init(&result);
+
+	for (size_t round = 0; round < 200; round++)
+	{
+		UINT16 coords[4] = WINPR_C_ARRAY_INIT;
+		const size_t count = 1 + (round % ARRAYSIZE(rects));
+		UINT32 nbRects = 0;
+		/* reuse one scratch across rounds of growing and shrinking size, every
+		 * third round allocates its own */
+		REGION16_SCRATCH* scratch = (round % 3) ? kept : nullptr;
+
+		if (!kept)
+			goto out;
+
+		for (size_t i = 0; i < count; i++)
+		{
+			if (winpr_RAND(coords, sizeof(coords)) < 0)
+				goto out;
+			rects[i].left = coords[0] % TEST_GRID_SIZE;
+			rects[i].top = coords[1] % TEST_GRID_SIZE;
+			rects[i].right = MIN(TEST_GRID_SIZE, rects[i].left + coords[2] % 24);
+			rects[i].bottom = MIN(TEST_GRID_SIZE, rects[i].top + coords[3] % 24);
+		}
+
+		/* union: batch and iterative must produce the same banded region */
+		region16_clear(&iterative);
+		for (size_t i = 0; i < count; i++)
+		{
+			if (rectangle_is_empty(&rects[i]))
+				continue;
+			if (!region16_union_rect(&iterative, &iterative, &rects[i]))
+				goto out;
+		}
+
+		region16_clear(&batch);
+		if (!region16_union_rects(&batch, &batch, rects, count, scratch))
+			goto out;
+
+		rasterize(expected, rects, WINPR_ASSERTING_INT_CAST(UINT32, count));
+		const RECTANGLE_16* cur = region16_rects(&batch, &nbRects);
+		rasterize(gridA, cur, nbRects);
+
+		if (!region_is_banded(&batch) || (memcmp(expected, gridA, sizeof(expected)) != 0))
+			goto out;
+
+		/* the sweep never produces more rectangles than the iterative union */
+		if (WINPR_ASSERTING_INT_CAST(UINT32, region16_n_rects(&iterative)) < nbRects)
+			goto out;
+
+		if (!region16_is_empty(&iterative) &&
+		    !compareRectangles(region16_extents(&iterative), region16_extents(&batch), 1))
+			goto out;
+
+		/* split the set in two regions, check intersection and subtraction */
+		const size_t half = count / 2;
+		region16_clear(&batch);
+		if (!region16_union_rects(&batch, &batch, rects, half, scratch))
+			goto out;
+		region16_clear(&other);
+		if (!region16_union_rects(&other, &other, &rects[half], count - half, scratch))
+			goto out;
+
+		cur = region16_rects(&batch, &nbRects);
+		rasterize(gridA, cur, nbRects);
+		cur = region16_rects(&other, &nbRects);
+		rasterize(gridB, cur, nbRects);
+
+		if (!region16_intersect_region(&result, &batch, &other, scratch))
+			goto out;
+		cur = region16_rects(&result, &nbRects);
+		rasterize(gridR, cur, nbRects);
+		for (size_t i = 0; i < ARRAYSIZE(gridR); i++)
+		{
+			if (gridR[i] != (gridA[i] & gridB[i]))
+				goto out;
+		}
+		if (!region_is_banded(&result))
+			goto out;
+
+		if (!region16_subtract(&result, &batch, &other, scratch))
+			goto out;
+		cur = region16_rects(&result, &nbRects);
+		rasterize(gridR, cur, nbRects);
+		for (size_t i = 0; i < ARRAYSIZE(gridR); i++)
+		{
+			if (gridR[i] != (gridA[i] & !gridB[i]))
+				goto out;
+		}
+		if (!region_is_banded(&result))
+			goto out;
+
+		/* in place operation */
+		if (!region16_subtract(&batch, &batch, &batch, scratch) || !region16_is_empty(&batch))
+			goto out;
+	}
+
+	retCode = 0;
+out:
+	region16_uninit(&result);
+	region16_uninit(&other);
+	region16_uninit(&batch);
+	region16_uninit(&iterative);
+	region16_scratch_free(kept);
+	return retCode;
+}
+
+static int test_tiled_union(void)
+{
+	int retCode = -1;
+	REGION16 src;
+	REGION16 tiled;
+	RECTANGLE_16 rects[64] = WINPR_C_ARRAY_INIT;
+	RECTANGLE_16 aligned[ARRAYSIZE(rects) + 1] = WINPR_C_ARRAY_INIT;
+	BYTE expected[TEST_GRID_SIZE * TEST_GRID_SIZE] = WINPR_C_ARRAY_INIT;
+	BYTE grid[TEST_GRID_SIZE * TEST_GRID_SIZE] = WINPR_C_ARRAY_INIT;
+	const RECTANGLE_16 seed = { 3, 5, 9, 6 };
+	const UINT16 tileSize = 8;
+	REGION16_SCRATCH* scratch = region16_scratch_new();
+
+	region16_init(&src);
+	region16_init(&tiled);
+
+	if (!scratch)
+		goto out;
+
+	/* tiles smaller than 8 pixels are refused */
+	if (region16_union_rects_tiled(&tiled, &src, &seed, 1, 4, scratch))
+		goto out;
+
+	if (!region16_union_rect(&src, &src, &seed))
+		goto out;
+
+	for (size_t round = 0; round < 200; round++)
+	{
+		UINT16 coords[4] = WINPR_C_ARRAY_INIT;
+		const size_t count = 1 + (round % ARRAYSIZE(rects));
+		UINT32 nbRects = 0;
+
+		/* the source region is kept, the tiles touched by each rectangle are added */
+		aligned[0] = seed;
+		for (size_t i = 0; i < count; i++)
+		{
+			if (winpr_RAND(coords, sizeof(coords)) < 0)
+				goto out;
+			rects[i].left = coords[0] % TEST_GRID_SIZE;
+			rects[i].top = coords[1] % TEST_GRID_SIZE;
+			rects[i].right = MIN(TEST_GRID_SIZE, rects[i].left + coords[2] % 24);
+			rects[i].bottom = MIN(TEST_GRID_SIZE, rects[i].top + coords[3] % 24);
+
+			RECTANGLE_16* tile = &aligned[i + 1];
+			*tile = rects[i];
+			if (rectangle_is_empty(tile))
+				continue;
+			tile->left = tile->left / tileSize * tileSize;
+			tile->top = tile->top / tileSize * tileSize;
+			tile->right = (tile->right + tileSize - 1) / tileSize * tileSize;
+			tile->bottom = (tile->bottom + tileSize - 1) / tileSize * tileSize;
+		}
+
+		/* every other round allocates its own scratch */
+		if (!region16_union_rects_tiled(&tiled, &src, rects, count, tileSize,
+		                                (round % 2) ? scratch : nullptr))
+			goto out;
+
+		rasterize(expected, aligned, WINPR_ASSERTING_INT_CAST(UINT32, count + 1));
+		const RECTANGLE_16* cur = region16_rects(&tiled, &nbRects);
+		rasterize(grid, cur, nbRects);
+		if (!region_is_banded(&tiled) || (memcmp(expected, grid, sizeof(expected)) != 0))
+			goto out;
+	}
+
+	retCode = 0;
+out:
+	region16_uninit(&tiled);
+	region16_uninit(&src);
+	region16_scratch_free(scratch);
+	return retCode;
+}
+
 typedef int (*TestFunction)(void);
 struct UnitaryTest
 {
@@ -849,6 +1085,8 @@ static struct UnitaryTest tests[] = { { "Basic trivial tests", test_basic },
 	                                  { "norbert's case", test_norbert_case },
 	                                  { "norbert's case 2", test_norbert2_case },
 	                                  { "empty rectangle case", test_empty_rectangle },
+	                                  { "batch union/intersect/subtract", test_batch_operations },
+	                                  { "tiled union", test_tiled_union },
 
 	                                  { nullptr, nullptr } };
 
@@ -1121,7 +1121,8 @@ int xcrush_compress(XCRUSH_CONTEXT* WINPR_RESTRICT xcrush, const BYTE* WINPR_RES
 	if (status < 0)
 		return status;
 
-	if (!status || (Level2ComprFlags & PACKET_FLUSHED))
+	/* mppc did not run or could not compress, send the level 1 output as is */
+	if (!status || !(Level2ComprFlags & PACKET_COMPRESSED))
 	{
 		if (CompressedDataSize > DstSize)
 		{
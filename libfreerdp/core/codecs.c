@@ -110,7 +110,8 @@ BOOL freerdp_client_codecs_prepare(rdpCodecs* codecs, UINT32 flags, UINT32 width
 
 	if ((flags & FREERDP_CODEC_PLANAR))
 	{
-		if (!(codecs->planar = freerdp_bitmap_planar_context_new(0, 64, 64)))
+		if (!(codecs->planar =
+		          freerdp_bitmap_planar_context_new_ex(0, 64, 64, codecs->ThreadingFlags)))
 		{
 			WLog_ERR(TAG, "Failed to create planar bitmap codec context");
 			return FALSE;
@@ -137,7 +138,7 @@ BOOL freerdp_client_codecs_prepare(rdpCodecs* codecs, UINT32 flags, UINT32 width
 
 	if ((flags & FREERDP_CODEC_CLEARCODEC))
 	{
-		if (!(codecs->clear = clear_context_new(FALSE)))
+		if (!(codecs->clear = clear_context_new_ex(FALSE, codecs->ThreadingFlags)))
 		{
 			WLog_ERR(TAG, "Failed to create clear codec context");
 			return FALSE;
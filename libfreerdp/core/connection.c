@@ -197,41 +197,112 @@
 
 static BOOL rdp_set_state(rdpRdp* rdp, CONNECTION_STATE state);
 
-static BOOL rdp_client_reset_codecs(rdpContext* context)
+/* Preparing the codecs (loading H264 backends, allocating RemoteFX/progressive contexts, ...)
+ * is independent of the connection sequence. Run it in the background while the transport,
+ * TLS and NLA are established and collect the result before the MCS connect. */
+static DWORD WINAPI rdp_client_prepare_codecs_thread(LPVOID arg)
 {
-	rdpSettings* settings = nullptr;
+	rdpRdp* rdp = arg;
+	WINPR_ASSERT(rdp);
+
+	rdp->preparedCodecsResult =
+	    freerdp_client_codecs_prepare(rdp->preparedCodecs, rdp->preparedCodecsFlags,
+	                                  rdp->preparedCodecsWidth, rdp->preparedCodecsHeight);
+	return 0;
+}
 
+static void rdp_client_prepare_codecs_wait(rdpRdp* rdp)
+{
+	WINPR_ASSERT(rdp);
+
+	if (!rdp->codecThread)
+		return;
+
+	(void)WaitForSingleObject(rdp->codecThread, INFINITE);
+	(void)CloseHandle(rdp->codecThread);
+	rdp->codecThread = nullptr;
+}
+
+void rdp_client_discard_codecs(rdpRdp* rdp)
+{
+	WINPR_ASSERT(rdp);
+
+	rdp_client_prepare_codecs_wait(rdp);
+	freerdp_client_codecs_free(rdp->preparedCodecs);
+	rdp->preparedCodecs = nullptr;
+}
+
+static BOOL rdp_client_reset_codecs(rdpRdp* rdp)
+{
+	WINPR_ASSERT(rdp);
+
+	rdpContext* context = rdp->context;
 	if (!context || !context->settings)
 		return FALSE;
 
-	settings = context->settings;
+	rdpSettings* settings = context->settings;
 
+	rdp_client_discard_codecs(rdp);
 	if (!freerdp_settings_get_bool(settings, FreeRDP_DeactivateClientDecoding))
 	{
 		const UINT32 flags = freerdp_settings_get_uint32(settings, FreeRDP_ThreadingFlags);
 		freerdp_client_codecs_free(context->codecs);
-		context->codecs = freerdp_client_codecs_new(flags);
+		context->codecs = nullptr;
 
-		if (!context->codecs)
+		rdp->preparedCodecs = freerdp_client_codecs_new(flags);
+		if (!rdp->preparedCodecs)
 			return FALSE;
 
-		if (!freerdp_client_codecs_prepare(context->codecs,
-		                                   freerdp_settings_get_codecs_flags(settings),
-		                                   settings->DesktopWidth, settings->DesktopHeight))
-			return FALSE;
+		rdp->preparedCodecsFlags = freerdp_settings_get_codecs_flags(settings);
+		rdp->preparedCodecsWidth = settings->DesktopWidth;
+		rdp->preparedCodecsHeight = settings->DesktopHeight;
+		rdp->preparedCodecsResult = FALSE;
+		rdp->codecThread =
+		    CreateThread(nullptr, 0, rdp_client_prepare_codecs_thread, rdp, 0, nullptr);
+		if (!rdp->codecThread)
+		{
+			WLog_Print(rdp->log, WLOG_WARN, "failed to start codec thread, preparing inline");
+			(void)rdp_client_prepare_codecs_thread(rdp);
+		}
+	}
+
+	return TRUE;
+}
+
+/* Hand the codecs prepared by rdp_client_reset_codecs over to the context */
+static BOOL rdp_client_finish_codecs(rdpRdp* rdp)
+{
+	WINPR_ASSERT(rdp);
+
+	if (!rdp->preparedCodecs)
+		return TRUE;
+
+	rdp_client_prepare_codecs_wait(rdp);
+	if (!rdp->preparedCodecsResult)
+	{
+		rdp_client_discard_codecs(rdp);
+		return FALSE;
+	}
+
+	rdpContext* context = rdp->context;
+	WINPR_ASSERT(context);
+
+	freerdp_client_codecs_free(context->codecs);
+	context->codecs = rdp->preparedCodecs;
+	rdp->preparedCodecs = nullptr;
 
 /* Runtime H264 detection. (only available if dynamic backend loading is defined)
  * If no backend is available disable it before the channel is loaded.
  */
 #if defined(WITH_GFX_H264) && defined(WITH_OPENH264_LOADING)
-		if (!context->codecs->h264)
-		{
-			settings->GfxH264 = FALSE;
-			settings->GfxAVC444 = FALSE;
-			settings->GfxAVC444v2 = FALSE;
-		}
-#endif
+	if (!context->codecs->h264)
+	{
+		rdpSettings* settings = context->settings;
+		settings->GfxH264 = FALSE;
+		settings->GfxAVC444 = FALSE;
+		settings->GfxAVC444v2 = FALSE;
 	}
+#endif
 
 	return TRUE;
 }
@@ -312,7 +383,7 @@ BOOL rdp_client_connect(rdpRdp* rdp)
 	rdpSettings* settings = rdp->settings;
 	WINPR_ASSERT(settings);
 
-	if (!rdp_client_reset_codecs(rdp->context))
+	if (!rdp_client_reset_codecs(rdp))
 		return FALSE;
 
 	if (settings->FIPSMode)
@@ -525,6 +596,7 @@ BOOL rdp_client_disconnect(rdpRdp* rdp)
 	if (!rdp_client_transition_to_state(rdp, CONNECTION_STATE_INITIAL))
 		return FALSE;
 
+	rdp_client_discard_codecs(rdp);
 	if (context->channels)
 	{
 		if (freerdp_channels_disconnect(context->channels, context->instance) != CHANNEL_RC_OK)
@@ -1427,6 +1499,15 @@ BOOL rdp_client_transition_to_state(rdpRdp* rdp, CONNECTION_STATE state)
 	if (!rdp_set_state(rdp, state))
 		return FALSE;
 
+	if (state >= CONNECTION_STATE_MCS_CREATE_REQUEST)
+	{
+		if (!rdp_client_finish_codecs(rdp))
+		{
+			WLog_Print(rdp->log, WLOG_ERROR, "failed to prepare codecs");
+			return FALSE;
+		}
+	}
+
 	switch (state)
 	{
 		case CONNECTION_STATE_FINALIZATION_SYNC:
@@ -2130,6 +2211,77 @@ CONNECTION_STATE rdp_get_state(const rdpRdp* rdp)
 	return rdp->state;
 }
 
+void rdp_reset_connection_timeline(rdpRdp* rdp)
+{
+	WINPR_ASSERT(rdp);
+
+	EnterCriticalSection(&rdp->critical);
+	rdp->connectStart = winpr_GetTickCount64NS();
+	rdp->stateStart = rdp->connectStart;
+	rdp->timelineCount = 0;
+	LeaveCriticalSection(&rdp->critical);
+}
+
+static void rdp_log_connection_timeline(rdpRdp* rdp)
+{
+	WINPR_ASSERT(rdp);
+
+	const size_t count = MIN(rdp->timelineCount, ARRAYSIZE(rdp->timeline));
+	if (count == 0)
+		return;
+
+	const DWORD level = WLOG_DEBUG;
+	if (WLog_IsLevelActive(rdp->log, level))
+	{
+		UINT64 last = 0;
+		for (size_t x = 0; x < count; x++)
+		{
+			const FREERDP_CONNECTION_TIMELINE_ENTRY* entry = &rdp->timeline[x];
+			WLog_Print(rdp->log, level, "  %-55s +%8" PRIu64 " us [%8" PRIu64 " us]",
+			           rdp_state_string(entry->state), entry->timestamp / 1000ull,
+			           (entry->timestamp - last) / 1000ull);
+			last = entry->timestamp;
+		}
+	}
+
+	WLog_Print(rdp->log, WLOG_INFO, "connection established in %" PRIu64 " ms",
+	           rdp->timeline[count - 1].timestamp / 1000000ull);
+}
+
+static void rdp_record_state(rdpRdp* rdp, CONNECTION_STATE state)
+{
+	WINPR_ASSERT(rdp);
+
+	const UINT64 now = winpr_GetTickCount64NS();
+
+	EnterCriticalSection(&rdp->critical);
+	if (rdp->connectStart == 0)
+	{
+		rdp->connectStart = now;
+		rdp->stateStart = now;
+	}
+
+	if (rdp->timelineCount < ARRAYSIZE(rdp->timeline))
+	{
+		FREERDP_CONNECTION_TIMELINE_ENTRY* entry = &rdp->timeline[rdp->timelineCount];
+		entry->state = state;
+		entry->timestamp = now - rdp->connectStart;
+	}
+	rdp->timelineCount++;
+
+	const UINT64 stateStart = rdp->stateStart;
+	rdp->stateStart = now;
+	LeaveCriticalSection(&rdp->critical);
+
+	rdpContext* context = rdp->context;
+	WINPR_ASSERT(context);
+	(void)freerdp_metrics_record(context->metrics, FREERDP_METRIC_CONNECT_STATE_TIME, rdp->state,
+	                             now - stateStart);
+
+	if ((state == CONNECTION_STATE_ACTIVE) && (rdp->state != CONNECTION_STATE_ACTIVE))
+		rdp_log_connection_timeline(rdp);
+}
+
 BOOL rdp_set_state(rdpRdp* rdp, CONNECTION_STATE state)
 {
 	WINPR_ASSERT(rdp);
@@ -2137,6 +2289,8 @@ BOOL rdp_set_state(rdpRdp* rdp, CONNECTION_STATE state)
 	rdpContext* context = rdp->context;
 	WINPR_ASSERT(context);
 
+	rdp_record_state(rdp, state);
+
 	if (context->pubSub)
 	{
 		StateChangedEventArgs e = WINPR_C_ARRAY_INIT;
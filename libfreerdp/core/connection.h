@@ -83,6 +83,10 @@ FREERDP_LOCAL CONNECTION_STATE rdp_get_state(const rdpRdp* rdp);
 WINPR_ATTR_NODISCARD
 FREERDP_LOCAL const char* rdp_state_string(CONNECTION_STATE state);
 
+FREERDP_LOCAL void rdp_reset_connection_timeline(rdpRdp* rdp);
+
+FREERDP_LOCAL void rdp_client_discard_codecs(rdpRdp* rdp);
+
 WINPR_ATTR_NODISCARD
 FREERDP_LOCAL BOOL rdp_is_active_state(const rdpRdp* rdp);
 
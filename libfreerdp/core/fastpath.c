@@ -95,7 +95,7 @@ static const char* const FASTPATH_UPDATETYPE_STRINGS[] = {
 	"New Pointer",            /* 0xB */
 };
 
-static const char* fastpath_update_to_string(UINT8 update)
+const char* fastpath_update_to_string(UINT8 update)
 {
 	if (update >= ARRAYSIZE(FASTPATH_UPDATETYPE_STRINGS))
 		return "UNKNOWN";
@@ -387,6 +387,7 @@ static int fastpath_recv_update(rdpFastPath* fastpath, BYTE updateCode, wStream*
 
 	const BOOL defaultReturn =
 	    freerdp_settings_get_bool(context->settings, FreeRDP_DeactivateClientDecoding);
+	const UINT64 start = winpr_GetTickCount64NS();
 	switch (updateCode)
 	{
 		case FASTPATH_UPDATETYPE_ORDERS:
@@ -509,6 +510,8 @@ static int fastpath_recv_update(rdpFastPath* fastpath, BYTE updateCode, wStream*
 		return -1;
 	}
 
+	freerdp_metrics_record_since(context->metrics, FREERDP_METRIC_FASTPATH_UPDATE_TIME, updateCode,
+	                             start);
 	return status;
 }
 
@@ -557,6 +560,29 @@ static int fastpath_recv_update_data(rdpFastPath* fastpath, wStream* s)
 	if (!Stream_CheckAndLogRequiredLength(TAG, s, size))
 		return -1;
 
+	BOOL handled = FALSE;
+	rdpUpdate* update = rdp->update;
+	WINPR_ASSERT(update);
+	if (update->FastPathUpdateRaw)
+	{
+		const FASTPATH_RAW_UPDATE raw = { .updateCode = updateCode,
+			                              .fragmentation = fragmentation,
+			                              .compressionFlags = compressionFlags,
+			                              .data = Stream_ConstPointer(s),
+			                              .length = size };
+		if (!update->FastPathUpdateRaw(rdp->context, &raw, &handled))
+		{
+			WLog_ERR(TAG, "FastPathUpdateRaw() failed");
+			return -1;
+		}
+
+		if (handled && (fastpath->fragmentation != -1))
+		{
+			WLog_ERR(TAG, "FastPathUpdateRaw() took over a partially reassembled update");
+			return -1;
+		}
+	}
+
 	const int bulkStatus =
 	    bulk_decompress(rdp->bulk, Stream_Pointer(s), size, &pDstData, &DstSize, compressionFlags);
 	Stream_Seek(s, size);
@@ -567,6 +593,9 @@ static int fastpath_recv_update_data(rdpFastPath* fastpath, wStream* s)
 		return -1;
 	}
 
+	if (handled)
+		return 0;
+
 	if (!Stream_EnsureRemainingCapacity(fastpath->updateData, DstSize))
 		return -1;
 
@@ -1185,25 +1214,153 @@ wStream* fastpath_update_pdu_init_new(WINPR_ATTR_UNUSED rdpFastPath* fastpath)
 	return s;
 }
 
+WINPR_ATTR_NODISCARD
+static UINT16 fastpath_get_output_sec_flags(rdpRdp* rdp)
+{
+	UINT16 sec_flags = 0;
+
+	WINPR_ASSERT(rdp);
+	if (rdp->do_crypt)
+	{
+		sec_flags |= SEC_ENCRYPT;
+
+		if (rdp->do_secure_checksum)
+			sec_flags |= SEC_SECURE_CHECKSUM;
+	}
+	return sec_flags;
+}
+
+/* Write a single fast-path update (already compressed, if requested) wrapped in its own
+ * fast-path update PDU, apply encryption and send it. */
+WINPR_ATTR_NODISCARD
+static BOOL fastpath_send_update_fragment(rdpFastPath* fastpath,
+                                          FASTPATH_UPDATE_HEADER* fpUpdateHeader,
+                                          const BYTE* pDstData, UINT32 DstSize, UINT16 sec_flags)
+{
+	BOOL status = TRUE;
+	BYTE pad = 0;
+	BYTE* pSignature = nullptr;
+	BOOL should_unlock = FALSE;
+	FASTPATH_UPDATE_PDU_HEADER fpUpdatePduHeader = WINPR_C_ARRAY_INIT;
+
+	WINPR_ASSERT(fastpath);
+	WINPR_ASSERT(fpUpdateHeader);
+
+	rdpRdp* rdp = fastpath->rdp;
+	wStream* fs = fastpath->fs;
+	WINPR_ASSERT(rdp);
+	WINPR_ASSERT(fs);
+
+	if (DstSize > UINT16_MAX)
+		return FALSE;
+	fpUpdateHeader->size = (UINT16)DstSize;
+
+	if (sec_flags & SEC_ENCRYPT)
+		fpUpdatePduHeader.secFlags |= FASTPATH_OUTPUT_ENCRYPTED;
+
+	if (sec_flags & SEC_SECURE_CHECKSUM)
+		fpUpdatePduHeader.secFlags |= FASTPATH_OUTPUT_SECURE_CHECKSUM;
+
+	const UINT32 fpUpdateHeaderSize = fastpath_get_update_header_size(fpUpdateHeader);
+	const UINT32 fpUpdatePduHeaderSize =
+	    fastpath_get_update_pdu_header_size(&fpUpdatePduHeader, rdp);
+	const UINT32 fpHeaderSize = fpUpdateHeaderSize + fpUpdatePduHeaderSize;
+
+	if (sec_flags & SEC_ENCRYPT)
+	{
+		pSignature = Stream_Buffer(fs) + 3;
+
+		if (freerdp_settings_get_uint32(rdp->settings, FreeRDP_EncryptionMethods) ==
+		    ENCRYPTION_METHOD_FIPS)
+		{
+			pSignature += 4;
+
+			if ((pad = 8 - ((DstSize + fpUpdateHeaderSize) % 8)) == 8)
+				pad = 0;
+
+			fpUpdatePduHeader.fipsInformation[0] = 0x10;
+			fpUpdatePduHeader.fipsInformation[1] = 0x00;
+			fpUpdatePduHeader.fipsInformation[2] = 0x01;
+			fpUpdatePduHeader.fipsInformation[3] = pad;
+		}
+	}
+
+	const size_t len = fpUpdateHeader->size + fpHeaderSize + pad;
+	if (len > UINT16_MAX)
+		return FALSE;
+
+	fpUpdatePduHeader.length = (UINT16)len;
+	Stream_ResetPosition(fs);
+	if (!fastpath_write_update_pdu_header(fs, &fpUpdatePduHeader, rdp))
+		return FALSE;
+	if (!fastpath_write_update_header(fs, fpUpdateHeader))
+		return FALSE;
+
+	if (!Stream_CheckAndLogRequiredCapacity(TAG, (fs), (size_t)DstSize + pad))
+		return FALSE;
+	Stream_Write(fs, pDstData, DstSize);
+
+	if (pad)
+		Stream_Zero(fs, pad);
+
+	BOOL res = FALSE;
+	if (sec_flags & SEC_ENCRYPT)
+	{
+		security_lock(rdp);
+
+		should_unlock = TRUE;
+		UINT32 dataSize = fpUpdateHeaderSize + DstSize + pad;
+		BYTE* data = Stream_PointerAs(fs, BYTE) - dataSize;
+
+		if (freerdp_settings_get_uint32(rdp->settings, FreeRDP_EncryptionMethods) ==
+		    ENCRYPTION_METHOD_FIPS)
+		{
+			// TODO: Ensure stream capacity
+			if (!security_hmac_signature(data, dataSize - pad, pSignature, 8, rdp))
+				goto unlock;
+
+			if (!security_fips_encrypt(data, dataSize, rdp))
+				goto unlock;
+		}
+		else
+		{
+			// TODO: Ensure stream capacity
+			if (sec_flags & SEC_SECURE_CHECKSUM)
+				status = security_salted_mac_signature(rdp, data, dataSize, TRUE, pSignature, 8);
+			else
+				status = security_mac_signature(rdp, data, dataSize, pSignature, 8);
+
+			if (!status || !security_encrypt(data, dataSize, rdp))
+				goto unlock;
+		}
+	}
+	res = TRUE;
+
+	Stream_SealLength(fs);
+
+	if (transport_write(rdp->transport, fs) < 0)
+	{
+		status = FALSE;
+	}
+
+unlock:
+	if (should_unlock)
+		security_unlock(rdp);
+
+	return res && status;
+}
+
 BOOL fastpath_send_update_pdu(rdpFastPath* fastpath, BYTE updateCode, wStream* s,
                               BOOL skipCompression)
 {
-	BOOL status = TRUE;
-	wStream* fs = nullptr;
 	rdpSettings* settings = nullptr;
 	rdpRdp* rdp = nullptr;
-	UINT32 fpHeaderSize = 6;
-	UINT32 fpUpdatePduHeaderSize = 0;
-	UINT32 fpUpdateHeaderSize = 0;
-	FASTPATH_UPDATE_PDU_HEADER fpUpdatePduHeader = WINPR_C_ARRAY_INIT;
 	FASTPATH_UPDATE_HEADER fpUpdateHeader = WINPR_C_ARRAY_INIT;
-	UINT16 sec_flags = 0;
 
 	if (!fastpath || !fastpath->rdp || !fastpath->fs || !s)
 		return FALSE;
 
 	rdp = fastpath->rdp;
-	fs = fastpath->fs;
 	settings = rdp->settings;
 
 	if (!settings)
@@ -1239,36 +1396,19 @@ BOOL fastpath_send_update_pdu(rdpFastPath* fastpath, BYTE updateCode, wStream* s
 		return FALSE;
 	}
 
-	if (rdp->do_crypt)
-	{
-		sec_flags |= SEC_ENCRYPT;
-
-		if (rdp->do_secure_checksum)
-			sec_flags |= SEC_SECURE_CHECKSUM;
-	}
+	const UINT16 sec_flags = fastpath_get_output_sec_flags(rdp);
 
 	for (int fragment = 0; (totalLength > 0) || (fragment == 0); fragment++)
 	{
 		UINT32 DstSize = 0;
 		const BYTE* pDstData = nullptr;
 		UINT32 compressionFlags = 0;
-		BYTE pad = 0;
-		BYTE* pSignature = nullptr;
-		fpUpdatePduHeader.action = 0;
-		fpUpdatePduHeader.secFlags = 0;
 		fpUpdateHeader.compression = 0;
 		fpUpdateHeader.compressionFlags = 0;
 		fpUpdateHeader.updateCode = updateCode;
 		fpUpdateHeader.size = (UINT16)(totalLength > maxLength) ? maxLength : (UINT16)totalLength;
 		const BYTE* pSrcData = Stream_Pointer(s);
 		UINT32 SrcSize = DstSize = fpUpdateHeader.size;
-		BOOL should_unlock = FALSE;
-
-		if (sec_flags & SEC_ENCRYPT)
-			fpUpdatePduHeader.secFlags |= FASTPATH_OUTPUT_ENCRYPTED;
-
-		if (sec_flags & SEC_SECURE_CHECKSUM)
-			fpUpdatePduHeader.secFlags |= FASTPATH_OUTPUT_SECURE_CHECKSUM;
 
 		if (freerdp_settings_get_bool(settings, FreeRDP_CompressionEnabled) && !skipCompression)
 		{
@@ -1290,9 +1430,6 @@ BOOL fastpath_send_update_pdu(rdpFastPath* fastpath, BYTE updateCode, wStream* s
 			DstSize = fpUpdateHeader.size;
 		}
 
-		if (DstSize > UINT16_MAX)
-			return FALSE;
-		fpUpdateHeader.size = (UINT16)DstSize;
 		totalLength -= SrcSize;
 
 		if (totalLength == 0)
@@ -1302,99 +1439,49 @@ BOOL fastpath_send_update_pdu(rdpFastPath* fastpath, BYTE updateCode, wStream* s
 			fpUpdateHeader.fragmentation =
 			    (fragment == 0) ? FASTPATH_FRAGMENT_FIRST : FASTPATH_FRAGMENT_NEXT;
 
-		fpUpdateHeaderSize = fastpath_get_update_header_size(&fpUpdateHeader);
-		fpUpdatePduHeaderSize = fastpath_get_update_pdu_header_size(&fpUpdatePduHeader, rdp);
-		fpHeaderSize = fpUpdateHeaderSize + fpUpdatePduHeaderSize;
-
-		if (sec_flags & SEC_ENCRYPT)
-		{
-			pSignature = Stream_Buffer(fs) + 3;
-
-			if (freerdp_settings_get_uint32(rdp->settings, FreeRDP_EncryptionMethods) ==
-			    ENCRYPTION_METHOD_FIPS)
-			{
-				pSignature += 4;
-
-				if ((pad = 8 - ((DstSize + fpUpdateHeaderSize) % 8)) == 8)
-					pad = 0;
-
-				fpUpdatePduHeader.fipsInformation[0] = 0x10;
-				fpUpdatePduHeader.fipsInformation[1] = 0x00;
-				fpUpdatePduHeader.fipsInformation[2] = 0x01;
-				fpUpdatePduHeader.fipsInformation[3] = pad;
-			}
-		}
-
-		const size_t len = fpUpdateHeader.size + fpHeaderSize + pad;
-		if (len > UINT16_MAX)
-			return FALSE;
-
-		fpUpdatePduHeader.length = (UINT16)len;
-		Stream_ResetPosition(fs);
-		if (!fastpath_write_update_pdu_header(fs, &fpUpdatePduHeader, rdp))
-			return FALSE;
-		if (!fastpath_write_update_header(fs, &fpUpdateHeader))
-			return FALSE;
-
-		if (!Stream_CheckAndLogRequiredCapacity(TAG, (fs), (size_t)DstSize + pad))
+		if (!fastpath_send_update_fragment(fastpath, &fpUpdateHeader, pDstData, DstSize,
+		                                   sec_flags))
 			return FALSE;
-		Stream_Write(fs, pDstData, DstSize);
-
-		if (pad)
-			Stream_Zero(fs, pad);
-
-		BOOL res = FALSE;
-		if (sec_flags & SEC_ENCRYPT)
-		{
-			security_lock(rdp);
 
-			should_unlock = TRUE;
-			UINT32 dataSize = fpUpdateHeaderSize + DstSize + pad;
-			BYTE* data = Stream_PointerAs(fs, BYTE) - dataSize;
+		Stream_Seek(s, SrcSize);
+	}
 
-			if (freerdp_settings_get_uint32(rdp->settings, FreeRDP_EncryptionMethods) ==
-			    ENCRYPTION_METHOD_FIPS)
-			{
-				// TODO: Ensure stream capacity
-				if (!security_hmac_signature(data, dataSize - pad, pSignature, 8, rdp))
-					goto unlock;
+	return TRUE;
+}
 
-				if (!security_fips_encrypt(data, dataSize, rdp))
-					goto unlock;
-			}
-			else
-			{
-				// TODO: Ensure stream capacity
-				if (sec_flags & SEC_SECURE_CHECKSUM)
-					status =
-					    security_salted_mac_signature(rdp, data, dataSize, TRUE, pSignature, 8);
-				else
-					status = security_mac_signature(rdp, data, dataSize, pSignature, 8);
+BOOL fastpath_send_raw_update_pdu(rdpFastPath* fastpath, const FASTPATH_RAW_UPDATE* update)
+{
+	FASTPATH_UPDATE_HEADER fpUpdateHeader = WINPR_C_ARRAY_INIT;
 
-				if (!status || !security_encrypt(data, dataSize, rdp))
-					goto unlock;
-			}
-		}
-		res = TRUE;
+	if (!fastpath || !fastpath->rdp || !fastpath->fs || !update)
+		return FALSE;
 
-		Stream_SealLength(fs);
+	rdpRdp* rdp = fastpath->rdp;
 
-		if (transport_write(rdp->transport, fs) < 0)
-		{
-			status = FALSE;
-		}
+	if (!freerdp_settings_get_bool(rdp->settings, FreeRDP_FastPathOutput))
+	{
+		WLog_ERR(TAG, "client does not support fast path output");
+		return FALSE;
+	}
 
-	unlock:
-		if (should_unlock)
-			security_unlock(rdp);
+	if ((update->length > UINT16_MAX) || (!update->data && (update->length > 0)))
+		return FALSE;
 
-		if (!res || !status)
-			return FALSE;
+	/* The sending peer might use larger fragments than we would, make room for them */
+	if (!Stream_EnsureCapacity(fastpath->fs, update->length + 32))
+		return FALSE;
 
-		Stream_Seek(s, SrcSize);
+	fpUpdateHeader.updateCode = update->updateCode;
+	fpUpdateHeader.fragmentation = update->fragmentation;
+	if (update->compressionFlags)
+	{
+		fpUpdateHeader.compression = FASTPATH_OUTPUT_COMPRESSION_USED;
+		fpUpdateHeader.compressionFlags = update->compressionFlags;
 	}
 
-	return status;
+	return fastpath_send_update_fragment(fastpath, &fpUpdateHeader, update->data,
+	                                     (UINT32)update->length,
+	                                     fastpath_get_output_sec_flags(rdp));
 }
 
 rdpFastPath* fastpath_new(rdpRdp* rdp)
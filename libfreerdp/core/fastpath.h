@@ -71,14 +71,6 @@ enum FASTPATH_UPDATETYPE
 	FASTPATH_UPDATETYPE_LARGE_POINTER = 0xC
 };
 
-enum FASTPATH_FRAGMENT
-{
-	FASTPATH_FRAGMENT_SINGLE = 0x0,
-	FASTPATH_FRAGMENT_LAST = 0x1,
-	FASTPATH_FRAGMENT_FIRST = 0x2,
-	FASTPATH_FRAGMENT_NEXT = 0x3
-};
-
 enum FASTPATH_OUTPUT_COMPRESSION
 {
 	FASTPATH_OUTPUT_COMPRESSION_USED = 0x2
@@ -126,6 +118,9 @@ typedef struct
 	BYTE compression;
 } FASTPATH_UPDATE_HEADER;
 
+WINPR_ATTR_NODISCARD
+FREERDP_LOCAL const char* fastpath_update_to_string(UINT8 update);
+
 WINPR_ATTR_NODISCARD
 FREERDP_LOCAL BOOL fastpath_read_header_rdp(rdpFastPath* fastpath, wStream* s, UINT16* length);
 
@@ -166,6 +161,10 @@ WINPR_ATTR_NODISCARD
 FREERDP_LOCAL BOOL fastpath_send_update_pdu(rdpFastPath* fastpath, BYTE updateCode, wStream* s,
                                             BOOL skipCompression);
 
+WINPR_ATTR_NODISCARD
+FREERDP_LOCAL BOOL fastpath_send_raw_update_pdu(rdpFastPath* fastpath,
+                                                const FASTPATH_RAW_UPDATE* update);
+
 WINPR_ATTR_NODISCARD
 FREERDP_LOCAL BOOL fastpath_send_surfcmd_frame_marker(rdpFastPath* fastpath, UINT16 frameAction,
                                                       UINT32 frameId);
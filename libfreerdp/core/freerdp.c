@@ -117,6 +117,7 @@ static int freerdp_connect_begin(freerdp* instance)
 	if (!freerdp_add_signal_cleanup_handler(instance->context, sig_abort_connect))
 		return -1;
 
+	rdp_reset_connection_timeline(rdp);
 	IFCALLRET(instance->PreConnect, status, instance);
 	instance->ConnectionCallbackState = CLIENT_STATE_PRECONNECT_PASSED;
 
@@ -368,6 +369,10 @@ BOOL freerdp_check_fds(freerdp* instance)
 	rdp = instance->context->rdp;
 	status = rdp_check_fds(rdp);
 
+	if ((status >= 0) && instance->context->input &&
+	    !input_flush(instance->context->input, FALSE))
+		WLog_Print(instance->context->log, WLOG_WARN, "failed to send batched input events");
+
 	if (status < 0)
 	{
 		TerminateEventArgs e;
@@ -407,6 +412,10 @@ DWORD freerdp_get_event_handles(rdpContext* context, HANDLE* events, DWORD count
 	else
 		return 0;
 
+	if (nCount >= count)
+		return 0;
+	events[nCount++] = input_get_event_handle(context->input);
+
 	const SSIZE_T rc = freerdp_client_channel_get_registered_event_handles(
 	    context->channels, &events[nCount], count - nCount);
 	if (rc < 0)
@@ -1493,6 +1502,26 @@ BOOL freerdp_is_active_state(const rdpContext* context)
 	return rdp_is_active_state(context->rdp);
 }
 
+size_t freerdp_get_connection_timeline(const rdpContext* context,
+                                       FREERDP_CONNECTION_TIMELINE_ENTRY* entries, size_t count)
+{
+	WINPR_ASSERT(context);
+
+	rdpRdp* rdp = context->rdp;
+	WINPR_ASSERT(rdp);
+
+	EnterCriticalSection(&rdp->critical);
+	const size_t total = MIN(rdp->timelineCount, ARRAYSIZE(rdp->timeline));
+	if (entries)
+	{
+		const size_t copy = MIN(count, total);
+		for (size_t x = 0; x < copy; x++)
+			entries[x] = rdp->timeline[x];
+	}
+	LeaveCriticalSection(&rdp->critical);
+	return total;
+}
+
 BOOL freerdp_channels_from_mcs(rdpSettings* settings, const rdpContext* context)
 {
 	WINPR_ASSERT(context);
@@ -22,6 +22,8 @@
 
 #include <winpr/crt.h>
 #include <winpr/assert.h>
+#include <winpr/endian.h>
+#include <winpr/sysinfo.h>
 
 #include <freerdp/input.h>
 #include <freerdp/log.h>
@@ -381,74 +383,213 @@ static BOOL input_send_keyboard_pause_event(rdpInput* input)
 	                                 RDP_SCANCODE_CODE(RDP_SCANCODE_NUMLOCK));
 }
 
-static BOOL input_send_fastpath_synchronize_event(rdpInput* input, UINT32 flags)
+typedef enum
 {
-	UINT16 sec_flags = 0;
-	wStream* s = nullptr;
-	rdpRdp* rdp = nullptr;
+	INPUT_MERGE_NONE,
+	INPUT_MERGE_REPLACE, /* absolute pointer moves, the latest position wins */
+	INPUT_MERGE_ADD      /* relative pointer moves, the deltas add up */
+} InputMerge;
 
-	WINPR_ASSERT(input);
-	WINPR_ASSERT(input->context);
+static BOOL input_flush_unlocked(rdp_input_internal* in)
+{
+	WINPR_ASSERT(in);
 
-	rdp = input->context->rdp;
+	const size_t events = in->batchEvents;
+	const size_t length = in->batchLength;
+	in->batchEvents = 0;
+	in->batchLength = 0;
+
+	if (events == 0)
+		return TRUE;
+
+	rdpContext* context = in->common.context;
+	WINPR_ASSERT(context);
+
+	/* Disconnected or reactivating since the events were queued, drop them */
+	if (!freerdp_is_active_state(context))
+		return TRUE;
+
+	rdpRdp* rdp = context->rdp;
 	WINPR_ASSERT(rdp);
 
-	if (!input_ensure_client_running(input))
+	UINT16 sec_flags = 0;
+	wStream* s = fastpath_input_pdu_init_header(rdp->fastpath, &sec_flags);
+
+	if (!s)
 		return FALSE;
 
-	/* The FastPath Synchronization eventFlags has identical values as SlowPath */
-	s = fastpath_input_pdu_init(rdp->fastpath, (BYTE)flags, FASTPATH_INPUT_EVENT_SYNC, &sec_flags);
+	if (!Stream_EnsureRemainingCapacity(s, length))
+	{
+		Stream_Release(s);
+		return FALSE;
+	}
 
-	if (!s)
+	Stream_Write(s, in->batch, length);
+	return fastpath_send_multiple_input_pdu(rdp->fastpath, s, events, sec_flags);
+}
+
+static BOOL input_merge_move(BYTE* last, const BYTE* event, InputMerge merge)
+{
+	/* eventHeader (1 byte), pointerFlags (2 bytes), followed by the position or delta */
+	if (merge == INPUT_MERGE_REPLACE)
+	{
+		memcpy(&last[3], &event[3], 4);
+		return TRUE;
+	}
+
+	const INT32 xDelta = winpr_Data_Get_INT16(&last[3]) + winpr_Data_Get_INT16(&event[3]);
+	const INT32 yDelta = winpr_Data_Get_INT16(&last[5]) + winpr_Data_Get_INT16(&event[5]);
+	if ((xDelta < INT16_MIN) || (xDelta > INT16_MAX) || (yDelta < INT16_MIN) ||
+	    (yDelta > INT16_MAX))
+		return FALSE;
+
+	winpr_Data_Write_INT16(&last[3], (INT16)xDelta);
+	winpr_Data_Write_INT16(&last[5], (INT16)yDelta);
+	return TRUE;
+}
+
+static BOOL input_arm_batch_timer(rdp_input_internal* in, UINT64 milliseconds)
+{
+	LARGE_INTEGER due = WINPR_C_ARRAY_INIT;
+	due.QuadPart = -10000ll * (INT64)milliseconds; /* relative, in 100ns */
+	return SetWaitableTimer(in->batchTimer, &due, 0, nullptr, nullptr, FALSE);
+}
+
+/* Appends the fastpath event in \b s (eventHeader and data) to the batch. Pointer moves
+ * directly following a move with identical eventHeader and pointerFlags are merged into it,
+ * anything queued in between (buttons, keys) keeps the order of events intact. */
+static BOOL input_queue_fastpath_event(rdpInput* input, wStream* s, InputMerge merge)
+{
+	BOOL rc = TRUE;
+	rdp_input_internal* in = input_cast(input);
+
+	const BYTE* event = Stream_Buffer(s);
+	const size_t length = Stream_GetPosition(s);
+	WINPR_ASSERT(length > 0);
+	WINPR_ASSERT(length <= INPUT_BATCH_MAX_EVENT_SIZE);
+
+	EnterCriticalSection(&in->batchLock);
+
+	if ((merge != INPUT_MERGE_NONE) && (in->batchEvents > 0) &&
+	    (in->batchLength - in->batchLast == length) &&
+	    (memcmp(&in->batch[in->batchLast], event, 3) == 0) &&
+	    input_merge_move(&in->batch[in->batchLast], event, merge))
+		goto out;
+
+	if ((in->batchEvents >= INPUT_BATCH_MAX_EVENTS) ||
+	    (in->batchLength + length > sizeof(in->batch)))
+		rc = input_flush_unlocked(in);
+
+	BOOL armed = TRUE;
+	if (in->batchEvents == 0)
+	{
+		in->batchDeadline = GetTickCount64() + INPUT_BATCH_INTERVAL;
+		armed = input_arm_batch_timer(in, INPUT_BATCH_INTERVAL);
+	}
+
+	in->batchLast = in->batchLength;
+	memcpy(&in->batch[in->batchLength], event, length);
+	in->batchLength += length;
+	in->batchEvents++;
+
+	/* Nobody would wake up the event loop in time, do not wait for more events */
+	if (!armed && !input_flush_unlocked(in))
+		rc = FALSE;
+
+out:
+	LeaveCriticalSection(&in->batchLock);
+	return rc;
+}
+
+static wStream* input_fastpath_event_init(wStream* buffer, BYTE* data, size_t size,
+                                          BYTE eventFlags, BYTE eventCode)
+{
+	wStream* s = Stream_StaticInit(buffer, data, size);
+	WINPR_ASSERT(eventCode < 8);
+	WINPR_ASSERT(eventFlags < 0x20);
+	Stream_Write_UINT8(s, (UINT8)(eventFlags | (eventCode << 5))); /* eventHeader (1 byte) */
+	return s;
+}
+
+BOOL input_flush(rdpInput* input, BOOL force)
+{
+	BOOL rc = TRUE;
+
+	if (!input)
+		return FALSE;
+
+	rdp_input_internal* in = input_cast(input);
+	EnterCriticalSection(&in->batchLock);
+	if (in->batchEvents > 0)
+	{
+		const UINT64 now = GetTickCount64();
+		if (force || (now >= in->batchDeadline))
+			rc = input_flush_unlocked(in);
+		/* The timer runs on a different clock and might fire a little early, nothing else
+		 * would wake up the event loop for the rest of the interval */
+		else if (!input_arm_batch_timer(in, in->batchDeadline - now))
+			rc = input_flush_unlocked(in);
+	}
+	LeaveCriticalSection(&in->batchLock);
+	return rc;
+}
+
+HANDLE input_get_event_handle(rdpInput* input)
+{
+	WINPR_ASSERT(input);
+	return input_cast(input)->batchTimer;
+}
+
+static BOOL input_send_fastpath_synchronize_event(rdpInput* input, UINT32 flags)
+{
+	wStream buffer = WINPR_C_ARRAY_INIT;
+	BYTE data[INPUT_BATCH_MAX_EVENT_SIZE] = WINPR_C_ARRAY_INIT;
+
+	WINPR_ASSERT(input);
+	WINPR_ASSERT(input->context);
+
+	if (!input_ensure_client_running(input))
 		return FALSE;
 
-	return fastpath_send_input_pdu(rdp->fastpath, s, sec_flags);
+	/* The FastPath Synchronization eventFlags has identical values as SlowPath */
+	wStream* s = input_fastpath_event_init(&buffer, data, sizeof(data), (BYTE)flags,
+	                                       FASTPATH_INPUT_EVENT_SYNC);
+	return input_queue_fastpath_event(input, s, INPUT_MERGE_NONE);
 }
 
 static BOOL input_send_fastpath_keyboard_event(rdpInput* input, UINT16 flags, UINT8 code)
 {
-	UINT16 sec_flags = 0;
-	wStream* s = nullptr;
+	wStream buffer = WINPR_C_ARRAY_INIT;
+	BYTE data[INPUT_BATCH_MAX_EVENT_SIZE] = WINPR_C_ARRAY_INIT;
 	BYTE eventFlags = 0;
-	rdpRdp* rdp = nullptr;
 
 	WINPR_ASSERT(input);
 	WINPR_ASSERT(input->context);
 
-	rdp = input->context->rdp;
-	WINPR_ASSERT(rdp);
-
 	if (!input_ensure_client_running(input))
 		return FALSE;
 
 	eventFlags |= (flags & KBD_FLAGS_RELEASE) ? FASTPATH_INPUT_KBDFLAGS_RELEASE : 0;
 	eventFlags |= (flags & KBD_FLAGS_EXTENDED) ? FASTPATH_INPUT_KBDFLAGS_EXTENDED : 0;
 	eventFlags |= (flags & KBD_FLAGS_EXTENDED1) ? FASTPATH_INPUT_KBDFLAGS_PREFIX_E1 : 0;
-	s = fastpath_input_pdu_init(rdp->fastpath, eventFlags, FASTPATH_INPUT_EVENT_SCANCODE,
-	                            &sec_flags);
-
-	if (!s)
-		return FALSE;
+	wStream* s = input_fastpath_event_init(&buffer, data, sizeof(data), eventFlags,
+	                                       FASTPATH_INPUT_EVENT_SCANCODE);
 
 	WINPR_ASSERT(code <= UINT8_MAX);
 	Stream_Write_UINT8(s, code); /* keyCode (1 byte) */
-	return fastpath_send_input_pdu(rdp->fastpath, s, sec_flags);
+	return input_queue_fastpath_event(input, s, INPUT_MERGE_NONE);
 }
 
 static BOOL input_send_fastpath_unicode_keyboard_event(rdpInput* input, UINT16 flags, UINT16 code)
 {
-	UINT16 sec_flags = 0;
-	wStream* s = nullptr;
+	wStream buffer = WINPR_C_ARRAY_INIT;
+	BYTE data[INPUT_BATCH_MAX_EVENT_SIZE] = WINPR_C_ARRAY_INIT;
 	BYTE eventFlags = 0;
-	rdpRdp* rdp = nullptr;
 
 	WINPR_ASSERT(input);
 	WINPR_ASSERT(input->context);
 	WINPR_ASSERT(input->context->settings);
 
-	rdp = input->context->rdp;
-	WINPR_ASSERT(rdp);
-
 	if (!input_ensure_client_running(input))
 		return FALSE;
 
@@ -459,29 +600,22 @@ static BOOL input_send_fastpath_unicode_keyboard_event(rdpInput* input, UINT16 f
 	}
 
 	eventFlags |= (flags & KBD_FLAGS_RELEASE) ? FASTPATH_INPUT_KBDFLAGS_RELEASE : 0;
-	s = fastpath_input_pdu_init(rdp->fastpath, eventFlags, FASTPATH_INPUT_EVENT_UNICODE,
-	                            &sec_flags);
-
-	if (!s)
-		return FALSE;
+	wStream* s = input_fastpath_event_init(&buffer, data, sizeof(data), eventFlags,
+	                                       FASTPATH_INPUT_EVENT_UNICODE);
 
 	Stream_Write_UINT16(s, code); /* unicodeCode (2 bytes) */
-	return fastpath_send_input_pdu(rdp->fastpath, s, sec_flags);
+	return input_queue_fastpath_event(input, s, INPUT_MERGE_NONE);
 }
 
 static BOOL input_send_fastpath_mouse_event(rdpInput* input, UINT16 flags, UINT16 x, UINT16 y)
 {
-	UINT16 sec_flags = 0;
-	wStream* s = nullptr;
-	rdpRdp* rdp = nullptr;
+	wStream buffer = WINPR_C_ARRAY_INIT;
+	BYTE data[INPUT_BATCH_MAX_EVENT_SIZE] = WINPR_C_ARRAY_INIT;
 
 	WINPR_ASSERT(input);
 	WINPR_ASSERT(input->context);
 	WINPR_ASSERT(input->context->settings);
 
-	rdp = input->context->rdp;
-	WINPR_ASSERT(rdp);
-
 	if (!input_ensure_client_running(input))
 		return FALSE;
 
@@ -497,28 +631,23 @@ static BOOL input_send_fastpath_mouse_event(rdpInput* input, UINT16 flags, UINT1
 		}
 	}
 
-	s = fastpath_input_pdu_init(rdp->fastpath, 0, FASTPATH_INPUT_EVENT_MOUSE, &sec_flags);
-
-	if (!s)
-		return FALSE;
+	wStream* s =
+	    input_fastpath_event_init(&buffer, data, sizeof(data), 0, FASTPATH_INPUT_EVENT_MOUSE);
 
 	input_write_mouse_event(s, flags, x, y);
-	return fastpath_send_input_pdu(rdp->fastpath, s, sec_flags);
+	return input_queue_fastpath_event(
+	    input, s, (flags == PTR_FLAGS_MOVE) ? INPUT_MERGE_REPLACE : INPUT_MERGE_NONE);
 }
 
 static BOOL input_send_fastpath_extended_mouse_event(rdpInput* input, UINT16 flags, UINT16 x,
                                                      UINT16 y)
 {
-	UINT16 sec_flags = 0;
-	wStream* s = nullptr;
-	rdpRdp* rdp = nullptr;
+	wStream buffer = WINPR_C_ARRAY_INIT;
+	BYTE data[INPUT_BATCH_MAX_EVENT_SIZE] = WINPR_C_ARRAY_INIT;
 
 	WINPR_ASSERT(input);
 	WINPR_ASSERT(input->context);
 
-	rdp = input->context->rdp;
-	WINPR_ASSERT(rdp);
-
 	if (!input_ensure_client_running(input))
 		return FALSE;
 
@@ -531,29 +660,23 @@ static BOOL input_send_fastpath_extended_mouse_event(rdpInput* input, UINT16 fla
 		return TRUE;
 	}
 
-	s = fastpath_input_pdu_init(rdp->fastpath, 0, FASTPATH_INPUT_EVENT_MOUSEX, &sec_flags);
-
-	if (!s)
-		return FALSE;
+	wStream* s =
+	    input_fastpath_event_init(&buffer, data, sizeof(data), 0, FASTPATH_INPUT_EVENT_MOUSEX);
 
 	input_write_extended_mouse_event(s, flags, x, y);
-	return fastpath_send_input_pdu(rdp->fastpath, s, sec_flags);
+	return input_queue_fastpath_event(input, s, INPUT_MERGE_NONE);
 }
 
 static BOOL input_send_fastpath_relmouse_event(rdpInput* input, UINT16 flags, INT16 xDelta,
                                                INT16 yDelta)
 {
-	UINT16 sec_flags = 0;
-	wStream* s = nullptr;
-	rdpRdp* rdp = nullptr;
+	wStream buffer = WINPR_C_ARRAY_INIT;
+	BYTE data[INPUT_BATCH_MAX_EVENT_SIZE] = WINPR_C_ARRAY_INIT;
 
 	WINPR_ASSERT(input);
 	WINPR_ASSERT(input->context);
 	WINPR_ASSERT(input->context->settings);
 
-	rdp = input->context->rdp;
-	WINPR_ASSERT(rdp);
-
 	if (!input_ensure_client_running(input))
 		return FALSE;
 
@@ -563,26 +686,25 @@ static BOOL input_send_fastpath_relmouse_event(rdpInput* input, UINT16 flags, IN
 		return FALSE;
 	}
 
-	s = fastpath_input_pdu_init(rdp->fastpath, 0, TS_FP_RELPOINTER_EVENT, &sec_flags);
-
-	if (!s)
-		return FALSE;
+	wStream* s =
+	    input_fastpath_event_init(&buffer, data, sizeof(data), 0, TS_FP_RELPOINTER_EVENT);
 
 	Stream_Write_UINT16(s, flags); /* pointerFlags (2 bytes) */
 	Stream_Write_INT16(s, xDelta); /* xDelta (2 bytes) */
 	Stream_Write_INT16(s, yDelta); /* yDelta (2 bytes) */
-	return fastpath_send_input_pdu(rdp->fastpath, s, sec_flags);
+	return input_queue_fastpath_event(
+	    input, s, (flags == PTR_FLAGS_MOVE) ? INPUT_MERGE_ADD : INPUT_MERGE_NONE);
 }
 
 static BOOL input_send_fastpath_qoe_event(rdpInput* input, UINT32 timestampMS)
 {
+	wStream buffer = WINPR_C_ARRAY_INIT;
+	BYTE data[INPUT_BATCH_MAX_EVENT_SIZE] = WINPR_C_ARRAY_INIT;
+
 	WINPR_ASSERT(input);
 	WINPR_ASSERT(input->context);
 	WINPR_ASSERT(input->context->settings);
 
-	rdpRdp* rdp = input->context->rdp;
-	WINPR_ASSERT(rdp);
-
 	if (!input_ensure_client_running(input))
 		return FALSE;
 
@@ -592,55 +714,48 @@ static BOOL input_send_fastpath_qoe_event(rdpInput* input, UINT32 timestampMS)
 		return FALSE;
 	}
 
-	UINT16 sec_flags = 0;
-	wStream* s = fastpath_input_pdu_init(rdp->fastpath, 0, TS_FP_QOETIMESTAMP_EVENT, &sec_flags);
+	wStream* s =
+	    input_fastpath_event_init(&buffer, data, sizeof(data), 0, TS_FP_QOETIMESTAMP_EVENT);
 
-	if (!s)
-		return FALSE;
+	Stream_Write_UINT32(s, timestampMS);
+	return input_queue_fastpath_event(input, s, INPUT_MERGE_NONE);
+}
 
-	if (!Stream_EnsureRemainingCapacity(s, 4))
-	{
-		Stream_Free(s, TRUE);
-		return FALSE;
-	}
+static BOOL input_send_fastpath_scancode(rdpInput* input, BYTE eventFlags, UINT8 code)
+{
+	wStream buffer = WINPR_C_ARRAY_INIT;
+	BYTE data[INPUT_BATCH_MAX_EVENT_SIZE] = WINPR_C_ARRAY_INIT;
 
-	Stream_Write_UINT32(s, timestampMS);
-	return fastpath_send_input_pdu(rdp->fastpath, s, sec_flags);
+	wStream* s = input_fastpath_event_init(&buffer, data, sizeof(data), eventFlags,
+	                                       FASTPATH_INPUT_EVENT_SCANCODE);
+	Stream_Write_UINT8(s, code); /* keyCode (1 byte) */
+	return input_queue_fastpath_event(input, s, INPUT_MERGE_NONE);
 }
 
 static BOOL input_send_fastpath_focus_in_event(rdpInput* input, UINT16 toggleStates)
 {
-	UINT16 sec_flags = 0;
-	wStream* s = nullptr;
-	BYTE eventFlags = 0;
-	rdpRdp* rdp = nullptr;
+	wStream buffer = WINPR_C_ARRAY_INIT;
+	BYTE data[INPUT_BATCH_MAX_EVENT_SIZE] = WINPR_C_ARRAY_INIT;
 
 	WINPR_ASSERT(input);
 	WINPR_ASSERT(input->context);
 
-	rdp = input->context->rdp;
-	WINPR_ASSERT(rdp);
-
 	if (!input_ensure_client_running(input))
 		return FALSE;
 
-	s = fastpath_input_pdu_init_header(rdp->fastpath, &sec_flags);
-
-	if (!s)
+	/* send a tab up like mstsc.exe */
+	if (!input_send_fastpath_scancode(input, FASTPATH_INPUT_KBDFLAGS_RELEASE, 0x0f))
 		return FALSE;
 
-	/* send a tab up like mstsc.exe */
-	eventFlags = FASTPATH_INPUT_KBDFLAGS_RELEASE | FASTPATH_INPUT_EVENT_SCANCODE << 5;
-	Stream_Write_UINT8(s, eventFlags); /* Key Release event (1 byte) */
-	Stream_Write_UINT8(s, 0x0f);       /* keyCode (1 byte) */
 	/* send the toggle key states */
-	eventFlags = (toggleStates & 0x1F) | FASTPATH_INPUT_EVENT_SYNC << 5;
-	Stream_Write_UINT8(s, eventFlags); /* toggle state (1 byte) */
+	const BYTE eventFlags = (BYTE)(toggleStates & 0x1F);
+	wStream* s = input_fastpath_event_init(&buffer, data, sizeof(data), eventFlags,
+	                                       FASTPATH_INPUT_EVENT_SYNC);
+	if (!input_queue_fastpath_event(input, s, INPUT_MERGE_NONE))
+		return FALSE;
+
 	/* send another tab up like mstsc.exe */
-	eventFlags = FASTPATH_INPUT_KBDFLAGS_RELEASE | FASTPATH_INPUT_EVENT_SCANCODE << 5;
-	Stream_Write_UINT8(s, eventFlags); /* Key Release event (1 byte) */
-	Stream_Write_UINT8(s, 0x0f);       /* keyCode (1 byte) */
-	return fastpath_send_multiple_input_pdu(rdp->fastpath, s, 3, sec_flags);
+	return input_send_fastpath_scancode(input, FASTPATH_INPUT_KBDFLAGS_RELEASE, 0x0f);
 }
 
 static BOOL input_send_fastpath_keyboard_pause_event(rdpInput* input)
@@ -649,39 +764,27 @@ static BOOL input_send_fastpath_keyboard_pause_event(rdpInput* input)
 	 * and pause-up sent nothing.  However, reverse engineering mstsc shows
 	 * it sending the following sequence:
 	 */
-	UINT16 sec_flags = 0;
-	wStream* s = nullptr;
-	const BYTE keyDownEvent = FASTPATH_INPUT_EVENT_SCANCODE << 5;
-	const BYTE keyUpEvent = (FASTPATH_INPUT_EVENT_SCANCODE << 5) | FASTPATH_INPUT_KBDFLAGS_RELEASE;
-	rdpRdp* rdp = nullptr;
-
 	WINPR_ASSERT(input);
 	WINPR_ASSERT(input->context);
 
-	rdp = input->context->rdp;
-	WINPR_ASSERT(rdp);
-
 	if (!input_ensure_client_running(input))
 		return FALSE;
 
-	s = fastpath_input_pdu_init_header(rdp->fastpath, &sec_flags);
-
-	if (!s)
-		return FALSE;
-
 	/* Control down (0x1D) */
-	Stream_Write_UINT8(s, keyDownEvent | FASTPATH_INPUT_KBDFLAGS_PREFIX_E1);
-	Stream_Write_UINT8(s, RDP_SCANCODE_CODE(RDP_SCANCODE_LCONTROL));
+	if (!input_send_fastpath_scancode(input, FASTPATH_INPUT_KBDFLAGS_PREFIX_E1,
+	                                     RDP_SCANCODE_CODE(RDP_SCANCODE_LCONTROL)))
+		return FALSE;
 	/* Numlock down (0x45) */
-	Stream_Write_UINT8(s, keyDownEvent);
-	Stream_Write_UINT8(s, RDP_SCANCODE_CODE(RDP_SCANCODE_NUMLOCK));
+	if (!input_send_fastpath_scancode(input, 0, RDP_SCANCODE_CODE(RDP_SCANCODE_NUMLOCK)))
+		return FALSE;
 	/* Control up (0x1D) */
-	Stream_Write_UINT8(s, keyUpEvent | FASTPATH_INPUT_KBDFLAGS_PREFIX_E1);
-	Stream_Write_UINT8(s, RDP_SCANCODE_CODE(RDP_SCANCODE_LCONTROL));
+	if (!input_send_fastpath_scancode(
+	        input, FASTPATH_INPUT_KBDFLAGS_RELEASE | FASTPATH_INPUT_KBDFLAGS_PREFIX_E1,
+	        RDP_SCANCODE_CODE(RDP_SCANCODE_LCONTROL)))
+		return FALSE;
 	/* Numlock down (0x45) */
-	Stream_Write_UINT8(s, keyUpEvent);
-	Stream_Write_UINT8(s, RDP_SCANCODE_CODE(RDP_SCANCODE_NUMLOCK));
-	return fastpath_send_multiple_input_pdu(rdp->fastpath, s, 4, sec_flags);
+	return input_send_fastpath_scancode(input, FASTPATH_INPUT_KBDFLAGS_RELEASE,
+	                                       RDP_SCANCODE_CODE(RDP_SCANCODE_NUMLOCK));
 }
 
 static BOOL input_recv_sync_event(rdpInput* input, wStream* s)
@@ -1170,13 +1273,18 @@ rdpInput* input_new(rdpRdp* rdp)
 	input->common.context = rdp->context;
 	input->queue = MessageQueue_New(&cb);
 	input->log = WLog_Get(TAG);
+	input->batchTimer = CreateWaitableTimerA(nullptr, FALSE, nullptr);
 
-	if (!input->queue)
+	if (!input->queue || !input->batchTimer)
 	{
+		MessageQueue_Free(input->queue);
+		if (input->batchTimer)
+			(void)CloseHandle(input->batchTimer);
 		free(input);
 		return nullptr;
 	}
 
+	InitializeCriticalSection(&input->batchLock);
 	return &input->common;
 }
 
@@ -1187,6 +1295,8 @@ void input_free(rdpInput* input)
 		rdp_input_internal* in = input_cast(input);
 
 		MessageQueue_Free(in->queue);
+		DeleteCriticalSection(&in->batchLock);
+		(void)CloseHandle(in->batchTimer);
 		free(in);
 	}
 }
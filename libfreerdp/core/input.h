@@ -28,8 +28,16 @@
 #include <freerdp/freerdp.h>
 #include <freerdp/api.h>
 
+#include <winpr/synch.h>
 #include <winpr/stream.h>
 
+/* Without the optional numEvents field a fastpath input PDU holds at most 15 events */
+#define INPUT_BATCH_MAX_EVENTS 15
+/* eventHeader and the largest event (mouse, extended and relative mouse) */
+#define INPUT_BATCH_MAX_EVENT_SIZE 7
+/* Time in ms an event may wait for others to share its PDU */
+#define INPUT_BATCH_INTERVAL 8
+
 typedef struct
 {
 	rdpInput common;
@@ -42,6 +50,15 @@ typedef struct
 	UINT16 lastX;
 	UINT16 lastY;
 	wLog* log;
+
+	/* fastpath input events not sent yet, see input_flush */
+	CRITICAL_SECTION batchLock;
+	HANDLE batchTimer;
+	BYTE batch[INPUT_BATCH_MAX_EVENTS * INPUT_BATCH_MAX_EVENT_SIZE];
+	size_t batchLength;
+	size_t batchEvents;
+	size_t batchLast; /* offset of the last event */
+	UINT64 batchDeadline;
 } rdp_input_internal;
 
 WINPR_ATTR_NODISCARD
@@ -67,6 +84,16 @@ FREERDP_LOCAL int input_process_events(rdpInput* input);
 WINPR_ATTR_NODISCARD
 FREERDP_LOCAL BOOL input_register_client_callbacks(rdpInput* input);
 
+/** @brief Sends the batched fastpath input events, if \b force is not set only once the
+ *  oldest of them waited INPUT_BATCH_INTERVAL ms. The event handle is armed again if they
+ *  are not due yet. */
+WINPR_ATTR_NODISCARD
+FREERDP_LOCAL BOOL input_flush(rdpInput* input, BOOL force);
+
+/** @brief A handle signaled when batched input events are due, see input_flush */
+WINPR_ATTR_NODISCARD
+FREERDP_LOCAL HANDLE input_get_event_handle(rdpInput* input);
+
 FREERDP_LOCAL void input_free(rdpInput* input);
 
 WINPR_ATTR_MALLOC(input_free, 1)
@@ -19,7 +19,211 @@
 
 #include <freerdp/config.h>
 
+#include <winpr/assert.h>
+#include <winpr/intrin.h>
+#include <winpr/interlocked.h>
+#include <winpr/sysinfo.h>
+#include <winpr/string.h>
+
+#include <freerdp/utils/gfx.h>
+
 #include "rdp.h"
+#include "fastpath.h"
+#include "../crypto/tls_session.h"
+
+/* Histograms use log-linear buckets (HdrHistogram style): values below
+ * METRICS_SUB_BUCKETS are exact, above that every power of two is split into
+ * METRICS_SUB_BUCKETS linear buckets, giving a relative error below 12.5% */
+#define METRICS_SUB_BUCKET_BITS 3
+#define METRICS_SUB_BUCKETS (1u << METRICS_SUB_BUCKET_BITS)
+#define METRICS_MAX_OCTAVE 48
+#define METRICS_HISTOGRAM_BUCKETS \
+	((METRICS_MAX_OCTAVE - METRICS_SUB_BUCKET_BITS + 2) * METRICS_SUB_BUCKETS)
+
+typedef struct
+{
+	LONGLONG sum;
+	LONGLONG max;
+	LONGLONG buckets[METRICS_HISTOGRAM_BUCKETS];
+} rdpMetricsHistogram;
+
+typedef struct
+{
+	rdpMetrics common;
+
+	LONGLONG counters[FREERDP_METRIC_COUNT][FREERDP_METRICS_MAX_LABELS];
+	rdpMetricsHistogram* histograms[FREERDP_METRIC_COUNT][FREERDP_METRICS_MAX_LABELS];
+} rdpMetricsInternal;
+
+typedef struct
+{
+	const char* name;
+	const char* help;
+	BOOL histogram;
+	BOOL nanoseconds;
+	const char* label;
+	const char* (*labelToString)(UINT32 label);
+	UINT32 firstOctave; /* exported histogram buckets, as powers of two */
+	UINT32 lastOctave;
+} METRIC_DESCRIPTOR;
+
+static const char* metrics_data_pdu_label(UINT32 label)
+{
+	return data_pdu_type_to_string((UINT8)label);
+}
+
+static const char* metrics_fastpath_label(UINT32 label)
+{
+	return fastpath_update_to_string((UINT8)label);
+}
+
+static const char* metrics_codec_label(UINT32 label)
+{
+	return rdpgfx_get_codec_id_string((UINT16)label);
+}
+
+static const char* metrics_tls_session_label(UINT32 label)
+{
+	return tls_session_mode_string(label);
+}
+
+static const char* metrics_state_label(UINT32 label)
+{
+	return rdp_state_string(label);
+}
+
+static const METRIC_DESCRIPTOR METRIC_DESCRIPTORS[FREERDP_METRIC_COUNT] = {
+	{ "freerdp_pdu_dispatch_seconds", "Time to process a slow path data PDU", TRUE, TRUE, "type",
+	  metrics_data_pdu_label, 10, 36 },
+	{ "freerdp_fastpath_update_seconds", "Time to process a fastpath update", TRUE, TRUE, "type",
+	  metrics_fastpath_label, 10, 36 },
+	{ "freerdp_codec_decode_seconds", "Time to decode a surface command", TRUE, TRUE, "codec",
+	  metrics_codec_label, 10, 36 },
+	{ "freerdp_codec_decode_bytes", "Encoded bytes passed to a decoder", FALSE, FALSE, "codec",
+	  metrics_codec_label, 0, 0 },
+	{ "freerdp_codec_encode_seconds", "Time to encode a surface command", TRUE, TRUE, "codec",
+	  metrics_codec_label, 10, 36 },
+	{ "freerdp_codec_encode_bytes", "Encoded bytes produced by an encoder", FALSE, FALSE, "codec",
+	  metrics_codec_label, 0, 0 },
+	{ "freerdp_transport_read_bytes", "Bytes read from the transport", FALSE, FALSE, nullptr,
+	  nullptr, 0, 0 },
+	{ "freerdp_transport_write_bytes", "Bytes written to the transport", FALSE, FALSE, nullptr,
+	  nullptr, 0, 0 },
+	{ "freerdp_transport_write_blocked_seconds", "Time a write waited for the socket", TRUE,
+	  TRUE, nullptr, nullptr, 10, 36 },
+	{ "freerdp_frame_ack_seconds", "Time from starting a frame to its acknowledge", TRUE, TRUE,
+	  nullptr, nullptr, 14, 36 },
+	{ "freerdp_frame_queue_depth", "Frames queued on the client when acknowledging", TRUE, FALSE,
+	  nullptr, nullptr, 0, 16 },
+	{ "freerdp_tls_handshake_seconds", "Time to complete a TLS handshake", TRUE, TRUE, "session",
+	  metrics_tls_session_label, 14, 36 },
+	{ "freerdp_connect_state_seconds", "Time spent in a connection state", TRUE, TRUE, "state",
+	  metrics_state_label, 14, 36 },
+};
+
+static inline rdpMetricsInternal* metrics_cast(rdpMetrics* metrics)
+{
+	return (rdpMetricsInternal*)metrics;
+}
+
+static inline const rdpMetricsInternal* metrics_cast_const(const rdpMetrics* metrics)
+{
+	return (const rdpMetricsInternal*)metrics;
+}
+
+static inline void metrics_atomic_add(LONGLONG volatile* target, UINT64 value)
+{
+	LONGLONG cur = *target;
+	for (;;)
+	{
+		const LONGLONG next = (LONGLONG)((UINT64)cur + value);
+		const LONGLONG prev = InterlockedCompareExchange64(target, next, cur);
+		if (prev == cur)
+			return;
+		cur = prev;
+	}
+}
+
+static inline void metrics_atomic_max(LONGLONG volatile* target, UINT64 value)
+{
+	LONGLONG cur = *target;
+	while ((UINT64)cur < value)
+	{
+		const LONGLONG prev = InterlockedCompareExchange64(target, (LONGLONG)value, cur);
+		if (prev == cur)
+			return;
+		cur = prev;
+	}
+}
+
+static inline UINT64 metrics_atomic_load(const LONGLONG volatile* target)
+{
+	return (UINT64)InterlockedCompareExchange64((LONGLONG volatile*)target, 0, 0);
+}
+
+static inline UINT32 metrics_msb(UINT64 value)
+{
+	WINPR_ASSERT(value != 0);
+
+	const UINT32 hi = (UINT32)(value >> 32);
+	if (hi != 0)
+		return 63 - __lzcnt(hi);
+	return 31 - __lzcnt((UINT32)value);
+}
+
+static inline size_t metrics_bucket(UINT64 value)
+{
+	if (value < METRICS_SUB_BUCKETS)
+		return (size_t)value;
+
+	const UINT32 msb = metrics_msb(value);
+	const size_t sub = (value >> (msb - METRICS_SUB_BUCKET_BITS)) & (METRICS_SUB_BUCKETS - 1);
+	const size_t index = (msb - METRICS_SUB_BUCKET_BITS + 1) * METRICS_SUB_BUCKETS + sub;
+	return MIN(index, METRICS_HISTOGRAM_BUCKETS - 1);
+}
+
+/* exclusive upper bound of the values counted in a bucket */
+static inline UINT64 metrics_bucket_limit(size_t index)
+{
+	if (index < METRICS_SUB_BUCKETS)
+		return index + 1;
+
+	const size_t octave = index / METRICS_SUB_BUCKETS;
+	const size_t sub = index % METRICS_SUB_BUCKETS;
+	return (UINT64)(METRICS_SUB_BUCKETS + sub + 1) << (octave - 1);
+}
+
+static BOOL metrics_valid(const rdpMetrics* metrics, FreeRDP_MetricId id, UINT32 label,
+                          BOOL histogram)
+{
+	if (!metrics)
+		return FALSE;
+	if (((size_t)id >= FREERDP_METRIC_COUNT) || (label >= FREERDP_METRICS_MAX_LABELS))
+		return FALSE;
+	return METRIC_DESCRIPTORS[id].histogram == histogram;
+}
+
+static rdpMetricsHistogram* metrics_histogram(rdpMetricsInternal* internal, FreeRDP_MetricId id,
+                                              UINT32 label)
+{
+	rdpMetricsHistogram* histogram = internal->histograms[id][label];
+	if (histogram)
+		return histogram;
+
+	/* allocated on first use, a concurrent allocation loses the race and is discarded */
+	rdpMetricsHistogram* cur = calloc(1, sizeof(rdpMetricsHistogram));
+	if (!cur)
+		return nullptr;
+
+	histogram = InterlockedCompareExchangePointer((PVOID volatile*)&internal->histograms[id][label],
+	                                              cur, nullptr);
+	if (histogram)
+	{
+		free(cur);
+		return histogram;
+	}
+	return cur;
+}
 
 double metrics_write_bytes(rdpMetrics* metrics, UINT32 UncompressedBytes, UINT32 CompressedBytes)
 {
@@ -37,21 +241,294 @@ double metrics_write_bytes(rdpMetrics* metrics, UINT32 UncompressedBytes, UINT32
 	return CompressionRatio;
 }
 
-rdpMetrics* metrics_new(rdpContext* context)
+BOOL freerdp_metrics_add(rdpMetrics* metrics, FreeRDP_MetricId id, UINT32 label, UINT64 value)
+{
+	if (!metrics_valid(metrics, id, label, FALSE))
+		return FALSE;
+
+	rdpMetricsInternal* internal = metrics_cast(metrics);
+	metrics_atomic_add(&internal->counters[id][label], value);
+	return TRUE;
+}
+
+BOOL freerdp_metrics_record(rdpMetrics* metrics, FreeRDP_MetricId id, UINT32 label, UINT64 value)
+{
+	if (!metrics_valid(metrics, id, label, TRUE))
+		return FALSE;
+
+	rdpMetricsHistogram* histogram = metrics_histogram(metrics_cast(metrics), id, label);
+	if (!histogram)
+		return FALSE;
+
+	metrics_atomic_add(&histogram->buckets[metrics_bucket(value)], 1);
+	metrics_atomic_add(&histogram->sum, value);
+	metrics_atomic_max(&histogram->max, value);
+	return TRUE;
+}
+
+BOOL freerdp_metrics_record_since(rdpMetrics* metrics, FreeRDP_MetricId id, UINT32 label,
+                                  UINT64 start)
+{
+	const UINT64 now = winpr_GetTickCount64NS();
+	return freerdp_metrics_record(metrics, id, label, (now > start) ? now - start : 0);
+}
+
+UINT64 freerdp_metrics_get_counter(const rdpMetrics* metrics, FreeRDP_MetricId id, UINT32 label)
+{
+	if (!metrics_valid(metrics, id, label, FALSE))
+		return 0;
+
+	const rdpMetricsInternal* internal = metrics_cast_const(metrics);
+	return metrics_atomic_load(&internal->counters[id][label]);
+}
+
+static UINT64 metrics_percentile(const UINT64* buckets, UINT64 count, UINT64 max, UINT32 percent)
+{
+	const UINT64 rank = (count * percent + 99) / 100;
+	UINT64 seen = 0;
+
+	for (size_t x = 0; x < METRICS_HISTOGRAM_BUCKETS; x++)
+	{
+		seen += buckets[x];
+		if ((seen >= rank) && (seen > 0))
+			return MIN(metrics_bucket_limit(x) - 1, max);
+	}
+	return max;
+}
+
+BOOL freerdp_metrics_get_histogram(const rdpMetrics* metrics, FreeRDP_MetricId id, UINT32 label,
+                                   FREERDP_METRICS_HISTOGRAM* histogram)
+{
+	UINT64 buckets[METRICS_HISTOGRAM_BUCKETS] = WINPR_C_ARRAY_INIT;
+
+	if (!histogram || !metrics_valid(metrics, id, label, TRUE))
+		return FALSE;
+
+	const FREERDP_METRICS_HISTOGRAM empty = WINPR_C_ARRAY_INIT;
+	*histogram = empty;
+
+	const rdpMetricsInternal* internal = metrics_cast_const(metrics);
+	const rdpMetricsHistogram* cur = internal->histograms[id][label];
+	if (!cur)
+		return TRUE;
+
+	/* The snapshot is not atomic as a whole, so the count is derived from the buckets to
+	 * keep the percentiles consistent */
+	for (size_t x = 0; x < ARRAYSIZE(buckets); x++)
+	{
+		buckets[x] = metrics_atomic_load(&cur->buckets[x]);
+		histogram->count += buckets[x];
+	}
+	histogram->sum = metrics_atomic_load(&cur->sum);
+	histogram->max = metrics_atomic_load(&cur->max);
+	histogram->p50 = metrics_percentile(buckets, histogram->count, histogram->max, 50);
+	histogram->p90 = metrics_percentile(buckets, histogram->count, histogram->max, 90);
+	histogram->p99 = metrics_percentile(buckets, histogram->count, histogram->max, 99);
+	return TRUE;
+}
+
+WINPR_ATTR_FORMAT_ARG(2, 3)
+static BOOL metrics_printf(wStream* s, WINPR_FORMAT_ARG const char* fmt, ...)
 {
-	rdpMetrics* metrics = nullptr;
+	va_list ap = WINPR_C_ARRAY_INIT;
 
-	metrics = (rdpMetrics*)calloc(1, sizeof(rdpMetrics));
+	va_start(ap, fmt);
+	const int len = vsnprintf(nullptr, 0, fmt, ap);
+	va_end(ap);
 
-	if (metrics)
+	if (len < 0)
+		return FALSE;
+
+	if (!Stream_EnsureRemainingCapacity(s, (size_t)len + 1))
+		return FALSE;
+
+	va_start(ap, fmt);
+	const int rc = vsnprintf(Stream_PointerAs(s, char), (size_t)len + 1, fmt, ap);
+	va_end(ap);
+
+	if (rc != len)
+		return FALSE;
+
+	Stream_Seek(s, (size_t)len);
+	return TRUE;
+}
+
+static BOOL metrics_print_value(wStream* s, const METRIC_DESCRIPTOR* desc, UINT64 value)
+{
+	if (desc->nanoseconds)
+		return metrics_printf(s, " %.9f\n", (double)value / 1000000000.0);
+	return metrics_printf(s, " %" PRIu64 "\n", value);
+}
+
+/* prints '<name><suffix>{<extra>,<label>="<value>"' without the closing brace */
+static BOOL metrics_print_sample(wStream* s, const METRIC_DESCRIPTOR* desc, const char* suffix,
+                                 const char* extra, UINT32 label)
+{
+	const char* sep = "";
+
+	if (!metrics_printf(s, "%s%s{", desc->name, suffix))
+		return FALSE;
+
+	if (extra && (strlen(extra) > 0))
 	{
-		metrics->context = context;
+		if (!metrics_printf(s, "%s", extra))
+			return FALSE;
+		sep = ",";
 	}
 
-	return metrics;
+	if (desc->label)
+		return metrics_printf(s, "%s%s=\"%s\"", sep, desc->label, desc->labelToString(label));
+	return TRUE;
+}
+
+static BOOL metrics_export_histogram(wStream* s, const METRIC_DESCRIPTOR* desc,
+                                     const rdpMetricsHistogram* histogram, const char* extra,
+                                     UINT32 label)
+{
+	const BOOL hasLabels = desc->label || (extra && (strlen(extra) > 0));
+	UINT64 cumulative = 0;
+	size_t bucket = 0;
+
+	for (UINT32 octave = desc->firstOctave; octave <= desc->lastOctave; octave++)
+	{
+		/* bucket limits are exclusive, so 'le' is one below the power of two */
+		const UINT64 limit = 1ull << octave;
+		for (; (bucket < METRICS_HISTOGRAM_BUCKETS) && (metrics_bucket_limit(bucket) <= limit);
+		     bucket++)
+			cumulative += metrics_atomic_load(&histogram->buckets[bucket]);
+
+		if (!metrics_print_sample(s, desc, "_bucket", extra, label))
+			return FALSE;
+		if (desc->nanoseconds)
+		{
+			if (!metrics_printf(s, "%sle=\"%.9f\"}", hasLabels ? "," : "",
+			                    (double)(limit - 1) / 1000000000.0))
+				return FALSE;
+		}
+		else if (!metrics_printf(s, "%sle=\"%" PRIu64 "\"}", hasLabels ? "," : "", limit - 1))
+			return FALSE;
+		if (!metrics_printf(s, " %" PRIu64 "\n", cumulative))
+			return FALSE;
+	}
+
+	for (; bucket < METRICS_HISTOGRAM_BUCKETS; bucket++)
+		cumulative += metrics_atomic_load(&histogram->buckets[bucket]);
+
+	if (!metrics_print_sample(s, desc, "_bucket", extra, label) ||
+	    !metrics_printf(s, "%sle=\"+Inf\"} %" PRIu64 "\n", hasLabels ? "," : "", cumulative))
+		return FALSE;
+
+	if (!metrics_print_sample(s, desc, "_count", extra, label) ||
+	    !metrics_printf(s, "} %" PRIu64 "\n", cumulative))
+		return FALSE;
+
+	if (!metrics_print_sample(s, desc, "_sum", extra, label) || !metrics_printf(s, "}") ||
+	    !metrics_print_value(s, desc, metrics_atomic_load(&histogram->sum)))
+		return FALSE;
+	return TRUE;
+}
+
+static BOOL metrics_export_family(wStream* s, const METRIC_DESCRIPTOR* desc, FreeRDP_MetricId id,
+                                  const rdpMetrics* const* metrics, const char* const* labels,
+                                  size_t count)
+{
+	if (!metrics_printf(s, "# TYPE %s %s\n", desc->name, desc->histogram ? "histogram" : "counter"))
+		return FALSE;
+	/* all counters count bytes */
+	const char* unit = desc->nanoseconds ? "seconds" : (desc->histogram ? nullptr : "bytes");
+	if (unit && !metrics_printf(s, "# UNIT %s %s\n", desc->name, unit))
+		return FALSE;
+	if (!metrics_printf(s, "# HELP %s %s.\n", desc->name, desc->help))
+		return FALSE;
+
+	for (size_t x = 0; x < count; x++)
+	{
+		const rdpMetricsInternal* internal = metrics_cast_const(metrics[x]);
+		const char* extra = labels ? labels[x] : nullptr;
+		if (!internal)
+			continue;
+
+		const UINT32 maxLabel = desc->label ? FREERDP_METRICS_MAX_LABELS : 1;
+		for (UINT32 label = 0; label < maxLabel; label++)
+		{
+			if (desc->histogram)
+			{
+				const rdpMetricsHistogram* histogram = internal->histograms[id][label];
+				if (!histogram)
+					continue;
+				if (!metrics_export_histogram(s, desc, histogram, extra, label))
+					return FALSE;
+			}
+			else
+			{
+				const UINT64 value = metrics_atomic_load(&internal->counters[id][label]);
+				if ((value == 0) && desc->label)
+					continue;
+				if (!metrics_print_sample(s, desc, "_total", extra, label) ||
+				    !metrics_printf(s, "} %" PRIu64 "\n", value))
+					return FALSE;
+			}
+		}
+	}
+	return TRUE;
+}
+
+char* freerdp_metrics_to_openmetrics(const rdpMetrics* const* metrics, const char* const* labels,
+                                     size_t count, size_t* plength)
+{
+	char* str = nullptr;
+
+	if (!metrics && (count > 0))
+		return nullptr;
+
+	wStream* s = Stream_New(nullptr, 4096);
+	if (!s)
+		return nullptr;
+
+	for (size_t x = 0; x < FREERDP_METRIC_COUNT; x++)
+	{
+		if (!metrics_export_family(s, &METRIC_DESCRIPTORS[x], (FreeRDP_MetricId)x, metrics, labels,
+		                           count))
+			goto fail;
+	}
+
+	if (!metrics_printf(s, "# EOF\n"))
+		goto fail;
+
+	if (plength)
+		*plength = Stream_GetPosition(s);
+
+	Stream_Write_UINT8(s, 0);
+	str = Stream_BufferAs(s, char);
+	Stream_Free(s, FALSE);
+	return str;
+
+fail:
+	Stream_Free(s, TRUE);
+	return nullptr;
+}
+
+rdpMetrics* metrics_new(rdpContext* context)
+{
+	rdpMetricsInternal* internal = (rdpMetricsInternal*)calloc(1, sizeof(rdpMetricsInternal));
+
+	if (!internal)
+		return nullptr;
+
+	internal->common.context = context;
+	return &internal->common;
 }
 
 void metrics_free(rdpMetrics* metrics)
 {
-	free(metrics);
+	rdpMetricsInternal* internal = metrics_cast(metrics);
+	if (!internal)
+		return;
+
+	for (size_t x = 0; x < FREERDP_METRIC_COUNT; x++)
+	{
+		for (size_t y = 0; y < FREERDP_METRICS_MAX_LABELS; y++)
+			free(internal->histograms[x][y]);
+	}
+	free(internal);
 }
@@ -356,6 +356,7 @@ static state_run_t peer_recv_data_pdu(freerdp_peer* client, wStream* s,
 	           data_pdu_type_to_string(type), type, length);
 #endif
 
+	const UINT64 start = winpr_GetTickCount64NS();
 	switch (type)
 	{
 		case DATA_PDU_TYPE_SYNCHRONIZE:
@@ -422,6 +423,8 @@ static state_run_t peer_recv_data_pdu(freerdp_peer* client, wStream* s,
 			break;
 	}
 
+	freerdp_metrics_record_since(client->context->metrics, FREERDP_METRIC_PDU_DISPATCH_TIME, type,
+	                             start);
 	return STATE_RUN_SUCCESS;
 }
 
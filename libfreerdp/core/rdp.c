@@ -1197,6 +1197,12 @@ state_run_t rdp_recv_data_pdu(rdpRdp* rdp, wStream* s)
 		const BYTE* pDstData = nullptr;
 		UINT16 SrcSize = compressedLength - 18;
 
+		if (rdp->update->FastPathUpdateRaw && rdp->update->SlowPathCompressed)
+		{
+			if (!rdp->update->SlowPathCompressed(rdp->context, type))
+				return STATE_RUN_FAILED;
+		}
+
 		if (!Stream_CheckAndLogRequiredLengthWLog(rdp->log, s, SrcSize))
 		{
 			WLog_Print(rdp->log, WLOG_ERROR,
@@ -1232,6 +1238,7 @@ state_run_t rdp_recv_data_pdu(rdpRdp* rdp, wStream* s)
 	WLog_Print(rdp->log, WLOG_DEBUG, "recv %s Data PDU (0x%02" PRIX8 "), length: %" PRIu16 "",
 	           data_pdu_type_to_string(type), type, length);
 
+	const UINT64 start = winpr_GetTickCount64NS();
 	switch (type)
 	{
 		case DATA_PDU_TYPE_UPDATE:
@@ -1385,6 +1392,9 @@ state_run_t rdp_recv_data_pdu(rdpRdp* rdp, wStream* s)
 			break;
 	}
 
+	freerdp_metrics_record_since(rdp->context->metrics, FREERDP_METRIC_PDU_DISPATCH_TIME, type,
+	                             start);
+
 	if (cs != s)
 		Stream_Release(cs);
 
@@ -2582,6 +2592,7 @@ void rdp_free(rdpRdp* rdp)
 	if (rdp)
 	{
 		freerdp_timer_free(rdp->timer);
+		rdp_client_discard_codecs(rdp);
 		rdp_reset_free(rdp);
 
 		freerdp_settings_free(rdp->settings);
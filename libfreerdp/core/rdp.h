@@ -144,6 +144,8 @@ typedef enum
 #define STREAM_MED 0x02
 #define STREAM_HI 0x04
 
+#define RDP_CONNECTION_TIMELINE_SIZE 64
+
 struct rdp_rdp
 {
 	CONNECTION_STATE state;
@@ -210,6 +212,18 @@ struct rdp_rdp
 	WINPR_JSON* wellknown;
 	FreeRDPTimer* timer;
 	WINPR_ATTR_NODISCARD pGetCommonAccessToken GetCommonAccessToken;
+
+	UINT64 connectStart;
+	UINT64 stateStart;
+	size_t timelineCount;
+	FREERDP_CONNECTION_TIMELINE_ENTRY timeline[RDP_CONNECTION_TIMELINE_SIZE];
+
+	HANDLE codecThread;
+	rdpCodecs* preparedCodecs;
+	UINT32 preparedCodecsFlags;
+	UINT32 preparedCodecsWidth;
+	UINT32 preparedCodecsHeight;
+	BOOL preparedCodecsResult;
 };
 
 WINPR_ATTR_NODISCARD
@@ -810,130 +810,230 @@ static BOOL freerdp_tcp_is_hostname_resolvable(rdpContext* context, const char*
 	return TRUE;
 }
 
-static BOOL freerdp_tcp_connect_timeout(rdpContext* context, int sockfd, struct sockaddr* addr,
-                                        size_t addrlen, UINT32 timeout)
+typedef struct
+{
+	SOCKET s;
+	HANDLE event;
+	const struct addrinfo* addr;
+	UINT64 deadline;
+} t_connect_attempt;
+
+static void log_connect_failure(const struct addrinfo* addr, int error)
+{
+	char ebuffer[256] = WINPR_C_ARRAY_INIT;
+	char hostname[512] = WINPR_C_ARRAY_INIT;
+	char serv[512] = WINPR_C_ARRAY_INIT;
+
+	WINPR_ASSERT(addr);
+	getnameinfo(addr->ai_addr, WINPR_ASSERTING_INT_CAST(socklen_t, addr->ai_addrlen), hostname,
+	            WINPR_ASSERTING_INT_CAST(socklen_t, sizeof(hostname)), serv,
+	            WINPR_ASSERTING_INT_CAST(socklen_t, sizeof(serv)), NI_NUMERICHOST | NI_NUMERICSERV);
+	WLog_WARN(TAG, "connect to %s:%s failed with error: %s [%d]", hostname, serv,
+	          winpr_strerror(error, ebuffer, sizeof(ebuffer)), error);
+}
+
+static void connect_attempt_free(t_connect_attempt* attempt)
 {
-	BOOL rc = FALSE;
-	HANDLE handles[2] = WINPR_C_ARRAY_INIT;
-	DWORD count = 0;
-	u_long arg = 0;
-	DWORD tout = (timeout > 0) ? timeout : INFINITE;
+	WINPR_ASSERT(attempt);
+
+	if (attempt->s != INVALID_SOCKET)
+		closesocket(attempt->s);
+	if (attempt->event)
+		(void)CloseHandle(attempt->event);
+	attempt->s = INVALID_SOCKET;
+	attempt->event = nullptr;
+}
 
-	handles[count] = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+static BOOL connect_attempt_start(t_connect_attempt* attempt, const struct addrinfo* addr,
+                                  UINT32 timeout)
+{
+	WINPR_ASSERT(attempt);
+	WINPR_ASSERT(addr);
 
-	if (!handles[count])
+	attempt->addr = addr;
+	attempt->deadline = (timeout > 0) ? GetTickCount64() + timeout : UINT64_MAX;
+	attempt->s = _socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
+	if (attempt->s == INVALID_SOCKET)
 		return FALSE;
 
-	const int wsastatus = WSAEventSelect((SOCKET)sockfd, handles[count++],
-	                                     FD_READ | FD_WRITE | FD_CONNECT | FD_CLOSE);
+	attempt->event = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+	if (!attempt->event)
+		goto fail;
 
-	if (wsastatus < 0)
+	if (WSAEventSelect(attempt->s, attempt->event, FD_WRITE | FD_CONNECT | FD_CLOSE) < 0)
 	{
 		WLog_ERR(TAG, "WSAEventSelect failed with %d", WSAGetLastError());
 		goto fail;
 	}
 
-	handles[count++] = utils_get_abort_event(context->rdp);
-
+	if (_connect(attempt->s, addr->ai_addr, WINPR_ASSERTING_INT_CAST(int, addr->ai_addrlen)) < 0)
 	{
-		const int constatus =
-		    _connect((SOCKET)sockfd, addr, WINPR_ASSERTING_INT_CAST(int, addrlen));
-		if (constatus < 0)
-		{
-			const int estatus = WSAGetLastError();
+		const int estatus = WSAGetLastError();
 
-			switch (estatus)
-			{
-				case WSAEINPROGRESS:
-				case WSAEWOULDBLOCK:
-					break;
+		switch (estatus)
+		{
+			case WSAEINPROGRESS:
+			case WSAEWOULDBLOCK:
+				break;
 
-				default:
-					goto fail;
-			}
+			default:
+				log_connect_failure(addr, estatus);
+				goto fail;
 		}
 	}
+	return TRUE;
+
+fail:
+	connect_attempt_free(attempt);
+	return FALSE;
+}
+
+/* The attempt was signaled, check if the connection was established */
+static BOOL connect_attempt_succeeded(t_connect_attempt* attempt)
+{
+	WINPR_ASSERT(attempt);
+
+	INT32 optval = 0;
+	socklen_t optlen = sizeof(optval);
+	if (getsockopt(attempt->s, SOL_SOCKET, SO_ERROR, (void*)&optval, &optlen) < 0)
+		return FALSE;
 
+	if (optval != 0)
 	{
-		const DWORD wstatus = WaitForMultipleObjects(count, handles, FALSE, tout);
-		if (WAIT_OBJECT_0 != wstatus)
-			goto fail;
+		log_connect_failure(attempt->addr, optval);
+		return FALSE;
 	}
+	return TRUE;
+}
+
+/**
+ * Connects to the first reachable address of \b addrs.
+ *
+ * The addresses are tried in order, but an attempt that did not complete within
+ * TCP_CONNECT_ATTEMPT_DELAY is raced against the next address instead of blocking it. The first
+ * connection established wins, all other attempts are cancelled.
+ *
+ * @return The connected (blocking) socket or INVALID_SOCKET
+ */
+SOCKET freerdp_tcp_connect_race(rdpContext* context, const struct addrinfo* const* addrs,
+                                size_t count, UINT32 timeout)
+{
+	SOCKET sockfd = INVALID_SOCKET;
+	t_connect_attempt attempts[MAXIMUM_WAIT_OBJECTS - 1] = WINPR_C_ARRAY_INIT;
+	HANDLE handles[MAXIMUM_WAIT_OBJECTS] = WINPR_C_ARRAY_INIT;
+	DWORD active = 0;
+	size_t next = 0;
+	UINT64 nextStart = 0;
+
+	WINPR_ASSERT(context);
+	WINPR_ASSERT(addrs || (count == 0));
 
+	HANDLE abortEvent = utils_get_abort_event(context->rdp);
+
+	for (;;)
 	{
-		const int status = WSAEventSelect((SOCKET)sockfd, handles[0], 0);
-		if (status < 0)
+		UINT64 now = GetTickCount64();
+
+		/* Start the next attempt if the pending ones take too long or all failed */
+		while ((next < count) && (active < ARRAYSIZE(attempts)) &&
+		       ((active == 0) || (now >= nextStart)))
 		{
-			WLog_ERR(TAG, "WSAEventSelect failed with %d", WSAGetLastError());
-			goto fail;
+			const struct addrinfo* addr = addrs[next++];
+			if (!connect_attempt_start(&attempts[active], addr, timeout))
+				continue;
+
+			active++;
+			nextStart = now + TCP_CONNECT_ATTEMPT_DELAY;
 		}
-	}
 
-	if (_ioctlsocket((SOCKET)sockfd, FIONBIO, &arg) != 0)
-		goto fail;
+		if (active == 0)
+			break;
 
-	rc = TRUE;
-fail:
-{
-	INT32 optval = 0;
-	socklen_t optlen = sizeof(optval);
-	if (getsockopt(sockfd, SOL_SOCKET, SO_ERROR, &optval, &optlen) >= 0)
-	{
-		if (optval != 0)
+		/* Wait until an attempt completes, the next one is due or the oldest timed out */
+		UINT64 due = (next < count) ? nextStart : UINT64_MAX;
+		for (DWORD x = 0; x < active; x++)
 		{
-			char ebuffer[256] = WINPR_C_ARRAY_INIT;
-			char hostname[512] = WINPR_C_ARRAY_INIT;
-			char serv[512] = WINPR_C_ARRAY_INIT;
-
-			getnameinfo(addr, WINPR_ASSERTING_INT_CAST(socklen_t, addrlen), hostname,
-			            WINPR_ASSERTING_INT_CAST(socklen_t, sizeof(hostname)), serv,
-			            WINPR_ASSERTING_INT_CAST(socklen_t, sizeof(serv)), NI_NUMERICSERV);
-			WLog_WARN(TAG, "connect to %s:%s failed with error: %s [%" PRId32 "]", hostname, serv,
-			          winpr_strerror(optval, ebuffer, sizeof(ebuffer)), optval);
-			rc = FALSE;
+			handles[x] = attempts[x].event;
+			due = MIN(due, attempts[x].deadline);
 		}
-	}
-}
+		handles[active] = abortEvent;
 
-	(void)CloseHandle(handles[0]);
-	return rc;
-}
+		DWORD wait = INFINITE;
+		if (due != UINT64_MAX)
+			wait = (due > now) ? (DWORD)MIN(due - now, INFINITE - 1) : 0;
 
-typedef struct
-{
-	SOCKET s;
-	struct addrinfo* addr;
-	struct addrinfo* result;
-} t_peer;
+		const DWORD status = WaitForMultipleObjects(active + 1, handles, FALSE, wait);
+		now = GetTickCount64();
 
-static void peer_free(t_peer* peer)
-{
-	if (peer->s != INVALID_SOCKET)
-		closesocket(peer->s);
+		if (status == WAIT_OBJECT_0 + active)
+		{
+			freerdp_set_last_error_if_not(context, FREERDP_ERROR_CONNECT_CANCELLED);
+			break;
+		}
+
+		if (status < WAIT_OBJECT_0 + active)
+		{
+			t_connect_attempt* attempt = &attempts[status - WAIT_OBJECT_0];
+			if (connect_attempt_succeeded(attempt))
+			{
+				u_long arg = 0;
+
+				if ((WSAEventSelect(attempt->s, attempt->event, 0) == 0) &&
+				    (_ioctlsocket(attempt->s, FIONBIO, &arg) == 0))
+				{
+					sockfd = attempt->s;
+					attempt->s = INVALID_SOCKET;
+				}
+				else
+					WLog_ERR(TAG, "failed to reset socket to blocking mode");
+				break;
+			}
+
+			/* Failed, drop it and try the next address right away */
+			connect_attempt_free(attempt);
+			*attempt = attempts[--active];
+			nextStart = now;
+		}
+		else if (status != WAIT_TIMEOUT)
+		{
+			WLog_ERR(TAG, "WaitForMultipleObjects failed with %" PRIu32, GetLastError());
+			break;
+		}
+
+		for (DWORD x = 0; x < active;)
+		{
+			if (attempts[x].deadline > now)
+			{
+				x++;
+				continue;
+			}
+
+			WLog_WARN(TAG, "connection attempt timed out after %" PRIu32 " ms", timeout);
+			connect_attempt_free(&attempts[x]);
+			attempts[x] = attempts[--active];
+			nextStart = now;
+		}
+	}
+
+	for (DWORD x = 0; x < active; x++)
+		connect_attempt_free(&attempts[x]);
 
-	freeaddrinfo(peer->addr);
-	memset(peer, 0, sizeof(t_peer));
-	peer->s = INVALID_SOCKET;
+	return sockfd;
 }
 
 static int freerdp_tcp_connect_multi(rdpContext* context, char** hostnames, const UINT32* ports,
-                                     UINT32 count, UINT16 port, WINPR_ATTR_UNUSED UINT32 timeout)
+                                     UINT32 count, UINT16 port, UINT32 timeout)
 {
-	UINT32 sindex = count;
 	SOCKET sockfd = INVALID_SOCKET;
-	struct addrinfo* addr = nullptr;
-	struct addrinfo* result = nullptr;
 
-	HANDLE* events = (HANDLE*)calloc(count + 1, sizeof(HANDLE));
-	t_peer* peers = (t_peer*)calloc(count, sizeof(t_peer));
+	struct addrinfo** results = (struct addrinfo**)calloc(count, sizeof(struct addrinfo*));
+	const struct addrinfo** addrs =
+	    (const struct addrinfo**)calloc(count, sizeof(const struct addrinfo*));
 
-	if (!peers || !events || (count < 1))
-	{
-		free(peers);
-		free((void*)events);
-		return -1;
-	}
+	if (!results || !addrs || (count < 1))
+		goto fail;
 
+	size_t naddrs = 0;
 	for (UINT32 index = 0; index < count; index++)
 	{
 		int curPort = port;
@@ -941,12 +1041,12 @@ static int freerdp_tcp_connect_multi(rdpContext* context, char** hostnames, cons
 		if (ports)
 			curPort = WINPR_ASSERTING_INT_CAST(int, ports[index]);
 
-		result = freerdp_tcp_resolve_host(hostnames[index], curPort, 0);
+		struct addrinfo* result = freerdp_tcp_resolve_host(hostnames[index], curPort, 0);
 
 		if (!result)
 			continue;
 
-		addr = result;
+		struct addrinfo* addr = result;
 
 		if ((addr->ai_family == AF_INET6) && (addr->ai_next != nullptr))
 		{
@@ -960,51 +1060,25 @@ static int freerdp_tcp_connect_multi(rdpContext* context, char** hostnames, cons
 				addr = result;
 		}
 
-		peers[index].s = _socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
-
-		if (peers[index].s == INVALID_SOCKET)
-		{
-			freeaddrinfo(result);
-			continue;
-		}
-
-		peers[index].addr = addr;
-		peers[index].result = result;
+		results[index] = result;
+		addrs[naddrs++] = addr;
 	}
 
-	for (UINT32 index = 0; index < count; index++)
-	{
-		sockfd = peers[index].s;
-		addr = peers[index].addr;
-
-		if ((sockfd == INVALID_SOCKET) || (!addr))
-			continue;
-
-		/* blocking tcp connect */
-		const int rc =
-		    _connect(sockfd, addr->ai_addr, WINPR_ASSERTING_INT_CAST(int, addr->ai_addrlen));
+	/* The targets are alternatives, race them instead of waiting for each one in turn */
+	sockfd = freerdp_tcp_connect_race(context, addrs, naddrs, timeout);
 
-		if (rc >= 0)
-		{
-			/* connection success */
-			sindex = index;
-			break;
-		}
-	}
+	if (sockfd == INVALID_SOCKET)
+		freerdp_set_last_error_log(context, FREERDP_ERROR_CONNECT_CANCELLED);
 
-	if (sindex < count)
+fail:
+	if (results)
 	{
-		sockfd = peers[sindex].s;
-		peers[sindex].s = INVALID_SOCKET;
+		for (UINT32 index = 0; index < count; index++)
+			freeaddrinfo(results[index]);
 	}
-	else
-		freerdp_set_last_error_log(context, FREERDP_ERROR_CONNECT_CANCELLED);
-
-	for (UINT32 index = 0; index < count; index++)
-		peer_free(&peers[index]);
 
-	free(peers);
-	free((void*)events);
+	free((void*)results);
+	free((void*)addrs);
 	return (int)sockfd;
 }
 
@@ -1249,7 +1323,7 @@ static int freerdp_host_connect(rdpContext* context, const char* hostname, int p
 	}
 	freerdp_set_last_error_log(context, 0);
 
-	/* By default we take the first returned entry.
+	/* Addresses are tried in the order returned, a slow attempt is raced against the next one.
 	 * If PreferIPv6OverIPv4 = TRUE we reorder addresses by preference:
 	 * IPv6 addresses come first, then other addresses.
 	 */
@@ -1259,29 +1333,28 @@ static int freerdp_host_connect(rdpContext* context, const char* hostname, int p
 	if (rc < 0)
 		goto fail;
 
-	do
 	{
-		sockfd = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
-		if (sockfd >= 0)
+		size_t count = 0;
+		const struct addrinfo* addrs[MAXIMUM_WAIT_OBJECTS - 1] = WINPR_C_ARRAY_INIT;
+		const UINT32 IPvX = freerdp_settings_get_uint32(context->settings, FreeRDP_ForceIPvX);
+
+		for (; addr && (count < ARRAYSIZE(addrs)); addr = addr->ai_next)
 		{
-			log_connection_address(hostname, addr);
+			if ((IPvX == 4) && (addr->ai_family != AF_INET))
+				continue;
+			if ((IPvX == 6) && (addr->ai_family != AF_INET6))
+				continue;
 
-			if (!freerdp_tcp_connect_timeout(context, sockfd, addr->ai_addr, addr->ai_addrlen,
-			                                 timeout))
-			{
-				close(sockfd);
-				sockfd = -1;
-			}
+			log_connection_address(hostname, addr);
+			addrs[count++] = addr;
 		}
 
-		if (sockfd < 0)
-		{
-			const int lrc =
-			    get_next_addrinfo(context, addr->ai_next, &addr, FREERDP_ERROR_CONNECT_FAILED);
-			if (lrc < 0)
-				goto fail;
-		}
-	} while (sockfd < 0);
+		const SOCKET s = freerdp_tcp_connect_race(context, addrs, count, timeout);
+		if (s != INVALID_SOCKET)
+			sockfd = (int)s;
+		else
+			freerdp_set_last_error_if_not(context, FREERDP_ERROR_CONNECT_FAILED);
+	}
 
 fail:
 	freeaddrinfo(result);
@@ -44,6 +44,10 @@
 #define BIO_TYPE_BUFFERED 67
 #define BIO_TYPE_NAMEDPIPE 69
 
+/* Delay before racing the next address against a pending connection attempt, as recommended by
+ * RFC 8305 (Happy Eyeballs) */
+#define TCP_CONNECT_ATTEMPT_DELAY 250
+
 #define BIO_C_SET_SOCKET 1101
 #define BIO_C_GET_SOCKET 1102
 #define BIO_C_GET_EVENT 1103
@@ -116,6 +120,11 @@ WINPR_ATTR_NODISCARD
 FREERDP_LOCAL int freerdp_tcp_connect(rdpContext* context, const char* hostname, int port,
                                       DWORD timeout);
 
+WINPR_ATTR_NODISCARD
+FREERDP_LOCAL SOCKET freerdp_tcp_connect_race(rdpContext* context,
+                                              const struct addrinfo* const* addrs, size_t count,
+                                              UINT32 timeout);
+
 WINPR_ATTR_NODISCARD
 FREERDP_LOCAL int freerdp_tcp_default_connect(rdpContext* context, rdpSettings* settings,
                                               const char* hostname, int port, DWORD timeout);
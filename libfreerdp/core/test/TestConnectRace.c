@@ -0,0 +1,302 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Staggered TCP connect unit test
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+#include <winpr/thread.h>
+#include <winpr/sysinfo.h>
+#include <winpr/winsock.h>
+
+#include <freerdp/freerdp.h>
+
+#include "../tcp.h"
+
+/* A connection to a listener with a full accept queue only stalls where the SYN is dropped
+ * instead of refused, so the test needs Linux */
+#if defined(__linux__)
+#include <unistd.h>
+
+typedef struct
+{
+	int listener;
+	int filler;
+	UINT16 port;
+	struct addrinfo* addr;
+} TEST_ENDPOINT;
+
+static BOOL test_resolve(TEST_ENDPOINT* endpoint)
+{
+	char service[16] = WINPR_C_ARRAY_INIT;
+	struct addrinfo hints = WINPR_C_ARRAY_INIT;
+
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_NUMERICHOST | AI_NUMERICSERV;
+
+	(void)_snprintf(service, sizeof(service), "%" PRIu16, endpoint->port);
+	return getaddrinfo("127.0.0.1", service, &hints, &endpoint->addr) == 0;
+}
+
+/* Binds a socket to a free port of the loopback interface */
+static BOOL test_bind(TEST_ENDPOINT* endpoint)
+{
+	struct sockaddr_in addr = WINPR_C_ARRAY_INIT;
+	socklen_t len = sizeof(addr);
+
+	endpoint->filler = -1;
+	endpoint->listener = socket(AF_INET, SOCK_STREAM, 0);
+	if (endpoint->listener < 0)
+		return FALSE;
+
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if ((bind(endpoint->listener, (struct sockaddr*)&addr, sizeof(addr)) != 0) ||
+	    (getsockname(endpoint->listener, (struct sockaddr*)&addr, &len) != 0))
+		return FALSE;
+
+	endpoint->port = ntohs(addr.sin_port);
+	return test_resolve(endpoint);
+}
+
+static BOOL test_listen(TEST_ENDPOINT* endpoint)
+{
+	return test_bind(endpoint) && (listen(endpoint->listener, 8) == 0);
+}
+
+/* A port nothing listens on, connecting is refused */
+static BOOL test_refusing(TEST_ENDPOINT* endpoint)
+{
+	if (!test_bind(endpoint))
+		return FALSE;
+
+	(void)close(endpoint->listener);
+	endpoint->listener = -1;
+	return TRUE;
+}
+
+/* A listener that never answers: its accept queue is filled by a connection that is never
+ * accepted, further SYNs are dropped */
+static BOOL test_stalling(TEST_ENDPOINT* endpoint)
+{
+	if (!test_bind(endpoint) || (listen(endpoint->listener, 0) != 0))
+		return FALSE;
+
+	endpoint->filler = socket(AF_INET, SOCK_STREAM, 0);
+	if (endpoint->filler < 0)
+		return FALSE;
+
+	return connect(endpoint->filler, endpoint->addr->ai_addr, endpoint->addr->ai_addrlen) == 0;
+}
+
+static void test_endpoint_free(TEST_ENDPOINT* endpoint)
+{
+	if (endpoint->filler >= 0)
+		(void)close(endpoint->filler);
+	if (endpoint->listener >= 0)
+		(void)close(endpoint->listener);
+	if (endpoint->addr)
+		freeaddrinfo(endpoint->addr);
+	memset(endpoint, 0, sizeof(TEST_ENDPOINT));
+	endpoint->listener = -1;
+	endpoint->filler = -1;
+}
+
+static UINT16 test_peer_port(SOCKET s)
+{
+	struct sockaddr_in addr = WINPR_C_ARRAY_INIT;
+	socklen_t len = sizeof(addr);
+
+	if (getpeername((int)s, (struct sockaddr*)&addr, &len) != 0)
+		return 0;
+	return ntohs(addr.sin_port);
+}
+
+static SOCKET test_race(rdpContext* context, TEST_ENDPOINT* endpoints, size_t count,
+                        UINT32 timeout, UINT64* elapsed)
+{
+	const struct addrinfo* addrs[4] = WINPR_C_ARRAY_INIT;
+
+	WINPR_ASSERT(count <= ARRAYSIZE(addrs));
+	for (size_t x = 0; x < count; x++)
+		addrs[x] = endpoints[x].addr;
+
+	const UINT64 start = GetTickCount64();
+	const SOCKET s = freerdp_tcp_connect_race(context, addrs, count, timeout);
+	*elapsed = GetTickCount64() - start;
+	return s;
+}
+
+/* A refused address is skipped without waiting for the attempt delay */
+static BOOL test_refused_first(rdpContext* context)
+{
+	BOOL rc = FALSE;
+	UINT64 elapsed = 0;
+	TEST_ENDPOINT endpoints[2] = WINPR_C_ARRAY_INIT;
+
+	if (!test_refusing(&endpoints[0]) || !test_listen(&endpoints[1]))
+		goto fail;
+
+	const SOCKET s = test_race(context, endpoints, ARRAYSIZE(endpoints), 0, &elapsed);
+	if (s == INVALID_SOCKET)
+		goto fail;
+
+	rc = (test_peer_port(s) == endpoints[1].port) && (elapsed < TCP_CONNECT_ATTEMPT_DELAY);
+	closesocket(s);
+	if (!rc)
+		(void)fprintf(stderr, "refused address delayed the connection by %" PRIu64 " ms\n",
+		              elapsed);
+fail:
+	test_endpoint_free(&endpoints[0]);
+	test_endpoint_free(&endpoints[1]);
+	return rc;
+}
+
+/* A stalled address is raced against the next one after the attempt delay */
+static BOOL test_stalled_first(rdpContext* context)
+{
+	BOOL rc = FALSE;
+	UINT64 elapsed = 0;
+	TEST_ENDPOINT endpoints[2] = WINPR_C_ARRAY_INIT;
+
+	if (!test_stalling(&endpoints[0]) || !test_listen(&endpoints[1]))
+		goto fail;
+
+	const SOCKET s = test_race(context, endpoints, ARRAYSIZE(endpoints), 0, &elapsed);
+	if (s == INVALID_SOCKET)
+		goto fail;
+
+	/* a tick of tolerance, the stalled SYN is first retransmitted after a second */
+	rc = (test_peer_port(s) == endpoints[1].port) &&
+	     (elapsed + 16 >= TCP_CONNECT_ATTEMPT_DELAY) && (elapsed < 4 * TCP_CONNECT_ATTEMPT_DELAY);
+	closesocket(s);
+	if (!rc)
+		(void)fprintf(stderr, "stalled address raced after %" PRIu64 " ms\n", elapsed);
+fail:
+	test_endpoint_free(&endpoints[0]);
+	test_endpoint_free(&endpoints[1]);
+	return rc;
+}
+
+/* Attempts are given up once the connect timeout expired */
+static BOOL test_deadline(rdpContext* context)
+{
+	BOOL rc = FALSE;
+	UINT64 elapsed = 0;
+	TEST_ENDPOINT endpoints[2] = WINPR_C_ARRAY_INIT;
+	const UINT32 timeout = 2 * TCP_CONNECT_ATTEMPT_DELAY;
+
+	if (!test_stalling(&endpoints[0]) || !test_stalling(&endpoints[1]))
+		goto fail;
+
+	const SOCKET s = test_race(context, endpoints, ARRAYSIZE(endpoints), timeout, &elapsed);
+	if (s != INVALID_SOCKET)
+	{
+		closesocket(s);
+		goto fail;
+	}
+
+	/* The second attempt started late and times out last */
+	rc = (elapsed + 16 >= timeout + TCP_CONNECT_ATTEMPT_DELAY) &&
+	     (elapsed < 2 * timeout + TCP_CONNECT_ATTEMPT_DELAY);
+	if (!rc)
+		(void)fprintf(stderr, "timeout of %" PRIu32 " ms expired after %" PRIu64 " ms\n",
+		              timeout, elapsed);
+fail:
+	test_endpoint_free(&endpoints[0]);
+	test_endpoint_free(&endpoints[1]);
+	return rc;
+}
+
+static DWORD WINAPI test_abort_thread(LPVOID arg)
+{
+	rdpContext* context = arg;
+
+	Sleep(TCP_CONNECT_ATTEMPT_DELAY / 2);
+	if (!freerdp_abort_connect_context(context))
+		return 1;
+	return 0;
+}
+
+/* Aborting the connection cancels pending attempts right away */
+static BOOL test_abort(rdpContext* context)
+{
+	BOOL rc = FALSE;
+	UINT64 elapsed = 0;
+	TEST_ENDPOINT endpoints[1] = WINPR_C_ARRAY_INIT;
+
+	if (!test_stalling(&endpoints[0]))
+		goto fail;
+
+	HANDLE thread = CreateThread(nullptr, 0, test_abort_thread, context, 0, nullptr);
+	if (!thread)
+		goto fail;
+
+	const SOCKET s = test_race(context, endpoints, ARRAYSIZE(endpoints), 0, &elapsed);
+	(void)WaitForSingleObject(thread, INFINITE);
+	(void)CloseHandle(thread);
+
+	if (s != INVALID_SOCKET)
+	{
+		closesocket(s);
+		goto fail;
+	}
+
+	rc = (freerdp_get_last_error(context) == FREERDP_ERROR_CONNECT_CANCELLED) &&
+	     (elapsed < 2 * TCP_CONNECT_ATTEMPT_DELAY);
+	if (!rc)
+		(void)fprintf(stderr, "abort took %" PRIu64 " ms\n", elapsed);
+fail:
+	test_endpoint_free(&endpoints[0]);
+	return rc;
+}
+#endif
+
+int TestConnectRace(int argc, char* argv[])
+{
+	int rc = -1;
+
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+#if defined(__linux__)
+	freerdp* instance = freerdp_new();
+	if (!instance || !freerdp_context_new(instance))
+		goto fail;
+
+	if (!test_refused_first(instance->context))
+		goto fail;
+	if (!test_stalled_first(instance->context))
+		goto fail;
+	if (!test_deadline(instance->context))
+		goto fail;
+
+	/* must be last, the context stays aborted */
+	if (!test_abort(instance->context))
+		goto fail;
+
+	rc = 0;
+fail:
+	if (instance)
+		freerdp_context_free(instance);
+	freerdp_free(instance);
+#else
+	rc = 0;
+#endif
+	return rc;
+}
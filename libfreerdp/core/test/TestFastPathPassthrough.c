@@ -0,0 +1,431 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Compressed fast-path passthrough unit test
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+
+#include <winpr/crt.h>
+
+#include <freerdp/freerdp.h>
+#include <freerdp/peer.h>
+#include <freerdp/codec/bulk.h>
+#include <freerdp/transport_io.h>
+
+#include "../fastpath.h"
+#include "../rdp.h"
+
+#define TEST_RECTS 3
+#define TEST_RECT_WIDTH 64
+#define TEST_RECT_HEIGHT 48
+#define TEST_RECT_SIZE (TEST_RECT_WIDTH * TEST_RECT_HEIGHT * 4)
+#define TEST_FRAME_SIZE (TEST_RECTS * TEST_RECT_SIZE)
+
+/* Three connections as the proxy sees them: target -> proxy client, proxy server -> client.
+ * Server side contexts capture what they send, client side contexts are fed with it. */
+typedef struct
+{
+	rdpContext context;
+	freerdp_peer* peer;
+	wStream* wire;
+
+	/* proxy client: forwarding state, modelled after pf_client_fastpath_update_raw */
+	rdpContext* front;
+	BOOL armed;
+	BOOL active;
+	BOOL fragment;
+	size_t forwarded;
+
+	/* client: what was received */
+	BYTE frame[TEST_FRAME_SIZE];
+	size_t frameLength;
+	size_t compressedFragments;
+} TestContext;
+
+static int test_write_pdu(rdpTransport* transport, wStream* s)
+{
+	TestContext* tc = (TestContext*)transport_get_context(transport);
+	WINPR_ASSERT(tc);
+
+	const size_t length = Stream_Length(s);
+	if (!Stream_EnsureRemainingCapacity(tc->wire, length))
+		return -1;
+	Stream_Write(tc->wire, Stream_Buffer(s), length);
+	return (int)length;
+}
+
+static BOOL test_capture_output(TestContext* tc)
+{
+	tc->wire = Stream_New(nullptr, 4096);
+	if (!tc->wire)
+		return FALSE;
+
+	rdpTransportIo io = *freerdp_get_io_callbacks(&tc->context);
+	io.WritePdu = test_write_pdu;
+	return freerdp_set_io_callbacks(&tc->context, &io);
+}
+
+static BOOL test_apply_settings(rdpSettings* settings, UINT32 level)
+{
+	return freerdp_settings_set_bool(settings, FreeRDP_FastPathOutput, TRUE) &&
+	       freerdp_settings_set_bool(settings, FreeRDP_CompressionEnabled, TRUE) &&
+	       freerdp_settings_set_uint32(settings, FreeRDP_CompressionLevel, level) &&
+	       freerdp_settings_set_uint32(settings, FreeRDP_MultifragMaxRequestSize, 0x40000);
+}
+
+static TestContext* test_server_new(UINT32 level)
+{
+	freerdp_peer* peer = calloc(1, sizeof(freerdp_peer));
+	if (!peer)
+		return nullptr;
+
+	peer->ContextSize = sizeof(TestContext);
+	if (!freerdp_peer_context_new(peer))
+	{
+		free(peer);
+		return nullptr;
+	}
+
+	TestContext* tc = (TestContext*)peer->context;
+	tc->peer = peer;
+	if (!test_apply_settings(tc->context.settings, level) || !test_capture_output(tc))
+	{
+		Stream_Free(tc->wire, TRUE);
+		freerdp_peer_context_free(peer);
+		free(peer);
+		return nullptr;
+	}
+	return tc;
+}
+
+static void test_server_free(TestContext* tc)
+{
+	if (!tc)
+		return;
+
+	freerdp_peer* peer = tc->peer;
+	Stream_Free(tc->wire, TRUE);
+	freerdp_peer_context_free(peer);
+	free(peer);
+}
+
+static TestContext* test_client_new(UINT32 level)
+{
+	freerdp* instance = freerdp_new();
+	if (!instance)
+		return nullptr;
+
+	instance->ContextSize = sizeof(TestContext);
+	if (!freerdp_context_new(instance))
+	{
+		freerdp_free(instance);
+		return nullptr;
+	}
+
+	TestContext* tc = (TestContext*)instance->context;
+	if (!test_apply_settings(tc->context.settings, level))
+	{
+		freerdp_context_free(instance);
+		freerdp_free(instance);
+		return nullptr;
+	}
+	return tc;
+}
+
+static void test_client_free(TestContext* tc)
+{
+	if (!tc)
+		return;
+
+	freerdp* instance = tc->context.instance;
+	freerdp_context_free(instance);
+	freerdp_free(instance);
+}
+
+/** feeds everything the sender wrote to the receiver, one fast-path PDU at a time */
+static BOOL test_deliver(TestContext* sender, TestContext* receiver)
+{
+	wStream* wire = sender->wire;
+	rdpRdp* rdp = receiver->context.rdp;
+
+	Stream_SealLength(wire);
+	Stream_ResetPosition(wire);
+	while (Stream_GetRemainingLength(wire) > 0)
+	{
+		wStream sbuffer = WINPR_C_ARRAY_INIT;
+		UINT16 length = 0;
+		wStream* s = Stream_StaticInit(&sbuffer, Stream_Pointer(wire),
+		                               Stream_GetRemainingLength(wire));
+		if (!fastpath_read_header_rdp(rdp->fastpath, s, &length))
+			return FALSE;
+
+		const size_t pduLength = Stream_GetPosition(s) + length;
+		if (pduLength > Stream_GetRemainingLength(wire))
+			return FALSE;
+
+		s = Stream_StaticInit(&sbuffer, Stream_Pointer(wire), pduLength);
+		if (!fastpath_read_header_rdp(rdp->fastpath, s, &length))
+			return FALSE;
+		if (state_run_failed(fastpath_recv_updates(rdp->fastpath, s)))
+			return FALSE;
+		Stream_Seek(wire, pduLength);
+	}
+
+	Stream_SetPosition(wire, 0);
+	Stream_SetLength(wire, 0);
+	return TRUE;
+}
+
+/** same rule as the proxy: forwarding may only start where the history starts over */
+static BOOL test_history_restarts(const FASTPATH_RAW_UPDATE* update)
+{
+	const BYTE flags = update->compressionFlags;
+	if ((flags & (PACKET_COMPRESSED | PACKET_AT_FRONT | PACKET_FLUSHED)) == 0)
+		return FALSE;
+
+	if ((flags & 0x0F) != PACKET_COMPR_TYPE_RDP61)
+		return (flags & (PACKET_AT_FRONT | PACKET_FLUSHED)) != 0;
+
+	if (update->length < 2)
+		return FALSE;
+
+	const BYTE l1 = update->data[0];
+	const BYTE l2 = update->data[1];
+	if (((flags & PACKET_FLUSHED) == 0) && ((l1 & L1_PACKET_AT_FRONT) == 0))
+		return FALSE;
+	if (l2 & PACKET_FLUSHED)
+		return TRUE;
+	return ((l2 & PACKET_COMPRESSED) != 0) && ((l2 & PACKET_AT_FRONT) != 0);
+}
+
+static BOOL test_proxy_update_raw(rdpContext* context, const FASTPATH_RAW_UPDATE* update,
+                                  BOOL* handled)
+{
+	TestContext* tc = (TestContext*)context;
+
+	*handled = FALSE;
+	if ((update->fragmentation != FASTPATH_FRAGMENT_SINGLE) &&
+	    (update->fragmentation != FASTPATH_FRAGMENT_FIRST))
+	{
+		if (!tc->fragment)
+			return TRUE;
+
+		*handled = TRUE;
+		tc->forwarded++;
+		return freerdp_update_send_fastpath_raw(tc->front, update);
+	}
+
+	tc->fragment = FALSE;
+	if (!tc->armed)
+		return TRUE;
+
+	if (!tc->active)
+	{
+		if (!test_history_restarts(update))
+			return TRUE;
+		if (!freerdp_update_set_compression_passthrough(tc->front, TRUE))
+			return FALSE;
+		tc->active = TRUE;
+	}
+
+	tc->fragment = TRUE;
+	*handled = TRUE;
+	tc->forwarded++;
+	return freerdp_update_send_fastpath_raw(tc->front, update);
+}
+
+/** what the proxy does with updates it does not forward: decode and send them again */
+static BOOL test_proxy_bitmap_update(rdpContext* context, const BITMAP_UPDATE* bitmap)
+{
+	TestContext* tc = (TestContext*)context;
+	WINPR_ASSERT(tc->front);
+	return tc->front->update->BitmapUpdate(tc->front, bitmap);
+}
+
+static BOOL test_client_update_raw(rdpContext* context, const FASTPATH_RAW_UPDATE* update,
+                                   BOOL* handled)
+{
+	TestContext* tc = (TestContext*)context;
+
+	*handled = FALSE;
+	if (update->compressionFlags & PACKET_COMPRESSED)
+		tc->compressedFragments++;
+	return TRUE;
+}
+
+static BOOL test_client_bitmap_update(rdpContext* context, const BITMAP_UPDATE* bitmap)
+{
+	TestContext* tc = (TestContext*)context;
+
+	tc->frameLength = 0;
+	for (UINT32 x = 0; x < bitmap->number; x++)
+	{
+		const BITMAP_DATA* rect = &bitmap->rectangles[x];
+		if (rect->bitmapLength > sizeof(tc->frame) - tc->frameLength)
+			return FALSE;
+		memcpy(&tc->frame[tc->frameLength], rect->bitmapDataStream, rect->bitmapLength);
+		tc->frameLength += rect->bitmapLength;
+	}
+	return TRUE;
+}
+
+/** compressible, but different for every frame so the history is referenced */
+static void test_frame_data(BYTE* data, UINT32 frame)
+{
+	for (size_t x = 0; x < TEST_FRAME_SIZE; x++)
+	{
+		const size_t pixel = x / 4;
+		data[x] = (BYTE)(((pixel % TEST_RECT_WIDTH) / 8) * 17 + (pixel / 96) * 3 + frame * 29 +
+		                 (x % 4) * 50);
+	}
+}
+
+static BOOL test_send_frame(TestContext* server, UINT32 frame)
+{
+	static BYTE data[TEST_FRAME_SIZE];
+	BITMAP_DATA rects[TEST_RECTS] = WINPR_C_ARRAY_INIT;
+
+	test_frame_data(data, frame);
+	for (size_t x = 0; x < TEST_RECTS; x++)
+	{
+		BITMAP_DATA* rect = &rects[x];
+		rect->destLeft = (UINT32)x * TEST_RECT_WIDTH;
+		rect->destRight = rect->destLeft + TEST_RECT_WIDTH - 1;
+		rect->destBottom = TEST_RECT_HEIGHT - 1;
+		rect->width = TEST_RECT_WIDTH;
+		rect->height = TEST_RECT_HEIGHT;
+		rect->bitsPerPixel = 32;
+		rect->bitmapLength = TEST_RECT_SIZE;
+		rect->bitmapDataStream = &data[x * TEST_RECT_SIZE];
+	}
+
+	const BITMAP_UPDATE update = { .number = TEST_RECTS, .rectangles = rects };
+	return server->context.update->BitmapUpdate(&server->context, &update);
+}
+
+/** sends a frame from @p sender and checks the client received it unmodified */
+static BOOL test_frame(TestContext* sender, TestContext* target, TestContext* proxy,
+                       TestContext* front, TestContext* client, UINT32 frame)
+{
+	BYTE expected[TEST_FRAME_SIZE] = WINPR_C_ARRAY_INIT;
+
+	client->frameLength = 0;
+	if (!test_send_frame(sender, frame))
+		return FALSE;
+	if ((sender == target) && !test_deliver(target, proxy))
+		return FALSE;
+	if (!test_deliver(front, client))
+		return FALSE;
+
+	test_frame_data(expected, frame);
+	if ((client->frameLength != sizeof(expected)) ||
+	    (memcmp(client->frame, expected, sizeof(expected)) != 0))
+	{
+		(void)fprintf(stderr, "frame %" PRIu32 " differs after passing the proxy\n", frame);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+static BOOL test_passthrough(UINT32 level)
+{
+	BOOL rc = FALSE;
+	UINT32 frame = 0;
+	TestContext* target = test_server_new(level);
+	TestContext* proxy = test_client_new(level);
+	TestContext* front = test_server_new(level);
+	TestContext* client = test_client_new(level);
+
+	if (!target || !proxy || !front || !client)
+		goto fail;
+
+	proxy->front = &front->context;
+	proxy->context.update->FastPathUpdateRaw = test_proxy_update_raw;
+	proxy->context.update->BitmapUpdate = test_proxy_bitmap_update;
+	client->context.update->FastPathUpdateRaw = test_client_update_raw;
+	client->context.update->BitmapUpdate = test_client_bitmap_update;
+
+	/* not armed, the proxy decodes and compresses again */
+	if (!test_frame(target, target, proxy, front, client, frame++) || (proxy->forwarded != 0))
+		goto fail;
+
+	/* armed in the middle of the target history, nothing can be forwarded yet */
+	proxy->armed = TRUE;
+	if (!test_frame(target, target, proxy, front, client, frame++) || proxy->active)
+		goto fail;
+
+	/* the target starts over, forwarding starts with the first update that shows it,
+	 * fragments included. RDP 6.1 might send a few uncompressed updates before. */
+	if (!freerdp_update_set_compression_passthrough(&target->context, TRUE) ||
+	    !freerdp_update_set_compression_passthrough(&target->context, FALSE))
+		goto fail;
+	for (; !proxy->active && (frame < 8); frame++)
+	{
+		if (!test_frame(target, target, proxy, front, client, frame))
+			goto fail;
+	}
+	if (!proxy->active || (proxy->forwarded < 2))
+		goto fail;
+
+	/* the proxy's own updates must not touch the history the client shares with the target */
+	client->compressedFragments = 0;
+	if (!test_frame(front, target, proxy, front, client, frame++) ||
+	    (client->compressedFragments != 0))
+		goto fail;
+
+	/* forwarded updates referencing history sent before the proxy's own update */
+	const size_t forwarded = proxy->forwarded;
+	for (size_t x = 0; x < 2; x++)
+	{
+		if (!test_frame(target, target, proxy, front, client, frame++))
+			goto fail;
+	}
+	if ((proxy->forwarded <= forwarded) || (client->compressedFragments == 0))
+		goto fail;
+
+	/* suspended, the proxy compresses on its own again and flushes the client history */
+	proxy->armed = FALSE;
+	proxy->active = FALSE;
+	if (!freerdp_update_set_compression_passthrough(&front->context, FALSE))
+		goto fail;
+	for (size_t x = 0; x < 2; x++)
+	{
+		if (!test_frame(target, target, proxy, front, client, frame++))
+			goto fail;
+	}
+
+	rc = TRUE;
+fail:
+	if (!rc)
+		(void)fprintf(stderr, "compression level %" PRIu32 " failed\n", level);
+	test_client_free(client);
+	test_server_free(front);
+	test_client_free(proxy);
+	test_server_free(target);
+	return rc;
+}
+
+int TestFastPathPassthrough(WINPR_ATTR_UNUSED int argc, WINPR_ATTR_UNUSED char* argv[])
+{
+	const UINT32 levels[] = { PACKET_COMPR_TYPE_64K, PACKET_COMPR_TYPE_RDP6,
+		                      PACKET_COMPR_TYPE_RDP61 };
+
+	for (size_t x = 0; x < ARRAYSIZE(levels); x++)
+	{
+		if (!test_passthrough(levels[x]))
+			return -1;
+	}
+	return 0;
+}
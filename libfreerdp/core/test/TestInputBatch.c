@@ -0,0 +1,359 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Fast-path input batching unit test
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+
+#include <freerdp/freerdp.h>
+#include <freerdp/input.h>
+#include <freerdp/transport_io.h>
+
+#include "../fastpath.h"
+#include "../input.h"
+#include "../rdp.h"
+
+#define TEST_MAX_PDUS 4
+#define TEST_MAX_EVENTS 32
+
+typedef struct
+{
+	BYTE code;
+	BYTE flags;
+	UINT16 pointerFlags;
+	INT32 x;
+	INT32 y;
+} TEST_EVENT;
+
+typedef struct
+{
+	size_t count;
+	TEST_EVENT events[TEST_MAX_EVENTS];
+} TEST_PDU;
+
+typedef struct
+{
+	rdpContext context;
+	wStream* wire;
+} TestContext;
+
+static int test_write_pdu(rdpTransport* transport, wStream* s)
+{
+	TestContext* tc = (TestContext*)transport_get_context(transport);
+	WINPR_ASSERT(tc);
+
+	const size_t length = Stream_Length(s);
+	if (!Stream_EnsureRemainingCapacity(tc->wire, length))
+		return -1;
+	Stream_Write(tc->wire, Stream_Buffer(s), length);
+	return (int)length;
+}
+
+static void test_free(TestContext* tc)
+{
+	if (!tc)
+		return;
+
+	freerdp* instance = tc->context.instance;
+	Stream_Free(tc->wire, TRUE);
+	freerdp_context_free(instance);
+	freerdp_free(instance);
+}
+
+static TestContext* test_new(void)
+{
+	freerdp* instance = freerdp_new();
+	if (!instance)
+		return nullptr;
+
+	instance->ContextSize = sizeof(TestContext);
+	if (!freerdp_context_new(instance))
+	{
+		freerdp_free(instance);
+		return nullptr;
+	}
+
+	TestContext* tc = (TestContext*)instance->context;
+	rdpSettings* settings = tc->context.settings;
+	tc->wire = Stream_New(nullptr, 4096);
+	if (!tc->wire || !freerdp_settings_set_bool(settings, FreeRDP_FastPathInput, TRUE) ||
+	    !freerdp_settings_set_bool(settings, FreeRDP_HasRelativeMouseEvent, TRUE) ||
+	    !input_register_client_callbacks(tc->context.input))
+		goto fail;
+
+	rdpTransportIo io = *freerdp_get_io_callbacks(&tc->context);
+	io.WritePdu = test_write_pdu;
+	if (!freerdp_set_io_callbacks(&tc->context, &io))
+		goto fail;
+
+	/* input is only sent once the connection is active */
+	tc->context.rdp->state = CONNECTION_STATE_ACTIVE;
+	return tc;
+
+fail:
+	test_free(tc);
+	return nullptr;
+}
+
+static BOOL test_read_event(wStream* s, TEST_EVENT* event)
+{
+	if (!Stream_CheckAndLogRequiredLength("test", s, 1))
+		return FALSE;
+
+	const BYTE eventHeader = Stream_Get_UINT8(s);
+	event->code = eventHeader >> 5;
+	event->flags = eventHeader & 0x1F;
+
+	switch (event->code)
+	{
+		case FASTPATH_INPUT_EVENT_SCANCODE:
+			if (!Stream_CheckAndLogRequiredLength("test", s, 1))
+				return FALSE;
+			event->x = Stream_Get_UINT8(s);
+			return TRUE;
+
+		case FASTPATH_INPUT_EVENT_MOUSE:
+			if (!Stream_CheckAndLogRequiredLength("test", s, 6))
+				return FALSE;
+			Stream_Read_UINT16(s, event->pointerFlags);
+			event->x = Stream_Get_UINT16(s);
+			event->y = Stream_Get_UINT16(s);
+			return TRUE;
+
+		case TS_FP_RELPOINTER_EVENT:
+			if (!Stream_CheckAndLogRequiredLength("test", s, 6))
+				return FALSE;
+			Stream_Read_UINT16(s, event->pointerFlags);
+			event->x = Stream_Get_INT16(s);
+			event->y = Stream_Get_INT16(s);
+			return TRUE;
+
+		default:
+			(void)fprintf(stderr, "unexpected event code %" PRIu8 "\n", event->code);
+			return FALSE;
+	}
+}
+
+/** splits what was sent into fast-path input PDUs and decodes their events */
+static BOOL test_take_pdus(TestContext* tc, TEST_PDU* pdus, size_t* count)
+{
+	wStream* wire = tc->wire;
+	*count = 0;
+
+	Stream_SealLength(wire);
+	Stream_ResetPosition(wire);
+	while (Stream_GetRemainingLength(wire) > 0)
+	{
+		if ((*count >= TEST_MAX_PDUS) || !Stream_CheckAndLogRequiredLength("test", wire, 3))
+			return FALSE;
+
+		TEST_PDU* pdu = &pdus[(*count)++];
+		const BYTE fpInputHeader = Stream_Get_UINT8(wire);
+		size_t length = Stream_Get_UINT8(wire);
+		size_t header = 2;
+		if (length & 0x80)
+		{
+			length = ((length & 0x7F) << 8) | Stream_Get_UINT8(wire);
+			header++;
+		}
+
+		pdu->count = (fpInputHeader >> 2) & 0x0F;
+		if ((length < header) || (pdu->count == 0) ||
+		    !Stream_CheckAndLogRequiredLength("test", wire, length - header))
+			return FALSE;
+
+		wStream sbuffer = WINPR_C_ARRAY_INIT;
+		wStream* s = Stream_StaticConstInit(&sbuffer, Stream_Pointer(wire), length - header);
+		for (size_t x = 0; x < pdu->count; x++)
+		{
+			if (!test_read_event(s, &pdu->events[x]))
+				return FALSE;
+		}
+		if (Stream_GetRemainingLength(s) != 0)
+			return FALSE;
+		Stream_Seek(wire, length - header);
+	}
+
+	Stream_ResetPosition(wire);
+	Stream_SetLength(wire, 0);
+	return TRUE;
+}
+
+static BOOL test_flush(TestContext* tc, TEST_PDU* pdus, size_t* count)
+{
+	return input_flush(tc->context.input, TRUE) && test_take_pdus(tc, pdus, count);
+}
+
+static BOOL test_expect_event(const TEST_EVENT* event, BYTE code, UINT16 pointerFlags, INT32 x,
+                              INT32 y)
+{
+	if ((event->code != code) || (event->pointerFlags != pointerFlags) || (event->x != x) ||
+	    (event->y != y))
+	{
+		(void)fprintf(stderr,
+		              "event %" PRIu8 " flags 0x%04" PRIx16 " (%" PRId32 ", %" PRId32
+		              "), expected %" PRIu8 " flags 0x%04" PRIx16 " (%" PRId32 ", %" PRId32 ")\n",
+		              event->code, event->pointerFlags, event->x, event->y, code, pointerFlags, x,
+		              y);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/* consecutive moves are merged, a button or key in between keeps its place */
+static BOOL test_merge_moves(TestContext* tc)
+{
+	rdpInput* input = tc->context.input;
+	TEST_PDU pdus[TEST_MAX_PDUS] = WINPR_C_ARRAY_INIT;
+	size_t count = 0;
+
+	for (UINT16 x = 0; x < 5; x++)
+	{
+		if (!freerdp_input_send_mouse_event(input, PTR_FLAGS_MOVE, x, 100 + x))
+			return FALSE;
+	}
+	if (!freerdp_input_send_mouse_event(input, PTR_FLAGS_DOWN | PTR_FLAGS_BUTTON1, 4, 104) ||
+	    !freerdp_input_send_mouse_event(input, PTR_FLAGS_MOVE, 10, 110) ||
+	    !freerdp_input_send_mouse_event(input, PTR_FLAGS_MOVE, 11, 111) ||
+	    !freerdp_input_send_keyboard_event(input, 0, 0x1E) ||
+	    !freerdp_input_send_mouse_event(input, PTR_FLAGS_MOVE, 12, 112))
+		return FALSE;
+
+	if (!test_flush(tc, pdus, &count) || (count != 1) || (pdus[0].count != 5))
+	{
+		(void)fprintf(stderr, "merge: %" PRIuz " PDUs\n", count);
+		return FALSE;
+	}
+
+	const TEST_EVENT* events = pdus[0].events;
+	return test_expect_event(&events[0], FASTPATH_INPUT_EVENT_MOUSE, PTR_FLAGS_MOVE, 4, 104) &&
+	       test_expect_event(&events[1], FASTPATH_INPUT_EVENT_MOUSE,
+	                         PTR_FLAGS_DOWN | PTR_FLAGS_BUTTON1, 4, 104) &&
+	       test_expect_event(&events[2], FASTPATH_INPUT_EVENT_MOUSE, PTR_FLAGS_MOVE, 11, 111) &&
+	       test_expect_event(&events[3], FASTPATH_INPUT_EVENT_SCANCODE, 0, 0x1E, 0) &&
+	       test_expect_event(&events[4], FASTPATH_INPUT_EVENT_MOUSE, PTR_FLAGS_MOVE, 12, 112);
+}
+
+/* relative deltas add up as long as they fit an INT16 */
+static BOOL test_relative_overflow(TestContext* tc)
+{
+	rdpInput* input = tc->context.input;
+	TEST_PDU pdus[TEST_MAX_PDUS] = WINPR_C_ARRAY_INIT;
+	size_t count = 0;
+
+	if (!freerdp_input_send_rel_mouse_event(input, PTR_FLAGS_MOVE, 20000, -3) ||
+	    !freerdp_input_send_rel_mouse_event(input, PTR_FLAGS_MOVE, 10000, -4) ||
+	    !freerdp_input_send_rel_mouse_event(input, PTR_FLAGS_MOVE, 10000, -5) ||
+	    !freerdp_input_send_rel_mouse_event(input, PTR_FLAGS_MOVE, 10, INT16_MIN) ||
+	    !freerdp_input_send_rel_mouse_event(input, PTR_FLAGS_MOVE, -10, 1))
+		return FALSE;
+
+	if (!test_flush(tc, pdus, &count) || (count != 1) || (pdus[0].count != 3))
+	{
+		(void)fprintf(stderr, "relative: %" PRIuz " PDUs\n", count);
+		return FALSE;
+	}
+
+	const TEST_EVENT* events = pdus[0].events;
+	return test_expect_event(&events[0], TS_FP_RELPOINTER_EVENT, PTR_FLAGS_MOVE, 30000, -7) &&
+	       test_expect_event(&events[1], TS_FP_RELPOINTER_EVENT, PTR_FLAGS_MOVE, 10000, -5) &&
+	       test_expect_event(&events[2], TS_FP_RELPOINTER_EVENT, PTR_FLAGS_MOVE, 0,
+	                         INT16_MIN + 1);
+}
+
+/* a PDU carries at most 15 events, the 16th sends the batch */
+static BOOL test_event_limit(TestContext* tc)
+{
+	rdpInput* input = tc->context.input;
+	TEST_PDU pdus[TEST_MAX_PDUS] = WINPR_C_ARRAY_INIT;
+	size_t count = 0;
+
+	for (BYTE x = 0; x < 20; x++)
+	{
+		if (!freerdp_input_send_keyboard_event(input, 0, x + 1))
+			return FALSE;
+	}
+
+	if (!test_flush(tc, pdus, &count) || (count != 2) || (pdus[0].count != 15) ||
+	    (pdus[1].count != 5))
+	{
+		(void)fprintf(stderr, "limit: %" PRIuz " PDUs\n", count);
+		return FALSE;
+	}
+
+	for (size_t x = 0; x < 20; x++)
+	{
+		const TEST_EVENT* event = &pdus[x / 15].events[x % 15];
+		if (!test_expect_event(event, FASTPATH_INPUT_EVENT_SCANCODE, 0, (INT32)x + 1, 0))
+			return FALSE;
+	}
+	return TRUE;
+}
+
+/* the batch is sent once its event handle fires, even if that happens before the deadline */
+static BOOL test_timer(TestContext* tc)
+{
+	rdpInput* input = tc->context.input;
+	rdp_input_internal* in = input_cast(input);
+	HANDLE handle = input_get_event_handle(input);
+	TEST_PDU pdus[TEST_MAX_PDUS] = WINPR_C_ARRAY_INIT;
+	size_t count = 0;
+
+	if (!freerdp_input_send_keyboard_event(input, 0, 0x1E) || !input_flush(input, FALSE) ||
+	    !test_take_pdus(tc, pdus, &count) || (count != 0))
+		return FALSE;
+
+	/* fired, but the deadline is not reached on the clock input_flush uses */
+	if (WaitForSingleObject(handle, 1000) != WAIT_OBJECT_0)
+		return FALSE;
+	in->batchDeadline = GetTickCount64() + INPUT_BATCH_INTERVAL;
+
+	for (size_t x = 0; (x < 10) && (count == 0); x++)
+	{
+		if (!input_flush(input, FALSE) || !test_take_pdus(tc, pdus, &count))
+			return FALSE;
+		if ((count == 0) && (WaitForSingleObject(handle, 1000) != WAIT_OBJECT_0))
+		{
+			(void)fprintf(stderr, "timer: not armed again\n");
+			return FALSE;
+		}
+	}
+
+	return (count == 1) && (pdus[0].count == 1) &&
+	       test_expect_event(&pdus[0].events[0], FASTPATH_INPUT_EVENT_SCANCODE, 0, 0x1E, 0);
+}
+
+int TestInputBatch(WINPR_ATTR_UNUSED int argc, WINPR_ATTR_UNUSED char* argv[])
+{
+	int rc = -1;
+	TestContext* tc = test_new();
+
+	if (!tc)
+		goto fail;
+
+	if (!test_merge_moves(tc) || !test_relative_overflow(tc) || !test_event_limit(tc) ||
+	    !test_timer(tc))
+		goto fail;
+
+	rc = 0;
+fail:
+	if (rc != 0)
+		(void)fprintf(stderr, "TestInputBatch failed\n");
+	test_free(tc);
+	return rc;
+}
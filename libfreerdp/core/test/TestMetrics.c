@@ -0,0 +1,158 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Connection metrics unit test
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <freerdp/freerdp.h>
+#include <freerdp/metrics.h>
+#include <freerdp/channels/rdpgfx.h>
+
+static BOOL test_counters(rdpMetrics* metrics)
+{
+	for (UINT32 x = 0; x < 10; x++)
+	{
+		if (!freerdp_metrics_add(metrics, FREERDP_METRIC_TRANSPORT_READ_BYTES, 0, 100))
+			return FALSE;
+	}
+
+	if (freerdp_metrics_get_counter(metrics, FREERDP_METRIC_TRANSPORT_READ_BYTES, 0) != 1000)
+		return FALSE;
+
+	/* counters and histograms must not be mixed up, labels are bounded */
+	if (freerdp_metrics_add(metrics, FREERDP_METRIC_PDU_DISPATCH_TIME, 0, 1))
+		return FALSE;
+	if (freerdp_metrics_add(metrics, FREERDP_METRIC_CODEC_DECODE_BYTES,
+	                        FREERDP_METRICS_MAX_LABELS, 1))
+		return FALSE;
+	if (freerdp_metrics_add(nullptr, FREERDP_METRIC_TRANSPORT_READ_BYTES, 0, 1))
+		return FALSE;
+	return TRUE;
+}
+
+static BOOL test_histogram(rdpMetrics* metrics)
+{
+	FREERDP_METRICS_HISTOGRAM histogram = WINPR_C_ARRAY_INIT;
+	UINT64 sum = 0;
+
+	for (UINT64 x = 1; x <= 10000; x++)
+	{
+		if (!freerdp_metrics_record(metrics, FREERDP_METRIC_CODEC_DECODE_TIME,
+		                            RDPGFX_CODECID_PLANAR, x * 1000))
+			return FALSE;
+		sum += x * 1000;
+	}
+
+	if (freerdp_metrics_record(metrics, FREERDP_METRIC_CODEC_DECODE_BYTES, 0, 1))
+		return FALSE;
+
+	if (!freerdp_metrics_get_histogram(metrics, FREERDP_METRIC_CODEC_DECODE_TIME,
+	                                   RDPGFX_CODECID_PLANAR, &histogram))
+		return FALSE;
+
+	if ((histogram.count != 10000) || (histogram.sum != sum) || (histogram.max != 10000000))
+	{
+		(void)fprintf(stderr, "unexpected histogram count/sum/max\n");
+		return FALSE;
+	}
+
+	/* buckets have a relative error of at most 1/8 */
+	const UINT64 expected[] = { 5000000, 9000000, 9900000 };
+	const UINT64 actual[] = { histogram.p50, histogram.p90, histogram.p99 };
+	for (size_t x = 0; x < ARRAYSIZE(expected); x++)
+	{
+		if ((actual[x] < expected[x]) || (actual[x] > expected[x] + expected[x] / 8))
+		{
+			(void)fprintf(stderr, "percentile %" PRIuz ": %" PRIu64 " not close to %" PRIu64 "\n",
+			              x, actual[x], expected[x]);
+			return FALSE;
+		}
+	}
+
+	/* unused labels report an empty histogram */
+	if (!freerdp_metrics_get_histogram(metrics, FREERDP_METRIC_CODEC_DECODE_TIME,
+	                                   RDPGFX_CODECID_CLEARCODEC, &histogram))
+		return FALSE;
+	return histogram.count == 0;
+}
+
+static BOOL test_export(const rdpMetrics* metrics)
+{
+	BOOL rc = FALSE;
+	size_t length = 0;
+	const rdpMetrics* list[] = { metrics, metrics };
+	const char* labels[] = { "client=\"0\"", nullptr };
+
+	char* text = freerdp_metrics_to_openmetrics(list, labels, ARRAYSIZE(list), &length);
+	if (!text)
+		return FALSE;
+
+	if (strlen(text) != length)
+		goto fail;
+
+	const char* lines[] = {
+		"# TYPE freerdp_codec_decode_seconds histogram\n",
+		"freerdp_codec_decode_seconds_count{client=\"0\",codec=\"RDPGFX_CODECID_PLANAR\"} 10000\n",
+		"freerdp_codec_decode_seconds_count{codec=\"RDPGFX_CODECID_PLANAR\"} 10000\n",
+		"freerdp_codec_decode_seconds_bucket{client=\"0\",codec=\"RDPGFX_CODECID_PLANAR\","
+		"le=\"+Inf\"} 10000\n",
+		"freerdp_transport_read_bytes_total{client=\"0\"} 1000\n",
+		"freerdp_transport_read_bytes_total{} 1000\n",
+	};
+
+	for (size_t x = 0; x < ARRAYSIZE(lines); x++)
+	{
+		if (!strstr(text, lines[x]))
+		{
+			(void)fprintf(stderr, "missing '%s' in export:\n%s\n", lines[x], text);
+			goto fail;
+		}
+	}
+
+	if (strcmp(&text[length - 6], "# EOF\n") != 0)
+		goto fail;
+
+	rc = TRUE;
+fail:
+	free(text);
+	return rc;
+}
+
+int TestMetrics(int argc, char* argv[])
+{
+	int rc = -1;
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	rdpMetrics* metrics = metrics_new(nullptr);
+	if (!metrics)
+		return -1;
+
+	if (!test_counters(metrics))
+		goto fail;
+
+	if (!test_histogram(metrics))
+		goto fail;
+
+	if (!test_export(metrics))
+		goto fail;
+
+	rc = 0;
+fail:
+	metrics_free(metrics);
+	return rc;
+}
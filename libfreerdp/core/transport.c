@@ -900,6 +900,8 @@ static SSIZE_T transport_read_layer(rdpTransport* transport, BYTE* data, size_t
 #endif
 		read += status;
 		rdp->inBytes += WINPR_ASSERTING_INT_CAST(uint64_t, status);
+		freerdp_metrics_add(context->metrics, FREERDP_METRIC_TRANSPORT_READ_BYTES, 0,
+		                    WINPR_ASSERTING_INT_CAST(uint64_t, status));
 	}
 
 	return read;
@@ -1227,6 +1229,7 @@ static int transport_default_write(rdpTransport* transport, wStream* s)
 	{
 		size_t length = Stream_GetPosition(s);
 		size_t writtenlength = length;
+		UINT64 blocked = 0;
 		Stream_ResetPosition(s);
 
 		if (length > 0)
@@ -1260,12 +1263,14 @@ static int transport_default_write(rdpTransport* transport, wStream* s)
 					goto out_cleanup;
 				}
 
+				const UINT64 start = winpr_GetTickCount64NS();
 				if (BIO_wait_write(transport->frontBio, 100) < 0)
 				{
 					WLog_ERR_BIO(transport, "BIO_wait_write", transport->frontBio);
 					status = -1;
 					goto out_cleanup;
 				}
+				blocked += winpr_GetTickCount64NS() - start;
 
 				continue;
 			}
@@ -1275,12 +1280,14 @@ static int transport_default_write(rdpTransport* transport, wStream* s)
 			{
 				while (BIO_write_blocked(transport->frontBio))
 				{
+					const UINT64 start = winpr_GetTickCount64NS();
 					if (BIO_wait_write(transport->frontBio, 100) < 0)
 					{
 						WLog_Print(transport->log, WLOG_ERROR, "error when selecting for write");
 						status = -1;
 						goto out_cleanup;
 					}
+					blocked += winpr_GetTickCount64NS() - start;
 
 					if (BIO_flush(transport->frontBio) < 1)
 					{
@@ -1303,6 +1310,11 @@ static int transport_default_write(rdpTransport* transport, wStream* s)
 		}
 
 		transport->written += writtenlength;
+		freerdp_metrics_add(context->metrics, FREERDP_METRIC_TRANSPORT_WRITE_BYTES, 0,
+		                    writtenlength);
+		if (blocked > 0)
+			freerdp_metrics_record(context->metrics, FREERDP_METRIC_TRANSPORT_WRITE_BLOCKED_TIME,
+			                       0, blocked);
 	}
 out_cleanup:
 
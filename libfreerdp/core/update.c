@@ -3573,6 +3573,32 @@ void rdp_update_unlock(rdpUpdate* update)
 	LeaveCriticalSection(&up->mux);
 }
 
+BOOL freerdp_update_send_fastpath_raw(rdpContext* context, const FASTPATH_RAW_UPDATE* update)
+{
+	WINPR_ASSERT(context);
+	WINPR_ASSERT(context->rdp);
+	WINPR_ASSERT(context->update);
+
+	rdp_update_lock(context->update);
+	const BOOL rc = fastpath_send_raw_update_pdu(context->rdp->fastpath, update);
+	rdp_update_unlock(context->update);
+	return rc;
+}
+
+BOOL freerdp_update_set_compression_passthrough(rdpContext* context, BOOL enable)
+{
+	WINPR_ASSERT(context);
+	WINPR_ASSERT(context->rdp);
+
+	if (!context->rdp->bulk)
+		return FALSE;
+
+	rdp_update_lock(context->update);
+	bulk_set_send_passthrough(context->rdp->bulk, enable);
+	rdp_update_unlock(context->update);
+	return TRUE;
+}
+
 BOOL update_begin_paint(rdpUpdate* update)
 {
 	rdp_update_internal* up = update_cast(update);
@@ -3618,6 +3644,10 @@ BOOL update_end_paint(rdpUpdate* update)
 	if (!rc)
 		WLog_WARN(TAG, "EndPaint call failed");
 
+	/* Batched input is sent at the end of a frame at the latest */
+	if (update->context && update->context->input && !input_flush(update->context->input, TRUE))
+		WLog_WARN(TAG, "failed to send batched input events");
+
 	if (!up->withinBeginEndPaint)
 		return rc;
 	up->withinBeginEndPaint = FALSE;
@@ -0,0 +1,331 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * TLS session cache unit test
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+
+#include <openssl/bio.h>
+#include <openssl/ec.h>
+#include <openssl/evp.h>
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+
+#include "../tls_session.h"
+
+/* Matches the cache size in tls_session.c */
+#define TEST_CACHE_SIZE 64
+
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L && !defined(LIBRESSL_VERSION_NUMBER)
+typedef struct
+{
+	EVP_PKEY* key;
+	X509* cert;
+	SSL_CTX* ctx;
+} TEST_SERVER;
+
+static SSL_SESSION* received = nullptr;
+
+static int test_new_session(WINPR_ATTR_UNUSED SSL* ssl, SSL_SESSION* session)
+{
+	SSL_SESSION_free(received);
+	received = session;
+	return 1;
+}
+
+static EVP_PKEY* test_key_new(void)
+{
+	EVP_PKEY* key = nullptr;
+	EVP_PKEY* params = nullptr;
+
+	EVP_PKEY_CTX* pctx = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, nullptr);
+	if (!pctx || (EVP_PKEY_paramgen_init(pctx) <= 0) ||
+	    (EVP_PKEY_CTX_set_ec_paramgen_curve_nid(pctx, NID_X9_62_prime256v1) <= 0) ||
+	    (EVP_PKEY_paramgen(pctx, &params) <= 0))
+		goto fail;
+
+	EVP_PKEY_CTX_free(pctx);
+	pctx = EVP_PKEY_CTX_new(params, nullptr);
+	if (!pctx || (EVP_PKEY_keygen_init(pctx) <= 0) || (EVP_PKEY_keygen(pctx, &key) <= 0))
+		goto fail;
+
+fail:
+	EVP_PKEY_free(params);
+	EVP_PKEY_CTX_free(pctx);
+	return key;
+}
+
+static X509* test_cert_new(EVP_PKEY* key, const char* cn, long serial)
+{
+	X509* cert = X509_new();
+	if (!cert)
+		return nullptr;
+
+	X509_NAME* name = X509_get_subject_name(cert);
+	if (!X509_set_version(cert, 2) || !ASN1_INTEGER_set(X509_get_serialNumber(cert), serial) ||
+	    !X509_gmtime_adj(X509_getm_notBefore(cert), 0) ||
+	    !X509_gmtime_adj(X509_getm_notAfter(cert), 3600) || !X509_set_pubkey(cert, key) ||
+	    !X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, (const unsigned char*)cn, -1, -1,
+	                                0) ||
+	    !X509_set_issuer_name(cert, name) || !X509_sign(cert, key, EVP_sha256()))
+	{
+		X509_free(cert);
+		return nullptr;
+	}
+
+	return cert;
+}
+
+static void test_server_free(TEST_SERVER* server)
+{
+	SSL_CTX_free(server->ctx);
+	X509_free(server->cert);
+	EVP_PKEY_free(server->key);
+}
+
+static BOOL test_server_init(TEST_SERVER* server, const char* cn, long serial)
+{
+	static const unsigned char sid_ctx[] = "TestTlsSession";
+
+	server->key = test_key_new();
+	server->cert = server->key ? test_cert_new(server->key, cn, serial) : nullptr;
+	server->ctx = SSL_CTX_new(TLS_server_method());
+	if (!server->cert || !server->ctx)
+		return FALSE;
+
+	return (SSL_CTX_use_certificate(server->ctx, server->cert) == 1) &&
+	       (SSL_CTX_use_PrivateKey(server->ctx, server->key) == 1) &&
+	       (SSL_CTX_set_session_id_context(server->ctx, sid_ctx, sizeof(sid_ctx) - 1) == 1);
+}
+
+/* Connects a client to server over a memory BIO pair, offering session if not nullptr. A new
+ * session received by the client is left in received. */
+static BOOL test_handshake(TEST_SERVER* server, SSL_SESSION* session, BOOL* resumed)
+{
+	BOOL rc = FALSE;
+	BIO* cbio = nullptr;
+	BIO* sbio = nullptr;
+	SSL* client = nullptr;
+	SSL* srv = nullptr;
+
+	SSL_SESSION_free(received);
+	received = nullptr;
+
+	SSL_CTX* ctx = SSL_CTX_new(TLS_client_method());
+	if (!ctx)
+		return FALSE;
+
+	/* TLS 1.2 sessions are complete when the handshake is */
+	if (!SSL_CTX_set_max_proto_version(ctx, TLS1_2_VERSION) ||
+	    !tls_session_cache_prepare(ctx, test_new_session))
+		goto fail;
+
+	client = SSL_new(ctx);
+	srv = SSL_new(server->ctx);
+	if (!client || !srv || !BIO_new_bio_pair(&cbio, 0, &sbio, 0))
+		goto fail;
+
+	SSL_set_bio(client, cbio, cbio);
+	SSL_set_bio(srv, sbio, sbio);
+	SSL_set_connect_state(client);
+	SSL_set_accept_state(srv);
+
+	if (session && (SSL_set_session(client, session) != 1))
+		goto fail;
+
+	for (size_t x = 0; x < 32; x++)
+	{
+		const int crc = SSL_do_handshake(client);
+		const int src = SSL_do_handshake(srv);
+
+		if ((crc == 1) && (src == 1))
+		{
+			*resumed = SSL_session_reused(client) == 1;
+
+			/* sessions of connections not shut down cleanly are no longer resumable */
+			rc = (SSL_shutdown(client) >= 0) && (SSL_shutdown(srv) >= 0);
+			break;
+		}
+
+		const int cerr = SSL_get_error(client, crc);
+		const int serr = SSL_get_error(srv, src);
+		if (((crc != 1) && (cerr != SSL_ERROR_WANT_READ) && (cerr != SSL_ERROR_WANT_WRITE)) ||
+		    ((src != 1) && (serr != SSL_ERROR_WANT_READ) && (serr != SSL_ERROR_WANT_WRITE)))
+			break;
+	}
+
+fail:
+	SSL_free(client);
+	SSL_free(srv);
+	SSL_CTX_free(ctx);
+	return rc;
+}
+
+static BOOL test_peer_is(SSL_SESSION* session, const TEST_SERVER* server)
+{
+	if (!session)
+		return FALSE;
+
+	X509* peer = SSL_SESSION_get0_peer(session);
+	return peer && (X509_cmp(peer, server->cert) == 0);
+}
+
+static BOOL test_cached(const char* hostname, UINT16 port, const TEST_SERVER* server)
+{
+	SSL_SESSION* session = tls_session_cache_lookup(hostname, port);
+	const BOOL rc = server ? test_peer_is(session, server) : (session == nullptr);
+	SSL_SESSION_free(session);
+	return rc;
+}
+
+static BOOL test_lookup(TEST_SERVER* a, TEST_SERVER* b)
+{
+	BOOL resumed = TRUE;
+
+	if (!test_cached("server.example", 3389, nullptr))
+		return FALSE;
+
+	if (!test_handshake(a, nullptr, &resumed) || resumed || !received)
+		return FALSE;
+	if (!tls_session_cache_store("server.example", 3389, received))
+		return FALSE;
+
+	/* Host names compare case insensitive, ports must match */
+	if (!test_cached("server.example", 3389, a) || !test_cached("SERVER.example", 3389, a) ||
+	    !test_cached("server.example", 3390, nullptr) ||
+	    !test_cached("other.example", 3389, nullptr))
+		return FALSE;
+
+	/* The cached session is resumed */
+	SSL_SESSION* session = tls_session_cache_lookup("server.example", 3389);
+	const BOOL ok = test_handshake(a, session, &resumed);
+	SSL_SESSION_free(session);
+	if (!ok || !resumed)
+		return FALSE;
+
+	/* A different server certificate replaces the session */
+	if (!test_handshake(b, nullptr, &resumed) || resumed || !received)
+		return FALSE;
+	if (!tls_session_cache_store("server.example", 3389, received) ||
+	    !test_cached("server.example", 3389, b))
+		return FALSE;
+
+	/* and server a does not resume the session issued by b */
+	session = tls_session_cache_lookup("server.example", 3389);
+	const BOOL rejected = test_handshake(a, session, &resumed);
+	SSL_SESSION_free(session);
+	if (!rejected || resumed)
+		return FALSE;
+
+	tls_session_cache_remove("server.example", 3389);
+	return test_cached("server.example", 3389, nullptr);
+}
+
+static BOOL test_reject(void)
+{
+	/* Sessions without a verified peer certificate are never cached */
+	SSL_SESSION* session = SSL_SESSION_new();
+	if (!session)
+		return FALSE;
+
+	const BOOL stored = tls_session_cache_store("server.example", 3389, session);
+	SSL_SESSION_free(session);
+	return !stored && test_cached("server.example", 3389, nullptr);
+}
+
+static BOOL test_eviction(TEST_SERVER* a)
+{
+	char name[32] = WINPR_C_ARRAY_INIT;
+	BOOL resumed = FALSE;
+
+	if (!test_handshake(a, nullptr, &resumed) || !received)
+		return FALSE;
+
+	for (size_t x = 0; x < TEST_CACHE_SIZE; x++)
+	{
+		(void)_snprintf(name, sizeof(name), "host%" PRIuz, x);
+		if (!tls_session_cache_store(name, 3389, received))
+			return FALSE;
+		Sleep(2);
+	}
+
+	for (size_t x = 0; x < TEST_CACHE_SIZE; x++)
+	{
+		(void)_snprintf(name, sizeof(name), "host%" PRIuz, x);
+		if (!test_cached(name, 3389, a))
+			return FALSE;
+		Sleep(2);
+	}
+
+	/* host0 is the least recently used entry after all lookups, use it again */
+	if (!test_cached("host0", 3389, a))
+		return FALSE;
+	Sleep(2);
+
+	/* so a new server evicts host1 */
+	if (!tls_session_cache_store("host64", 3389, received))
+		return FALSE;
+
+	return test_cached("host0", 3389, a) && test_cached("host1", 3389, nullptr) &&
+	       test_cached("host2", 3389, a) && test_cached("host64", 3389, a);
+}
+#endif
+
+int TestTlsSession(int argc, char* argv[])
+{
+	int rc = -1;
+
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L && !defined(LIBRESSL_VERSION_NUMBER)
+	TEST_SERVER a = WINPR_C_ARRAY_INIT;
+	TEST_SERVER b = WINPR_C_ARRAY_INIT;
+
+	if (!test_server_init(&a, "server.example", 1) || !test_server_init(&b, "server.example", 2))
+		goto fail;
+
+	if (!test_lookup(&a, &b))
+	{
+		(void)fprintf(stderr, "session lookup by host and certificate failed\n");
+		goto fail;
+	}
+
+	if (!test_reject())
+	{
+		(void)fprintf(stderr, "session without peer certificate was cached\n");
+		goto fail;
+	}
+
+	if (!test_eviction(&a))
+	{
+		(void)fprintf(stderr, "least recently used session was not evicted\n");
+		goto fail;
+	}
+
+	rc = 0;
+fail:
+	SSL_SESSION_free(received);
+	received = nullptr;
+	test_server_free(&a);
+	test_server_free(&b);
+#else
+	rc = 0;
+#endif
+	return rc;
+}
@@ -33,6 +33,7 @@
 #include <winpr/sspi.h>
 #include <winpr/ssl.h>
 #include <winpr/json.h>
+#include <winpr/sysinfo.h>
 
 #include <winpr/stream.h>
 #include <freerdp/utils/ringbuffer.h>
@@ -48,6 +49,7 @@
 #include "opensslcompat.h"
 #include "certificate.h"
 #include "privatekey.h"
+#include "tls_session.h"
 
 #ifdef WINPR_HAVE_POLL_H
 #include <poll.h>
@@ -839,10 +841,118 @@ static void SSLCTX_keylog_cb(const SSL* ssl, const char* line)
 	}
 }
 
+static INIT_ONCE tls_idx_once = INIT_ONCE_STATIC_INIT;
+static int tls_idx = -1;
+
+static BOOL CALLBACK tls_idx_init_cb(WINPR_ATTR_UNUSED PINIT_ONCE once,
+                                     WINPR_ATTR_UNUSED PVOID param,
+                                     WINPR_ATTR_UNUSED PVOID* context)
+{
+	tls_idx = SSL_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+
+	return (tls_idx != -1);
+}
+
+static UINT16 tls_get_port(const rdpTls* tls)
+{
+	WINPR_ASSERT(tls);
+	WINPR_ASSERT((tls->port >= 0) && (tls->port <= UINT16_MAX));
+	return (UINT16)tls->port;
+}
+
+static int tls_new_session_cb(SSL* ssl, SSL_SESSION* session)
+{
+	rdpTls* tls = SSL_get_ex_data(ssl, tls_idx);
+
+	if (!tls)
+		return 0;
+
+	/* TLS 1.3 tickets arrive after the handshake, the certificate is verified by then */
+	if (tls->sessionVerified)
+	{
+		(void)tls_session_cache_store(tls_get_server_name(tls), tls_get_port(tls), session);
+		return 0;
+	}
+
+	/* Keep the reference until the certificate was verified */
+	if (tls->pendingSession)
+		SSL_SESSION_free(tls->pendingSession);
+	tls->pendingSession = session;
+	return 1;
+}
+
+/* Offers a cached session of the server we connect to */
+static void tls_prepare_session(rdpTls* tls)
+{
+	WINPR_ASSERT(tls);
+
+	if (!InitOnceExecuteOnce(&tls_idx_once, tls_idx_init_cb, nullptr, nullptr))
+		return;
+
+	if (!tls_session_cache_prepare(tls->ctx, tls_new_session_cb))
+		return;
+
+	SSL_set_ex_data(tls->ssl, tls_idx, tls);
+
+	SSL_SESSION* session = tls_session_cache_lookup(tls_get_server_name(tls), tls_get_port(tls));
+	if (!session)
+		return;
+
+	tls->sessionOffered = (SSL_set_session(tls->ssl, session) == 1);
+	SSL_SESSION_free(session);
+}
+
+/* Publishes the session once the certificate of the server is trusted */
+static void tls_session_verified(rdpTls* tls, BOOL trusted)
+{
+	WINPR_ASSERT(tls);
+
+	const char* name = tls_get_server_name(tls);
+	const UINT16 port = tls_get_port(tls);
+
+	if (trusted)
+	{
+		tls->sessionVerified = TRUE;
+		if (tls->pendingSession)
+			(void)tls_session_cache_store(name, port, tls->pendingSession);
+	}
+	else
+		tls_session_cache_remove(name, port);
+
+	if (tls->pendingSession)
+		SSL_SESSION_free(tls->pendingSession);
+	tls->pendingSession = nullptr;
+}
+
+static void tls_record_handshake(rdpTls* tls)
+{
+	WINPR_ASSERT(tls);
+
+	TlsSessionMode mode = TLS_SESSION_FULL;
+	if (SSL_session_reused(tls->ssl))
+		mode = TLS_SESSION_RESUMED;
+	else if (tls->sessionOffered)
+		mode = TLS_SESSION_REJECTED;
+
+	WLog_DBG(TAG, "TLS handshake completed, session %s", tls_session_mode_string(mode));
+
+	rdpMetrics* metrics = tls->context ? tls->context->metrics : nullptr;
+	(void)freerdp_metrics_record_since(metrics, FREERDP_METRIC_TLS_HANDSHAKE_TIME, mode,
+	                                   tls->handshakeStart);
+}
+
 static void tls_reset(rdpTls* tls)
 {
 	WINPR_ASSERT(tls);
 
+	if (tls->pendingSession)
+	{
+		SSL_SESSION_free(tls->pendingSession);
+		tls->pendingSession = nullptr;
+	}
+	tls->sessionVerified = FALSE;
+	tls->sessionOffered = FALSE;
+
 	if (tls->ctx)
 	{
 		SSL_CTX_free(tls->ctx);
@@ -1018,9 +1128,12 @@ TlsHandshakeResult freerdp_tls_connect_ex(rdpTls* tls, BIO* underlying, const SS
 	tls->isClientMode = TRUE;
 	adjustSslOptions(&options);
 
+	tls->handshakeStart = winpr_GetTickCount64NS();
 	if (!tls_prepare(tls, underlying, methods, options, TRUE))
 		return TLS_HANDSHAKE_ERROR;
 
+	tls_prepare_session(tls);
+
 #if !defined(OPENSSL_NO_TLSEXT)
 	const char* str = tls_get_server_name(tls);
 	void* ptr = WINPR_CAST_CONST_PTR_AWAY(str, void*);
@@ -1092,6 +1205,7 @@ TlsHandshakeResult freerdp_tls_handshake(rdpTls* tls)
 			verify_status =
 			    tls_verify_certificate(tls, cert, tls_get_server_name(tls), (UINT16)tls->port);
 
+			tls_session_verified(tls, verify_status >= 1);
 			if (verify_status < 1)
 			{
 				WLog_ERR(TAG, "certificate not trusted, aborting.");
@@ -1099,6 +1213,9 @@ TlsHandshakeResult freerdp_tls_handshake(rdpTls* tls)
 				ret = TLS_HANDSHAKE_VERIFY_ERROR;
 			}
 		}
+
+		if (ret == TLS_HANDSHAKE_SUCCESS)
+			tls_record_handshake(tls);
 	} while (0);
 
 	freerdp_certificate_free(cert);
@@ -1264,9 +1381,14 @@ TlsHandshakeResult freerdp_tls_accept_ex(rdpTls* tls, BIO* underlying, rdpSettin
 	options |= SSL_OP_NO_RENEGOTIATION;
 #endif
 
+	tls->handshakeStart = winpr_GetTickCount64NS();
 	if (!tls_prepare(tls, underlying, methods, options, FALSE))
 		return TLS_HANDSHAKE_ERROR;
 
+	/* Share ticket keys between connections so reconnecting clients can resume */
+	if (!tls_session_ticket_keys_install(tls->ctx))
+		WLog_WARN(TAG, "failed to install TLS session ticket keys, resumption disabled");
+
 	const rdpPrivateKey* key = freerdp_settings_get_pointer(settings, FreeRDP_RdpServerRsaKey);
 	if (!key)
 	{
@@ -1310,6 +1432,20 @@ TlsHandshakeResult freerdp_tls_accept_ex(rdpTls* tls, BIO* underlying, rdpSettin
 		return TLS_HANDSHAKE_ERROR;
 	}
 
+	/* Sessions are only resumed with the certificate they were established with */
+	{
+		BYTE sid_ctx[SSL_MAX_SID_CTX_LENGTH] = WINPR_C_ARRAY_INIT;
+		unsigned int sid_ctx_len = sizeof(sid_ctx);
+
+		if (!X509_digest(freerdp_certificate_get_x509(cert), EVP_sha256(), sid_ctx,
+		                 &sid_ctx_len) ||
+		    !SSL_set_session_id_context(tls->ssl, sid_ctx, sid_ctx_len))
+		{
+			WLog_ERR(TAG, "SSL_set_session_id_context failed");
+			return TLS_HANDSHAKE_ERROR;
+		}
+	}
+
 	const size_t cnt = freerdp_certificate_get_chain_len(cert);
 	for (size_t x = 0; x < cnt; x++)
 	{
@@ -82,6 +82,10 @@ struct rdp_tls
 	int alertDescription;
 	BOOL isGatewayTransport;
 	BOOL isClientMode;
+	SSL_SESSION* pendingSession; /* received before the certificate was verified */
+	BOOL sessionVerified;
+	BOOL sessionOffered;
+	UINT64 handshakeStart;
 };
 
 /** @brief result of a handshake operation */
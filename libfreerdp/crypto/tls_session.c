@@ -0,0 +1,417 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * TLS session resumption
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <freerdp/config.h>
+
+#include <string.h>
+
+#include <winpr/assert.h>
+#include <winpr/atexit.h>
+#include <winpr/crypto.h>
+#include <winpr/string.h>
+#include <winpr/synch.h>
+#include <winpr/sysinfo.h>
+
+#include <openssl/evp.h>
+#include <openssl/x509.h>
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L && !defined(LIBRESSL_VERSION_NUMBER)
+#include <openssl/core_names.h>
+#define WITH_TLS_TICKET_KEYS
+#endif
+
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L && !defined(LIBRESSL_VERSION_NUMBER)
+#define WITH_TLS_SESSION_CACHE
+#endif
+
+#include <freerdp/log.h>
+
+#include "tls_session.h"
+
+#define TAG FREERDP_TAG("crypto.tls")
+
+/* Sessions of the most recently used servers, enough for gateway and target of a few
+ * concurrent connections */
+#define TLS_SESSION_CACHE_SIZE 64
+
+/* Ticket keys are rotated once an hour, tickets of the previous key are still accepted (and
+ * replaced by a new one) so a ticket is valid for at least one and at most two hours. */
+#define TLS_TICKET_KEY_LIFETIME_MS (60ull * 60ull * 1000ull)
+
+typedef struct
+{
+	char* hostname;
+	UINT16 port;
+	BYTE fingerprint[32];
+	SSL_SESSION* session;
+	UINT64 lastUsed;
+} TLS_SESSION_CACHE_ENTRY;
+
+typedef struct
+{
+	BYTE name[16];
+	BYTE hmac[32];
+	BYTE aes[32];
+} TLS_TICKET_KEY;
+
+static const char* const tls_session_mode_strings[TLS_SESSION_MODE_COUNT] = { "full", "resumed",
+	                                                                          "rejected" };
+
+const char* tls_session_mode_string(UINT32 mode)
+{
+	if (mode >= TLS_SESSION_MODE_COUNT)
+		return "unknown";
+	return tls_session_mode_strings[mode];
+}
+
+#if defined(WITH_TLS_SESSION_CACHE)
+static INIT_ONCE session_cache_once = INIT_ONCE_STATIC_INIT;
+static CRITICAL_SECTION session_cache_lock;
+static TLS_SESSION_CACHE_ENTRY session_cache[TLS_SESSION_CACHE_SIZE];
+
+static void tls_session_cache_entry_clear(TLS_SESSION_CACHE_ENTRY* entry)
+{
+	WINPR_ASSERT(entry);
+
+	free(entry->hostname);
+	SSL_SESSION_free(entry->session);
+	memset(entry, 0, sizeof(TLS_SESSION_CACHE_ENTRY));
+}
+
+static void tls_session_cache_clear(void)
+{
+	EnterCriticalSection(&session_cache_lock);
+	for (size_t x = 0; x < ARRAYSIZE(session_cache); x++)
+		tls_session_cache_entry_clear(&session_cache[x]);
+	LeaveCriticalSection(&session_cache_lock);
+}
+
+static BOOL CALLBACK tls_session_cache_init_cb(WINPR_ATTR_UNUSED PINIT_ONCE once,
+                                               WINPR_ATTR_UNUSED PVOID param,
+                                               WINPR_ATTR_UNUSED PVOID* context)
+{
+	if (!InitializeCriticalSectionAndSpinCount(&session_cache_lock, 4000))
+		return FALSE;
+
+	(void)winpr_atexit(tls_session_cache_clear);
+	return TRUE;
+}
+
+static BOOL tls_session_cache_init(void)
+{
+	return InitOnceExecuteOnce(&session_cache_once, tls_session_cache_init_cb, nullptr, nullptr);
+}
+
+static BOOL tls_session_fingerprint(const SSL_SESSION* session, BYTE fingerprint[32])
+{
+	unsigned int length = 0;
+
+	if (!session)
+		return FALSE;
+
+	X509* peer = SSL_SESSION_get0_peer(WINPR_CAST_CONST_PTR_AWAY(session, SSL_SESSION*));
+	if (!peer)
+		return FALSE;
+
+	if (!X509_digest(peer, EVP_sha256(), fingerprint, &length))
+		return FALSE;
+
+	return length == 32;
+}
+
+/* Must be called with the lock held */
+static TLS_SESSION_CACHE_ENTRY* tls_session_cache_find(const char* hostname, UINT16 port)
+{
+	for (size_t x = 0; x < ARRAYSIZE(session_cache); x++)
+	{
+		TLS_SESSION_CACHE_ENTRY* entry = &session_cache[x];
+
+		if (entry->hostname && (entry->port == port) &&
+		    (_stricmp(entry->hostname, hostname) == 0))
+			return entry;
+	}
+
+	return nullptr;
+}
+#endif
+
+BOOL tls_session_cache_prepare(SSL_CTX* ctx, int (*cb)(SSL*, SSL_SESSION*))
+{
+	WINPR_ASSERT(ctx);
+	WINPR_ASSERT(cb);
+
+#if defined(WITH_TLS_SESSION_CACHE)
+	if (!tls_session_cache_init())
+		return FALSE;
+
+	/* With TLS 1.3 the tickets arrive after the handshake completed */
+	SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+	SSL_CTX_sess_set_new_cb(ctx, cb);
+#endif
+	return TRUE;
+}
+
+SSL_SESSION* tls_session_cache_lookup(WINPR_ATTR_UNUSED const char* hostname,
+                                      WINPR_ATTR_UNUSED UINT16 port)
+{
+	SSL_SESSION* session = nullptr;
+
+#if defined(WITH_TLS_SESSION_CACHE)
+	if (!hostname || !tls_session_cache_init())
+		return nullptr;
+
+	EnterCriticalSection(&session_cache_lock);
+	TLS_SESSION_CACHE_ENTRY* entry = tls_session_cache_find(hostname, port);
+	if (entry)
+	{
+		if (SSL_SESSION_is_resumable(entry->session))
+		{
+			session = SSL_SESSION_dup(entry->session);
+			entry->lastUsed = winpr_GetTickCount64();
+		}
+		else
+			tls_session_cache_entry_clear(entry);
+	}
+	LeaveCriticalSection(&session_cache_lock);
+#endif
+
+	return session;
+}
+
+BOOL tls_session_cache_store(WINPR_ATTR_UNUSED const char* hostname,
+                             WINPR_ATTR_UNUSED UINT16 port,
+                             WINPR_ATTR_UNUSED SSL_SESSION* session)
+{
+#if defined(WITH_TLS_SESSION_CACHE)
+	BOOL rc = FALSE;
+	BYTE fingerprint[32] = WINPR_C_ARRAY_INIT;
+
+	if (!hostname || !session || !tls_session_cache_init())
+		return FALSE;
+
+	if (!SSL_SESSION_is_resumable(session) || !tls_session_fingerprint(session, fingerprint))
+		return FALSE;
+
+	char* name = _strdup(hostname);
+	if (!name)
+		return FALSE;
+
+	/* OpenSSL marks the session of a connection that was not shut down cleanly as not
+	 * resumable, exactly what happens on a network failure, so keep a copy of our own */
+	SSL_SESSION* copy = SSL_SESSION_dup(session);
+	if (!copy)
+	{
+		free(name);
+		return FALSE;
+	}
+
+	EnterCriticalSection(&session_cache_lock);
+	TLS_SESSION_CACHE_ENTRY* entry = tls_session_cache_find(hostname, port);
+	if (entry && (memcmp(entry->fingerprint, fingerprint, sizeof(fingerprint)) != 0))
+		WLog_DBG(TAG, "certificate of %s:%" PRIu16 " changed, dropping old TLS session",
+		         hostname, port);
+	else if (!entry)
+	{
+		/* Replace the least recently used entry */
+		entry = &session_cache[0];
+		for (size_t x = 1; x < ARRAYSIZE(session_cache); x++)
+		{
+			if (session_cache[x].lastUsed < entry->lastUsed)
+				entry = &session_cache[x];
+		}
+	}
+
+	tls_session_cache_entry_clear(entry);
+	entry->hostname = name;
+	entry->port = port;
+	entry->session = copy;
+	entry->lastUsed = winpr_GetTickCount64();
+	memcpy(entry->fingerprint, fingerprint, sizeof(fingerprint));
+	rc = TRUE;
+	LeaveCriticalSection(&session_cache_lock);
+
+	WLog_DBG(TAG, "cached TLS session for %s:%" PRIu16, hostname, port);
+	return rc;
+#else
+	return FALSE;
+#endif
+}
+
+void tls_session_cache_remove(WINPR_ATTR_UNUSED const char* hostname,
+                              WINPR_ATTR_UNUSED UINT16 port)
+{
+#if defined(WITH_TLS_SESSION_CACHE)
+	if (!hostname || !tls_session_cache_init())
+		return;
+
+	EnterCriticalSection(&session_cache_lock);
+	TLS_SESSION_CACHE_ENTRY* entry = tls_session_cache_find(hostname, port);
+	if (entry)
+		tls_session_cache_entry_clear(entry);
+	LeaveCriticalSection(&session_cache_lock);
+#endif
+}
+
+#if defined(WITH_TLS_TICKET_KEYS)
+static INIT_ONCE ticket_keys_once = INIT_ONCE_STATIC_INIT;
+static CRITICAL_SECTION ticket_keys_lock;
+static TLS_TICKET_KEY ticket_keys[2]; /* current and previous key */
+static BOOL ticket_key_previous_valid = FALSE;
+static UINT64 ticket_key_created = 0;
+
+static BOOL tls_ticket_key_generate(TLS_TICKET_KEY* key)
+{
+	WINPR_ASSERT(key);
+	return winpr_RAND(key, sizeof(TLS_TICKET_KEY)) >= 0;
+}
+
+static BOOL CALLBACK tls_ticket_keys_init_cb(WINPR_ATTR_UNUSED PINIT_ONCE once,
+                                             WINPR_ATTR_UNUSED PVOID param,
+                                             WINPR_ATTR_UNUSED PVOID* context)
+{
+	if (!tls_ticket_key_generate(&ticket_keys[0]))
+		return FALSE;
+
+	if (!InitializeCriticalSectionAndSpinCount(&ticket_keys_lock, 4000))
+		return FALSE;
+
+	ticket_key_created = winpr_GetTickCount64();
+	return TRUE;
+}
+
+/* Copies the key to encrypt a new ticket with, rotating the keys when due */
+static BOOL tls_ticket_key_current(TLS_TICKET_KEY* key)
+{
+	BOOL rc = TRUE;
+	const UINT64 now = winpr_GetTickCount64();
+
+	WINPR_ASSERT(key);
+
+	EnterCriticalSection(&ticket_keys_lock);
+	if (now - ticket_key_created >= TLS_TICKET_KEY_LIFETIME_MS)
+	{
+		TLS_TICKET_KEY next = WINPR_C_ARRAY_INIT;
+
+		rc = tls_ticket_key_generate(&next);
+		if (rc)
+		{
+			ticket_keys[1] = ticket_keys[0];
+			ticket_keys[0] = next;
+			ticket_key_previous_valid = TRUE;
+			ticket_key_created = now;
+			WLog_DBG(TAG, "rotated TLS session ticket key");
+		}
+		memset(&next, 0, sizeof(next));
+	}
+	*key = ticket_keys[0];
+	LeaveCriticalSection(&ticket_keys_lock);
+
+	return rc;
+}
+
+/* Copies the key a ticket was encrypted with. Returns 1 for the current, 2 for the previous
+ * key and 0 if the ticket is unknown or expired. */
+static int tls_ticket_key_find(const BYTE* name, TLS_TICKET_KEY* key)
+{
+	int rc = 0;
+
+	WINPR_ASSERT(name);
+	WINPR_ASSERT(key);
+
+	EnterCriticalSection(&ticket_keys_lock);
+	if (memcmp(ticket_keys[0].name, name, sizeof(ticket_keys[0].name)) == 0)
+	{
+		*key = ticket_keys[0];
+		rc = 1;
+	}
+	else if (ticket_key_previous_valid &&
+	         (memcmp(ticket_keys[1].name, name, sizeof(ticket_keys[1].name)) == 0))
+	{
+		*key = ticket_keys[1];
+		rc = 2;
+	}
+	LeaveCriticalSection(&ticket_keys_lock);
+
+	return rc;
+}
+
+static int tls_ticket_key_cb(WINPR_ATTR_UNUSED SSL* ssl, unsigned char* key_name,
+                             unsigned char* iv, EVP_CIPHER_CTX* ctx, EVP_MAC_CTX* hctx, int enc)
+{
+	int rc = -1;
+	TLS_TICKET_KEY key = WINPR_C_ARRAY_INIT;
+	const EVP_CIPHER* cipher = EVP_aes_256_cbc();
+	const int ivlen = EVP_CIPHER_get_iv_length(cipher);
+
+	if (ivlen <= 0)
+		return -1;
+
+	if (enc)
+	{
+		if (!tls_ticket_key_current(&key))
+			goto out;
+		if (winpr_RAND(iv, (size_t)ivlen) < 0)
+			goto out;
+		memcpy(key_name, key.name, sizeof(key.name));
+		if (!EVP_EncryptInit_ex(ctx, cipher, nullptr, key.aes, iv))
+			goto out;
+		rc = 1;
+	}
+	else
+	{
+		rc = tls_ticket_key_find(key_name, &key);
+		if (rc == 0)
+			goto out;
+		if (!EVP_DecryptInit_ex(ctx, cipher, nullptr, key.aes, iv))
+		{
+			rc = -1;
+			goto out;
+		}
+	}
+
+	{
+		char digest[] = "SHA256";
+		OSSL_PARAM params[] = {
+			OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY, key.hmac, sizeof(key.hmac)),
+			OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, digest, 0),
+			OSSL_PARAM_construct_end()
+		};
+
+		if (!EVP_MAC_CTX_set_params(hctx, params))
+			rc = -1;
+	}
+
+out:
+	memset(&key, 0, sizeof(key));
+	return rc;
+}
+#endif
+
+BOOL tls_session_ticket_keys_install(WINPR_ATTR_UNUSED SSL_CTX* ctx)
+{
+	WINPR_ASSERT(ctx);
+
+#if defined(WITH_TLS_TICKET_KEYS)
+	if (!InitOnceExecuteOnce(&ticket_keys_once, tls_ticket_keys_init_cb, nullptr, nullptr))
+		return FALSE;
+
+	return SSL_CTX_set_tlsext_ticket_key_evp_cb(ctx, tls_ticket_key_cb) == 1;
+#else
+	/* Tickets stay bound to the context of a single connection */
+	return TRUE;
+#endif
+}
@@ -0,0 +1,71 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * TLS session resumption
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FREERDP_LIB_CRYPTO_TLS_SESSION_H
+#define FREERDP_LIB_CRYPTO_TLS_SESSION_H
+
+#include <winpr/wtypes.h>
+
+#include <openssl/ssl.h>
+
+#include <freerdp/api.h>
+
+/** @brief how a TLS handshake was completed, used as metrics label */
+typedef enum
+{
+	TLS_SESSION_FULL,     /*!< no session was offered, full handshake */
+	TLS_SESSION_RESUMED,  /*!< the offered session was resumed */
+	TLS_SESSION_REJECTED, /*!< a session was offered, the server did a full handshake */
+	TLS_SESSION_MODE_COUNT
+} TlsSessionMode;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+	WINPR_ATTR_NODISCARD
+	FREERDP_LOCAL const char* tls_session_mode_string(UINT32 mode);
+
+	/** @brief Enables client side session caching on a new context. OpenSSL does not keep the
+	 *  sessions itself, each session received is passed to \b cb instead. */
+	WINPR_ATTR_NODISCARD
+	FREERDP_LOCAL BOOL tls_session_cache_prepare(SSL_CTX* ctx, int (*cb)(SSL*, SSL_SESSION*));
+
+	/** @brief Returns a copy of the cached session for \b hostname and \b port */
+	WINPR_ATTR_NODISCARD
+	FREERDP_LOCAL SSL_SESSION* tls_session_cache_lookup(const char* hostname, UINT16 port);
+
+	/** @brief Caches \b session for \b hostname and \b port, replacing a previous one.
+	 *  The fingerprint of the session certificate is stored with it, a changed server certificate
+	 *  replaces the entry. Only cache sessions whose certificate was verified. */
+	FREERDP_LOCAL BOOL tls_session_cache_store(const char* hostname, UINT16 port,
+	                                           SSL_SESSION* session);
+
+	/** @brief Drops a cached session, e.g. after the server certificate was rejected */
+	FREERDP_LOCAL void tls_session_cache_remove(const char* hostname, UINT16 port);
+
+	/** @brief Installs the process wide, rotating session ticket keys on a server context so
+	 *  tickets issued by one connection can be resumed on another. */
+	WINPR_ATTR_NODISCARD
+	FREERDP_LOCAL BOOL tls_session_ticket_keys_install(SSL_CTX* ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FREERDP_LIB_CRYPTO_TLS_SESSION_H */
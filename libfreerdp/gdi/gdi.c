@@ -27,6 +27,8 @@
 #include <winpr/crt.h>
 #include <winpr/assert.h>
 #include <winpr/cast.h>
+#include <winpr/pool.h>
+#include <winpr/sysinfo.h>
 
 #include <freerdp/api.h>
 #include <freerdp/log.h>
@@ -480,6 +482,270 @@ void gdi_bitmap_free_ex(gdiBitmap* bitmap)
 	}
 }
 
+typedef struct
+{
+	BITMAP_INTERLEAVED_CONTEXT* interleaved;
+	BITMAP_PLANAR_CONTEXT* planar;
+	UINT32 planarWidth;
+	UINT32 planarHeight;
+} gdiBitmapDecoder;
+
+struct gdi_bitmap_decoders
+{
+	size_t count;
+	gdiBitmapDecoder* decoders;
+};
+
+typedef struct
+{
+	rdpContext* context;
+	gdiBitmapDecoder* decoder;
+	const BITMAP_UPDATE* bitmapUpdate;
+	rdpBitmap** bitmaps;
+	BOOL* decoded;
+	size_t first;
+	size_t step;
+} gdiBitmapDecodeParam;
+
+static void gdi_bitmap_decoders_free(gdiBitmapDecoders* decoders)
+{
+	if (!decoders)
+		return;
+
+	for (size_t x = 0; x < decoders->count; x++)
+	{
+		gdiBitmapDecoder* decoder = &decoders->decoders[x];
+		bitmap_interleaved_context_free(decoder->interleaved);
+		freerdp_bitmap_planar_context_free(decoder->planar);
+	}
+
+	free(decoders->decoders);
+	free(decoders);
+}
+
+WINPR_ATTR_MALLOC(gdi_bitmap_decoders_free, 1)
+WINPR_ATTR_NODISCARD
+static gdiBitmapDecoders* gdi_bitmap_decoders_new(size_t count)
+{
+	gdiBitmapDecoders* decoders = calloc(1, sizeof(gdiBitmapDecoders));
+	if (!decoders)
+		return nullptr;
+
+	decoders->decoders = calloc(count, sizeof(gdiBitmapDecoder));
+	if (!decoders->decoders)
+		goto fail;
+	decoders->count = count;
+
+	for (size_t x = 0; x < count; x++)
+	{
+		gdiBitmapDecoder* decoder = &decoders->decoders[x];
+		decoder->planarWidth = 64;
+		decoder->planarHeight = 64;
+		decoder->interleaved = bitmap_interleaved_context_new(FALSE);
+		decoder->planar =
+		    freerdp_bitmap_planar_context_new(0, decoder->planarWidth, decoder->planarHeight);
+		if (!decoder->interleaved || !decoder->planar)
+			goto fail;
+	}
+
+	return decoders;
+fail:
+	gdi_bitmap_decoders_free(decoders);
+	return nullptr;
+}
+
+/** returns the number of decoders to use for a bitmap update, 0 to decode on the
+ * calling thread. The per thread decoders are created on first use.
+ */
+static size_t gdi_bitmap_update_workers(rdpContext* context, const BITMAP_UPDATE* bitmapUpdate)
+{
+	WINPR_ASSERT(context);
+	WINPR_ASSERT(bitmapUpdate);
+
+	rdpGdi* gdi = context->gdi;
+	WINPR_ASSERT(gdi);
+
+	/* a single rectangle is not worth the dispatch overhead */
+	if (bitmapUpdate->number < 2)
+		return 0;
+
+	const UINT32 flags = freerdp_settings_get_uint32(context->settings, FreeRDP_ThreadingFlags);
+	if (flags & THREADING_FLAGS_DISABLE_THREADS)
+		return 0;
+
+	if (!gdi->bitmapDecoders)
+	{
+		SYSTEM_INFO sysInfos = WINPR_C_ARRAY_INIT;
+		GetNativeSystemInfo(&sysInfos);
+		if (sysInfos.dwNumberOfProcessors < 2)
+			return 0;
+
+		gdi->bitmapDecoders = gdi_bitmap_decoders_new(sysInfos.dwNumberOfProcessors);
+		if (!gdi->bitmapDecoders)
+			return 0;
+	}
+
+	return MIN(gdi->bitmapDecoders->count, bitmapUpdate->number);
+}
+
+static void CALLBACK
+gdi_bitmap_decode_work_callback(WINPR_ATTR_UNUSED PTP_CALLBACK_INSTANCE instance, void* context,
+                                WINPR_ATTR_UNUSED PTP_WORK work)
+{
+	gdiBitmapDecodeParam* param = context;
+	WINPR_ASSERT(param);
+
+	gdiBitmapDecoder* decoder = param->decoder;
+	WINPR_ASSERT(decoder);
+
+	for (size_t index = param->first; index < param->bitmapUpdate->number; index += param->step)
+	{
+		const BITMAP_DATA* bitmap = &param->bitmapUpdate->rectangles[index];
+		rdpBitmap* bmp = param->bitmaps[index];
+
+		if ((bitmap->width > decoder->planarWidth) || (bitmap->height > decoder->planarHeight))
+		{
+			decoder->planarWidth = MAX(bitmap->width, decoder->planarWidth);
+			decoder->planarHeight = MAX(bitmap->height, decoder->planarHeight);
+			if (!freerdp_bitmap_planar_context_reset(decoder->planar, decoder->planarWidth,
+			                                         decoder->planarHeight))
+				return;
+		}
+
+		param->decoded[index] = gdi_bitmap_decompress_ex(
+		    param->context, bmp, bitmap->bitmapDataStream, bitmap->width, bitmap->height,
+		    bitmap->bitsPerPixel, bitmap->bitmapLength, bitmap->compressed, RDP_CODEC_ID_NONE,
+		    decoder->interleaved, decoder->planar);
+	}
+}
+
+WINPR_ATTR_NODISCARD
+static rdpBitmap* gdi_bitmap_update_alloc(rdpContext* context, const BITMAP_DATA* bitmap)
+{
+	rdpBitmap* bmp = Bitmap_Alloc(context);
+
+	if (!bmp)
+		return nullptr;
+
+	if (!Bitmap_SetDimensions(bmp, WINPR_ASSERTING_INT_CAST(UINT16, bitmap->width),
+	                          WINPR_ASSERTING_INT_CAST(UINT16, bitmap->height)))
+		goto fail;
+
+	if (!Bitmap_SetRectangle(bmp, WINPR_ASSERTING_INT_CAST(UINT16, bitmap->destLeft),
+	                         WINPR_ASSERTING_INT_CAST(UINT16, bitmap->destTop),
+	                         WINPR_ASSERTING_INT_CAST(UINT16, bitmap->destRight),
+	                         WINPR_ASSERTING_INT_CAST(UINT16, bitmap->destBottom)))
+		goto fail;
+
+	return bmp;
+fail:
+	Bitmap_Free(context, bmp);
+	return nullptr;
+}
+
+/** decodes all rectangles of a bitmap update concurrently, each worker using its
+ * own interleaved and planar context. The decoded bitmaps are painted afterwards
+ * in update order on the calling thread, so overlapping rectangles are drawn
+ * exactly as with sequential decoding.
+ */
+WINPR_ATTR_NODISCARD
+static BOOL gdi_bitmap_update_threaded(rdpContext* context, const BITMAP_UPDATE* bitmapUpdate,
+                                       size_t workers, BOOL* fallback)
+{
+	BOOL rc = FALSE;
+	size_t submitted = 0;
+	const size_t count = bitmapUpdate->number;
+
+	rdpGdi* gdi = context->gdi;
+	WINPR_ASSERT(gdi);
+	WINPR_ASSERT(gdi->bitmapDecoders);
+	WINPR_ASSERT(fallback);
+
+	*fallback = FALSE;
+	rdpBitmap** bitmaps = calloc(count, sizeof(rdpBitmap*));
+	BOOL* decoded = calloc(count, sizeof(BOOL));
+	PTP_WORK* work = calloc(workers, sizeof(PTP_WORK));
+	gdiBitmapDecodeParam* params = calloc(workers, sizeof(gdiBitmapDecodeParam));
+
+	if (!bitmaps || !decoded || !work || !params)
+		goto fail;
+
+	for (size_t index = 0; index < count; index++)
+	{
+		bitmaps[index] = gdi_bitmap_update_alloc(context, &bitmapUpdate->rectangles[index]);
+		if (!bitmaps[index])
+			goto fail;
+
+		/* a client provided decoder might not be thread safe */
+		if (!gdi_bitmap_has_default_decompress(bitmaps[index]))
+		{
+			*fallback = TRUE;
+			goto fail;
+		}
+	}
+
+	for (size_t x = 0; x < workers; x++)
+	{
+		params[x].context = context;
+		params[x].decoder = &gdi->bitmapDecoders->decoders[x];
+		params[x].bitmapUpdate = bitmapUpdate;
+		params[x].bitmaps = bitmaps;
+		params[x].decoded = decoded;
+		params[x].first = x;
+		params[x].step = workers;
+
+		if (submitted == x)
+		{
+			work[x] = CreateThreadpoolWork(gdi_bitmap_decode_work_callback, &params[x], nullptr);
+			if (work[x])
+			{
+				SubmitThreadpoolWork(work[x]);
+				submitted = x + 1;
+				continue;
+			}
+
+			WLog_Print(gdi->log, WLOG_WARN,
+			           "CreateThreadpoolWork failed, decoding the remaining rectangles here");
+		}
+
+		/* each share has its own decoder, so it can run here while the workers continue */
+		gdi_bitmap_decode_work_callback(nullptr, &params[x], nullptr);
+	}
+
+	for (size_t x = 0; x < submitted; x++)
+	{
+		WaitForThreadpoolWorkCallbacks(work[x], FALSE);
+		CloseThreadpoolWork(work[x]);
+	}
+
+	for (size_t index = 0; index < count; index++)
+	{
+		rdpBitmap* bmp = bitmaps[index];
+
+		if (!decoded[index])
+			goto fail;
+
+		if (!bmp->New(context, bmp))
+			goto fail;
+
+		if (!bmp->Paint(context, bmp))
+			goto fail;
+	}
+
+	rc = TRUE;
+fail:
+	if (bitmaps)
+	{
+		for (size_t index = 0; index < count; index++)
+			Bitmap_Free(context, bitmaps[index]);
+	}
+	free(params);
+	free((void*)work);
+	free(decoded);
+	free((void*)bitmaps);
+	return rc;
+}
+
 BOOL gdi_bitmap_update(rdpContext* context, const BITMAP_UPDATE* bitmapUpdate)
 {
 	if (!context || !bitmapUpdate || !context->gdi || !context->codecs)
@@ -494,25 +760,24 @@ BOOL gdi_bitmap_update(rdpContext* context, const BITMAP_UPDATE* bitmapUpdate)
 		return FALSE;
 	}
 
+	const size_t workers = gdi_bitmap_update_workers(context, bitmapUpdate);
+	if (workers > 1)
+	{
+		BOOL fallback = FALSE;
+		const BOOL rc = gdi_bitmap_update_threaded(context, bitmapUpdate, workers, &fallback);
+		if (!fallback)
+			return rc;
+	}
+
 	for (UINT32 index = 0; index < bitmapUpdate->number; index++)
 	{
 		BOOL rc = FALSE;
 		const BITMAP_DATA* bitmap = &(bitmapUpdate->rectangles[index]);
-		rdpBitmap* bmp = Bitmap_Alloc(context);
+		rdpBitmap* bmp = gdi_bitmap_update_alloc(context, bitmap);
 
 		if (!bmp)
 			goto fail;
 
-		if (!Bitmap_SetDimensions(bmp, WINPR_ASSERTING_INT_CAST(UINT16, bitmap->width),
-		                          WINPR_ASSERTING_INT_CAST(UINT16, bitmap->height)))
-			goto fail;
-
-		if (!Bitmap_SetRectangle(bmp, WINPR_ASSERTING_INT_CAST(UINT16, bitmap->destLeft),
-		                         WINPR_ASSERTING_INT_CAST(UINT16, bitmap->destTop),
-		                         WINPR_ASSERTING_INT_CAST(UINT16, bitmap->destRight),
-		                         WINPR_ASSERTING_INT_CAST(UINT16, bitmap->destBottom)))
-			goto fail;
-
 		if (!bmp->Decompress(context, bmp, bitmap->bitmapDataStream, bitmap->width, bitmap->height,
 		                     bitmap->bitsPerPixel, bitmap->bitmapLength, bitmap->compressed,
 		                     RDP_CODEC_ID_NONE))
@@ -1504,6 +1769,7 @@ void gdi_free(freerdp* instance)
 	{
 		gdi_bitmap_free_ex(gdi->primary);
 		gdi_DeleteDC(gdi->hdc);
+		gdi_bitmap_decoders_free(gdi->bitmapDecoders);
 		free(gdi);
 	}
 
@@ -545,11 +545,9 @@ static UINT gdi_SurfaceCommand_RemoteFX(rdpGdi* gdi, RdpgfxClientContext* contex
 	if (status != CHANNEL_RC_OK)
 		goto fail;
 
-	for (UINT32 x = 0; x < nrRects; x++)
-	{
-		if (!region16_union_rect(&surface->invalidRegion, &surface->invalidRegion, &rects[x]))
-			goto fail;
-	}
+	if (!region16_union_rects(&surface->invalidRegion, &surface->invalidRegion, rects, nrRects,
+	                          gdi->gfxRegionScratch))
+		goto fail;
 
 	status = gdi_interFrameUpdate(gdi, context);
 
@@ -1131,11 +1129,9 @@ static UINT gdi_SurfaceCommand_Progressive(rdpGdi* gdi, RdpgfxClientContext* con
 		goto fail;
 
 	status = ERROR_INTERNAL_ERROR;
-	for (UINT32 x = 0; x < nrRects; x++)
-	{
-		if (!region16_union_rect(&surface->invalidRegion, &surface->invalidRegion, &rects[x]))
-			goto fail;
-	}
+	if (!region16_union_rects(&surface->invalidRegion, &surface->invalidRegion, rects, nrRects,
+	                          gdi->gfxRegionScratch))
+		goto fail;
 
 	status = gdi_interFrameUpdate(gdi, context);
 
@@ -1174,6 +1170,7 @@ static UINT gdi_SurfaceCommand(RdpgfxClientContext* context, const RDPGFX_SURFAC
 	dump_cmd(cmd, gdi->frameId);
 #endif
 
+	const UINT64 start = winpr_GetTickCount64NS();
 	switch (codecId)
 	{
 		case RDPGFX_CODECID_UNCOMPRESSED:
@@ -1226,6 +1223,13 @@ static UINT gdi_SurfaceCommand(RdpgfxClientContext* context, const RDPGFX_SURFAC
 			break;
 	}
 
+	if (status == CHANNEL_RC_OK)
+	{
+		rdpMetrics* metrics = gdi->context->metrics;
+		freerdp_metrics_record_since(metrics, FREERDP_METRIC_CODEC_DECODE_TIME, codecId, start);
+		freerdp_metrics_add(metrics, FREERDP_METRIC_CODEC_DECODE_BYTES, codecId, cmd->length);
+	}
+
 	LeaveCriticalSection(&context->mux);
 	return status;
 }
@@ -1532,42 +1536,237 @@ fail:
 	return status;
 }
 
-static void gdi_GfxCacheEntryFree(gdiGfxCacheEntry* entry)
+/* Cache entries are pooled in size classes: 1 KiB and below share one class, above that every
+ * power of two up to 4 MiB is split into 4 classes, wasting at most 25% per entry. Larger
+ * entries are not pooled. */
+#define GFX_CACHE_ARENA_MIN_OCTAVE 10
+#define GFX_CACHE_ARENA_MAX_OCTAVE 21
+#define GFX_CACHE_ARENA_CLASSES \
+	(1 + (GFX_CACHE_ARENA_MAX_OCTAVE - GFX_CACHE_ARENA_MIN_OCTAVE + 1) * 4)
+#define GFX_CACHE_ARENA_NO_CLASS UINT32_MAX
+
+typedef struct gdi_gfx_cache_block
 {
-	if (!entry)
+	gdiGfxCacheEntry entry; /* must be first */
+	size_t capacity;
+	UINT32 sizeClass;
+	struct gdi_gfx_cache_block* next;
+} gdiGfxCacheBlock;
+
+struct gdi_gfx_cache_arena
+{
+	CRITICAL_SECTION lock;
+	gdiGfxCacheBlock* freeLists[GFX_CACHE_ARENA_CLASSES];
+	size_t maxEntries;
+	size_t maxPooledBytes;
+	gdiGfxCacheStats stats;
+};
+
+static UINT32 gdi_GfxCacheArenaClass(size_t size, size_t* capacity)
+{
+	WINPR_ASSERT(capacity);
+
+	if (size <= (1ull << GFX_CACHE_ARENA_MIN_OCTAVE))
+	{
+		*capacity = 1ull << GFX_CACHE_ARENA_MIN_OCTAVE;
+		return 0;
+	}
+
+	const size_t value = size - 1;
+	UINT32 octave = 0;
+	while ((value >> (octave + 1)) != 0)
+		octave++;
+
+	if (octave > GFX_CACHE_ARENA_MAX_OCTAVE)
+	{
+		*capacity = size;
+		return GFX_CACHE_ARENA_NO_CLASS;
+	}
+
+	const size_t step = 1ull << (octave - 2);
+	const size_t sub = (value - (1ull << octave)) / step;
+	*capacity = (1ull << octave) + (sub + 1) * step;
+	return (UINT32)(1 + (octave - GFX_CACHE_ARENA_MIN_OCTAVE) * 4 + sub);
+}
+
+static gdiGfxCacheArena* gdi_GfxCacheArenaGet(RdpgfxClientContext* context)
+{
+	WINPR_ASSERT(context);
+
+	rdpGdi* gdi = (rdpGdi*)context->custom;
+	if (!gdi)
+		return nullptr;
+	return gdi->gfxCacheArena;
+}
+
+static void gdi_GfxCacheBlockFree(gdiGfxCacheBlock* block)
+{
+	if (!block)
 		return;
-	free(entry->data);
-	free(entry);
+	winpr_aligned_free(block->entry.data);
+	free(block);
 }
 
-static gdiGfxCacheEntry* gdi_GfxCacheEntryNew(UINT64 cacheKey, UINT32 width, UINT32 height,
-                                              UINT32 format)
+static gdiGfxCacheArena* gdi_GfxCacheArenaNew(rdpSettings* settings)
 {
-	gdiGfxCacheEntry* cacheEntry = (gdiGfxCacheEntry*)calloc(1, sizeof(gdiGfxCacheEntry));
-	if (!cacheEntry)
-		goto fail;
+	gdiGfxCacheArena* arena = calloc(1, sizeof(gdiGfxCacheArena));
+	if (!arena)
+		return nullptr;
+
+	/* Never hold more entries than the server can address, and keep at most a quarter of the
+	 * negotiated cache size (16 MiB small, 100 MiB regular) in released entries */
+	const BOOL smallCache = freerdp_settings_get_bool(settings, FreeRDP_GfxSmallCache);
+	arena->maxEntries = smallCache ? 4096 : 25600;
+	arena->maxPooledBytes = (smallCache ? 16ull : 100ull) * 1024ull * 1024ull / 4ull;
+
+	if (!InitializeCriticalSectionAndSpinCount(&arena->lock, 4000))
+	{
+		free(arena);
+		return nullptr;
+	}
+	return arena;
+}
+
+static void gdi_GfxCacheArenaFree(gdiGfxCacheArena* arena)
+{
+	if (!arena)
+		return;
+
+	for (size_t x = 0; x < ARRAYSIZE(arena->freeLists); x++)
+	{
+		gdiGfxCacheBlock* block = arena->freeLists[x];
+		while (block)
+		{
+			gdiGfxCacheBlock* next = block->next;
+			gdi_GfxCacheBlockFree(block);
+			block = next;
+		}
+	}
 
-	cacheEntry->cacheKey = cacheKey;
-	cacheEntry->width = width;
-	cacheEntry->height = height;
-	cacheEntry->format = format;
+	WLog_DBG(TAG,
+	         "cache arena: %" PRIu64 " allocations, %" PRIu64 " reuses, %" PRIuz
+	         " entries still in use",
+	         arena->stats.allocations, arena->stats.reuses, arena->stats.liveEntries);
+	DeleteCriticalSection(&arena->lock);
+	free(arena);
+}
+
+/* Entries are released to the arena of the graphics pipeline they belong to, once the pipeline
+ * is gone they are freed directly */
+static void gdi_GfxCacheEntryFree(gdiGfxCacheArena* arena, gdiGfxCacheEntry* entry)
+{
+	if (!entry)
+		return;
+
+	gdiGfxCacheBlock* block = (gdiGfxCacheBlock*)entry;
+	if (arena)
+	{
+		EnterCriticalSection(&arena->lock);
+		gdiGfxCacheStats* stats = &arena->stats;
+		stats->liveEntries -= MIN(stats->liveEntries, 1);
+		stats->liveBytes -= MIN(stats->liveBytes, block->capacity);
+
+		if ((block->sizeClass != GFX_CACHE_ARENA_NO_CLASS) &&
+		    (stats->liveEntries + stats->pooledEntries < arena->maxEntries) &&
+		    (stats->pooledBytes + block->capacity <= arena->maxPooledBytes))
+		{
+			block->next = arena->freeLists[block->sizeClass];
+			arena->freeLists[block->sizeClass] = block;
+			stats->pooledEntries++;
+			stats->pooledBytes += block->capacity;
+			block = nullptr;
+		}
+		LeaveCriticalSection(&arena->lock);
+	}
+
+	gdi_GfxCacheBlockFree(block);
+}
+
+static gdiGfxCacheEntry* gdi_GfxCacheEntryNew(gdiGfxCacheArena* arena, UINT64 cacheKey,
+                                              UINT32 width, UINT32 height, UINT32 format)
+{
+	gdiGfxCacheBlock* block = nullptr;
+	size_t capacity = 0;
+	UINT32 sizeClass = GFX_CACHE_ARENA_NO_CLASS;
 
 	const UINT32 bpp = MAX(4, FreeRDPGetBytesPerPixel(format));
-	cacheEntry->scanline = gfx_align_scanline(cacheEntry->width * bpp, 16);
+	const UINT32 scanline = gfx_align_scanline(width * bpp, 16);
+	const size_t size = 1ull * scanline * height;
+
+	if ((width > 0) && (height > 0))
+		sizeClass = gdi_GfxCacheArenaClass(size, &capacity);
 
-	if ((cacheEntry->width > 0) && (cacheEntry->height > 0))
+	if (arena)
 	{
-		cacheEntry->data = (BYTE*)calloc(cacheEntry->height, cacheEntry->scanline);
+		EnterCriticalSection(&arena->lock);
+		gdiGfxCacheStats* stats = &arena->stats;
+		if (sizeClass != GFX_CACHE_ARENA_NO_CLASS)
+		{
+			block = arena->freeLists[sizeClass];
+			if (block)
+			{
+				arena->freeLists[sizeClass] = block->next;
+				stats->pooledEntries--;
+				stats->pooledBytes -= block->capacity;
+				stats->reuses++;
+			}
+		}
+		if (!block)
+			stats->allocations++;
+		stats->liveEntries++;
+		stats->liveBytes += capacity;
+		LeaveCriticalSection(&arena->lock);
+	}
 
-		if (!cacheEntry->data)
+	if (!block)
+	{
+		block = (gdiGfxCacheBlock*)calloc(1, sizeof(gdiGfxCacheBlock));
+		if (!block)
 			goto fail;
+
+		block->capacity = capacity;
+		block->sizeClass = sizeClass;
+		if (capacity > 0)
+		{
+			/* Entries are copied as a whole into surfaces, no need to clear them */
+			block->entry.data = (BYTE*)winpr_aligned_malloc(capacity, 32);
+			if (!block->entry.data)
+				goto fail;
+		}
 	}
-	return cacheEntry;
+
+	block->next = nullptr;
+	block->entry.cacheKey = cacheKey;
+	block->entry.width = width;
+	block->entry.height = height;
+	block->entry.format = format;
+	block->entry.scanline = scanline;
+	return &block->entry;
+
 fail:
-	gdi_GfxCacheEntryFree(cacheEntry);
+	if (arena)
+	{
+		EnterCriticalSection(&arena->lock);
+		arena->stats.liveEntries--;
+		arena->stats.liveBytes -= capacity;
+		LeaveCriticalSection(&arena->lock);
+	}
+	gdi_GfxCacheBlockFree(block);
 	return nullptr;
 }
 
+BOOL gdi_graphics_pipeline_get_cache_stats(rdpGdi* gdi, gdiGfxCacheStats* stats)
+{
+	if (!gdi || !gdi->gfxCacheArena || !stats)
+		return FALSE;
+
+	gdiGfxCacheArena* arena = gdi->gfxCacheArena;
+	EnterCriticalSection(&arena->lock);
+	*stats = arena->stats;
+	LeaveCriticalSection(&arena->lock);
+	return TRUE;
+}
+
 /**
  * Function description
  *
@@ -1591,7 +1790,8 @@ static UINT gdi_SurfaceToCache(RdpgfxClientContext* context,
 	if (!is_rect_valid(rect, surface->width, surface->height))
 		goto fail;
 
-	cacheEntry = gdi_GfxCacheEntryNew(surfaceToCache->cacheKey, (UINT32)(rect->right - rect->left),
+	cacheEntry = gdi_GfxCacheEntryNew(gdi_GfxCacheArenaGet(context), surfaceToCache->cacheKey,
+	                                  (UINT32)(rect->right - rect->left),
 	                                  (UINT32)(rect->bottom - rect->top), surface->format);
 
 	if (!cacheEntry)
@@ -1618,7 +1818,7 @@ static UINT gdi_SurfaceToCache(RdpgfxClientContext* context,
 	rc = context->SetCacheSlotData(context, surfaceToCache->cacheSlot, (void*)cacheEntry);
 fail:
 	if (rc != CHANNEL_RC_OK)
-		gdi_GfxCacheEntryFree(cacheEntry);
+		gdi_GfxCacheEntryFree(gdi_GfxCacheArenaGet(context), cacheEntry);
 	LeaveCriticalSection(&context->mux);
 	return rc;
 }
@@ -1717,7 +1917,8 @@ static UINT gdi_CacheImportReply(RdpgfxClientContext* context,
 		if (cacheEntry)
 			continue;
 
-		cacheEntry = gdi_GfxCacheEntryNew(cacheSlot, 0, 0, PIXEL_FORMAT_BGRX32);
+		cacheEntry = gdi_GfxCacheEntryNew(gdi_GfxCacheArenaGet(context), cacheSlot, 0, 0,
+		                                  PIXEL_FORMAT_BGRX32);
 
 		if (!cacheEntry)
 			return ERROR_INTERNAL_ERROR;
@@ -1729,7 +1930,7 @@ static UINT gdi_CacheImportReply(RdpgfxClientContext* context,
 		{
 			WLog_ERR(TAG, "CacheImportReply: SetCacheSlotData failed with error %" PRIu32 "",
 			         error);
-			gdi_GfxCacheEntryFree(cacheEntry);
+			gdi_GfxCacheEntryFree(gdi_GfxCacheArenaGet(context), cacheEntry);
 			break;
 		}
 	}
@@ -1746,8 +1947,9 @@ static UINT gdi_ImportCacheEntry(RdpgfxClientContext* context, UINT16 cacheSlot,
 	if (cacheSlot == 0)
 		return CHANNEL_RC_OK;
 
-	cacheEntry = gdi_GfxCacheEntryNew(importCacheEntry->key64, importCacheEntry->width,
-	                                  importCacheEntry->height, PIXEL_FORMAT_BGRX32);
+	cacheEntry = gdi_GfxCacheEntryNew(gdi_GfxCacheArenaGet(context), importCacheEntry->key64,
+	                                  importCacheEntry->width, importCacheEntry->height,
+	                                  PIXEL_FORMAT_BGRX32);
 
 	if (!cacheEntry)
 		goto fail;
@@ -1772,7 +1974,7 @@ static UINT gdi_ImportCacheEntry(RdpgfxClientContext* context, UINT16 cacheSlot,
 fail:
 	if (error)
 	{
-		gdi_GfxCacheEntryFree(cacheEntry);
+		gdi_GfxCacheEntryFree(gdi_GfxCacheArenaGet(context), cacheEntry);
 		WLog_ERR(TAG, "ImportCacheEntry: SetCacheSlotData failed with error %" PRIu32 "", error);
 	}
 
@@ -1820,7 +2022,7 @@ static UINT gdi_EvictCacheEntry(RdpgfxClientContext* context,
 	WINPR_ASSERT(context->GetCacheSlotData);
 	cacheEntry = (gdiGfxCacheEntry*)context->GetCacheSlotData(context, evictCacheEntry->cacheSlot);
 
-	gdi_GfxCacheEntryFree(cacheEntry);
+	gdi_GfxCacheEntryFree(gdi_GfxCacheArenaGet(context), cacheEntry);
 
 	WINPR_ASSERT(context->SetCacheSlotData);
 	rc = context->SetCacheSlotData(context, evictCacheEntry->cacheSlot, nullptr);
@@ -2040,6 +2242,18 @@ BOOL gdi_graphics_pipeline_init_ex(rdpGdi* gdi, RdpgfxClientContext* gfx,
 		if (!freerdp_client_codecs_prepare(gfx->codecs, FREERDP_CODEC_ALL, w, h))
 			return FALSE;
 	}
+
+	gdi_GfxCacheArenaFree(gdi->gfxCacheArena);
+	gdi->gfxCacheArena = gdi_GfxCacheArenaNew(settings);
+	if (!gdi->gfxCacheArena)
+		return FALSE;
+
+	/* surface commands run under gfx->mux, so they can share one scratch */
+	region16_scratch_free(gdi->gfxRegionScratch);
+	gdi->gfxRegionScratch = region16_scratch_new();
+	if (!gdi->gfxRegionScratch)
+		return FALSE;
+
 	InitializeCriticalSection(&gfx->mux);
 	PROFILER_CREATE(gfx->SurfaceProfiler, "GFX-PROFILER")
 
@@ -2063,7 +2277,13 @@ BOOL gdi_graphics_pipeline_init_ex(rdpGdi* gdi, RdpgfxClientContext* gfx,
 void gdi_graphics_pipeline_uninit(rdpGdi* gdi, RdpgfxClientContext* gfx)
 {
 	if (gdi)
+	{
 		gdi->gfx = nullptr;
+		gdi_GfxCacheArenaFree(gdi->gfxCacheArena);
+		gdi->gfxCacheArena = nullptr;
+		region16_scratch_free(gdi->gfxRegionScratch);
+		gdi->gfxRegionScratch = nullptr;
+	}
 
 	if (!gfx)
 		return;
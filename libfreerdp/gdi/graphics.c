@@ -159,9 +159,11 @@ static BOOL gdi_Bitmap_Rfx(rdpContext* context, rdpBitmap* bitmap, const BYTE* p
 	return TRUE;
 }
 
-static BOOL gdi_Bitmap_Decompress(rdpContext* context, rdpBitmap* bitmap, const BYTE* pSrcData,
-                                  UINT32 DstWidth, UINT32 DstHeight, UINT32 bpp, UINT32 length,
-                                  BOOL compressed, UINT32 codecId)
+BOOL gdi_bitmap_decompress_ex(rdpContext* context, rdpBitmap* bitmap, const BYTE* pSrcData,
+                              UINT32 DstWidth, UINT32 DstHeight, UINT32 bpp, UINT32 length,
+                              BOOL compressed, UINT32 codecId,
+                              BITMAP_INTERLEAVED_CONTEXT* interleaved,
+                              BITMAP_PLANAR_CONTEXT* planar)
 {
 	WINPR_ASSERT(context);
 	WINPR_ASSERT(bitmap);
@@ -223,7 +225,7 @@ static BOOL gdi_Bitmap_Decompress(rdpContext* context, rdpBitmap* bitmap, const
 					if (FreeRDPColorHasAlpha(bitmap->format))
 						memset(bitmap->data, 0xff, bitmap->length);
 
-					if (!interleaved_decompress(context->codecs->interleaved, pSrcData, SrcSize,
+					if (!interleaved_decompress(interleaved, pSrcData, SrcSize,
 					                            DstWidth, DstHeight, bpp, bitmap->data,
 					                            bitmap->format, stride, 0, 0, DstWidth, DstHeight,
 					                            &gdi->palette))
@@ -236,10 +238,10 @@ static BOOL gdi_Bitmap_Decompress(rdpContext* context, rdpBitmap* bitmap, const
 				{
 					const BOOL fidelity = freerdp_settings_get_bool(
 					    context->settings, FreeRDP_DrawAllowDynamicColorFidelity);
-					freerdp_planar_switch_bgr(context->codecs->planar, fidelity);
-					if (!freerdp_bitmap_decompress_planar(
-					        context->codecs->planar, pSrcData, SrcSize, DstWidth, DstHeight,
-					        bitmap->data, bitmap->format, stride, 0, 0, DstWidth, DstHeight, TRUE))
+					freerdp_planar_switch_bgr(planar, fidelity);
+					if (!freerdp_bitmap_decompress_planar(planar, pSrcData, SrcSize, DstWidth,
+					                                      DstHeight, bitmap->data, bitmap->format,
+					                                      stride, 0, 0, DstWidth, DstHeight, TRUE))
 					{
 						WLog_ERR(TAG, "freerdp_bitmap_decompress_planar failed");
 						return FALSE;
@@ -280,6 +282,24 @@ static BOOL gdi_Bitmap_Decompress(rdpContext* context, rdpBitmap* bitmap, const
 	return TRUE;
 }
 
+static BOOL gdi_Bitmap_Decompress(rdpContext* context, rdpBitmap* bitmap, const BYTE* pSrcData,
+                                  UINT32 DstWidth, UINT32 DstHeight, UINT32 bpp, UINT32 length,
+                                  BOOL compressed, UINT32 codecId)
+{
+	WINPR_ASSERT(context);
+	WINPR_ASSERT(context->codecs);
+
+	return gdi_bitmap_decompress_ex(context, bitmap, pSrcData, DstWidth, DstHeight, bpp, length,
+	                                compressed, codecId, context->codecs->interleaved,
+	                                context->codecs->planar);
+}
+
+BOOL gdi_bitmap_has_default_decompress(const rdpBitmap* bitmap)
+{
+	WINPR_ASSERT(bitmap);
+	return bitmap->Decompress == gdi_Bitmap_Decompress;
+}
+
 static BOOL gdi_Bitmap_SetSurface(rdpContext* context, rdpBitmap* bitmap, BOOL primary)
 {
 	rdpGdi* gdi = nullptr;
@@ -26,6 +26,8 @@
 #include <freerdp/graphics.h>
 #include <freerdp/api.h>
 #include <freerdp/types.h>
+#include <freerdp/codec/interleaved.h>
+#include <freerdp/codec/planar.h>
 
 WINPR_ATTR_NODISCARD
 FREERDP_LOCAL HGDI_BITMAP gdi_create_bitmap(rdpGdi* gdi, UINT32 width, UINT32 height, UINT32 format,
@@ -34,4 +36,19 @@ FREERDP_LOCAL HGDI_BITMAP gdi_create_bitmap(rdpGdi* gdi, UINT32 width, UINT32 he
 WINPR_ATTR_NODISCARD
 FREERDP_LOCAL BOOL gdi_register_graphics(rdpGraphics* graphics);
 
+/** decompresses bitmap data with the given interleaved and planar contexts instead
+ * of the shared ones in rdpContext::codecs, allowing concurrent decoding.
+ */
+WINPR_ATTR_NODISCARD
+FREERDP_LOCAL BOOL gdi_bitmap_decompress_ex(rdpContext* context, rdpBitmap* bitmap,
+                                            const BYTE* pSrcData, UINT32 DstWidth,
+                                            UINT32 DstHeight, UINT32 bpp, UINT32 length,
+                                            BOOL compressed, UINT32 codecId,
+                                            BITMAP_INTERLEAVED_CONTEXT* interleaved,
+                                            BITMAP_PLANAR_CONTEXT* planar);
+
+/** @return \b TRUE if the bitmap uses the GDI decompress callback */
+WINPR_ATTR_NODISCARD
+FREERDP_LOCAL BOOL gdi_bitmap_has_default_decompress(const rdpBitmap* bitmap);
+
 #endif /* FREERDP_LIB_GDI_GRAPHICS_H */
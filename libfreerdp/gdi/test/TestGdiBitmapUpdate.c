@@ -0,0 +1,199 @@
+
+#include <freerdp/freerdp.h>
+#include <freerdp/gdi/gdi.h>
+#include <freerdp/codec/planar.h>
+
+#include <winpr/crt.h>
+#include <winpr/cast.h>
+
+#include "../../cache/cache.h"
+
+#define TEST_WIDTH 256
+#define TEST_HEIGHT 192
+#define TEST_RECTS 24
+#define TEST_TILE 64
+
+typedef struct
+{
+	BITMAP_DATA rectangles[TEST_RECTS];
+	BYTE* data[TEST_RECTS];
+} TestBitmaps;
+
+static void test_bitmaps_free(TestBitmaps* bitmaps)
+{
+	for (size_t x = 0; x < TEST_RECTS; x++)
+		free(bitmaps->data[x]);
+}
+
+/** creates overlapping rectangles, every other one planar compressed, so the order in which
+ * they are painted shows in the result */
+static BOOL test_bitmaps_init(TestBitmaps* bitmaps)
+{
+	BOOL rc = FALSE;
+	BYTE pixels[TEST_TILE * TEST_TILE * 4] = WINPR_C_ARRAY_INIT;
+	const DWORD planarFlags = PLANAR_FORMAT_HEADER_NA | PLANAR_FORMAT_HEADER_RLE;
+	BITMAP_PLANAR_CONTEXT* planar =
+	    freerdp_bitmap_planar_context_new(planarFlags, TEST_TILE, TEST_TILE);
+
+	memset(bitmaps, 0, sizeof(TestBitmaps));
+	if (!planar)
+		return FALSE;
+
+	for (size_t x = 0; x < TEST_RECTS; x++)
+	{
+		BITMAP_DATA* bitmap = &bitmaps->rectangles[x];
+		const UINT32 width = (x % 3) ? TEST_TILE : TEST_TILE / 2;
+		const UINT32 height = (x % 4) ? TEST_TILE : TEST_TILE - 16;
+
+		for (size_t y = 0; y < ARRAYSIZE(pixels); y += 4)
+		{
+			/* flat runs with a few edges so the planar RLE has something to do */
+			const size_t pos = y / 4;
+			pixels[y] = (BYTE)(x * 10);
+			pixels[y + 1] = (BYTE)((pos / 16) * 7);
+			pixels[y + 2] = (BYTE)((pos % TEST_TILE) < 32 ? 0x40 : 0xc0);
+			pixels[y + 3] = 0xff;
+		}
+
+		bitmap->width = width;
+		bitmap->height = height;
+		bitmap->destLeft = (UINT32)(x * 37) % (TEST_WIDTH - TEST_TILE);
+		bitmap->destTop = (UINT32)(x * 23) % (TEST_HEIGHT - TEST_TILE);
+		bitmap->destRight = bitmap->destLeft + width - 1;
+		bitmap->destBottom = bitmap->destTop + height - 1;
+		bitmap->bitsPerPixel = 32;
+
+		if (x % 2)
+		{
+			UINT32 dstSize = 0;
+			bitmaps->data[x] = freerdp_bitmap_compress_planar(planar, pixels, PIXEL_FORMAT_BGRX32,
+			                                                  width, height, TEST_TILE * 4,
+			                                                  nullptr, &dstSize);
+			bitmap->bitmapLength = dstSize;
+			bitmap->compressed = TRUE;
+		}
+		else
+		{
+			bitmap->bitmapLength = width * height * 4;
+			bitmaps->data[x] = malloc(bitmap->bitmapLength);
+			if (bitmaps->data[x])
+			{
+				for (size_t y = 0; y < height; y++)
+					memcpy(&bitmaps->data[x][y * width * 4], &pixels[y * TEST_TILE * 4],
+					       width * 4ull);
+			}
+			bitmap->compressed = FALSE;
+		}
+
+		if (!bitmaps->data[x])
+			goto fail;
+		bitmap->bitmapDataStream = bitmaps->data[x];
+	}
+
+	rc = TRUE;
+fail:
+	freerdp_bitmap_planar_context_free(planar);
+	return rc;
+}
+
+static void test_instance_free(freerdp* instance)
+{
+	if (!instance)
+		return;
+	if (instance->context)
+	{
+		gdi_free(instance);
+		cache_free(instance->context->cache);
+		instance->context->cache = nullptr;
+		freerdp_context_free(instance);
+	}
+	freerdp_free(instance);
+}
+
+static freerdp* test_instance_new(UINT32 threadingFlags)
+{
+	freerdp* instance = freerdp_new();
+	if (!instance || !freerdp_context_new(instance))
+		goto fail;
+
+	rdpContext* context = instance->context;
+	rdpSettings* settings = context->settings;
+	if (!freerdp_settings_set_uint32(settings, FreeRDP_DesktopWidth, TEST_WIDTH) ||
+	    !freerdp_settings_set_uint32(settings, FreeRDP_DesktopHeight, TEST_HEIGHT) ||
+	    !freerdp_settings_set_uint32(settings, FreeRDP_ColorDepth, 32) ||
+	    !freerdp_settings_set_uint32(settings, FreeRDP_ThreadingFlags, threadingFlags))
+		goto fail;
+
+	/* what the connection sequence does before the gdi receives updates */
+	context->codecs = freerdp_client_codecs_new(threadingFlags);
+	if (!context->codecs ||
+	    !freerdp_client_codecs_prepare(context->codecs,
+	                                   FREERDP_CODEC_INTERLEAVED | FREERDP_CODEC_PLANAR,
+	                                   TEST_WIDTH, TEST_HEIGHT))
+		goto fail;
+
+	context->cache = cache_new(context);
+	if (!context->cache || !gdi_init(instance, PIXEL_FORMAT_BGRX32))
+		goto fail;
+
+	return instance;
+fail:
+	test_instance_free(instance);
+	return nullptr;
+}
+
+static BOOL test_paint(freerdp* instance, const TestBitmaps* bitmaps, size_t first, size_t count)
+{
+	rdpContext* context = instance->context;
+	const BITMAP_UPDATE update = { .number = WINPR_ASSERTING_INT_CAST(UINT32, count),
+		                           .rectangles = WINPR_CAST_CONST_PTR_AWAY(
+		                               &bitmaps->rectangles[first], BITMAP_DATA*) };
+
+	WINPR_ASSERT(context->update->BitmapUpdate);
+	return context->update->BitmapUpdate(context, &update);
+}
+
+int TestGdiBitmapUpdate(WINPR_ATTR_UNUSED int argc, WINPR_ATTR_UNUSED char* argv[])
+{
+	int rc = -1;
+	TestBitmaps bitmaps = WINPR_C_ARRAY_INIT;
+	freerdp* sequential = test_instance_new(THREADING_FLAGS_DISABLE_THREADS);
+	freerdp* threaded = test_instance_new(0);
+
+	if (!sequential || !threaded || !test_bitmaps_init(&bitmaps))
+		goto fail;
+
+	/* the threaded decoder is used for updates of more than one rectangle and on machines
+	 * with more than one core, the result must not differ from the sequential decoder */
+	const size_t counts[] = { 1, 2, 5, TEST_RECTS };
+	for (size_t x = 0; x < ARRAYSIZE(counts); x++)
+	{
+		const size_t first = TEST_RECTS - counts[x];
+		if (!test_paint(sequential, &bitmaps, first, counts[x]) ||
+		    !test_paint(threaded, &bitmaps, first, counts[x]))
+			goto fail;
+
+		const rdpGdi* gdiS = sequential->context->gdi;
+		const rdpGdi* gdiT = threaded->context->gdi;
+		const size_t size = 1ull * gdiS->stride * TEST_HEIGHT;
+		if ((gdiS->stride != gdiT->stride) ||
+		    (memcmp(gdiS->primary_buffer, gdiT->primary_buffer, size) != 0))
+		{
+			(void)fprintf(stderr, "bitmap update of %" PRIuz " rectangles differs\n", counts[x]);
+			goto fail;
+		}
+	}
+
+	/* a corrupt rectangle fails the whole update on both paths */
+	bitmaps.rectangles[TEST_RECTS - 1].bitmapLength = 3;
+	if (test_paint(sequential, &bitmaps, 0, TEST_RECTS) ||
+	    test_paint(threaded, &bitmaps, 0, TEST_RECTS))
+		goto fail;
+
+	rc = 0;
+fail:
+	test_bitmaps_free(&bitmaps);
+	test_instance_free(threaded);
+	test_instance_free(sequential);
+	return rc;
+}
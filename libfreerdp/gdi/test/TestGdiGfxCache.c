@@ -0,0 +1,364 @@
+
+#include <freerdp/freerdp.h>
+#include <freerdp/gdi/gdi.h>
+#include <freerdp/gdi/gfx.h>
+
+#include <winpr/crt.h>
+
+#include "../../cache/cache.h"
+
+#define TEST_SURFACE_ID 3
+#define TEST_SURFACE_WIDTH 1100
+#define TEST_SURFACE_HEIGHT 1000
+#define TEST_SLOTS 4200
+
+/* the gfx context custom pointer belongs to the gdi, keep the channel side state here */
+static void* testSurface;
+static void* testSlots[TEST_SLOTS];
+
+static UINT test_set_surface_data(WINPR_ATTR_UNUSED RdpgfxClientContext* context,
+                                  WINPR_ATTR_UNUSED UINT16 surfaceId, void* pData)
+{
+	testSurface = pData;
+	return CHANNEL_RC_OK;
+}
+
+static void* test_get_surface_data(WINPR_ATTR_UNUSED RdpgfxClientContext* context,
+                                   UINT16 surfaceId)
+{
+	if (surfaceId != TEST_SURFACE_ID)
+		return nullptr;
+	return testSurface;
+}
+
+static UINT test_set_cache_slot_data(WINPR_ATTR_UNUSED RdpgfxClientContext* context,
+                                     UINT16 cacheSlot, void* pData)
+{
+	if ((cacheSlot == 0) || (cacheSlot > TEST_SLOTS))
+		return ERROR_INVALID_INDEX;
+	testSlots[cacheSlot - 1] = pData;
+	return CHANNEL_RC_OK;
+}
+
+static void* test_get_cache_slot_data(WINPR_ATTR_UNUSED RdpgfxClientContext* context,
+                                      UINT16 cacheSlot)
+{
+	if ((cacheSlot == 0) || (cacheSlot > TEST_SLOTS))
+		return nullptr;
+	return testSlots[cacheSlot - 1];
+}
+
+static void test_instance_free(freerdp* instance)
+{
+	if (!instance)
+		return;
+	if (instance->context)
+	{
+		gdi_free(instance);
+		cache_free(instance->context->cache);
+		instance->context->cache = nullptr;
+		freerdp_context_free(instance);
+	}
+	freerdp_free(instance);
+}
+
+static freerdp* test_instance_new(BOOL smallCache)
+{
+	freerdp* instance = freerdp_new();
+	if (!instance || !freerdp_context_new(instance))
+		goto fail;
+
+	rdpContext* context = instance->context;
+	rdpSettings* settings = context->settings;
+	if (!freerdp_settings_set_uint32(settings, FreeRDP_DesktopWidth, TEST_SURFACE_WIDTH) ||
+	    !freerdp_settings_set_uint32(settings, FreeRDP_DesktopHeight, TEST_SURFACE_HEIGHT) ||
+	    !freerdp_settings_set_uint32(settings, FreeRDP_ColorDepth, 32) ||
+	    !freerdp_settings_set_bool(settings, FreeRDP_GfxSmallCache, smallCache))
+		goto fail;
+
+	context->cache = cache_new(context);
+	if (!context->cache || !gdi_init(instance, PIXEL_FORMAT_BGRX32))
+		goto fail;
+
+	return instance;
+fail:
+	test_instance_free(instance);
+	return nullptr;
+}
+
+static BOOL test_surface_create(RdpgfxClientContext* gfx)
+{
+	const RDPGFX_CREATE_SURFACE_PDU create = { .surfaceId = TEST_SURFACE_ID,
+		                                       .width = TEST_SURFACE_WIDTH,
+		                                       .height = TEST_SURFACE_HEIGHT,
+		                                       .pixelFormat = GFX_PIXEL_FORMAT_XRGB_8888 };
+	return gfx->CreateSurface(gfx, &create) == CHANNEL_RC_OK;
+}
+
+static BOOL test_surface_delete(RdpgfxClientContext* gfx)
+{
+	const RDPGFX_DELETE_SURFACE_PDU del = { .surfaceId = TEST_SURFACE_ID };
+	if (!testSurface)
+		return TRUE;
+	return gfx->DeleteSurface(gfx, &del) == CHANNEL_RC_OK;
+}
+
+static RdpgfxClientContext* test_gfx_new(rdpGdi* gdi)
+{
+	RdpgfxClientContext* gfx = calloc(1, sizeof(RdpgfxClientContext));
+	if (!gfx)
+		return nullptr;
+
+	gfx->SetSurfaceData = test_set_surface_data;
+	gfx->GetSurfaceData = test_get_surface_data;
+	gfx->SetCacheSlotData = test_set_cache_slot_data;
+	gfx->GetCacheSlotData = test_get_cache_slot_data;
+	if (!gdi_graphics_pipeline_init(gdi, gfx))
+	{
+		free(gfx);
+		return nullptr;
+	}
+	return gfx;
+}
+
+static void test_gfx_free(rdpGdi* gdi, RdpgfxClientContext* gfx)
+{
+	if (!gfx)
+		return;
+
+	/* what the channel does on close */
+	if (gfx->custom)
+	{
+		for (UINT16 x = 1; x <= TEST_SLOTS; x++)
+		{
+			const RDPGFX_EVICT_CACHE_ENTRY_PDU evict = { .cacheSlot = x };
+			if (testSlots[x - 1])
+				(void)gfx->EvictCacheEntry(gfx, &evict);
+		}
+		(void)test_surface_delete(gfx);
+		gdi_graphics_pipeline_uninit(gdi, gfx);
+	}
+	free(gfx);
+}
+
+static BOOL test_cache(RdpgfxClientContext* gfx, UINT16 slot, UINT16 width, UINT16 height)
+{
+	const RDPGFX_SURFACE_TO_CACHE_PDU pdu = { .surfaceId = TEST_SURFACE_ID,
+		                                      .cacheKey = slot,
+		                                      .cacheSlot = slot,
+		                                      .rectSrc = { 0, 0, width, height } };
+	return gfx->SurfaceToCache(gfx, &pdu) == CHANNEL_RC_OK;
+}
+
+static BOOL test_evict(RdpgfxClientContext* gfx, UINT16 slot)
+{
+	const RDPGFX_EVICT_CACHE_ENTRY_PDU pdu = { .cacheSlot = slot };
+	return gfx->EvictCacheEntry(gfx, &pdu) == CHANNEL_RC_OK;
+}
+
+static BOOL test_stats(rdpGdi* gdi, gdiGfxCacheStats* stats)
+{
+	if (!gdi_graphics_pipeline_get_cache_stats(gdi, stats))
+		return FALSE;
+
+	(void)printf("live %" PRIuz "/%" PRIuz " pooled %" PRIuz "/%" PRIuz " allocations %" PRIu64
+	             " reuses %" PRIu64 "\n",
+	             stats->liveEntries, stats->liveBytes, stats->pooledEntries, stats->pooledBytes,
+	             stats->allocations, stats->reuses);
+	return TRUE;
+}
+
+/* 32 bpp entries with 16 byte aligned lines, rounded up to their size class */
+static BOOL test_size_classes(rdpGdi* gdi, RdpgfxClientContext* gfx)
+{
+	const struct
+	{
+		UINT16 width;
+		UINT16 height;
+		size_t capacity;
+	} sizes[] = {
+		{ 1, 1, 1024 },       /* everything up to 1 KiB shares one class */
+		{ 16, 16, 1024 },     /* exactly 1 KiB */
+		{ 17, 16, 1280 },     /* first quarter step above 1 KiB */
+		{ 32, 11, 1536 },     /* 1408 bytes */
+		{ 64, 64, 16384 },    /* a power of two fits its own class */
+		{ 65, 64, 20480 },    /* 17408 bytes */
+		{ 512, 512, 1048576 } /* 1 MiB */
+	};
+
+	for (size_t x = 0; x < ARRAYSIZE(sizes); x++)
+	{
+		gdiGfxCacheStats before = WINPR_C_ARRAY_INIT;
+		gdiGfxCacheStats stats = WINPR_C_ARRAY_INIT;
+		if (!test_cache(gfx, 1, sizes[x].width, sizes[x].height) || !test_stats(gdi, &stats))
+			return FALSE;
+
+		if ((stats.liveEntries != 1) || (stats.liveBytes != sizes[x].capacity))
+		{
+			(void)fprintf(stderr,
+			              "%" PRIu16 "x%" PRIu16 ": %" PRIuz " bytes, expected %" PRIuz "\n",
+			              sizes[x].width, sizes[x].height, stats.liveBytes, sizes[x].capacity);
+			return FALSE;
+		}
+
+		/* released to its class and handed out again for the same size */
+		if (!test_stats(gdi, &before) || !test_evict(gfx, 1) || !test_stats(gdi, &stats) ||
+		    (stats.pooledEntries != before.pooledEntries + 1) ||
+		    (stats.pooledBytes != before.pooledBytes + sizes[x].capacity))
+			return FALSE;
+
+		if (!test_cache(gfx, 1, sizes[x].width, sizes[x].height) || !test_stats(gdi, &stats) ||
+		    (stats.reuses != before.reuses + 1) || (stats.allocations != before.allocations) ||
+		    (stats.pooledEntries != before.pooledEntries) || !test_evict(gfx, 1))
+			return FALSE;
+	}
+
+	/* above 4 MiB entries are allocated and freed as they are */
+	gdiGfxCacheStats before = WINPR_C_ARRAY_INIT;
+	gdiGfxCacheStats stats = WINPR_C_ARRAY_INIT;
+	if (!test_stats(gdi, &before) ||
+	    !test_cache(gfx, 1, TEST_SURFACE_WIDTH, TEST_SURFACE_HEIGHT) || !test_stats(gdi, &stats) ||
+	    (stats.liveBytes != 4ull * TEST_SURFACE_WIDTH * TEST_SURFACE_HEIGHT) ||
+	    !test_evict(gfx, 1) || !test_stats(gdi, &stats) ||
+	    (stats.pooledEntries != before.pooledEntries) ||
+	    (stats.pooledBytes != before.pooledBytes))
+		return FALSE;
+
+	if (!test_cache(gfx, 1, TEST_SURFACE_WIDTH, TEST_SURFACE_HEIGHT) || !test_stats(gdi, &stats) ||
+	    (stats.allocations != before.allocations + 2) || (stats.reuses != before.reuses))
+		return FALSE;
+	return test_evict(gfx, 1);
+}
+
+/* the small cache keeps no more released entries than the server can address */
+static BOOL test_max_entries(rdpGdi* gdi, RdpgfxClientContext* gfx)
+{
+	gdiGfxCacheStats stats = WINPR_C_ARRAY_INIT;
+
+	/* 1 KiB entries, more than the cache can address */
+	for (UINT16 x = 1; x <= TEST_SLOTS; x++)
+	{
+		if (!test_cache(gfx, x, 16, 16))
+			return FALSE;
+	}
+
+	/* live and pooled entries together never exceed the limit */
+	for (UINT16 x = 1; x <= TEST_SLOTS - 1000; x++)
+	{
+		if (!test_evict(gfx, x))
+			return FALSE;
+	}
+	if (!test_stats(gdi, &stats) || (stats.liveEntries != 1000) ||
+	    (stats.pooledEntries != 4096 - 1000))
+		return FALSE;
+
+	for (UINT16 x = TEST_SLOTS - 1000 + 1; x <= TEST_SLOTS; x++)
+	{
+		if (!test_evict(gfx, x))
+			return FALSE;
+	}
+	return test_stats(gdi, &stats) && (stats.liveEntries == 0) && (stats.liveBytes == 0) &&
+	       (stats.pooledEntries == 4096) && (stats.pooledBytes == 4096ull * 1024ull);
+}
+
+/* the small cache keeps at most 4 MiB of released entries */
+static BOOL test_max_pooled_bytes(rdpGdi* gdi, RdpgfxClientContext* gfx)
+{
+	gdiGfxCacheStats stats = WINPR_C_ARRAY_INIT;
+
+	/* 2 KiB entries, the memory limit is reached before the entry limit */
+	for (UINT16 x = 1; x <= 3000; x++)
+	{
+		if (!test_cache(gfx, x, 32, 16))
+			return FALSE;
+	}
+	for (UINT16 x = 1; x <= 3000; x++)
+	{
+		if (!test_evict(gfx, x))
+			return FALSE;
+	}
+	if (!test_stats(gdi, &stats) || (stats.liveEntries != 0) || (stats.pooledEntries != 2048) ||
+	    (stats.pooledBytes != 4ull * 1024ull * 1024ull))
+		return FALSE;
+
+	/* a released 4 MiB entry does not fit any more */
+	if (!test_cache(gfx, 1, 1024, 1000) || !test_stats(gdi, &stats) ||
+	    (stats.liveBytes != 4ull * 1024ull * 1024ull) || !test_evict(gfx, 1) ||
+	    !test_stats(gdi, &stats))
+		return FALSE;
+	return (stats.pooledEntries == 2048) && (stats.pooledBytes == 4ull * 1024ull * 1024ull);
+}
+
+/* entries that outlive the pipeline they came from are freed directly or by the next one */
+static BOOL test_uninit(rdpGdi* gdi, RdpgfxClientContext* gfx)
+{
+	gdiGfxCacheStats stats = WINPR_C_ARRAY_INIT;
+
+	for (UINT16 x = 1; x <= 8; x++)
+	{
+		if (!test_cache(gfx, x, (UINT16)(x * 10), 10))
+			return FALSE;
+	}
+	if (!test_surface_delete(gfx))
+		return FALSE;
+
+	/* the gdi side is gone while the channel still holds its cache slots */
+	gdi_graphics_pipeline_uninit(gdi, nullptr);
+	if (gdi_graphics_pipeline_get_cache_stats(gdi, &stats))
+		return FALSE;
+	for (UINT16 x = 1; x <= 4; x++)
+	{
+		if (!test_evict(gfx, x))
+			return FALSE;
+	}
+	gdi_graphics_pipeline_uninit(nullptr, gfx);
+
+	/* a new pipeline takes the remaining entries without counting them as its own */
+	if (!gdi_graphics_pipeline_init(gdi, gfx) || !test_surface_create(gfx))
+		return FALSE;
+	for (UINT16 x = 5; x <= 8; x++)
+	{
+		if (!test_evict(gfx, x))
+			return FALSE;
+	}
+	return test_stats(gdi, &stats) && (stats.liveEntries == 0) && (stats.liveBytes == 0);
+}
+
+int TestGdiGfxCache(WINPR_ATTR_UNUSED int argc, WINPR_ATTR_UNUSED char* argv[])
+{
+	int rc = -1;
+	const struct
+	{
+		const char* name;
+		BOOL (*fkt)(rdpGdi* gdi, RdpgfxClientContext* gfx);
+	} tests[] = { { "size classes", test_size_classes },
+		          { "entry limit", test_max_entries },
+		          { "memory limit", test_max_pooled_bytes },
+		          { "uninit", test_uninit } };
+
+	freerdp* instance = test_instance_new(TRUE);
+	if (!instance)
+		return -1;
+
+	/* every test starts with an empty arena */
+	rdpGdi* gdi = instance->context->gdi;
+	for (size_t x = 0; x < ARRAYSIZE(tests); x++)
+	{
+		RdpgfxClientContext* gfx = test_gfx_new(gdi);
+		if (!gfx)
+			goto fail;
+
+		const BOOL res = test_surface_create(gfx) && tests[x].fkt(gdi, gfx);
+		test_gfx_free(gdi, gfx);
+		if (!res)
+		{
+			(void)fprintf(stderr, "%s test failed\n", tests[x].name);
+			goto fail;
+		}
+	}
+
+	rc = 0;
+fail:
+	test_instance_free(instance);
+	return rc;
+}
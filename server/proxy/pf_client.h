@@ -30,6 +30,13 @@
  * Wraps rdpContext and holds the state for the proxy's client.
  */
 
+typedef enum
+{
+	PF_PASSTHROUGH_OFF,    /* graphics are decoded and re-encoded */
+	PF_PASSTHROUGH_ARMED,  /* both sides are compatible, waiting for a history restart */
+	PF_PASSTHROUGH_ACTIVE  /* fast-path updates are forwarded as received */
+} pf_passthrough_state;
+
 struct p_client_context
 {
 	rdpClientContext cctx;
@@ -72,6 +79,10 @@ struct p_client_context
 		char* c;
 		void* v;
 	} computerName;
+
+	/* CompressedPassthrough, see pf_update.c */
+	pf_passthrough_state passthrough_state;
+	BOOL passthrough_fragment; /* the current fragmented update is forwarded */
 };
 
 int RdpClientEntry(RDP_CLIENT_ENTRY_POINTS* pEntryPoints);
@@ -79,6 +79,8 @@ static const char* pf_modules_get_filter_type_string(PF_FILTER_TYPE result)
 			return "FILTER_TYPE_DYN_INTERCEPT_LIST";
 		case FILTER_TYPE_INTERCEPT_CHANNEL:
 			return "FILTER_TYPE_INTERCEPT_CHANNEL";
+		case FILTER_TYPE_CLIENT_PASSTHROUGH_FASTPATH_UPDATE:
+			return "FILTER_TYPE_CLIENT_PASSTHROUGH_FASTPATH_UPDATE";
 		case FILTER_LAST:
 			return "FILTER_LAST";
 		default:
@@ -310,6 +312,10 @@ static BOOL pf_modules_ArrayList_ForEachFkt(void* data, size_t index, va_list ap
 			result = IFCALLRESULT(TRUE, plugin->StaticChannelToIntercept, plugin, pdata, param);
 			break;
 
+		case FILTER_TYPE_CLIENT_PASSTHROUGH_FASTPATH_UPDATE:
+			result = IFCALLRESULT(TRUE, plugin->FastPathUpdate, plugin, pdata, param);
+			break;
+
 		case FILTER_LAST:
 		default:
 			WLog_ERR(TAG, "invalid filter called");
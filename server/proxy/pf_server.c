@@ -398,7 +398,7 @@ static BOOL pf_server_activate(freerdp_peer* peer)
 	if (!pf_modules_run_hook(pdata->module, HOOK_TYPE_SERVER_ACTIVATE, pdata, peer))
 		return FALSE;
 
-	return TRUE;
+	return pf_update_passthrough_arm(pdata);
 }
 
 WINPR_ATTR_NODISCARD
@@ -23,6 +23,7 @@
 
 #include <freerdp/display.h>
 #include <freerdp/session.h>
+#include <freerdp/codec/bulk.h>
 #include <winpr/assert.h>
 #include <winpr/image.h>
 #include <winpr/sysinfo.h>
@@ -657,6 +658,241 @@ static BOOL pf_client_non_monitored_desktop(rdpContext* context, const WINDOW_OR
 	return rc;
 }
 
+/* Compressed passthrough
+ *
+ * If both sides of the proxy negotiated compatible capabilities fast-path updates from the
+ * target are forwarded to the client as received, without decompressing, parsing and
+ * recompressing them. The front connection sends its own updates uncompressed during that
+ * time, so the bulk compression history of the client always mirrors the one of the target.
+ * Forwarding can only start with an update that restarts the compression history.
+ */
+
+#define PF_BULK_HISTORY_FLAGS (PACKET_COMPRESSED | PACKET_AT_FRONT | PACKET_FLUSHED)
+
+WINPR_ATTR_NODISCARD
+static BOOL pf_update_passthrough_compatible(const rdpSettings* front, const rdpSettings* back)
+{
+	const FreeRDP_Settings_Keys_Bool bools[] = { FreeRDP_CompressionEnabled,
+		                                         FreeRDP_FastPathOutput,
+		                                         FreeRDP_SurfaceCommandsEnabled,
+		                                         FreeRDP_RemoteFxCodec,
+		                                         FreeRDP_NSCodec,
+		                                         FreeRDP_BitmapCacheEnabled,
+		                                         FreeRDP_BitmapCacheV3Enabled,
+		                                         FreeRDP_FrameMarkerCommandEnabled,
+		                                         FreeRDP_SurfaceFrameMarkerEnabled };
+	const FreeRDP_Settings_Keys_UInt32 uints[] = { FreeRDP_ColorDepth,
+		                                           FreeRDP_DesktopWidth,
+		                                           FreeRDP_DesktopHeight,
+		                                           FreeRDP_GlyphSupportLevel,
+		                                           FreeRDP_OffscreenSupportLevel,
+		                                           FreeRDP_PointerCacheSize,
+		                                           FreeRDP_ColorPointerCacheSize,
+		                                           FreeRDP_BitmapCacheVersion,
+		                                           FreeRDP_LargePointerFlag };
+
+	WINPR_ASSERT(front);
+	WINPR_ASSERT(back);
+
+	if (!freerdp_settings_get_bool(back, FreeRDP_FastPathOutput))
+		return FALSE;
+
+	for (size_t x = 0; x < ARRAYSIZE(bools); x++)
+	{
+		const FreeRDP_Settings_Keys_Bool key = bools[x];
+		if (freerdp_settings_get_bool(front, key) != freerdp_settings_get_bool(back, key))
+		{
+			WLog_DBG(TAG, "%s differs", freerdp_settings_get_name_for_key(key));
+			return FALSE;
+		}
+	}
+
+	for (size_t x = 0; x < ARRAYSIZE(uints); x++)
+	{
+		const FreeRDP_Settings_Keys_UInt32 key = uints[x];
+		if (freerdp_settings_get_uint32(front, key) != freerdp_settings_get_uint32(back, key))
+		{
+			WLog_DBG(TAG, "%s differs", freerdp_settings_get_name_for_key(key));
+			return FALSE;
+		}
+	}
+
+	/* the client must be able to reassemble whatever the target sends */
+	if (freerdp_settings_get_uint32(front, FreeRDP_MultifragMaxRequestSize) <
+	    freerdp_settings_get_uint32(back, FreeRDP_MultifragMaxRequestSize))
+		return FALSE;
+
+	const BYTE* frontOrders = freerdp_settings_get_pointer(front, FreeRDP_OrderSupport);
+	const BYTE* backOrders = freerdp_settings_get_pointer(back, FreeRDP_OrderSupport);
+	if (!frontOrders || !backOrders)
+		return FALSE;
+	return memcmp(frontOrders, backOrders, 32) == 0;
+}
+
+/* TRUE if nothing after this update references compression history sent before it */
+WINPR_ATTR_NODISCARD
+static BOOL pf_update_passthrough_history_restarts(const rdpSettings* back,
+                                                   const FASTPATH_RAW_UPDATE* update)
+{
+	WINPR_ASSERT(update);
+
+	if (!freerdp_settings_get_bool(back, FreeRDP_CompressionEnabled))
+		return TRUE;
+
+	const BYTE flags = update->compressionFlags;
+	if ((flags & PF_BULK_HISTORY_FLAGS) == 0)
+		return FALSE;
+
+	if ((flags & 0x0F) == PACKET_COMPR_TYPE_RDP61)
+	{
+		/* both the level 1 and the inner MPPC history must start over */
+		if (update->length < 2)
+			return FALSE;
+
+		const BYTE l1 = update->data[0];
+		const BYTE l2 = update->data[1];
+		if (((flags & PACKET_FLUSHED) == 0) && ((l1 & L1_PACKET_AT_FRONT) == 0))
+			return FALSE;
+
+		/* a flushed inner history that did not compress marks the next compressed packet */
+		if (l2 & PACKET_FLUSHED)
+			return TRUE;
+		return ((l2 & PACKET_COMPRESSED) != 0) && ((l2 & PACKET_AT_FRONT) != 0);
+	}
+
+	return (flags & (PACKET_AT_FRONT | PACKET_FLUSHED)) != 0;
+}
+
+WINPR_ATTR_NODISCARD
+static BOOL pf_update_passthrough_fallback(pClientContext* pc, pServerContext* ps)
+{
+	WINPR_ASSERT(pc);
+	WINPR_ASSERT(ps);
+
+	if (pc->passthrough_state != PF_PASSTHROUGH_ACTIVE)
+		return TRUE;
+
+	PROXY_LOG_INFO(TAG, pc, "graphics passthrough suspended");
+	pc->passthrough_state = PF_PASSTHROUGH_ARMED;
+	return freerdp_update_set_compression_passthrough(&ps->context, FALSE);
+}
+
+WINPR_ATTR_NODISCARD
+static BOOL pf_client_fastpath_update_raw(rdpContext* context, const FASTPATH_RAW_UPDATE* update,
+                                          BOOL* handled)
+{
+	pClientContext* pc = (pClientContext*)context;
+	WINPR_ASSERT(pc);
+	WINPR_ASSERT(update);
+	WINPR_ASSERT(handled);
+
+	proxyData* pdata = pc->pdata;
+	WINPR_ASSERT(pdata);
+
+	pServerContext* ps = proxy_data_get_server_context(pdata);
+	WINPR_ASSERT(ps);
+
+	*handled = FALSE;
+	if ((update->fragmentation != FASTPATH_FRAGMENT_SINGLE) &&
+	    (update->fragmentation != FASTPATH_FRAGMENT_FIRST))
+	{
+		if (!pc->passthrough_fragment)
+			return TRUE;
+
+		*handled = TRUE;
+		return freerdp_update_send_fastpath_raw(&ps->context, update);
+	}
+
+	pc->passthrough_fragment = FALSE;
+	if (pc->passthrough_state == PF_PASSTHROUGH_OFF)
+		return TRUE;
+
+	proxyFastPathUpdateInfo info = { .updateCode = update->updateCode,
+		                             .fragmentation = update->fragmentation,
+		                             .compressionFlags = update->compressionFlags,
+		                             .length = update->length };
+	if (!pf_modules_run_filter(pdata->module, FILTER_TYPE_CLIENT_PASSTHROUGH_FASTPATH_UPDATE, pdata,
+	                           &info))
+	{
+		/* Decoding an update the client does not see compressed breaks the shared history */
+		if ((update->compressionFlags & PF_BULK_HISTORY_FLAGS) == 0)
+			return TRUE;
+		return pf_update_passthrough_fallback(pc, ps);
+	}
+
+	if (pc->passthrough_state == PF_PASSTHROUGH_ARMED)
+	{
+		if (!pf_update_passthrough_history_restarts(context->settings, update))
+			return TRUE;
+
+		if (!freerdp_update_set_compression_passthrough(&ps->context, TRUE))
+			return FALSE;
+
+		PROXY_LOG_INFO(TAG, pc, "graphics passthrough active");
+		pc->passthrough_state = PF_PASSTHROUGH_ACTIVE;
+	}
+
+	pc->passthrough_fragment = TRUE;
+	*handled = TRUE;
+	return freerdp_update_send_fastpath_raw(&ps->context, update);
+}
+
+WINPR_ATTR_NODISCARD
+static BOOL pf_client_slowpath_compressed(rdpContext* context, BYTE pduType2)
+{
+	pClientContext* pc = (pClientContext*)context;
+	WINPR_ASSERT(pc);
+
+	proxyData* pdata = pc->pdata;
+	WINPR_ASSERT(pdata);
+
+	pServerContext* ps = proxy_data_get_server_context(pdata);
+	WINPR_ASSERT(ps);
+
+	if (pc->passthrough_state != PF_PASSTHROUGH_ACTIVE)
+		return TRUE;
+
+	if (pc->passthrough_fragment)
+	{
+		PROXY_LOG_ERR(TAG, pc,
+		              "compressed slow-path PDU 0x%02" PRIx8 " inside a forwarded fragment",
+		              pduType2);
+		return FALSE;
+	}
+
+	/* The client never sees this PDU compressed, the target history diverges from here on */
+	return pf_update_passthrough_fallback(pc, ps);
+}
+
+BOOL pf_update_passthrough_arm(proxyData* pdata)
+{
+	WINPR_ASSERT(pdata);
+	WINPR_ASSERT(pdata->config);
+
+	if (!pdata->config->CompressedPassthrough)
+		return TRUE;
+
+	pClientContext* pc = proxy_data_get_client_context(pdata);
+	pServerContext* ps = proxy_data_get_server_context(pdata);
+	if (!pc || !ps || !pc->connected)
+		return TRUE;
+
+	/* (Re)activation: the client starts over, wait for the target to do the same */
+	pc->passthrough_fragment = FALSE;
+	pc->passthrough_state = PF_PASSTHROUGH_OFF;
+	if (!freerdp_update_set_compression_passthrough(&ps->context, FALSE))
+		return FALSE;
+
+	if (!pf_update_passthrough_compatible(ps->context.settings, pc->cctx.context.settings))
+	{
+		PROXY_LOG_INFO(TAG, pc, "capabilities differ, graphics passthrough disabled");
+		return TRUE;
+	}
+
+	pc->passthrough_state = PF_PASSTHROUGH_ARMED;
+	return TRUE;
+}
+
 void pf_server_register_update_callbacks(rdpUpdate* update)
 {
 	WINPR_ASSERT(update);
@@ -700,4 +936,14 @@ void pf_client_register_update_callbacks(rdpUpdate* update)
 	update->pointer->PointerLarge = pf_client_send_pointer_large;
 	update->pointer->PointerNew = pf_client_send_pointer_new;
 	update->pointer->PointerCached = pf_client_send_pointer_cached;
+
+	pClientContext* pc = (pClientContext*)update->context;
+	WINPR_ASSERT(pc);
+	WINPR_ASSERT(pc->pdata);
+	WINPR_ASSERT(pc->pdata->config);
+	if (pc->pdata->config->CompressedPassthrough)
+	{
+		update->FastPathUpdateRaw = pf_client_fastpath_update_raw;
+		update->SlowPathCompressed = pf_client_slowpath_compressed;
+	}
 }
@@ -31,4 +31,12 @@
 void pf_server_register_update_callbacks(rdpUpdate* update);
 void pf_client_register_update_callbacks(rdpUpdate* update);
 
+/**
+ * @brief Re-evaluate compressed passthrough after the client was (re)activated.
+ *
+ * @param pdata The proxy session. Must not be nullptr.
+ * @return \b TRUE for success, \b FALSE otherwise
+ */
+WINPR_ATTR_NODISCARD BOOL pf_update_passthrough_arm(proxyData* pdata);
+
 #endif /* FREERDP_SERVER_PROXY_PFUPDATE_H */
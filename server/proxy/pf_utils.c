@@ -22,6 +22,8 @@
 #include <winpr/string.h>
 #include <winpr/wtsapi.h>
 
+#include <freerdp/channels/rdpgfx.h>
+
 #include <freerdp/server/proxy/proxy_log.h>
 #include "pf_utils.h"
 
@@ -64,6 +66,9 @@ pf_utils_channel_mode pf_utils_get_channel_mode(const proxyConfig* config, const
 	}
 	else if (config->PassthroughIsBlacklist)
 		rc = PF_UTILS_CHANNEL_PASSTHROUGH;
+	else if (config->CompressedPassthrough && config->GFX &&
+	         (strcmp(name, RDPGFX_DVC_CHANNEL_NAME) == 0))
+		rc = PF_UTILS_CHANNEL_PASSTHROUGH; /* forward ZGFX compressed data as is */
 
 end:
 	WLog_DBG(TAG, "%s -> %s", name, pf_utils_channel_mode_string(rc));
@@ -42,6 +42,8 @@ typedef enum
 	FILTER_TYPE_STATIC_INTERCEPT_LIST, /* proxyChannelToInterceptData */
 	FILTER_TYPE_DYN_INTERCEPT_LIST,    /* proxyChannelToInterceptData */
 	FILTER_TYPE_INTERCEPT_CHANNEL,     /* proxyDynChannelInterceptData */
+
+	FILTER_TYPE_CLIENT_PASSTHROUGH_FASTPATH_UPDATE, /* proxyFastPathUpdateInfo */
 	FILTER_LAST
 } PF_FILTER_TYPE;
 
@@ -111,6 +111,10 @@ int main(int argc, char** argv)
 		  "Allow GFX AVC444 codec" },
 		{ "bitmap-compat", COMMAND_LINE_VALUE_BOOL, nullptr, BoolValueFalse, nullptr, -1, nullptr,
 		  "Limit BitmapUpdate to 1 rectangle (fixes broken windows 11 24H2 clients)" },
+		{ "metrics-file", COMMAND_LINE_VALUE_REQUIRED, "<file>", nullptr, nullptr, -1, nullptr,
+		  "Periodically write connection metrics in OpenMetrics text format to <file>" },
+		{ "metrics-interval", COMMAND_LINE_VALUE_REQUIRED, "<seconds>", "10", nullptr, -1, nullptr,
+		  "Interval for /metrics-file updates" },
 		{ "version", COMMAND_LINE_VALUE_FLAG | COMMAND_LINE_PRINT_VERSION, nullptr, nullptr,
 		  nullptr, -1, nullptr, "Print version" },
 		{ "buildconfig", COMMAND_LINE_VALUE_FLAG | COMMAND_LINE_PRINT_BUILDCONFIG, nullptr, nullptr,
@@ -38,6 +38,9 @@
 
 #define TAG CLIENT_TAG("shadow")
 
+/* Damage made of at least this many rectangles is merged on a tile grid */
+#define SHADOW_CLIENT_TILED_DAMAGE_RECTS 128
+
 typedef struct
 {
 	BOOL gfxOpened;
@@ -247,13 +250,31 @@ static void shadow_client_context_free(freerdp_peer* peer, rdpContext* context)
 	MessageQueue_Free(client->MsgQueue);
 	WTSCloseServer(client->vcm);
 	region16_uninit(&(client->invalidRegion));
+	region16_scratch_free(client->regionScratch);
 	DeleteCriticalSection(&(client->lock));
 
+	client->regionScratch = nullptr;
 	client->MsgQueue = nullptr;
 	client->encoder = nullptr;
 	client->vcm = nullptr;
 }
 
+WINPR_ATTR_NODISCARD
+static BOOL shadow_client_rtt_measure_response(rdpAutoDetect* autodetect,
+                                               WINPR_ATTR_UNUSED RDP_TRANSPORT_TYPE transport,
+                                               WINPR_ATTR_UNUSED UINT16 sequenceNumber)
+{
+	WINPR_ASSERT(autodetect);
+
+	rdpShadowClient* client = (rdpShadowClient*)autodetect->context;
+	WINPR_ASSERT(client);
+
+	/* Feeds the rate control, see shadow_encoder_create_frame_id */
+	if (client->encoder)
+		shadow_encoder_rtt_sample(client->encoder, 1000000ULL * autodetect->netCharAverageRTT);
+	return TRUE;
+}
+
 WINPR_ATTR_NODISCARD
 static BOOL shadow_client_context_new(freerdp_peer* peer, rdpContext* context)
 {
@@ -335,6 +356,10 @@ static BOOL shadow_client_context_new(freerdp_peer* peer, rdpContext* context)
 		goto fail;
 
 	region16_init(&(client->invalidRegion));
+	client->regionScratch = region16_scratch_new();
+	if (!client->regionScratch)
+		goto fail;
+
 	client->vcm = WTSOpenServerA((LPSTR)peer->context);
 
 	if (!client->vcm || client->vcm == INVALID_HANDLE_VALUE)
@@ -346,6 +371,9 @@ static BOOL shadow_client_context_new(freerdp_peer* peer, rdpContext* context)
 	if (!(client->encoder = shadow_encoder_new(client)))
 		goto fail;
 
+	WINPR_ASSERT(context->autodetect);
+	context->autodetect->RTTMeasureResponse = shadow_client_rtt_measure_response;
+
 	if (!ArrayList_Append(server->clients, (void*)client))
 		goto fail;
 
@@ -367,15 +395,19 @@ static inline void shadow_client_mark_invalid(rdpShadowClient* client, UINT32 nu
 
 	EnterCriticalSection(&(client->lock));
 
-	/* Mark client invalid region. No rectangle means full screen */
-	if (numRects > 0)
+	/* Mark client invalid region. No rectangle means full screen.
+	 * Dense damage is rounded up to tiles, the encoder works on 64x64 tiles anyway. */
+	if (numRects >= SHADOW_CLIENT_TILED_DAMAGE_RECTS)
 	{
-		for (UINT32 index = 0; index < numRects; index++)
-		{
-			if (!region16_union_rect(&(client->invalidRegion), &(client->invalidRegion),
-			                         &rects[index]))
-				goto fail;
-		}
+		if (!region16_union_rects_tiled(&(client->invalidRegion), &(client->invalidRegion), rects,
+		                                numRects, 64, client->regionScratch))
+			goto fail;
+	}
+	else if (numRects > 0)
+	{
+		if (!region16_union_rects(&(client->invalidRegion), &(client->invalidRegion), rects,
+		                          numRects, client->regionScratch))
+			goto fail;
 	}
 	else
 	{
@@ -824,20 +856,26 @@ static inline void shadow_client_common_frame_acknowledge(rdpShadowClient* clien
 	 */
 	WINPR_ASSERT(client);
 	WINPR_ASSERT(client->encoder);
-	client->encoder->lastAckframeId = frameId;
+
+	const UINT64 sent = shadow_encoder_frame_time(client->encoder, frameId);
+	if (sent > 0)
+		freerdp_metrics_record_since(client->context.metrics, FREERDP_METRIC_FRAME_ACK_TIME, 0,
+		                             sent);
+
+	shadow_encoder_frame_acknowledged(client->encoder, frameId);
 }
 
 WINPR_ATTR_NODISCARD
 static BOOL shadow_client_surface_frame_acknowledge(rdpContext* context, UINT32 frameId)
 {
 	rdpShadowClient* client = (rdpShadowClient*)context;
-	shadow_client_common_frame_acknowledge(client, frameId);
 	/*
 	 * Reset queueDepth for legacy none RDPGFX acknowledge
 	 */
 	WINPR_ASSERT(client);
 	WINPR_ASSERT(client->encoder);
 	client->encoder->queueDepth = QUEUE_DEPTH_UNAVAILABLE;
+	shadow_client_common_frame_acknowledge(client, frameId);
 	return TRUE;
 }
 
@@ -852,14 +890,39 @@ shadow_client_rdpgfx_frame_acknowledge(RdpgfxServerContext* context,
 	WINPR_ASSERT(frameAcknowledge);
 
 	client = (rdpShadowClient*)context->custom;
-	shadow_client_common_frame_acknowledge(client, frameAcknowledge->frameId);
-
 	WINPR_ASSERT(client);
 	WINPR_ASSERT(client->encoder);
 	client->encoder->queueDepth = frameAcknowledge->queueDepth;
+	shadow_client_common_frame_acknowledge(client, frameAcknowledge->frameId);
+
+	if ((frameAcknowledge->queueDepth != QUEUE_DEPTH_UNAVAILABLE) &&
+	    (frameAcknowledge->queueDepth != SUSPEND_FRAME_ACKNOWLEDGEMENT))
+		freerdp_metrics_record(client->context.metrics, FREERDP_METRIC_FRAME_QUEUE_DEPTH, 0,
+		                       frameAcknowledge->queueDepth);
 	return CHANNEL_RC_OK;
 }
 
+/* Measure the round trip time about once per second while frames are sent */
+static void shadow_client_request_rtt(rdpShadowClient* client)
+{
+	UINT16 sequenceNumber = 0;
+
+	WINPR_ASSERT(client);
+
+	rdpAutoDetect* autodetect = client->context.autodetect;
+	if (!autodetect || !autodetect->RTTMeasureRequest)
+		return;
+
+	if (!freerdp_settings_get_bool(client->context.settings, FreeRDP_NetworkAutoDetect))
+		return;
+
+	if (!shadow_encoder_rtt_request_due(client->encoder, &sequenceNumber))
+		return;
+
+	if (!autodetect->RTTMeasureRequest(autodetect, RDP_TRANSPORT_TCP, sequenceNumber))
+		WLog_WARN(TAG, "Failed to send RTT measure request");
+}
+
 WINPR_ATTR_NODISCARD
 static BOOL shadow_are_caps_filtered(const rdpSettings* settings, UINT32 caps)
 {
@@ -1235,6 +1298,33 @@ static inline UINT32 rdpgfx_estimate_h264_avc420(RDPGFX_AVC420_BITMAP_STREAM* ha
 	       havc420->length;
 }
 
+/**
+ * Send an encoded surface command and account the time spent encoding it.
+ *
+ * @return 0 on success, otherwise a Win32 error code
+ */
+WINPR_ATTR_NODISCARD
+static UINT shadow_client_submit_gfx(rdpShadowClient* client, const RDPGFX_SURFACE_COMMAND* cmd,
+                                     const RDPGFX_START_FRAME_PDU* cmdstart,
+                                     const RDPGFX_END_FRAME_PDU* cmdend, UINT64 bytes)
+{
+	UINT error = CHANNEL_RC_OK;
+
+	WINPR_ASSERT(client);
+	WINPR_ASSERT(client->encoder);
+	WINPR_ASSERT(cmd);
+
+	rdpMetrics* metrics = client->context.metrics;
+	freerdp_metrics_record_since(metrics, FREERDP_METRIC_CODEC_ENCODE_TIME, cmd->codecId,
+	                             client->encoder->encodeStart);
+	freerdp_metrics_add(metrics, FREERDP_METRIC_CODEC_ENCODE_BYTES, cmd->codecId, bytes);
+	if (cmdstart)
+		shadow_encoder_add_frame_bytes(client->encoder, cmdstart->frameId, bytes);
+
+	IFCALLRET(client->rdpgfx->SurfaceFrameCommand, error, client->rdpgfx, cmd, cmdstart, cmdend);
+	return error;
+}
+
 #if defined(WITH_GFX_AV1)
 WINPR_ATTR_NODISCARD
 static BOOL shadow_client_send_av1(rdpShadowClient* client, const BYTE* pSrcData, UINT32 nSrcStep,
@@ -1285,8 +1375,7 @@ static BOOL shadow_client_send_av1(rdpShadowClient* client, const BYTE* pSrcData
 		cmd->codecId = RDPGFX_CODECID_AV1;
 		cmd->extra = (void*)&avc420;
 
-		IFCALLRET(client->rdpgfx->SurfaceFrameCommand, error, client->rdpgfx, cmd, cmdstart,
-		          cmdend);
+		error = shadow_client_submit_gfx(client, cmd, cmdstart, cmdend, avc420.length);
 		cmd->extra = nullptr;
 	}
 	free_h264_metablock(&avc420.meta);
@@ -1349,8 +1438,9 @@ static BOOL shadow_client_send_avc444(rdpShadowClient* client, const BYTE* pSrcD
 	{
 		avc444.cbAvc420EncodedBitstream1 = rdpgfx_estimate_h264_avc420(&avc444.bitstream[0]);
 		cmd->extra = (void*)&avc444;
-		IFCALLRET(client->rdpgfx->SurfaceFrameCommand, error, client->rdpgfx, cmd, cmdstart,
-		          cmdend);
+		error = shadow_client_submit_gfx(client, cmd, cmdstart, cmdend,
+		                                 1ull * avc444.bitstream[0].length +
+		                                     avc444.bitstream[1].length);
 		cmd->extra = nullptr;
 	}
 
@@ -1408,8 +1498,7 @@ static BOOL shadow_client_send_avc420(rdpShadowClient* client, const BYTE* pSrcD
 	{
 		cmd->codecId = RDPGFX_CODECID_AVC420;
 		cmd->extra = (void*)&avc420;
-		IFCALLRET(client->rdpgfx->SurfaceFrameCommand, error, client->rdpgfx, cmd, cmdstart,
-		          cmdend);
+		error = shadow_client_submit_gfx(client, cmd, cmdstart, cmdend, avc420.length);
 		cmd->extra = nullptr;
 	}
 	free_h264_metablock(&avc420.meta);
@@ -1483,8 +1572,7 @@ static BOOL shadow_client_send_rfx(rdpShadowClient* client, const BYTE* pSrcData
 		cmd->data = Stream_Buffer(s);
 		cmd->length = (UINT32)pos;
 
-		IFCALLRET(client->rdpgfx->SurfaceFrameCommand, error, client->rdpgfx, cmd, cmdstart,
-		          cmdend);
+		error = shadow_client_submit_gfx(client, cmd, cmdstart, cmdend, cmd->length);
 		cmd->data = nullptr;
 	}
 
@@ -1548,8 +1636,7 @@ static BOOL shadow_client_send_progressive(rdpShadowClient* client, const BYTE*
 	{
 		cmd->codecId = RDPGFX_CODECID_CAPROGRESSIVE;
 
-		IFCALLRET(client->rdpgfx->SurfaceFrameCommand, error, client->rdpgfx, cmd, cmdstart,
-		          cmdend);
+		error = shadow_client_submit_gfx(client, cmd, cmdstart, cmdend, cmd->length);
 	}
 	cmd->data = nullptr;
 
@@ -1596,7 +1683,7 @@ static BOOL shadow_client_send_planar(rdpShadowClient* client, const BYTE* pSrcD
 
 	cmd->codecId = RDPGFX_CODECID_PLANAR;
 
-	IFCALLRET(client->rdpgfx->SurfaceFrameCommand, error, client->rdpgfx, cmd, cmdstart, cmdend);
+	error = shadow_client_submit_gfx(client, cmd, cmdstart, cmdend, cmd->length);
 	free(cmd->data);
 	cmd->data = nullptr;
 
@@ -1638,7 +1725,7 @@ static BOOL shadow_client_send_uncompressed(rdpShadowClient* client, const BYTE*
 	cmd->length = length;
 	cmd->codecId = RDPGFX_CODECID_UNCOMPRESSED;
 
-	IFCALLRET(client->rdpgfx->SurfaceFrameCommand, error, client->rdpgfx, cmd, cmdstart, cmdend);
+	error = shadow_client_submit_gfx(client, cmd, cmdstart, cmdend, cmd->length);
 	free(data);
 	cmd->data = nullptr;
 	if (error)
@@ -1721,6 +1808,7 @@ static BOOL shadow_client_send_surface_gfx(rdpShadowClient* client, const BYTE*
 	}
 
 	cmdstart.frameId = shadow_encoder_create_frame_id(encoder);
+	encoder->encodeStart = winpr_GetTickCount64NS();
 	GetSystemTime(&sTime);
 	cmdstart.timestamp = (UINT32)(sTime.wHour << 22U | sTime.wMinute << 16U | sTime.wSecond << 10U |
 	                              sTime.wMilliseconds);
@@ -1936,6 +2024,7 @@ static BOOL shadow_client_send_surface_bits(rdpShadowClient* client, BYTE* pSrcD
 				WLog_ERR(TAG, "Send surface bits(RemoteFxCodec) failed");
 				break;
 			}
+			shadow_encoder_add_frame_bytes(encoder, frameId, cmd.bmp.bitmapDataLength);
 		}
 
 		rfx_message_list_free(messages);
@@ -1980,6 +2069,10 @@ static BOOL shadow_client_send_surface_bits(rdpShadowClient* client, BYTE* pSrcD
 		{
 			WLog_ERR(TAG, "Send surface bits(NSCodec) failed");
 		}
+		else
+		{
+			shadow_encoder_add_frame_bytes(encoder, frameId, cmd.bmp.bitmapDataLength);
+		}
 	}
 
 	return ret;
@@ -2206,9 +2299,11 @@ out:
  * @return TRUE on success (or nothing need to be updated)
  */
 WINPR_ATTR_NODISCARD
-static BOOL shadow_client_send_surface_update(rdpShadowClient* client, SHADOW_GFX_STATUS* pStatus)
+static BOOL shadow_client_send_surface_update(rdpShadowClient* client, SHADOW_GFX_STATUS* pStatus,
+                                              void* subscriber)
 {
 	BOOL ret = TRUE;
+	BOOL locked = FALSE;
 	INT64 nXSrc = 0;
 	INT64 nYSrc = 0;
 	INT64 nWidth = 0;
@@ -2220,29 +2315,31 @@ static BOOL shadow_client_send_surface_update(rdpShadowClient* client, SHADOW_GF
 	REGION16 invalidRegion;
 	RECTANGLE_16 surfaceRect;
 	const RECTANGLE_16* extents = nullptr;
+	BYTE* snapshot = nullptr;
 	BYTE* pSrcData = nullptr;
 	UINT32 nSrcStep = 0;
 	UINT32 SrcFormat = 0;
 	UINT32 numRects = 0;
 	const RECTANGLE_16* rects = nullptr;
 
+	region16_init(&invalidRegion);
+
 	if (!context || !pStatus)
-		return FALSE;
+		goto fail;
 
 	settings = context->settings;
 	server = client->server;
 
 	if (!settings || !server)
-		return FALSE;
+		goto fail;
 
 	surface = client->inLobby ? server->lobby : server->surface;
 
 	if (!surface)
-		return FALSE;
+		goto fail;
 
 	{
 		EnterCriticalSection(&(client->lock));
-		region16_init(&invalidRegion);
 
 		const BOOL res = region16_copy(&invalidRegion, &(client->invalidRegion));
 		region16_clear(&(client->invalidRegion));
@@ -2252,11 +2349,16 @@ static BOOL shadow_client_send_surface_update(rdpShadowClient* client, SHADOW_GF
 	}
 
 	EnterCriticalSection(&surface->lock);
+	locked = TRUE;
 	rects = region16_rects(&(surface->invalidRegion), &numRects);
 
-	for (UINT32 index = 0; index < numRects; index++)
 	{
-		if (!region16_union_rect(&invalidRegion, &invalidRegion, &rects[index]))
+		/* lock order is surface->lock, then client->lock */
+		EnterCriticalSection(&(client->lock));
+		const BOOL res = region16_union_rects(&invalidRegion, &invalidRegion, rects, numRects,
+		                                      client->regionScratch);
+		LeaveCriticalSection(&(client->lock));
+		if (!res)
 			goto out;
 	}
 
@@ -2281,14 +2383,28 @@ static BOOL shadow_client_send_surface_update(rdpShadowClient* client, SHADOW_GF
 		goto out;
 	}
 
+	/*
+	 * Encode from a copy of the surface shared by the clients of this frame. The update is
+	 * consumed once the copy was taken, so the subsystem captures the next frame while this one
+	 * is encoded and sent. Without a copy encode from the surface while holding it.
+	 */
+	snapshot = shadow_surface_snapshot_acquire(surface, shadow_multiclient_get_frame(subscriber));
+	pSrcData = snapshot ? snapshot : surface->data;
+	nSrcStep = surface->scanline;
+	SrcFormat = surface->format;
+	if (snapshot)
+	{
+		LeaveCriticalSection(&surface->lock);
+		locked = FALSE;
+		(void)shadow_multiclient_consume(subscriber);
+		subscriber = nullptr;
+	}
+
 	extents = region16_extents(&invalidRegion);
 	nXSrc = extents->left;
 	nYSrc = extents->top;
 	nWidth = extents->right - extents->left;
 	nHeight = extents->bottom - extents->top;
-	pSrcData = surface->data;
-	nSrcStep = surface->scanline;
-	SrcFormat = surface->format;
 
 	/* Move to new pSrcData / nXSrc / nYSrc according to sub rect */
 	if (server->shareSubRect)
@@ -2370,8 +2486,16 @@ static BOOL shadow_client_send_surface_update(rdpShadowClient* client, SHADOW_GF
 		                                       (UINT16)nYSrc, (UINT16)nWidth, (UINT16)nHeight);
 	}
 
+	goto out;
+fail:
+	ret = FALSE;
 out:
-	LeaveCriticalSection(&surface->lock);
+	if (locked)
+		LeaveCriticalSection(&surface->lock);
+	if (snapshot)
+		shadow_surface_snapshot_release(surface, snapshot);
+	if (subscriber)
+		(void)shadow_multiclient_consume(subscriber);
 	region16_uninit(&invalidRegion);
 	return ret;
 }
@@ -2721,6 +2845,8 @@ static DWORD WINAPI shadow_client_thread(LPVOID arg)
 			 * (at shadow_multiclient_consume). As best practice, subsystem
 			 * implementation should invoke shadow_subsystem_frame_update which
 			 * triggers the event and then wait for completion */
+			BOOL consumed = FALSE;
+
 			if (client->activated && !client->suppressOutput)
 			{
 				/* Send screen update or resize to this client */
@@ -2737,12 +2863,16 @@ static DWORD WINAPI shadow_client_thread(LPVOID arg)
 				}
 				else
 				{
-					/* Send frame */
-					if (!shadow_client_send_surface_update(client, &gfxstatus))
+					/* Send frame, the update is consumed as soon as the surface was copied */
+					const BOOL sent =
+					    shadow_client_send_surface_update(client, &gfxstatus, UpdateSubscriber);
+					consumed = TRUE;
+					if (!sent)
 					{
 						WLog_ERR(TAG, "Failed to send surface update");
 						break;
 					}
+					shadow_client_request_rtt(client);
 				}
 			}
 			else
@@ -2759,7 +2889,8 @@ static DWORD WINAPI shadow_client_thread(LPVOID arg)
 			 * The return value of shadow_multiclient_consume is whether or not
 			 * the subscriber really consumes the event. It's not cared currently.
 			 */
-			(void)shadow_multiclient_consume(UpdateSubscriber);
+			if (!consumed)
+				(void)shadow_multiclient_consume(UpdateSubscriber);
 		}
 
 		WINPR_ASSERT(peer->CheckFileDescriptor);
@@ -19,6 +19,7 @@
 #include <freerdp/config.h>
 
 #include <winpr/assert.h>
+#include <winpr/sysinfo.h>
 
 #include "shadow.h"
 
@@ -49,35 +50,246 @@ UINT32 shadow_encoder_inflight_frames(rdpShadowEncoder* encoder)
 	           : encoder->frameId - encoder->lastAckframeId;
 }
 
+/* Acknowledge delay tolerated on top of the round trip time before backing off */
+#define SHADOW_ENCODER_LATENCY_BUDGET (100ULL * 1000ULL * 1000ULL)
+/* Minimum time between two quality level increments while the link is healthy */
+#define SHADOW_ENCODER_RECOVERY_INTERVAL (1000ULL * 1000ULL * 1000ULL)
+#define SHADOW_ENCODER_RTT_INTERVAL (1000ULL * 1000ULL * 1000ULL)
+
+/* RemoteFX default quantization, raised by the quality level */
+static const UINT32 shadow_encoder_default_quants[] = { 6, 6, 6, 6, 7, 7, 8, 8, 8, 9 };
+
+static UINT64 shadow_encoder_smooth(UINT64 average, UINT64 sample, unsigned shift)
+{
+	if (average == 0)
+		return sample;
+	return average - (average >> shift) + (sample >> shift);
+}
+
+static void shadow_encoder_update_targets(rdpShadowEncoder* encoder, BOOL congested)
+{
+	WINPR_ASSERT(encoder);
+	WINPR_ASSERT(encoder->server);
+
+	const UINT64 level = encoder->qualityLevel;
+	const UINT64 configured = encoder->server->h264BitRate;
+	UINT64 bitRate = configured * (SHADOW_ENCODER_MAX_QUALITY_LEVEL + 2 - level) /
+	                 (SHADOW_ENCODER_MAX_QUALITY_LEVEL + 2);
+
+	/* While congested do not send faster than the client acknowledged recently */
+	if (congested && (encoder->deliveryRate > 0))
+		bitRate = MIN(bitRate, encoder->deliveryRate * 8ULL * 4ULL / 5ULL);
+	bitRate = MAX(bitRate, configured / 8);
+
+	const UINT32 qp = (UINT32)MIN(encoder->server->h264QP + 3ULL * level, 51ULL);
+
+	if ((bitRate != encoder->bitRate) || (qp != encoder->qp))
+		encoder->rateChanged = TRUE;
+	encoder->bitRate = (UINT32)bitRate;
+	encoder->qp = qp;
+}
+
+static void shadow_encoder_reset_rate(rdpShadowEncoder* encoder)
+{
+	WINPR_ASSERT(encoder);
+
+	encoder->fps = 16;
+	encoder->maxFps = 32;
+	encoder->rtt = 0;
+	encoder->ackDelay = 0;
+	encoder->deliveryRate = 0;
+	encoder->lastAckTime = 0;
+	encoder->lastRateChange = 0;
+	encoder->qualityLevel = 0;
+	encoder->rttRequestTime = 0;
+	shadow_encoder_update_targets(encoder, FALSE);
+	encoder->rateChanged = TRUE;
+}
+
+static BOOL shadow_encoder_apply_rate(rdpShadowEncoder* encoder)
+{
+	BOOL rc = TRUE;
+	UINT32 quants[ARRAYSIZE(shadow_encoder_default_quants)] = WINPR_C_ARRAY_INIT;
+
+	WINPR_ASSERT(encoder);
+
+	for (size_t i = 0; i < ARRAYSIZE(quants); i++)
+		quants[i] = MIN(shadow_encoder_default_quants[i] + encoder->qualityLevel, 15);
+
+	if (encoder->rfx && !rfx_context_set_quantization(encoder->rfx, quants, ARRAYSIZE(quants)))
+		rc = FALSE;
+
+	if (encoder->progressive &&
+	    !progressive_context_set_quantization(encoder->progressive, quants, ARRAYSIZE(quants)))
+		rc = FALSE;
+
+	if (encoder->h264)
+	{
+		if (!h264_context_set_option(encoder->h264, H264_CONTEXT_OPTION_BITRATE,
+		                             encoder->bitRate))
+			rc = FALSE;
+		if (!h264_context_set_option(encoder->h264, H264_CONTEXT_OPTION_QP, encoder->qp))
+			rc = FALSE;
+	}
+
+	return rc;
+}
+
+/*
+ * Adapt frame rate and codec quality to the delay of frame acknowledges.
+ * A delay beyond the round trip time plus SHADOW_ENCODER_LATENCY_BUDGET means frames queue up
+ * somewhere between encoder and client display: back off multiplicatively, at most once per
+ * round trip. Otherwise the frame rate grows additively and the quality slowly recovers.
+ */
+static void shadow_encoder_update_rate(rdpShadowEncoder* encoder, UINT64 now)
+{
+	WINPR_ASSERT(encoder);
+
+	UINT64 delay = encoder->ackDelay;
+
+	/* Acknowledges may stop completely, the oldest unacknowledged frame bounds the delay */
+	if (shadow_encoder_inflight_frames(encoder) > 0)
+	{
+		const UINT64 sent = shadow_encoder_frame_time(encoder, encoder->lastAckframeId + 1);
+		if ((sent > 0) && (now > sent))
+			delay = MAX(delay, now - sent);
+	}
+
+	const BOOL queued = (encoder->queueDepth != QUEUE_DEPTH_UNAVAILABLE) &&
+	                    (encoder->queueDepth != SUSPEND_FRAME_ACKNOWLEDGEMENT) &&
+	                    (encoder->queueDepth > 2);
+	const BOOL congested = queued || (delay > encoder->rtt + SHADOW_ENCODER_LATENCY_BUDGET);
+	const UINT64 sinceChange = now - encoder->lastRateChange;
+
+	if (congested)
+	{
+		if (sinceChange < MAX(encoder->rtt, SHADOW_ENCODER_LATENCY_BUDGET))
+			return;
+
+		encoder->fps = MAX(encoder->fps * 3 / 4, 1);
+		if (encoder->qualityLevel < SHADOW_ENCODER_MAX_QUALITY_LEVEL)
+			encoder->qualityLevel++;
+		encoder->lastRateChange = now;
+		shadow_encoder_update_targets(encoder, TRUE);
+	}
+	else if (delay < encoder->rtt + SHADOW_ENCODER_LATENCY_BUDGET / 2)
+	{
+		encoder->fps = MIN(encoder->fps + 1, encoder->maxFps);
+		if ((encoder->qualityLevel > 0) && (sinceChange >= SHADOW_ENCODER_RECOVERY_INTERVAL))
+		{
+			encoder->qualityLevel--;
+			encoder->lastRateChange = now;
+			shadow_encoder_update_targets(encoder, FALSE);
+		}
+	}
+}
+
 UINT32 shadow_encoder_create_frame_id(rdpShadowEncoder* encoder)
+{
+	return shadow_encoder_create_frame_id_at(encoder, winpr_GetTickCount64NS());
+}
+
+UINT32 shadow_encoder_create_frame_id_at(rdpShadowEncoder* encoder, UINT64 now)
 {
 	UINT32 frameId = 0;
-	UINT32 inFlightFrames = shadow_encoder_inflight_frames(encoder);
 
 	/*
-	 * Calculate preferred fps according to how much frames are
-	 * in-progress. Note that it only works when subsystem implementation
-	 * calls shadow_encoder_preferred_fps and takes the suggestion.
+	 * Calculate preferred fps according to the frame acknowledges. Note that
+	 * it only works when subsystem implementation calls shadow_encoder_preferred_fps
+	 * and takes the suggestion.
 	 */
-	if (inFlightFrames > 1)
-	{
-		encoder->fps = (100 / (inFlightFrames + 1) * encoder->maxFps) / 100;
-	}
+	if (encoder->queueDepth == SUSPEND_FRAME_ACKNOWLEDGEMENT)
+		encoder->fps = MIN(encoder->fps + 2, encoder->maxFps);
 	else
-	{
-		encoder->fps += 2;
+		shadow_encoder_update_rate(encoder, now);
 
-		if (encoder->fps > encoder->maxFps)
-			encoder->fps = encoder->maxFps;
+	if (encoder->rateChanged)
+	{
+		WLog_DBG(TAG,
+		         "rate control: %" PRIu32 " fps, quality level %" PRIu32 ", bit rate %" PRIu32
+		         ", QP %" PRIu32,
+		         encoder->fps, encoder->qualityLevel, encoder->bitRate, encoder->qp);
+		if (!shadow_encoder_apply_rate(encoder))
+			WLog_WARN(TAG, "failed to update codec rate control parameters");
+		encoder->rateChanged = FALSE;
 	}
 
-	if (encoder->fps < 1)
-		encoder->fps = 1;
-
 	frameId = ++encoder->frameId;
+	encoder->frameTimes[frameId % ARRAYSIZE(encoder->frameTimes)] = now;
+	encoder->frameBytes[frameId % ARRAYSIZE(encoder->frameBytes)] = 0;
 	return frameId;
 }
 
+UINT64 shadow_encoder_frame_time(const rdpShadowEncoder* encoder, UINT32 frameId)
+{
+	/* Only the most recent frames are tracked, older acknowledges are ignored */
+	WINPR_ASSERT(encoder);
+	if ((encoder->frameId - frameId) >= ARRAYSIZE(encoder->frameTimes))
+		return 0;
+	return encoder->frameTimes[frameId % ARRAYSIZE(encoder->frameTimes)];
+}
+
+void shadow_encoder_add_frame_bytes(rdpShadowEncoder* encoder, UINT32 frameId, UINT64 bytes)
+{
+	WINPR_ASSERT(encoder);
+	if ((encoder->frameId - frameId) >= ARRAYSIZE(encoder->frameBytes))
+		return;
+	encoder->frameBytes[frameId % ARRAYSIZE(encoder->frameBytes)] += bytes;
+}
+
+void shadow_encoder_frame_acknowledged(rdpShadowEncoder* encoder, UINT32 frameId)
+{
+	shadow_encoder_frame_acknowledged_at(encoder, frameId, winpr_GetTickCount64NS());
+}
+
+void shadow_encoder_frame_acknowledged_at(rdpShadowEncoder* encoder, UINT32 frameId, UINT64 now)
+{
+	WINPR_ASSERT(encoder);
+
+	const UINT64 sent = shadow_encoder_frame_time(encoder, frameId);
+	if ((sent > 0) && (now >= sent))
+		encoder->ackDelay = shadow_encoder_smooth(encoder->ackDelay, now - sent, 3);
+
+	/* An acknowledge covers all frames sent since the previous one */
+	UINT64 bytes = 0;
+	for (UINT32 id = frameId; (id != encoder->lastAckframeId) &&
+	                          ((encoder->frameId - id) < ARRAYSIZE(encoder->frameBytes));
+	     id--)
+		bytes += encoder->frameBytes[id % ARRAYSIZE(encoder->frameBytes)];
+
+	if ((encoder->lastAckTime > 0) && (now > encoder->lastAckTime) && (bytes > 0))
+	{
+		const UINT64 rate = bytes * 1000000000ULL / (now - encoder->lastAckTime);
+		encoder->deliveryRate = shadow_encoder_smooth(encoder->deliveryRate, rate, 2);
+	}
+
+	encoder->lastAckTime = now;
+	encoder->lastAckframeId = frameId;
+
+	if (encoder->queueDepth != SUSPEND_FRAME_ACKNOWLEDGEMENT)
+		shadow_encoder_update_rate(encoder, now);
+}
+
+void shadow_encoder_rtt_sample(rdpShadowEncoder* encoder, UINT64 rtt)
+{
+	WINPR_ASSERT(encoder);
+	encoder->rtt = shadow_encoder_smooth(encoder->rtt, rtt, 3);
+}
+
+BOOL shadow_encoder_rtt_request_due(rdpShadowEncoder* encoder, UINT16* sequenceNumber)
+{
+	WINPR_ASSERT(encoder);
+	WINPR_ASSERT(sequenceNumber);
+
+	const UINT64 now = winpr_GetTickCount64NS();
+	if (now - encoder->rttRequestTime < SHADOW_ENCODER_RTT_INTERVAL)
+		return FALSE;
+
+	encoder->rttRequestTime = now;
+	*sequenceNumber = encoder->rttSequence++;
+	return TRUE;
+}
+
 WINPR_ATTR_NODISCARD
 static int shadow_encoder_init_grid(rdpShadowEncoder* encoder)
 {
@@ -149,6 +361,7 @@ static int shadow_encoder_init_rfx(rdpShadowEncoder* encoder)
 			goto fail;
 	}
 	rfx_context_set_pixel_format(encoder->rfx, PIXEL_FORMAT_BGRX32);
+	encoder->rateChanged = TRUE;
 	encoder->codecs |= FREERDP_CODEC_REMOTEFX;
 	return 1;
 fail:
@@ -259,13 +472,12 @@ static int shadow_encoder_init_h264(rdpShadowEncoder* encoder)
 	if (!h264_context_set_option(encoder->h264, H264_CONTEXT_OPTION_RATECONTROL,
 	                             encoder->server->h264RateControlMode))
 		goto fail;
-	if (!h264_context_set_option(encoder->h264, H264_CONTEXT_OPTION_BITRATE,
-	                             encoder->server->h264BitRate))
+	if (!h264_context_set_option(encoder->h264, H264_CONTEXT_OPTION_BITRATE, encoder->bitRate))
 		goto fail;
 	if (!h264_context_set_option(encoder->h264, H264_CONTEXT_OPTION_FRAMERATE,
 	                             encoder->server->h264FrameRate))
 		goto fail;
-	if (!h264_context_set_option(encoder->h264, H264_CONTEXT_OPTION_QP, encoder->server->h264QP))
+	if (!h264_context_set_option(encoder->h264, H264_CONTEXT_OPTION_QP, encoder->qp))
 		goto fail;
 
 	encoder->codecs |= FREERDP_CODEC_AVC420 | FREERDP_CODEC_AVC444;
@@ -327,6 +539,7 @@ static int shadow_encoder_init_progressive(rdpShadowEncoder* encoder)
 	if (!progressive_context_reset(encoder->progressive))
 		goto fail;
 
+	encoder->rateChanged = TRUE;
 	encoder->codecs |= FREERDP_CODEC_PROGRESSIVE;
 	return 1;
 fail:
@@ -482,15 +695,16 @@ int shadow_encoder_reset(rdpShadowEncoder* encoder)
 	if (status < 0)
 		return -1;
 
+	shadow_encoder_reset_rate(encoder);
 	status = shadow_encoder_prepare(encoder, codecs);
 
 	if (status < 0)
 		return -1;
 
-	encoder->fps = 16;
-	encoder->maxFps = 32;
 	encoder->frameId = 0;
 	encoder->lastAckframeId = 0;
+	memset(encoder->frameTimes, 0, sizeof(encoder->frameTimes));
+	memset(encoder->frameBytes, 0, sizeof(encoder->frameBytes));
 	encoder->frameAck = freerdp_settings_get_bool(settings, FreeRDP_SurfaceFrameMarkerEnabled);
 	return 1;
 }
@@ -581,8 +795,7 @@ rdpShadowEncoder* shadow_encoder_new(rdpShadowClient* client)
 
 	encoder->client = client;
 	encoder->server = server;
-	encoder->fps = 16;
-	encoder->maxFps = 32;
+	shadow_encoder_reset_rate(encoder);
 
 	if (shadow_encoder_init(encoder) < 0)
 	{
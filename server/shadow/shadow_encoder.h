@@ -27,6 +27,9 @@
 
 #include <freerdp/server/shadow.h>
 
+#define SHADOW_ENCODER_FRAME_TIMES 64
+#define SHADOW_ENCODER_MAX_QUALITY_LEVEL 6
+
 struct rdp_shadow_encoder
 {
 	rdpShadowClient* client;
@@ -60,6 +63,23 @@ struct rdp_shadow_encoder
 	UINT32 frameId;
 	UINT32 lastAckframeId;
 	UINT32 queueDepth;
+
+	UINT64 encodeStart;
+	UINT64 frameTimes[SHADOW_ENCODER_FRAME_TIMES]; /* send time of recent frames by frameId */
+	UINT64 frameBytes[SHADOW_ENCODER_FRAME_TIMES]; /* encoded size of recent frames by frameId */
+
+	/* rate control, driven by frame acknowledges and RTT measurements */
+	UINT64 rtt;          /* smoothed round trip time in ns, 0 if unknown */
+	UINT64 ackDelay;     /* smoothed time from sending a frame to its acknowledge in ns */
+	UINT64 deliveryRate; /* smoothed acknowledged bytes per second */
+	UINT64 lastAckTime;
+	UINT64 lastRateChange;
+	UINT32 qualityLevel; /* 0 (configured quality) to SHADOW_ENCODER_MAX_QUALITY_LEVEL */
+	UINT32 bitRate;      /* H.264 target bit rate */
+	UINT32 qp;           /* H.264 quantization parameter */
+	BOOL rateChanged;    /* codec parameters must be updated before the next frame */
+	UINT16 rttSequence;
+	UINT64 rttRequestTime;
 };
 
 #ifdef __cplusplus
@@ -70,6 +90,19 @@ extern "C"
 	WINPR_ATTR_NODISCARD int shadow_encoder_reset(rdpShadowEncoder* encoder);
 	WINPR_ATTR_NODISCARD int shadow_encoder_prepare(rdpShadowEncoder* encoder, UINT32 codecs);
 	WINPR_ATTR_NODISCARD UINT32 shadow_encoder_create_frame_id(rdpShadowEncoder* encoder);
+	WINPR_ATTR_NODISCARD UINT64 shadow_encoder_frame_time(const rdpShadowEncoder* encoder,
+	                                                      UINT32 frameId);
+	void shadow_encoder_add_frame_bytes(rdpShadowEncoder* encoder, UINT32 frameId, UINT64 bytes);
+	void shadow_encoder_frame_acknowledged(rdpShadowEncoder* encoder, UINT32 frameId);
+	void shadow_encoder_rtt_sample(rdpShadowEncoder* encoder, UINT64 rtt);
+
+	/* Variants taking the current time in ns, the rate control only depends on these times */
+	WINPR_ATTR_NODISCARD UINT32 shadow_encoder_create_frame_id_at(rdpShadowEncoder* encoder,
+	                                                              UINT64 now);
+	void shadow_encoder_frame_acknowledged_at(rdpShadowEncoder* encoder, UINT32 frameId,
+	                                          UINT64 now);
+	WINPR_ATTR_NODISCARD BOOL shadow_encoder_rtt_request_due(rdpShadowEncoder* encoder,
+	                                                         UINT16* sequenceNumber);
 
 	void shadow_encoder_free(rdpShadowEncoder* encoder);
 
@@ -33,6 +33,7 @@ struct rdp_shadow_multiclient_event
 	CRITICAL_SECTION lock;
 	int consuming;
 	int waiting;
+	UINT32 frame; /* Number of published events */
 
 	/* For debug */
 	int eventid;
@@ -127,6 +128,7 @@ static void Publish(rdpShadowMultiClientEvent* event)
 	if (event->consuming > 0)
 	{
 		event->eventid = (event->eventid & 0xff) + 1;
+		event->frame++;
 		WLog_VRB(TAG, "Server published event %d. %d clients.\n", event->eventid, event->consuming);
 		(void)ResetEvent(event->doneEvent);
 		(void)SetEvent(event->event);
@@ -339,3 +341,15 @@ HANDLE shadow_multiclient_getevent(void* subscriber)
 
 	return ((struct rdp_shadow_multiclient_subscriber*)subscriber)->ref->event;
 }
+
+UINT32 shadow_multiclient_get_frame(void* subscriber)
+{
+	if (!subscriber)
+		return 0;
+
+	rdpShadowMultiClientEvent* event = ((struct rdp_shadow_multiclient_subscriber*)subscriber)->ref;
+	EnterCriticalSection(&(event->lock));
+	const UINT32 frame = event->frame;
+	LeaveCriticalSection(&(event->lock));
+	return frame;
+}
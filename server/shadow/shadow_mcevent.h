@@ -50,6 +50,9 @@ extern "C"
 	BOOL shadow_multiclient_consume(void* subscriber);
 	WINPR_ATTR_NODISCARD HANDLE shadow_multiclient_getevent(void* subscriber);
 
+	/* The number of the last published event, clients share per frame state with it */
+	WINPR_ATTR_NODISCARD UINT32 shadow_multiclient_get_frame(void* subscriber);
+
 #ifdef __cplusplus
 }
 #endif
@@ -29,6 +29,7 @@
 #include <winpr/path.h>
 #include <winpr/cmdline.h>
 #include <winpr/winsock.h>
+#include <winpr/sysinfo.h>
 
 #include <freerdp/log.h>
 #include <freerdp/version.h>
@@ -293,6 +294,22 @@ int shadow_server_parse_command_line(rdpShadowServer* server, int argc, char** a
 			    !freerdp_settings_set_bool(settings, FreeRDP_HasRelativeMouseEvent, val))
 				return fail_at(arg, COMMAND_LINE_ERROR);
 		}
+		CommandLineSwitchCase(arg, "metrics-file")
+		{
+			free(server->MetricsFile);
+			server->MetricsFile = _strdup(arg->Value);
+			if (!server->MetricsFile)
+				return fail_at(arg, COMMAND_LINE_ERROR);
+		}
+		CommandLineSwitchCase(arg, "metrics-interval")
+		{
+			errno = 0;
+			unsigned long val = strtoul(arg->Value, nullptr, 0);
+
+			if ((errno != 0) || (val == 0) || (val > UINT32_MAX / 1000))
+				return fail_at(arg, COMMAND_LINE_ERROR);
+			server->MetricsInterval = (UINT32)val;
+		}
 		CommandLineSwitchCase(arg, "max-connections")
 		{
 			errno = 0;
@@ -658,6 +675,75 @@ int shadow_server_parse_command_line(rdpShadowServer* server, int argc, char** a
 	return status;
 }
 
+/**
+ * Write the metrics of all connected clients to server->MetricsFile.
+ * The file is replaced atomically so a collector never sees partial content.
+ */
+static void shadow_server_write_metrics(rdpShadowServer* server)
+{
+	BOOL rc = FALSE;
+	char* text = nullptr;
+	char* tmp = nullptr;
+	size_t tmplen = 0;
+	size_t length = 0;
+	const rdpMetrics** metrics = nullptr;
+	char** labels = nullptr;
+
+	WINPR_ASSERT(server);
+	WINPR_ASSERT(server->MetricsFile);
+
+	ArrayList_Lock(server->clients);
+	const size_t count = ArrayList_Count(server->clients);
+	metrics = (const rdpMetrics**)calloc(count + 1, sizeof(rdpMetrics*));
+	labels = (char**)calloc(count + 1, sizeof(char*));
+	if (metrics && labels)
+	{
+		for (size_t x = 0; x < count; x++)
+		{
+			const rdpShadowClient* client = ArrayList_GetItem(server->clients, x);
+			size_t len = 0;
+			metrics[x] = client->context.metrics;
+			(void)winpr_asprintf(&labels[x], &len, "client=\"%" PRIuz "\",address=\"%s\"", x,
+			                     client->context.peer ? client->context.peer->hostname : "");
+		}
+		text = freerdp_metrics_to_openmetrics(metrics, (const char* const*)labels, count, &length);
+	}
+	ArrayList_Unlock(server->clients);
+
+	if (!text)
+		goto fail;
+
+	(void)winpr_asprintf(&tmp, &tmplen, "%s.tmp", server->MetricsFile);
+	if (!tmp)
+		goto fail;
+
+	{
+		FILE* fp = winpr_fopen(tmp, "wb");
+		if (!fp)
+			goto fail;
+
+		const size_t written = fwrite(text, 1, length, fp);
+		(void)fclose(fp);
+		if (written != length)
+			goto fail;
+	}
+
+	rc = winpr_MoveFileEx(tmp, server->MetricsFile, MOVEFILE_REPLACE_EXISTING);
+
+fail:
+	if (!rc)
+		WLog_WARN(TAG, "Failed to write metrics to %s", server->MetricsFile);
+	if (labels)
+	{
+		for (size_t x = 0; x < count; x++)
+			free(labels[x]);
+	}
+	free((void*)labels);
+	free((void*)metrics);
+	free(tmp);
+	free(text);
+}
+
 WINPR_ATTR_NODISCARD
 static DWORD WINAPI shadow_server_thread(LPVOID arg)
 {
@@ -665,6 +751,8 @@ static DWORD WINAPI shadow_server_thread(LPVOID arg)
 	BOOL running = TRUE;
 	DWORD status = 0;
 	freerdp_listener* listener = server->listener;
+	const UINT64 metricsInterval = 1000ull * server->MetricsInterval;
+	UINT64 nextMetrics = GetTickCount64() + metricsInterval;
 	if (shadow_subsystem_start(server->subsystem) < 0)
 		running = FALSE;
 
@@ -681,7 +769,13 @@ static DWORD WINAPI shadow_server_thread(LPVOID arg)
 			break;
 		}
 
-		status = WaitForMultipleObjects(nCount, events, FALSE, INFINITE);
+		DWORD timeout = INFINITE;
+		if (server->MetricsFile)
+		{
+			const UINT64 now = GetTickCount64();
+			timeout = (now < nextMetrics) ? (DWORD)MIN(nextMetrics - now, INFINITE - 1) : 0;
+		}
+		status = WaitForMultipleObjects(nCount, events, FALSE, timeout);
 
 		switch (status)
 		{
@@ -690,6 +784,9 @@ static DWORD WINAPI shadow_server_thread(LPVOID arg)
 				running = FALSE;
 				break;
 
+			case WAIT_TIMEOUT:
+				break;
+
 			default:
 			{
 				if (!listener->CheckFileDescriptor(listener))
@@ -706,6 +803,17 @@ static DWORD WINAPI shadow_server_thread(LPVOID arg)
 			}
 			break;
 		}
+
+		/* a busy listener never times out the wait, so check the interval on every pass */
+		if (running && server->MetricsFile)
+		{
+			const UINT64 now = GetTickCount64();
+			if (now >= nextMetrics)
+			{
+				shadow_server_write_metrics(server);
+				nextMetrics = now + metricsInterval;
+			}
+		}
 	}
 
 	listener->Close(listener);
@@ -1138,6 +1246,7 @@ rdpShadowServer* shadow_server_new(void)
 	server->h264FrameRate = 30;
 	server->h264QP = 0;
 	server->authentication = TRUE;
+	server->MetricsInterval = 10;
 #if defined(WITH_GFX_AV1)
 	server->AV1BitRate = 500;
 	server->AV1RateControlMode = FREERDP_AV1_VBR;
@@ -1153,6 +1262,8 @@ void shadow_server_free(rdpShadowServer* server)
 
 	free(server->ipcSocket);
 	server->ipcSocket = nullptr;
+	free(server->MetricsFile);
+	server->MetricsFile = nullptr;
 	freerdp_settings_free(server->settings);
 	server->settings = nullptr;
 	free(server);
@@ -24,11 +24,36 @@
 #define ALIGN_SCREEN_SIZE(size, align) \
 	((((size) % (align)) != 0) ? ((size) + (align) - ((size) % (align))) : (size))
 
+/* Clients encode from a copy of the surface that is shared by all clients of a frame. The
+ * subsystem waits for every client to take a frame before capturing the next one, so besides
+ * the current copy only the one of the previous frame can still be in use. */
+#define SHADOW_SURFACE_SNAPSHOTS 2
+
+typedef struct
+{
+	BYTE* data;
+	size_t size;
+	UINT32 width;
+	UINT32 height;
+	UINT32 scanline;
+	UINT32 format;
+	UINT32 frame;
+	size_t users;
+} rdpShadowSnapshot;
+
+typedef struct
+{
+	rdpShadowSurface common;
+
+	rdpShadowSnapshot snapshots[SHADOW_SURFACE_SNAPSHOTS];
+	rdpShadowSnapshot* current;
+} rdpShadowSurfaceEx;
+
 rdpShadowSurface* shadow_surface_new(rdpShadowServer* server, UINT16 x, UINT16 y, UINT32 width,
                                      UINT32 height)
 {
 	rdpShadowSurface* surface = nullptr;
-	surface = (rdpShadowSurface*)calloc(1, sizeof(rdpShadowSurface));
+	surface = (rdpShadowSurface*)calloc(1, sizeof(rdpShadowSurfaceEx));
 
 	if (!surface)
 		return nullptr;
@@ -64,6 +89,10 @@ void shadow_surface_free(rdpShadowSurface* surface)
 	if (!surface)
 		return;
 
+	rdpShadowSurfaceEx* ex = (rdpShadowSurfaceEx*)surface;
+	for (size_t x = 0; x < ARRAYSIZE(ex->snapshots); x++)
+		winpr_aligned_free(ex->snapshots[x].data);
+
 	free(surface->data);
 	DeleteCriticalSection(&(surface->lock));
 	region16_uninit(&(surface->invalidRegion));
@@ -102,3 +131,123 @@ BOOL shadow_surface_resize(rdpShadowSurface* surface, UINT16 x, UINT16 y, UINT32
 
 	return FALSE;
 }
+
+static BOOL shadow_surface_snapshot_matches(const rdpShadowSnapshot* snapshot,
+                                            const rdpShadowSurface* surface)
+{
+	return (snapshot->width == surface->width) && (snapshot->height == surface->height) &&
+	       (snapshot->scanline == surface->scanline) && (snapshot->format == surface->format);
+}
+
+static BOOL shadow_surface_snapshot_update(rdpShadowSnapshot* snapshot,
+                                           const rdpShadowSurface* surface, BOOL full)
+{
+	if (full)
+	{
+		const size_t size = 1ull * surface->scanline * surface->height;
+		if (snapshot->size < size)
+		{
+			winpr_aligned_free(snapshot->data);
+			snapshot->size = 0;
+			snapshot->data = winpr_aligned_malloc(size, 32);
+			if (!snapshot->data)
+				return FALSE;
+			snapshot->size = size;
+		}
+
+		CopyMemory(snapshot->data, surface->data, size);
+		snapshot->width = surface->width;
+		snapshot->height = surface->height;
+		snapshot->scanline = surface->scanline;
+		snapshot->format = surface->format;
+		return TRUE;
+	}
+
+	/* everything the subsystem changed since the previous frame */
+	UINT32 numRects = 0;
+	const RECTANGLE_16* rects = region16_rects(&surface->invalidRegion, &numRects);
+	for (UINT32 x = 0; x < numRects; x++)
+	{
+		const UINT32 right = MIN(rects[x].right, surface->width);
+		const UINT32 bottom = MIN(rects[x].bottom, surface->height);
+		if ((rects[x].left >= right) || (rects[x].top >= bottom))
+			continue;
+
+		if (!freerdp_image_copy_no_overlap(snapshot->data, snapshot->format, snapshot->scanline,
+		                                   rects[x].left, rects[x].top, right - rects[x].left,
+		                                   bottom - rects[x].top, surface->data, surface->format,
+		                                   surface->scanline, rects[x].left, rects[x].top,
+		                                   nullptr, FREERDP_FLIP_NONE))
+			return FALSE;
+	}
+	return TRUE;
+}
+
+BYTE* shadow_surface_snapshot_acquire(rdpShadowSurface* surface, UINT32 frame)
+{
+	WINPR_ASSERT(surface);
+
+	/* Called with the surface locked */
+	rdpShadowSurfaceEx* ex = (rdpShadowSurfaceEx*)surface;
+	rdpShadowSnapshot* current = ex->current;
+	const BOOL matches = current && shadow_surface_snapshot_matches(current, surface);
+
+	if (matches && (current->frame == frame))
+	{
+		current->users++;
+		return current->data;
+	}
+
+	/* A new frame, refresh the current copy if no client encodes from it any more */
+	rdpShadowSnapshot* snapshot = nullptr;
+	BOOL full = TRUE;
+	if (current && (current->users == 0))
+	{
+		snapshot = current;
+		full = !matches || (current->frame + 1 != frame);
+	}
+	else
+	{
+		for (size_t x = 0; x < ARRAYSIZE(ex->snapshots); x++)
+		{
+			if ((&ex->snapshots[x] != current) && (ex->snapshots[x].users == 0))
+			{
+				snapshot = &ex->snapshots[x];
+				break;
+			}
+		}
+	}
+
+	if (!snapshot)
+		return nullptr;
+
+	ex->current = nullptr;
+	if (!shadow_surface_snapshot_update(snapshot, surface, full))
+		return nullptr;
+
+	snapshot->frame = frame;
+	snapshot->users = 1;
+	ex->current = snapshot;
+	return snapshot->data;
+}
+
+void shadow_surface_snapshot_release(rdpShadowSurface* surface, const BYTE* data)
+{
+	WINPR_ASSERT(surface);
+
+	if (!data)
+		return;
+
+	rdpShadowSurfaceEx* ex = (rdpShadowSurfaceEx*)surface;
+	EnterCriticalSection(&surface->lock);
+	for (size_t x = 0; x < ARRAYSIZE(ex->snapshots); x++)
+	{
+		rdpShadowSnapshot* snapshot = &ex->snapshots[x];
+		if ((snapshot->data == data) && (snapshot->users > 0))
+		{
+			snapshot->users--;
+			break;
+		}
+	}
+	LeaveCriticalSection(&surface->lock);
+}
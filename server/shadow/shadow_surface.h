@@ -39,6 +39,13 @@ extern "C"
 	WINPR_ATTR_NODISCARD BOOL shadow_surface_resize(rdpShadowSurface* surface, UINT16 x, UINT16 y,
 	                                                UINT32 width, UINT32 height);
 
+	/** Returns a copy of the surface for the given frame, shared with the other clients of
+	 *  that frame. Must be called with the surface locked, returns nullptr if no copy is
+	 *  available. */
+	WINPR_ATTR_NODISCARD BYTE* shadow_surface_snapshot_acquire(rdpShadowSurface* surface,
+	                                                           UINT32 frame);
+	void shadow_surface_snapshot_release(rdpShadowSurface* surface, const BYTE* data);
+
 #ifdef __cplusplus
 }
 #endif
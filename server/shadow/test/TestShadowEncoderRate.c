@@ -0,0 +1,229 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Shadow encoder rate control unit test
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+
+#include <winpr/crt.h>
+
+#include <freerdp/channels/rdpgfx.h>
+
+#include "../shadow_encoder.h"
+
+#define TEST_MS (1000ULL * 1000ULL)
+#define TEST_FRAME_INTERVAL (33ULL * TEST_MS)
+#define TEST_FRAME_BYTES 20000
+#define TEST_BIT_RATE 10000000
+#define TEST_QP 22
+
+/* Frames in flight, acknowledged by a simulated client after a given latency */
+typedef struct
+{
+	rdpShadowServer server;
+	rdpShadowEncoder encoder;
+	UINT64 now;
+	UINT32 pending[64];
+	UINT64 ackTime[64];
+	size_t head;
+	size_t count;
+	UINT32 backoffs;
+	UINT32 recoveries;
+	UINT64 lastRecovery;
+	UINT64 minRecoveryInterval;
+} TEST_LINK;
+
+static void test_link_init(TEST_LINK* link)
+{
+	memset(link, 0, sizeof(TEST_LINK));
+
+	link->server.h264BitRate = TEST_BIT_RATE;
+	link->server.h264QP = TEST_QP;
+	link->encoder.server = &link->server;
+	link->encoder.queueDepth = QUEUE_DEPTH_UNAVAILABLE;
+	link->encoder.fps = 16;
+	link->encoder.maxFps = 32;
+	link->encoder.bitRate = TEST_BIT_RATE;
+	link->encoder.qp = TEST_QP;
+	link->now = 1000ULL * TEST_MS;
+	link->minRecoveryInterval = UINT64_MAX;
+
+	shadow_encoder_rtt_sample(&link->encoder, 20ULL * TEST_MS);
+}
+
+static void test_link_track(TEST_LINK* link, UINT32 level)
+{
+	const rdpShadowEncoder* encoder = &link->encoder;
+
+	if (encoder->qualityLevel > level)
+		link->backoffs++;
+	else if (encoder->qualityLevel < level)
+	{
+		if (link->recoveries > 0)
+			link->minRecoveryInterval =
+			    MIN(link->minRecoveryInterval, link->now - link->lastRecovery);
+		link->recoveries++;
+		link->lastRecovery = link->now;
+	}
+}
+
+/* Runs the link for duration ns, frames are acknowledged after latency ns or never if 0 */
+static BOOL test_link_run(TEST_LINK* link, UINT64 duration, UINT64 latency)
+{
+	rdpShadowEncoder* encoder = &link->encoder;
+	const UINT64 end = link->now + duration;
+
+	for (; link->now < end; link->now += TEST_FRAME_INTERVAL)
+	{
+		while ((link->count > 0) && (link->ackTime[link->head] <= link->now))
+		{
+			const UINT32 level = encoder->qualityLevel;
+			shadow_encoder_frame_acknowledged_at(encoder, link->pending[link->head], link->now);
+			test_link_track(link, level);
+			link->head = (link->head + 1) % ARRAYSIZE(link->pending);
+			link->count--;
+		}
+
+		const UINT32 level = encoder->qualityLevel;
+		const UINT32 frameId = shadow_encoder_create_frame_id_at(encoder, link->now);
+		test_link_track(link, level);
+		shadow_encoder_add_frame_bytes(encoder, frameId, TEST_FRAME_BYTES);
+
+		if (latency == 0)
+			continue;
+		if (link->count >= ARRAYSIZE(link->pending))
+			return FALSE;
+
+		const size_t tail = (link->head + link->count++) % ARRAYSIZE(link->pending);
+		link->pending[tail] = frameId;
+		link->ackTime[tail] = link->now + latency;
+	}
+
+	return TRUE;
+}
+
+/* Acknowledges within the round trip time let the frame rate grow to its maximum */
+static BOOL test_healthy(void)
+{
+	TEST_LINK link;
+	test_link_init(&link);
+
+	if (!test_link_run(&link, 2000ULL * TEST_MS, 30ULL * TEST_MS))
+		return FALSE;
+
+	return (link.encoder.fps == link.encoder.maxFps) && (link.encoder.qualityLevel == 0) &&
+	       (link.backoffs == 0) && (link.encoder.bitRate == TEST_BIT_RATE) &&
+	       (link.encoder.qp == TEST_QP);
+}
+
+/* Late acknowledges back off multiplicatively, at most once per latency budget, then recover
+ * one quality level per recovery interval */
+static BOOL test_backoff_and_recovery(void)
+{
+	TEST_LINK link;
+	test_link_init(&link);
+
+	if (!test_link_run(&link, 1000ULL * TEST_MS, 30ULL * TEST_MS))
+		return FALSE;
+	const UINT32 healthyFps = link.encoder.fps;
+
+	if (!test_link_run(&link, 500ULL * TEST_MS, 400ULL * TEST_MS))
+		return FALSE;
+
+	/* 500 ms with a latency budget of 100 ms allow at most 5 (+1 at the boundary) steps */
+	if ((link.backoffs == 0) || (link.backoffs > 6) || (link.encoder.fps >= healthyFps) ||
+	    (link.encoder.bitRate >= TEST_BIT_RATE) || (link.encoder.qp <= TEST_QP))
+	{
+		(void)fprintf(stderr, "no backoff: %" PRIu32 " steps, %" PRIu32 " fps\n", link.backoffs,
+		              link.encoder.fps);
+		return FALSE;
+	}
+
+	/* Acknowledges of frames sent before still arrive late, so it backs off further first */
+	if (!test_link_run(&link, 15000ULL * TEST_MS, 30ULL * TEST_MS))
+		return FALSE;
+
+	if ((link.recoveries != link.backoffs) || (link.minRecoveryInterval < 1000ULL * TEST_MS) ||
+	    (link.encoder.qualityLevel != 0) || (link.encoder.fps != link.encoder.maxFps) ||
+	    (link.encoder.bitRate != TEST_BIT_RATE) || (link.encoder.qp != TEST_QP))
+	{
+		(void)fprintf(stderr,
+		              "no recovery: %" PRIu32 " of %" PRIu32 " steps, quality level %" PRIu32
+		              ", %" PRIu32 " fps\n",
+		              link.recoveries, link.backoffs, link.encoder.qualityLevel, link.encoder.fps);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/* Acknowledges stopping completely is congestion as well */
+static BOOL test_stalled(void)
+{
+	TEST_LINK link;
+	test_link_init(&link);
+
+	if (!test_link_run(&link, 1000ULL * TEST_MS, 30ULL * TEST_MS))
+		return FALSE;
+	const UINT32 healthyFps = link.encoder.fps;
+
+	if (!test_link_run(&link, 1000ULL * TEST_MS, 0))
+		return FALSE;
+
+	return (link.backoffs > 0) && (link.encoder.fps < healthyFps) &&
+	       (link.encoder.qualityLevel == SHADOW_ENCODER_MAX_QUALITY_LEVEL);
+}
+
+/* The bit rate of a congested link does not exceed the acknowledged delivery rate */
+static BOOL test_delivery_rate(void)
+{
+	TEST_LINK link;
+	test_link_init(&link);
+
+	if (!test_link_run(&link, 1000ULL * TEST_MS, 300ULL * TEST_MS))
+		return FALSE;
+
+	const UINT64 delivered = link.encoder.deliveryRate * 8ULL;
+	return (delivered > 0) && (link.encoder.bitRate <= MAX(delivered, TEST_BIT_RATE / 8));
+}
+
+int TestShadowEncoderRate(int argc, char* argv[])
+{
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	if (!test_healthy())
+	{
+		(void)fprintf(stderr, "healthy link did not reach the maximum frame rate\n");
+		return -1;
+	}
+
+	if (!test_backoff_and_recovery())
+		return -1;
+
+	if (!test_stalled())
+	{
+		(void)fprintf(stderr, "missing acknowledges did not back off\n");
+		return -1;
+	}
+
+	if (!test_delivery_rate())
+	{
+		(void)fprintf(stderr, "bit rate exceeds the delivery rate\n");
+		return -1;
+	}
+
+	return 0;
+}
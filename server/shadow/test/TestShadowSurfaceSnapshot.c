@@ -0,0 +1,143 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Shadow surface snapshot unit test
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+
+#include <winpr/crt.h>
+
+#include "../shadow_surface.h"
+
+#define TEST_WIDTH 64
+#define TEST_HEIGHT 48
+
+/* what a subsystem does when it captured a frame */
+static BOOL test_capture(rdpShadowSurface* surface, UINT16 left, UINT16 top, UINT16 right,
+                         UINT16 bottom, BYTE value, BOOL invalidate)
+{
+	const RECTANGLE_16 rect = { left, top, right, bottom };
+
+	for (UINT32 y = top; y < bottom; y++)
+		memset(&surface->data[1ull * y * surface->scanline + 4ull * left], value,
+		       4ull * (right - left));
+
+	region16_clear(&surface->invalidRegion);
+	if (!invalidate)
+		return TRUE;
+	return region16_union_rect(&surface->invalidRegion, &surface->invalidRegion, &rect);
+}
+
+static BOOL test_equal(const rdpShadowSurface* surface, const BYTE* snapshot)
+{
+	for (UINT32 y = 0; y < surface->height; y++)
+	{
+		const size_t offset = 1ull * y * surface->scanline;
+		if (memcmp(&surface->data[offset], &snapshot[offset], 4ull * surface->width) != 0)
+		{
+			(void)fprintf(stderr, "snapshot differs from the surface in line %" PRIu32 "\n", y);
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+static BYTE* test_acquire(rdpShadowSurface* surface, UINT32 frame)
+{
+	EnterCriticalSection(&surface->lock);
+	BYTE* snapshot = shadow_surface_snapshot_acquire(surface, frame);
+	LeaveCriticalSection(&surface->lock);
+	return snapshot;
+}
+
+int TestShadowSurfaceSnapshot(int argc, char* argv[])
+{
+	int rc = -1;
+	BYTE* a = nullptr;
+	BYTE* b = nullptr;
+	BYTE* c = nullptr;
+	BYTE* d = nullptr;
+	BYTE* saved = nullptr;
+
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	rdpShadowSurface* surface = shadow_surface_new(nullptr, 0, 0, TEST_WIDTH, TEST_HEIGHT);
+	if (!surface)
+		return -1;
+
+	const size_t size = 1ull * surface->scanline * surface->height;
+	saved = malloc(size);
+	if (!saved)
+		goto fail;
+
+	/* all clients of a frame share one copy */
+	if (!test_capture(surface, 0, 0, TEST_WIDTH, TEST_HEIGHT, 0x11, TRUE))
+		goto fail;
+	a = test_acquire(surface, 1);
+	b = test_acquire(surface, 1);
+	if (!a || (a != b) || !test_equal(surface, a))
+		goto fail;
+	shadow_surface_snapshot_release(surface, a);
+	shadow_surface_snapshot_release(surface, b);
+
+	/* once no client encodes from it the copy is refreshed with the changed area */
+	if (!test_capture(surface, 8, 4, 24, 20, 0x22, TRUE))
+		goto fail;
+	b = test_acquire(surface, 2);
+	if ((a != b) || !test_equal(surface, b))
+		goto fail;
+
+	/* a client still encodes the previous frame, the next one gets its own copy */
+	CopyMemory(saved, b, size);
+	if (!test_capture(surface, 30, 10, 60, 40, 0x33, TRUE))
+		goto fail;
+	c = test_acquire(surface, 3);
+	d = test_acquire(surface, 3);
+	if (!c || (c == b) || (c != d) || !test_equal(surface, c) || (memcmp(saved, b, size) != 0))
+		goto fail;
+
+	/* no third copy while both are in use, the caller encodes from the surface instead */
+	if (!test_capture(surface, 0, 0, 4, 4, 0x44, TRUE) || test_acquire(surface, 4))
+		goto fail;
+	shadow_surface_snapshot_release(surface, b);
+	shadow_surface_snapshot_release(surface, c);
+	shadow_surface_snapshot_release(surface, d);
+
+	/* frames no client took are not in the copy, refresh it completely */
+	if (!test_capture(surface, 40, 0, 64, 8, 0x55, FALSE))
+		goto fail;
+	a = test_acquire(surface, 6);
+	if (!a || !test_equal(surface, a))
+		goto fail;
+	shadow_surface_snapshot_release(surface, a);
+
+	/* a resized surface is copied completely */
+	if (!shadow_surface_resize(surface, 0, 0, TEST_WIDTH * 2, TEST_HEIGHT * 2) ||
+	    !test_capture(surface, 0, 0, TEST_WIDTH * 2, TEST_HEIGHT * 2, 0x66, FALSE))
+		goto fail;
+	a = test_acquire(surface, 7);
+	if (!a || !test_equal(surface, a))
+		goto fail;
+	shadow_surface_snapshot_release(surface, a);
+
+	rc = 0;
+fail:
+	if (rc != 0)
+		(void)fprintf(stderr, "%s failed\n", __func__);
+	free(saved);
+	shadow_surface_free(surface);
+	return rc;
+}
@@ -36,6 +36,17 @@ struct winpr_sam_entry
 };
 typedef struct winpr_sam_entry WINPR_SAM_ENTRY;
 
+/** @brief Resolves the hashes of a user instead of the SAM file.
+ *
+ *  \b User and \b Domain are UTF-8 and not necessarily '\0' terminated.
+ *
+ *  @return \b TRUE and the filled hashes if the user is known, \b FALSE otherwise
+ *  @since version 3.31.0
+ */
+typedef BOOL (*pSamCredentialProvider)(void* context, LPCSTR User, UINT32 UserLength,
+                                       LPCSTR Domain, UINT32 DomainLength, BYTE LmHash[16],
+                                       BYTE NtHash[16]);
+
 #ifdef __cplusplus
 extern "C"
 {
@@ -54,6 +65,15 @@ extern "C"
 
 	WINPR_API void SamClose(WINPR_SAM* sam);
 
+	/** @brief Installs a process wide credential provider used by all lookups instead of the
+	 *  SAM file. Pass \b nullptr to use the SAM file again.
+	 *
+	 *  @param provider The callback resolving the user hashes
+	 *  @param context A user defined pointer passed to the callback
+	 *  @since version 3.31.0
+	 */
+	WINPR_API void SamSetCredentialProvider(pSamCredentialProvider provider, void* context);
+
 	WINPR_ATTR_MALLOC(SamClose, 1)
 	WINPR_API WINPR_SAM* SamOpen(const char* filename, BOOL readOnly);
 
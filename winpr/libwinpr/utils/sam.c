@@ -30,6 +30,8 @@
 #include <winpr/cast.h>
 #include <winpr/print.h>
 #include <winpr/file.h>
+#include <winpr/synch.h>
+#include <winpr/collections.h>
 
 #include "../log.h"
 #include "../utils.h"
@@ -38,17 +40,47 @@
 #include <unistd.h>
 #endif
 
+#if !defined(_WIN32)
+#include <sys/stat.h>
+#endif
+
 #define TAG WINPR_TAG("utils")
 
+/* Number of SAM files kept indexed, all are dropped if more are in use */
+#define SAM_MAX_INDEXED_FILES 16
+
 struct winpr_sam
 {
 	FILE* fp;
+	char* filename;
 	char* line;
 	char* buffer;
 	char* context;
 	BOOL readOnly;
 };
 
+/* Identifies a version of a SAM file, the index is rebuilt when it changes */
+typedef struct
+{
+	UINT64 device;
+	UINT64 inode;
+	UINT64 mtime;
+	UINT64 ctime;
+	UINT64 size;
+} WINPR_SAM_STAMP;
+
+typedef struct
+{
+	WINPR_SAM_STAMP stamp;
+	wHashTable* entries; /* SamIndexKey -> WINPR_SAM_ENTRY */
+} WINPR_SAM_INDEX;
+
+static INIT_ONCE s_sam_once = INIT_ONCE_STATIC_INIT;
+static CRITICAL_SECTION s_sam_lock;
+static wHashTable* s_sam_indices = nullptr; /* filename -> WINPR_SAM_INDEX */
+static pSamCredentialProvider s_sam_provider = nullptr;
+static void* s_sam_provider_context = nullptr;
+
 static WINPR_SAM_ENTRY* SamEntryFromDataA(LPCSTR User, DWORD UserLength, LPCSTR Domain,
                                           DWORD DomainLength)
 {
@@ -89,6 +121,41 @@ static BOOL SamAreEntriesEqual(const WINPR_SAM_ENTRY* a, const WINPR_SAM_ENTRY*
 	return TRUE;
 }
 
+static BOOL CALLBACK SamInitialize(WINPR_ATTR_UNUSED PINIT_ONCE once,
+                                   WINPR_ATTR_UNUSED PVOID param,
+                                   WINPR_ATTR_UNUSED PVOID* context)
+{
+	InitializeCriticalSection(&s_sam_lock);
+	return TRUE;
+}
+
+static BOOL SamEnsureInitialized(void)
+{
+	return InitOnceExecuteOnce(&s_sam_once, SamInitialize, nullptr, nullptr);
+}
+
+static BOOL SamHasCredentialProvider(void)
+{
+	if (!SamEnsureInitialized())
+		return FALSE;
+
+	EnterCriticalSection(&s_sam_lock);
+	const BOOL rc = (s_sam_provider != nullptr);
+	LeaveCriticalSection(&s_sam_lock);
+	return rc;
+}
+
+void SamSetCredentialProvider(pSamCredentialProvider provider, void* context)
+{
+	if (!SamEnsureInitialized())
+		return;
+
+	EnterCriticalSection(&s_sam_lock);
+	s_sam_provider = provider;
+	s_sam_provider_context = context;
+	LeaveCriticalSection(&s_sam_lock);
+}
+
 WINPR_SAM* SamOpen(const char* filename, BOOL readOnly)
 {
 	FILE* fp = nullptr;
@@ -101,6 +168,9 @@ WINPR_SAM* SamOpen(const char* filename, BOOL readOnly)
 		filename = allocatedFileName;
 	}
 
+	if (!filename)
+		return nullptr;
+
 	if (readOnly)
 		fp = winpr_fopen(filename, "r");
 	else
@@ -110,28 +180,34 @@ WINPR_SAM* SamOpen(const char* filename, BOOL readOnly)
 		if (!fp)
 			fp = winpr_fopen(filename, "w+");
 	}
-	free(allocatedFileName);
-
-	if (fp)
-	{
-		sam = (WINPR_SAM*)calloc(1, sizeof(WINPR_SAM));
-
-		if (!sam)
-		{
-			(void)fclose(fp);
-			return nullptr;
-		}
 
-		sam->readOnly = readOnly;
-		sam->fp = fp;
-	}
-	else
+	/* A credential provider does not need the file at all */
+	if (!fp && !SamHasCredentialProvider())
 	{
 		WLog_DBG(TAG, "Could not open SAM file!");
+		free(allocatedFileName);
 		return nullptr;
 	}
 
+	sam = (WINPR_SAM*)calloc(1, sizeof(WINPR_SAM));
+	if (!sam)
+		goto fail;
+
+	sam->filename = allocatedFileName ? allocatedFileName : _strdup(filename);
+	allocatedFileName = nullptr;
+	if (!sam->filename)
+		goto fail;
+
+	sam->readOnly = readOnly;
+	sam->fp = fp;
 	return sam;
+
+fail:
+	if (fp)
+		(void)fclose(fp);
+	free(allocatedFileName);
+	free(sam);
+	return nullptr;
 }
 
 static BOOL SamLookupStart(WINPR_SAM* sam)
@@ -296,8 +372,8 @@ void SamResetEntry(WINPR_SAM_ENTRY* entry)
 	ZeroMemory(entry->NtHash, sizeof(entry->NtHash));
 }
 
-WINPR_SAM_ENTRY* SamLookupUserA(WINPR_SAM* sam, LPCSTR User, UINT32 UserLength, LPCSTR Domain,
-                                UINT32 DomainLength)
+static WINPR_SAM_ENTRY* SamLookupUserFile(WINPR_SAM* sam, LPCSTR User, UINT32 UserLength,
+                                          LPCSTR Domain, UINT32 DomainLength)
 {
 	size_t length = 0;
 	BOOL found = FALSE;
@@ -349,6 +425,302 @@ fail:
 	return entry;
 }
 
+static WINPR_SAM_ENTRY* SamCopyEntry(LPCSTR User, UINT32 UserLength, LPCSTR Domain,
+                                     UINT32 DomainLength, const BYTE* LmHash, const BYTE* NtHash)
+{
+	WINPR_SAM_ENTRY* entry = calloc(1, sizeof(WINPR_SAM_ENTRY));
+	if (!entry)
+		return nullptr;
+
+	if (User && (UserLength > 0))
+	{
+		entry->User = calloc(UserLength + 1ull, sizeof(char));
+		if (!entry->User)
+			goto fail;
+		memcpy(entry->User, User, UserLength);
+		entry->UserLength = UserLength;
+	}
+
+	if (Domain && (DomainLength > 0))
+	{
+		entry->Domain = calloc(DomainLength + 1ull, sizeof(char));
+		if (!entry->Domain)
+			goto fail;
+		memcpy(entry->Domain, Domain, DomainLength);
+		entry->DomainLength = DomainLength;
+	}
+
+	memcpy(entry->LmHash, LmHash, sizeof(entry->LmHash));
+	memcpy(entry->NtHash, NtHash, sizeof(entry->NtHash));
+	return entry;
+
+fail:
+	SamFreeEntry(nullptr, entry);
+	return nullptr;
+}
+
+static void SamIndexEntryFree(void* obj)
+{
+	SamFreeEntry(nullptr, obj);
+}
+
+static void SamIndexFree(void* obj)
+{
+	WINPR_SAM_INDEX* index = obj;
+	if (!index)
+		return;
+	HashTable_Free(index->entries);
+	free(index);
+}
+
+static wHashTable* SamIndexTableNew(OBJECT_FREE_FN fnValueFree)
+{
+	wHashTable* table = HashTable_New(FALSE);
+	if (!table)
+		return nullptr;
+
+	if (!HashTable_SetHashFunction(table, HashTable_StringHash))
+		goto fail;
+
+	wObject* obj = HashTable_KeyObject(table);
+	obj->fnObjectEquals = HashTable_StringCompare;
+	obj->fnObjectNew = winpr_ObjectStringClone;
+	obj->fnObjectFree = winpr_ObjectStringFree;
+
+	obj = HashTable_ValueObject(table);
+	obj->fnObjectFree = fnValueFree;
+	return table;
+
+fail:
+	HashTable_Free(table);
+	return nullptr;
+}
+
+/* The user length prefix keeps user and domain apart, the search may contain any character */
+static char* SamIndexKey(LPCSTR User, UINT32 UserLength, LPCSTR Domain, UINT32 DomainLength)
+{
+	char* key = nullptr;
+	size_t size = 0;
+
+	if (!User)
+		UserLength = 0;
+	if (!Domain)
+		DomainLength = 0;
+
+	winpr_asprintf(&key, &size, "%" PRIu32 ":%.*s%.*s", UserLength, (int)UserLength,
+	               User ? User : "", (int)DomainLength, Domain ? Domain : "");
+	return key;
+}
+
+static BOOL SamGetStamp(const char* filename, WINPR_SAM_STAMP* stamp)
+{
+	WINPR_ASSERT(stamp);
+
+	ZeroMemory(stamp, sizeof(*stamp));
+	if (!filename)
+		return FALSE;
+
+#if defined(_WIN32)
+	WIN32_FILE_ATTRIBUTE_DATA data = WINPR_C_ARRAY_INIT;
+	if (!GetFileAttributesExA(filename, GetFileExInfoStandard, &data))
+		return FALSE;
+
+	stamp->mtime = ((UINT64)data.ftLastWriteTime.dwHighDateTime << 32) |
+	               data.ftLastWriteTime.dwLowDateTime;
+	stamp->ctime =
+	    ((UINT64)data.ftCreationTime.dwHighDateTime << 32) | data.ftCreationTime.dwLowDateTime;
+	stamp->size = ((UINT64)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+#else
+	struct stat st = WINPR_C_ARRAY_INIT;
+	if (stat(filename, &st) != 0)
+		return FALSE;
+
+	stamp->device = (UINT64)st.st_dev;
+	stamp->inode = (UINT64)st.st_ino;
+	/* Rewrites within the same second must be detected, so take the nanoseconds as well */
+#if defined(__APPLE__)
+	const struct timespec mtim = st.st_mtimespec;
+	const struct timespec ctim = st.st_ctimespec;
+#else
+	const struct timespec mtim = st.st_mtim;
+	const struct timespec ctim = st.st_ctim;
+#endif
+	stamp->mtime = (UINT64)mtim.tv_sec * 1000000000ull + (UINT64)mtim.tv_nsec;
+	stamp->ctime = (UINT64)ctim.tv_sec * 1000000000ull + (UINT64)ctim.tv_nsec;
+	stamp->size = (UINT64)st.st_size;
+#endif
+	return TRUE;
+}
+
+static WINPR_SAM_INDEX* SamIndexLoad(const char* filename, const WINPR_SAM_STAMP* stamp)
+{
+	WINPR_SAM file = WINPR_C_ARRAY_INIT;
+	WINPR_SAM_ENTRY entry = WINPR_C_ARRAY_INIT;
+	WINPR_SAM_INDEX* index = calloc(1, sizeof(WINPR_SAM_INDEX));
+
+	if (!index)
+		return nullptr;
+
+	index->stamp = *stamp;
+	index->entries = SamIndexTableNew(SamIndexEntryFree);
+	if (!index->entries)
+		goto fail;
+
+	file.fp = winpr_fopen(filename, "r");
+	if (!file.fp)
+		goto fail;
+
+	/* An empty file is a valid, empty index */
+	if (SamLookupStart(&file))
+	{
+		while (file.line != nullptr)
+		{
+			if ((strlen(file.line) > 1) && (file.line[0] != '#'))
+			{
+				/* A direct lookup stops at the first broken line, so does the index */
+				if (!SamReadEntry(&file, &entry))
+				{
+					WLog_WARN(TAG, "Invalid SAM entry, ignoring the remainder of the file");
+					break;
+				}
+
+				char* key =
+				    SamIndexKey(entry.User, entry.UserLength, entry.Domain, entry.DomainLength);
+				if (!key)
+					goto fail_entry;
+
+				/* The first matching line wins */
+				if (!HashTable_Contains(index->entries, key))
+				{
+					WINPR_SAM_ENTRY* value =
+					    SamCopyEntry(entry.User, entry.UserLength, entry.Domain,
+					                 entry.DomainLength, entry.LmHash, entry.NtHash);
+					if (!value || !HashTable_Insert(index->entries, key, value))
+					{
+						SamFreeEntry(nullptr, value);
+						free(key);
+						goto fail_entry;
+					}
+				}
+				free(key);
+			}
+
+			SamResetEntry(&entry);
+			file.line = strtok_s(nullptr, "\n", &file.context);
+		}
+
+		SamResetEntry(&entry);
+		SamLookupFinish(&file);
+	}
+
+	(void)fclose(file.fp);
+	return index;
+
+fail_entry:
+	SamResetEntry(&entry);
+	SamLookupFinish(&file);
+fail:
+	if (file.fp)
+		(void)fclose(file.fp);
+	SamIndexFree(index);
+	return nullptr;
+}
+
+/* Returns the index of the SAM file, rebuilt if the file changed. Requires s_sam_lock */
+static WINPR_SAM_INDEX* SamIndexGet(const WINPR_SAM* sam)
+{
+	WINPR_SAM_STAMP stamp = WINPR_C_ARRAY_INIT;
+
+	WINPR_ASSERT(sam);
+
+	if (!SamGetStamp(sam->filename, &stamp))
+		return nullptr;
+
+	if (!s_sam_indices)
+	{
+		s_sam_indices = SamIndexTableNew(SamIndexFree);
+		if (!s_sam_indices)
+			return nullptr;
+	}
+
+	WINPR_SAM_INDEX* index = HashTable_GetItemValue(s_sam_indices, sam->filename);
+	if (index && (memcmp(&index->stamp, &stamp, sizeof(stamp)) == 0))
+		return index;
+
+	index = SamIndexLoad(sam->filename, &stamp);
+	if (!index)
+		return nullptr;
+
+	if (HashTable_Count(s_sam_indices) >= SAM_MAX_INDEXED_FILES)
+		HashTable_Clear(s_sam_indices);
+
+	(void)HashTable_Remove(s_sam_indices, sam->filename);
+	if (!HashTable_Insert(s_sam_indices, sam->filename, index))
+	{
+		SamIndexFree(index);
+		return nullptr;
+	}
+
+	return index;
+}
+
+static WINPR_SAM_ENTRY* SamLookupUserProvider(pSamCredentialProvider provider, void* context,
+                                              LPCSTR User, UINT32 UserLength, LPCSTR Domain,
+                                              UINT32 DomainLength)
+{
+	BYTE LmHash[16] = WINPR_C_ARRAY_INIT;
+	BYTE NtHash[16] = WINPR_C_ARRAY_INIT;
+
+	WINPR_ASSERT(provider);
+
+	if (!provider(context, User, UserLength, Domain, DomainLength, LmHash, NtHash))
+		return nullptr;
+
+	WINPR_SAM_ENTRY* entry = SamCopyEntry(User, UserLength, Domain, DomainLength, LmHash, NtHash);
+	SecureZeroMemory(LmHash, sizeof(LmHash));
+	SecureZeroMemory(NtHash, sizeof(NtHash));
+	return entry;
+}
+
+WINPR_SAM_ENTRY* SamLookupUserA(WINPR_SAM* sam, LPCSTR User, UINT32 UserLength, LPCSTR Domain,
+                                UINT32 DomainLength)
+{
+	WINPR_SAM_ENTRY* entry = nullptr;
+
+	if (!sam || !SamEnsureInitialized())
+		return nullptr;
+
+	EnterCriticalSection(&s_sam_lock);
+
+	/* The provider might block or call back into this module, it is called without the lock */
+	const pSamCredentialProvider provider = s_sam_provider;
+	void* context = s_sam_provider_context;
+
+	if (!provider)
+	{
+		WINPR_SAM_INDEX* index = SamIndexGet(sam);
+		if (!index)
+			entry = SamLookupUserFile(sam, User, UserLength, Domain, DomainLength);
+		else
+		{
+			char* key = SamIndexKey(User, UserLength, Domain, DomainLength);
+			const WINPR_SAM_ENTRY* cur = nullptr;
+			if (key)
+				cur = HashTable_GetItemValue(index->entries, key);
+			if (cur)
+				entry = SamCopyEntry(cur->User, cur->UserLength, cur->Domain, cur->DomainLength,
+				                     cur->LmHash, cur->NtHash);
+			free(key);
+		}
+	}
+
+	LeaveCriticalSection(&s_sam_lock);
+
+	if (provider)
+		entry = SamLookupUserProvider(provider, context, User, UserLength, Domain, DomainLength);
+	return entry;
+}
+
 WINPR_SAM_ENTRY* SamLookupUserW(WINPR_SAM* sam, LPCWSTR User, UINT32 UserLength, LPCWSTR Domain,
                                 UINT32 DomainLength)
 {
@@ -393,6 +765,7 @@ void SamClose(WINPR_SAM* sam)
 	{
 		if (sam->fp)
 			(void)fclose(sam->fp);
+		free(sam->filename);
 		free(sam);
 	}
 }
@@ -7,6 +7,8 @@
 #include <winpr/file.h>
 #include <winpr/crypto.h>
 #include <winpr/path.h>
+#include <winpr/synch.h>
+#include <winpr/thread.h>
 
 const char* sam_entries[] = {
 	"test1:::1910bd9285a6b8c9344d9f5cc74e0878:::",      /* test1, xxxxxx */
@@ -204,6 +206,62 @@ static char* prepare(void)
 	return tmp;
 }
 
+static BOOL append(const char* path, const char* entry)
+{
+	FILE* fp = fopen(path, "a");
+	if (!fp)
+		return FALSE;
+	(void)fprintf(fp, "%s\r\n", entry);
+	(void)fclose(fp);
+	return TRUE;
+}
+
+/* Rewrites the file with the same size and inode, only the modification time changes */
+static BOOL rewrite(const char* path, const char* entry)
+{
+	FILE* fp = fopen(path, "w");
+	if (!fp)
+		return FALSE;
+	for (size_t x = 0; x < ARRAYSIZE(sam_entries); x++)
+		(void)fprintf(fp, "%s\r\n", sam_entries[x]);
+	(void)fprintf(fp, "%s\r\n", entry);
+	(void)fclose(fp);
+	return TRUE;
+}
+
+static BOOL provider(void* context, LPCSTR User, UINT32 UserLength, LPCSTR Domain,
+                     UINT32 DomainLength, BYTE LmHash[16], BYTE NtHash[16]);
+
+static DWORD WINAPI provider_thread(LPVOID arg)
+{
+	SamSetCredentialProvider(provider, arg);
+	return 0;
+}
+
+static BOOL provider(void* context, LPCSTR User, UINT32 UserLength,
+                     WINPR_ATTR_UNUSED LPCSTR Domain, WINPR_ATTR_UNUSED UINT32 DomainLength,
+                     BYTE LmHash[16], BYTE NtHash[16])
+{
+	if ((UserLength != 8) || (strncmp(User, "provided", UserLength) != 0))
+		return FALSE;
+
+	/* The provider is called without the SAM lock, other threads may use the module */
+	if (context)
+	{
+		HANDLE thread = CreateThread(nullptr, 0, provider_thread, context, 0, nullptr);
+		if (!thread)
+			return FALSE;
+		const DWORD status = WaitForSingleObject(thread, 5000);
+		(void)CloseHandle(thread);
+		if (status != WAIT_OBJECT_0)
+			return FALSE;
+	}
+
+	memcpy(LmHash, hashes[2].LmHash, sizeof(hashes[2].LmHash));
+	memcpy(NtHash, hashes[2].NtHash, sizeof(hashes[2].NtHash));
+	return TRUE;
+}
+
 int TestSAM(WINPR_ATTR_UNUSED int argc, WINPR_ATTR_UNUSED char* argv[])
 {
 	int res = -1;
@@ -229,6 +287,31 @@ int TestSAM(WINPR_ATTR_UNUSED int argc, WINPR_ATTR_UNUSED char* argv[])
 	if (!test(sam, "test1", nullptr, "xxxxxxe", FALSE))
 		goto fail;
 
+	/* Entries added to the file are picked up by the next lookup */
+	if (!append(tmp, "test4:::1bfc28ca2a4c218b032f4a0309b31f20:::"))
+		goto fail;
+	if (!test(sam, "test4", nullptr, "aaaaaabbbbbb", TRUE))
+		goto fail;
+	if (!test(sam, "test1", nullptr, "xxxxxx", TRUE))
+		goto fail;
+
+	/* A hash changed within the same second is picked up as well. The pause exceeds the
+	 * granularity of coarse file time stamps */
+	Sleep(20);
+	if (!rewrite(tmp, "test4:::1910bd9285a6b8c9344d9f5cc74e0878:::"))
+		goto fail;
+	if (!test(sam, "test4", nullptr, "xxxxxx", TRUE))
+		goto fail;
+
+	/* A credential provider replaces the file */
+	BOOL concurrent = TRUE;
+	SamSetCredentialProvider(provider, &concurrent);
+	const BOOL provided = test(sam, "provided", nullptr, "pppppppp", TRUE) &&
+	                      test(sam, "test1", nullptr, "xxxxxx", FALSE);
+	SamSetCredentialProvider(nullptr, nullptr);
+	if (!provided)
+		goto fail;
+
 	res = 0;
 fail:
 	SamClose(sam);